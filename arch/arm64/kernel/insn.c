@@ -635,6 +635,78 @@ u32 aarch64_insn_gen_load_store_reg(enum aarch64_insn_register reg,
 					    offset);
 }
 
+/*
+ * Load/store with an immediate offset: either unsigned and scaled by the
+ * access size (imm12), or signed and unscaled (imm9). Offsets that fit
+ * neither form return AARCH64_BREAK_FAULT without complaint, so callers
+ * may probe and fall back to a register offset.
+ */
+u32 aarch64_insn_gen_load_store_imm(enum aarch64_insn_register reg,
+				    enum aarch64_insn_register base,
+				    int imm,
+				    enum aarch64_insn_size_type size,
+				    enum aarch64_insn_ldst_type type)
+{
+	enum aarch64_insn_imm_type imm_type;
+	u32 insn;
+	int shift;
+
+	switch (size) {
+	case AARCH64_INSN_SIZE_8:
+		shift = 0;
+		break;
+	case AARCH64_INSN_SIZE_16:
+		shift = 1;
+		break;
+	case AARCH64_INSN_SIZE_32:
+		shift = 2;
+		break;
+	case AARCH64_INSN_SIZE_64:
+		shift = 3;
+		break;
+	default:
+		pr_err("%s: unknown size encoding %d\n", __func__, size);
+		return AARCH64_BREAK_FAULT;
+	}
+
+	switch (type) {
+	case AARCH64_INSN_LDST_LOAD_IMM_OFFSET:
+	case AARCH64_INSN_LDST_STORE_IMM_OFFSET:
+		if (imm < 0 || imm & ((1 << shift) - 1) ||
+		    (imm >> shift) > 0xfff)
+			return AARCH64_BREAK_FAULT;
+		imm >>= shift;
+		imm_type = AARCH64_INSN_IMM_12;
+		if (type == AARCH64_INSN_LDST_LOAD_IMM_OFFSET)
+			insn = aarch64_insn_get_ldr_imm_value();
+		else
+			insn = aarch64_insn_get_str_imm_value();
+		break;
+	case AARCH64_INSN_LDST_LOAD_UNSCALED_IMM:
+	case AARCH64_INSN_LDST_STORE_UNSCALED_IMM:
+		if (imm < -256 || imm > 255)
+			return AARCH64_BREAK_FAULT;
+		imm_type = AARCH64_INSN_IMM_9;
+		if (type == AARCH64_INSN_LDST_LOAD_UNSCALED_IMM)
+			insn = aarch64_insn_get_ldur_value();
+		else
+			insn = aarch64_insn_get_stur_value();
+		break;
+	default:
+		pr_err("%s: unknown load/store encoding %d\n", __func__, type);
+		return AARCH64_BREAK_FAULT;
+	}
+
+	insn = aarch64_insn_encode_ldst_size(size, insn);
+
+	insn = aarch64_insn_encode_register(AARCH64_INSN_REGTYPE_RT, insn, reg);
+
+	insn = aarch64_insn_encode_register(AARCH64_INSN_REGTYPE_RN, insn,
+					    base);
+
+	return aarch64_insn_encode_immediate(imm_type, insn, imm);
+}
+
 u32 aarch64_insn_gen_load_store_pair(enum aarch64_insn_register reg1,
 				     enum aarch64_insn_register reg2,
 				     enum aarch64_insn_register base,
@@ -1458,7 +1530,8 @@ static u32 aarch64_encode_immediate(u64 imm,
 
 	switch (variant) {
 	case AARCH64_INSN_VARIANT_32BIT:
-		if (upper_32_bits(imm))
+		/* Nor full ones of the 32-bit register */
+		if (upper_32_bits(imm) || imm == U32_MAX)
 			return AARCH64_BREAK_FAULT;
 		esz = 32;
 		break;
@@ -76,6 +76,27 @@
 #define A64_LDR32(Wt, Xn, Xm) A64_LS_REG(Wt, Xn, Xm, 32, LOAD)
 #define A64_STR64(Xt, Xn, Xm) A64_LS_REG(Xt, Xn, Xm, 64, STORE)
 #define A64_LDR64(Xt, Xn, Xm) A64_LS_REG(Xt, Xn, Xm, 64, LOAD)
+/* As above, size is AARCH64_INSN_SIZE_* */
+#define A64_LDR_R(size, Rt, Rn, Rm) \
+	aarch64_insn_gen_load_store_reg(Rt, Rn, Rm, size, \
+		AARCH64_INSN_LDST_LOAD_REG_OFFSET)
+#define A64_STR_R(size, Rt, Rn, Rm) \
+	aarch64_insn_gen_load_store_reg(Rt, Rn, Rm, size, \
+		AARCH64_INSN_LDST_STORE_REG_OFFSET)
+
+/*
+ * Load/store register (immediate offset), size is AARCH64_INSN_SIZE_*.
+ * Return AARCH64_BREAK_FAULT if the offset cannot be encoded.
+ */
+#define A64_LS_IMM(Rt, Rn, imm, size, type) \
+	aarch64_insn_gen_load_store_imm(Rt, Rn, imm, size, \
+		AARCH64_INSN_LDST_##type)
+/* Rt = Rn[imm]; imm = k * (1 << size) where 0 <= k < 4096 */
+#define A64_LDR_I(size, Rt, Rn, imm)  A64_LS_IMM(Rt, Rn, imm, size, LOAD_IMM_OFFSET)
+#define A64_STR_I(size, Rt, Rn, imm)  A64_LS_IMM(Rt, Rn, imm, size, STORE_IMM_OFFSET)
+/* Rt = Rn[imm]; -256 <= imm < 256 */
+#define A64_LDUR(size, Rt, Rn, imm)   A64_LS_IMM(Rt, Rn, imm, size, LOAD_UNSCALED_IMM)
+#define A64_STUR(size, Rt, Rn, imm)   A64_LS_IMM(Rt, Rn, imm, size, STORE_UNSCALED_IMM)
 
 /* Load/store register pair */
 #define A64_LS_PAIR(Rt, Rt2, Rn, offset, ls, type) \
@@ -107,6 +128,14 @@
 /* Rd = Rn OP imm12 */
 #define A64_ADD_I(sf, Rd, Rn, imm12) A64_ADDSUB_IMM(sf, Rd, Rn, imm12, ADD)
 #define A64_SUB_I(sf, Rd, Rn, imm12) A64_ADDSUB_IMM(sf, Rd, Rn, imm12, SUB)
+#define A64_ADDS_I(sf, Rd, Rn, imm12) \
+	A64_ADDSUB_IMM(sf, Rd, Rn, imm12, ADD_SETFLAGS)
+#define A64_SUBS_I(sf, Rd, Rn, imm12) \
+	A64_ADDSUB_IMM(sf, Rd, Rn, imm12, SUB_SETFLAGS)
+/* Rn + imm12; set condition flags */
+#define A64_CMN_I(sf, Rn, imm12) A64_ADDS_I(sf, A64_ZR, Rn, imm12)
+/* Rn - imm12; set condition flags */
+#define A64_CMP_I(sf, Rn, imm12) A64_SUBS_I(sf, A64_ZR, Rn, imm12)
 /* Rd = Rn */
 #define A64_MOV(sf, Rd, Rn) A64_ADD_I(sf, Rd, Rn, 0)
 
@@ -193,4 +222,21 @@
 /* Rn & Rm; set condition flags */
 #define A64_TST(sf, Rn, Rm) A64_ANDS(sf, A64_ZR, Rn, Rm)
 
+/*
+ * Logical (immediate), imm is sign extended for 64-bit operations.
+ * Return AARCH64_BREAK_FAULT if imm is not a valid bitmask immediate.
+ */
+#define A64_LOGIC_IMM(sf, Rd, Rn, imm, type) ({ \
+	u64 __imm = (sf) ? (u64)(s64)(imm) : (u64)(u32)(imm); \
+	aarch64_insn_gen_logical_immediate(AARCH64_INSN_LOGIC_##type, \
+		A64_VARIANT(sf), Rn, Rd, __imm); \
+})
+/* Rd = Rn OP imm */
+#define A64_AND_I(sf, Rd, Rn, imm)  A64_LOGIC_IMM(sf, Rd, Rn, imm, AND)
+#define A64_ORR_I(sf, Rd, Rn, imm)  A64_LOGIC_IMM(sf, Rd, Rn, imm, ORR)
+#define A64_EOR_I(sf, Rd, Rn, imm)  A64_LOGIC_IMM(sf, Rd, Rn, imm, EOR)
+#define A64_ANDS_I(sf, Rd, Rn, imm) A64_LOGIC_IMM(sf, Rd, Rn, imm, AND_SETFLAGS)
+/* Rn & imm; set condition flags */
+#define A64_TST_I(sf, Rn, imm) A64_ANDS_I(sf, A64_ZR, Rn, imm)
+
 #endif /* _BPF_JIT_H */
@@ -21,12 +21,14 @@
 #include <linux/bpf.h>
 #include <linux/filter.h>
 #include <linux/printk.h>
+#include <linux/sizes.h>
 #include <linux/slab.h>
 
 #include <asm/byteorder.h>
 #include <asm/cacheflush.h>
 #include <asm/debug-monitors.h>
 #include <asm/set_memory.h>
+#include <asm/stacktrace.h>
 
 #include "bpf_jit.h"
 
@@ -69,6 +71,11 @@ struct jit_ctx {
 	int *offset;
 	__le32 *image;
 	u32 stack_size;
+	/* callee-saved A64 registers the prologue pushes, in order */
+	u8 saved_regs[6];
+	int nr_saved_regs;
+	bool fp_used;
+	bool tail_call;
 };
 
 static inline void emit(const u32 insn, struct jit_ctx *ctx)
@@ -84,6 +91,16 @@ static inline void emit_a64_mov_i(const int is64, const int reg,
 {
 	u16 hi = val >> 16;
 	u16 lo = val & 0xffff;
+	u32 insn;
+
+	/* Rather than MOVN/MOVZ plus MOVK, a bitmask takes a single ORR */
+	if ((hi & 0x8000) ? (hi != 0xffff && lo != 0xffff) : hi) {
+		insn = A64_ORR_I(is64, reg, A64_ZR, val);
+		if (insn != AARCH64_BREAK_FAULT) {
+			emit(insn, ctx);
+			return;
+		}
+	}
 
 	if (hi & 0x8000) {
 		if (hi == 0xffff) {
@@ -114,11 +131,19 @@ static inline void emit_a64_mov_i64(const int reg, const u64 val,
 	u64 nrm_tmp = val, rev_tmp = ~val;
 	bool inverse;
 	int shift;
+	u32 insn;
 
 	if (!(nrm_tmp >> 32))
 		return emit_a64_mov_i(0, reg, (u32)val, ctx);
 
 	inverse = i64_i16_blocks(nrm_tmp, true) < i64_i16_blocks(nrm_tmp, false);
+	if (i64_i16_blocks(nrm_tmp, inverse) > 1) {
+		insn = A64_ORR_I(1, reg, A64_ZR, val);
+		if (insn != AARCH64_BREAK_FAULT) {
+			emit(insn, ctx);
+			return;
+		}
+	}
 	shift = max(round_down((inverse ? (fls64(rev_tmp) - 1) :
 					  (fls64(nrm_tmp) - 1)), 16), 0);
 	if (inverse)
@@ -153,6 +178,63 @@ static inline void emit_addr_mov_i64(const int reg, const u64 val,
 	}
 }
 
+/* Fits the imm12 of ADD/SUB, optionally shifted left by 12 */
+static inline bool is_addsub_imm(u32 imm)
+{
+	return !(imm & ~0xfff) || !(imm & ~0xfff000);
+}
+
+/* Rd = Rn + imm, with tmp holding imm if it does not fit an ADD or SUB */
+static void emit_a64_add_i(const bool is64, const int dst, const int src,
+			   const int tmp, const s32 imm, struct jit_ctx *ctx)
+{
+	if (is_addsub_imm(imm)) {
+		emit(A64_ADD_I(is64, dst, src, imm), ctx);
+	} else if (is_addsub_imm(-imm)) {
+		emit(A64_SUB_I(is64, dst, src, -imm), ctx);
+	} else {
+		emit_a64_mov_i(is64, tmp, imm, ctx);
+		emit(A64_ADD(is64, dst, src, tmp), ctx);
+	}
+}
+
+static inline int bpf2a64_size(const u8 code)
+{
+	switch (BPF_SIZE(code)) {
+	case BPF_B:
+		return AARCH64_INSN_SIZE_8;
+	case BPF_H:
+		return AARCH64_INSN_SIZE_16;
+	case BPF_W:
+		return AARCH64_INSN_SIZE_32;
+	default:
+		return AARCH64_INSN_SIZE_64;
+	}
+}
+
+/*
+ * Load or store reg at base + off. The offset goes into the instruction
+ * whenever possible, scaled or not, and only otherwise into tmp.
+ */
+static void emit_a64_ldst(const bool load, const int size, const int reg,
+			  const int base, const s16 off, const int tmp,
+			  struct jit_ctx *ctx)
+{
+	u32 insn;
+
+	insn = load ? A64_LDR_I(size, reg, base, off) :
+		      A64_STR_I(size, reg, base, off);
+	if (insn == AARCH64_BREAK_FAULT)
+		insn = load ? A64_LDUR(size, reg, base, off) :
+			      A64_STUR(size, reg, base, off);
+	if (insn == AARCH64_BREAK_FAULT) {
+		emit_a64_mov_i(1, tmp, off, ctx);
+		insn = load ? A64_LDR_R(size, reg, base, tmp) :
+			      A64_STR_R(size, reg, base, tmp);
+	}
+	emit(insn, ctx);
+}
+
 static inline int bpf2a64_offset(int bpf_to, int bpf_from,
 				 const struct jit_ctx *ctx)
 {
@@ -182,20 +264,56 @@ static inline int epilogue_offset(const struct jit_ctx *ctx)
 /* Stack must be multiples of 16B */
 #define STACK_ALIGN(sz) (((sz) + 15) & ~15)
 
-/* Tail call offset to jump into */
-#define PROLOGUE_OFFSET 7
+/*
+ * Tail call offset to jump into: an eBPF program starts by clearing the
+ * incoming tail_call_cnt, which a tail call passes in TMP_REG_1 instead.
+ */
+#define PROLOGUE_OFFSET 1
 
-static int build_prologue(struct jit_ctx *ctx, bool ebpf_from_cbpf)
+/*
+ * Find the callee-saved registers the program clobbers, only those are
+ * pushed by the prologue. BPF FP is only set up when the program uses
+ * it, and tail_call_cnt only kept when the program does tail calls.
+ */
+static void build_frame_layout(struct jit_ctx *ctx)
 {
+	static const int callee_saved[] = {
+		BPF_REG_6, BPF_REG_7, BPF_REG_8, BPF_REG_9, BPF_REG_FP,
+	};
 	const struct bpf_prog *prog = ctx->prog;
-	const u8 r6 = bpf2a64[BPF_REG_6];
-	const u8 r7 = bpf2a64[BPF_REG_7];
-	const u8 r8 = bpf2a64[BPF_REG_8];
-	const u8 r9 = bpf2a64[BPF_REG_9];
+	u32 used = 0;
+	int i;
+
+	for (i = 0; i < prog->len; i++) {
+		const struct bpf_insn *insn = &prog->insnsi[i];
+
+		/* Conservative: src_reg of pseudo calls and ld64 included */
+		used |= BIT(insn->dst_reg) | BIT(insn->src_reg);
+		if (insn->code == (BPF_JMP | BPF_TAIL_CALL))
+			ctx->tail_call = true;
+	}
+
+	ctx->nr_saved_regs = 0;
+	for (i = 0; i < ARRAY_SIZE(callee_saved); i++)
+		if (used & BIT(callee_saved[i]))
+			ctx->saved_regs[ctx->nr_saved_regs++] =
+				bpf2a64[callee_saved[i]];
+	if (ctx->tail_call)
+		ctx->saved_regs[ctx->nr_saved_regs++] = bpf2a64[TCALL_CNT];
+
+	ctx->fp_used = used & BIT(BPF_REG_FP);
+	ctx->stack_size = 0;
+	if (ctx->fp_used)
+		ctx->stack_size = STACK_ALIGN(prog->aux->stack_depth);
+}
+
+static void build_prologue(struct jit_ctx *ctx, bool ebpf_from_cbpf)
+{
 	const u8 fp = bpf2a64[BPF_REG_FP];
 	const u8 tcc = bpf2a64[TCALL_CNT];
-	const int idx0 = ctx->idx;
-	int cur_offset;
+	const u8 *regs = ctx->saved_regs;
+	const int n = ctx->nr_saved_regs;
+	int i;
 
 	/*
 	 * BPF prog stack layout
@@ -204,8 +322,9 @@ static int build_prologue(struct jit_ctx *ctx, bool ebpf_from_cbpf)
 	 * original A64_SP =>   0:+-----+ BPF prologue
 	 *                        |FP/LR|
 	 * current A64_FP =>  -16:+-----+
-	 *                        | ... | callee saved registers
-	 * BPF fp register => -64:+-----+ <= (BPF_FP)
+	 *                        | ... | callee saved registers in use,
+	 *                        |     | pairs padded with XZR
+	 * BPF fp register =>     +-----+ <= (BPF_FP)
 	 *                        |     |
 	 *                        | ... | BPF prog stack
 	 *                        |     |
@@ -220,39 +339,54 @@ static int build_prologue(struct jit_ctx *ctx, bool ebpf_from_cbpf)
 	 *
 	 */
 
+	/* Initialize tail_call_cnt, skipped by tail calls */
+	if (!ebpf_from_cbpf)
+		emit(A64_MOVZ(1, bpf2a64[TMP_REG_1], 0, 0), ctx);
+
 	/* Save FP and LR registers to stay align with ARM64 AAPCS */
 	emit(A64_PUSH(A64_FP, A64_LR, A64_SP), ctx);
 	emit(A64_MOV(1, A64_FP, A64_SP), ctx);
 
 	/* Save callee-saved registers */
-	emit(A64_PUSH(r6, r7, A64_SP), ctx);
-	emit(A64_PUSH(r8, r9, A64_SP), ctx);
-	emit(A64_PUSH(fp, tcc, A64_SP), ctx);
+	for (i = 0; i < n; i += 2)
+		emit(A64_PUSH(regs[i], i + 1 < n ? regs[i + 1] : A64_ZR,
+			      A64_SP), ctx);
+
+	if (ctx->tail_call)
+		emit(A64_MOV(1, tcc, bpf2a64[TMP_REG_1]), ctx);
+
+	if (!ctx->fp_used)
+		return;
 
 	/* Set up BPF prog stack base register */
 	emit(A64_MOV(1, fp, A64_SP), ctx);
 
-	if (!ebpf_from_cbpf) {
-		/* Initialize tail_call_cnt */
-		emit(A64_MOVZ(1, tcc, 0, 0), ctx);
+	/* Set up function call stack */
+	if (ctx->stack_size)
+		emit(A64_SUB_I(1, A64_SP, A64_SP, ctx->stack_size), ctx);
+}
 
-		cur_offset = ctx->idx - idx0;
-		if (cur_offset != PROLOGUE_OFFSET) {
-			pr_err_once("PROLOGUE_OFFSET = %d, expected %d!\n",
-				    cur_offset, PROLOGUE_OFFSET);
-			return -1;
-		}
-	}
+/* Undo the prologue, up to restoring FP/LR */
+static void build_frame_teardown(struct jit_ctx *ctx)
+{
+	const u8 *regs = ctx->saved_regs;
+	const int n = ctx->nr_saved_regs;
+	int i;
 
-	ctx->stack_size = STACK_ALIGN(prog->aux->stack_depth);
+	/* We're done with BPF stack */
+	if (ctx->stack_size)
+		emit(A64_ADD_I(1, A64_SP, A64_SP, ctx->stack_size), ctx);
 
-	/* Set up function call stack */
-	emit(A64_SUB_I(1, A64_SP, A64_SP, ctx->stack_size), ctx);
-	return 0;
+	/* Restore callee-saved registers */
+	for (i = round_up(n, 2) - 2; i >= 0; i -= 2)
+		emit(A64_POP(regs[i], i + 1 < n ? regs[i + 1] : A64_ZR,
+			     A64_SP), ctx);
+
+	/* Restore FP/LR registers */
+	emit(A64_POP(A64_FP, A64_LR, A64_SP), ctx);
 }
 
-static int out_offset = -1; /* initialized on the first pass of build_body() */
-static int emit_bpf_tail_call(struct jit_ctx *ctx)
+static void emit_bpf_tail_call(struct jit_ctx *ctx)
 {
 	/* bpf_tail_call(void *prog_ctx, struct bpf_array *array, u64 index) */
 	const u8 r2 = bpf2a64[BPF_REG_2];
@@ -261,28 +395,26 @@ static int emit_bpf_tail_call(struct jit_ctx *ctx)
 	const u8 tmp = bpf2a64[TMP_REG_1];
 	const u8 prg = bpf2a64[TMP_REG_2];
 	const u8 tcc = bpf2a64[TCALL_CNT];
-	const int idx0 = ctx->idx;
-#define cur_offset (ctx->idx - idx0)
-#define jmp_offset (out_offset - (cur_offset))
+	int out[3];
 	size_t off;
 
 	/* if (index >= array->map.max_entries)
 	 *     goto out;
 	 */
 	off = offsetof(struct bpf_array, map.max_entries);
-	emit_a64_mov_i64(tmp, off, ctx);
-	emit(A64_LDR32(tmp, r2, tmp), ctx);
+	emit_a64_ldst(true, AARCH64_INSN_SIZE_32, tmp, r2, off, tmp, ctx);
 	emit(A64_MOV(0, r3, r3), ctx);
 	emit(A64_CMP(0, r3, tmp), ctx);
-	emit(A64_B_(A64_COND_CS, jmp_offset), ctx);
+	out[0] = ctx->idx;
+	emit(A64_B_(A64_COND_CS, 0), ctx);
 
 	/* if (tail_call_cnt > MAX_TAIL_CALL_CNT)
 	 *     goto out;
 	 * tail_call_cnt++;
 	 */
-	emit_a64_mov_i64(tmp, MAX_TAIL_CALL_CNT, ctx);
-	emit(A64_CMP(1, tcc, tmp), ctx);
-	emit(A64_B_(A64_COND_HI, jmp_offset), ctx);
+	emit(A64_CMP_I(1, tcc, MAX_TAIL_CALL_CNT), ctx);
+	out[1] = ctx->idx;
+	emit(A64_B_(A64_COND_HI, 0), ctx);
 	emit(A64_ADD_I(1, tcc, tcc, 1), ctx);
 
 	/* prog = array->ptrs[index];
@@ -290,54 +422,39 @@ static int emit_bpf_tail_call(struct jit_ctx *ctx)
 	 *     goto out;
 	 */
 	off = offsetof(struct bpf_array, ptrs);
-	emit_a64_mov_i64(tmp, off, ctx);
-	emit(A64_ADD(1, tmp, r2, tmp), ctx);
+	emit_a64_add_i(1, tmp, r2, tmp, off, ctx);
 	emit(A64_LSL(1, prg, r3, 3), ctx);
 	emit(A64_LDR64(prg, tmp, prg), ctx);
-	emit(A64_CBZ(1, prg, jmp_offset), ctx);
+	out[2] = ctx->idx;
+	emit(A64_CBZ(1, prg, 0), ctx);
 
-	/* goto *(prog->bpf_func + prologue_offset); */
+	/* tail_call_cnt goes to the target in TMP_REG_1, our own frame
+	 * is torn down, and the target's prologue sets up its own:
+	 * goto *(prog->bpf_func + prologue_offset);
+	 */
 	off = offsetof(struct bpf_prog, bpf_func);
-	emit_a64_mov_i64(tmp, off, ctx);
-	emit(A64_LDR64(tmp, prg, tmp), ctx);
-	emit(A64_ADD_I(1, tmp, tmp, sizeof(u32) * PROLOGUE_OFFSET), ctx);
-	emit(A64_ADD_I(1, A64_SP, A64_SP, ctx->stack_size), ctx);
-	emit(A64_BR(tmp), ctx);
-
-	/* out: */
-	if (out_offset == -1)
-		out_offset = cur_offset;
-	if (cur_offset != out_offset) {
-		pr_err_once("tail_call out_offset = %d, expected %d!\n",
-			    cur_offset, out_offset);
-		return -1;
+	emit_a64_ldst(true, AARCH64_INSN_SIZE_64, prg, prg, off, tmp, ctx);
+	emit(A64_ADD_I(1, prg, prg, sizeof(u32) * PROLOGUE_OFFSET), ctx);
+	emit(A64_MOV(1, tmp, tcc), ctx);
+	build_frame_teardown(ctx);
+	emit(A64_BR(prg), ctx);
+
+	/* out: now known, fix up the branches to it */
+	if (ctx->image) {
+		ctx->image[out[0]] = cpu_to_le32(A64_B_(A64_COND_CS,
+							ctx->idx - out[0]));
+		ctx->image[out[1]] = cpu_to_le32(A64_B_(A64_COND_HI,
+							ctx->idx - out[1]));
+		ctx->image[out[2]] = cpu_to_le32(A64_CBZ(1, prg,
+							 ctx->idx - out[2]));
 	}
-	return 0;
-#undef cur_offset
-#undef jmp_offset
 }
 
 static void build_epilogue(struct jit_ctx *ctx)
 {
 	const u8 r0 = bpf2a64[BPF_REG_0];
-	const u8 r6 = bpf2a64[BPF_REG_6];
-	const u8 r7 = bpf2a64[BPF_REG_7];
-	const u8 r8 = bpf2a64[BPF_REG_8];
-	const u8 r9 = bpf2a64[BPF_REG_9];
-	const u8 fp = bpf2a64[BPF_REG_FP];
 
-	/* We're done with BPF stack */
-	emit(A64_ADD_I(1, A64_SP, A64_SP, ctx->stack_size), ctx);
-
-	/* Restore fs (x25) and x26 */
-	emit(A64_POP(fp, A64_R(26), A64_SP), ctx);
-
-	/* Restore callee-saved register */
-	emit(A64_POP(r8, r9, A64_SP), ctx);
-	emit(A64_POP(r6, r7, A64_SP), ctx);
-
-	/* Restore FP/LR registers */
-	emit(A64_POP(A64_FP, A64_LR, A64_SP), ctx);
+	build_frame_teardown(ctx);
 
 	/* Set return value */
 	emit(A64_MOV(1, A64_R(0), r0), ctx);
@@ -364,8 +481,9 @@ static int build_insn(const struct bpf_insn *insn, struct jit_ctx *ctx)
 	const int i = insn - ctx->prog->insnsi;
 	const bool is64 = BPF_CLASS(code) == BPF_ALU64;
 	const bool isdw = BPF_SIZE(code) == BPF_DW;
-	u8 jmp_cond;
+	u8 jmp_cond, reg;
 	s32 jmp_offset;
+	u32 a64_insn;
 
 #define check_imm(bits, imm) do {				\
 	if ((((imm) > 0) && ((imm) >> (bits))) ||		\
@@ -489,28 +607,48 @@ emit_bswap_uxt:
 	/* dst = dst OP imm */
 	case BPF_ALU | BPF_ADD | BPF_K:
 	case BPF_ALU64 | BPF_ADD | BPF_K:
-		emit_a64_mov_i(is64, tmp, imm, ctx);
-		emit(A64_ADD(is64, dst, dst, tmp), ctx);
+		emit_a64_add_i(is64, dst, dst, tmp, imm, ctx);
 		break;
 	case BPF_ALU | BPF_SUB | BPF_K:
 	case BPF_ALU64 | BPF_SUB | BPF_K:
-		emit_a64_mov_i(is64, tmp, imm, ctx);
-		emit(A64_SUB(is64, dst, dst, tmp), ctx);
+		if (is_addsub_imm(imm)) {
+			emit(A64_SUB_I(is64, dst, dst, imm), ctx);
+		} else if (is_addsub_imm(-imm)) {
+			emit(A64_ADD_I(is64, dst, dst, -imm), ctx);
+		} else {
+			emit_a64_mov_i(is64, tmp, imm, ctx);
+			emit(A64_SUB(is64, dst, dst, tmp), ctx);
+		}
 		break;
 	case BPF_ALU | BPF_AND | BPF_K:
 	case BPF_ALU64 | BPF_AND | BPF_K:
-		emit_a64_mov_i(is64, tmp, imm, ctx);
-		emit(A64_AND(is64, dst, dst, tmp), ctx);
+		a64_insn = A64_AND_I(is64, dst, dst, imm);
+		if (a64_insn != AARCH64_BREAK_FAULT) {
+			emit(a64_insn, ctx);
+		} else {
+			emit_a64_mov_i(is64, tmp, imm, ctx);
+			emit(A64_AND(is64, dst, dst, tmp), ctx);
+		}
 		break;
 	case BPF_ALU | BPF_OR | BPF_K:
 	case BPF_ALU64 | BPF_OR | BPF_K:
-		emit_a64_mov_i(is64, tmp, imm, ctx);
-		emit(A64_ORR(is64, dst, dst, tmp), ctx);
+		a64_insn = A64_ORR_I(is64, dst, dst, imm);
+		if (a64_insn != AARCH64_BREAK_FAULT) {
+			emit(a64_insn, ctx);
+		} else {
+			emit_a64_mov_i(is64, tmp, imm, ctx);
+			emit(A64_ORR(is64, dst, dst, tmp), ctx);
+		}
 		break;
 	case BPF_ALU | BPF_XOR | BPF_K:
 	case BPF_ALU64 | BPF_XOR | BPF_K:
-		emit_a64_mov_i(is64, tmp, imm, ctx);
-		emit(A64_EOR(is64, dst, dst, tmp), ctx);
+		a64_insn = A64_EOR_I(is64, dst, dst, imm);
+		if (a64_insn != AARCH64_BREAK_FAULT) {
+			emit(a64_insn, ctx);
+		} else {
+			emit_a64_mov_i(is64, tmp, imm, ctx);
+			emit(A64_EOR(is64, dst, dst, tmp), ctx);
+		}
 		break;
 	case BPF_ALU | BPF_MUL | BPF_K:
 	case BPF_ALU64 | BPF_MUL | BPF_K:
@@ -614,12 +752,23 @@ emit_cond_jmp:
 	case BPF_JMP | BPF_JSLT | BPF_K:
 	case BPF_JMP | BPF_JSGE | BPF_K:
 	case BPF_JMP | BPF_JSLE | BPF_K:
-		emit_a64_mov_i(1, tmp, imm, ctx);
-		emit(A64_CMP(1, dst, tmp), ctx);
+		if (is_addsub_imm(imm)) {
+			emit(A64_CMP_I(1, dst, imm), ctx);
+		} else if (is_addsub_imm(-imm)) {
+			emit(A64_CMN_I(1, dst, -imm), ctx);
+		} else {
+			emit_a64_mov_i(1, tmp, imm, ctx);
+			emit(A64_CMP(1, dst, tmp), ctx);
+		}
 		goto emit_cond_jmp;
 	case BPF_JMP | BPF_JSET | BPF_K:
-		emit_a64_mov_i(1, tmp, imm, ctx);
-		emit(A64_TST(1, dst, tmp), ctx);
+		a64_insn = A64_TST_I(1, dst, imm);
+		if (a64_insn != AARCH64_BREAK_FAULT) {
+			emit(a64_insn, ctx);
+		} else {
+			emit_a64_mov_i(1, tmp, imm, ctx);
+			emit(A64_TST(1, dst, tmp), ctx);
+		}
 		goto emit_cond_jmp;
 	/* function call */
 	case BPF_JMP | BPF_CALL:
@@ -637,8 +786,7 @@ emit_cond_jmp:
 	}
 	/* tail call */
 	case BPF_JMP | BPF_TAIL_CALL:
-		if (emit_bpf_tail_call(ctx))
-			return -EFAULT;
+		emit_bpf_tail_call(ctx);
 		break;
 	/* function return */
 	case BPF_JMP | BPF_EXIT:
@@ -668,21 +816,7 @@ emit_cond_jmp:
 	case BPF_LDX | BPF_MEM | BPF_H:
 	case BPF_LDX | BPF_MEM | BPF_B:
 	case BPF_LDX | BPF_MEM | BPF_DW:
-		emit_a64_mov_i(1, tmp, off, ctx);
-		switch (BPF_SIZE(code)) {
-		case BPF_W:
-			emit(A64_LDR32(dst, src, tmp), ctx);
-			break;
-		case BPF_H:
-			emit(A64_LDRH(dst, src, tmp), ctx);
-			break;
-		case BPF_B:
-			emit(A64_LDRB(dst, src, tmp), ctx);
-			break;
-		case BPF_DW:
-			emit(A64_LDR64(dst, src, tmp), ctx);
-			break;
-		}
+		emit_a64_ldst(true, bpf2a64_size(code), dst, src, off, tmp, ctx);
 		break;
 
 	/* ST: *(size *)(dst + off) = imm */
@@ -690,22 +824,14 @@ emit_cond_jmp:
 	case BPF_ST | BPF_MEM | BPF_H:
 	case BPF_ST | BPF_MEM | BPF_B:
 	case BPF_ST | BPF_MEM | BPF_DW:
-		/* Load imm to a register then store it */
-		emit_a64_mov_i(1, tmp2, off, ctx);
-		emit_a64_mov_i(1, tmp, imm, ctx);
-		switch (BPF_SIZE(code)) {
-		case BPF_W:
-			emit(A64_STR32(tmp, dst, tmp2), ctx);
-			break;
-		case BPF_H:
-			emit(A64_STRH(tmp, dst, tmp2), ctx);
-			break;
-		case BPF_B:
-			emit(A64_STRB(tmp, dst, tmp2), ctx);
-			break;
-		case BPF_DW:
-			emit(A64_STR64(tmp, dst, tmp2), ctx);
-			break;
+		/* Load imm to a register then store it, zero comes free */
+		if (imm) {
+			emit_a64_mov_i(1, tmp, imm, ctx);
+			emit_a64_ldst(false, bpf2a64_size(code), tmp, dst, off,
+				      tmp2, ctx);
+		} else {
+			emit_a64_ldst(false, bpf2a64_size(code), A64_ZR, dst,
+				      off, tmp2, ctx);
 		}
 		break;
 
@@ -714,31 +840,21 @@ emit_cond_jmp:
 	case BPF_STX | BPF_MEM | BPF_H:
 	case BPF_STX | BPF_MEM | BPF_B:
 	case BPF_STX | BPF_MEM | BPF_DW:
-		emit_a64_mov_i(1, tmp, off, ctx);
-		switch (BPF_SIZE(code)) {
-		case BPF_W:
-			emit(A64_STR32(src, dst, tmp), ctx);
-			break;
-		case BPF_H:
-			emit(A64_STRH(src, dst, tmp), ctx);
-			break;
-		case BPF_B:
-			emit(A64_STRB(src, dst, tmp), ctx);
-			break;
-		case BPF_DW:
-			emit(A64_STR64(src, dst, tmp), ctx);
-			break;
-		}
+		emit_a64_ldst(false, bpf2a64_size(code), src, dst, off, tmp, ctx);
 		break;
 	/* STX XADD: lock *(u32 *)(dst + off) += src */
 	case BPF_STX | BPF_XADD | BPF_W:
 	/* STX XADD: lock *(u64 *)(dst + off) += src */
 	case BPF_STX | BPF_XADD | BPF_DW:
-		emit_a64_mov_i(1, tmp, off, ctx);
-		emit(A64_ADD(1, tmp, tmp, dst), ctx);
-		emit(A64_LDXR(isdw, tmp2, tmp), ctx);
+		if (off) {
+			emit_a64_add_i(1, tmp, dst, tmp, off, ctx);
+			reg = tmp;
+		} else {
+			reg = dst;
+		}
+		emit(A64_LDXR(isdw, tmp2, reg), ctx);
 		emit(A64_ADD(isdw, tmp2, tmp2, src), ctx);
-		emit(A64_STXR(isdw, tmp2, tmp, tmp3), ctx);
+		emit(A64_STXR(isdw, tmp2, reg, tmp3), ctx);
 		jmp_offset = -3;
 		check_imm19(jmp_offset);
 		emit(A64_CBNZ(0, tmp3, jmp_offset), ctx);
@@ -847,6 +963,7 @@ struct bpf_prog *bpf_int_jit_compile(struct bpf_prog *prog)
 	}
 	memset(&ctx, 0, sizeof(ctx));
 	ctx.prog = prog;
+	build_frame_layout(&ctx);
 
 	ctx.offset = kcalloc(prog->len, sizeof(int), GFP_KERNEL);
 	if (ctx.offset == NULL) {
@@ -862,10 +979,7 @@ struct bpf_prog *bpf_int_jit_compile(struct bpf_prog *prog)
 		goto out_off;
 	}
 
-	if (build_prologue(&ctx, was_classic)) {
-		prog = orig_prog;
-		goto out_off;
-	}
+	build_prologue(&ctx, was_classic);
 
 	ctx.epilogue_offset = ctx.idx;
 	build_epilogue(&ctx);
@@ -939,3 +1053,268 @@ out:
 					   tmp : orig_prog);
 	return prog;
 }
+
+#ifdef CONFIG_BPF_SYSCALL
+/*
+ * BPF trampoline image, branched to from the first instruction of the
+ * traced function with the caller's FP and LR still live:
+ *
+ *	stp	x29, x30, [sp, #-16]!
+ *	mov	x29, sp
+ *	sub	sp, sp, #TRAMP_FRAME_SIZE
+ *	<save x0-x8>
+ *	<fentry programs>
+ * without fexit programs:
+ *	<restore x0-x8>
+ *	add	sp, sp, #TRAMP_FRAME_SIZE
+ *	ldp	x29, x30, [sp], #16
+ *	<displaced instruction>
+ *	b	ip + 4
+ * with fexit programs:
+ *	__bpf_tramp_enter(im)
+ *	x9 = bpf_tramp_stack_args(caller's sp, caller's fp)
+ *	<restore x0-x8>
+ *	sub	sp, sp, #TRAMP_STACK_ARGS
+ *	<copy the caller's outgoing stack arguments>
+ *	bl	1f
+ *	add	sp, sp, #TRAMP_STACK_ARGS
+ *	<save x0-x1>
+ *	<fexit programs>
+ *	__bpf_tramp_exit(im)
+ *	<restore x0-x1>
+ *	add	sp, sp, #TRAMP_FRAME_SIZE
+ *	ldp	x29, x30, [sp], #16
+ *	ret
+ * 1:	<displaced instruction>
+ *	b	ip + 4
+ *
+ * The frame starts with the struct bpf_tracing_ctx the programs get.
+ *
+ * A function taking more than 8 register arguments finds the others at
+ * its sp on entry, which the image has moved: before calling it, the
+ * image copies the outgoing argument area of the caller, between the sp
+ * it branched with and the frame record its fp points to, up to
+ * TRAMP_STACK_ARGS bytes. Nothing is copied unless that fp is above the
+ * sp on the same stack: it is 0 in the first function called by
+ * ret_from_fork, and still points into the task stack after the switch
+ * to the IRQ stack.
+ */
+#define TRAMP_RET_OFF	(BPF_TRACING_MAX_ARGS * 8)
+/* x6-x8, not covered by bpf_tracing_ctx */
+#define TRAMP_REGS_OFF	(TRAMP_RET_OFF + 8)
+/* upper half of a 128-bit return value */
+#define TRAMP_X1_OFF	(TRAMP_REGS_OFF + 24)
+/* result of __bpf_prog_enter() */
+#define TRAMP_RUN_OFF	(TRAMP_X1_OFF + 8)
+#define TRAMP_FRAME_SIZE STACK_ALIGN(TRAMP_RUN_OFF + 8)
+/* stack arguments handed over to the function, 8 slots */
+#define TRAMP_STACK_ARGS	64
+
+static void tramp_call(struct jit_ctx *ctx, const void *func)
+{
+	emit_a64_mov_i64(A64_R(10), (u64)func, ctx);
+	emit(A64_BLR(A64_R(10)), ctx);
+}
+
+/* Save or restore the argument registers x0-x8 */
+static void tramp_ldst_args(struct jit_ctx *ctx, const bool load)
+{
+	int i, off;
+
+	for (i = 0; i <= 8; i++) {
+		const int reg = AARCH64_INSN_REG_0 + i;
+
+		off = i < BPF_TRACING_MAX_ARGS ? i * 8 :
+		      TRAMP_REGS_OFF + (i - BPF_TRACING_MAX_ARGS) * 8;
+		emit(load ? A64_LDR_I(AARCH64_INSN_SIZE_64, reg, A64_SP, off) :
+			    A64_STR_I(AARCH64_INSN_SIZE_64, reg, A64_SP, off),
+		     ctx);
+	}
+}
+
+/* Size of the outgoing argument area between @sp and the frame record @fp */
+static u64 notrace bpf_tramp_stack_args(unsigned long sp, unsigned long fp)
+{
+	struct stack_info info;
+
+	if (!fp || fp <= sp || !on_accessible_stack(current, sp, &info) ||
+	    fp > info.high)
+		return 0;
+	return min_t(unsigned long, fp - sp, TRAMP_STACK_ARGS);
+}
+
+/* x9 = bytes of stack arguments to copy, see bpf_tramp_stack_args() */
+static void tramp_size_stack_args(struct jit_ctx *ctx)
+{
+	emit(A64_ADD_I(1, A64_R(0), A64_FP, 16), ctx);
+	emit(A64_LDR_I(AARCH64_INSN_SIZE_64, A64_R(1), A64_FP, 0), ctx);
+	tramp_call(ctx, bpf_tramp_stack_args);
+	emit(A64_MOV(1, A64_R(9), A64_R(0)), ctx);
+}
+
+/* Copy x9 bytes of the caller's stack arguments below sp, keeps x0-x8 */
+static void tramp_copy_stack_args(struct jit_ctx *ctx)
+{
+	const u8 len = A64_R(9), src = A64_R(10), off = A64_R(11);
+	const u8 tmp = A64_R(12);
+
+	emit(A64_ADD_I(1, src, A64_FP, 16), ctx);
+	emit(A64_MOVZ(1, off, 0, 0), ctx);
+	emit(A64_CMP(1, off, len), ctx);
+	emit(A64_B_(A64_COND_CS, 5), ctx);
+	emit(A64_LDR64(tmp, src, off), ctx);
+	emit(A64_STR64(tmp, A64_SP, off), ctx);
+	emit(A64_ADD_I(1, off, off, 8), ctx);
+	emit(A64_B(-5), ctx);
+}
+
+static void tramp_run_progs(struct jit_ctx *ctx, struct bpf_prog **progs,
+			    const int nr)
+{
+	int i, skip;
+
+	tramp_call(ctx, __bpf_prog_enter);
+	emit(A64_STR_I(AARCH64_INSN_SIZE_64, A64_R(0), A64_SP, TRAMP_RUN_OFF),
+	     ctx);
+	/* recursion, fixed up below */
+	skip = ctx->idx;
+	emit(A64_CBZ(1, A64_R(0), 0), ctx);
+
+	for (i = 0; i < nr; i++) {
+		emit(A64_MOV(1, A64_R(0), A64_SP), ctx);
+		emit_a64_mov_i64(A64_R(1), (u64)progs[i]->insnsi, ctx);
+		tramp_call(ctx, progs[i]->bpf_func);
+	}
+
+	if (ctx->image)
+		ctx->image[skip] = cpu_to_le32(A64_CBZ(1, A64_R(0),
+						       ctx->idx - skip));
+	emit(A64_LDR_I(AARCH64_INSN_SIZE_64, A64_R(0), A64_SP, TRAMP_RUN_OFF),
+	     ctx);
+	tramp_call(ctx, __bpf_prog_exit);
+}
+
+static void build_trampoline(struct jit_ctx *ctx, struct bpf_tramp_image *im,
+			     const struct bpf_trampoline *tr)
+{
+	const int nr_fexit = im->nr_progs[BPF_TRAMP_FEXIT];
+	int call_orig = 0;
+
+	emit(A64_PUSH(A64_FP, A64_LR, A64_SP), ctx);
+	emit(A64_MOV(1, A64_FP, A64_SP), ctx);
+	emit(A64_SUB_I(1, A64_SP, A64_SP, TRAMP_FRAME_SIZE), ctx);
+	tramp_ldst_args(ctx, false);
+
+	if (im->nr_progs[BPF_TRAMP_FENTRY])
+		tramp_run_progs(ctx, im->progs[BPF_TRAMP_FENTRY],
+				im->nr_progs[BPF_TRAMP_FENTRY]);
+
+	if (nr_fexit) {
+		emit_a64_mov_i64(A64_R(0), (u64)im, ctx);
+		tramp_call(ctx, __bpf_tramp_enter);
+		tramp_size_stack_args(ctx);
+	}
+	tramp_ldst_args(ctx, true);
+
+	if (nr_fexit) {
+		emit(A64_SUB_I(1, A64_SP, A64_SP, TRAMP_STACK_ARGS), ctx);
+		tramp_copy_stack_args(ctx);
+		/* call the function, fixed up below */
+		call_orig = ctx->idx;
+		emit(A64_BL(0), ctx);
+		emit(A64_ADD_I(1, A64_SP, A64_SP, TRAMP_STACK_ARGS), ctx);
+		emit(A64_STR_I(AARCH64_INSN_SIZE_64, A64_R(0), A64_SP,
+			       TRAMP_RET_OFF), ctx);
+		emit(A64_STR_I(AARCH64_INSN_SIZE_64, A64_R(1), A64_SP,
+			       TRAMP_X1_OFF), ctx);
+
+		tramp_run_progs(ctx, im->progs[BPF_TRAMP_FEXIT], nr_fexit);
+
+		emit_a64_mov_i64(A64_R(0), (u64)im, ctx);
+		tramp_call(ctx, __bpf_tramp_exit);
+		emit(A64_LDR_I(AARCH64_INSN_SIZE_64, A64_R(0), A64_SP,
+			       TRAMP_RET_OFF), ctx);
+		emit(A64_LDR_I(AARCH64_INSN_SIZE_64, A64_R(1), A64_SP,
+			       TRAMP_X1_OFF), ctx);
+	}
+
+	emit(A64_ADD_I(1, A64_SP, A64_SP, TRAMP_FRAME_SIZE), ctx);
+	emit(A64_POP(A64_FP, A64_LR, A64_SP), ctx);
+
+	if (nr_fexit) {
+		emit(A64_RET(A64_LR), ctx);
+		if (ctx->image)
+			ctx->image[call_orig] =
+				cpu_to_le32(A64_BL(ctx->idx - call_orig));
+	}
+
+	emit(tr->orig_insn, ctx);
+	if (ctx->image)
+		emit(aarch64_insn_gen_branch_imm((unsigned long)&ctx->image[ctx->idx],
+						 tr->ip + AARCH64_INSN_SIZE,
+						 AARCH64_INSN_BRANCH_NOLINK),
+		     ctx);
+	else
+		emit(0, ctx);
+}
+
+int arch_prepare_bpf_trampoline(struct bpf_tramp_image *im,
+				struct bpf_trampoline *tr)
+{
+	long off = (long)im->image - (long)tr->ip;
+	struct jit_ctx ctx = { };
+	u32 insn;
+
+	/* both ways between the function and the image take a B */
+	if (off < -SZ_128M + PAGE_SIZE || off >= SZ_128M - PAGE_SIZE)
+		return -ERANGE;
+
+	if (!tr->cur_image) {
+		if (aarch64_insn_read((void *)tr->ip, &insn))
+			return -EFAULT;
+		/* the image runs the displaced instruction at another pc */
+		if (aarch64_insn_uses_literal(insn) ||
+		    aarch64_insn_is_branch(insn) ||
+		    aarch64_insn_is_exception(insn))
+			return -EOPNOTSUPP;
+		tr->orig_insn = insn;
+	}
+
+	build_trampoline(&ctx, im, tr);
+	if (ctx.idx * AARCH64_INSN_SIZE > PAGE_SIZE)
+		return -E2BIG;
+
+	ctx.image = im->image;
+	ctx.idx = 0;
+	build_trampoline(&ctx, im, tr);
+	if (validate_code(&ctx))
+		return -EINVAL;
+
+	bpf_flush_icache(ctx.image, ctx.image + ctx.idx);
+	return 0;
+}
+
+int arch_bpf_trampoline_patch(struct bpf_trampoline *tr, void *old_image,
+			      void *new_image)
+{
+	void *addr = (void *)tr->ip;
+	u32 old, new, cur;
+
+	old = old_image ? aarch64_insn_gen_branch_imm(tr->ip,
+						      (unsigned long)old_image,
+						      AARCH64_INSN_BRANCH_NOLINK) :
+			  tr->orig_insn;
+	new = new_image ? aarch64_insn_gen_branch_imm(tr->ip,
+						      (unsigned long)new_image,
+						      AARCH64_INSN_BRANCH_NOLINK) :
+			  tr->orig_insn;
+	if (new == AARCH64_BREAK_FAULT)
+		return -ERANGE;
+
+	/* a kprobe or another text patcher got there first */
+	if (aarch64_insn_read(addr, &cur) || cur != old)
+		return -EBUSY;
+
+	return aarch64_insn_patch_text(&addr, &new, 1);
+}
+#endif /* CONFIG_BPF_SYSCALL */
@@ -1739,6 +1739,10 @@ static int __do_execve_file(int fd, struct filename *filename,
 	if (retval)
 		goto out_ret;
 
+	retval = unshare_files_fdtable(current->files);
+	if (retval)
+		goto out_files;
+
 	retval = -ENOMEM;
 	bprm = kzalloc(sizeof(*bprm), GFP_KERNEL);
 	if (!bprm)
@@ -337,8 +337,7 @@ static long do_fcntl(int fd, unsigned int cmd, unsigned long arg,
 		err = get_close_on_exec(fd) ? FD_CLOEXEC : 0;
 		break;
 	case F_SETFD:
-		err = 0;
-		set_close_on_exec(fd, arg & FD_CLOEXEC);
+		err = set_close_on_exec(fd, arg & FD_CLOEXEC);
 		break;
 	case F_GETFL:
 		err = filp->f_flags;
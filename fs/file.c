@@ -11,10 +11,12 @@
 #include <linux/export.h>
 #include <linux/fs.h>
 #include <linux/mm.h>
+#include <linux/sched/coredump.h>
 #include <linux/sched/signal.h>
 #include <linux/slab.h>
 #include <linux/file.h>
 #include <linux/fdtable.h>
+#include <linux/vmalloc.h>
 #include <linux/bitops.h>
 #include <linux/spinlock.h>
 #include <linux/rcupdate.h>
@@ -38,6 +40,26 @@ static void free_fdtable_rcu(struct rcu_head *rcu)
 	__free_fdtable(container_of(rcu, struct fdtable, rcu));
 }
 
+/*
+ * Drop a files_struct's use of an fd table that is not embedded in it.
+ * A table that dup_fd() shared holds the references to its files for all
+ * of its users, the last one drops them.
+ */
+static void put_fdtable(struct fdtable *fdt)
+{
+	struct file *file;
+	unsigned int fd;
+
+	if (!atomic_dec_and_test(&fdt->count))
+		return;
+	for_each_set_bit(fd, fdt->open_fds, fdt->max_fds) {
+		file = rcu_dereference_raw(fdt->fd[fd]);
+		if (file)
+			fput(file);
+	}
+	call_rcu(&fdt->rcu, free_fdtable_rcu);
+}
+
 #define BITBIT_NR(nr)	BITS_TO_LONGS(BITS_TO_LONGS(nr))
 #define BITBIT_SIZE(nr)	(BITBIT_NR(nr) * sizeof(long))
 
@@ -82,44 +104,40 @@ static void copy_fdtable(struct fdtable *nfdt, struct fdtable *ofdt)
 	copy_fd_bitmaps(nfdt, ofdt, ofdt->max_fds);
 }
 
-static struct fdtable * alloc_fdtable(unsigned int nr)
+/*
+ * kvmalloc() does not take __GFP_NOFAIL: for a copy that cannot fail, try
+ * it without, then fall back to a vmalloc() that loops on each page.
+ */
+static void *fdtable_kvmalloc(size_t size, gfp_t gfp)
+{
+	void *p;
+
+	if (!(gfp & __GFP_NOFAIL))
+		return kvmalloc(size, gfp);
+	p = kvmalloc(size, gfp & ~__GFP_NOFAIL);
+	if (!p)
+		p = __vmalloc(size, gfp, PAGE_KERNEL);
+	return p;
+}
+
+static struct fdtable *__alloc_fdtable(unsigned int nr, gfp_t gfp)
 {
 	struct fdtable *fdt;
 	void *data;
 
-	/*
-	 * Figure out how many fds we actually want to support in this fdtable.
-	 * Allocation steps are keyed to the size of the fdarray, since it
-	 * grows far faster than any of the other dynamic data. We try to fit
-	 * the fdarray into comfortable page-tuned chunks: starting at 1024B
-	 * and growing in powers of two from there on.
-	 */
-	nr /= (1024 / sizeof(struct file *));
-	nr = roundup_pow_of_two(nr + 1);
-	nr *= (1024 / sizeof(struct file *));
-	/*
-	 * Note that this can drive nr *below* what we had passed if sysctl_nr_open
-	 * had been set lower between the check in expand_files() and here.  Deal
-	 * with that in caller, it's cheaper that way.
-	 *
-	 * We make sure that nr remains a multiple of BITS_PER_LONG - otherwise
-	 * bitmaps handling below becomes unpleasant, to put it mildly...
-	 */
-	if (unlikely(nr > sysctl_nr_open))
-		nr = ((sysctl_nr_open - 1) | (BITS_PER_LONG - 1)) + 1;
-
-	fdt = kmalloc(sizeof(struct fdtable), GFP_KERNEL_ACCOUNT);
+	fdt = kmalloc(sizeof(struct fdtable), gfp);
 	if (!fdt)
 		goto out;
 	fdt->max_fds = nr;
-	data = kvmalloc_array(nr, sizeof(struct file *), GFP_KERNEL_ACCOUNT);
+	atomic_set(&fdt->count, 1);
+	data = fdtable_kvmalloc(array_size(nr, sizeof(struct file *)), gfp);
 	if (!data)
 		goto out_fdt;
 	fdt->fd = data;
 
-	data = kvmalloc(max_t(size_t,
+	data = fdtable_kvmalloc(max_t(size_t,
 				 2 * nr / BITS_PER_BYTE + BITBIT_SIZE(nr), L1_CACHE_BYTES),
-				 GFP_KERNEL_ACCOUNT);
+				 gfp);
 	if (!data)
 		goto out_arr;
 	fdt->open_fds = data;
@@ -138,6 +156,32 @@ out:
 	return NULL;
 }
 
+static struct fdtable * alloc_fdtable(unsigned int nr)
+{
+	/*
+	 * Figure out how many fds we actually want to support in this fdtable.
+	 * Allocation steps are keyed to the size of the fdarray, since it
+	 * grows far faster than any of the other dynamic data. We try to fit
+	 * the fdarray into comfortable page-tuned chunks: starting at 1024B
+	 * and growing in powers of two from there on.
+	 */
+	nr /= (1024 / sizeof(struct file *));
+	nr = roundup_pow_of_two(nr + 1);
+	nr *= (1024 / sizeof(struct file *));
+	/*
+	 * Note that this can drive nr *below* what we had passed if sysctl_nr_open
+	 * had been set lower between the check in expand_files() and here.  Deal
+	 * with that in caller, it's cheaper that way.
+	 *
+	 * We make sure that nr remains a multiple of BITS_PER_LONG - otherwise
+	 * bitmaps handling below becomes unpleasant, to put it mildly...
+	 */
+	if (unlikely(nr > sysctl_nr_open))
+		nr = ((sysctl_nr_open - 1) | (BITS_PER_LONG - 1)) + 1;
+
+	return __alloc_fdtable(nr, GFP_KERNEL_ACCOUNT);
+}
+
 /*
  * Expand the file descriptor table.
  * This function will allocate a new fdtable and both fd array and fdset, of
@@ -182,10 +226,13 @@ static int expand_fdtable(struct files_struct *files, unsigned int nr)
 	return 1;
 }
 
+static int unshare_fdtable(struct files_struct *files, gfp_t gfp);
+
 /*
  * Expand files.
  * This function will expand the file structures, if the requested size exceeds
- * the current capacity and there is room for expansion.
+ * the current capacity and there is room for expansion.  A table shared since
+ * dup_fd() is copied first.
  * Return <0 error code on error; 0 when nothing done; 1 when files were
  * expanded and execution may have blocked.
  * The files->file_lock should be held on entry, and will be held on exit.
@@ -200,6 +247,13 @@ static int expand_files(struct files_struct *files, unsigned int nr)
 repeat:
 	fdt = files_fdtable(files);
 
+	if (unlikely(fdtable_shared(fdt))) {
+		expanded = unshare_fdtable(files, GFP_KERNEL_ACCOUNT);
+		if (expanded < 0)
+			return expanded;
+		goto repeat;
+	}
+
 	/* Do we need to expand? */
 	if (nr < fdt->max_fds)
 		return expanded;
@@ -264,6 +318,99 @@ static unsigned int count_open_files(struct fdtable *fdt)
 	return i;
 }
 
+/*
+ * Give files a table of its own in place of the one it shares with other
+ * files_structs since dup_fd(), with a reference to each of the files in
+ * it.  Callers that cannot fail pass __GFP_NOFAIL.
+ * Return <0 error code on error; 0 when the table was not shared; 1 when it
+ * was copied and execution may have blocked.
+ * The files->file_lock should be held on entry, and will be held on exit.
+ */
+static int unshare_fdtable(struct files_struct *files, gfp_t gfp)
+	__releases(files->file_lock)
+	__acquires(files->file_lock)
+{
+	struct fdtable *new_fdt, *cur_fdt;
+	struct file *file;
+	unsigned int fd;
+	int copied = 0;
+
+repeat:
+	cur_fdt = files_fdtable(files);
+	if (!fdtable_shared(cur_fdt))
+		return copied;
+
+	copied = 1;
+	if (unlikely(files->resize_in_progress)) {
+		spin_unlock(&files->file_lock);
+		wait_event(files->resize_wait, !files->resize_in_progress);
+		spin_lock(&files->file_lock);
+		goto repeat;
+	}
+
+	/*
+	 * No __fd_install() can be going on in a shared table: dup_fd() does
+	 * not share one with fds allocated but not installed yet, and
+	 * __alloc_fd() copies it before allocating.
+	 */
+	files->resize_in_progress = true;
+	spin_unlock(&files->file_lock);
+	new_fdt = __alloc_fdtable(cur_fdt->max_fds, gfp);
+	spin_lock(&files->file_lock);
+	files->resize_in_progress = false;
+	wake_up_all(&files->resize_wait);
+	if (!new_fdt)
+		return -ENOMEM;
+
+	copy_fdtable(new_fdt, cur_fdt);
+	for_each_set_bit(fd, new_fdt->open_fds, new_fdt->max_fds) {
+		file = rcu_dereference_raw(new_fdt->fd[fd]);
+		if (file)
+			get_file(file);
+	}
+	rcu_assign_pointer(files->fdt, new_fdt);
+	put_fdtable(cur_fdt);
+	return copied;
+}
+
+/*
+ * Copy the fd table of files if it is shared since dup_fd(), while the
+ * failure can still be reported: exec calls this before the point of no
+ * return, so that do_close_on_exec() finds a table of its own.
+ */
+int unshare_files_fdtable(struct files_struct *files)
+{
+	int err;
+
+	spin_lock(&files->file_lock);
+	err = unshare_fdtable(files, GFP_KERNEL_ACCOUNT);
+	spin_unlock(&files->file_lock);
+	return err < 0 ? err : 0;
+}
+
+/*
+ * dup_fd() can leave the new files_struct on the fd table of the old one
+ * until either changes it.  Only tables outside of the files_struct are
+ * shared that way, and not while a sibling thread may be between
+ * __alloc_fd() and fd_install() on it.
+ */
+static bool fdtable_can_share(struct files_struct *files, struct fdtable *fdt)
+{
+	unsigned int fd;
+
+	if (!current->mm ||
+	    !test_bit(MMF_FORK_LAZY_FILES, &current->mm->flags))
+		return false;
+	if (fdt == &files->fdtab || files->resize_in_progress)
+		return false;
+	if (atomic_read(&files->count) == 1)
+		return true;
+	for_each_set_bit(fd, fdt->open_fds, fdt->max_fds)
+		if (!rcu_access_pointer(fdt->fd[fd]))
+			return false;
+	return true;
+}
+
 /*
  * Allocate a new files structure and copy contents from the
  * passed in files structure.
@@ -293,9 +440,16 @@ struct files_struct *dup_fd(struct files_struct *oldf, int *errorp)
 	new_fdt->open_fds = newf->open_fds_init;
 	new_fdt->full_fds_bits = newf->full_fds_bits_init;
 	new_fdt->fd = &newf->fd_array[0];
+	atomic_set(&new_fdt->count, 1);
 
 	spin_lock(&oldf->file_lock);
 	old_fdt = files_fdtable(oldf);
+	if (fdtable_can_share(oldf, old_fdt)) {
+		atomic_inc(&old_fdt->count);
+		spin_unlock(&oldf->file_lock);
+		rcu_assign_pointer(newf->fdt, old_fdt);
+		return newf;
+	}
 	open_files = count_open_files(old_fdt);
 
 	/*
@@ -373,6 +527,7 @@ static struct fdtable *close_files(struct files_struct * files)
 	 * files structure.
 	 */
 	struct fdtable *fdt = rcu_dereference_raw(files->fdt);
+	bool shared = fdtable_shared(fdt);
 	unsigned int i, j = 0;
 
 	for (;;) {
@@ -383,9 +538,18 @@ static struct fdtable *close_files(struct files_struct * files)
 		set = fdt->open_fds[j++];
 		while (set) {
 			if (set & 1) {
-				struct file * file = xchg(&fdt->fd[i], NULL);
+				struct file * file;
+
+				/* the files of a shared table go with it */
+				if (shared)
+					file = rcu_dereference_raw(fdt->fd[i]);
+				else
+					file = xchg(&fdt->fd[i], NULL);
 				if (file) {
-					filp_close(file, files);
+					if (shared)
+						filp_flush(file, files);
+					else
+						filp_close(file, files);
 					cond_resched();
 				}
 			}
@@ -417,7 +581,7 @@ void put_files_struct(struct files_struct *files)
 
 		/* free the arrays if they are not embedded */
 		if (fdt != &files->fdtab)
-			__free_fdtable(fdt);
+			put_fdtable(fdt);
 		kmem_cache_free(files_cachep, files);
 	}
 }
@@ -455,6 +619,7 @@ struct files_struct init_files = {
 		.close_on_exec	= init_files.close_on_exec_init,
 		.open_fds	= init_files.open_fds_init,
 		.full_fds_bits	= init_files.full_fds_bits_init,
+		.count		= ATOMIC_INIT(1),
 	},
 	.file_lock	= __SPIN_LOCK_UNLOCKED(init_files.file_lock),
 	.resize_wait	= __WAIT_QUEUE_HEAD_INITIALIZER(init_files.resize_wait),
@@ -624,12 +789,18 @@ int __close_fd(struct files_struct *files, unsigned fd)
 	struct fdtable *fdt;
 
 	spin_lock(&files->file_lock);
+repeat:
 	fdt = files_fdtable(files);
 	if (fd >= fdt->max_fds)
 		goto out_unlock;
 	file = fdt->fd[fd];
 	if (!file)
 		goto out_unlock;
+	if (unlikely(fdtable_shared(fdt))) {
+		/* close() always releases the descriptor */
+		unshare_fdtable(files, GFP_KERNEL_ACCOUNT | __GFP_NOFAIL);
+		goto repeat;
+	}
 	rcu_assign_pointer(fdt->fd[fd], NULL);
 	__put_unused_fd(files, fd);
 	spin_unlock(&files->file_lock);
@@ -646,8 +817,10 @@ void do_close_on_exec(struct files_struct *files)
 	unsigned i;
 	struct fdtable *fdt;
 
-	/* exec unshares first */
+	/* exec unshared the table with unshare_files_fdtable() */
 	spin_lock(&files->file_lock);
+	if (WARN_ON_ONCE(fdtable_shared(files_fdtable(files))))
+		unshare_fdtable(files, GFP_KERNEL_ACCOUNT | __GFP_NOFAIL);
 	for (i = 0; ; i++) {
 		unsigned long set;
 		unsigned fd = i * BITS_PER_LONG;
@@ -762,7 +935,9 @@ unsigned long __fdget_pos(unsigned int fd)
 	struct file *file = (struct file *)(v & ~3);
 
 	if (file && (file->f_mode & FMODE_ATOMIC_POS)) {
-		if (file_count(file) > 1) {
+		/* a shared fd table holds one reference for all its users */
+		if (file_count(file) > 1 ||
+		    fdtable_shared(rcu_dereference_raw(current->files->fdt))) {
 			v |= FDPUT_POS_UNLOCK;
 			mutex_lock(&file->f_pos_lock);
 		}
@@ -781,17 +956,26 @@ void __f_unlock_pos(struct file *f)
  * file count (done either by fdget() or by fork()).
  */
 
-void set_close_on_exec(unsigned int fd, int flag)
+int set_close_on_exec(unsigned int fd, int flag)
 {
 	struct files_struct *files = current->files;
 	struct fdtable *fdt;
+	int err = 0;
 	spin_lock(&files->file_lock);
 	fdt = files_fdtable(files);
-	if (flag)
-		__set_close_on_exec(fd, fdt);
-	else
-		__clear_close_on_exec(fd, fdt);
+	if (unlikely(fdtable_shared(fdt)) && close_on_exec(fd, fdt) != !!flag) {
+		err = unshare_fdtable(files, GFP_KERNEL_ACCOUNT);
+		fdt = files_fdtable(files);
+	}
+	if (err >= 0) {
+		if (flag)
+			__set_close_on_exec(fd, fdt);
+		else
+			__clear_close_on_exec(fd, fdt);
+		err = 0;
+	}
 	spin_unlock(&files->file_lock);
+	return err;
 }
 
 bool get_close_on_exec(unsigned int fd)
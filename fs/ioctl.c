@@ -632,11 +632,11 @@ int do_vfs_ioctl(struct file *filp, unsigned int fd, unsigned int cmd,
 
 	switch (cmd) {
 	case FIOCLEX:
-		set_close_on_exec(fd, 1);
+		error = set_close_on_exec(fd, 1);
 		break;
 
 	case FIONCLEX:
-		set_close_on_exec(fd, 0);
+		error = set_close_on_exec(fd, 0);
 		break;
 
 	case FIONBIO:
@@ -1130,18 +1130,14 @@ SYSCALL_DEFINE2(creat, const char __user *, pathname, umode_t, mode)
 #endif
 
 /*
- * "id" is the POSIX thread ID. We use the
- * files pointer for this..
+ * What closing a descriptor does besides dropping the reference to the
+ * file, for descriptor tables that go away without holding one of their
+ * own, see fs/file.c.
  */
-int filp_close(struct file *filp, fl_owner_t id)
+int filp_flush(struct file *filp, fl_owner_t id)
 {
 	int retval = 0;
 
-	if (!file_count(filp)) {
-		printk(KERN_ERR "VFS: Close: file count is 0\n");
-		return 0;
-	}
-
 	if (filp->f_op->flush)
 		retval = filp->f_op->flush(filp, id);
 
@@ -1149,6 +1145,23 @@ int filp_close(struct file *filp, fl_owner_t id)
 		dnotify_flush(filp, id);
 		locks_remove_posix(filp, id);
 	}
+	return retval;
+}
+
+/*
+ * "id" is the POSIX thread ID. We use the
+ * files pointer for this..
+ */
+int filp_close(struct file *filp, fl_owner_t id)
+{
+	int retval;
+
+	if (!file_count(filp)) {
+		printk(KERN_ERR "VFS: Close: file count is 0\n");
+		return 0;
+	}
+
+	retval = filp_flush(filp, id);
 	fput(filp);
 	return retval;
 }
@@ -1024,6 +1024,9 @@ out:
 
 	if (pmd_trans_unstable(pmd))
 		return 0;
+	/* Left as is, a PTE table shared on fork is not changed */
+	if (pte_table_shared(pmd))
+		return 0;
 
 	pte = pte_offset_map_lock(vma->vm_mm, pmd, addr, &ptl);
 	for (; addr != end; pte++, addr += PAGE_SIZE) {
@@ -12,10 +12,13 @@
 #include <linux/workqueue.h>
 #include <linux/file.h>
 #include <linux/percpu.h>
+#include <linux/percpu-refcount.h>
 #include <linux/err.h>
 #include <linux/rbtree_latch.h>
 #include <linux/numa.h>
 #include <linux/wait.h>
+#include <linux/mutex.h>
+#include <linux/refcount.h>
 
 struct bpf_verifier_env;
 struct perf_event;
@@ -24,6 +27,8 @@ struct bpf_map;
 struct sock;
 struct seq_file;
 struct btf_type;
+struct vm_area_struct;
+struct poll_table_struct;
 
 /* map is generic key/value storage optionally accesible by eBPF programs */
 struct bpf_map_ops {
@@ -35,6 +40,15 @@ struct bpf_map_ops {
 	int (*map_get_next_key)(struct bpf_map *map, void *key, void *next_key);
 	void (*map_release_uref)(struct bpf_map *map);
 	void *(*map_lookup_elem_sys_only)(struct bpf_map *map, void *key);
+	int (*map_lookup_batch)(struct bpf_map *map, const union bpf_attr *attr,
+				union bpf_attr __user *uattr);
+	int (*map_lookup_and_delete_batch)(struct bpf_map *map,
+					   const union bpf_attr *attr,
+					   union bpf_attr __user *uattr);
+	int (*map_update_batch)(struct bpf_map *map, const union bpf_attr *attr,
+				union bpf_attr __user *uattr);
+	int (*map_delete_batch)(struct bpf_map *map, const union bpf_attr *attr,
+				union bpf_attr __user *uattr);
 
 	/* funcs callable from userspace and from eBPF programs */
 	void *(*map_lookup_elem)(struct bpf_map *map, void *key);
@@ -52,6 +66,10 @@ struct bpf_map_ops {
 	int (*map_check_btf)(const struct bpf_map *map,
 			     const struct btf_type *key_type,
 			     const struct btf_type *value_type);
+	int (*map_mmap)(struct bpf_map *map, struct vm_area_struct *vma);
+	__poll_t (*map_poll)(struct bpf_map *map, struct file *filp,
+			     struct poll_table_struct *pts);
+	void (*map_show_fdinfo)(const struct bpf_map *map, struct seq_file *m);
 };
 
 struct bpf_map {
@@ -155,6 +173,8 @@ enum bpf_arg_type {
 
 	ARG_PTR_TO_CTX,		/* pointer to context */
 	ARG_ANYTHING,		/* any (initialized) argument is ok */
+	ARG_PTR_TO_ALLOC_MEM,	/* pointer to dynamically allocated memory */
+	ARG_CONST_ALLOC_SIZE_OR_ZERO,	/* number of allocated bytes requested */
 };
 
 /* type of values returned from helper functions */
@@ -163,6 +183,7 @@ enum bpf_return_type {
 	RET_VOID,			/* function doesn't return anything */
 	RET_PTR_TO_MAP_VALUE,		/* returns a pointer to map elem value */
 	RET_PTR_TO_MAP_VALUE_OR_NULL,	/* returns a pointer to map elem value or NULL */
+	RET_PTR_TO_ALLOC_MEM_OR_NULL,	/* returns a pointer to dynamically allocated memory or NULL */
 };
 
 /* eBPF function prototype used by verifier to allow BPF_CALLs from eBPF programs
@@ -213,6 +234,8 @@ enum bpf_reg_type {
 	PTR_TO_PACKET_META,	 /* skb->data - meta_len */
 	PTR_TO_PACKET,		 /* reg points to skb->data */
 	PTR_TO_PACKET_END,	 /* skb->data + headlen */
+	PTR_TO_MEM,		 /* reg points to valid memory region */
+	PTR_TO_MEM_OR_NULL,	 /* reg points to valid memory region or NULL */
 };
 
 /* The information passed from prog-specific *_is_valid_access
@@ -456,6 +479,31 @@ void *bpf_map_area_alloc(size_t size, int numa_node);
 void bpf_map_area_free(void *base);
 void bpf_map_init_from_attr(struct bpf_map *map, union bpf_attr *attr);
 
+/* Bucket chain lengths of hash maps, shown in the map's fdinfo */
+#define BPF_MAP_CHAIN_HIST_SLOTS	5
+
+struct bpf_map_chain_stats {
+	u32 buckets;
+	u32 elems;
+	u32 max_chain;
+	/* buckets with 0, 1, 2, 3 and 4 or more elements */
+	u32 hist[BPF_MAP_CHAIN_HIST_SLOTS];
+};
+
+void bpf_map_chain_stats_add(struct bpf_map_chain_stats *stats, u32 len);
+void bpf_map_show_chain_stats(struct seq_file *m,
+			      const struct bpf_map_chain_stats *stats);
+
+int generic_map_lookup_batch(struct bpf_map *map,
+			     const union bpf_attr *attr,
+			     union bpf_attr __user *uattr);
+int generic_map_update_batch(struct bpf_map *map,
+			     const union bpf_attr *attr,
+			     union bpf_attr __user *uattr);
+int generic_map_delete_batch(struct bpf_map *map,
+			     const union bpf_attr *attr,
+			     union bpf_attr __user *uattr);
+
 extern int sysctl_unprivileged_bpf_disabled;
 
 int bpf_map_new_fd(struct bpf_map *map, int flags);
@@ -532,6 +580,99 @@ static inline int bpf_map_attr_numa_node(const union bpf_attr *attr)
 struct bpf_prog *bpf_prog_get_type_path(const char *name, enum bpf_prog_type type);
 int array_map_alloc_check(union bpf_attr *attr);
 
+/* A kernel table walked by BPF_PROG_TYPE_ITER programs */
+struct bpf_iter_target {
+	enum bpf_attach_type attach_type;
+	/* largest context record, the verifier checks accesses against it */
+	u32 ctx_size;
+	u32 priv_size;
+	/* ->show() fills the context record from the object, or skips it */
+	const struct seq_operations *seq_ops;
+	/* set the record size for @map, for targets walking a map */
+	int (*attach)(struct bpf_map *map, u32 *ctx_size);
+	int (*init)(void *priv, struct bpf_map *map);
+	void (*fini)(void *priv);
+	struct list_head list;
+};
+
+struct bpf_iter;
+
+int bpf_iter_reg_target(struct bpf_iter_target *target);
+void *bpf_iter_priv(struct seq_file *seq);
+void *bpf_iter_ctx(struct seq_file *seq);
+struct bpf_iter *bpf_iter_alloc(struct bpf_prog *prog, struct bpf_map *map);
+struct bpf_iter *bpf_iter_inc(struct bpf_iter *iter);
+void bpf_iter_put(struct bpf_iter *iter);
+int bpf_iter_new_fd(struct bpf_iter *iter);
+struct bpf_iter *bpf_iter_get_from_fd(u32 ufd);
+
+extern const struct file_operations bpf_iter_fops;
+
+/* BPF_PROG_TYPE_TRACING programs attached to one kernel function */
+enum bpf_tramp_prog_type {
+	BPF_TRAMP_FENTRY,
+	BPF_TRAMP_FEXIT,
+	BPF_TRAMP_MAX,
+};
+
+#define BPF_MAX_TRAMP_PROGS 16
+
+/* Generated code the patched function branches to. The image is freed
+ * once no task can still be running in it: after an RCU-tasks grace period
+ * for the fentry part, and after the last fexit caller returned, which is
+ * what @pcref counts. It holds a reference on the programs it calls.
+ */
+struct bpf_tramp_image {
+	void *image;
+	struct bpf_prog *progs[BPF_TRAMP_MAX][BPF_MAX_TRAMP_PROGS];
+	int nr_progs[BPF_TRAMP_MAX];
+	struct percpu_ref pcref;
+	struct rcu_head rcu;
+	struct work_struct work;
+};
+
+struct bpf_trampoline {
+	struct hlist_node hlist;
+	/* entry of the traced function */
+	unsigned long ip;
+	refcount_t refcnt;
+	/* serializes program changes and image updates */
+	struct mutex mutex;
+	struct bpf_prog *progs[BPF_TRAMP_MAX][BPF_MAX_TRAMP_PROGS];
+	int nr_progs[BPF_TRAMP_MAX];
+	struct bpf_tramp_image *cur_image;
+	/* @cur_image still runs unlinked programs, holds a reference */
+	bool stale;
+	/* instruction at @ip replaced by the branch to the image */
+	u32 orig_insn;
+};
+
+struct bpf_trampoline *bpf_trampoline_get(unsigned long ip, unsigned long size);
+void bpf_trampoline_put(struct bpf_trampoline *tr);
+int bpf_trampoline_link_prog(struct bpf_trampoline *tr, struct bpf_prog *prog);
+int bpf_trampoline_unlink_prog(struct bpf_trampoline *tr, struct bpf_prog *prog);
+
+/* Called from the generated code */
+u64 notrace __bpf_prog_enter(void);
+void notrace __bpf_prog_exit(u64 run);
+void notrace __bpf_tramp_enter(struct bpf_tramp_image *im);
+void notrace __bpf_tramp_exit(struct bpf_tramp_image *im);
+
+/* Provided by the JIT */
+int arch_prepare_bpf_trampoline(struct bpf_tramp_image *im,
+				struct bpf_trampoline *tr);
+int arch_bpf_trampoline_patch(struct bpf_trampoline *tr, void *old_image,
+			      void *new_image);
+
+#ifdef CONFIG_BPF_JIT
+int bpf_tracing_prog_open(struct bpf_prog *prog, const char *name);
+#else
+static inline int bpf_tracing_prog_open(struct bpf_prog *prog, const char *name)
+{
+	return -EOPNOTSUPP;
+}
+#endif
+
 #else /* !CONFIG_BPF_SYSCALL */
 static inline struct bpf_prog *bpf_prog_get(u32 ufd)
 {
@@ -823,6 +964,15 @@ extern const struct bpf_func_proto bpf_sock_hash_update_proto;
 extern const struct bpf_func_proto bpf_get_current_cgroup_id_proto;
 
 extern const struct bpf_func_proto bpf_get_local_storage_proto;
+extern const struct bpf_func_proto bpf_ringbuf_output_proto;
+extern const struct bpf_func_proto bpf_ringbuf_reserve_proto;
+extern const struct bpf_func_proto bpf_ringbuf_submit_proto;
+extern const struct bpf_func_proto bpf_ringbuf_discard_proto;
+extern const struct bpf_func_proto bpf_ringbuf_query_proto;
+extern const struct bpf_func_proto bpf_task_storage_get_proto;
+extern const struct bpf_func_proto bpf_task_storage_delete_proto;
+extern const struct bpf_func_proto bpf_inode_storage_get_proto;
+extern const struct bpf_func_proto bpf_inode_storage_delete_proto;
 
 /* Shared helpers among cBPF and eBPF. */
 void bpf_user_rnd_init_once(void);
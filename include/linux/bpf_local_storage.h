@@ -0,0 +1,157 @@
+/* SPDX-License-Identifier: GPL-2.0 */
+/*
+ * BPF local storage: map values that live in the object they belong to.
+ *
+ * A BPF_MAP_TYPE_TASK_STORAGE or BPF_MAP_TYPE_INODE_STORAGE map has no
+ * elements of its own. The value of a task (inode) in the map is kept in a
+ * bpf_local_storage hanging off that task (inode), found without any hash
+ * lookup, and is freed together with it.
+ */
+#ifndef _BPF_LOCAL_STORAGE_H
+#define _BPF_LOCAL_STORAGE_H
+
+#include <linux/bpf.h>
+#include <linux/list.h>
+#include <linux/percpu.h>
+#include <linux/rculist.h>
+#include <linux/spinlock.h>
+#include <linux/types.h>
+
+struct inode;
+struct task_struct;
+
+#ifdef CONFIG_BPF_SYSCALL
+
+/* Number of maps whose data a storage caches for lookups without walking
+ * its list, maps share the slots beyond that.
+ */
+#define BPF_LOCAL_STORAGE_CACHE_SIZE	16
+
+struct bpf_local_storage_map_bucket {
+	struct hlist_head list;
+	raw_spinlock_t lock;
+};
+
+/* The map only keeps its elements on a list, so that they can be found and
+ * freed with the map. Elements are looked up through their owner.
+ */
+struct bpf_local_storage_map {
+	struct bpf_map map;
+	struct bpf_local_storage_map_bucket *buckets;
+	u32 bucket_log;
+	u16 elem_size;
+	u16 cache_idx;
+};
+
+struct bpf_local_storage_data {
+	/* smap is used as the searching key when looking up the data of a
+	 * map in its owner's storage.
+	 */
+	struct bpf_local_storage_map __rcu *smap;
+	u8 data[0] __aligned(8);
+};
+
+/* The value of one owner in one map */
+struct bpf_local_storage_elem {
+	struct hlist_node map_node;	/* linked to bpf_local_storage_map */
+	struct hlist_node snode;	/* linked to bpf_local_storage */
+	struct bpf_local_storage __rcu *local_storage;
+	struct rcu_head rcu;
+	/* 8 bytes hole */
+	/* the data is stored in another cacheline to minimize the number
+	 * of cachelines accessed during a cache hit.
+	 */
+	struct bpf_local_storage_data sdata ____cacheline_aligned;
+};
+
+/* All the values of one owner */
+struct bpf_local_storage {
+	struct bpf_local_storage_data __rcu *cache[BPF_LOCAL_STORAGE_CACHE_SIZE];
+	struct hlist_head list;		/* list of bpf_local_storage_elem */
+	/* the field of the owner pointing to this storage, cleared when its
+	 * last element is unlinked.
+	 */
+	struct bpf_local_storage __rcu **owner_storage;
+	struct rcu_head rcu;
+	raw_spinlock_t lock;		/* protects list and cache */
+};
+
+struct bpf_local_storage_cache {
+	spinlock_t idx_lock;
+	u64 idx_usage_counts[BPF_LOCAL_STORAGE_CACHE_SIZE];
+};
+
+#define DEFINE_BPF_STORAGE_CACHE(name)				\
+static struct bpf_local_storage_cache name = {			\
+	.idx_lock = __SPIN_LOCK_UNLOCKED(name.idx_lock),	\
+}
+
+#define SELEM(_SDATA)							\
+	container_of((_SDATA), struct bpf_local_storage_elem, sdata)
+#define SDATA(_SELEM) (&(_SELEM)->sdata)
+
+/* Programs may run while a storage or map bucket lock is held on their cpu,
+ * e.g. from a tracepoint in kmalloc() or from an NMI. The helpers only go
+ * ahead if nobody else is in local storage code on this cpu, everything
+ * else just marks the cpu busy.
+ */
+DECLARE_PER_CPU(int, bpf_local_storage_busy);
+
+static inline void bpf_local_storage_lock(void)
+{
+	preempt_disable();
+	__this_cpu_inc(bpf_local_storage_busy);
+}
+
+static inline void bpf_local_storage_unlock(void)
+{
+	__this_cpu_dec(bpf_local_storage_busy);
+	preempt_enable();
+}
+
+static inline bool bpf_local_storage_trylock(void)
+{
+	preempt_disable();
+	if (unlikely(__this_cpu_inc_return(bpf_local_storage_busy) != 1)) {
+		__this_cpu_dec(bpf_local_storage_busy);
+		preempt_enable();
+		return false;
+	}
+	return true;
+}
+
+u16 bpf_local_storage_cache_idx_get(struct bpf_local_storage_cache *cache);
+void bpf_local_storage_cache_idx_free(struct bpf_local_storage_cache *cache,
+				      u16 idx);
+
+int bpf_local_storage_map_alloc_check(union bpf_attr *attr);
+struct bpf_local_storage_map *bpf_local_storage_map_alloc(union bpf_attr *attr);
+void bpf_local_storage_map_free(struct bpf_local_storage_map *smap);
+
+struct bpf_local_storage_data *
+bpf_local_storage_lookup(struct bpf_local_storage *local_storage,
+			 struct bpf_local_storage_map *smap,
+			 bool cacheit_lockit);
+struct bpf_local_storage_data *
+bpf_local_storage_update(struct bpf_local_storage __rcu **owner_storage,
+			 struct bpf_local_storage_map *smap, void *value,
+			 u64 map_flags);
+void bpf_selem_unlink(struct bpf_local_storage_elem *selem);
+void bpf_local_storage_destroy(struct bpf_local_storage *local_storage);
+
+void bpf_task_storage_free(struct task_struct *task);
+void bpf_inode_storage_free(struct inode *inode);
+
+#else /* CONFIG_BPF_SYSCALL */
+
+static inline void bpf_task_storage_free(struct task_struct *task)
+{
+}
+
+static inline void bpf_inode_storage_free(struct inode *inode)
+{
+}
+
+#endif /* CONFIG_BPF_SYSCALL */
+
+#endif /* _BPF_LOCAL_STORAGE_H */
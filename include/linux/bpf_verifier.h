@@ -51,6 +51,9 @@ struct bpf_reg_state {
 		 */
 		struct bpf_map *map_ptr;
 
+		/* valid when type == PTR_TO_MEM | PTR_TO_MEM_OR_NULL */
+		u32 mem_size;
+
 		/* Max size from any of the above. */
 		unsigned long raw;
 	};
@@ -60,6 +63,9 @@ struct bpf_reg_state {
 	 * offset, so they can share range knowledge.
 	 * For PTR_TO_MAP_VALUE_OR_NULL this is used to share which map value we
 	 * came from, when one is tested for != NULL.
+	 * For PTR_TO_MEM_OR_NULL and PTR_TO_MEM this is also the id of the
+	 * reference acquired by the helper that returned the memory, which
+	 * must be released before the program exits.
 	 */
 	u32 id;
 	/* Ordering of fields matters.  See states_equal() */
@@ -129,12 +135,18 @@ struct bpf_func_state {
 };
 
 #define MAX_CALL_FRAMES 8
+#define MAX_ACQUIRED_REFS 8
 struct bpf_verifier_state {
 	/* call stack tracking */
 	struct bpf_func_state *frame[MAX_CALL_FRAMES];
 	struct bpf_verifier_state *parent;
 	u32 curframe;
 	bool speculative;
+	/* ids of references acquired by helpers (e.g. reserved ring buffer
+	 * records) and not yet released, across all frames
+	 */
+	u32 acquired_refs;
+	u32 refs[MAX_ACQUIRED_REFS];
 };
 
 /* linked list of verifier states used to prune search */
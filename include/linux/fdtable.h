@@ -29,9 +29,19 @@ struct fdtable {
 	unsigned long *close_on_exec;
 	unsigned long *open_fds;
 	unsigned long *full_fds_bits;
+	atomic_t count;		/* files_structs using it, see dup_fd() */
 	struct rcu_head rcu;
 };
 
+/*
+ * A table shared by several files_structs is never modified: they copy
+ * it before changing anything in it.
+ */
+static inline bool fdtable_shared(const struct fdtable *fdt)
+{
+	return atomic_read(&fdt->count) > 1;
+}
+
 static inline bool close_on_exec(unsigned int fd, const struct fdtable *fdt)
 {
 	return test_bit(fd, fdt->close_on_exec);
@@ -110,6 +120,7 @@ void put_files_struct(struct files_struct *fs);
 void reset_files_struct(struct files_struct *);
 int unshare_files(struct files_struct **);
 struct files_struct *dup_fd(struct files_struct *, int *) __latent_entropy;
+int unshare_files_fdtable(struct files_struct *);
 void do_close_on_exec(struct files_struct *);
 int iterate_fd(struct files_struct *, unsigned,
 		int (*)(const void *, struct file *, unsigned),
@@ -822,12 +822,12 @@ struct sock *do_msg_redirect_map(struct sk_msg_buff *md);
 #ifdef CONFIG_INET
 struct sock *bpf_run_sk_reuseport(struct sock_reuseport *reuse, struct sock *sk,
 				  struct bpf_prog *prog, struct sk_buff *skb,
-				  u32 hash);
+				  struct sock *migrating_sk, u32 hash);
 #else
 static inline struct sock *
 bpf_run_sk_reuseport(struct sock_reuseport *reuse, struct sock *sk,
 		     struct bpf_prog *prog, struct sk_buff *skb,
-		     u32 hash)
+		     struct sock *migrating_sk, u32 hash)
 {
 	return NULL;
 }
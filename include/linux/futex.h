@@ -81,4 +81,30 @@ static inline void exit_pi_state_list(struct task_struct *curr)
 }
 #endif
 
+#ifdef CONFIG_FUTEX_PRIVATE_HASH
+extern void futex_mm_init(struct mm_struct *mm);
+extern void futex_hash_free(struct mm_struct *mm);
+extern void futex_hash_allocate_default(void);
+extern int futex_hash_prctl(unsigned long arg2, unsigned long arg3,
+			    unsigned long arg4);
+#else
+static inline void futex_mm_init(struct mm_struct *mm)
+{
+}
+
+static inline void futex_hash_free(struct mm_struct *mm)
+{
+}
+
+static inline void futex_hash_allocate_default(void)
+{
+}
+
+static inline int futex_hash_prctl(unsigned long arg2, unsigned long arg3,
+				   unsigned long arg4)
+{
+	return -EINVAL;
+}
+#endif
+
 #endif
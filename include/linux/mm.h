@@ -1923,6 +1923,9 @@ static inline bool pgtable_page_ctor(struct page *page)
 {
 	if (!ptlock_init(page))
 		return false;
+#ifdef CONFIG_FORK_SHARE_PTE
+	atomic_set(&page->pt_share_count, 0);
+#endif
 	__SetPageTable(page);
 	inc_zone_page_state(page, NR_PAGETABLE);
 	return true;
@@ -1930,11 +1933,93 @@ static inline bool pgtable_page_ctor(struct page *page)
 
 static inline void pgtable_page_dtor(struct page *page)
 {
+#ifdef CONFIG_FORK_SHARE_PTE
+	VM_BUG_ON_PAGE(atomic_read(&page->pt_share_count), page);
+#endif
 	pte_lock_deinit(page);
 	__ClearPageTable(page);
 	dec_zone_page_state(page, NR_PAGETABLE);
 }
 
+#ifdef CONFIG_FORK_SHARE_PTE
+/*
+ * Whether @pmd points to a PTE table that fork shares with other mms.
+ * Stable under the lock of the table.
+ */
+static inline bool pte_table_shared(pmd_t *pmd)
+{
+	pmd_t pmdval = READ_ONCE(*pmd);
+
+	return pmd_present(pmdval) && !pmd_trans_huge(pmdval) &&
+	       !pmd_devmap(pmdval) &&
+	       atomic_read(&pmd_page(pmdval)->pt_share_count);
+}
+
+extern int __pte_unshare(struct vm_area_struct *vma, pmd_t *pmd,
+			 unsigned long addr);
+extern int pte_unshare_vma(struct vm_area_struct *vma, unsigned long start,
+			   unsigned long end);
+extern void pte_unshare_async(struct vm_area_struct *vma, unsigned long addr);
+
+/* Give the mm of @vma its own copy of the PTE table of @addr, if shared */
+static inline int pte_unshare(struct vm_area_struct *vma, pmd_t *pmd,
+			      unsigned long addr)
+{
+	if (likely(!pte_table_shared(pmd)))
+		return 0;
+	return __pte_unshare(vma, pmd, addr);
+}
+#else
+static inline bool pte_table_shared(pmd_t *pmd)
+{
+	return false;
+}
+
+static inline int pte_unshare(struct vm_area_struct *vma, pmd_t *pmd,
+			      unsigned long addr)
+{
+	return 0;
+}
+
+static inline int pte_unshare_vma(struct vm_area_struct *vma,
+				  unsigned long start, unsigned long end)
+{
+	return 0;
+}
+
+static inline void pte_unshare_async(struct vm_area_struct *vma,
+				     unsigned long addr)
+{
+}
+#endif /* CONFIG_FORK_SHARE_PTE */
+
+#ifdef CONFIG_FORK_SHARE_PTE
+/*
+ * The PTE table of a pmd can be replaced under mmap_sem held for read,
+ * when the table was shared on fork: lock the table the pmd still points
+ * to once the lock is taken.
+ */
+#define pte_offset_map_lock(mm, pmd, address, ptlp)		\
+({								\
+	spinlock_t *__ptl;					\
+	pte_t *__pte;						\
+	pmd_t __pmdval;						\
+								\
+	for (;;) {						\
+		__pmdval = READ_ONCE(*(pmd));			\
+		__ptl = pte_lockptr(mm, &__pmdval);		\
+		__pte = pte_offset_map(&__pmdval, address);	\
+		spin_lock(__ptl);				\
+		if (likely(pmd_val(__pmdval) ==			\
+			   pmd_val(READ_ONCE(*(pmd)))))		\
+			break;					\
+		spin_unlock(__ptl);				\
+		pte_unmap(__pte);				\
+	}							\
+	*(ptlp) = __ptl;					\
+	__pte;							\
+})
+#else
 #define pte_offset_map_lock(mm, pmd, address, ptlp)	\
 ({							\
 	spinlock_t *__ptl = pte_lockptr(mm, pmd);	\
@@ -1943,6 +2028,7 @@ static inline void pgtable_page_dtor(struct page *page)
 	spin_lock(__ptl);				\
 	__pte;						\
 })
+#endif
 
 #define pte_unmap_unlock(pte, ptl)	do {		\
 	spin_unlock(ptl);				\
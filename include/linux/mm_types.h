@@ -142,6 +142,8 @@ struct page {
 			union {
 				struct mm_struct *pt_mm; /* x86 pgds only */
 				atomic_t pt_frag_refcount; /* powerpc */
+				/* PTE tables: extra mms, FORK_SHARE_PTE */
+				atomic_t pt_share_count;
 			};
 #if ALLOC_SPLIT_PTLOCKS
 			spinlock_t *ptl;
@@ -490,6 +492,12 @@ struct mm_struct {
 #if IS_ENABLED(CONFIG_HMM)
 		/* HMM needs to track a few things per mm */
 		struct hmm *hmm;
+#endif
+#ifdef CONFIG_FUTEX_PRIVATE_HASH
+		/* Hash of the private futexes, see futex_hash_prctl() */
+		struct futex_private_hash *futex_phash;
+		/* Sized by PR_FUTEX_HASH, no default hash is allocated */
+		bool futex_phash_set;
 #endif
 	} __randomize_layout;
 
@@ -96,6 +96,7 @@ static inline vm_fault_t check_stable_address_space(struct mm_struct *mm)
 }
 
 bool __oom_reap_task_mm(struct mm_struct *mm);
+bool current_is_oom_reaper(void);
 
 extern unsigned long oom_badness(struct task_struct *p,
 		struct mem_cgroup *memcg, const nodemask_t *nodemask,
@@ -72,6 +72,9 @@ static inline int get_dumpable(struct mm_struct *mm)
 #define MMF_DISABLE_THP		24	/* disable THP for all VMAs */
 #define MMF_OOM_VICTIM		25	/* mm is the oom victim */
 #define MMF_OOM_REAP_QUEUED	26	/* mm was queued for oom_reaper */
+#define MMF_FORK_SHARE_PTE	27	/* PR_SET_LAZY_FORK: share PTE tables */
+#define MMF_FORK_LAZY_FILES	28	/* PR_SET_LAZY_FORK: share the fd table */
+#define MMF_PTE_UNSHARE_QUEUED	29	/* pte_unshare_async() pending */
 #define MMF_DISABLE_THP_MASK	(1 << MMF_DISABLE_THP)
 
 #define MMF_INIT_MASK		(MMF_DUMPABLE_MASK | MMF_DUMP_FILTER_MASK |\
@@ -183,6 +183,24 @@ int ip_route_input_rcu(struct sk_buff *skb, __be32 dst, __be32 src,
 		       u8 tos, struct net_device *devin,
 		       struct fib_result *res);
 
+/* Input route of the last packet of a receive batch, reused by the next
+ * packets with the same route keys. Only valid within one RCU section.
+ */
+struct ip_route_input_batch {
+	struct dst_entry	*dst;
+	struct net_device	*dev;
+	__be32			daddr;
+	__be32			saddr;
+	u32			mark;
+	u8			tos;
+	u8			protocol;
+	u8			ipcb_flags;
+};
+
+int ip_route_input_batch_noref(struct sk_buff *skb, __be32 dst, __be32 src,
+			       u8 tos, struct net_device *devin,
+			       struct ip_route_input_batch *batch);
+
 static inline int ip_route_input(struct sk_buff *skb, __be32 dst, __be32 src,
 				 u8 tos, struct net_device *devin)
 {
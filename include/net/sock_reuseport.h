@@ -15,6 +15,8 @@ struct sock_reuseport {
 
 	u16			max_socks;	/* length of socks */
 	u16			num_socks;	/* elements in socks */
+	u16			num_closed_socks; /* closed elements in socks */
+	u16			incoming_cpu;	/* socks with SO_INCOMING_CPU */
 	/* The last synq overflow event timestamp of this
 	 * reuse->socks[] group.
 	 */
@@ -23,6 +25,10 @@ struct sock_reuseport {
 	unsigned int		reuseport_id;
 	bool			bind_inany;
 	struct bpf_prog __rcu	*prog;		/* optional BPF sock selector */
+	/* The listening sockets live in socks[0 .. num_socks - 1], the
+	 * closed ones waiting for their requests to be migrated live at the
+	 * tail, in socks[max_socks - num_closed_socks .. max_socks - 1].
+	 */
 	struct sock		*socks[0];	/* array of sock pointers */
 };
 
@@ -30,10 +36,15 @@ extern int reuseport_alloc(struct sock *sk, bool bind_inany);
 extern int reuseport_add_sock(struct sock *sk, struct sock *sk2,
 			      bool bind_inany);
 extern void reuseport_detach_sock(struct sock *sk);
+extern void reuseport_stop_listen_sock(struct sock *sk);
 extern struct sock *reuseport_select_sock(struct sock *sk,
 					  u32 hash,
 					  struct sk_buff *skb,
 					  int hdr_len);
+extern struct sock *reuseport_migrate_sock(struct sock *sk,
+					   struct sock *migrating_sk,
+					   struct sk_buff *skb);
+extern void reuseport_update_incoming_cpu(struct sock *sk, int val);
 extern int reuseport_attach_prog(struct sock *sk, struct bpf_prog *prog);
 int reuseport_get_id(struct sock_reuseport *reuse);
 
@@ -118,6 +118,74 @@ DEFINE_EVENT(workqueue_work, workqueue_execute_end,
 	TP_ARGS(work)
 );
 
+/**
+ * workqueue_execute_stats - called after the workqueue callback with timings
+ * @work:	pointer to struct work_struct, may be freed already
+ * @function:	the callback that ran
+ * @latency:	ns between queueing and the start of the callback
+ * @runtime:	ns the callback took to return
+ *
+ * Only emitted with CONFIG_WQ_STATS.
+ */
+TRACE_EVENT(workqueue_execute_stats,
+
+	TP_PROTO(struct work_struct *work, work_func_t function, u64 latency,
+		 u64 runtime),
+
+	TP_ARGS(work, function, latency, runtime),
+
+	TP_STRUCT__entry(
+		__field( void *,	work	)
+		__field( void *,	function)
+		__field( u64,		latency	)
+		__field( u64,		runtime	)
+	),
+
+	TP_fast_assign(
+		__entry->work		= work;
+		__entry->function	= function;
+		__entry->latency	= latency;
+		__entry->runtime	= runtime;
+	),
+
+	TP_printk("work struct %p: function %pf latency=%llu runtime=%llu",
+		  __entry->work, __entry->function,
+		  (unsigned long long)__entry->latency,
+		  (unsigned long long)__entry->runtime)
+);
+
+/**
+ * workqueue_cpu_intensive - a work item ran too long without sleeping
+ * @work:	pointer to struct work_struct
+ * @function:	the callback that is running
+ * @runtime:	ns of CPU time the callback used since it last slept
+ *
+ * The worker is taken out of concurrency management, as if the workqueue
+ * had WQ_CPU_INTENSIVE, until the callback returns.
+ */
+TRACE_EVENT(workqueue_cpu_intensive,
+
+	TP_PROTO(struct work_struct *work, work_func_t function, u64 runtime),
+
+	TP_ARGS(work, function, runtime),
+
+	TP_STRUCT__entry(
+		__field( void *,	work	)
+		__field( void *,	function)
+		__field( u64,		runtime	)
+	),
+
+	TP_fast_assign(
+		__entry->work		= work;
+		__entry->function	= function;
+		__entry->runtime	= runtime;
+	),
+
+	TP_printk("work struct %p: function %pf runtime=%llu",
+		  __entry->work, __entry->function,
+		  (unsigned long long)__entry->runtime)
+);
+
 #endif /*  _TRACE_WORKQUEUE_H */
 
 /* This part must be outside protection */
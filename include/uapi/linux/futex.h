@@ -41,6 +41,29 @@
 #define FUTEX_CMP_REQUEUE_PI_PRIVATE	(FUTEX_CMP_REQUEUE_PI | \
 					 FUTEX_PRIVATE_FLAG)
 
+/*
+ * Flags of the futexes of futex_waitv(): the size of the futex word, only
+ * 32 bit is supported, and FUTEX_PRIVATE_FLAG.
+ */
+#define FUTEX_32		2
+
+/* Maximum number of futexes futex_waitv() waits on */
+#define FUTEX_WAITV_MAX		128
+
+/**
+ * struct futex_waitv - A futex futex_waitv() waits on
+ * @val:	Expected value at uaddr
+ * @uaddr:	User address of the futex
+ * @flags:	FUTEX_32, optionally with FUTEX_PRIVATE_FLAG
+ * @__reserved:	Must be 0
+ */
+struct futex_waitv {
+	__u64 val;
+	__u64 uaddr;
+	__u32 flags;
+	__u32 __reserved;
+};
+
 /*
  * Support for robust futexes: the kernel cleans up held futexes at
  * thread exit time.
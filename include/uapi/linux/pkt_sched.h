@@ -816,6 +816,10 @@ struct tc_fq_codel_qd_stats {
 	__u32	ce_mark;	/* packets above ce_threshold */
 	__u32	memory_usage;	/* in bytes */
 	__u32	drop_overmemory;
+	__u32	stage_overflows; /* drops because a staging ring was full */
+	__u32	stage_contended; /* lockless enqueues while dequeue ran */
+	__u32	stage_drains;	/* staging ring drains by the dequeuer */
+	__u32	stage_max_batch; /* max packets moved by one drain */
 };
 
 struct tc_fq_codel_cl_stats {
@@ -864,6 +868,8 @@ enum {
 
 	TCA_FQ_LOW_RATE_THRESHOLD, /* per packet delay under this rate */
 
+	TCA_FQ_TIMER_SLACK,	/* timer slack, in ns */
+
 	__TCA_FQ_MAX
 };
 
@@ -882,6 +888,21 @@ struct tc_fq_qd_stats {
 	__u32	inactive_flows;
 	__u32	throttled_flows;
 	__u32	unthrottle_latency_ns;
+	__u64	wheel_overflows;
+};
+
+/* FQ per flow stats, flows are dumped as classes */
+#define TC_FQ_FLOW_THROTTLED	(1 << 0)
+#define TC_FQ_FLOW_DETACHED	(1 << 1)
+#define TC_FQ_FLOW_ORPHAN	(1 << 2)
+
+struct tc_fq_cl_stats {
+	__s64	time_to_send;	/* ns until next packet may be sent */
+	__s32	credit;
+	__u32	qlen;
+	__u32	backlog;
+	__u32	socket_hash;
+	__u32	flags;		/* TC_FQ_FLOW_* */
 };
 
 /* Heavy-Hitter Filter */
@@ -9,6 +9,8 @@ struct sched_param {
 };
 
 #define SCHED_ATTR_SIZE_VER0	48	/* sizeof first published struct */
+#define SCHED_ATTR_SIZE_VER1	56	/* add: util_{min,max} */
+#define SCHED_ATTR_SIZE_VER2	60	/* add: latency_nice */
 
 /*
  * Extended scheduling parameters data structure.
@@ -53,6 +55,48 @@ struct sched_param {
  * As of now, the SCHED_DEADLINE policy (sched_dl scheduling class) is the
  * only user of this new interface. More information about the algorithm
  * available in the scheduling class file or in Documentation/.
+ *
+ * Task Utilization Attributes
+ * ===========================
+ *
+ * A subset of sched_attr attributes allows to specify the utilization
+ * expected for a task. These attributes allow to inform the scheduler about
+ * the utilization boundaries within which it should schedule the task. These
+ * boundaries are valuable hints to support scheduler decisions on both task
+ * placement and frequency selection.
+ *
+ *  @sched_util_min	represents the minimum utilization
+ *  @sched_util_max	represents the maximum utilization
+ *
+ * Utilization is a value in the range [0..SCHED_CAPACITY_SCALE]. It
+ * represents the percentage of CPU time used by a task when running at the
+ * maximum frequency on the highest capacity CPU of the system. For example, a
+ * 20% utilization task is a task running for 2ms every 10ms at maximum
+ * frequency.
+ *
+ * A task with a min utilization value bigger than 0 is more likely scheduled
+ * on a CPU with a capacity big enough to fit the specified value.
+ * A task with a max utilization value smaller than 1024 is more likely
+ * scheduled on a CPU with no more capacity than the specified value.
+ *
+ * The values are only read when SCHED_FLAG_UTIL_CLAMP_MIN or
+ * SCHED_FLAG_UTIL_CLAMP_MAX is set in @sched_flags, which requires @size
+ * to be at least SCHED_ATTR_SIZE_VER1.
+ *
+ * Task Latency Attribute
+ * ======================
+ *
+ *  @sched_latency_nice	task's latency_nice value
+ *
+ * The latency nice of a SCHED_NORMAL task, in [-20..19], tells how much it
+ * cares about the delay to run once woken up, relative to the other tasks:
+ * a task with a lower latency nice preempts the running task more easily
+ * and a task with a higher one more reluctantly. At the highest values, a
+ * woken up task also gives up on searching for an idle CPU. Unlike nice,
+ * it does not change the share of CPU time a task gets.
+ *
+ * The value is only read when SCHED_FLAG_LATENCY_NICE is set in
+ * @sched_flags, which requires @size to be at least SCHED_ATTR_SIZE_VER2.
  */
 struct sched_attr {
 	__u32 size;
@@ -70,6 +114,14 @@ struct sched_attr {
 	__u64 sched_runtime;
 	__u64 sched_deadline;
 	__u64 sched_period;
+
+	/* Utilization hints */
+	__u32 sched_util_min;
+	__u32 sched_util_max;
+
+	/* latency requirement hints */
+	__s32 sched_latency_nice;
+
 };
 
 #endif /* _UAPI_LINUX_SCHED_TYPES_H */
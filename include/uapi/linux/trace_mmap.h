@@ -0,0 +1,70 @@
+/* SPDX-License-Identifier: GPL-2.0 WITH Linux-syscall-note */
+#ifndef _UAPI_TRACE_MMAP_H_
+#define _UAPI_TRACE_MMAP_H_
+
+#include <linux/types.h>
+
+/*
+ * A tracefs per_cpu/cpuN/trace_pipe_raw file can be mapped read-only.
+ * The first page of the mapping is the meta page described below, it is
+ * followed by the nr_subbufs sub-buffers of the CPU buffer, sub-buffer id
+ * at offset meta_page_size + id * subbuf_size. A sub-buffer starts with
+ * the page header of events/header_page, its events begin at data_offset.
+ *
+ * The writer never touches the sub-buffer the reader is on. Each
+ * TRACE_MMAP_IOCTL_GET_READER on the file consumes the events of the
+ * current reader sub-buffer, swaps in the oldest sub-buffer of the ring
+ * when it is fully consumed and updates the meta page: the new events are
+ * in [reader.read, reader.commit) of sub-buffer reader.id. The ioctl
+ * waits for events unless the file is O_NONBLOCK. The previous reader
+ * sub-buffer is back in the ring then, for the writer to overwrite.
+ *
+ * While a CPU buffer is mapped, read() and splice() of the trace_pipe_raw
+ * and trace_pipe files that consume it fail with EBUSY.
+ */
+
+/**
+ * struct trace_buffer_meta - meta page of a mapped CPU buffer
+ * @meta_page_size:	size of the meta page, offset of sub-buffer 0
+ * @meta_struct_len:	size of this structure
+ * @subbuf_size:	size of each sub-buffer
+ * @nr_subbufs:		number of sub-buffers, including the reader one
+ * @data_offset:	offset of the events in a sub-buffer
+ * @reader.lost_events:	events overwritten since the previous ioctl
+ * @reader.id:		sub-buffer the reader is on
+ * @reader.read:	offset of the first new event in its data
+ * @reader.commit:	offset of the end of the new events in its data
+ * @entries:		events written to the CPU buffer
+ * @overrun:		events overwritten before they were read
+ * @commit_overrun:	events lost to a wrapped commit
+ * @dropped_events:	events dropped when the buffer was full
+ * @read:		events consumed by the readers
+ */
+struct trace_buffer_meta {
+	__u32		meta_page_size;
+	__u32		meta_struct_len;
+
+	__u32		subbuf_size;
+	__u32		nr_subbufs;
+
+	__u32		data_offset;
+	__u32		__reserved0;
+
+	struct {
+		__u64	lost_events;
+		__u32	id;
+		__u32	read;
+		__u32	commit;
+		__u32	__reserved;
+	} reader;
+
+	__u64		entries;
+	__u64		overrun;
+	__u64		commit_overrun;
+	__u64		dropped_events;
+	__u64		read;
+};
+
+#define TRACE_MMAP_IOCTL_GET_READER		_IO('R', 0x20)
+
+#endif /* _UAPI_TRACE_MMAP_H_ */
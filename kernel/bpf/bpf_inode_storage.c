@@ -0,0 +1,245 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * BPF_MAP_TYPE_INODE_STORAGE: a value per inode, kept in the struct inode.
+ *
+ * Both programs and user space address an inode through a file descriptor
+ * of the calling task open on it. Values are freed with the inode.
+ */
+#include <linux/bpf.h>
+#include <linux/bpf_local_storage.h>
+#include <linux/err.h>
+#include <linux/fdtable.h>
+#include <linux/file.h>
+#include <linux/filter.h>
+#include <linux/fs.h>
+#include <linux/hardirq.h>
+#include <linux/rcupdate.h>
+#include <linux/sched.h>
+
+DEFINE_BPF_STORAGE_CACHE(inode_cache);
+
+static struct bpf_local_storage_data *
+inode_storage_lookup(struct inode *inode, struct bpf_map *map,
+		     bool cacheit_lockit)
+{
+	struct bpf_local_storage *inode_storage;
+	struct bpf_local_storage_map *smap;
+
+	inode_storage = rcu_dereference(inode->i_bpf_storage);
+	if (!inode_storage)
+		return NULL;
+
+	smap = (struct bpf_local_storage_map *)map;
+	return bpf_local_storage_lookup(inode_storage, smap, cacheit_lockit);
+}
+
+static int inode_storage_delete(struct inode *inode, struct bpf_map *map)
+{
+	struct bpf_local_storage_data *sdata;
+
+	sdata = inode_storage_lookup(inode, map, false);
+	if (!sdata)
+		return -ENOENT;
+
+	bpf_selem_unlink(SELEM(sdata));
+
+	return 0;
+}
+
+/* Called from __destroy_inode() */
+void bpf_inode_storage_free(struct inode *inode)
+{
+	struct bpf_local_storage *local_storage;
+
+	rcu_read_lock();
+
+	local_storage = rcu_dereference(inode->i_bpf_storage);
+	if (local_storage) {
+		bpf_local_storage_lock();
+		bpf_local_storage_destroy(local_storage);
+		bpf_local_storage_unlock();
+	}
+
+	rcu_read_unlock();
+}
+
+/* Called from syscall, in an RCU read-side critical section */
+static void *inode_storage_map_lookup_elem(struct bpf_map *map, void *key)
+{
+	struct bpf_local_storage_data *sdata;
+	struct file *f;
+
+	f = fget(*(int *)key);
+	if (!f)
+		return NULL;
+
+	sdata = inode_storage_lookup(file_inode(f), map, false);
+	fput(f);
+
+	/* the element is freed after an RCU grace period */
+	return sdata ? sdata->data : NULL;
+}
+
+static int inode_storage_map_update_elem(struct bpf_map *map, void *key,
+					 void *value, u64 map_flags)
+{
+	struct bpf_local_storage_data *sdata;
+	struct file *f;
+
+	f = fget(*(int *)key);
+	if (!f)
+		return -EBADF;
+
+	bpf_local_storage_lock();
+	sdata = bpf_local_storage_update(&file_inode(f)->i_bpf_storage,
+					 (struct bpf_local_storage_map *)map,
+					 value, map_flags);
+	bpf_local_storage_unlock();
+
+	fput(f);
+
+	return PTR_ERR_OR_ZERO(sdata);
+}
+
+static int inode_storage_map_delete_elem(struct bpf_map *map, void *key)
+{
+	struct file *f;
+	int err;
+
+	f = fget(*(int *)key);
+	if (!f)
+		return -EBADF;
+
+	bpf_local_storage_lock();
+	err = inode_storage_delete(file_inode(f), map);
+	bpf_local_storage_unlock();
+
+	fput(f);
+
+	return err;
+}
+
+static int notsupp_get_next_key(struct bpf_map *map, void *key,
+				void *next_key)
+{
+	return -ENOTSUPP;
+}
+
+static struct bpf_map *inode_storage_map_alloc(union bpf_attr *attr)
+{
+	struct bpf_local_storage_map *smap;
+
+	smap = bpf_local_storage_map_alloc(attr);
+	if (IS_ERR(smap))
+		return ERR_CAST(smap);
+
+	smap->cache_idx = bpf_local_storage_cache_idx_get(&inode_cache);
+	return &smap->map;
+}
+
+static void inode_storage_map_free(struct bpf_map *map)
+{
+	struct bpf_local_storage_map *smap;
+
+	smap = (struct bpf_local_storage_map *)map;
+	bpf_local_storage_cache_idx_free(&inode_cache, smap->cache_idx);
+	bpf_local_storage_map_free(smap);
+}
+
+const struct bpf_map_ops inode_storage_map_ops = {
+	.map_alloc_check = bpf_local_storage_map_alloc_check,
+	.map_alloc = inode_storage_map_alloc,
+	.map_free = inode_storage_map_free,
+	.map_get_next_key = notsupp_get_next_key,
+	.map_lookup_elem = inode_storage_map_lookup_elem,
+	.map_update_elem = inode_storage_map_update_elem,
+	.map_delete_elem = inode_storage_map_delete_elem,
+};
+
+/* Pin the file open as fd in the current task, which keeps its inode from
+ * being destroyed while storage may be created for it. Not for NMI, where
+ * fput() cannot be called.
+ */
+static struct file *inode_storage_get_file(int fd)
+{
+	struct files_struct *files = current->files;
+	struct file *f;
+
+	if (in_nmi() || !files)
+		return NULL;
+
+	rcu_read_lock();
+	f = fcheck_files(files, fd);
+	if (f && (f->f_mode & FMODE_PATH || !get_file_rcu(f)))
+		f = NULL;
+	rcu_read_unlock();
+
+	return f;
+}
+
+BPF_CALL_3(bpf_inode_storage_get, struct bpf_map *, map, int, fd, u64, flags)
+{
+	struct bpf_local_storage_data *sdata = NULL;
+	struct file *f;
+
+	if (flags & ~BPF_LOCAL_STORAGE_GET_F_CREATE)
+		return (unsigned long)NULL;
+
+	f = inode_storage_get_file(fd);
+	if (!f)
+		return (unsigned long)NULL;
+
+	if (bpf_local_storage_trylock()) {
+		sdata = inode_storage_lookup(file_inode(f), map, true);
+		if (!sdata && (flags & BPF_LOCAL_STORAGE_GET_F_CREATE))
+			sdata = bpf_local_storage_update(&file_inode(f)->i_bpf_storage,
+							 (struct bpf_local_storage_map *)map,
+							 NULL, BPF_NOEXIST);
+		bpf_local_storage_unlock();
+	}
+
+	fput(f);
+
+	/* the element is freed an RCU grace period after being unlinked,
+	 * it outlives the program even if the file is closed meanwhile
+	 */
+	return IS_ERR_OR_NULL(sdata) ? (unsigned long)NULL :
+		(unsigned long)sdata->data;
+}
+
+BPF_CALL_2(bpf_inode_storage_delete, struct bpf_map *, map, int, fd)
+{
+	struct file *f;
+	int err;
+
+	f = inode_storage_get_file(fd);
+	if (!f)
+		return in_nmi() ? -EBUSY : -EBADF;
+
+	err = -EBUSY;
+	if (bpf_local_storage_trylock()) {
+		err = inode_storage_delete(file_inode(f), map);
+		bpf_local_storage_unlock();
+	}
+
+	fput(f);
+
+	return err;
+}
+
+const struct bpf_func_proto bpf_inode_storage_get_proto = {
+	.func		= bpf_inode_storage_get,
+	.gpl_only	= false,
+	.ret_type	= RET_PTR_TO_MAP_VALUE_OR_NULL,
+	.arg1_type	= ARG_CONST_MAP_PTR,
+	.arg2_type	= ARG_ANYTHING,
+	.arg3_type	= ARG_ANYTHING,
+};
+
+const struct bpf_func_proto bpf_inode_storage_delete_proto = {
+	.func		= bpf_inode_storage_delete,
+	.gpl_only	= false,
+	.ret_type	= RET_INTEGER,
+	.arg1_type	= ARG_CONST_MAP_PTR,
+	.arg2_type	= ARG_ANYTHING,
+};
@@ -0,0 +1,526 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * BPF iterators
+ *
+ * A BPF_PROG_TYPE_ITER program is run once for every object of a kernel
+ * table (tasks, open files, map elements, sockets) and prints what it
+ * wants to know about it into a seq_file, instead of the reader parsing
+ * the fixed text format of the corresponding /proc file.
+ *
+ * Tables register a struct bpf_iter_target with start/next/stop
+ * operations that walk the objects and a show operation that fills the
+ * read-only record the program gets as context. BPF_ITER_CREATE binds a
+ * program, and a map for map element iterators, into a struct bpf_iter
+ * and returns a file descriptor that reads one walk. The descriptor can
+ * be pinned in bpffs, every open() of the pinned file starts a new walk.
+ */
+#include <linux/anon_inodes.h>
+#include <linux/bpf.h>
+#include <linux/ctype.h>
+#include <linux/file.h>
+#include <linux/filter.h>
+#include <linux/fs.h>
+#include <linux/mm.h>
+#include <linux/mutex.h>
+#include <linux/seq_file.h>
+#include <linux/slab.h>
+
+struct bpf_iter {
+	atomic_t			refcnt;
+	const struct bpf_iter_target	*target;
+	struct bpf_prog			*prog;
+	struct bpf_map			*map;
+	u32				ctx_size;
+};
+
+/* State of one reader of an iterator */
+struct bpf_iter_session {
+	struct bpf_iter			*iter;
+	struct seq_file			*seq;
+	void				*priv;
+	/* the program asked to end the walk after the current object */
+	bool				stop;
+	bool				done;
+	u64				ctx[0];
+};
+
+static LIST_HEAD(targets);
+static DEFINE_MUTEX(targets_mutex);
+
+int bpf_iter_reg_target(struct bpf_iter_target *target)
+{
+	mutex_lock(&targets_mutex);
+	list_add(&target->list, &targets);
+	mutex_unlock(&targets_mutex);
+
+	return 0;
+}
+
+static const struct bpf_iter_target *
+bpf_iter_find_target(enum bpf_attach_type type)
+{
+	const struct bpf_iter_target *target, *found = NULL;
+
+	mutex_lock(&targets_mutex);
+	list_for_each_entry(target, &targets, list) {
+		if (target->attach_type == type) {
+			found = target;
+			break;
+		}
+	}
+	mutex_unlock(&targets_mutex);
+
+	return found;
+}
+
+void *bpf_iter_priv(struct seq_file *seq)
+{
+	struct bpf_iter_session *s = seq->private;
+
+	return s->priv;
+}
+
+void *bpf_iter_ctx(struct seq_file *seq)
+{
+	struct bpf_iter_session *s = seq->private;
+
+	return s->ctx;
+}
+
+static struct seq_file *bpf_iter_ctx_seq(void *ctx)
+{
+	return container_of((u64 *)ctx, struct bpf_iter_session, ctx[0])->seq;
+}
+
+static void *bpf_iter_seq_start(struct seq_file *seq, loff_t *pos)
+{
+	struct bpf_iter_session *s = seq->private;
+
+	if (!*pos)
+		s->stop = s->done = false;
+	if (s->done)
+		return NULL;
+
+	return s->iter->target->seq_ops->start(seq, pos);
+}
+
+static void *bpf_iter_seq_next(struct seq_file *seq, void *v, loff_t *pos)
+{
+	struct bpf_iter_session *s = seq->private;
+	const struct seq_operations *ops = s->iter->target->seq_ops;
+
+	if (s->stop) {
+		s->done = true;
+		ops->stop(seq, v);
+		++*pos;
+		return NULL;
+	}
+
+	return ops->next(seq, v, pos);
+}
+
+static void bpf_iter_seq_stop(struct seq_file *seq, void *v)
+{
+	struct bpf_iter_session *s = seq->private;
+
+	s->iter->target->seq_ops->stop(seq, v);
+}
+
+static int bpf_iter_seq_show(struct seq_file *seq, void *v)
+{
+	struct bpf_iter_session *s = seq->private;
+	struct bpf_iter_meta *meta = (void *)s->ctx;
+	u32 ret;
+	int err;
+
+	err = s->iter->target->seq_ops->show(seq, v);
+	if (err)
+		return err;
+
+	meta->seq_num = seq->index;
+
+	/* If the output overflows the buffer, seq_read() runs us again for
+	 * the same object with a larger one.
+	 */
+	preempt_disable();
+	rcu_read_lock();
+	ret = BPF_PROG_RUN(s->iter->prog, s->ctx);
+	rcu_read_unlock();
+	preempt_enable();
+
+	if (ret == 1)
+		s->stop = true;
+
+	return 0;
+}
+
+static const struct seq_operations bpf_iter_seq_ops = {
+	.start	= bpf_iter_seq_start,
+	.next	= bpf_iter_seq_next,
+	.stop	= bpf_iter_seq_stop,
+	.show	= bpf_iter_seq_show,
+};
+
+struct bpf_iter *bpf_iter_inc(struct bpf_iter *iter)
+{
+	atomic_inc(&iter->refcnt);
+	return iter;
+}
+
+void bpf_iter_put(struct bpf_iter *iter)
+{
+	if (!atomic_dec_and_test(&iter->refcnt))
+		return;
+
+	bpf_prog_put(iter->prog);
+	if (iter->map)
+		bpf_map_put_with_uref(iter->map);
+	kfree(iter);
+}
+
+/* Start a walk of @iter on @file, which takes over the caller's reference
+ * on success.
+ */
+static int bpf_iter_seq_open(struct bpf_iter *iter, struct file *file)
+{
+	const struct bpf_iter_target *target = iter->target;
+	struct bpf_iter_session *s;
+	int err = -ENOMEM;
+
+	s = kvzalloc(sizeof(*s) + iter->ctx_size, GFP_USER);
+	if (!s)
+		return -ENOMEM;
+
+	if (target->priv_size) {
+		s->priv = kzalloc(target->priv_size, GFP_USER);
+		if (!s->priv)
+			goto out_free;
+	}
+
+	if (target->init) {
+		err = target->init(s->priv, iter->map);
+		if (err)
+			goto out_free;
+	}
+
+	err = seq_open(file, &bpf_iter_seq_ops);
+	if (err)
+		goto out_fini;
+
+	s->iter = iter;
+	s->seq = file->private_data;
+	s->seq->private = s;
+	return 0;
+
+out_fini:
+	if (target->fini)
+		target->fini(s->priv);
+out_free:
+	kfree(s->priv);
+	kvfree(s);
+	return err;
+}
+
+static int bpf_iter_open(struct inode *inode, struct file *file)
+{
+	struct bpf_iter *iter = inode->i_private;
+	int err;
+
+	err = bpf_iter_seq_open(bpf_iter_inc(iter), file);
+	if (err)
+		bpf_iter_put(iter);
+
+	return err;
+}
+
+static int bpf_iter_release(struct inode *inode, struct file *file)
+{
+	struct seq_file *seq = file->private_data;
+	struct bpf_iter_session *s;
+
+	/* failed bpf_iter_new_fd() */
+	if (!seq)
+		return 0;
+
+	s = seq->private;
+	if (s->iter->target->fini)
+		s->iter->target->fini(s->priv);
+	bpf_iter_put(s->iter);
+	kfree(s->priv);
+	kvfree(s);
+
+	return seq_release(inode, file);
+}
+
+/* Also used for iterators pinned in bpffs */
+const struct file_operations bpf_iter_fops = {
+	.open		= bpf_iter_open,
+	.read		= seq_read,
+	.release	= bpf_iter_release,
+};
+
+/* Return a file descriptor reading a new walk of @iter, which takes over
+ * the caller's reference on success.
+ */
+int bpf_iter_new_fd(struct bpf_iter *iter)
+{
+	struct file *file;
+	int fd, err;
+
+	fd = get_unused_fd_flags(O_CLOEXEC);
+	if (fd < 0)
+		return fd;
+
+	file = anon_inode_getfile("bpf-iter", &bpf_iter_fops, NULL,
+				  O_RDONLY | O_CLOEXEC);
+	if (IS_ERR(file)) {
+		put_unused_fd(fd);
+		return PTR_ERR(file);
+	}
+
+	err = bpf_iter_seq_open(iter, file);
+	if (err) {
+		fput(file);
+		put_unused_fd(fd);
+		return err;
+	}
+
+	fd_install(fd, file);
+	return fd;
+}
+
+struct bpf_iter *bpf_iter_get_from_fd(u32 ufd)
+{
+	struct fd f = fdget(ufd);
+	struct seq_file *seq;
+	struct bpf_iter *iter;
+
+	if (!f.file)
+		return ERR_PTR(-EBADF);
+	if (f.file->f_op != &bpf_iter_fops) {
+		fdput(f);
+		return ERR_PTR(-EINVAL);
+	}
+
+	seq = f.file->private_data;
+	iter = bpf_iter_inc(((struct bpf_iter_session *)seq->private)->iter);
+	fdput(f);
+
+	return iter;
+}
+
+/* Bind @prog and, for targets that walk one, @map into an iterator. The
+ * iterator takes over both references on success.
+ */
+struct bpf_iter *bpf_iter_alloc(struct bpf_prog *prog, struct bpf_map *map)
+{
+	const struct bpf_iter_target *target;
+	struct bpf_iter *iter;
+	u32 ctx_size;
+	int err;
+
+	target = bpf_iter_find_target(prog->expected_attach_type);
+	if (!target)
+		return ERR_PTR(-EOPNOTSUPP);
+	if (!map != !target->attach)
+		return ERR_PTR(-EINVAL);
+
+	ctx_size = target->ctx_size;
+	if (map) {
+		err = target->attach(map, &ctx_size);
+		if (err)
+			return ERR_PTR(err);
+	}
+
+	/* The verifier checked context accesses against the largest record
+	 * of the target, check them against the actual one.
+	 */
+	if (prog->aux->max_ctx_offset > ctx_size)
+		return ERR_PTR(-EACCES);
+
+	iter = kzalloc(sizeof(*iter), GFP_USER);
+	if (!iter)
+		return ERR_PTR(-ENOMEM);
+
+	atomic_set(&iter->refcnt, 1);
+	iter->target = target;
+	iter->prog = prog;
+	iter->map = map;
+	iter->ctx_size = ctx_size;
+
+	return iter;
+}
+
+/* Parse the conversion specification following a '%' in @fmt, return its
+ * length and the number of 'l' length modifiers in @mod.
+ */
+static int bpf_seq_printf_spec(const char *fmt, int *mod)
+{
+	int i = 0;
+
+	while (fmt[i] && strchr("-+ #0", fmt[i]))
+		i++;
+	while (isdigit(fmt[i]))
+		i++;
+
+	for (*mod = 0; fmt[i] == 'l' && *mod < 2; i++)
+		(*mod)++;
+
+	if (!fmt[i] || !strchr("diuxXc", fmt[i]))
+		return -EINVAL;
+
+	return i + 1;
+}
+
+#define BPF_SEQ_PRINTF_SPEC_MAX	16
+#define BPF_SEQ_PRINTF_FMT_MAX	512
+
+/* The format can be map memory that changes under us: it is checked and
+ * printed from a copy.  Iterator programs run with preemption disabled
+ * and never from interrupts, one at a time on a CPU.
+ */
+static DEFINE_PER_CPU(char [BPF_SEQ_PRINTF_FMT_MAX], bpf_seq_printf_buf);
+
+BPF_CALL_5(bpf_seq_printf, void *, ctx, char *, unsafe_fmt, u32, fmt_size,
+	   const void *, data, u32, data_len)
+{
+	struct seq_file *seq = bpf_iter_ctx_seq(ctx);
+	char spec[BPF_SEQ_PRINTF_SPEC_MAX];
+	int i, len, mod, start, nargs = 0;
+	const u64 *args = data;
+	char *fmt;
+
+	if (fmt_size > BPF_SEQ_PRINTF_FMT_MAX)
+		return -E2BIG;
+	fmt = this_cpu_ptr(bpf_seq_printf_buf);
+	memcpy(fmt, unsafe_fmt, fmt_size);
+	if (fmt[fmt_size - 1] != 0 || data_len % sizeof(u64))
+		return -EINVAL;
+
+	/* Check the whole format before printing any of it */
+	for (i = 0; fmt[i]; i++) {
+		if (fmt[i] != '%')
+			continue;
+		if (fmt[++i] == '%')
+			continue;
+
+		len = bpf_seq_printf_spec(fmt + i, &mod);
+		if (len < 0 || len + 2 > sizeof(spec) ||
+		    ++nargs > data_len / sizeof(u64))
+			return -EINVAL;
+		i += len - 1;
+	}
+	if (nargs != data_len / sizeof(u64))
+		return -EINVAL;
+
+	/* and print it one conversion at a time, each with its own type */
+	for (i = start = nargs = 0; fmt[i]; i++) {
+		if (fmt[i] != '%')
+			continue;
+
+		seq_write(seq, fmt + start, i - start);
+		if (fmt[i + 1] == '%') {
+			seq_putc(seq, '%');
+			start = ++i + 1;
+			continue;
+		}
+
+		len = bpf_seq_printf_spec(fmt + i + 1, &mod);
+		memcpy(spec, fmt + i, len + 1);
+		spec[len + 1] = 0;
+
+		if (mod == 2)
+			seq_printf(seq, spec, (unsigned long long)args[nargs]);
+		else if (mod == 1)
+			seq_printf(seq, spec, (unsigned long)args[nargs]);
+		else
+			seq_printf(seq, spec, (unsigned int)args[nargs]);
+		nargs++;
+
+		i += len;
+		start = i + 1;
+	}
+	seq_write(seq, fmt + start, i - start);
+
+	return seq_has_overflowed(seq) ? -EOVERFLOW : 0;
+}
+
+static const struct bpf_func_proto bpf_seq_printf_proto = {
+	.func		= bpf_seq_printf,
+	.gpl_only	= true,
+	.ret_type	= RET_INTEGER,
+	.arg1_type	= ARG_PTR_TO_CTX,
+	.arg2_type	= ARG_PTR_TO_MEM,
+	.arg3_type	= ARG_CONST_SIZE,
+	.arg4_type	= ARG_PTR_TO_MEM_OR_NULL,
+	.arg5_type	= ARG_CONST_SIZE_OR_ZERO,
+};
+
+BPF_CALL_3(bpf_seq_write, void *, ctx, const void *, data, u32, len)
+{
+	struct seq_file *seq = bpf_iter_ctx_seq(ctx);
+
+	seq_write(seq, data, len);
+
+	return seq_has_overflowed(seq) ? -EOVERFLOW : 0;
+}
+
+static const struct bpf_func_proto bpf_seq_write_proto = {
+	.func		= bpf_seq_write,
+	.gpl_only	= true,
+	.ret_type	= RET_INTEGER,
+	.arg1_type	= ARG_PTR_TO_CTX,
+	.arg2_type	= ARG_PTR_TO_MEM,
+	.arg3_type	= ARG_CONST_SIZE_OR_ZERO,
+};
+
+static const struct bpf_func_proto *
+bpf_iter_func_proto(enum bpf_func_id func_id, const struct bpf_prog *prog)
+{
+	switch (func_id) {
+	case BPF_FUNC_seq_printf:
+		return &bpf_seq_printf_proto;
+	case BPF_FUNC_seq_write:
+		return &bpf_seq_write_proto;
+	case BPF_FUNC_map_lookup_elem:
+		return &bpf_map_lookup_elem_proto;
+	case BPF_FUNC_map_update_elem:
+		return &bpf_map_update_elem_proto;
+	case BPF_FUNC_map_delete_elem:
+		return &bpf_map_delete_elem_proto;
+	case BPF_FUNC_get_prandom_u32:
+		return &bpf_get_prandom_u32_proto;
+	case BPF_FUNC_get_smp_processor_id:
+		return &bpf_get_smp_processor_id_proto;
+	case BPF_FUNC_ktime_get_ns:
+		return &bpf_ktime_get_ns_proto;
+	case BPF_FUNC_tail_call:
+		return &bpf_tail_call_proto;
+	default:
+		return NULL;
+	}
+}
+
+static bool bpf_iter_is_valid_access(int off, int size,
+				     enum bpf_access_type type,
+				     const struct bpf_prog *prog,
+				     struct bpf_insn_access_aux *info)
+{
+	const struct bpf_iter_target *target;
+
+	target = bpf_iter_find_target(prog->expected_attach_type);
+	if (!target || type != BPF_READ)
+		return false;
+	if (off < 0 || off % size || off + size > target->ctx_size)
+		return false;
+
+	return true;
+}
+
+const struct bpf_verifier_ops bpf_iter_verifier_ops = {
+	.get_func_proto		= bpf_iter_func_proto,
+	.is_valid_access	= bpf_iter_is_valid_access,
+};
+
+const struct bpf_prog_ops bpf_iter_prog_ops = {
+};
@@ -0,0 +1,498 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * Storage shared by the BPF local storage maps.
+ *
+ * Each element is on two lists: the list of its owner's bpf_local_storage,
+ * which lookups walk under RCU, and a bucket list of its map, which is only
+ * walked to free the elements when the map goes away. An element is linked
+ * to the map before it is published to its owner and unlinked from the map
+ * before it is unlinked from its owner. Lock ordering is storage->lock
+ * before bucket->lock.
+ */
+#include <linux/bpf.h>
+#include <linux/bpf_local_storage.h>
+#include <linux/capability.h>
+#include <linux/err.h>
+#include <linux/hash.h>
+#include <linux/log2.h>
+#include <linux/mm.h>
+#include <linux/rculist.h>
+#include <linux/sched.h>
+#include <linux/slab.h>
+
+#define BPF_LOCAL_STORAGE_CREATE_FLAG_MASK \
+	(BPF_F_NO_PREALLOC | BPF_F_RDONLY | BPF_F_WRONLY)
+
+#define BPF_LOCAL_STORAGE_MAX_VALUE_SIZE				\
+	min_t(u32, KMALLOC_MAX_SIZE - MAX_BPF_STACK -			\
+		   sizeof(struct bpf_local_storage_elem),		\
+	      U16_MAX - sizeof(struct bpf_local_storage_elem))
+
+DEFINE_PER_CPU(int, bpf_local_storage_busy);
+
+static struct bpf_local_storage_map_bucket *
+select_bucket(struct bpf_local_storage_map *smap,
+	      struct bpf_local_storage_elem *selem)
+{
+	return &smap->buckets[hash_ptr(selem, smap->bucket_log)];
+}
+
+static bool selem_linked_to_storage(const struct bpf_local_storage_elem *selem)
+{
+	return !hlist_unhashed(&selem->snode);
+}
+
+static bool selem_linked_to_map(const struct bpf_local_storage_elem *selem)
+{
+	return !hlist_unhashed(&selem->map_node);
+}
+
+static struct bpf_local_storage_elem *
+bpf_selem_alloc(struct bpf_local_storage_map *smap, void *value)
+{
+	struct bpf_local_storage_elem *selem;
+
+	selem = kzalloc(smap->elem_size, GFP_ATOMIC | __GFP_NOWARN);
+	if (selem && value)
+		memcpy(SDATA(selem)->data, value, smap->map.value_size);
+	return selem;
+}
+
+/* local_storage->lock must be held. Returns true if selem was the last
+ * element and local_storage has to be freed by the caller once the lock is
+ * dropped.
+ */
+static bool
+bpf_selem_unlink_storage_nolock(struct bpf_local_storage *local_storage,
+				struct bpf_local_storage_elem *selem)
+{
+	struct bpf_local_storage_map *smap;
+	bool free_local_storage;
+
+	smap = rcu_dereference(SDATA(selem)->smap);
+	free_local_storage = hlist_is_singular_node(&selem->snode,
+						    &local_storage->list);
+	if (free_local_storage) {
+		/* The owner no longer points to the storage, so the update
+		 * of a racing bpf_local_storage_update() allocates a new
+		 * one. Its own update of this storage sees the empty list
+		 * under the lock and backs off.
+		 */
+		RCU_INIT_POINTER(*local_storage->owner_storage, NULL);
+		local_storage->owner_storage = NULL;
+	}
+	hlist_del_init_rcu(&selem->snode);
+	if (rcu_access_pointer(local_storage->cache[smap->cache_idx]) ==
+	    SDATA(selem))
+		RCU_INIT_POINTER(local_storage->cache[smap->cache_idx], NULL);
+
+	kfree_rcu(selem, rcu);
+
+	return free_local_storage;
+}
+
+static void bpf_selem_unlink_storage(struct bpf_local_storage_elem *selem)
+{
+	struct bpf_local_storage *local_storage;
+	bool free_local_storage = false;
+	unsigned long flags;
+
+	if (unlikely(!selem_linked_to_storage(selem)))
+		/* selem has already been unlinked from its owner */
+		return;
+
+	local_storage = rcu_dereference(selem->local_storage);
+	raw_spin_lock_irqsave(&local_storage->lock, flags);
+	if (likely(selem_linked_to_storage(selem)))
+		free_local_storage =
+			bpf_selem_unlink_storage_nolock(local_storage, selem);
+	raw_spin_unlock_irqrestore(&local_storage->lock, flags);
+
+	if (free_local_storage)
+		kfree_rcu(local_storage, rcu);
+}
+
+static void bpf_selem_link_storage_nolock(struct bpf_local_storage *local_storage,
+					  struct bpf_local_storage_elem *selem)
+{
+	RCU_INIT_POINTER(selem->local_storage, local_storage);
+	hlist_add_head_rcu(&selem->snode, &local_storage->list);
+}
+
+static void bpf_selem_unlink_map(struct bpf_local_storage_elem *selem)
+{
+	struct bpf_local_storage_map_bucket *b;
+	struct bpf_local_storage_map *smap;
+	unsigned long flags;
+
+	if (unlikely(!selem_linked_to_map(selem)))
+		/* selem has already been unlinked from its map */
+		return;
+
+	smap = rcu_dereference(SDATA(selem)->smap);
+	b = select_bucket(smap, selem);
+	raw_spin_lock_irqsave(&b->lock, flags);
+	if (likely(selem_linked_to_map(selem)))
+		hlist_del_init_rcu(&selem->map_node);
+	raw_spin_unlock_irqrestore(&b->lock, flags);
+}
+
+static void bpf_selem_link_map(struct bpf_local_storage_map *smap,
+			       struct bpf_local_storage_elem *selem)
+{
+	struct bpf_local_storage_map_bucket *b = select_bucket(smap, selem);
+	unsigned long flags;
+
+	raw_spin_lock_irqsave(&b->lock, flags);
+	RCU_INIT_POINTER(SDATA(selem)->smap, smap);
+	hlist_add_head_rcu(&selem->map_node, &b->list);
+	raw_spin_unlock_irqrestore(&b->lock, flags);
+}
+
+void bpf_selem_unlink(struct bpf_local_storage_elem *selem)
+{
+	/* Always unlink from the map first, as bpf_local_storage_map_free()
+	 * walks the map lists to find the elements still linked anywhere.
+	 */
+	bpf_selem_unlink_map(selem);
+	bpf_selem_unlink_storage(selem);
+}
+
+struct bpf_local_storage_data *
+bpf_local_storage_lookup(struct bpf_local_storage *local_storage,
+			 struct bpf_local_storage_map *smap,
+			 bool cacheit_lockit)
+{
+	struct bpf_local_storage_data *sdata;
+	struct bpf_local_storage_elem *selem;
+
+	/* Fast path (cache hit) */
+	sdata = rcu_dereference(local_storage->cache[smap->cache_idx]);
+	if (sdata && rcu_access_pointer(sdata->smap) == smap)
+		return sdata;
+
+	/* Slow path (cache miss) */
+	hlist_for_each_entry_rcu(selem, &local_storage->list, snode)
+		if (rcu_access_pointer(SDATA(selem)->smap) == smap)
+			break;
+
+	if (!selem)
+		return NULL;
+
+	sdata = SDATA(selem);
+	if (cacheit_lockit) {
+		unsigned long flags;
+
+		/* The lock keeps an element being unlinked out of the cache,
+		 * bpf_selem_unlink_storage_nolock() clears its slot.
+		 */
+		raw_spin_lock_irqsave(&local_storage->lock, flags);
+		if (selem_linked_to_storage(selem))
+			rcu_assign_pointer(local_storage->cache[smap->cache_idx],
+					   sdata);
+		raw_spin_unlock_irqrestore(&local_storage->lock, flags);
+	}
+
+	return sdata;
+}
+
+static int check_flags(const struct bpf_local_storage_data *old_sdata,
+		       u64 map_flags)
+{
+	if (old_sdata && map_flags == BPF_NOEXIST)
+		/* elem already exists */
+		return -EEXIST;
+
+	if (!old_sdata && map_flags == BPF_EXIST)
+		/* elem doesn't exist, cannot update it */
+		return -ENOENT;
+
+	return 0;
+}
+
+static int bpf_local_storage_alloc(struct bpf_local_storage __rcu **owner_storage,
+				   struct bpf_local_storage_map *smap,
+				   struct bpf_local_storage_elem *first_selem)
+{
+	struct bpf_local_storage *prev_storage, *storage;
+
+	storage = kzalloc(sizeof(*storage), GFP_ATOMIC | __GFP_NOWARN);
+	if (!storage)
+		return -ENOMEM;
+
+	INIT_HLIST_HEAD(&storage->list);
+	raw_spin_lock_init(&storage->lock);
+	storage->owner_storage = owner_storage;
+
+	bpf_selem_link_storage_nolock(storage, first_selem);
+	bpf_selem_link_map(smap, first_selem);
+
+	/* Publish the storage to the owner. Instead of taking a lock of the
+	 * owner, cmpxchg() settles a race with any other update creating
+	 * the first element, the first one wins.
+	 */
+	prev_storage = cmpxchg((struct bpf_local_storage **)owner_storage,
+			       NULL, storage);
+	if (unlikely(prev_storage)) {
+		bpf_selem_unlink_map(first_selem);
+		/* The storage was never seen by anyone. first_selem was on
+		 * the map list, but only bpf_local_storage_map_free() walks
+		 * that, after a synchronize_rcu() which excludes us, so the
+		 * caller may kfree() it right away too.
+		 */
+		kfree(storage);
+		return -EAGAIN;
+	}
+
+	return 0;
+}
+
+/* Set the value of the owner of *owner_storage in smap, to zeroes if value
+ * is NULL. Called under rcu_read_lock() with bpf_local_storage_lock() held,
+ * the owner must be pinned by the caller.
+ */
+struct bpf_local_storage_data *
+bpf_local_storage_update(struct bpf_local_storage __rcu **owner_storage,
+			 struct bpf_local_storage_map *smap, void *value,
+			 u64 map_flags)
+{
+	struct bpf_local_storage_data *old_sdata;
+	struct bpf_local_storage *local_storage;
+	struct bpf_local_storage_elem *selem;
+	unsigned long flags;
+	int err;
+
+	if (unlikely(map_flags > BPF_EXIST))
+		/* BPF_F_LOCK is not supported */
+		return ERR_PTR(-EINVAL);
+
+	local_storage = rcu_dereference(*owner_storage);
+	if (!local_storage) {
+		/* Very first element of the owner */
+		err = check_flags(NULL, map_flags);
+		if (err)
+			return ERR_PTR(err);
+
+		selem = bpf_selem_alloc(smap, value);
+		if (!selem)
+			return ERR_PTR(-ENOMEM);
+
+		err = bpf_local_storage_alloc(owner_storage, smap, selem);
+		if (err) {
+			kfree(selem);
+			return ERR_PTR(err);
+		}
+
+		return SDATA(selem);
+	}
+
+	raw_spin_lock_irqsave(&local_storage->lock, flags);
+
+	/* Recheck local_storage->list under local_storage->lock */
+	if (unlikely(hlist_empty(&local_storage->list))) {
+		/* A parallel delete is freeing local_storage. It was just
+		 * seen in use, so this is very unlikely. Return instead of
+		 * retrying to keep things simple.
+		 */
+		err = -EAGAIN;
+		goto unlock_err;
+	}
+
+	old_sdata = bpf_local_storage_lookup(local_storage, smap, false);
+	err = check_flags(old_sdata, map_flags);
+	if (err)
+		goto unlock_err;
+
+	selem = bpf_selem_alloc(smap, value);
+	if (!selem) {
+		err = -ENOMEM;
+		goto unlock_err;
+	}
+
+	/* First, link the new selem to the map */
+	bpf_selem_link_map(smap, selem);
+
+	/* Second, link (and publish) the new selem to local_storage */
+	bpf_selem_link_storage_nolock(local_storage, selem);
+
+	/* Third, remove the old selem, local_storage is not freed as the
+	 * new selem is on its list.
+	 */
+	if (old_sdata) {
+		bpf_selem_unlink_map(SELEM(old_sdata));
+		bpf_selem_unlink_storage_nolock(local_storage, SELEM(old_sdata));
+	}
+
+	raw_spin_unlock_irqrestore(&local_storage->lock, flags);
+	return SDATA(selem);
+
+unlock_err:
+	raw_spin_unlock_irqrestore(&local_storage->lock, flags);
+	return ERR_PTR(err);
+}
+
+/* Free all the values of an owner which is going away. Called under
+ * rcu_read_lock() with bpf_local_storage_lock() held.
+ */
+void bpf_local_storage_destroy(struct bpf_local_storage *local_storage)
+{
+	struct bpf_local_storage_elem *selem;
+	bool free_local_storage = false;
+	struct hlist_node *n;
+	unsigned long flags;
+
+	/* Neither the owner nor local_storage can be found by a program
+	 * any more, but a map may still be freeing elements of it. Each
+	 * selem is unlinked from its map and then from local_storage, the
+	 * last one clears the owner's pointer.
+	 */
+	raw_spin_lock_irqsave(&local_storage->lock, flags);
+	hlist_for_each_entry_safe(selem, n, &local_storage->list, snode) {
+		bpf_selem_unlink_map(selem);
+		free_local_storage =
+			bpf_selem_unlink_storage_nolock(local_storage, selem);
+	}
+	raw_spin_unlock_irqrestore(&local_storage->lock, flags);
+
+	if (free_local_storage)
+		kfree_rcu(local_storage, rcu);
+}
+
+u16 bpf_local_storage_cache_idx_get(struct bpf_local_storage_cache *cache)
+{
+	u64 min_usage = U64_MAX;
+	u16 i, res = 0;
+
+	spin_lock(&cache->idx_lock);
+
+	for (i = 0; i < BPF_LOCAL_STORAGE_CACHE_SIZE; i++) {
+		if (cache->idx_usage_counts[i] < min_usage) {
+			min_usage = cache->idx_usage_counts[i];
+			res = i;
+
+			/* Found a free cache_idx */
+			if (!min_usage)
+				break;
+		}
+	}
+	cache->idx_usage_counts[res]++;
+
+	spin_unlock(&cache->idx_lock);
+
+	return res;
+}
+
+void bpf_local_storage_cache_idx_free(struct bpf_local_storage_cache *cache,
+				      u16 idx)
+{
+	spin_lock(&cache->idx_lock);
+	cache->idx_usage_counts[idx]--;
+	spin_unlock(&cache->idx_lock);
+}
+
+/* Called from syscall */
+int bpf_local_storage_map_alloc_check(union bpf_attr *attr)
+{
+	if (attr->map_flags & ~BPF_LOCAL_STORAGE_CREATE_FLAG_MASK ||
+	    !(attr->map_flags & BPF_F_NO_PREALLOC) ||
+	    attr->max_entries ||
+	    attr->key_size != sizeof(int) || !attr->value_size)
+		return -EINVAL;
+
+	/* Values are not charged to the map, and can be created for any
+	 * task or inode.
+	 */
+	if (!capable(CAP_SYS_ADMIN))
+		return -EPERM;
+
+	if (attr->value_size > BPF_LOCAL_STORAGE_MAX_VALUE_SIZE)
+		return -E2BIG;
+
+	return 0;
+}
+
+struct bpf_local_storage_map *bpf_local_storage_map_alloc(union bpf_attr *attr)
+{
+	struct bpf_local_storage_map *smap;
+	unsigned int i;
+	u32 nbuckets;
+	u64 cost;
+	int err;
+
+	smap = kzalloc(sizeof(*smap), GFP_USER | __GFP_NOWARN);
+	if (!smap)
+		return ERR_PTR(-ENOMEM);
+	bpf_map_init_from_attr(&smap->map, attr);
+
+	nbuckets = roundup_pow_of_two(num_possible_cpus());
+	/* Use at least 2 buckets, select_bucket() is undefined behavior with
+	 * 1 bucket.
+	 */
+	nbuckets = max_t(u32, 2, nbuckets);
+	smap->bucket_log = ilog2(nbuckets);
+	cost = sizeof(*smap->buckets) * nbuckets + sizeof(*smap);
+	smap->map.pages = round_up(cost, PAGE_SIZE) >> PAGE_SHIFT;
+
+	err = bpf_map_precharge_memlock(smap->map.pages);
+	if (err)
+		goto free_smap;
+
+	err = -ENOMEM;
+	smap->buckets = kvcalloc(nbuckets, sizeof(*smap->buckets),
+				 GFP_USER | __GFP_NOWARN);
+	if (!smap->buckets)
+		goto free_smap;
+
+	for (i = 0; i < nbuckets; i++) {
+		INIT_HLIST_HEAD(&smap->buckets[i].list);
+		raw_spin_lock_init(&smap->buckets[i].lock);
+	}
+
+	smap->elem_size = sizeof(struct bpf_local_storage_elem) +
+			  attr->value_size;
+
+	return smap;
+
+free_smap:
+	kfree(smap);
+	return ERR_PTR(err);
+}
+
+void bpf_local_storage_map_free(struct bpf_local_storage_map *smap)
+{
+	struct bpf_local_storage_elem *selem;
+	struct bpf_local_storage_map_bucket *b;
+	unsigned int i;
+
+	/* No program and no syscall can reach the map any more, so nobody
+	 * adds elements to it, but owners are still being freed and programs
+	 * already running may still be walking their storage. Wait for those
+	 * before unlinking what is left.
+	 */
+	synchronize_rcu();
+
+	for (i = 0; i < (1U << smap->bucket_log); i++) {
+		b = &smap->buckets[i];
+
+		rcu_read_lock();
+		/* No one is adding to b->list now */
+		while ((selem = hlist_entry_safe(
+				rcu_dereference_raw(hlist_first_rcu(&b->list)),
+				struct bpf_local_storage_elem, map_node))) {
+			bpf_local_storage_lock();
+			bpf_selem_unlink(selem);
+			bpf_local_storage_unlock();
+			cond_resched_rcu();
+		}
+		rcu_read_unlock();
+	}
+
+	/* An owner being freed may have unlinked an element from the map,
+	 * which made the loop above skip it, and still look at smap to
+	 * unlink it from its storage. Wait for it before freeing smap.
+	 */
+	synchronize_rcu();
+
+	kvfree(smap->buckets);
+	kfree(smap);
+}
@@ -0,0 +1,211 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * BPF_MAP_TYPE_TASK_STORAGE: a value per task, kept in the task_struct.
+ *
+ * Programs get and delete the value of the current task, user space
+ * addresses tasks by pid in its pid namespace. Values are freed with the
+ * task.
+ */
+#include <linux/bpf.h>
+#include <linux/bpf_local_storage.h>
+#include <linux/err.h>
+#include <linux/filter.h>
+#include <linux/hardirq.h>
+#include <linux/rcupdate.h>
+#include <linux/sched.h>
+#include <linux/sched/task.h>
+
+DEFINE_BPF_STORAGE_CACHE(task_cache);
+
+static struct bpf_local_storage_data *
+task_storage_lookup(struct task_struct *task, struct bpf_map *map,
+		    bool cacheit_lockit)
+{
+	struct bpf_local_storage *task_storage;
+	struct bpf_local_storage_map *smap;
+
+	task_storage = rcu_dereference(task->bpf_storage);
+	if (!task_storage)
+		return NULL;
+
+	smap = (struct bpf_local_storage_map *)map;
+	return bpf_local_storage_lookup(task_storage, smap, cacheit_lockit);
+}
+
+static int task_storage_delete(struct task_struct *task, struct bpf_map *map)
+{
+	struct bpf_local_storage_data *sdata;
+
+	sdata = task_storage_lookup(task, map, false);
+	if (!sdata)
+		return -ENOENT;
+
+	bpf_selem_unlink(SELEM(sdata));
+
+	return 0;
+}
+
+/* Called from free_task() */
+void bpf_task_storage_free(struct task_struct *task)
+{
+	struct bpf_local_storage *local_storage;
+
+	rcu_read_lock();
+
+	local_storage = rcu_dereference(task->bpf_storage);
+	if (local_storage) {
+		bpf_local_storage_lock();
+		bpf_local_storage_destroy(local_storage);
+		bpf_local_storage_unlock();
+	}
+
+	rcu_read_unlock();
+}
+
+/* Called from syscall, in an RCU read-side critical section */
+static void *task_storage_map_lookup_elem(struct bpf_map *map, void *key)
+{
+	struct bpf_local_storage_data *sdata;
+	struct task_struct *task;
+
+	task = find_get_task_by_vpid(*(pid_t *)key);
+	if (!task)
+		return NULL;
+
+	sdata = task_storage_lookup(task, map, false);
+	put_task_struct(task);
+
+	/* the element is freed after an RCU grace period */
+	return sdata ? sdata->data : NULL;
+}
+
+static int task_storage_map_update_elem(struct bpf_map *map, void *key,
+					void *value, u64 map_flags)
+{
+	struct bpf_local_storage_data *sdata;
+	struct task_struct *task;
+
+	task = find_get_task_by_vpid(*(pid_t *)key);
+	if (!task)
+		return -ESRCH;
+
+	bpf_local_storage_lock();
+	sdata = bpf_local_storage_update(&task->bpf_storage,
+					 (struct bpf_local_storage_map *)map,
+					 value, map_flags);
+	bpf_local_storage_unlock();
+
+	put_task_struct(task);
+
+	return PTR_ERR_OR_ZERO(sdata);
+}
+
+static int task_storage_map_delete_elem(struct bpf_map *map, void *key)
+{
+	struct task_struct *task;
+	int err;
+
+	task = find_get_task_by_vpid(*(pid_t *)key);
+	if (!task)
+		return -ESRCH;
+
+	bpf_local_storage_lock();
+	err = task_storage_delete(task, map);
+	bpf_local_storage_unlock();
+
+	put_task_struct(task);
+
+	return err;
+}
+
+static int notsupp_get_next_key(struct bpf_map *map, void *key,
+				void *next_key)
+{
+	return -ENOTSUPP;
+}
+
+static struct bpf_map *task_storage_map_alloc(union bpf_attr *attr)
+{
+	struct bpf_local_storage_map *smap;
+
+	smap = bpf_local_storage_map_alloc(attr);
+	if (IS_ERR(smap))
+		return ERR_CAST(smap);
+
+	smap->cache_idx = bpf_local_storage_cache_idx_get(&task_cache);
+	return &smap->map;
+}
+
+static void task_storage_map_free(struct bpf_map *map)
+{
+	struct bpf_local_storage_map *smap;
+
+	smap = (struct bpf_local_storage_map *)map;
+	bpf_local_storage_cache_idx_free(&task_cache, smap->cache_idx);
+	bpf_local_storage_map_free(smap);
+}
+
+const struct bpf_map_ops task_storage_map_ops = {
+	.map_alloc_check = bpf_local_storage_map_alloc_check,
+	.map_alloc = task_storage_map_alloc,
+	.map_free = task_storage_map_free,
+	.map_get_next_key = notsupp_get_next_key,
+	.map_lookup_elem = task_storage_map_lookup_elem,
+	.map_update_elem = task_storage_map_update_elem,
+	.map_delete_elem = task_storage_map_delete_elem,
+};
+
+BPF_CALL_2(bpf_task_storage_get, struct bpf_map *, map, u64, flags)
+{
+	struct bpf_local_storage_data *sdata;
+
+	if (flags & ~BPF_LOCAL_STORAGE_GET_F_CREATE)
+		return (unsigned long)NULL;
+
+	if (!bpf_local_storage_trylock())
+		return (unsigned long)NULL;
+
+	sdata = task_storage_lookup(current, map, true);
+	/* the allocators and call_rcu() are not NMI safe */
+	if (!sdata && (flags & BPF_LOCAL_STORAGE_GET_F_CREATE) && !in_nmi())
+		sdata = bpf_local_storage_update(&current->bpf_storage,
+						 (struct bpf_local_storage_map *)map,
+						 NULL, BPF_NOEXIST);
+
+	bpf_local_storage_unlock();
+
+	return IS_ERR_OR_NULL(sdata) ? (unsigned long)NULL :
+		(unsigned long)sdata->data;
+}
+
+BPF_CALL_1(bpf_task_storage_delete, struct bpf_map *, map)
+{
+	int err;
+
+	if (in_nmi())
+		return -EBUSY;
+
+	if (!bpf_local_storage_trylock())
+		return -EBUSY;
+
+	err = task_storage_delete(current, map);
+
+	bpf_local_storage_unlock();
+
+	return err;
+}
+
+const struct bpf_func_proto bpf_task_storage_get_proto = {
+	.func		= bpf_task_storage_get,
+	.gpl_only	= false,
+	.ret_type	= RET_PTR_TO_MAP_VALUE_OR_NULL,
+	.arg1_type	= ARG_CONST_MAP_PTR,
+	.arg2_type	= ARG_ANYTHING,
+};
+
+const struct bpf_func_proto bpf_task_storage_delete_proto = {
+	.func		= bpf_task_storage_delete,
+	.gpl_only	= false,
+	.ret_type	= RET_INTEGER,
+	.arg1_type	= ARG_CONST_MAP_PTR,
+};
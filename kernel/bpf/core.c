@@ -1859,6 +1859,11 @@ const struct bpf_func_proto bpf_sock_map_update_proto __weak;
 const struct bpf_func_proto bpf_sock_hash_update_proto __weak;
 const struct bpf_func_proto bpf_get_current_cgroup_id_proto __weak;
 const struct bpf_func_proto bpf_get_local_storage_proto __weak;
+const struct bpf_func_proto bpf_ringbuf_output_proto __weak;
+const struct bpf_func_proto bpf_ringbuf_reserve_proto __weak;
+const struct bpf_func_proto bpf_ringbuf_submit_proto __weak;
+const struct bpf_func_proto bpf_ringbuf_discard_proto __weak;
+const struct bpf_func_proto bpf_ringbuf_query_proto __weak;
 
 const struct bpf_func_proto * __weak bpf_get_trace_printk_proto(void)
 {
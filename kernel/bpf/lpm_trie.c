@@ -12,9 +12,15 @@
 #include <linux/bpf.h>
 #include <linux/btf.h>
 #include <linux/err.h>
+#include <linux/irq_work.h>
+#include <linux/mm.h>
+#include <linux/seq_file.h>
+#include <linux/seqlock.h>
 #include <linux/slab.h>
+#include <linux/sort.h>
 #include <linux/spinlock.h>
 #include <linux/vmalloc.h>
+#include <linux/workqueue.h>
 #include <net/ipv6.h>
 #include <uapi/linux/btf.h>
 
@@ -31,6 +37,29 @@ struct lpm_trie_node {
 	u8				data[0];
 };
 
+/* Multibit lookup table, see BPF_F_LPM_MULTIBIT below */
+#define LPM_MB_STRIDE		8
+#define LPM_MB_FANOUT		(1 << LPM_MB_STRIDE)
+#define LPM_MB_DATA_SIZE_MAX	16
+#define LPM_MB_REBUILD_DELAY	(HZ / 100)
+
+struct lpm_mb_node {
+	u64				child_map[LPM_MB_FANOUT / 64];
+	u64				leaf_map[LPM_MB_FANOUT / 64];
+	u32				child_base;
+	u32				leaf_base;
+};
+
+struct lpm_mb_table {
+	struct rcu_head			rcu;
+	unsigned int			seq;
+	bool				stale;
+	u32				nr_nodes;
+	u32				nr_leaves;
+	struct lpm_trie_node		**leaves;
+	struct lpm_mb_node		nodes[0];
+};
+
 struct lpm_trie {
 	struct bpf_map			map;
 	struct lpm_trie_node __rcu	*root;
@@ -38,6 +67,10 @@ struct lpm_trie {
 	size_t				max_prefixlen;
 	size_t				data_size;
 	raw_spinlock_t			lock;
+	seqcount_t			seq;
+	struct lpm_mb_table __rcu	*mb_table;
+	struct delayed_work		rebuild_work;
+	struct irq_work			rebuild_irq_work;
 };
 
 /* This trie implements a longest prefix match algorithm that can be used to
@@ -149,6 +182,27 @@ struct lpm_trie {
  * is a child that can be used to become more specific, the trie is traversed
  * downwards. The last node in the traversal that is a non-intermediate one is
  * returned.
+ *
+ * Walking the trie costs up to one cache miss per prefix bit, which adds up
+ * for large IPv6 tables. Maps created with BPF_F_LPM_MULTIBIT additionally
+ * keep a read-only multibit table that consumes the key one byte at a time,
+ * so a lookup visits at most data_size table nodes:
+ *
+ * Every table node covers the 256 values of one key byte. Entry i of a node
+ * at depth d holds the longest prefix of length <= 8 * (d + 1) that matches
+ * the key bytes leading to the node followed by i ("leaf pushing"), and a
+ * child node if longer prefixes exist below it. Both arrays are compressed
+ * with bitmaps as in poptrie: a set bit in @child_map marks an entry with a
+ * child, a set bit in @leaf_map an entry whose leaf differs from the one of
+ * the entry before. The children and leaves of a node are stored back to
+ * back, so the index of entry i is the number of bits set below it.
+ *
+ * The trie stays the authoritative copy, updates and deletes only mark
+ * the table stale and schedule a rebuild from a snapshot of the trie, at
+ * most LPM_MB_REBUILD_DELAY after the first of a batch of updates. Lookups
+ * walk the trie while the table is stale. @seq detects updates racing with
+ * the snapshot; a table is installed under the trie lock, only if the trie
+ * did not change since.
  */
 
 static inline int extract_bit(const u8 *data, size_t index)
@@ -187,12 +241,62 @@ static size_t longest_prefix_match(const struct lpm_trie *trie,
 	return prefixlen;
 }
 
+/* Number of bits set in @map below @bit */
+static inline u32 lpm_mb_rank(const u64 *map, unsigned int bit)
+{
+	u32 i, n = 0;
+
+	for (i = 0; i < bit / 64; i++)
+		n += hweight64(map[i]);
+
+	return n + hweight64(map[i] & (BIT_ULL(bit % 64) - 1));
+}
+
+static inline bool lpm_mb_test(const u64 *map, unsigned int bit)
+{
+	return map[bit / 64] & BIT_ULL(bit % 64);
+}
+
+static struct lpm_trie_node *lpm_mb_lookup(const struct lpm_mb_table *tbl,
+					   const u8 *data, size_t data_size)
+{
+	const struct lpm_mb_node *node = tbl->nodes;
+	struct lpm_trie_node *found = NULL;
+	size_t i;
+
+	for (i = 0; i < data_size; i++) {
+		unsigned int b = data[i];
+
+		found = tbl->leaves[node->leaf_base +
+				    lpm_mb_rank(node->leaf_map, b) +
+				    lpm_mb_test(node->leaf_map, b) - 1];
+		if (!lpm_mb_test(node->child_map, b))
+			break;
+
+		node = &tbl->nodes[node->child_base +
+				   lpm_mb_rank(node->child_map, b)];
+	}
+
+	return found;
+}
+
 /* Called from syscall or from eBPF program */
 static void *trie_lookup_elem(struct bpf_map *map, void *_key)
 {
 	struct lpm_trie *trie = container_of(map, struct lpm_trie, map);
 	struct lpm_trie_node *node, *found = NULL;
 	struct bpf_lpm_trie_key *key = _key;
+	struct lpm_mb_table *tbl;
+
+	/* The multibit table only answers full length lookups, and only
+	 * until the trie is modified again.
+	 */
+	tbl = rcu_dereference(trie->mb_table);
+	if (tbl && key->prefixlen == trie->max_prefixlen &&
+	    !READ_ONCE(tbl->stale)) {
+		found = lpm_mb_lookup(tbl, key->data, trie->data_size);
+		return found ? found->data + trie->data_size : NULL;
+	}
 
 	/* Start walking the trie from the root node ... */
 
@@ -260,6 +364,39 @@ static struct lpm_trie_node *lpm_trie_node_alloc(const struct lpm_trie *trie,
 	return node;
 }
 
+static void trie_rebuild_irq_work(struct irq_work *work)
+{
+	struct lpm_trie *trie = container_of(work, struct lpm_trie,
+					     rebuild_irq_work);
+
+	queue_delayed_work(system_wq, &trie->rebuild_work, LPM_MB_REBUILD_DELAY);
+}
+
+static void trie_schedule_rebuild(struct lpm_trie *trie)
+{
+	if (!(trie->map.map_flags & BPF_F_LPM_MULTIBIT))
+		return;
+	/* perf_event programs update from NMIs, which cannot take the timer
+	 * and workqueue locks
+	 */
+	if (in_nmi())
+		irq_work_queue(&trie->rebuild_irq_work);
+	else
+		queue_delayed_work(system_wq, &trie->rebuild_work,
+				   LPM_MB_REBUILD_DELAY);
+}
+
+/* The trie is about to change, under trie->lock */
+static void trie_mb_table_invalidate(struct lpm_trie *trie)
+{
+	struct lpm_mb_table *tbl;
+
+	tbl = rcu_dereference_protected(trie->mb_table,
+					lockdep_is_held(&trie->lock));
+	if (tbl)
+		WRITE_ONCE(tbl->stale, true);
+}
+
 /* Called from syscall or from eBPF program */
 static int trie_update_elem(struct bpf_map *map,
 			    void *_key, void *value, u64 flags)
@@ -270,6 +407,7 @@ static int trie_update_elem(struct bpf_map *map,
 	struct bpf_lpm_trie_key *key = _key;
 	unsigned long irq_flags;
 	unsigned int next_bit;
+	bool modified = false;
 	size_t matchlen = 0;
 	int ret = 0;
 
@@ -294,6 +432,10 @@ static int trie_update_elem(struct bpf_map *map,
 		goto out;
 	}
 
+	write_seqcount_begin(&trie->seq);
+	trie_mb_table_invalidate(trie);
+	modified = true;
+
 	trie->n_entries++;
 
 	new_node->prefixlen = key->prefixlen;
@@ -386,8 +528,14 @@ out:
 		kfree(im_node);
 	}
 
+	if (modified)
+		write_seqcount_end(&trie->seq);
+
 	raw_spin_unlock_irqrestore(&trie->lock, irq_flags);
 
+	if (modified)
+		trie_schedule_rebuild(trie);
+
 	return ret;
 }
 
@@ -438,6 +586,9 @@ static int trie_delete_elem(struct bpf_map *map, void *_key)
 		goto out;
 	}
 
+	write_seqcount_begin(&trie->seq);
+	trie_mb_table_invalidate(trie);
+
 	trie->n_entries--;
 
 	/* If the node we are removing has two children, simply mark it
@@ -482,11 +633,281 @@ static int trie_delete_elem(struct bpf_map *map, void *_key)
 	kfree_rcu(node, rcu);
 
 out:
+	if (!ret)
+		write_seqcount_end(&trie->seq);
+
 	raw_spin_unlock_irqrestore(&trie->lock, irq_flags);
 
+	if (!ret)
+		trie_schedule_rebuild(trie);
+
 	return ret;
 }
 
+struct lpm_mb_prefix {
+	struct lpm_trie_node		*node;
+	u32				prefixlen;
+	u8				data[LPM_MB_DATA_SIZE_MAX];
+};
+
+struct lpm_mb_builder {
+	struct lpm_mb_prefix		*prefixes;
+	u32				nr_prefixes;
+	u32				nr_nodes;
+	u32				nr_leaves;
+	struct lpm_mb_table		*tbl;
+	const struct lpm_mb_prefix	*paint[LPM_MB_DATA_SIZE_MAX][LPM_MB_FANOUT];
+	struct lpm_trie_node		*stack[LPM_MB_DATA_SIZE_MAX * 8 + 2];
+};
+
+/* Copy all non-intermediate nodes of the trie, with the bits past their
+ * prefix length cleared so that sorting groups prefixes by their leading
+ * bytes. Runs under RCU and may see a trie that is being modified, which
+ * the caller detects through trie->seq.
+ */
+static int lpm_mb_snapshot(struct lpm_trie *trie, struct lpm_mb_builder *b,
+			   u32 max_prefixes)
+{
+	struct lpm_trie_node *node, *child;
+	int i, sp = 0;
+
+	node = rcu_dereference(trie->root);
+	if (node)
+		b->stack[sp++] = node;
+
+	while (sp) {
+		node = b->stack[--sp];
+
+		if (!(node->flags & LPM_TREE_NODE_FLAG_IM)) {
+			struct lpm_mb_prefix *p;
+			u32 len = node->prefixlen;
+
+			if (b->nr_prefixes == max_prefixes)
+				return -EAGAIN;
+
+			p = &b->prefixes[b->nr_prefixes++];
+			p->node = node;
+			p->prefixlen = len;
+			memset(p->data, 0, sizeof(p->data));
+			memcpy(p->data, node->data, DIV_ROUND_UP(len, 8));
+			if (len % 8)
+				p->data[len / 8] &= 0xff << (8 - len % 8);
+		}
+
+		for (i = 1; i >= 0; i--) {
+			child = rcu_dereference(node->child[i]);
+			if (!child)
+				continue;
+			if (sp == ARRAY_SIZE(b->stack))
+				return -EAGAIN;
+			b->stack[sp++] = child;
+		}
+	}
+
+	return 0;
+}
+
+static int lpm_mb_prefix_cmp(const void *a, const void *b)
+{
+	const struct lpm_mb_prefix *pa = a, *pb = b;
+	int ret;
+
+	ret = memcmp(pa->data, pb->data, sizeof(pa->data));
+	if (ret)
+		return ret;
+
+	return (int)pa->prefixlen - (int)pb->prefixlen;
+}
+
+/* Return the end of the run of prefixes starting at @i that share key byte
+ * @level, and whether any of them continues past this byte.
+ */
+static u32 lpm_mb_next_group(const struct lpm_mb_builder *b, u32 level,
+			     u32 i, u32 hi, bool *deeper)
+{
+	u8 v = b->prefixes[i].data[level];
+
+	*deeper = false;
+	for (; i < hi && b->prefixes[i].data[level] == v; i++)
+		if (b->prefixes[i].prefixlen > (level + 1) * LPM_MB_STRIDE)
+			*deeper = true;
+
+	return i;
+}
+
+/* Build table node @idx at depth @level from the sorted prefixes [@lo, @hi),
+ * which all share the key bytes leading to it. @inherit is the best match
+ * shorter than the node. Without b->tbl only the nodes and leaves are
+ * counted.
+ */
+static void lpm_mb_build_node(struct lpm_mb_builder *b, u32 level,
+			      u32 lo, u32 hi,
+			      const struct lpm_mb_prefix *inherit, u32 idx)
+{
+	const struct lpm_mb_prefix **paint = b->paint[level];
+	struct lpm_mb_node *node = b->tbl ? &b->tbl->nodes[idx] : NULL;
+	u32 base_len = level * LPM_MB_STRIDE;
+	u32 i, j, e, nr_children = 0, child;
+	bool deeper;
+
+	for (e = 0; e < LPM_MB_FANOUT; e++)
+		paint[e] = inherit;
+
+	for (i = lo; i < hi; i++) {
+		const struct lpm_mb_prefix *p = &b->prefixes[i];
+		u32 first, last;
+
+		if (p->prefixlen < base_len ||
+		    p->prefixlen > base_len + LPM_MB_STRIDE)
+			continue;
+
+		first = p->data[level];
+		last = first +
+		       (1 << (base_len + LPM_MB_STRIDE - p->prefixlen)) - 1;
+		for (e = first; e <= last; e++)
+			if (!paint[e] || paint[e]->prefixlen < p->prefixlen)
+				paint[e] = p;
+	}
+
+	if (node)
+		node->leaf_base = b->nr_leaves;
+	for (e = 0; e < LPM_MB_FANOUT; e++) {
+		if (e && paint[e] == paint[e - 1])
+			continue;
+		if (node) {
+			node->leaf_map[e / 64] |= BIT_ULL(e % 64);
+			b->tbl->leaves[b->nr_leaves] =
+				paint[e] ? paint[e]->node : NULL;
+		}
+		b->nr_leaves++;
+	}
+
+	for (i = lo; i < hi; i = j) {
+		j = lpm_mb_next_group(b, level, i, hi, &deeper);
+		if (!deeper)
+			continue;
+		if (node)
+			node->child_map[b->prefixes[i].data[level] / 64] |=
+				BIT_ULL(b->prefixes[i].data[level] % 64);
+		nr_children++;
+	}
+
+	/* children of a node are allocated back to back */
+	child = b->nr_nodes;
+	b->nr_nodes += nr_children;
+	if (node)
+		node->child_base = child;
+
+	for (i = lo; i < hi; i = j) {
+		j = lpm_mb_next_group(b, level, i, hi, &deeper);
+		if (deeper)
+			lpm_mb_build_node(b, level + 1, i, j,
+					  paint[b->prefixes[i].data[level]],
+					  child++);
+	}
+
+	cond_resched();
+}
+
+static struct lpm_mb_table *lpm_mb_table_build(struct lpm_trie *trie)
+{
+	struct lpm_mb_table *tbl = ERR_PTR(-ENOMEM);
+	struct lpm_mb_builder *b;
+	u32 max_prefixes;
+	unsigned int seq;
+	int err;
+
+	b = kvzalloc(sizeof(*b), GFP_KERNEL);
+	if (!b)
+		return tbl;
+
+	/* leave room for a few concurrent updates */
+	max_prefixes = READ_ONCE(trie->n_entries) + 64;
+	b->prefixes = kvmalloc_array(max_prefixes, sizeof(*b->prefixes),
+				     GFP_KERNEL);
+	if (!b->prefixes)
+		goto out;
+
+	seq = read_seqcount_begin(&trie->seq);
+	rcu_read_lock();
+	err = lpm_mb_snapshot(trie, b, max_prefixes);
+	rcu_read_unlock();
+	if (err || read_seqcount_retry(&trie->seq, seq)) {
+		tbl = ERR_PTR(-EAGAIN);
+		goto out;
+	}
+
+	sort(b->prefixes, b->nr_prefixes, sizeof(*b->prefixes),
+	     lpm_mb_prefix_cmp, NULL);
+
+	/* Size the table in a first pass and fill it in a second one */
+	b->nr_nodes = 1;
+	lpm_mb_build_node(b, 0, 0, b->nr_prefixes, NULL, 0);
+
+	tbl = kvzalloc(sizeof(*tbl) +
+		       (u64)b->nr_nodes * sizeof(struct lpm_mb_node) +
+		       (u64)b->nr_leaves * sizeof(struct lpm_trie_node *),
+		       GFP_KERNEL | __GFP_NOWARN);
+	if (!tbl) {
+		tbl = ERR_PTR(-ENOMEM);
+		goto out;
+	}
+
+	tbl->seq = seq;
+	tbl->nr_nodes = b->nr_nodes;
+	tbl->nr_leaves = b->nr_leaves;
+	tbl->leaves = (struct lpm_trie_node **)(tbl->nodes + b->nr_nodes);
+
+	b->tbl = tbl;
+	b->nr_nodes = 1;
+	b->nr_leaves = 0;
+	lpm_mb_build_node(b, 0, 0, b->nr_prefixes, NULL, 0);
+
+	/* The trie changed while building, the table would never be used */
+	if (read_seqcount_retry(&trie->seq, seq)) {
+		kvfree(tbl);
+		tbl = ERR_PTR(-EAGAIN);
+	}
+out:
+	kvfree(b->prefixes);
+	kvfree(b);
+	return tbl;
+}
+
+static void lpm_mb_table_free_rcu(struct rcu_head *rcu)
+{
+	kvfree(container_of(rcu, struct lpm_mb_table, rcu));
+}
+
+static void trie_rebuild_work(struct work_struct *work)
+{
+	struct lpm_trie *trie = container_of(to_delayed_work(work),
+					     struct lpm_trie, rebuild_work);
+	struct lpm_mb_table *tbl, *old;
+	unsigned long irq_flags;
+
+	/* On failure lookups keep walking the trie. A concurrent update
+	 * has already rescheduled us.
+	 */
+	tbl = lpm_mb_table_build(trie);
+	if (IS_ERR(tbl))
+		return;
+
+	/* Updates after the build would not mark the new table stale */
+	raw_spin_lock_irqsave(&trie->lock, irq_flags);
+	if (raw_read_seqcount(&trie->seq) != tbl->seq) {
+		raw_spin_unlock_irqrestore(&trie->lock, irq_flags);
+		kvfree(tbl);
+		return;
+	}
+	old = rcu_dereference_protected(trie->mb_table,
+					lockdep_is_held(&trie->lock));
+	rcu_assign_pointer(trie->mb_table, tbl);
+	raw_spin_unlock_irqrestore(&trie->lock, irq_flags);
+	if (old)
+		call_rcu(&old->rcu, lpm_mb_table_free_rcu);
+}
+
 #define LPM_DATA_SIZE_MAX	256
 #define LPM_DATA_SIZE_MIN	1
 
@@ -499,7 +920,8 @@ out:
 #define LPM_KEY_SIZE_MIN	LPM_KEY_SIZE(LPM_DATA_SIZE_MIN)
 
 #define LPM_CREATE_FLAG_MASK	(BPF_F_NO_PREALLOC | BPF_F_NUMA_NODE |	\
-				 BPF_F_RDONLY | BPF_F_WRONLY)
+				 BPF_F_RDONLY | BPF_F_WRONLY |		\
+				 BPF_F_LPM_MULTIBIT)
 
 static struct bpf_map *trie_alloc(union bpf_attr *attr)
 {
@@ -532,6 +954,20 @@ static struct bpf_map *trie_alloc(union bpf_attr *attr)
 
 	cost_per_node = sizeof(struct lpm_trie_node) +
 			attr->value_size + trie->data_size;
+
+	/* Each prefix adds at most one table node per key byte and two
+	 * leaves to the node it ends in.
+	 */
+	if (attr->map_flags & BPF_F_LPM_MULTIBIT) {
+		if (trie->data_size > LPM_MB_DATA_SIZE_MAX) {
+			ret = -EINVAL;
+			goto out_err;
+		}
+		cost_per_node += trie->data_size *
+				 (sizeof(struct lpm_mb_node) +
+				  sizeof(struct lpm_trie_node *)) +
+				 2 * sizeof(struct lpm_trie_node *);
+	}
 	cost += (u64) attr->max_entries * cost_per_node;
 	if (cost >= U32_MAX - PAGE_SIZE) {
 		ret = -E2BIG;
@@ -545,6 +981,9 @@ static struct bpf_map *trie_alloc(union bpf_attr *attr)
 		goto out_err;
 
 	raw_spin_lock_init(&trie->lock);
+	seqcount_init(&trie->seq);
+	INIT_DELAYED_WORK(&trie->rebuild_work, trie_rebuild_work);
+	init_irq_work(&trie->rebuild_irq_work, trie_rebuild_irq_work);
 
 	return &trie->map;
 out_err:
@@ -563,6 +1002,10 @@ static void trie_free(struct bpf_map *map)
 	 */
 	synchronize_rcu();
 
+	irq_work_sync(&trie->rebuild_irq_work);
+	cancel_delayed_work_sync(&trie->rebuild_work);
+	kvfree(rcu_dereference_protected(trie->mb_table, 1));
+
 	/* Always start at the root and walk down to a node that has no
 	 * children. Then free that node, nullify its reference in the parent
 	 * and start over.
@@ -698,6 +1141,26 @@ static int trie_check_btf(const struct bpf_map *map,
 	       -EINVAL : 0;
 }
 
+static void trie_show_fdinfo(const struct bpf_map *map, struct seq_file *m)
+{
+	struct lpm_trie *trie = container_of(map, struct lpm_trie, map);
+	struct lpm_mb_table *tbl;
+
+	if (!(map->map_flags & BPF_F_LPM_MULTIBIT))
+		return;
+
+	rcu_read_lock();
+	tbl = rcu_dereference(trie->mb_table);
+	seq_printf(m,
+		   "multibit_nodes:\t%u\n"
+		   "multibit_leaves:\t%u\n"
+		   "multibit_current:\t%u\n",
+		   tbl ? tbl->nr_nodes : 0,
+		   tbl ? tbl->nr_leaves : 0,
+		   tbl && !READ_ONCE(tbl->stale));
+	rcu_read_unlock();
+}
+
 const struct bpf_map_ops trie_map_ops = {
 	.map_alloc = trie_alloc,
 	.map_free = trie_free,
@@ -706,4 +1169,5 @@ const struct bpf_map_ops trie_map_ops = {
 	.map_update_elem = trie_update_elem,
 	.map_delete_elem = trie_delete_elem,
 	.map_check_btf = trie_check_btf,
+	.map_show_fdinfo = trie_show_fdinfo,
 };
@@ -0,0 +1,157 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * BPF iterator over the elements of a map
+ */
+#include <linux/bpf.h>
+#include <linux/init.h>
+#include <linux/rcupdate.h>
+#include <linux/seq_file.h>
+#include <linux/slab.h>
+
+/* Largest key plus value the context record can hold */
+#define BPF_ITER_MAP_ELEM_DATA_MAX	(1U << 15)
+
+struct bpf_iter_map_priv {
+	struct bpf_map *map;
+	/* key of the element shown next */
+	void *key;
+	void *next_key;
+	bool valid;
+};
+
+static bool map_iter_get_next(struct bpf_iter_map_priv *priv, bool first)
+{
+	struct bpf_map *map = priv->map;
+	int err;
+
+	rcu_read_lock();
+	err = map->ops->map_get_next_key(map, first ? NULL : priv->key,
+					 priv->next_key);
+	rcu_read_unlock();
+
+	if (!err)
+		swap(priv->key, priv->next_key);
+	priv->valid = !err;
+
+	return priv->valid;
+}
+
+static void *map_seq_start(struct seq_file *seq, loff_t *pos)
+{
+	struct bpf_iter_map_priv *priv = bpf_iter_priv(seq);
+
+	/* Otherwise resume from the element next() moved to */
+	if (!*pos)
+		map_iter_get_next(priv, true);
+
+	return priv->valid ? priv->key : NULL;
+}
+
+static void *map_seq_next(struct seq_file *seq, void *v, loff_t *pos)
+{
+	struct bpf_iter_map_priv *priv = bpf_iter_priv(seq);
+
+	++*pos;
+
+	return map_iter_get_next(priv, false) ? priv->key : NULL;
+}
+
+static void map_seq_stop(struct seq_file *seq, void *v)
+{
+}
+
+static int map_seq_show(struct seq_file *seq, void *v)
+{
+	struct bpf_iter_map_priv *priv = bpf_iter_priv(seq);
+	struct bpf_iter_map_elem *ctx = bpf_iter_ctx(seq);
+	struct bpf_map *map = priv->map;
+	u32 key_size = round_up(map->key_size, 8);
+	void *value;
+
+	rcu_read_lock();
+	value = map->ops->map_lookup_elem(map, priv->key);
+	if (!value) {
+		/* deleted since get_next_key */
+		rcu_read_unlock();
+		return SEQ_SKIP;
+	}
+	memcpy(ctx->data + key_size, value, map->value_size);
+	rcu_read_unlock();
+
+	ctx->key_size = map->key_size;
+	ctx->value_size = map->value_size;
+	memcpy(ctx->data, priv->key, map->key_size);
+
+	return 0;
+}
+
+static const struct seq_operations map_seq_ops = {
+	.start	= map_seq_start,
+	.next	= map_seq_next,
+	.stop	= map_seq_stop,
+	.show	= map_seq_show,
+};
+
+static int map_iter_attach(struct bpf_map *map, u32 *ctx_size)
+{
+	u32 data_size;
+
+	switch (map->map_type) {
+	case BPF_MAP_TYPE_HASH:
+	case BPF_MAP_TYPE_LRU_HASH:
+	case BPF_MAP_TYPE_ARRAY:
+	case BPF_MAP_TYPE_LPM_TRIE:
+	case BPF_MAP_TYPE_RHASH:
+		break;
+	default:
+		return -EOPNOTSUPP;
+	}
+
+	data_size = round_up(map->key_size, 8) + map->value_size;
+	if (data_size > BPF_ITER_MAP_ELEM_DATA_MAX)
+		return -E2BIG;
+
+	*ctx_size = offsetof(struct bpf_iter_map_elem, data) + data_size;
+	return 0;
+}
+
+static int map_iter_init(void *priv, struct bpf_map *map)
+{
+	struct bpf_iter_map_priv *p = priv;
+
+	p->map = map;
+	p->key = kmalloc(map->key_size, GFP_USER);
+	p->next_key = kmalloc(map->key_size, GFP_USER);
+	if (!p->key || !p->next_key) {
+		kfree(p->key);
+		kfree(p->next_key);
+		return -ENOMEM;
+	}
+
+	return 0;
+}
+
+static void map_iter_fini(void *priv)
+{
+	struct bpf_iter_map_priv *p = priv;
+
+	kfree(p->key);
+	kfree(p->next_key);
+}
+
+static struct bpf_iter_target map_iter_target = {
+	.attach_type	= BPF_ITER_MAP_ELEM,
+	.ctx_size	= offsetof(struct bpf_iter_map_elem, data) +
+			  BPF_ITER_MAP_ELEM_DATA_MAX,
+	.priv_size	= sizeof(struct bpf_iter_map_priv),
+	.seq_ops	= &map_seq_ops,
+	.attach		= map_iter_attach,
+	.init		= map_iter_init,
+	.fini		= map_iter_fini,
+};
+
+static int __init map_iter_register(void)
+{
+	return bpf_iter_reg_target(&map_iter_target);
+}
+late_initcall(map_iter_register);
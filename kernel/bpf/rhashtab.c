@@ -0,0 +1,419 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * Resizable BPF hash map.
+ *
+ * BPF_MAP_TYPE_RHASH stores its elements in an rhashtable: the bucket
+ * array starts small and is grown and shrunk by incremental rehashing from
+ * a worker as elements come and go, instead of being sized for max_entries
+ * when the map is created like BPF_MAP_TYPE_HASH. Lookups walk the chains
+ * under RCU without taking any lock; max_entries only caps the number of
+ * elements.
+ */
+#include <linux/bpf.h>
+#include <linux/btf.h>
+#include <linux/err.h>
+#include <linux/rhashtable.h>
+#include <linux/sched.h>
+#include <linux/seq_file.h>
+#include <linux/slab.h>
+
+#define RHTAB_CREATE_FLAG_MASK \
+	(BPF_F_NO_PREALLOC | BPF_F_RDONLY | BPF_F_WRONLY)
+
+/* An update races with deletes and inserts of the same key, give up after
+ * this many attempts rather than spinning in program context.
+ */
+#define RHTAB_UPDATE_RETRIES 8
+
+struct bpf_rhtab {
+	struct bpf_map map;
+	struct rhashtable ht;
+	struct rhashtable_params params;
+	atomic_t count;	/* number of elements in this hashtable */
+	u32 elem_size;	/* size of each element in bytes */
+};
+
+/* each rhtab element is struct rhtab_elem + key + value */
+struct rhtab_elem {
+	struct rhash_head node;
+	struct rcu_head rcu;
+	char key[0] __aligned(8);
+};
+
+static inline void *rhtab_elem_value(struct rhtab_elem *l, u32 key_size)
+{
+	return l->key + round_up(key_size, 8);
+}
+
+/* Called from syscall */
+static int rhtab_map_alloc_check(union bpf_attr *attr)
+{
+	if (attr->map_flags & ~RHTAB_CREATE_FLAG_MASK)
+		/* reserved bits should not be used */
+		return -EINVAL;
+
+	if (attr->max_entries == 0 || attr->key_size == 0 ||
+	    attr->value_size == 0)
+		return -EINVAL;
+
+	if (attr->key_size > MAX_BPF_STACK)
+		/* eBPF programs initialize keys on stack, so they cannot be
+		 * larger than max stack size
+		 */
+		return -E2BIG;
+
+	if (attr->value_size >= KMALLOC_MAX_SIZE -
+	    MAX_BPF_STACK - sizeof(struct rhtab_elem))
+		/* elements are kmalloc()ed and copied by the bpf syscall */
+		return -E2BIG;
+
+	return 0;
+}
+
+static struct bpf_map *rhtab_map_alloc(union bpf_attr *attr)
+{
+	struct bpf_rhtab *rhtab;
+	int err;
+	u64 cost;
+
+	rhtab = kzalloc(sizeof(*rhtab), GFP_USER);
+	if (!rhtab)
+		return ERR_PTR(-ENOMEM);
+
+	bpf_map_init_from_attr(&rhtab->map, attr);
+
+	rhtab->elem_size = sizeof(struct rhtab_elem) +
+			   round_up(rhtab->map.key_size, 8) +
+			   round_up(rhtab->map.value_size, 8);
+
+	/* The map is charged as if it were full and its bucket table at the
+	 * largest size, as it can grow to that on its own.
+	 */
+	err = -E2BIG;
+	cost = (u64) rhtab->elem_size * rhtab->map.max_entries;
+	if (cost >= U32_MAX - PAGE_SIZE)
+		goto free_rhtab;
+
+	cost += (u64) roundup_pow_of_two(rhtab->map.max_entries) *
+		sizeof(struct rhash_head *);
+	if (cost >= U32_MAX - PAGE_SIZE)
+		/* make sure page count doesn't overflow */
+		goto free_rhtab;
+
+	rhtab->map.pages = round_up(cost, PAGE_SIZE) >> PAGE_SHIFT;
+
+	/* if map size is larger than memlock limit, reject it early */
+	err = bpf_map_precharge_memlock(rhtab->map.pages);
+	if (err)
+		goto free_rhtab;
+
+	rhtab->params.key_len = rhtab->map.key_size;
+	rhtab->params.key_offset = offsetof(struct rhtab_elem, key);
+	rhtab->params.head_offset = offsetof(struct rhtab_elem, node);
+	rhtab->params.max_size = roundup_pow_of_two(rhtab->map.max_entries);
+	rhtab->params.automatic_shrinking = true;
+
+	err = rhashtable_init(&rhtab->ht, &rhtab->params);
+	if (err)
+		goto free_rhtab;
+
+	return &rhtab->map;
+
+free_rhtab:
+	kfree(rhtab);
+	return ERR_PTR(err);
+}
+
+static void rhtab_elem_free(void *ptr, void *arg)
+{
+	kfree(ptr);
+}
+
+static void rhtab_elem_free_rcu(struct rcu_head *head)
+{
+	kfree(container_of(head, struct rhtab_elem, rcu));
+}
+
+/* Called when map->refcnt goes to zero, either from workqueue or from syscall */
+static void rhtab_map_free(struct bpf_map *map)
+{
+	struct bpf_rhtab *rhtab = container_of(map, struct bpf_rhtab, map);
+
+	/* wait for programs still using the map and for the elements
+	 * replaced or deleted by them to be freed
+	 */
+	synchronize_rcu();
+	rcu_barrier();
+
+	rhashtable_free_and_destroy(&rhtab->ht, rhtab_elem_free, NULL);
+	kfree(rhtab);
+}
+
+/* Called from syscall or from eBPF program */
+static void *rhtab_map_lookup_elem(struct bpf_map *map, void *key)
+{
+	struct bpf_rhtab *rhtab = container_of(map, struct bpf_rhtab, map);
+	struct rhtab_elem *l;
+
+	WARN_ON_ONCE(!rcu_read_lock_held());
+
+	l = rhashtable_lookup(&rhtab->ht, key, rhtab->params);
+	if (l)
+		return rhtab_elem_value(l, map->key_size);
+
+	return NULL;
+}
+
+/* Bucket locks are taken with spin_lock_bh() and growing or shrinking the
+ * table queues a work item, neither of which is allowed in hard irq or NMI
+ * context, where tracing programs may run. Tracing programs attached with
+ * interrupts disabled can't take the locks either, as local_bh_enable()
+ * would then run softirqs with them off.
+ */
+static bool rhtab_may_modify(void)
+{
+	return !in_irq() && !in_nmi() && !irqs_disabled();
+}
+
+/* Called from syscall or from eBPF program */
+static int rhtab_map_update_elem(struct bpf_map *map, void *key, void *value,
+				 u64 map_flags)
+{
+	struct bpf_rhtab *rhtab = container_of(map, struct bpf_rhtab, map);
+	struct rhtab_elem *l_new, *l_old;
+	int err = -EBUSY, retry;
+
+	WARN_ON_ONCE(!rcu_read_lock_held());
+
+	if (unlikely(map_flags > BPF_EXIST))
+		/* unknown flags */
+		return -EINVAL;
+
+	if (unlikely(!rhtab_may_modify()))
+		return -EBUSY;
+
+	l_new = kmalloc(rhtab->elem_size, GFP_ATOMIC | __GFP_NOWARN);
+	if (!l_new)
+		return -ENOMEM;
+
+	memcpy(l_new->key, key, map->key_size);
+	memcpy(rhtab_elem_value(l_new, map->key_size), value,
+	       map->value_size);
+
+	for (retry = 0; retry < RHTAB_UPDATE_RETRIES; retry++) {
+		l_old = rhashtable_lookup(&rhtab->ht, key, rhtab->params);
+		if (l_old) {
+			if (map_flags == BPF_NOEXIST) {
+				err = -EEXIST;
+				break;
+			}
+			/* readers see either the old or the new value, never
+			 * a partial update
+			 */
+			err = rhashtable_replace_fast(&rhtab->ht, &l_old->node,
+						      &l_new->node,
+						      rhtab->params);
+			if (!err) {
+				call_rcu(&l_old->rcu, rhtab_elem_free_rcu);
+				return 0;
+			}
+			/* deleted under us */
+			if (err != -ENOENT)
+				break;
+			continue;
+		}
+
+		if (map_flags == BPF_EXIST) {
+			err = -ENOENT;
+			break;
+		}
+
+		if (atomic_inc_return(&rhtab->count) > map->max_entries) {
+			atomic_dec(&rhtab->count);
+			err = -E2BIG;
+			break;
+		}
+
+		err = rhashtable_lookup_insert_fast(&rhtab->ht, &l_new->node,
+						    rhtab->params);
+		if (!err)
+			return 0;
+		atomic_dec(&rhtab->count);
+		/* inserted under us */
+		if (err != -EEXIST)
+			break;
+	}
+
+	kfree(l_new);
+	return err;
+}
+
+/* Called from syscall or from eBPF program */
+static int rhtab_map_delete_elem(struct bpf_map *map, void *key)
+{
+	struct bpf_rhtab *rhtab = container_of(map, struct bpf_rhtab, map);
+	struct rhtab_elem *l;
+	int err;
+
+	WARN_ON_ONCE(!rcu_read_lock_held());
+
+	if (unlikely(!rhtab_may_modify()))
+		return -EBUSY;
+
+	l = rhashtable_lookup(&rhtab->ht, key, rhtab->params);
+	if (!l)
+		return -ENOENT;
+
+	err = rhashtable_remove_fast(&rhtab->ht, &l->node, rhtab->params);
+	if (err)
+		return err;
+
+	atomic_dec(&rhtab->count);
+	call_rcu(&l->rcu, rhtab_elem_free_rcu);
+	return 0;
+}
+
+static struct bucket_table *rhtab_next_tbl(struct bpf_rhtab *rhtab,
+					   struct bucket_table *tbl)
+{
+	return rht_dereference_rcu(tbl->future_tbl, &rhtab->ht);
+}
+
+/* First element at or after bucket 'hash' of 'tbl'. While the table is
+ * being rehashed, elements live in this table and its future table, which
+ * are walked one after another.
+ */
+static struct rhtab_elem *rhtab_first_elem(struct bpf_rhtab *rhtab,
+					   struct bucket_table *tbl,
+					   unsigned int hash)
+{
+	struct rhash_head *pos;
+
+	while (tbl) {
+		for (; hash < tbl->size; hash++) {
+			rht_for_each_rcu(pos, tbl, hash)
+				return container_of(pos, struct rhtab_elem,
+						    node);
+		}
+		tbl = rhtab_next_tbl(rhtab, tbl);
+		hash = 0;
+	}
+
+	return NULL;
+}
+
+/* Called from syscall */
+static int rhtab_map_get_next_key(struct bpf_map *map, void *key,
+				  void *next_key)
+{
+	struct bpf_rhtab *rhtab = container_of(map, struct bpf_rhtab, map);
+	struct bucket_table *first, *tbl;
+	struct rhash_head *pos;
+	struct rhtab_elem *l;
+	unsigned int hash;
+
+	WARN_ON_ONCE(!rcu_read_lock_held());
+
+	first = rht_dereference_rcu(rhtab->ht.tbl, &rhtab->ht);
+	if (!key)
+		goto find_first_elem;
+
+	for (tbl = first; tbl; tbl = rhtab_next_tbl(rhtab, tbl)) {
+		hash = rht_key_hashfn(&rhtab->ht, tbl, key, rhtab->params);
+		rht_for_each_rcu(pos, tbl, hash) {
+			l = container_of(pos, struct rhtab_elem, node);
+			if (memcmp(l->key, key, map->key_size))
+				continue;
+
+			/* key was found, get next key in the same bucket */
+			pos = rht_dereference_bucket_rcu(pos->next, tbl, hash);
+			if (!rht_is_a_nulls(pos))
+				l = container_of(pos, struct rhtab_elem, node);
+			else
+				l = rhtab_first_elem(rhtab, tbl, hash + 1);
+			goto found;
+		}
+	}
+
+	/* key was not found, iterate from the start, as a deleted key
+	 * does in hash maps
+	 */
+find_first_elem:
+	l = rhtab_first_elem(rhtab, first, 0);
+found:
+	if (!l)
+		/* iterated over all buckets and all elements */
+		return -ENOENT;
+
+	memcpy(next_key, l->key, map->key_size);
+	return 0;
+}
+
+static void rhtab_map_show_fdinfo(const struct bpf_map *map,
+				  struct seq_file *m)
+{
+	struct bpf_rhtab *rhtab = container_of(map, struct bpf_rhtab, map);
+	struct bpf_map_chain_stats stats = {};
+	struct bucket_table *tbl;
+	struct rhash_head *pos;
+	unsigned int hash;
+	u32 len;
+
+	/* The table mutex keeps the tables from being swapped and freed, so
+	 * the RCU read section only has to cover one bucket at a time and
+	 * the walk can reschedule between them.
+	 */
+	mutex_lock(&rhtab->ht.mutex);
+	tbl = rht_dereference(rhtab->ht.tbl, &rhtab->ht);
+	seq_printf(m, "table_size:\t%u\n", tbl->size);
+	for (; tbl; tbl = rhtab_next_tbl(rhtab, tbl)) {
+		for (hash = 0; hash < tbl->size; hash++) {
+			len = 0;
+			rcu_read_lock();
+			rht_for_each_rcu(pos, tbl, hash)
+				len++;
+			rcu_read_unlock();
+			bpf_map_chain_stats_add(&stats, len);
+			cond_resched();
+		}
+	}
+	mutex_unlock(&rhtab->ht.mutex);
+
+	bpf_map_show_chain_stats(m, &stats);
+}
+
+static void rhtab_map_seq_show_elem(struct bpf_map *map, void *key,
+				    struct seq_file *m)
+{
+	void *value;
+
+	rcu_read_lock();
+
+	value = rhtab_map_lookup_elem(map, key);
+	if (!value) {
+		rcu_read_unlock();
+		return;
+	}
+
+	btf_type_seq_show(map->btf, map->btf_key_type_id, key, m);
+	seq_puts(m, ": ");
+	btf_type_seq_show(map->btf, map->btf_value_type_id, value, m);
+	seq_puts(m, "\n");
+
+	rcu_read_unlock();
+}
+
+const struct bpf_map_ops rhtab_map_ops = {
+	.map_alloc_check = rhtab_map_alloc_check,
+	.map_alloc = rhtab_map_alloc,
+	.map_free = rhtab_map_free,
+	.map_get_next_key = rhtab_map_get_next_key,
+	.map_lookup_elem = rhtab_map_lookup_elem,
+	.map_update_elem = rhtab_map_update_elem,
+	.map_delete_elem = rhtab_map_delete_elem,
+	.map_seq_show_elem = rhtab_map_seq_show_elem,
+	.map_show_fdinfo = rhtab_map_show_fdinfo,
+	.map_lookup_batch = generic_map_lookup_batch,
+	.map_update_batch = generic_map_update_batch,
+	.map_delete_batch = generic_map_delete_batch,
+};
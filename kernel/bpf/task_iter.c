@@ -0,0 +1,311 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * BPF iterators over tasks and their open files
+ */
+#include <linux/bpf.h>
+#include <linux/cred.h>
+#include <linux/fdtable.h>
+#include <linux/file.h>
+#include <linux/fs.h>
+#include <linux/init.h>
+#include <linux/mm.h>
+#include <linux/pid_namespace.h>
+#include <linux/sched/cputime.h>
+#include <linux/sched/mm.h>
+#include <linux/sched/signal.h>
+#include <linux/sched/task.h>
+#include <linux/seq_file.h>
+
+struct bpf_iter_task_priv {
+	struct pid_namespace *ns;
+	/* the task shown next, or the one after it if it is gone */
+	u32 tid;
+};
+
+/* Return the task with the lowest pid >= *@tid in @ns, with a reference */
+static struct task_struct *task_seq_get_next(struct pid_namespace *ns,
+					     u32 *tid, bool skip_threads)
+{
+	struct task_struct *task = NULL;
+	struct pid *pid;
+
+	rcu_read_lock();
+retry:
+	pid = find_ge_pid(*tid, ns);
+	if (pid) {
+		*tid = pid_nr_ns(pid, ns);
+		task = get_pid_task(pid, PIDTYPE_PID);
+		if (!task || (skip_threads && !thread_group_leader(task))) {
+			if (task)
+				put_task_struct(task);
+			task = NULL;
+			++*tid;
+			goto retry;
+		}
+	}
+	rcu_read_unlock();
+
+	return task;
+}
+
+static void *task_seq_start(struct seq_file *seq, loff_t *pos)
+{
+	struct bpf_iter_task_priv *priv = bpf_iter_priv(seq);
+
+	if (!*pos)
+		priv->tid = 0;
+
+	return task_seq_get_next(priv->ns, &priv->tid, false);
+}
+
+static void *task_seq_next(struct seq_file *seq, void *v, loff_t *pos)
+{
+	struct bpf_iter_task_priv *priv = bpf_iter_priv(seq);
+
+	put_task_struct(v);
+	++*pos;
+	++priv->tid;
+
+	return task_seq_get_next(priv->ns, &priv->tid, false);
+}
+
+static void task_seq_stop(struct seq_file *seq, void *v)
+{
+	if (v)
+		put_task_struct(v);
+}
+
+static int task_seq_show(struct seq_file *seq, void *v)
+{
+	struct bpf_iter_task_priv *priv = bpf_iter_priv(seq);
+	struct bpf_iter_task *ctx = bpf_iter_ctx(seq);
+	struct user_namespace *user_ns = seq_user_ns(seq);
+	struct task_struct *task = v;
+	const struct cred *cred;
+	struct mm_struct *mm;
+	u64 utime, stime;
+
+	ctx->pid = task_pid_nr_ns(task, priv->ns);
+	ctx->tgid = task_tgid_nr_ns(task, priv->ns);
+
+	rcu_read_lock();
+	ctx->ppid = pid_alive(task) ?
+		task_tgid_nr_ns(rcu_dereference(task->real_parent), priv->ns) : 0;
+	cred = __task_cred(task);
+	ctx->uid = from_kuid_munged(user_ns, cred->uid);
+	ctx->gid = from_kgid_munged(user_ns, cred->gid);
+	rcu_read_unlock();
+
+	ctx->state = task_state_index(task);
+	ctx->prio = task->prio - MAX_RT_PRIO;
+	ctx->nr_threads = get_nr_threads(task);
+
+	task_cputime_adjusted(task, &utime, &stime);
+	ctx->utime = utime;
+	ctx->stime = stime;
+	ctx->start_time = task->real_start_time;
+	ctx->min_flt = task->min_flt;
+	ctx->maj_flt = task->maj_flt;
+
+	ctx->vsize = 0;
+	ctx->rss = 0;
+	mm = get_task_mm(task);
+	if (mm) {
+		ctx->vsize = mm->total_vm << PAGE_SHIFT;
+		ctx->rss = get_mm_rss(mm);
+		mmput(mm);
+	}
+
+	get_task_comm(ctx->comm, task);
+
+	return 0;
+}
+
+static const struct seq_operations task_seq_ops = {
+	.start	= task_seq_start,
+	.next	= task_seq_next,
+	.stop	= task_seq_stop,
+	.show	= task_seq_show,
+};
+
+static int task_iter_init(void *priv, struct bpf_map *map)
+{
+	struct bpf_iter_task_priv *p = priv;
+
+	p->ns = get_pid_ns(task_active_pid_ns(current));
+	return 0;
+}
+
+static void task_iter_fini(void *priv)
+{
+	struct bpf_iter_task_priv *p = priv;
+
+	put_pid_ns(p->ns);
+}
+
+static struct bpf_iter_target task_iter_target = {
+	.attach_type	= BPF_ITER_TASK,
+	.ctx_size	= sizeof(struct bpf_iter_task),
+	.priv_size	= sizeof(struct bpf_iter_task_priv),
+	.seq_ops	= &task_seq_ops,
+	.init		= task_iter_init,
+	.fini		= task_iter_fini,
+};
+
+struct bpf_iter_task_file_priv {
+	struct pid_namespace *ns;
+	/* cursor, the process and the descriptor shown next */
+	u32 tid;
+	u32 fd;
+	struct task_struct *task;
+	struct files_struct *files;
+};
+
+static void task_file_put(struct bpf_iter_task_file_priv *priv)
+{
+	if (!priv->task)
+		return;
+
+	put_files_struct(priv->files);
+	put_task_struct(priv->task);
+	priv->files = NULL;
+	priv->task = NULL;
+}
+
+/* Return the next open file at or after the cursor, with a reference.
+ * Threads share the file table of their process, only leaders are walked.
+ */
+static struct file *task_file_seq_get_next(struct bpf_iter_task_file_priv *priv)
+{
+	struct files_struct *files;
+	struct task_struct *task;
+	struct file *file;
+
+	for (;;) {
+		if (!priv->task) {
+			task = task_seq_get_next(priv->ns, &priv->tid, true);
+			if (!task)
+				return NULL;
+
+			files = get_files_struct(task);
+			if (!files) {
+				put_task_struct(task);
+				priv->tid++;
+				priv->fd = 0;
+				continue;
+			}
+			priv->task = task;
+			priv->files = files;
+		}
+
+		rcu_read_lock();
+		for (; priv->fd < files_fdtable(priv->files)->max_fds;
+		     priv->fd++) {
+			file = fcheck_files(priv->files, priv->fd);
+			if (file && get_file_rcu(file)) {
+				rcu_read_unlock();
+				return file;
+			}
+		}
+		rcu_read_unlock();
+
+		task_file_put(priv);
+		priv->tid++;
+		priv->fd = 0;
+	}
+}
+
+static void *task_file_seq_start(struct seq_file *seq, loff_t *pos)
+{
+	struct bpf_iter_task_file_priv *priv = bpf_iter_priv(seq);
+
+	if (!*pos) {
+		task_file_put(priv);
+		priv->tid = 0;
+		priv->fd = 0;
+	}
+
+	return task_file_seq_get_next(priv);
+}
+
+static void *task_file_seq_next(struct seq_file *seq, void *v, loff_t *pos)
+{
+	struct bpf_iter_task_file_priv *priv = bpf_iter_priv(seq);
+
+	fput(v);
+	++*pos;
+	priv->fd++;
+
+	return task_file_seq_get_next(priv);
+}
+
+static void task_file_seq_stop(struct seq_file *seq, void *v)
+{
+	if (v)
+		fput(v);
+}
+
+static int task_file_seq_show(struct seq_file *seq, void *v)
+{
+	struct bpf_iter_task_file_priv *priv = bpf_iter_priv(seq);
+	struct bpf_iter_task_file *ctx = bpf_iter_ctx(seq);
+	struct inode *inode;
+	struct file *file = v;
+
+	inode = file_inode(file);
+
+	ctx->pid = task_tgid_nr_ns(priv->task, priv->ns);
+	ctx->fd = priv->fd;
+	ctx->flags = file->f_flags;
+	ctx->mode = inode->i_mode;
+	ctx->pos = file->f_pos;
+	ctx->ino = inode->i_ino;
+	ctx->dev = new_encode_dev(inode->i_sb->s_dev);
+	ctx->pad = 0;
+
+	return 0;
+}
+
+static const struct seq_operations task_file_seq_ops = {
+	.start	= task_file_seq_start,
+	.next	= task_file_seq_next,
+	.stop	= task_file_seq_stop,
+	.show	= task_file_seq_show,
+};
+
+static int task_file_iter_init(void *priv, struct bpf_map *map)
+{
+	struct bpf_iter_task_file_priv *p = priv;
+
+	p->ns = get_pid_ns(task_active_pid_ns(current));
+	return 0;
+}
+
+static void task_file_iter_fini(void *priv)
+{
+	struct bpf_iter_task_file_priv *p = priv;
+
+	task_file_put(p);
+	put_pid_ns(p->ns);
+}
+
+static struct bpf_iter_target task_file_iter_target = {
+	.attach_type	= BPF_ITER_TASK_FILE,
+	.ctx_size	= sizeof(struct bpf_iter_task_file),
+	.priv_size	= sizeof(struct bpf_iter_task_file_priv),
+	.seq_ops	= &task_file_seq_ops,
+	.init		= task_file_iter_init,
+	.fini		= task_file_iter_fini,
+};
+
+static int __init task_iter_register(void)
+{
+	int err;
+
+	err = bpf_iter_reg_target(&task_iter_target);
+	if (err)
+		return err;
+
+	return bpf_iter_reg_target(&task_file_iter_target);
+}
+late_initcall(task_iter_register);
@@ -0,0 +1,419 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * BPF trampolines
+ *
+ * A BPF_PROG_TYPE_TRACING program is attached to a kernel function by
+ * name. All programs attached to one function share a struct
+ * bpf_trampoline, for which the JIT generates an image that saves the
+ * argument registers, calls the BPF_TRACE_FENTRY programs with them,
+ * runs the function and, if there are BPF_TRACE_FEXIT programs, calls
+ * them with the arguments and the return value. The first instruction
+ * of the function is patched into a branch to the image, so a hit costs
+ * a few calls instead of the breakpoint or ftrace round trip and the
+ * pt_regs save of a kprobe.
+ *
+ * Every change of the attached programs generates a new image, switches
+ * the branch over and frees the old image once no task runs in it.
+ */
+#include <linux/anon_inodes.h>
+#include <linux/bpf.h>
+#include <linux/filter.h>
+#include <linux/ftrace.h>
+#include <linux/hash.h>
+#include <linux/jump_label.h>
+#include <linux/kallsyms.h>
+#include <linux/kprobes.h>
+#include <linux/moduleloader.h>
+#include <linux/mutex.h>
+#include <linux/rcupdate.h>
+#include <linux/slab.h>
+
+#include <asm/set_memory.h>
+
+#define TRAMPOLINE_HASH_BITS 10
+#define TRAMPOLINE_TABLE_SIZE (1 << TRAMPOLINE_HASH_BITS)
+
+/* serializes trampoline lookup, creation and destruction */
+static DEFINE_MUTEX(trampoline_mutex);
+static struct hlist_head trampoline_table[TRAMPOLINE_TABLE_SIZE];
+
+static int bpf_trampoline_check_ip(unsigned long ip, unsigned long size)
+{
+	/* module text may go away under the trampoline */
+	if (!core_kernel_text(ip))
+		return -EINVAL;
+#ifdef CONFIG_KPROBES
+	if (within_kprobe_blacklist(ip))
+		return -EINVAL;
+#endif
+	if (jump_label_text_reserved((void *)ip, (void *)ip + 3))
+		return -EBUSY;
+#ifdef CONFIG_DYNAMIC_FTRACE
+	/* Functions without an mcount call site are notrace, these include
+	 * the ones the image itself calls. The site must not be the
+	 * instruction the branch to the image displaces either.
+	 */
+	if (!ftrace_location_range(ip, ip + size - 1) || ftrace_location(ip))
+		return -EINVAL;
+	return 0;
+#else
+	return -EOPNOTSUPP;
+#endif
+}
+
+struct bpf_trampoline *bpf_trampoline_get(unsigned long ip, unsigned long size)
+{
+	struct bpf_trampoline *tr;
+	struct hlist_head *head;
+	int err;
+
+	err = bpf_trampoline_check_ip(ip, size);
+	if (err)
+		return ERR_PTR(err);
+
+	mutex_lock(&trampoline_mutex);
+	head = &trampoline_table[hash_long(ip, TRAMPOLINE_HASH_BITS)];
+	hlist_for_each_entry(tr, head, hlist) {
+		if (tr->ip == ip) {
+			refcount_inc(&tr->refcnt);
+			goto out;
+		}
+	}
+
+	tr = kzalloc(sizeof(*tr), GFP_KERNEL);
+	if (!tr) {
+		tr = ERR_PTR(-ENOMEM);
+		goto out;
+	}
+	tr->ip = ip;
+	refcount_set(&tr->refcnt, 1);
+	mutex_init(&tr->mutex);
+	hlist_add_head(&tr->hlist, head);
+out:
+	mutex_unlock(&trampoline_mutex);
+	return tr;
+}
+
+void bpf_trampoline_put(struct bpf_trampoline *tr)
+{
+	mutex_lock(&trampoline_mutex);
+	if (refcount_dec_and_test(&tr->refcnt)) {
+		/* the function got restored by the last unlink */
+		WARN_ON_ONCE(tr->cur_image);
+		hlist_del(&tr->hlist);
+		kfree(tr);
+	}
+	mutex_unlock(&trampoline_mutex);
+}
+
+static void __bpf_tramp_image_free(struct bpf_tramp_image *im)
+{
+	int kind, i;
+
+	for (kind = 0; kind < BPF_TRAMP_MAX; kind++)
+		for (i = 0; i < im->nr_progs[kind]; i++)
+			bpf_prog_put(im->progs[kind][i]);
+	if (im->image) {
+		set_memory_rw((unsigned long)im->image, 1);
+		module_memfree(im->image);
+	}
+	percpu_ref_exit(&im->pcref);
+	kfree(im);
+}
+
+static void bpf_tramp_image_free_work(struct work_struct *work)
+{
+	__bpf_tramp_image_free(container_of(work, struct bpf_tramp_image,
+					    work));
+}
+
+static void bpf_tramp_image_free_rcu(struct rcu_head *rcu)
+{
+	struct bpf_tramp_image *im = container_of(rcu, struct bpf_tramp_image,
+						  rcu);
+
+	/* module_memfree() sleeps */
+	INIT_WORK(&im->work, bpf_tramp_image_free_work);
+	schedule_work(&im->work);
+}
+
+static void bpf_tramp_image_release(struct percpu_ref *pcref)
+{
+	struct bpf_tramp_image *im = container_of(pcref, struct bpf_tramp_image,
+						  pcref);
+
+	/* The last task returning through the fexit part dropped its
+	 * reference a few instructions before leaving the image.
+	 */
+	call_rcu_tasks(&im->rcu, bpf_tramp_image_free_rcu);
+}
+
+static void bpf_tramp_image_kill_rcu(struct rcu_head *rcu)
+{
+	struct bpf_tramp_image *im = container_of(rcu, struct bpf_tramp_image,
+						  rcu);
+
+	percpu_ref_kill(&im->pcref);
+}
+
+/* Called once the function no longer branches to @im. A task preempted in
+ * the fentry part is done with it after an RCU-tasks grace period, which
+ * the tracer selects on preemptible kernels. Tasks that called the function
+ * from the fexit part return to the image later, they hold @im->pcref.
+ */
+static void bpf_tramp_image_put(struct bpf_tramp_image *im)
+{
+	call_rcu_tasks(&im->rcu, bpf_tramp_image_kill_rcu);
+}
+
+static struct bpf_tramp_image *bpf_tramp_image_alloc(struct bpf_trampoline *tr)
+{
+	struct bpf_tramp_image *im;
+	int kind, i, err = -ENOMEM;
+
+	im = kzalloc(sizeof(*im), GFP_KERNEL);
+	if (!im)
+		return ERR_PTR(-ENOMEM);
+	if (percpu_ref_init(&im->pcref, bpf_tramp_image_release, 0,
+			    GFP_KERNEL)) {
+		kfree(im);
+		return ERR_PTR(-ENOMEM);
+	}
+
+	for (kind = 0; kind < BPF_TRAMP_MAX; kind++) {
+		for (i = 0; i < tr->nr_progs[kind]; i++) {
+			struct bpf_prog *prog = bpf_prog_inc(tr->progs[kind][i]);
+
+			if (IS_ERR(prog)) {
+				err = PTR_ERR(prog);
+				goto out_free;
+			}
+			im->progs[kind][i] = prog;
+			im->nr_progs[kind]++;
+		}
+	}
+
+	im->image = module_alloc(PAGE_SIZE);
+	if (!im->image)
+		goto out_free;
+	return im;
+
+out_free:
+	__bpf_tramp_image_free(im);
+	return ERR_PTR(err);
+}
+
+/* The callers hold a reference of their own */
+static void bpf_trampoline_clear_stale(struct bpf_trampoline *tr)
+{
+	if (tr->stale) {
+		tr->stale = false;
+		refcount_dec(&tr->refcnt);
+	}
+}
+
+static int bpf_trampoline_update(struct bpf_trampoline *tr)
+{
+	struct bpf_tramp_image *im, *old = tr->cur_image;
+	int err;
+
+	if (!tr->nr_progs[BPF_TRAMP_FENTRY] && !tr->nr_progs[BPF_TRAMP_FEXIT]) {
+		err = arch_bpf_trampoline_patch(tr, old->image, NULL);
+		if (err)
+			return err;
+		tr->cur_image = NULL;
+		bpf_tramp_image_put(old);
+		bpf_trampoline_clear_stale(tr);
+		return 0;
+	}
+
+	im = bpf_tramp_image_alloc(tr);
+	if (IS_ERR(im))
+		return PTR_ERR(im);
+
+	err = arch_prepare_bpf_trampoline(im, tr);
+	if (err)
+		goto out_free;
+	set_memory_ro((unsigned long)im->image, 1);
+
+	err = arch_bpf_trampoline_patch(tr, old ? old->image : NULL, im->image);
+	if (err)
+		goto out_free;
+
+	tr->cur_image = im;
+	if (old)
+		bpf_tramp_image_put(old);
+	bpf_trampoline_clear_stale(tr);
+	return 0;
+
+out_free:
+	__bpf_tramp_image_free(im);
+	return err;
+}
+
+static enum bpf_tramp_prog_type bpf_tramp_kind(const struct bpf_prog *prog)
+{
+	return prog->expected_attach_type == BPF_TRACE_FEXIT ?
+	       BPF_TRAMP_FEXIT : BPF_TRAMP_FENTRY;
+}
+
+int bpf_trampoline_link_prog(struct bpf_trampoline *tr, struct bpf_prog *prog)
+{
+	enum bpf_tramp_prog_type kind = bpf_tramp_kind(prog);
+	int i, err = 0;
+
+	mutex_lock(&tr->mutex);
+	for (i = 0; i < tr->nr_progs[kind]; i++) {
+		if (tr->progs[kind][i] == prog) {
+			err = -EBUSY;
+			goto out;
+		}
+	}
+	if (tr->nr_progs[kind] == BPF_MAX_TRAMP_PROGS) {
+		err = -E2BIG;
+		goto out;
+	}
+
+	tr->progs[kind][tr->nr_progs[kind]++] = prog;
+	err = bpf_trampoline_update(tr);
+	if (err)
+		tr->nr_progs[kind]--;
+out:
+	mutex_unlock(&tr->mutex);
+	return err;
+}
+
+/* On failure the current image, which holds its own reference on @prog,
+ * keeps running it until the next successful update, and the image keeps
+ * the trampoline around until then: the caller can put its reference.
+ */
+int bpf_trampoline_unlink_prog(struct bpf_trampoline *tr, struct bpf_prog *prog)
+{
+	enum bpf_tramp_prog_type kind = bpf_tramp_kind(prog);
+	int i, err = -ENOENT;
+
+	mutex_lock(&tr->mutex);
+	for (i = 0; i < tr->nr_progs[kind]; i++) {
+		if (tr->progs[kind][i] != prog)
+			continue;
+		memmove(&tr->progs[kind][i], &tr->progs[kind][i + 1],
+			(tr->nr_progs[kind] - i - 1) * sizeof(prog));
+		tr->nr_progs[kind]--;
+		err = bpf_trampoline_update(tr);
+		if (err && !tr->stale) {
+			tr->stale = true;
+			refcount_inc(&tr->refcnt);
+		}
+		break;
+	}
+	mutex_unlock(&tr->mutex);
+	return err;
+}
+
+/* The generated code calls these around the programs and the function.
+ * Like kprobe programs, tracing programs do not nest, a function hit from
+ * within a program, or from a kprobe program, is not traced.
+ */
+u64 notrace __bpf_prog_enter(void)
+{
+	preempt_disable_notrace();
+	if (unlikely(__this_cpu_inc_return(bpf_prog_active) != 1))
+		return 0;
+	rcu_read_lock();
+	return 1;
+}
+
+void notrace __bpf_prog_exit(u64 run)
+{
+	if (run)
+		rcu_read_unlock();
+	__this_cpu_dec(bpf_prog_active);
+	preempt_enable_notrace();
+}
+
+void notrace __bpf_tramp_enter(struct bpf_tramp_image *im)
+{
+	percpu_ref_get(&im->pcref);
+}
+
+void notrace __bpf_tramp_exit(struct bpf_tramp_image *im)
+{
+	percpu_ref_put(&im->pcref);
+}
+
+int __weak arch_prepare_bpf_trampoline(struct bpf_tramp_image *im,
+				       struct bpf_trampoline *tr)
+{
+	return -EOPNOTSUPP;
+}
+
+int __weak arch_bpf_trampoline_patch(struct bpf_trampoline *tr,
+				     void *old_image, void *new_image)
+{
+	return -EOPNOTSUPP;
+}
+
+struct bpf_tracing_link {
+	struct bpf_trampoline *tr;
+	struct bpf_prog *prog;
+};
+
+static int bpf_tracing_release(struct inode *inode, struct file *filp)
+{
+	struct bpf_tracing_link *link = filp->private_data;
+
+	/* a failed unpatch leaves the trampoline to its current image */
+	bpf_trampoline_unlink_prog(link->tr, link->prog);
+	bpf_trampoline_put(link->tr);
+	bpf_prog_put(link->prog);
+	kfree(link);
+	return 0;
+}
+
+static const struct file_operations bpf_tracing_fops = {
+	.release	= bpf_tracing_release,
+};
+
+/* Attach @prog to the function @name, return the file descriptor keeping
+ * it attached. Takes over the reference on @prog on success.
+ */
+int bpf_tracing_prog_open(struct bpf_prog *prog, const char *name)
+{
+	struct bpf_tracing_link *link;
+	unsigned long ip, size, offset;
+	int fd, err;
+
+	ip = kallsyms_lookup_name(name);
+	if (!ip || !kallsyms_lookup_size_offset(ip, &size, &offset) || offset)
+		return -ENOENT;
+
+	link = kzalloc(sizeof(*link), GFP_USER);
+	if (!link)
+		return -ENOMEM;
+	link->prog = prog;
+
+	link->tr = bpf_trampoline_get(ip, size);
+	if (IS_ERR(link->tr)) {
+		err = PTR_ERR(link->tr);
+		goto out_free;
+	}
+
+	err = bpf_trampoline_link_prog(link->tr, prog);
+	if (err)
+		goto out_put;
+
+	fd = anon_inode_getfd("bpf-tracing", &bpf_tracing_fops, link,
+			      O_CLOEXEC);
+	if (fd < 0) {
+		bpf_trampoline_unlink_prog(link->tr, prog);
+		err = fd;
+		goto out_put;
+	}
+	return fd;
+
+out_put:
+	bpf_trampoline_put(link->tr);
+out_free:
+	kfree(link);
+	return err;
+}
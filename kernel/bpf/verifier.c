@@ -190,6 +190,8 @@ struct bpf_call_arg_meta {
 	int access_size;
 	s64 msize_smax_value;
 	u64 msize_umax_value;
+	u32 mem_size;
+	u32 ref_obj_id;
 };
 
 static DEFINE_MUTEX(bpf_verifier_lock);
@@ -262,6 +264,8 @@ static const char * const reg_type_str[] = {
 	[PTR_TO_PACKET]		= "pkt",
 	[PTR_TO_PACKET_META]	= "pkt_meta",
 	[PTR_TO_PACKET_END]	= "pkt_end",
+	[PTR_TO_MEM]		= "mem",
+	[PTR_TO_MEM_OR_NULL]	= "mem_or_null",
 };
 
 static void print_liveness(struct bpf_verifier_env *env,
@@ -318,6 +322,8 @@ static void print_verifier_state(struct bpf_verifier_env *env,
 				verbose(env, ",ks=%d,vs=%d",
 					reg->map_ptr->key_size,
 					reg->map_ptr->value_size);
+			else if (t == PTR_TO_MEM || t == PTR_TO_MEM_OR_NULL)
+				verbose(env, ",sz=%u", reg->mem_size);
 			if (tnum_is_const(reg->var_off)) {
 				/* Typically an immediate SCALAR_VALUE, but
 				 * could be a pointer whose offset is too big
@@ -468,6 +474,9 @@ static int copy_verifier_state(struct bpf_verifier_state *dst_state,
 	}
 	dst_state->speculative = src->speculative;
 	dst_state->curframe = src->curframe;
+	dst_state->acquired_refs = src->acquired_refs;
+	memcpy(dst_state->refs, src->refs,
+	       src->acquired_refs * sizeof(src->refs[0]));
 	dst_state->parent = src->parent;
 	for (i = 0; i <= src->curframe; i++) {
 		dst = dst_state->frame[i];
@@ -731,6 +740,49 @@ static void mark_reg_not_init(struct bpf_verifier_env *env,
 	__mark_reg_not_init(regs + regno);
 }
 
+/* Memory handed out by helpers such as bpf_ringbuf_reserve() is tracked
+ * as a reference in the verifier state. The id of the reference is the id
+ * of the registers pointing to the memory, and it must be given back to a
+ * releasing helper on every path before the program exits.
+ */
+static int acquire_reference_state(struct bpf_verifier_env *env)
+{
+	struct bpf_verifier_state *state = env->cur_state;
+
+	if (state->acquired_refs == MAX_ACQUIRED_REFS) {
+		verbose(env, "too many unreleased references, max %d\n",
+			MAX_ACQUIRED_REFS);
+		return -EINVAL;
+	}
+	state->refs[state->acquired_refs++] = ++env->id_gen;
+	return env->id_gen;
+}
+
+static bool reference_held(const struct bpf_verifier_state *state, u32 id)
+{
+	int i;
+
+	for (i = 0; i < state->acquired_refs; i++)
+		if (state->refs[i] == id)
+			return true;
+	return false;
+}
+
+static void release_reference_state(struct bpf_verifier_state *state, u32 id)
+{
+	int i;
+
+	for (i = 0; i < state->acquired_refs; i++) {
+		if (state->refs[i] != id)
+			continue;
+		/* keep the order, states_equal() compares refs pairwise */
+		state->acquired_refs--;
+		memmove(&state->refs[i], &state->refs[i + 1],
+			(state->acquired_refs - i) * sizeof(state->refs[0]));
+		return;
+	}
+}
+
 static void init_reg_state(struct bpf_verifier_env *env,
 			   struct bpf_func_state *state)
 {
@@ -1002,6 +1054,8 @@ static bool is_spillable_regtype(enum bpf_reg_type type)
 	case PTR_TO_PACKET_META:
 	case PTR_TO_PACKET_END:
 	case CONST_PTR_TO_MAP:
+	case PTR_TO_MEM:
+	case PTR_TO_MEM_OR_NULL:
 		return true;
 	default:
 		return false;
@@ -1337,6 +1391,41 @@ static int check_map_access(struct bpf_verifier_env *env, u32 regno,
 	return err;
 }
 
+/* check read/write into a memory region handed out by a helper, with
+ * possible variable offset
+ */
+static int check_mem_region_access(struct bpf_verifier_env *env, u32 regno,
+				   int off, int size, u32 mem_size,
+				   bool zero_size_allowed)
+{
+	struct bpf_reg_state *reg = cur_regs(env) + regno;
+	s64 min_off, max_off;
+
+	if (reg->smin_value < 0 &&
+	    (reg->smin_value == S64_MIN ||
+	     (off + reg->smin_value != (s64)(s32)(off + reg->smin_value)) ||
+	      reg->smin_value + off < 0)) {
+		verbose(env, "R%d min value is negative, either use unsigned index or do a if (index >=0) check.\n",
+			regno);
+		return -EACCES;
+	}
+	if (reg->umax_value >= BPF_MAX_VAR_OFF) {
+		verbose(env, "R%d unbounded memory access, make sure to bounds check any memory access\n",
+			regno);
+		return -EACCES;
+	}
+
+	min_off = reg->smin_value + off;
+	max_off = reg->umax_value + off;
+	if (min_off < 0 || size < 0 || (size == 0 && !zero_size_allowed) ||
+	    max_off + size > mem_size) {
+		verbose(env, "invalid access to memory, mem_size=%u off=%lld size=%d\n",
+			mem_size, min_off < 0 ? min_off : max_off, size);
+		return -EACCES;
+	}
+	return 0;
+}
+
 #define MAX_PACKET_OFF 0xffff
 
 static bool may_access_direct_pkt_data(struct bpf_verifier_env *env,
@@ -1740,6 +1829,18 @@ static int check_mem_access(struct bpf_verifier_env *env, int insn_idx, u32 regn
 		if (!err && t == BPF_READ && value_regno >= 0)
 			mark_reg_unknown(env, regs, value_regno);
 
+	} else if (reg->type == PTR_TO_MEM) {
+		if (t == BPF_WRITE && value_regno >= 0 &&
+		    is_pointer_value(env, value_regno)) {
+			verbose(env, "R%d leaks addr into mem\n", value_regno);
+			return -EACCES;
+		}
+
+		err = check_mem_region_access(env, regno, off, size,
+					      reg->mem_size, false);
+		if (!err && t == BPF_READ && value_regno >= 0)
+			mark_reg_unknown(env, regs, value_regno);
+
 	} else if (reg->type == PTR_TO_CTX) {
 		enum bpf_reg_type reg_type = SCALAR_VALUE;
 
@@ -1948,6 +2049,10 @@ static int check_helper_mem_access(struct bpf_verifier_env *env, int regno,
 	case PTR_TO_MAP_VALUE:
 		return check_map_access(env, regno, reg->off, access_size,
 					zero_size_allowed);
+	case PTR_TO_MEM:
+		return check_mem_region_access(env, regno, reg->off,
+					       access_size, reg->mem_size,
+					       zero_size_allowed);
 	default: /* scalar_value|ptr_to_stack or invalid ptr */
 		return check_stack_boundary(env, regno, access_size,
 					    zero_size_allowed, meta);
@@ -2004,7 +2109,8 @@ static int check_func_arg(struct bpf_verifier_env *env, u32 regno,
 		    type != expected_type)
 			goto err_type;
 	} else if (arg_type == ARG_CONST_SIZE ||
-		   arg_type == ARG_CONST_SIZE_OR_ZERO) {
+		   arg_type == ARG_CONST_SIZE_OR_ZERO ||
+		   arg_type == ARG_CONST_ALLOC_SIZE_OR_ZERO) {
 		expected_type = SCALAR_VALUE;
 		if (type != expected_type)
 			goto err_type;
@@ -2030,9 +2136,32 @@ static int check_func_arg(struct bpf_verifier_env *env, u32 regno,
 			/* final test in check_stack_boundary() */;
 		else if (!type_is_pkt_pointer(type) &&
 			 type != PTR_TO_MAP_VALUE &&
+			 type != PTR_TO_MEM &&
 			 type != expected_type)
 			goto err_type;
 		meta->raw_mode = arg_type == ARG_PTR_TO_UNINIT_MEM;
+	} else if (arg_type == ARG_PTR_TO_ALLOC_MEM) {
+		expected_type = PTR_TO_MEM;
+		if (type != expected_type)
+			goto err_type;
+		/* the helper releases the whole allocation, so it must be
+		 * given back the pointer it handed out
+		 */
+		if (reg->off || !tnum_equals_const(reg->var_off, 0)) {
+			verbose(env, "R%d must point to the start of the allocated memory\n",
+				regno);
+			return -EACCES;
+		}
+		if (!reference_held(env->cur_state, reg->id)) {
+			verbose(env, "R%d memory was already released\n", regno);
+			return -EINVAL;
+		}
+		if (meta->ref_obj_id) {
+			verbose(env, "verifier internal error: more than one arg with ref_obj_id R%d %u %u\n",
+				regno, reg->id, meta->ref_obj_id);
+			return -EFAULT;
+		}
+		meta->ref_obj_id = reg->id;
 	} else {
 		verbose(env, "unsupported arg_type %d\n", arg_type);
 		return -EFAULT;
@@ -2070,6 +2199,13 @@ static int check_func_arg(struct bpf_verifier_env *env, u32 regno,
 		err = check_helper_mem_access(env, regno,
 					      meta->map_ptr->value_size, false,
 					      NULL);
+	} else if (arg_type == ARG_CONST_ALLOC_SIZE_OR_ZERO) {
+		if (!tnum_is_const(reg->var_off)) {
+			verbose(env, "R%d is not a known constant\n",
+				regno);
+			return -EACCES;
+		}
+		meta->mem_size = reg->var_off.value;
 	} else if (arg_type_is_mem_size(arg_type)) {
 		bool zero_size_allowed = (arg_type == ARG_CONST_SIZE_OR_ZERO);
 
@@ -2191,6 +2327,22 @@ static int check_map_func_compatibility(struct bpf_verifier_env *env,
 		if (func_id != BPF_FUNC_sk_select_reuseport)
 			goto error;
 		break;
+	case BPF_MAP_TYPE_RINGBUF:
+		if (func_id != BPF_FUNC_ringbuf_output &&
+		    func_id != BPF_FUNC_ringbuf_reserve &&
+		    func_id != BPF_FUNC_ringbuf_query)
+			goto error;
+		break;
+	case BPF_MAP_TYPE_TASK_STORAGE:
+		if (func_id != BPF_FUNC_task_storage_get &&
+		    func_id != BPF_FUNC_task_storage_delete)
+			goto error;
+		break;
+	case BPF_MAP_TYPE_INODE_STORAGE:
+		if (func_id != BPF_FUNC_inode_storage_get &&
+		    func_id != BPF_FUNC_inode_storage_delete)
+			goto error;
+		break;
 	default:
 		break;
 	}
@@ -2246,6 +2398,22 @@ static int check_map_func_compatibility(struct bpf_verifier_env *env,
 		if (map->map_type != BPF_MAP_TYPE_REUSEPORT_SOCKARRAY)
 			goto error;
 		break;
+	case BPF_FUNC_ringbuf_output:
+	case BPF_FUNC_ringbuf_reserve:
+	case BPF_FUNC_ringbuf_query:
+		if (map->map_type != BPF_MAP_TYPE_RINGBUF)
+			goto error;
+		break;
+	case BPF_FUNC_task_storage_get:
+	case BPF_FUNC_task_storage_delete:
+		if (map->map_type != BPF_MAP_TYPE_TASK_STORAGE)
+			goto error;
+		break;
+	case BPF_FUNC_inode_storage_get:
+	case BPF_FUNC_inode_storage_delete:
+		if (map->map_type != BPF_MAP_TYPE_INODE_STORAGE)
+			goto error;
+		break;
 	default:
 		break;
 	}
@@ -2491,6 +2659,48 @@ record_func_map(struct bpf_verifier_env *env, struct bpf_call_arg_meta *meta,
 	return 0;
 }
 
+static bool reg_is_ref(const struct bpf_reg_state *reg, u32 id)
+{
+	return (reg->type == PTR_TO_MEM || reg->type == PTR_TO_MEM_OR_NULL) &&
+	       reg->id == id;
+}
+
+/* The memory was given back by a helper: drop the reference and turn all
+ * pointers to it, in any frame, into unknown scalars.
+ */
+static void release_reference(struct bpf_verifier_env *env, u32 id)
+{
+	struct bpf_verifier_state *vstate = env->cur_state;
+	struct bpf_func_state *state;
+	int i, j;
+
+	release_reference_state(vstate, id);
+
+	for (j = 0; j <= vstate->curframe; j++) {
+		state = vstate->frame[j];
+		for (i = 0; i < MAX_BPF_REG; i++)
+			if (reg_is_ref(&state->regs[i], id))
+				__mark_reg_unknown(&state->regs[i]);
+		for (i = 0; i < state->allocated_stack / BPF_REG_SIZE; i++) {
+			if (state->stack[i].slot_type[0] != STACK_SPILL)
+				continue;
+			if (reg_is_ref(&state->stack[i].spilled_ptr, id))
+				__mark_reg_unknown(&state->stack[i].spilled_ptr);
+		}
+	}
+}
+
+static int check_reference_leak(struct bpf_verifier_env *env)
+{
+	struct bpf_verifier_state *state = env->cur_state;
+
+	if (!state->acquired_refs)
+		return 0;
+
+	verbose(env, "Unreleased reference id=%d\n", state->refs[0]);
+	return -EINVAL;
+}
+
 static int check_helper_call(struct bpf_verifier_env *env, int func_id, int insn_idx)
 {
 	const struct bpf_func_proto *fn = NULL;
@@ -2580,6 +2790,17 @@ static int check_helper_call(struct bpf_verifier_env *env, int func_id, int insn
 		return -EINVAL;
 	}
 
+	/* a tail call never returns, so nothing could release the
+	 * references held by this program
+	 */
+	if (func_id == BPF_FUNC_tail_call && env->cur_state->acquired_refs) {
+		verbose(env, "tail_call would lead to reference leak\n");
+		return -EINVAL;
+	}
+
+	if (meta.ref_obj_id)
+		release_reference(env, meta.ref_obj_id);
+
 	/* reset caller saved regs */
 	for (i = 0; i < CALLER_SAVED_REGS; i++) {
 		mark_reg_not_init(env, regs, caller_saved[i]);
@@ -2611,6 +2832,16 @@ static int check_helper_call(struct bpf_verifier_env *env, int func_id, int insn
 		}
 		regs[BPF_REG_0].map_ptr = meta.map_ptr;
 		regs[BPF_REG_0].id = ++env->id_gen;
+	} else if (fn->ret_type == RET_PTR_TO_ALLOC_MEM_OR_NULL) {
+		int id;
+
+		mark_reg_known_zero(env, regs, BPF_REG_0);
+		regs[BPF_REG_0].type = PTR_TO_MEM_OR_NULL;
+		regs[BPF_REG_0].mem_size = meta.mem_size;
+		id = acquire_reference_state(env);
+		if (id < 0)
+			return id;
+		regs[BPF_REG_0].id = id;
 	} else {
 		verbose(env, "unknown return type %d of func %s#%d\n",
 			fn->ret_type, func_id_name(func_id), func_id);
@@ -2729,6 +2960,14 @@ static int retrieve_ptr_limit(const struct bpf_reg_state *ptr_reg,
 			*ptr_limit = ptr_reg->map_ptr->value_size - off;
 		}
 		return 0;
+	case PTR_TO_MEM:
+		if (mask_to_left) {
+			*ptr_limit = ptr_reg->umax_value + ptr_reg->off;
+		} else {
+			off = ptr_reg->smin_value + ptr_reg->off;
+			*ptr_limit = ptr_reg->mem_size - off;
+		}
+		return 0;
 	default:
 		return -EINVAL;
 	}
@@ -2866,6 +3105,11 @@ static int adjust_ptr_min_max_vals(struct bpf_verifier_env *env,
 			dst);
 		return -EACCES;
 	}
+	if (ptr_reg->type == PTR_TO_MEM_OR_NULL) {
+		verbose(env, "R%d pointer arithmetic on PTR_TO_MEM_OR_NULL prohibited, null-check it first\n",
+			dst);
+		return -EACCES;
+	}
 	if (ptr_reg->type == CONST_PTR_TO_MAP) {
 		verbose(env, "R%d pointer arithmetic on CONST_PTR_TO_MAP prohibited\n",
 			dst);
@@ -2876,7 +3120,7 @@ static int adjust_ptr_min_max_vals(struct bpf_verifier_env *env,
 			dst);
 		return -EACCES;
 	}
-	if (ptr_reg->type == PTR_TO_MAP_VALUE &&
+	if ((ptr_reg->type == PTR_TO_MAP_VALUE || ptr_reg->type == PTR_TO_MEM) &&
 	    !env->allow_ptr_leaks && !known && (smin_val < 0) != (smax_val < 0)) {
 		verbose(env, "R%d has unknown scalar with mixed signed bounds, pointer arithmetic with it prohibited for !root\n",
 			off_reg == dst_reg ? dst : src);
@@ -3938,7 +4182,8 @@ static void mark_map_reg(struct bpf_reg_state *regs, u32 regno, u32 id,
 {
 	struct bpf_reg_state *reg = &regs[regno];
 
-	if (reg->type == PTR_TO_MAP_VALUE_OR_NULL && reg->id == id) {
+	if ((reg->type == PTR_TO_MAP_VALUE_OR_NULL ||
+	     reg->type == PTR_TO_MEM_OR_NULL) && reg->id == id) {
 		/* Old offset (both fixed and variable parts) should
 		 * have been known-zero, because we don't allow pointer
 		 * arithmetic on pointers that might be NULL.
@@ -3951,6 +4196,12 @@ static void mark_map_reg(struct bpf_reg_state *regs, u32 regno, u32 id,
 		}
 		if (is_null) {
 			reg->type = SCALAR_VALUE;
+		} else if (reg->type == PTR_TO_MEM_OR_NULL) {
+			/* keep the id, it names the reference that has to
+			 * be released through this pointer
+			 */
+			reg->type = PTR_TO_MEM;
+			return;
 		} else if (reg->map_ptr->inner_map_meta) {
 			reg->type = CONST_PTR_TO_MAP;
 			reg->map_ptr = reg->map_ptr->inner_map_meta;
@@ -3973,6 +4224,7 @@ static void mark_map_regs(struct bpf_verifier_state *vstate, u32 regno,
 {
 	struct bpf_func_state *state = vstate->frame[vstate->curframe];
 	struct bpf_reg_state *regs = state->regs;
+	enum bpf_reg_type type = regs[regno].type;
 	u32 id = regs[regno].id;
 	int i, j;
 
@@ -3987,6 +4239,12 @@ static void mark_map_regs(struct bpf_verifier_state *vstate, u32 regno,
 			mark_map_reg(&state->stack[i].spilled_ptr, 0, id, is_null);
 		}
 	}
+
+	/* the helper failed to hand out memory on this branch, so there is
+	 * nothing to release
+	 */
+	if (is_null && type == PTR_TO_MEM_OR_NULL)
+		release_reference_state(vstate, id);
 }
 
 static bool try_match_pkt_pointers(const struct bpf_insn *insn,
@@ -4178,10 +4436,13 @@ static int check_cond_jmp_op(struct bpf_verifier_env *env,
 					dst_reg, insn->imm, opcode);
 	}
 
-	/* detect if R == 0 where R is returned from bpf_map_lookup_elem() */
+	/* detect if R == 0 where R is returned from bpf_map_lookup_elem() or
+	 * another helper returning memory or NULL
+	 */
 	if (BPF_SRC(insn->code) == BPF_K &&
 	    insn->imm == 0 && (opcode == BPF_JEQ || opcode == BPF_JNE) &&
-	    dst_reg->type == PTR_TO_MAP_VALUE_OR_NULL) {
+	    (dst_reg->type == PTR_TO_MAP_VALUE_OR_NULL ||
+	     dst_reg->type == PTR_TO_MEM_OR_NULL)) {
 		/* Mark all identical map registers in each branch as either
 		 * safe or unknown depending R == 0 or R != 0 conditional.
 		 */
@@ -4297,6 +4558,12 @@ static int check_ld_abs(struct bpf_verifier_env *env, struct bpf_insn *insn)
 		return -EINVAL;
 	}
 
+	/* a failed load exits the program implicitly */
+	if (env->cur_state->acquired_refs) {
+		verbose(env, "BPF_LD_[ABS|IND] cannot be mixed with unreleased references\n");
+		return -EINVAL;
+	}
+
 	if (insn->dst_reg != BPF_REG_0 || insn->off != 0 ||
 	    BPF_SIZE(insn->code) == BPF_DW ||
 	    (mode == BPF_ABS && insn->src_reg != BPF_REG_0)) {
@@ -4596,8 +4863,11 @@ static bool range_within(struct bpf_reg_state *old,
 	       old->smax_value >= cur->smax_value;
 }
 
-/* Maximum number of register states that can exist at once */
-#define ID_MAP_SIZE	(MAX_BPF_REG + MAX_BPF_STACK / BPF_REG_SIZE)
+/* Maximum number of register states that can exist at once, in all frames,
+ * plus the references they may point to
+ */
+#define ID_MAP_SIZE	((MAX_BPF_REG + MAX_BPF_STACK / BPF_REG_SIZE) * \
+			 MAX_CALL_FRAMES + MAX_ACQUIRED_REFS)
 struct idpair {
 	u32 old;
 	u32 cur;
@@ -4697,6 +4967,21 @@ static bool regsafe(struct bpf_reg_state *rold, struct bpf_reg_state *rcur,
 			return false;
 		/* Check our ids match any regs they're supposed to */
 		return check_ids(rold->id, rcur->id, idmap);
+	case PTR_TO_MEM:
+	case PTR_TO_MEM_OR_NULL:
+		if (rcur->type != rold->type)
+			return false;
+		/* same size and fixed offset */
+		if (memcmp(rold, rcur, offsetof(struct bpf_reg_state, id)))
+			return false;
+		/* the id names the reference, which must be the one
+		 * matched by states_equal()
+		 */
+		if (!check_ids(rold->id, rcur->id, idmap))
+			return false;
+		/* new val must satisfy old val knowledge */
+		return range_within(rold, rcur) &&
+		       tnum_in(rold->var_off, rcur->var_off);
 	case PTR_TO_PACKET_META:
 	case PTR_TO_PACKET:
 		if (rcur->type != rold->type)
@@ -4825,34 +5110,45 @@ static bool stacksafe(struct bpf_func_state *old,
  * the current state will reach 'bpf_exit' instruction safely
  */
 static bool func_states_equal(struct bpf_func_state *old,
-			      struct bpf_func_state *cur)
+			      struct bpf_func_state *cur,
+			      struct idpair *idmap)
 {
-	struct idpair *idmap;
-	bool ret = false;
 	int i;
 
-	idmap = kcalloc(ID_MAP_SIZE, sizeof(struct idpair), GFP_KERNEL);
-	/* If we failed to allocate the idmap, just say it's not safe */
-	if (!idmap)
-		return false;
-
 	for (i = 0; i < MAX_BPF_REG; i++) {
 		if (!regsafe(&old->regs[i], &cur->regs[i], idmap))
-			goto out_free;
+			return false;
 	}
 
-	if (!stacksafe(old, cur, idmap))
-		goto out_free;
-	ret = true;
-out_free:
-	kfree(idmap);
-	return ret;
+	return stacksafe(old, cur, idmap);
+}
+
+/* Both states must hold the same references, acquired in the same order.
+ * Seeding the idmap with them makes sure that registers in any frame
+ * point to corresponding references.
+ */
+static bool refsafe(struct bpf_verifier_state *old,
+		    struct bpf_verifier_state *cur,
+		    struct idpair *idmap)
+{
+	int i;
+
+	if (old->acquired_refs != cur->acquired_refs)
+		return false;
+
+	for (i = 0; i < old->acquired_refs; i++) {
+		if (!check_ids(old->refs[i], cur->refs[i], idmap))
+			return false;
+	}
+	return true;
 }
 
 static bool states_equal(struct bpf_verifier_env *env,
 			 struct bpf_verifier_state *old,
 			 struct bpf_verifier_state *cur)
 {
+	struct idpair *idmap;
+	bool ret = false;
 	int i;
 
 	if (old->curframe != cur->curframe)
@@ -4864,16 +5160,27 @@ static bool states_equal(struct bpf_verifier_env *env,
 	if (old->speculative && !cur->speculative)
 		return false;
 
+	idmap = kcalloc(ID_MAP_SIZE, sizeof(struct idpair), GFP_KERNEL);
+	/* If we failed to allocate the idmap, just say it's not safe */
+	if (!idmap)
+		return false;
+
+	if (!refsafe(old, cur, idmap))
+		goto out_free;
+
 	/* for states to be equal callsites have to be the same
 	 * and all frame states need to be equivalent
 	 */
 	for (i = 0; i <= old->curframe; i++) {
 		if (old->frame[i]->callsite != cur->frame[i]->callsite)
-			return false;
-		if (!func_states_equal(old->frame[i], cur->frame[i]))
-			return false;
+			goto out_free;
+		if (!func_states_equal(old->frame[i], cur->frame[i], idmap))
+			goto out_free;
 	}
-	return true;
+	ret = true;
+out_free:
+	kfree(idmap);
+	return ret;
 }
 
 /* A write screens off any subsequent reads; but write marks come from the
@@ -5271,6 +5578,10 @@ static int do_check(struct bpf_verifier_env *env)
 					continue;
 				}
 
+				err = check_reference_leak(env);
+				if (err)
+					return err;
+
 				/* eBPF calling convetion is such that R0 is used
 				 * to return the value from eBPF program.
 				 * Make sure that it's readable at this time
@@ -5348,6 +5659,10 @@ process_bpf_exit:
 
 static int check_map_prealloc(struct bpf_map *map)
 {
+	/* resizable hash maps always allocate elements on update */
+	if (map->map_type == BPF_MAP_TYPE_RHASH)
+		return 0;
+
 	return (map->map_type != BPF_MAP_TYPE_HASH &&
 		map->map_type != BPF_MAP_TYPE_PERCPU_HASH &&
 		map->map_type != BPF_MAP_TYPE_HASH_OF_MAPS) ||
@@ -35,6 +35,7 @@
 #include <linux/iocontext.h>
 #include <linux/key.h>
 #include <linux/binfmts.h>
+#include <linux/bpf_local_storage.h>
 #include <linux/mman.h>
 #include <linux/mmu_notifier.h>
 #include <linux/hmm.h>
@@ -410,6 +411,7 @@ void free_task(struct task_struct *tsk)
 	rt_mutex_debug_task_free(tsk);
 	ftrace_graph_exit_task(tsk);
 	put_seccomp_filter(tsk);
+	bpf_task_storage_free(tsk);
 	arch_release_task_struct(tsk);
 	if (tsk->flags & PF_KTHREAD)
 		free_kthread_struct(tsk);
@@ -631,6 +633,7 @@ void __mmdrop(struct mm_struct *mm)
 	destroy_context(mm);
 	hmm_mm_destroy(mm);
 	mmu_notifier_mm_destroy(mm);
+	futex_hash_free(mm);
 	check_mm(mm);
 	put_user_ns(mm->user_ns);
 	free_mm(mm);
@@ -959,6 +962,7 @@ static struct mm_struct *mm_init(struct mm_struct *mm, struct task_struct *p,
 	mm->pmd_huge_pte = NULL;
 #endif
 	mm_init_uprobes_state(mm);
+	futex_mm_init(mm);
 
 	if (current->mm) {
 		mm->flags = current->mm->flags & MMF_INIT_MASK;
@@ -1708,6 +1712,9 @@ static __latent_entropy struct task_struct *copy_process(
 		    (task_active_pid_ns(current) !=
 				current->nsproxy->pid_ns_for_children))
 			return ERR_PTR(-EINVAL);
+
+		/* The second thread of a process brings a private futex hash */
+		futex_hash_allocate_default();
 	}
 
 	/*
@@ -1740,6 +1747,10 @@ static __latent_entropy struct task_struct *copy_process(
 	 * kernel threads (PF_KTHREAD).
 	 */
 	p->set_child_tid = (clone_flags & CLONE_CHILD_SETTID) ? child_tidptr : NULL;
+#ifdef CONFIG_BPF_SYSCALL
+	/* the storage of the parent is not inherited */
+	RCU_INIT_POINTER(p->bpf_storage, NULL);
+#endif
 	/*
 	 * Clear TID on mm_release()?
 	 */
@@ -67,6 +67,10 @@
 #include <linux/freezer.h>
 #include <linux/bootmem.h>
 #include <linux/fault-inject.h>
+#include <linux/debugfs.h>
+#include <linux/prctl.h>
+#include <linux/seq_file.h>
+#include <linux/jump_label.h>
 
 #include <asm/futex.h>
 
@@ -277,6 +281,42 @@ static struct {
 #define futex_queues   (__futex_data.queues)
 #define futex_hashsize (__futex_data.hashsize)
 
+#ifdef CONFIG_FUTEX_PRIVATE_HASH
+/*
+ * The private futexes of a process hash into a table of its own once it
+ * has one, see futex_hash_prctl(). The table is only ever changed while
+ * the process has a single user of its mm: no other task can be looking
+ * up or be queued on one of its private futexes then.
+ */
+struct futex_private_hash {
+	unsigned int		 hash_mask;
+	struct futex_hash_bucket queues[];
+};
+
+static atomic_long_t futex_private_tables;
+#endif
+
+#if defined(CONFIG_FUTEX_PRIVATE_HASH) && defined(CONFIG_DEBUG_FS)
+/*
+ * Lock statistics of the hash buckets of the futex_wait() and futex_wake()
+ * paths, for the global table and the private ones.  Only counted once
+ * enabled by writing 1 to debugfs futex_hash.
+ */
+enum {
+	FUTEX_HASH_GLOBAL,
+	FUTEX_HASH_PRIVATE,
+	FUTEX_HASH_NR,
+};
+
+struct futex_hash_stats {
+	unsigned long lookups[FUTEX_HASH_NR];
+	unsigned long contended[FUTEX_HASH_NR];
+};
+
+static DEFINE_PER_CPU(struct futex_hash_stats, futex_hash_stats);
+static DEFINE_STATIC_KEY_FALSE(futex_hash_stats_enabled);
+#endif
+
 
 /*
  * Fault injections for futexes.
@@ -384,20 +424,60 @@ static inline int hb_waiters_pending(struct futex_hash_bucket *hb)
 }
 
 /**
- * hash_futex - Return the hash bucket in the global hash
+ * hash_futex - Return the hash bucket of a futex key
  * @key:	Pointer to the futex key for which the hash is calculated
  *
  * We hash on the keys returned from get_futex_key (see below) and return the
- * corresponding hash bucket in the global hash.
+ * corresponding hash bucket in the private hash of the process for private
+ * keys if it has one, in the global hash otherwise.
  */
 static struct futex_hash_bucket *hash_futex(union futex_key *key)
 {
 	u32 hash = jhash2((u32*)&key->both.word,
 			  (sizeof(key->both.word)+sizeof(key->both.ptr))/4,
 			  key->both.offset);
+#ifdef CONFIG_FUTEX_PRIVATE_HASH
+	struct futex_private_hash *fph;
+
+	if (!(key->both.offset & (FUT_OFF_INODE | FUT_OFF_MMSHARED))) {
+		fph = key->private.mm->futex_phash;
+		if (fph)
+			return &fph->queues[hash & fph->hash_mask];
+	}
+#endif
 	return &futex_queues[hash & (futex_hashsize - 1)];
 }
 
+#if defined(CONFIG_FUTEX_PRIVATE_HASH) && defined(CONFIG_DEBUG_FS)
+/* Lock a hash bucket, accounting for the contention on its lock */
+static void hb_lock_stats(struct futex_hash_bucket *hb)
+	__acquires(&hb->lock)
+{
+	int table = FUTEX_HASH_GLOBAL;
+
+	if (hb < futex_queues || hb >= futex_queues + futex_hashsize)
+		table = FUTEX_HASH_PRIVATE;
+
+	this_cpu_inc(futex_hash_stats.lookups[table]);
+	if (!spin_trylock(&hb->lock)) {
+		this_cpu_inc(futex_hash_stats.contended[table]);
+		spin_lock(&hb->lock);
+	}
+}
+#endif
+
+static inline void hb_lock(struct futex_hash_bucket *hb)
+	__acquires(&hb->lock)
+{
+#if defined(CONFIG_FUTEX_PRIVATE_HASH) && defined(CONFIG_DEBUG_FS)
+	if (static_branch_unlikely(&futex_hash_stats_enabled)) {
+		hb_lock_stats(hb);
+		return;
+	}
+#endif
+	spin_lock(&hb->lock);
+}
+
 
 /**
  * match_futex - Check whether two futex keys are equal
@@ -1593,7 +1673,7 @@ futex_wake(u32 __user *uaddr, unsigned int flags, int nr_wake, u32 bitset)
 	if (!hb_waiters_pending(hb))
 		goto out_put_key;
 
-	spin_lock(&hb->lock);
+	hb_lock(hb);
 
 	plist_for_each_entry_safe(this, next, &hb->chain, list) {
 		if (match_futex (&this->key, &key)) {
@@ -2217,7 +2297,7 @@ static inline struct futex_hash_bucket *queue_lock(struct futex_q *q)
 
 	q->lock_ptr = &hb->lock;
 
-	spin_lock(&hb->lock); /* implies smp_mb(); (A) */
+	hb_lock(hb); /* implies smp_mb(); (A) */
 	return hb;
 }
 
@@ -2775,6 +2855,174 @@ static long futex_wait_restart(struct restart_block *restart)
 				restart->futex.val, tp, restart->futex.bitset);
 }
 
+/**
+ * struct futex_vector - A futex futex_waitv() waits on
+ * @w:	the futex_waitv given by userspace
+ * @q:	the futex_q queued on its hash bucket
+ */
+struct futex_vector {
+	struct futex_waitv w;
+	struct futex_q q;
+};
+
+/**
+ * unqueue_multiple() - Remove the futex_qs of a futex vector
+ * @vs:		the futex vector
+ * @count:	the number of futex_qs of the vector that were queued
+ *
+ * Like unqueue_me(), drops the q.key references.
+ *
+ * Return:
+ *  - >=0 - index of the last futex_q already removed by a waking thread;
+ *  -  -1 - all the futex_qs were still queued.
+ */
+static int unqueue_multiple(struct futex_vector *vs, int count)
+{
+	int ret = -1, i;
+
+	for (i = 0; i < count; i++) {
+		if (!unqueue_me(&vs[i].q))
+			ret = i;
+	}
+	return ret;
+}
+
+/**
+ * futex_wait_multiple_setup() - Prepare to wait on and queue several futexes
+ * @vs:		the futex vector
+ * @count:	the number of futexes of the vector
+ * @woken:	index of a futex woken while the others were being queued
+ *
+ * A hash bucket lock can not be held while the next futex is looked at,
+ * so each futex_q is queued as soon as its value is checked, which makes
+ * the task state TASK_INTERRUPTIBLE before the first check: a wakeup of
+ * an already queued futex must not be lost. get_futex_key() can sleep, so
+ * all the keys are taken beforehand.
+ *
+ * Return:
+ *  -  1 - a futex was woken during the setup, its index is in *woken;
+ *  -  0 - all the futexes are queued;
+ *  - <0 - -EFAULT, -EINVAL or -EWOULDBLOCK, nothing is queued.
+ */
+static int futex_wait_multiple_setup(struct futex_vector *vs, int count,
+				     int *woken)
+{
+	struct futex_hash_bucket *hb;
+	int ret, i, j;
+	u32 uval;
+
+retry:
+	for (i = 0; i < count; i++) {
+		ret = get_futex_key(u64_to_user_ptr(vs[i].w.uaddr),
+				    !(vs[i].w.flags & FUTEX_PRIVATE_FLAG),
+				    &vs[i].q.key, VERIFY_READ);
+		if (unlikely(ret)) {
+			while (i--)
+				put_futex_key(&vs[i].q.key);
+			return ret;
+		}
+	}
+
+	set_current_state(TASK_INTERRUPTIBLE);
+
+	for (i = 0; i < count; i++) {
+		u32 __user *uaddr = u64_to_user_ptr(vs[i].w.uaddr);
+		struct futex_q *q = &vs[i].q;
+
+		hb = queue_lock(q);
+		ret = get_futex_value_locked(&uval, uaddr);
+		if (!ret && uval == (u32)vs[i].w.val) {
+			queue_me(q, hb);
+			continue;
+		}
+
+		queue_unlock(hb);
+		__set_current_state(TASK_RUNNING);
+
+		for (j = i; j < count; j++)
+			put_futex_key(&vs[j].q.key);
+
+		/* A woken futex wins over a fault or a changed value */
+		*woken = unqueue_multiple(vs, i);
+		if (*woken >= 0)
+			return 1;
+
+		if (ret) {
+			/* Fault the page in with nothing locked or queued */
+			if (get_user(uval, uaddr))
+				return -EFAULT;
+			goto retry;
+		}
+
+		return -EWOULDBLOCK;
+	}
+
+	return 0;
+}
+
+/**
+ * futex_sleep_multiple() - Sleep unless a futex was woken or we timed out
+ * @vs:		the futex vector
+ * @count:	the number of futexes of the vector
+ * @timeout:	the started hrtimer_sleeper, or null for no timeout
+ */
+static void futex_sleep_multiple(struct futex_vector *vs, int count,
+				 struct hrtimer_sleeper *timeout)
+{
+	int i;
+
+	if (timeout && !timeout->task)
+		return;
+
+	for (i = 0; i < count; i++) {
+		if (!READ_ONCE(vs[i].q.lock_ptr))
+			return;
+	}
+
+	freezable_schedule();
+}
+
+/**
+ * futex_wait_multiple() - Wait on several futexes at once
+ * @vs:		the futex vector
+ * @count:	the number of futexes of the vector
+ * @timeout:	the prepared hrtimer_sleeper, or null for no timeout
+ *
+ * Return: the index of a woken futex, or -EWOULDBLOCK, -ETIMEDOUT,
+ * -ERESTARTSYS or -EFAULT.
+ */
+static int futex_wait_multiple(struct futex_vector *vs, int count,
+			       struct hrtimer_sleeper *timeout)
+{
+	int ret, woken = -1;
+
+	if (timeout)
+		hrtimer_start_expires(&timeout->timer, HRTIMER_MODE_ABS);
+
+	for (;;) {
+		ret = futex_wait_multiple_setup(vs, count, &woken);
+		if (ret)
+			return ret > 0 ? woken : ret;
+
+		futex_sleep_multiple(vs, count, timeout);
+		__set_current_state(TASK_RUNNING);
+
+		/* If one of the futexes was woken, we succeeded, whatever. */
+		ret = unqueue_multiple(vs, count);
+		if (ret >= 0)
+			return ret;
+
+		if (timeout && !timeout->task)
+			return -ETIMEDOUT;
+		/*
+		 * The timeout is absolute, so the syscall can be restarted
+		 * as is. Otherwise this was a spurious wakeup, wait again.
+		 */
+		if (signal_pending(current))
+			return -ERESTARTSYS;
+	}
+}
+
 
 /*
  * Userspace tried a 0 -> TID atomic transition of the futex value
@@ -3707,6 +3955,287 @@ SYSCALL_DEFINE6(futex, u32 __user *, uaddr, int, op, u32, val,
 	return do_futex(uaddr, op, val, tp, uaddr2, val2, val3);
 }
 
+#define FUTEXV_WAITER_MASK	(FUTEX_32 | FUTEX_PRIVATE_FLAG)
+
+static int futex_parse_waitv(struct futex_vector *vs,
+			     struct futex_waitv __user *uwaitv,
+			     unsigned int nr_futexes)
+{
+	struct futex_waitv aux;
+	unsigned int i;
+
+	for (i = 0; i < nr_futexes; i++) {
+		if (copy_from_user(&aux, &uwaitv[i], sizeof(aux)))
+			return -EFAULT;
+
+		if ((aux.flags & ~FUTEXV_WAITER_MASK) || aux.__reserved)
+			return -EINVAL;
+		if (!(aux.flags & FUTEX_32) || aux.val > U32_MAX)
+			return -EINVAL;
+
+		vs[i].w = aux;
+		vs[i].q = futex_q_init;
+	}
+
+	return 0;
+}
+
+/**
+ * sys_futex_waitv - Wait on a list of futexes
+ * @waiters:	array of the futexes to wait on
+ * @nr_futexes:	length of the array, at most FUTEX_WAITV_MAX
+ * @flags:	no flags are defined yet, must be 0
+ * @timeout:	absolute timeout, or NULL to wait forever
+ * @clockid:	CLOCK_MONOTONIC or CLOCK_REALTIME, the clock of the timeout
+ *
+ * Blocks until one of the futexes is woken by FUTEX_WAKE, the way
+ * FUTEX_WAIT blocks on a single one: the task is queued on all of the
+ * futexes, as long as each holds its expected value.
+ *
+ * Return: the index in @waiters of a woken futex. -EWOULDBLOCK if a futex
+ * did not hold its expected value, -ETIMEDOUT on timeout, other negative
+ * errors for invalid arguments.
+ */
+SYSCALL_DEFINE5(futex_waitv, struct futex_waitv __user *, waiters,
+		unsigned int, nr_futexes, unsigned int, flags,
+		struct __kernel_timespec __user *, timeout, clockid_t, clockid)
+{
+	struct hrtimer_sleeper to;
+	struct futex_vector *vs;
+	struct timespec64 ts;
+	int ret;
+
+	if (flags)
+		return -EINVAL;
+
+	if (!waiters || !nr_futexes || nr_futexes > FUTEX_WAITV_MAX)
+		return -EINVAL;
+
+	if (timeout) {
+		if (clockid != CLOCK_REALTIME && clockid != CLOCK_MONOTONIC)
+			return -EINVAL;
+		if (get_timespec64(&ts, timeout))
+			return -EFAULT;
+		if (!timespec64_valid(&ts))
+			return -EINVAL;
+
+		hrtimer_init_on_stack(&to.timer, clockid, HRTIMER_MODE_ABS);
+		hrtimer_init_sleeper(&to, current);
+		hrtimer_set_expires_range_ns(&to.timer, timespec64_to_ktime(ts),
+					     current->timer_slack_ns);
+	}
+
+	vs = kcalloc(nr_futexes, sizeof(*vs), GFP_KERNEL);
+	if (!vs) {
+		ret = -ENOMEM;
+		goto out;
+	}
+
+	ret = futex_parse_waitv(vs, waiters, nr_futexes);
+	if (!ret)
+		ret = futex_wait_multiple(vs, nr_futexes, timeout ? &to : NULL);
+
+	kfree(vs);
+out:
+	if (timeout) {
+		hrtimer_cancel(&to.timer);
+		destroy_hrtimer_on_stack(&to.timer);
+	}
+	return ret;
+}
+
+static void futex_hash_bucket_init(struct futex_hash_bucket *hb)
+{
+	atomic_set(&hb->waiters, 0);
+	plist_head_init(&hb->chain);
+	spin_lock_init(&hb->lock);
+}
+
+#ifdef CONFIG_FUTEX_PRIVATE_HASH
+static struct futex_private_hash *futex_private_hash_alloc(unsigned int slots)
+{
+	struct futex_private_hash *fph;
+	unsigned int i;
+
+	fph = kvzalloc(struct_size(fph, queues, slots), GFP_KERNEL_ACCOUNT);
+	if (!fph)
+		return NULL;
+
+	fph->hash_mask = slots - 1;
+	for (i = 0; i < slots; i++)
+		futex_hash_bucket_init(&fph->queues[i]);
+	atomic_long_inc(&futex_private_tables);
+	return fph;
+}
+
+static void futex_private_hash_free(struct futex_private_hash *fph)
+{
+	if (!fph)
+		return;
+	atomic_long_dec(&futex_private_tables);
+	kvfree(fph);
+}
+
+void futex_mm_init(struct mm_struct *mm)
+{
+	mm->futex_phash = NULL;
+	mm->futex_phash_set = false;
+}
+
+void futex_hash_free(struct mm_struct *mm)
+{
+	futex_private_hash_free(mm->futex_phash);
+}
+
+/* Whether the private hash of the mm of current can be changed */
+static bool futex_hash_can_set(struct mm_struct *mm)
+{
+	return mm && atomic_read(&mm->mm_users) == 1;
+}
+
+/*
+ * Called by the only thread of a process when it creates a second one:
+ * allocate a private hash, four buckets per online CPU, unless the size
+ * was set with PR_FUTEX_HASH. The global hash stays in use on failure.
+ */
+void futex_hash_allocate_default(void)
+{
+	struct mm_struct *mm = current->mm;
+	unsigned long slots;
+
+	if (!futex_hash_can_set(mm) || mm->futex_phash || mm->futex_phash_set)
+		return;
+
+	slots = roundup_pow_of_two(4 * num_online_cpus());
+	slots = clamp(slots, 16UL, futex_hashsize);
+	mm->futex_phash = futex_private_hash_alloc(slots);
+}
+
+static int futex_hash_set_slots(unsigned long slots)
+{
+	struct mm_struct *mm = current->mm;
+	struct futex_private_hash *fph = NULL;
+
+	/* 0 hashes the private futexes into the global hash */
+	if (slots && (slots < 2 || slots > futex_hashsize ||
+		      !is_power_of_2(slots)))
+		return -EINVAL;
+
+	if (!futex_hash_can_set(mm))
+		return -EBUSY;
+
+	if (slots) {
+		fph = futex_private_hash_alloc(slots);
+		if (!fph)
+			return -ENOMEM;
+	}
+
+	futex_private_hash_free(mm->futex_phash);
+	mm->futex_phash = fph;
+	mm->futex_phash_set = true;
+	return 0;
+}
+
+static int futex_hash_get_slots(void)
+{
+	struct futex_private_hash *fph = current->mm->futex_phash;
+
+	return fph ? fph->hash_mask + 1 : 0;
+}
+
+/**
+ * futex_hash_prctl() - PR_FUTEX_HASH
+ * @arg2:	PR_FUTEX_HASH_SET_SLOTS or PR_FUTEX_HASH_GET_SLOTS
+ * @arg3:	number of buckets to set, a power of two, 0 for the global hash
+ * @arg4:	must be 0
+ *
+ * The size can only be set while the process is single threaded, -EBUSY
+ * otherwise: set it before creating threads.
+ */
+int futex_hash_prctl(unsigned long arg2, unsigned long arg3,
+		     unsigned long arg4)
+{
+	switch (arg2) {
+	case PR_FUTEX_HASH_SET_SLOTS:
+		if (arg4)
+			return -EINVAL;
+		return futex_hash_set_slots(arg3);
+	case PR_FUTEX_HASH_GET_SLOTS:
+		if (arg3 || arg4)
+			return -EINVAL;
+		return futex_hash_get_slots();
+	}
+	return -EINVAL;
+}
+#endif
+
+#if defined(CONFIG_FUTEX_PRIVATE_HASH) && defined(CONFIG_DEBUG_FS)
+static int futex_hash_stats_show(struct seq_file *m, void *v)
+{
+	unsigned long lookups[FUTEX_HASH_NR] = {}, contended[FUTEX_HASH_NR] = {};
+	struct futex_hash_stats *stats;
+	int cpu, i;
+
+	for_each_possible_cpu(cpu) {
+		stats = per_cpu_ptr(&futex_hash_stats, cpu);
+		for (i = 0; i < FUTEX_HASH_NR; i++) {
+			lookups[i] += stats->lookups[i];
+			contended[i] += stats->contended[i];
+		}
+	}
+
+	seq_printf(m, "enabled %d\n",
+		   static_key_enabled(&futex_hash_stats_enabled));
+	seq_printf(m, "global_buckets %lu\n", futex_hashsize);
+	seq_printf(m, "global_lookups %lu\n", lookups[FUTEX_HASH_GLOBAL]);
+	seq_printf(m, "global_contended %lu\n", contended[FUTEX_HASH_GLOBAL]);
+	seq_printf(m, "private_tables %ld\n",
+		   atomic_long_read(&futex_private_tables));
+	seq_printf(m, "private_lookups %lu\n", lookups[FUTEX_HASH_PRIVATE]);
+	seq_printf(m, "private_contended %lu\n", contended[FUTEX_HASH_PRIVATE]);
+	return 0;
+}
+
+static int futex_hash_stats_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, futex_hash_stats_show, NULL);
+}
+
+/* Start or stop counting, the bucket lock paths are untouched otherwise */
+static ssize_t futex_hash_stats_write(struct file *file,
+				      const char __user *ubuf,
+				      size_t cnt, loff_t *ppos)
+{
+	bool enable;
+	int ret;
+
+	ret = kstrtobool_from_user(ubuf, cnt, &enable);
+	if (ret)
+		return ret;
+	if (enable)
+		static_branch_enable(&futex_hash_stats_enabled);
+	else
+		static_branch_disable(&futex_hash_stats_enabled);
+	return cnt;
+}
+
+static const struct file_operations futex_hash_stats_fops = {
+	.open		= futex_hash_stats_open,
+	.read		= seq_read,
+	.write		= futex_hash_stats_write,
+	.llseek		= seq_lseek,
+	.release	= single_release,
+};
+
+static int __init futex_hash_debugfs(void)
+{
+	debugfs_create_file("futex_hash", 0644, NULL, NULL,
+			    &futex_hash_stats_fops);
+	return 0;
+}
+late_initcall(futex_hash_debugfs);
+#endif
+
 static void __init futex_detect_cmpxchg(void)
 {
 #ifndef CONFIG_HAVE_FUTEX_CMPXCHG
@@ -3747,11 +4276,8 @@ static int __init futex_init(void)
 
 	futex_detect_cmpxchg();
 
-	for (i = 0; i < futex_hashsize; i++) {
-		atomic_set(&futex_queues[i].waiters, 0);
-		plist_head_init(&futex_queues[i].chain);
-		spin_lock_init(&futex_queues[i].lock);
-	}
+	for (i = 0; i < futex_hashsize; i++)
+		futex_hash_bucket_init(&futex_queues[i]);
 
 	return 0;
 }
@@ -205,7 +205,12 @@ static unsigned long sugov_get_util(struct sugov_cpu *sg_cpu)
 	sg_cpu->max = max = arch_scale_cpu_capacity(NULL, sg_cpu->cpu);
 	sg_cpu->bw_dl = cpu_bw_dl(rq);
 
-	if (rt_rq_is_runnable(&rq->rt))
+	/*
+	 * With util clamping, RT tasks are boosted to max by their default
+	 * UCLAMP_MIN, which can be lowered per task: let the clamped sum below
+	 * decide their frequency.
+	 */
+	if (!IS_BUILTIN(CONFIG_UCLAMP_TASK) && rt_rq_is_runnable(&rq->rt))
 		return max;
 
 	/*
@@ -226,6 +231,9 @@ static unsigned long sugov_get_util(struct sugov_cpu *sg_cpu)
 	util = cpu_util_cfs(rq);
 	util += cpu_util_rt(rq);
 
+	/* Apply the boost and cap of the RUNNABLE tasks of the CPU */
+	util = uclamp_util(rq, util);
+
 	/*
 	 * We do not make cpu_util_dl() a permanent part of this sum because we
 	 * want to use cpu_bw_dl() later on, but we need to check if the
@@ -382,6 +390,7 @@ static unsigned long sugov_iowait_apply(struct sugov_cpu *sg_cpu, u64 time,
 	 * into the same scale so we can compare.
 	 */
 	boost = (sg_cpu->iowait_boost * max) >> SCHED_CAPACITY_SHIFT;
+	boost = uclamp_util(cpu_rq(sg_cpu->cpu), boost);
 	return max(boost, util);
 }
 
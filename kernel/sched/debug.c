@@ -889,6 +889,8 @@ void proc_sched_show_task(struct task_struct *p, struct pid_namespace *ns,
 		"----------\n");
 #define __P(F) \
 	SEQ_printf(m, "%-45s:%21Ld\n", #F, (long long)F)
+#define __PS(S, F) \
+	SEQ_printf(m, "%-45s:%21Ld\n", S, (long long)(F))
 #define P(F) \
 	SEQ_printf(m, "%-45s:%21Ld\n", #F, (long long)p->F)
 #define P_SCHEDSTAT(F) \
@@ -929,6 +931,7 @@ void proc_sched_show_task(struct task_struct *p, struct pid_namespace *ns,
 		P_SCHEDSTAT(se.statistics.nr_failed_migrations_running);
 		P_SCHEDSTAT(se.statistics.nr_failed_migrations_hot);
 		P_SCHEDSTAT(se.statistics.nr_forced_migrations);
+		P_SCHEDSTAT(se.statistics.nr_migrations_cross_llc);
 		P_SCHEDSTAT(se.statistics.nr_wakeups);
 		P_SCHEDSTAT(se.statistics.nr_wakeups_sync);
 		P_SCHEDSTAT(se.statistics.nr_wakeups_migrate);
@@ -938,6 +941,7 @@ void proc_sched_show_task(struct task_struct *p, struct pid_namespace *ns,
 		P_SCHEDSTAT(se.statistics.nr_wakeups_affine_attempts);
 		P_SCHEDSTAT(se.statistics.nr_wakeups_passive);
 		P_SCHEDSTAT(se.statistics.nr_wakeups_idle);
+		P_SCHEDSTAT(se.statistics.nr_wakeups_cluster);
 
 		avg_atom = p->se.sum_exec_runtime;
 		if (nr_switches)
@@ -978,6 +982,13 @@ void proc_sched_show_task(struct task_struct *p, struct pid_namespace *ns,
 #endif
 	P(policy);
 	P(prio);
+	P(latency_nice);
+#ifdef CONFIG_UCLAMP_TASK
+	__PS("uclamp.min", p->uclamp_req[UCLAMP_MIN].value);
+	__PS("uclamp.max", p->uclamp_req[UCLAMP_MAX].value);
+	__PS("effective uclamp.min", uclamp_eff_value(p, UCLAMP_MIN));
+	__PS("effective uclamp.max", uclamp_eff_value(p, UCLAMP_MAX));
+#endif
 	if (p->policy == SCHED_DEADLINE) {
 		P(dl.runtime);
 		P(dl.deadline);
@@ -987,6 +998,7 @@ void proc_sched_show_task(struct task_struct *p, struct pid_namespace *ns,
 #undef __PN
 #undef P_SCHEDSTAT
 #undef P
+#undef __PS
 #undef __P
 
 	{
@@ -3637,6 +3637,21 @@ static inline unsigned long task_util_est(struct task_struct *p)
 	return max(task_util(p), _task_util_est(p));
 }
 
+#ifdef CONFIG_UCLAMP_TASK
+/* The utilization of @p within the boost and cap of its util clamps */
+static inline unsigned long uclamp_task_util(struct task_struct *p)
+{
+	return clamp_t(unsigned long, task_util(p),
+		       uclamp_eff_value(p, UCLAMP_MIN),
+		       uclamp_eff_value(p, UCLAMP_MAX));
+}
+#else
+static inline unsigned long uclamp_task_util(struct task_struct *p)
+{
+	return task_util(p);
+}
+#endif
+
 static inline void util_est_enqueue(struct cfs_rq *cfs_rq,
 				    struct task_struct *p)
 {
@@ -4251,23 +4266,28 @@ static inline u64 sched_cfs_bandwidth_slice(void)
 }
 
 /*
- * Replenish runtime according to assigned quota and update expiration time.
- * We use sched_clock_cpu directly instead of rq->clock to avoid adding
- * additional synchronization around rq->lock.
+ * Replenish runtime according to assigned quota.  Runtime left over from
+ * the last period is kept up to the burst, and the runtime used on top of
+ * the quota in the last period is accounted as a burst.
  *
  * requires cfs_b->lock
  */
 void __refill_cfs_bandwidth_runtime(struct cfs_bandwidth *cfs_b)
 {
-	u64 now;
+	s64 runtime;
 
 	if (cfs_b->quota == RUNTIME_INF)
 		return;
 
-	now = sched_clock_cpu(smp_processor_id());
-	cfs_b->runtime = cfs_b->quota;
-	cfs_b->runtime_expires = now + ktime_to_ns(cfs_b->period);
-	cfs_b->expires_seq++;
+	cfs_b->runtime += cfs_b->quota;
+	runtime = cfs_b->runtime_snap - cfs_b->runtime;
+	if (runtime > 0) {
+		cfs_b->burst_time += runtime;
+		cfs_b->nr_burst++;
+	}
+
+	cfs_b->runtime = min(cfs_b->runtime, cfs_b->quota + cfs_b->burst);
+	cfs_b->runtime_snap = cfs_b->runtime;
 }
 
 static inline struct cfs_bandwidth *tg_cfs_bandwidth(struct task_group *tg)
@@ -4284,13 +4304,17 @@ static inline u64 cfs_rq_clock_task(struct cfs_rq *cfs_rq)
 	return rq_clock_task(rq_of(cfs_rq)) - cfs_rq->throttled_clock_task_time;
 }
 
-/* returns 0 on failure to allocate runtime */
+/*
+ * Returns 0 on failure to allocate runtime.  The runtime a cfs_rq gets is
+ * its own until it is used or returned when the cfs_rq goes idle, it does
+ * not expire with the period: a cfs_rq which runs only now and then uses
+ * its slice across periods instead of coming back for a new one each time.
+ */
 static int assign_cfs_rq_runtime(struct cfs_rq *cfs_rq)
 {
 	struct task_group *tg = cfs_rq->tg;
 	struct cfs_bandwidth *cfs_b = tg_cfs_bandwidth(tg);
-	u64 amount = 0, min_amount, expires;
-	int expires_seq;
+	u64 amount = 0, min_amount;
 
 	/* note: this is a positive sum as runtime_remaining <= 0 */
 	min_amount = sched_cfs_bandwidth_slice() - cfs_rq->runtime_remaining;
@@ -4307,61 +4331,16 @@ static int assign_cfs_rq_runtime(struct cfs_rq *cfs_rq)
 			cfs_b->idle = 0;
 		}
 	}
-	expires_seq = cfs_b->expires_seq;
-	expires = cfs_b->runtime_expires;
 	raw_spin_unlock(&cfs_b->lock);
 
 	cfs_rq->runtime_remaining += amount;
-	/*
-	 * we may have advanced our local expiration to account for allowed
-	 * spread between our sched_clock and the one on which runtime was
-	 * issued.
-	 */
-	if (cfs_rq->expires_seq != expires_seq) {
-		cfs_rq->expires_seq = expires_seq;
-		cfs_rq->runtime_expires = expires;
-	}
 
 	return cfs_rq->runtime_remaining > 0;
 }
 
-/*
- * Note: This depends on the synchronization provided by sched_clock and the
- * fact that rq->clock snapshots this value.
- */
-static void expire_cfs_rq_runtime(struct cfs_rq *cfs_rq)
-{
-	struct cfs_bandwidth *cfs_b = tg_cfs_bandwidth(cfs_rq->tg);
-
-	/* if the deadline is ahead of our clock, nothing to do */
-	if (likely((s64)(rq_clock(rq_of(cfs_rq)) - cfs_rq->runtime_expires) < 0))
-		return;
-
-	if (cfs_rq->runtime_remaining < 0)
-		return;
-
-	/*
-	 * If the local deadline has passed we have to consider the
-	 * possibility that our sched_clock is 'fast' and the global deadline
-	 * has not truly expired.
-	 *
-	 * Fortunately we can check determine whether this the case by checking
-	 * whether the global deadline(cfs_b->expires_seq) has advanced.
-	 */
-	if (cfs_rq->expires_seq == cfs_b->expires_seq) {
-		/* extend local deadline, drift is bounded above by 2 ticks */
-		cfs_rq->runtime_expires += TICK_NSEC;
-	} else {
-		/* global deadline is ahead, expiration has passed */
-		cfs_rq->runtime_remaining = 0;
-	}
-}
-
 static void __account_cfs_rq_runtime(struct cfs_rq *cfs_rq, u64 delta_exec)
 {
-	/* dock delta_exec before expiring quota (as it could span periods) */
 	cfs_rq->runtime_remaining -= delta_exec;
-	expire_cfs_rq_runtime(cfs_rq);
 
 	if (likely(cfs_rq->runtime_remaining > 0))
 		return;
@@ -4544,8 +4523,7 @@ void unthrottle_cfs_rq(struct cfs_rq *cfs_rq)
 		resched_curr(rq);
 }
 
-static u64 distribute_cfs_runtime(struct cfs_bandwidth *cfs_b,
-		u64 remaining, u64 expires)
+static u64 distribute_cfs_runtime(struct cfs_bandwidth *cfs_b, u64 remaining)
 {
 	struct cfs_rq *cfs_rq;
 	u64 runtime;
@@ -4567,7 +4545,6 @@ static u64 distribute_cfs_runtime(struct cfs_bandwidth *cfs_b,
 		remaining -= runtime;
 
 		cfs_rq->runtime_remaining += runtime;
-		cfs_rq->runtime_expires = expires;
 
 		/* we check whether we're throttled above */
 		if (cfs_rq->runtime_remaining > 0)
@@ -4592,7 +4569,7 @@ next:
  */
 static int do_sched_cfs_period_timer(struct cfs_bandwidth *cfs_b, int overrun)
 {
-	u64 runtime, runtime_expires;
+	u64 runtime;
 	int throttled;
 
 	/* no need to continue the timer with no bandwidth constraint */
@@ -4620,8 +4597,6 @@ static int do_sched_cfs_period_timer(struct cfs_bandwidth *cfs_b, int overrun)
 	/* account preceding periods in which throttling occurred */
 	cfs_b->nr_throttled += overrun;
 
-	runtime_expires = cfs_b->runtime_expires;
-
 	/*
 	 * This check is repeated as we are holding onto the new bandwidth while
 	 * we unthrottle. This can potentially race with an unthrottled group
@@ -4634,8 +4609,7 @@ static int do_sched_cfs_period_timer(struct cfs_bandwidth *cfs_b, int overrun)
 		cfs_b->distribute_running = 1;
 		raw_spin_unlock(&cfs_b->lock);
 		/* we can't nest cfs_b->lock while distributing bandwidth */
-		runtime = distribute_cfs_runtime(cfs_b, runtime,
-						 runtime_expires);
+		runtime = distribute_cfs_runtime(cfs_b, runtime);
 		raw_spin_lock(&cfs_b->lock);
 
 		cfs_b->distribute_running = 0;
@@ -4712,8 +4686,7 @@ static void __return_cfs_rq_runtime(struct cfs_rq *cfs_rq)
 		return;
 
 	raw_spin_lock(&cfs_b->lock);
-	if (cfs_b->quota != RUNTIME_INF &&
-	    cfs_rq->runtime_expires == cfs_b->runtime_expires) {
+	if (cfs_b->quota != RUNTIME_INF) {
 		cfs_b->runtime += slack_runtime;
 
 		/* we are under rq->lock, defer unthrottling using a timer */
@@ -4745,7 +4718,6 @@ static __always_inline void return_cfs_rq_runtime(struct cfs_rq *cfs_rq)
 static void do_sched_cfs_slack_timer(struct cfs_bandwidth *cfs_b)
 {
 	u64 runtime = 0, slice = sched_cfs_bandwidth_slice();
-	u64 expires;
 
 	/* confirm we're still not at a refresh boundary */
 	raw_spin_lock(&cfs_b->lock);
@@ -4762,7 +4734,6 @@ static void do_sched_cfs_slack_timer(struct cfs_bandwidth *cfs_b)
 	if (cfs_b->quota != RUNTIME_INF && cfs_b->runtime > slice)
 		runtime = cfs_b->runtime;
 
-	expires = cfs_b->runtime_expires;
 	if (runtime)
 		cfs_b->distribute_running = 1;
 
@@ -4771,11 +4742,10 @@ static void do_sched_cfs_slack_timer(struct cfs_bandwidth *cfs_b)
 	if (!runtime)
 		return;
 
-	runtime = distribute_cfs_runtime(cfs_b, runtime, expires);
+	runtime = distribute_cfs_runtime(cfs_b, runtime);
 
 	raw_spin_lock(&cfs_b->lock);
-	if (expires == cfs_b->runtime_expires)
-		cfs_b->runtime -= min(runtime, cfs_b->runtime);
+	cfs_b->runtime -= min(runtime, cfs_b->runtime);
 	cfs_b->distribute_running = 0;
 	raw_spin_unlock(&cfs_b->lock);
 }
@@ -4921,17 +4891,13 @@ static void init_cfs_rq_runtime(struct cfs_rq *cfs_rq)
 
 void start_cfs_bandwidth(struct cfs_bandwidth *cfs_b)
 {
-	u64 overrun;
-
 	lockdep_assert_held(&cfs_b->lock);
 
 	if (cfs_b->period_active)
 		return;
 
 	cfs_b->period_active = 1;
-	overrun = hrtimer_forward_now(&cfs_b->period_timer, cfs_b->period);
-	cfs_b->runtime_expires += (overrun + 1) * ktime_to_ns(cfs_b->period);
-	cfs_b->expires_seq++;
+	hrtimer_forward_now(&cfs_b->period_timer, cfs_b->period);
 	hrtimer_start_expires(&cfs_b->period_timer, HRTIMER_MODE_ABS_PINNED);
 }
 
@@ -5569,6 +5535,17 @@ static void record_wakee(struct task_struct *p)
 		current->last_wakee = p;
 		current->wakee_flips++;
 	}
+
+	/* The same from the side of the wakee, we hold its ->pi_lock */
+	if (time_after(jiffies, p->waker_flip_decay_ts + HZ)) {
+		p->waker_flips >>= 1;
+		p->waker_flip_decay_ts = jiffies;
+	}
+
+	if (p->last_waker != current) {
+		p->last_waker = current;
+		p->waker_flips++;
+	}
 }
 
 /*
@@ -5609,6 +5586,15 @@ static int wake_wide(struct task_struct *p)
  * wake_affine_idle() - only considers 'now', it check if the waking CPU is
  *			cache-affine and is (or	will be) idle.
  *
+ * wake_affine_cluster() - considers who the tasks wake. A waker and a wakee
+ *			   that each flip between fewer partners than the
+ *			   cache domain has CPUs, like the threads of a
+ *			   pipeline passing data through pipes or futexes,
+ *			   share data: keep them in the cache domain (the
+ *			   cluster on arm64) of the waker while it has an
+ *			   idle CPU. Tasks of many partners are left to
+ *			   wake_wide() and spread.
+ *
  * wake_affine_weight() - considers the weight to reflect the average
  *			  scheduling latency of the CPUs. This seems to work
  *			  for the overloaded case.
@@ -5680,6 +5666,27 @@ wake_affine_weight(struct sched_domain *sd, struct task_struct *p,
 	return this_eff_load < prev_eff_load ? this_cpu : nr_cpumask_bits;
 }
 
+static int
+wake_affine_cluster(struct task_struct *p, int this_cpu, int prev_cpu)
+{
+	struct sched_domain_shared *sds;
+	int factor;
+
+	if (cpus_share_cache(this_cpu, prev_cpu))
+		return nr_cpumask_bits;
+
+	factor = this_cpu_read(sd_llc_size);
+	if (current->wakee_flips >= factor || p->waker_flips >= factor)
+		return nr_cpumask_bits;
+
+	sds = rcu_dereference(per_cpu(sd_llc_shared, this_cpu));
+	if (!sds || !cpumask_intersects(sds_idle_cpus(sds), &p->cpus_allowed))
+		return nr_cpumask_bits;
+
+	schedstat_inc(p->se.statistics.nr_wakeups_cluster);
+	return this_cpu;
+}
+
 static int wake_affine(struct sched_domain *sd, struct task_struct *p,
 		       int this_cpu, int prev_cpu, int sync)
 {
@@ -5688,6 +5695,9 @@ static int wake_affine(struct sched_domain *sd, struct task_struct *p,
 	if (sched_feat(WA_IDLE))
 		target = wake_affine_idle(this_cpu, prev_cpu, sync);
 
+	if (sched_feat(WA_CLUSTER) && target == nr_cpumask_bits)
+		target = wake_affine_cluster(p, this_cpu, prev_cpu);
+
 	if (sched_feat(WA_WEIGHT) && target == nr_cpumask_bits)
 		target = wake_affine_weight(sd, p, this_cpu, prev_cpu, sync);
 
@@ -5959,6 +5969,46 @@ static inline int find_idlest_cpu(struct sched_domain *sd, struct task_struct *p
 	return new_cpu;
 }
 
+/*
+ * Called by a CPU entering or leaving its idle task, to keep its bit in
+ * sd_llc_shared->idle_cpus up to date.
+ */
+void update_idle_cpus(struct rq *rq, bool idle)
+{
+	struct sched_domain_shared *sds;
+	int cpu = cpu_of(rq);
+
+	rcu_read_lock();
+	sds = rcu_dereference(per_cpu(sd_llc_shared, cpu));
+	/* Don't dirty the cache line the whole LLC reads for nothing */
+	if (sds && cpumask_test_cpu(cpu, sds_idle_cpus(sds)) != idle) {
+		if (idle)
+			cpumask_set_cpu(cpu, sds_idle_cpus(sds));
+		else
+			cpumask_clear_cpu(cpu, sds_idle_cpus(sds));
+	}
+	rcu_read_unlock();
+}
+
+/*
+ * The CPUs of @sd, the LLC domain of @target, worth checking for @p: the
+ * allowed ones and, with SIS_IDLE_MASK, only those last known to be idle.
+ */
+static inline void select_idle_candidates(struct cpumask *cpus,
+					  struct task_struct *p,
+					  struct sched_domain *sd, int target)
+{
+	struct sched_domain_shared *sds;
+
+	cpumask_and(cpus, sched_domain_span(sd), &p->cpus_allowed);
+	if (!sched_feat(SIS_IDLE_MASK))
+		return;
+
+	sds = rcu_dereference(per_cpu(sd_llc_shared, target));
+	if (sds)
+		cpumask_and(cpus, cpus, sds_idle_cpus(sds));
+}
+
 #ifdef CONFIG_SCHED_SMT
 DEFINE_STATIC_KEY_FALSE(sched_smt_present);
 EXPORT_SYMBOL_GPL(sched_smt_present);
@@ -6020,7 +6070,7 @@ unlock:
 static int select_idle_core(struct task_struct *p, struct sched_domain *sd, int target)
 {
 	struct cpumask *cpus = this_cpu_cpumask_var_ptr(select_idle_mask);
-	int core, cpu;
+	int core, cpu, nr_scanned = 0;
 
 	if (!static_branch_likely(&sched_smt_present))
 		return -1;
@@ -6028,20 +6078,24 @@ static int select_idle_core(struct task_struct *p, struct sched_domain *sd, int
 	if (!test_idle_cores(target, false))
 		return -1;
 
-	cpumask_and(cpus, sched_domain_span(sd), &p->cpus_allowed);
+	select_idle_candidates(cpus, p, sd, target);
 
 	for_each_cpu_wrap(core, cpus, target) {
 		bool idle = true;
 
 		for_each_cpu(cpu, cpu_smt_mask(core)) {
 			cpumask_clear_cpu(cpu, cpus);
+			nr_scanned++;
 			if (!available_idle_cpu(cpu))
 				idle = false;
 		}
 
-		if (idle)
+		if (idle) {
+			schedstat_add(this_rq()->sis_scanned, nr_scanned);
 			return core;
+		}
 	}
+	schedstat_add(this_rq()->sis_scanned, nr_scanned);
 
 	/*
 	 * Failed to find an idle core; stop looking for one.
@@ -6089,14 +6143,18 @@ static inline int select_idle_smt(struct task_struct *p, struct sched_domain *sd
  * Scan the LLC domain for idle CPUs; this is dynamically regulated by
  * comparing the average scan cost (tracked in sd->avg_scan_cost) against the
  * average idle time for this rq (as found in rq->avg_idle).
+ *
+ * With SIS_IDLE_MASK only the CPUs last known to be idle are scanned, the
+ * first one is usually a hit whatever the size of the domain.
  */
 static int select_idle_cpu(struct task_struct *p, struct sched_domain *sd, int target)
 {
+	struct cpumask *cpus = this_cpu_cpumask_var_ptr(select_idle_mask);
 	struct sched_domain *this_sd;
 	u64 avg_cost, avg_idle;
 	u64 time, cost;
 	s64 delta;
-	int cpu, nr = INT_MAX;
+	int cpu, nr = INT_MAX, nr_scanned = 0;
 
 	this_sd = rcu_dereference(*this_cpu_ptr(&sd_llc));
 	if (!this_sd)
@@ -6120,16 +6178,34 @@ static int select_idle_cpu(struct task_struct *p, struct sched_domain *sd, int t
 			nr = 4;
 	}
 
+	/*
+	 * A latency tolerant task does not need the first idle CPU around,
+	 * scan less of the domain for it, none at MAX_LATENCY_NICE.
+	 */
+	if (p->latency_nice > 0) {
+		int nr_lat = 1 + sd->span_weight *
+			     (MAX_LATENCY_NICE + 1 - p->latency_nice) /
+			     (LATENCY_NICE_WIDTH / 2);
+
+		nr = min(nr, nr_lat);
+	}
+
 	time = local_clock();
 
-	for_each_cpu_wrap(cpu, sched_domain_span(sd), target) {
-		if (!--nr)
-			return -1;
-		if (!cpumask_test_cpu(cpu, &p->cpus_allowed))
-			continue;
+	select_idle_candidates(cpus, p, sd, target);
+
+	for_each_cpu_wrap(cpu, cpus, target) {
+		if (!--nr) {
+			cpu = -1;
+			break;
+		}
+		nr_scanned++;
 		if (available_idle_cpu(cpu))
 			break;
 	}
+	schedstat_add(this_rq()->sis_scanned, nr_scanned);
+	if (cpu < 0)
+		return -1;
 
 	time = local_clock() - time;
 	cost = this_sd->avg_scan_cost;
@@ -6175,19 +6251,28 @@ static int select_idle_sibling(struct task_struct *p, int prev, int target)
 	if (!sd)
 		return target;
 
-	i = select_idle_core(p, sd, target);
-	if ((unsigned)i < nr_cpumask_bits)
-		return i;
+	schedstat_inc(this_rq()->sis_search);
+
+	/* A latency tolerant task is not worth searching a whole idle core */
+	if (p->latency_nice <= 0) {
+		i = select_idle_core(p, sd, target);
+		if ((unsigned)i < nr_cpumask_bits)
+			goto found;
+	}
 
 	i = select_idle_cpu(p, sd, target);
 	if ((unsigned)i < nr_cpumask_bits)
-		return i;
+		goto found;
 
 	i = select_idle_smt(p, sd, target);
 	if ((unsigned)i < nr_cpumask_bits)
-		return i;
+		goto found;
 
 	return target;
+
+found:
+	schedstat_inc(this_rq()->sis_found);
+	return i;
 }
 
 /**
@@ -6350,10 +6435,13 @@ static int wake_cap(struct task_struct *p, int cpu, int prev_cpu)
 	if (max_cap - min_cap < max_cap >> 3)
 		return 0;
 
-	/* Bring task utilization in sync with prev_cpu */
+	/*
+	 * Bring task utilization in sync with prev_cpu. A boosted task is
+	 * sent to a big CPU and a capped one may stay on a little CPU.
+	 */
 	sync_entity_load_avg(&p->se);
 
-	return min_cap * 1024 < task_util(p) * capacity_margin;
+	return min_cap * 1024 < uclamp_task_util(p) * capacity_margin;
 }
 
 /*
@@ -6513,6 +6601,25 @@ static unsigned long wakeup_gran(struct sched_entity *se)
 	return calc_delta_fair(gran, se);
 }
 
+/*
+ * The latency nice of the entities shifts 'se' with respect to 'curr': a
+ * more latency sensitive 'se' preempts from further behind, a more latency
+ * tolerant one needs to be further ahead. Converted to virtual time in the
+ * units of 'se', as wakeup_gran() does.
+ */
+static long wakeup_latency_gran(struct sched_entity *curr,
+				struct sched_entity *se)
+{
+	long offset = READ_ONCE(curr->latency_offset) -
+		      READ_ONCE(se->latency_offset);
+
+	if (likely(!offset))
+		return 0;
+	if (offset > 0)
+		return calc_delta_fair(offset, se);
+	return -(long)calc_delta_fair(-offset, se);
+}
+
 /*
  * Should 'se' preempt 'curr'.
  *
@@ -6532,6 +6639,8 @@ wakeup_preempt_entity(struct sched_entity *curr, struct sched_entity *se)
 {
 	s64 gran, vdiff = curr->vruntime - se->vruntime;
 
+	vdiff += wakeup_latency_gran(curr, se);
+
 	if (vdiff <= 0)
 		return -1;
 
@@ -10087,6 +10196,7 @@ void init_tg_cfs_entry(struct task_group *tg, struct cfs_rq *cfs_rq,
 	se->my_q = cfs_rq;
 	/* guarantee group entities always have weight */
 	update_load_set(&se->load, NICE_0_LOAD);
+	se->latency_offset = latency_nice_to_offset(tg->latency_nice);
 	se->parent = parent;
 }
 
@@ -10124,6 +10234,34 @@ int sched_group_set_shares(struct task_group *tg, unsigned long shares)
 		rq_unlock_irqrestore(rq, &rf);
 	}
 
+done:
+	mutex_unlock(&shares_mutex);
+	return 0;
+}
+
+int sched_group_set_latency(struct task_group *tg, int latency_nice)
+{
+	long offset;
+	int i;
+
+	/*
+	 * The root cgroup has no entity to bias.
+	 */
+	if (!tg->se[0])
+		return -EINVAL;
+
+	if (latency_nice < MIN_LATENCY_NICE || latency_nice > MAX_LATENCY_NICE)
+		return -EINVAL;
+
+	mutex_lock(&shares_mutex);
+	if (tg->latency_nice == latency_nice)
+		goto done;
+
+	tg->latency_nice = latency_nice;
+	offset = latency_nice_to_offset(latency_nice);
+	for_each_possible_cpu(i)
+		WRITE_ONCE(tg->se[i]->latency_offset, offset);
+
 done:
 	mutex_unlock(&shares_mutex);
 	return 0;
@@ -10200,6 +10338,10 @@ const struct sched_class fair_sched_class = {
 #ifdef CONFIG_FAIR_GROUP_SCHED
 	.task_change_group	= task_change_group_fair,
 #endif
+
+#ifdef CONFIG_UCLAMP_TASK
+	.uclamp_enabled		= 1,
+#endif
 };
 
 #ifdef CONFIG_SCHED_DEBUG
@@ -58,6 +58,12 @@ SCHED_FEAT(TTWU_QUEUE, true)
 SCHED_FEAT(SIS_AVG_CPU, false)
 SCHED_FEAT(SIS_PROP, true)
 
+/*
+ * Only scan the CPUs of the LLC domain that were idle last we heard, as
+ * tracked in sd_llc_shared->idle_cpus, rather than the whole domain.
+ */
+SCHED_FEAT(SIS_IDLE_MASK, true)
+
 /*
  * Issue a WARN when we do multiple update_rq_clock() calls
  * in a single rq->lock section. Default disabled because the
@@ -86,6 +92,12 @@ SCHED_FEAT(WA_IDLE, true)
 SCHED_FEAT(WA_WEIGHT, true)
 SCHED_FEAT(WA_BIAS, true)
 
+/*
+ * Pull the wakee of a small group of tasks waking each other into the
+ * cache domain (cluster) of the waker when that one has an idle CPU.
+ */
+SCHED_FEAT(WA_CLUSTER, true)
+
 /*
  * UtilEstimation. Use estimated CPU utilization.
  */
@@ -37,6 +37,7 @@
 #include <linux/ptrace.h>
 #include <linux/fs_struct.h>
 #include <linux/file.h>
+#include <linux/futex.h>
 #include <linux/mount.h>
 #include <linux/gfp.h>
 #include <linux/syscore_ops.h>
@@ -2476,6 +2477,34 @@ SYSCALL_DEFINE5(prctl, int, option, unsigned long, arg2, unsigned long, arg3,
 			return -EINVAL;
 		error = arch_prctl_spec_ctrl_set(me, arg2, arg3);
 		break;
+	case PR_FUTEX_HASH:
+		if (arg5)
+			return -EINVAL;
+		error = futex_hash_prctl(arg2, arg3, arg4);
+		break;
+	case PR_SET_LAZY_FORK:
+		if (arg3 || arg4 || arg5 ||
+		    (arg2 & ~(PR_LAZY_FORK_PTE | PR_LAZY_FORK_FILES)))
+			return -EINVAL;
+		if ((arg2 & PR_LAZY_FORK_PTE) &&
+		    !IS_ENABLED(CONFIG_FORK_SHARE_PTE))
+			return -EINVAL;
+		if (down_write_killable(&me->mm->mmap_sem))
+			return -EINTR;
+		assign_bit(MMF_FORK_SHARE_PTE, &me->mm->flags,
+			   arg2 & PR_LAZY_FORK_PTE);
+		assign_bit(MMF_FORK_LAZY_FILES, &me->mm->flags,
+			   arg2 & PR_LAZY_FORK_FILES);
+		up_write(&me->mm->mmap_sem);
+		break;
+	case PR_GET_LAZY_FORK:
+		if (arg2 || arg3 || arg4 || arg5)
+			return -EINVAL;
+		if (test_bit(MMF_FORK_SHARE_PTE, &me->mm->flags))
+			error |= PR_LAZY_FORK_PTE;
+		if (test_bit(MMF_FORK_LAZY_FILES, &me->mm->flags))
+			error |= PR_LAZY_FORK_FILES;
+		break;
 	default:
 		error = -EINVAL;
 		break;
@@ -15,6 +15,7 @@
 #include <linux/hardirq.h>
 #include <linux/kthread.h>	/* for self test */
 #include <linux/module.h>
+#include <linux/mm.h>
 #include <linux/percpu.h>
 #include <linux/mutex.h>
 #include <linux/delay.h>
@@ -25,8 +26,11 @@
 #include <linux/cpu.h>
 #include <linux/oom.h>
 
+#include <asm/cacheflush.h>
 #include <asm/local.h>
 
+#include <uapi/linux/trace_mmap.h>
+
 static void update_pages_handler(struct work_struct *work);
 
 /*
@@ -330,6 +334,7 @@ struct buffer_page {
 	unsigned	 read;		/* index for next read */
 	local_t		 entries;	/* entries on this page */
 	unsigned long	 real_end;	/* real end of data */
+	u32		 id;		/* sub-buffer id of a mapping */
 	struct buffer_data_page *page;	/* Actual data page */
 };
 
@@ -498,6 +503,11 @@ struct ring_buffer_per_cpu {
 	struct completion		update_done;
 
 	struct rb_irq_work		irq_work;
+
+	/* user space mappings, see ring_buffer_map() */
+	unsigned int			mapped;
+	struct trace_buffer_meta	*meta_page;
+	unsigned long			*subbuf_ids;	/* id to data page */
 };
 
 struct ring_buffer {
@@ -1724,6 +1734,15 @@ int ring_buffer_resize(struct ring_buffer *buffer, unsigned long size,
 	/* prevent another thread from changing buffer sizes */
 	mutex_lock(&buffer->mutex);
 
+	/* A mapped CPU buffer keeps its pages until it is unmapped */
+	for_each_buffer_cpu(buffer, cpu) {
+		if ((cpu_id == RING_BUFFER_ALL_CPUS || cpu == cpu_id) &&
+		    buffer->buffers[cpu]->mapped) {
+			err = -EBUSY;
+			goto out_err;
+		}
+	}
+
 	if (cpu_id == RING_BUFFER_ALL_CPUS) {
 		/* calculate the pages to update */
 		for_each_buffer_cpu(buffer, cpu) {
@@ -3851,6 +3870,10 @@ rb_buffer_peek(struct ring_buffer_per_cpu *cpu_buffer, u64 *ts,
 	if (RB_WARN_ON(cpu_buffer, ++nr_loops > 2))
 		return NULL;
 
+	/* The reader page of a mapped CPU buffer is user space's */
+	if (unlikely(cpu_buffer->mapped))
+		return NULL;
+
 	reader = rb_get_reader_page(cpu_buffer);
 	if (!reader)
 		return NULL;
@@ -4305,6 +4328,28 @@ unsigned long ring_buffer_size(struct ring_buffer *buffer, int cpu)
 }
 EXPORT_SYMBOL_GPL(ring_buffer_size);
 
+/*
+ * Publish the reader sub-buffer of a mapped CPU buffer, with its new
+ * events in [read, commit), and the counters of the CPU buffer.
+ */
+static void rb_update_meta_page(struct ring_buffer_per_cpu *cpu_buffer,
+				unsigned int read, unsigned int commit)
+{
+	struct trace_buffer_meta *meta = cpu_buffer->meta_page;
+
+	meta->reader.id = cpu_buffer->reader_page->id;
+	meta->reader.read = read;
+	meta->reader.commit = commit;
+
+	meta->entries = local_read(&cpu_buffer->entries);
+	meta->overrun = local_read(&cpu_buffer->overrun);
+	meta->commit_overrun = local_read(&cpu_buffer->commit_overrun);
+	meta->dropped_events = local_read(&cpu_buffer->dropped_events);
+	meta->read = cpu_buffer->read;
+
+	flush_dcache_page(virt_to_page(meta));
+}
+
 static void
 rb_reset_cpu(struct ring_buffer_per_cpu *cpu_buffer)
 {
@@ -4377,6 +4422,10 @@ void ring_buffer_reset_cpu(struct ring_buffer *buffer, int cpu)
 
 	arch_spin_unlock(&cpu_buffer->lock);
 
+	if (cpu_buffer->mapped)
+		rb_update_meta_page(cpu_buffer, cpu_buffer->reader_page->read,
+				    cpu_buffer->reader_page->read);
+
  out:
 	raw_spin_unlock_irqrestore(&cpu_buffer->reader_lock, flags);
 
@@ -4482,6 +4531,11 @@ int ring_buffer_swap_cpu(struct ring_buffer *buffer_a,
 	if (cpu_buffer_a->nr_pages != cpu_buffer_b->nr_pages)
 		goto out;
 
+	/* The mapping of a CPU buffer is for the buffer it was mapped from */
+	ret = -EBUSY;
+	if (READ_ONCE(cpu_buffer_a->mapped) || READ_ONCE(cpu_buffer_b->mapped))
+		goto out;
+
 	ret = -EAGAIN;
 
 	if (atomic_read(&buffer_a->record_disabled))
@@ -4649,6 +4703,7 @@ EXPORT_SYMBOL_GPL(ring_buffer_free_read_page);
  *
  * Returns:
  *  >=0 if data has been transferred, returns the offset of consumed data.
+ *  -EBUSY if the CPU buffer is mapped, see ring_buffer_map().
  *  <0 if no data has been transferred.
  */
 int ring_buffer_read_page(struct ring_buffer *buffer,
@@ -4686,6 +4741,11 @@ int ring_buffer_read_page(struct ring_buffer *buffer,
 
 	raw_spin_lock_irqsave(&cpu_buffer->reader_lock, flags);
 
+	if (cpu_buffer->mapped) {
+		ret = -EBUSY;
+		goto out_unlock;
+	}
+
 	reader = rb_get_reader_page(cpu_buffer);
 	if (!reader)
 		goto out_unlock;
@@ -4815,6 +4875,308 @@ int ring_buffer_read_page(struct ring_buffer *buffer,
 }
 EXPORT_SYMBOL_GPL(ring_buffer_read_page);
 
+/*
+ * The sub-buffers of a mapping are numbered from the reader page, 0, on
+ * around the ring.
+ */
+static void rb_setup_ids(struct ring_buffer_per_cpu *cpu_buffer,
+			 unsigned long *subbuf_ids)
+{
+	struct buffer_page *first, *bpage;
+	u32 id = 0;
+
+	cpu_buffer->reader_page->id = id;
+	subbuf_ids[id++] = (unsigned long)cpu_buffer->reader_page->page;
+
+	first = bpage = cpu_buffer->head_page;
+	do {
+		if (RB_WARN_ON(cpu_buffer, id > cpu_buffer->nr_pages))
+			break;
+		bpage->id = id;
+		subbuf_ids[id++] = (unsigned long)bpage->page;
+		rb_inc_page(cpu_buffer, &bpage);
+	} while (bpage != first);
+}
+
+/*
+ * The meta page is at offset 0 of a mapping, sub-buffer id at page 1 + id.
+ * The mapping may cover any part of that.
+ */
+static int rb_map_vma(struct ring_buffer_per_cpu *cpu_buffer,
+		      struct vm_area_struct *vma)
+{
+	unsigned long nr_pages = vma_pages(vma);
+	unsigned long pgoff = vma->vm_pgoff;
+	unsigned long addr = vma->vm_start;
+	struct page *page;
+	int err;
+
+	if (pgoff + nr_pages > cpu_buffer->nr_pages + 2)
+		return -EINVAL;
+
+	vma->vm_flags |= VM_DONTCOPY | VM_DONTEXPAND | VM_DONTDUMP;
+	vma->vm_flags &= ~VM_MAYWRITE;
+
+	for (; nr_pages; nr_pages--, pgoff++, addr += PAGE_SIZE) {
+		if (!pgoff)
+			page = virt_to_page(cpu_buffer->meta_page);
+		else
+			page = virt_to_page((void *)cpu_buffer->subbuf_ids[pgoff - 1]);
+
+		err = vm_insert_page(vma, addr, page);
+		if (err)
+			return err;
+	}
+
+	return 0;
+}
+
+/**
+ * ring_buffer_map - map a CPU buffer to user space
+ * @buffer: the ring buffer
+ * @cpu: the CPU buffer to map
+ * @vma: the read-only mapping, laid out as include/uapi/linux/trace_mmap.h
+ *
+ * The pages of a mapped CPU buffer stay where they are: it can not be
+ * resized or swapped with another buffer. The reader moves on with
+ * ring_buffer_map_get_reader() only: ring_buffer_peek(), ring_buffer_consume()
+ * and ring_buffer_read_page() would swap out the reader page user space
+ * parses, they find no events or fail with -EBUSY.
+ * Each mapping is released by ring_buffer_unmap().
+ *
+ * Returns 0 on success and < 0 on failure.
+ */
+int ring_buffer_map(struct ring_buffer *buffer, int cpu,
+		    struct vm_area_struct *vma)
+{
+	struct ring_buffer_per_cpu *cpu_buffer;
+	struct trace_buffer_meta *meta;
+	unsigned long *subbuf_ids;
+	unsigned long flags;
+	int err;
+
+	if (!cpumask_test_cpu(cpu, buffer->cpumask))
+		return -EINVAL;
+
+	if (vma->vm_flags & (VM_WRITE | VM_EXEC))
+		return -EPERM;
+
+	cpu_buffer = buffer->buffers[cpu];
+
+	mutex_lock(&buffer->mutex);
+
+	if (cpu_buffer->mapped) {
+		err = rb_map_vma(cpu_buffer, vma);
+		if (!err)
+			cpu_buffer->mapped++;
+		goto out;
+	}
+
+	err = -ENOMEM;
+	meta = (void *)get_zeroed_page(GFP_KERNEL);
+	if (!meta)
+		goto out;
+
+	subbuf_ids = kcalloc(cpu_buffer->nr_pages + 1, sizeof(*subbuf_ids),
+			     GFP_KERNEL);
+	if (!subbuf_ids) {
+		free_page((unsigned long)meta);
+		goto out;
+	}
+
+	meta->meta_page_size = PAGE_SIZE;
+	meta->meta_struct_len = sizeof(*meta);
+	meta->subbuf_size = PAGE_SIZE;
+	meta->nr_subbufs = cpu_buffer->nr_pages + 1;
+	meta->data_offset = BUF_PAGE_HDR_SIZE;
+
+	raw_spin_lock_irqsave(&cpu_buffer->reader_lock, flags);
+	rb_setup_ids(cpu_buffer, subbuf_ids);
+	cpu_buffer->meta_page = meta;
+	cpu_buffer->subbuf_ids = subbuf_ids;
+	cpu_buffer->mapped = 1;
+	rb_update_meta_page(cpu_buffer, cpu_buffer->reader_page->read,
+			    cpu_buffer->reader_page->read);
+	raw_spin_unlock_irqrestore(&cpu_buffer->reader_lock, flags);
+
+	err = rb_map_vma(cpu_buffer, vma);
+	if (err) {
+		raw_spin_lock_irqsave(&cpu_buffer->reader_lock, flags);
+		cpu_buffer->mapped = 0;
+		cpu_buffer->meta_page = NULL;
+		cpu_buffer->subbuf_ids = NULL;
+		raw_spin_unlock_irqrestore(&cpu_buffer->reader_lock, flags);
+
+		kfree(subbuf_ids);
+		free_page((unsigned long)meta);
+	}
+
+ out:
+	mutex_unlock(&buffer->mutex);
+	return err;
+}
+EXPORT_SYMBOL_GPL(ring_buffer_map);
+
+/**
+ * ring_buffer_map_dup - account a copy of a mapping of a CPU buffer
+ * @buffer: the ring buffer
+ * @cpu: the mapped CPU buffer
+ *
+ * For the vm_operations open of a mapping made by ring_buffer_map(),
+ * the copy is released by ring_buffer_unmap() as well.
+ */
+void ring_buffer_map_dup(struct ring_buffer *buffer, int cpu)
+{
+	struct ring_buffer_per_cpu *cpu_buffer = buffer->buffers[cpu];
+
+	mutex_lock(&buffer->mutex);
+	if (!WARN_ON(!cpu_buffer->mapped))
+		cpu_buffer->mapped++;
+	mutex_unlock(&buffer->mutex);
+}
+EXPORT_SYMBOL_GPL(ring_buffer_map_dup);
+
+/**
+ * ring_buffer_unmap - release a mapping of a CPU buffer
+ * @buffer: the ring buffer
+ * @cpu: the mapped CPU buffer
+ *
+ * The meta page is freed with the last mapping, the CPU buffer then
+ * behaves as before it was mapped.
+ *
+ * Returns 0 on success and -ENODEV if the CPU buffer is not mapped.
+ */
+int ring_buffer_unmap(struct ring_buffer *buffer, int cpu)
+{
+	struct ring_buffer_per_cpu *cpu_buffer;
+	struct trace_buffer_meta *meta;
+	unsigned long *subbuf_ids;
+	unsigned long flags;
+	int err = 0;
+
+	if (!cpumask_test_cpu(cpu, buffer->cpumask))
+		return -EINVAL;
+
+	cpu_buffer = buffer->buffers[cpu];
+
+	mutex_lock(&buffer->mutex);
+
+	if (!cpu_buffer->mapped) {
+		err = -ENODEV;
+		goto out;
+	}
+
+	if (cpu_buffer->mapped > 1) {
+		cpu_buffer->mapped--;
+		goto out;
+	}
+
+	raw_spin_lock_irqsave(&cpu_buffer->reader_lock, flags);
+	cpu_buffer->mapped = 0;
+	meta = cpu_buffer->meta_page;
+	subbuf_ids = cpu_buffer->subbuf_ids;
+	cpu_buffer->meta_page = NULL;
+	cpu_buffer->subbuf_ids = NULL;
+	raw_spin_unlock_irqrestore(&cpu_buffer->reader_lock, flags);
+
+	kfree(subbuf_ids);
+	free_page((unsigned long)meta);
+
+ out:
+	mutex_unlock(&buffer->mutex);
+	return err;
+}
+EXPORT_SYMBOL_GPL(ring_buffer_unmap);
+
+/**
+ * ring_buffer_map_get_reader - move the reader of a mapped CPU buffer on
+ * @buffer: the ring buffer
+ * @cpu: the mapped CPU buffer
+ *
+ * The events the meta page published last are consumed. If the reader
+ * sub-buffer has no more events, the oldest sub-buffer of the ring is
+ * swapped in as the new reader one, so user space reads the events where
+ * the writer put them. The writer can overwrite the previous reader
+ * sub-buffer once it is back in the ring. The new
+ * events, the events lost meanwhile and the counters are published in
+ * the meta page; no new events leave reader.read == reader.commit.
+ *
+ * The caller serializes the readers of the CPU buffer.
+ *
+ * Returns 0 on success and -ENODEV if the CPU buffer is not mapped.
+ */
+int ring_buffer_map_get_reader(struct ring_buffer *buffer, int cpu)
+{
+	struct ring_buffer_per_cpu *cpu_buffer;
+	unsigned long lost_events = 0;
+	struct buffer_page *reader;
+	unsigned int read, size;
+	unsigned long flags;
+
+	if (!cpumask_test_cpu(cpu, buffer->cpumask))
+		return -EINVAL;
+
+	cpu_buffer = buffer->buffers[cpu];
+
+	raw_spin_lock_irqsave(&cpu_buffer->reader_lock, flags);
+
+	if (!cpu_buffer->mapped) {
+		raw_spin_unlock_irqrestore(&cpu_buffer->reader_lock, flags);
+		return -ENODEV;
+	}
+
+	for (;;) {
+		reader = cpu_buffer->reader_page;
+		read = size = reader->read;
+
+		if (rb_per_cpu_empty(cpu_buffer))
+			break;
+
+		size = rb_page_size(reader);
+		if (read < size) {
+			/* They are user space's events now */
+			while (reader->read < size)
+				rb_advance_reader(cpu_buffer);
+			break;
+		}
+
+		if (RB_WARN_ON(cpu_buffer, !rb_get_reader_page(cpu_buffer))) {
+			size = read;
+			break;
+		}
+
+		lost_events += cpu_buffer->lost_events;
+		cpu_buffer->lost_events = 0;
+	}
+
+	cpu_buffer->meta_page->reader.lost_events = lost_events;
+	rb_update_meta_page(cpu_buffer, read, size);
+
+	/* Some archs do not keep the kernel and user views coherent */
+	flush_dcache_page(virt_to_page(reader->page));
+
+	raw_spin_unlock_irqrestore(&cpu_buffer->reader_lock, flags);
+
+	return 0;
+}
+EXPORT_SYMBOL_GPL(ring_buffer_map_get_reader);
+
+/**
+ * ring_buffer_is_mapped - tell if a CPU buffer is mapped to user space
+ * @buffer: the ring buffer
+ * @cpu: the CPU buffer
+ *
+ * For the consuming readers to refuse a mapped CPU buffer upfront.
+ */
+bool ring_buffer_is_mapped(struct ring_buffer *buffer, int cpu)
+{
+	if (!cpumask_test_cpu(cpu, buffer->cpumask))
+		return false;
+
+	return READ_ONCE(buffer->buffers[cpu]->mapped);
+}
+EXPORT_SYMBOL_GPL(ring_buffer_is_mapped);
+
 /*
  * We only allocate new buffers, never free them if the CPU goes down.
  * If we were to free the buffer, then the user would lose any trace that was in
@@ -44,6 +44,7 @@
 #include <linux/trace.h>
 #include <linux/sched/clock.h>
 #include <linux/sched/rt.h>
+#include <uapi/linux/trace_mmap.h>
 
 #include "trace.h"
 #include "trace_output.h"
@@ -922,6 +923,13 @@ void tracing_snapshot_instance(struct trace_array *tr)
 		return;
 	}
 
+	/* Nor when user space has the buffers mapped */
+	if (atomic_read(&tr->mapped)) {
+		internal_trace_puts("*** BUFFER MEMORY MAPPED ***\n");
+		internal_trace_puts("*** Can not use snapshot (sorry) ***\n");
+		return;
+	}
+
 	local_irq_save(flags);
 	update_max_tr(tr, current, smp_processor_id());
 	local_irq_restore(flags);
@@ -4685,7 +4693,8 @@ static const char readme_msg[] =
 	"\t            [:values=<field1[,field2,...]>]\n"
 	"\t            [:sort=<field1[,field2,...]>]\n"
 	"\t            [:size=#entries]\n"
-	"\t            [:pause][:continue][:clear]\n"
+	"\t            [:percentiles=<p1[,p2,...]>]\n"
+	"\t            [:pause][:continue][:clear][:percpu]\n"
 	"\t            [:name=histname1]\n"
 	"\t            [if <filter>]\n\n"
 	"\t    When a matching event is hit, an entry is added to a hash\n"
@@ -4717,7 +4726,15 @@ static const char readme_msg[] =
 	"\t            .execname   display a common_pid as a program name\n"
 	"\t            .syscall    display a syscall id as a syscall name\n"
 	"\t            .log2       display log2 value rather than raw number\n"
+	"\t            .buckets=N  display value in groups of N rather than raw number\n"
 	"\t            .usecs      display a common_timestamp in microseconds\n\n"
+	"\t    The 'percentiles' parameter prints, after the entries, the\n"
+	"\t    bucket of the first .log2 or .buckets key each of the given\n"
+	"\t    percentiles of the hits falls in, e.g. percentiles=50,90,99.9\n\n"
+	"\t    The 'percpu' parameter keeps a copy of the hash table per\n"
+	"\t    CPU, merged when the 'hist' file is read, so that CPUs do not\n"
+	"\t    contend on common entries.  It can't be used with variables\n"
+	"\t    or actions.\n\n"
 	"\t    The 'pause' parameter can be used to pause an existing hist\n"
 	"\t    trigger or to start a hist trigger but not log any events\n"
 	"\t    until told to do so.  'continue' can be used to start or\n"
@@ -5667,6 +5684,25 @@ tracing_poll_pipe(struct file *filp, poll_table *poll_table)
 	return trace_poll(iter, filp, poll_table);
 }
 
+/*
+ * Consuming readers would swap out the reader page of a CPU buffer that
+ * user space has mapped, from under it: refuse them, see ring_buffer_map().
+ */
+static bool trace_consume_busy(struct trace_iterator *iter)
+{
+	struct ring_buffer *buffer = iter->trace_buffer->buffer;
+	int cpu;
+
+	if (iter->cpu_file != RING_BUFFER_ALL_CPUS)
+		return ring_buffer_is_mapped(buffer, iter->cpu_file);
+
+	for_each_tracing_cpu(cpu) {
+		if (ring_buffer_is_mapped(buffer, cpu))
+			return true;
+	}
+	return false;
+}
+
 /* Must be called with iter->mutex held. */
 static int tracing_wait_pipe(struct file *filp)
 {
@@ -5728,6 +5764,10 @@ tracing_read_pipe(struct file *filp, char __user *ubuf,
 
 	trace_seq_init(&iter->seq);
 
+	sret = -EBUSY;
+	if (trace_consume_busy(iter))
+		goto out;
+
 	if (iter->trace->read) {
 		sret = iter->trace->read(iter, filp, ubuf, cnt, ppos);
 		if (sret)
@@ -5889,6 +5929,10 @@ static ssize_t tracing_splice_read_pipe(struct file *filp,
 
 	mutex_lock(&iter->mutex);
 
+	ret = -EBUSY;
+	if (trace_consume_busy(iter))
+		goto out_err;
+
 	if (iter->trace->splice_read) {
 		ret = iter->trace->splice_read(iter, filp,
 					       ppos, pipe, len, flags);
@@ -6464,6 +6508,11 @@ tracing_snapshot_write(struct file *filp, const char __user *ubuf, size_t cnt,
 			free_snapshot(tr);
 		break;
 	case 1:
+		/* A mapped buffer must stay the live one */
+		if (atomic_read(&tr->mapped)) {
+			ret = -EBUSY;
+			break;
+		}
 /* Only allow per-cpu swap if the ring buffer supports it */
 #ifndef CONFIG_RING_BUFFER_ALLOW_SWAP
 		if (iter->cpu_file != RING_BUFFER_ALL_CPUS) {
@@ -6721,6 +6770,9 @@ tracing_buffers_read(struct file *filp, char __user *ubuf,
 		return -EBUSY;
 #endif
 
+	if (trace_consume_busy(iter))
+		return -EBUSY;
+
 	if (!info->spare) {
 		info->spare = ring_buffer_alloc_read_page(iter->trace_buffer->buffer,
 							  iter->cpu_file);
@@ -6747,6 +6799,9 @@ tracing_buffers_read(struct file *filp, char __user *ubuf,
 	trace_access_unlock(iter->cpu_file);
 
 	if (ret < 0) {
+		/* Mapped since the check above */
+		if (ret == -EBUSY)
+			return ret;
 		if (trace_empty(iter)) {
 			if ((filp->f_flags & O_NONBLOCK))
 				return -EAGAIN;
@@ -6882,6 +6937,9 @@ tracing_buffers_splice_read(struct file *file, loff_t *ppos,
 		return -EBUSY;
 #endif
 
+	if (trace_consume_busy(iter))
+		return -EBUSY;
+
 	if (*ppos & (PAGE_SIZE - 1))
 		return -EINVAL;
 
@@ -6925,6 +6983,9 @@ tracing_buffers_splice_read(struct file *file, loff_t *ppos,
 			ring_buffer_free_read_page(ref->buffer, ref->cpu,
 						   ref->page);
 			kfree(ref);
+			/* Mapped since the check above */
+			if (r == -EBUSY)
+				ret = r;
 			break;
 		}
 
@@ -6966,12 +7027,101 @@ out:
 	return ret;
 }
 
+/* Move the reader of a mapped CPU buffer on, see linux/trace_mmap.h */
+static long tracing_buffers_ioctl(struct file *file, unsigned int cmd,
+				  unsigned long arg)
+{
+	struct ftrace_buffer_info *info = file->private_data;
+	struct trace_iterator *iter = &info->iter;
+	int ret;
+
+	if (cmd != TRACE_MMAP_IOCTL_GET_READER)
+		return -ENOTTY;
+
+	if (iter->cpu_file == RING_BUFFER_ALL_CPUS)
+		return -EINVAL;
+
+	if (!(file->f_flags & O_NONBLOCK) &&
+	    ring_buffer_empty_cpu(iter->trace_buffer->buffer, iter->cpu_file)) {
+		ret = wait_on_pipe(iter, false);
+		if (ret)
+			return ret;
+	}
+
+	trace_access_lock(iter->cpu_file);
+	ret = ring_buffer_map_get_reader(iter->trace_buffer->buffer,
+					 iter->cpu_file);
+	trace_access_unlock(iter->cpu_file);
+
+	return ret;
+}
+
+static void tracing_buffers_mmap_open(struct vm_area_struct *vma)
+{
+	struct ftrace_buffer_info *info = vma->vm_file->private_data;
+	struct trace_iterator *iter = &info->iter;
+
+	ring_buffer_map_dup(iter->trace_buffer->buffer, iter->cpu_file);
+	atomic_inc(&iter->tr->mapped);
+}
+
+static void tracing_buffers_mmap_close(struct vm_area_struct *vma)
+{
+	struct ftrace_buffer_info *info = vma->vm_file->private_data;
+	struct trace_iterator *iter = &info->iter;
+
+	WARN_ON(ring_buffer_unmap(iter->trace_buffer->buffer, iter->cpu_file));
+	atomic_dec(&iter->tr->mapped);
+}
+
+static int tracing_buffers_mmap_split(struct vm_area_struct *vma,
+				      unsigned long addr)
+{
+	/* Every mapping covers what it was created with */
+	return -EINVAL;
+}
+
+static const struct vm_operations_struct tracing_buffers_vmops = {
+	.open		= tracing_buffers_mmap_open,
+	.close		= tracing_buffers_mmap_close,
+	.split		= tracing_buffers_mmap_split,
+};
+
+static int tracing_buffers_mmap(struct file *file, struct vm_area_struct *vma)
+{
+	struct ftrace_buffer_info *info = file->private_data;
+	struct trace_iterator *iter = &info->iter;
+	int ret;
+
+	if (iter->cpu_file == RING_BUFFER_ALL_CPUS)
+		return -EINVAL;
+
+	/*
+	 * A latency tracer swaps the live buffer with the max one, the
+	 * tracer can not change while this file is open.
+	 */
+	if (iter->trace->use_max_tr)
+		return -EBUSY;
+
+	ret = ring_buffer_map(iter->trace_buffer->buffer, iter->cpu_file, vma);
+	if (ret)
+		return ret;
+
+	atomic_inc(&iter->tr->mapped);
+	vma->vm_ops = &tracing_buffers_vmops;
+
+	return 0;
+}
+
 static const struct file_operations tracing_buffers_fops = {
 	.open		= tracing_buffers_open,
 	.read		= tracing_buffers_read,
 	.poll		= tracing_buffers_poll,
 	.release	= tracing_buffers_release,
 	.splice_read	= tracing_buffers_splice_read,
+	.unlocked_ioctl	= tracing_buffers_ioctl,
+	.compat_ioctl	= tracing_buffers_ioctl,
+	.mmap		= tracing_buffers_mmap,
 	.llseek		= no_llseek,
 };
 
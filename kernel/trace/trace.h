@@ -244,6 +244,7 @@ struct trace_array {
 	struct trace_event_file __rcu *exit_syscall_files[NR_syscalls];
 #endif
 	int			stop_count;
+	atomic_t		mapped;		/* CPU buffers mapped to user space */
 	int			clock_id;
 	int			nr_topts;
 	bool			clear_trace;
@@ -6,12 +6,15 @@
  */
 
 #include <linux/module.h>
+#include <linux/ctype.h>
 #include <linux/kallsyms.h>
 #include <linux/mutex.h>
 #include <linux/slab.h>
+#include <linux/sort.h>
 #include <linux/stacktrace.h>
 #include <linux/rculist.h>
 #include <linux/tracefs.h>
+#include <linux/vmalloc.h>
 
 #include "tracing_map.h"
 #include "trace.h"
@@ -31,6 +34,7 @@ typedef u64 (*hist_field_fn_t) (struct hist_field *field,
 #define HIST_FIELD_OPERANDS_MAX	2
 #define HIST_FIELDS_MAX		(TRACING_MAP_FIELDS_MAX + TRACING_MAP_VARS_MAX)
 #define HIST_ACTIONS_MAX	8
+#define HIST_PERCENTILES_MAX	8
 
 enum field_op_id {
 	FIELD_OP_NONE,
@@ -63,6 +67,7 @@ struct hist_field {
 	unsigned int			var_idx;
 	unsigned int			var_ref_idx;
 	bool                            read_once;
+	unsigned long			buckets;
 };
 
 static u64 hist_field_none(struct hist_field *field,
@@ -125,6 +130,25 @@ static u64 hist_field_log2(struct hist_field *hist_field,
 	return (u64) ilog2(roundup_pow_of_two(val));
 }
 
+static u64 hist_field_bucket(struct hist_field *hist_field,
+			     struct tracing_map_elt *elt,
+			     struct ring_buffer_event *rbe,
+			     void *event)
+{
+	struct hist_field *operand = hist_field->operands[0];
+	unsigned long buckets = hist_field->buckets;
+
+	u64 val = operand->fn(operand, elt, rbe, event);
+
+	if (WARN_ON_ONCE(!buckets))
+		return val;
+
+	if (is_power_of_2(buckets))
+		return val & ~((u64)buckets - 1);
+
+	return div64_ul(val, buckets) * buckets;
+}
+
 static u64 hist_field_plus(struct hist_field *hist_field,
 			   struct tracing_map_elt *elt,
 			   struct ring_buffer_event *rbe,
@@ -220,6 +244,7 @@ enum hist_field_flags {
 	HIST_FIELD_FL_VAR_REF		= 1 << 14,
 	HIST_FIELD_FL_CPU		= 1 << 15,
 	HIST_FIELD_FL_ALIAS		= 1 << 16,
+	HIST_FIELD_FL_BUCKET		= 1 << 17,
 };
 
 struct var_defs {
@@ -238,7 +263,9 @@ struct hist_trigger_attrs {
 	bool		cont;
 	bool		clear;
 	bool		ts_in_usecs;
+	bool		percpu;
 	unsigned int	map_bits;
+	char		*percentiles_str;
 
 	char		*assignment_str[TRACING_MAP_VARS_MAX];
 	unsigned int	n_assignments;
@@ -290,6 +317,10 @@ struct hist_trigger_data {
 	struct field_var		*max_vars[SYNTH_FIELDS_MAX];
 	unsigned int			n_max_vars;
 	unsigned int			n_max_var_str;
+
+	unsigned int			percentiles[HIST_PERCENTILES_MAX];
+	unsigned int			n_percentiles;
+	unsigned int			percentile_key;
 };
 
 struct synth_field {
@@ -1695,6 +1726,7 @@ static const char *hist_field_name(struct hist_field *field,
 	if (field->field)
 		field_name = field->field->name;
 	else if (field->flags & HIST_FIELD_FL_LOG2 ||
+		 field->flags & HIST_FIELD_FL_BUCKET ||
 		 field->flags & HIST_FIELD_FL_ALIAS)
 		field_name = hist_field_name(field->operands[0], ++level);
 	else if (field->flags & HIST_FIELD_FL_CPU)
@@ -1798,6 +1830,7 @@ static void destroy_hist_trigger_attrs(struct hist_trigger_attrs *attrs)
 	kfree(attrs->keys_str);
 	kfree(attrs->vals_str);
 	kfree(attrs->clock);
+	kfree(attrs->percentiles_str);
 	kfree(attrs);
 }
 
@@ -1874,6 +1907,12 @@ static int parse_assignment(char *str, struct hist_trigger_attrs *attrs)
 			goto out;
 		}
 		attrs->map_bits = map_bits;
+	} else if (strncmp(str, "percentiles=", strlen("percentiles=")) == 0) {
+		attrs->percentiles_str = kstrdup(str, GFP_KERNEL);
+		if (!attrs->percentiles_str) {
+			ret = -ENOMEM;
+			goto out;
+		}
 	} else {
 		char *assignment;
 
@@ -1918,6 +1957,8 @@ static struct hist_trigger_attrs *parse_hist_trigger_attrs(char *trigger_str)
 			attrs->cont = true;
 		else if (strcmp(str, "clear") == 0)
 			attrs->clear = true;
+		else if (strcmp(str, "percpu") == 0)
+			attrs->percpu = true;
 		else {
 			ret = parse_action(str, attrs);
 			if (ret)
@@ -2028,10 +2069,21 @@ static void hist_trigger_elt_data_init(struct tracing_map_elt *elt)
 		save_comm(elt_data->comm, current);
 }
 
+static void hist_trigger_elt_data_copy(struct tracing_map_elt *to,
+				       struct tracing_map_elt *from)
+{
+	struct hist_elt_data *to_data = to->private_data;
+	struct hist_elt_data *from_data = from->private_data;
+
+	if (to_data->comm)
+		memcpy(to_data->comm, from_data->comm, TASK_COMM_LEN);
+}
+
 static const struct tracing_map_ops hist_trigger_elt_data_ops = {
 	.elt_alloc	= hist_trigger_elt_data_alloc,
 	.elt_free	= hist_trigger_elt_data_free,
 	.elt_init	= hist_trigger_elt_data_init,
+	.elt_copy	= hist_trigger_elt_data_copy,
 };
 
 static const char *get_hist_field_flags(struct hist_field *hist_field)
@@ -2050,6 +2102,8 @@ static const char *get_hist_field_flags(struct hist_field *hist_field)
 		flags_str = "syscall";
 	else if (hist_field->flags & HIST_FIELD_FL_LOG2)
 		flags_str = "log2";
+	else if (hist_field->flags & HIST_FIELD_FL_BUCKET)
+		flags_str = "buckets";
 	else if (hist_field->flags & HIST_FIELD_FL_TIMESTAMP_USECS)
 		flags_str = "usecs";
 
@@ -2210,9 +2264,12 @@ static struct hist_field *create_hist_field(struct hist_trigger_data *hist_data,
 		goto out;
 	}
 
-	if (flags & HIST_FIELD_FL_LOG2) {
-		unsigned long fl = flags & ~HIST_FIELD_FL_LOG2;
-		hist_field->fn = hist_field_log2;
+	if (flags & (HIST_FIELD_FL_LOG2 | HIST_FIELD_FL_BUCKET)) {
+		unsigned long fl;
+
+		fl = flags & ~(HIST_FIELD_FL_LOG2 | HIST_FIELD_FL_BUCKET);
+		hist_field->fn = flags & HIST_FIELD_FL_LOG2 ? hist_field_log2 :
+			hist_field_bucket;
 		hist_field->operands[0] = create_hist_field(hist_data, field, fl, NULL);
 		hist_field->size = hist_field->operands[0]->size;
 		hist_field->type = kstrdup(hist_field->operands[0]->type, GFP_KERNEL);
@@ -2450,7 +2507,7 @@ static struct hist_field *parse_var_ref(struct hist_trigger_data *hist_data,
 
 static struct ftrace_event_field *
 parse_field(struct hist_trigger_data *hist_data, struct trace_event_file *file,
-	    char *field_str, unsigned long *flags)
+	    char *field_str, unsigned long *flags, unsigned long *buckets)
 {
 	struct ftrace_event_field *field = NULL;
 	char *field_name, *modifier, *str;
@@ -2474,7 +2531,15 @@ parse_field(struct hist_trigger_data *hist_data, struct trace_event_file *file,
 			*flags |= HIST_FIELD_FL_SYSCALL;
 		else if (strcmp(modifier, "log2") == 0)
 			*flags |= HIST_FIELD_FL_LOG2;
-		else if (strcmp(modifier, "usecs") == 0)
+		else if (strncmp(modifier, "buckets=", strlen("buckets=")) == 0) {
+			modifier += strlen("buckets=");
+			if (kstrtoul(modifier, 0, buckets) || !*buckets) {
+				hist_err("Invalid number of buckets: ", modifier);
+				field = ERR_PTR(-EINVAL);
+				goto out;
+			}
+			*flags |= HIST_FIELD_FL_BUCKET;
+		} else if (strcmp(modifier, "usecs") == 0)
 			*flags |= HIST_FIELD_FL_TIMESTAMP_USECS;
 		else {
 			hist_err("Invalid field modifier: ", modifier);
@@ -2533,6 +2598,7 @@ static struct hist_field *parse_atom(struct hist_trigger_data *hist_data,
 	char *s, *ref_system = NULL, *ref_event = NULL, *ref_var = str;
 	struct ftrace_event_field *field = NULL;
 	struct hist_field *hist_field = NULL;
+	unsigned long buckets = 0;
 	int ret = 0;
 
 	s = strchr(str, '.');
@@ -2571,7 +2637,7 @@ static struct hist_field *parse_atom(struct hist_trigger_data *hist_data,
 	} else
 		str = s;
 
-	field = parse_field(hist_data, file, str, flags);
+	field = parse_field(hist_data, file, str, flags, &buckets);
 	if (IS_ERR(field)) {
 		ret = PTR_ERR(field);
 		goto out;
@@ -2582,6 +2648,7 @@ static struct hist_field *parse_atom(struct hist_trigger_data *hist_data,
 		ret = -ENOMEM;
 		goto out;
 	}
+	hist_field->buckets = buckets;
 
 	return hist_field;
  out:
@@ -4245,6 +4312,79 @@ static int create_sort_keys(struct hist_trigger_data *hist_data)
 	return ret;
 }
 
+/* A percentile in tenths of a percent, "99.9" is 999 */
+static int parse_percentile(char *str, unsigned int *percentile)
+{
+	unsigned int whole, tenths = 0;
+	char *frac = str;
+
+	strsep(&frac, ".");
+	if (kstrtouint(str, 10, &whole))
+		return -EINVAL;
+
+	if (frac) {
+		if (strlen(frac) != 1 || !isdigit(frac[0]))
+			return -EINVAL;
+		tenths = frac[0] - '0';
+	}
+
+	if (whole > 100 || (whole == 100 && tenths))
+		return -EINVAL;
+
+	*percentile = whole * 10 + tenths;
+
+	return 0;
+}
+
+static int create_percentiles(struct hist_trigger_data *hist_data)
+{
+	char *fields_str = hist_data->attrs->percentiles_str;
+	unsigned int *percentiles = hist_data->percentiles;
+	struct hist_field *key_field;
+	char *str;
+	unsigned int i;
+	int ret;
+
+	if (!fields_str)
+		return 0;
+
+	/* The distribution is that of the first bucketed key */
+	for_each_hist_key_field(i, hist_data) {
+		key_field = hist_data->fields[i];
+		if (key_field->flags & (HIST_FIELD_FL_LOG2 |
+					HIST_FIELD_FL_BUCKET)) {
+			hist_data->percentile_key = i;
+			break;
+		}
+	}
+	if (!hist_data->percentile_key) {
+		hist_err("Percentiles need a .log2 or .buckets key", NULL);
+		return -EINVAL;
+	}
+
+	strsep(&fields_str, "=");
+	if (!fields_str || !*fields_str)
+		return -EINVAL;
+
+	while (fields_str) {
+		str = strsep(&fields_str, ",");
+
+		if (hist_data->n_percentiles == HIST_PERCENTILES_MAX) {
+			hist_err("Too many percentiles: ", str);
+			return -EINVAL;
+		}
+
+		ret = parse_percentile(str, &percentiles[hist_data->n_percentiles]);
+		if (ret) {
+			hist_err("Invalid percentile: ", str);
+			return ret;
+		}
+		hist_data->n_percentiles++;
+	}
+
+	return 0;
+}
+
 static void destroy_actions(struct hist_trigger_data *hist_data)
 {
 	unsigned int i;
@@ -4541,6 +4681,20 @@ create_hist_data(unsigned int map_bits,
 	if (ret)
 		goto free;
 
+	ret = create_percentiles(hist_data);
+	if (ret)
+		goto free;
+
+	/*
+	 * A per-CPU map can't be looked up from another event, so there
+	 * is nothing to keep variables or run actions on.
+	 */
+	if (attrs->percpu && (hist_data->n_vars || hist_data->n_actions)) {
+		hist_err("Per-CPU hist triggers can't have variables or actions", NULL);
+		ret = -EINVAL;
+		goto free;
+	}
+
 	map_ops = &hist_trigger_elt_data_ops;
 
 	hist_data->map = tracing_map_create(map_bits, hist_data->key_size,
@@ -4551,6 +4705,9 @@ create_hist_data(unsigned int map_bits,
 		goto free;
 	}
 
+	if (attrs->percpu)
+		tracing_map_set_percpu(hist_data->map);
+
 	ret = create_tracing_map_fields(hist_data);
 	if (ret)
 		goto free;
@@ -4719,6 +4876,16 @@ static void hist_trigger_stacktrace_print(struct seq_file *m,
 	}
 }
 
+static void hist_trigger_bucket_print(struct seq_file *m,
+				      struct hist_field *key_field, u64 uval)
+{
+	if (key_field->flags & HIST_FIELD_FL_LOG2)
+		seq_printf(m, "~ 2^%-2llu", uval);
+	else
+		seq_printf(m, "~ %llu-%llu", uval,
+			   uval + key_field->buckets - 1);
+}
+
 static void
 hist_trigger_entry_print(struct seq_file *m,
 			 struct hist_trigger_data *hist_data, void *key,
@@ -4782,9 +4949,11 @@ hist_trigger_entry_print(struct seq_file *m,
 						      key + key_field->offset,
 						      HIST_STACKTRACE_DEPTH);
 			multiline = true;
-		} else if (key_field->flags & HIST_FIELD_FL_LOG2) {
-			seq_printf(m, "%s: ~ 2^%-2llu", field_name,
-				   *(u64 *)(key + key_field->offset));
+		} else if (key_field->flags & (HIST_FIELD_FL_LOG2 |
+					       HIST_FIELD_FL_BUCKET)) {
+			uval = *(u64 *)(key + key_field->offset);
+			seq_printf(m, "%s: ", field_name);
+			hist_trigger_bucket_print(m, key_field, uval);
 		} else if (key_field->flags & HIST_FIELD_FL_STRING) {
 			seq_printf(m, "%s: %-50s", field_name,
 				   (char *)(key + key_field->offset));
@@ -4823,6 +4992,78 @@ hist_trigger_entry_print(struct seq_file *m,
 	seq_puts(m, "\n");
 }
 
+struct hist_bucket {
+	u64	val;
+	u64	hits;
+};
+
+static int cmp_hist_bucket(const void *a, const void *b)
+{
+	const struct hist_bucket *bucket_a = a, *bucket_b = b;
+
+	if (bucket_a->val < bucket_b->val)
+		return -1;
+
+	return bucket_a->val > bucket_b->val;
+}
+
+/*
+ * Print the bucket each requested percentile of the hits falls in,
+ * walking the buckets of the percentile key in ascending order.  With
+ * more than one key, the hits of the entries sharing a bucket add up.
+ */
+static void print_percentiles(struct seq_file *m,
+			      struct hist_trigger_data *hist_data,
+			      struct tracing_map_sort_entry **sort_entries,
+			      unsigned int n_entries)
+{
+	struct hist_field *key_field;
+	struct hist_bucket *buckets;
+	u64 total = 0, sum, target;
+	unsigned int i, j, p;
+
+	if (!hist_data->n_percentiles || !n_entries)
+		return;
+
+	key_field = hist_data->fields[hist_data->percentile_key];
+
+	buckets = vmalloc(array_size(n_entries, sizeof(*buckets)));
+	if (!buckets)
+		return;
+
+	for (i = 0; i < n_entries; i++) {
+		buckets[i].val = *(u64 *)(sort_entries[i]->key +
+					  key_field->offset);
+		buckets[i].hits = tracing_map_read_sum(sort_entries[i]->elt,
+						       HITCOUNT_IDX);
+		total += buckets[i].hits;
+	}
+
+	sort(buckets, n_entries, sizeof(*buckets), cmp_hist_bucket, NULL);
+
+	seq_printf(m, "\nPercentiles of %s:\n", hist_field_name(key_field, 0));
+
+	for (i = 0; i < hist_data->n_percentiles; i++) {
+		p = hist_data->percentiles[i];
+		target = max_t(u64, DIV_ROUND_UP_ULL(total * p, 1000), 1);
+
+		for (j = 0, sum = 0; j < n_entries - 1; j++) {
+			sum += buckets[j].hits;
+			if (sum >= target)
+				break;
+		}
+
+		seq_printf(m, "    p%u", p / 10);
+		if (p % 10)
+			seq_printf(m, ".%u", p % 10);
+		seq_puts(m, ": ");
+		hist_trigger_bucket_print(m, key_field, buckets[j].val);
+		seq_puts(m, "\n");
+	}
+
+	vfree(buckets);
+}
+
 static int print_entries(struct seq_file *m,
 			 struct hist_trigger_data *hist_data)
 {
@@ -4841,6 +5082,8 @@ static int print_entries(struct seq_file *m,
 					 sort_entries[i]->key,
 					 sort_entries[i]->elt);
 
+	print_percentiles(m, hist_data, sort_entries, n_entries);
+
 	tracing_map_destroy_sort_entries(sort_entries, n_entries);
 
 	return n_entries;
@@ -4865,8 +5108,8 @@ static void hist_trigger_show(struct seq_file *m,
 		n_entries = 0;
 
 	seq_printf(m, "\nTotals:\n    Hits: %llu\n    Entries: %u\n    Dropped: %llu\n",
-		   (u64)atomic64_read(&hist_data->map->hits),
-		   n_entries, (u64)atomic64_read(&hist_data->map->drops));
+		   tracing_map_read_hits(hist_data->map),
+		   n_entries, tracing_map_read_drops(hist_data->map));
 }
 
 static int hist_show(struct seq_file *m, void *v)
@@ -4935,6 +5178,8 @@ static void hist_field_print(struct seq_file *m, struct hist_field *hist_field)
 
 			if (flags)
 				seq_printf(m, ".%s", flags);
+			if (hist_field->flags & HIST_FIELD_FL_BUCKET)
+				seq_printf(m, "=%lu", hist_field->buckets);
 		}
 	}
 }
@@ -5033,6 +5278,18 @@ static int event_hist_trigger_print(struct seq_file *m,
 	if (hist_data->enable_timestamps)
 		seq_printf(m, ":clock=%s", hist_data->attrs->clock);
 
+	for (i = 0; i < hist_data->n_percentiles; i++) {
+		unsigned int p = hist_data->percentiles[i];
+
+		seq_puts(m, i ? "," : ":percentiles=");
+		seq_printf(m, "%u", p / 10);
+		if (p % 10)
+			seq_printf(m, ".%u", p % 10);
+	}
+
+	if (hist_data->attrs->percpu)
+		seq_puts(m, ":percpu");
+
 	print_actions_spec(m, hist_data);
 
 	if (data->filter_str)
@@ -5205,6 +5462,9 @@ static bool hist_trigger_match(struct event_trigger_data *data,
 	    hist_data->n_sort_keys != hist_data_test->n_sort_keys)
 		return false;
 
+	if (hist_data->attrs->percpu != hist_data_test->attrs->percpu)
+		return false;
+
 	if (!ignore_filter) {
 		if ((data->filter_str && !data_test->filter_str) ||
 		   (!data->filter_str && data_test->filter_str))
@@ -5225,6 +5485,8 @@ static bool hist_trigger_match(struct event_trigger_data *data,
 			return false;
 		if (key_field->is_signed != key_field_test->is_signed)
 			return false;
+		if (key_field->buckets != key_field_test->buckets)
+			return false;
 		if (!!key_field->var.name != !!key_field_test->var.name)
 			return false;
 		if (key_field->var.name &&
@@ -622,6 +622,9 @@ __tracing_map_insert(struct tracing_map *map, void *key, bool lookup_only)
  * run out of entries.  Readers can at any point in time traverse the
  * tracing map and safely access the key/val pairs.
  *
+ * On a per-CPU map, the key is inserted into the shard of the current
+ * CPU, which the caller must not be migrated away from.
+ *
  * Return: the tracing_map_elt pointer val associated with the key.
  * If this was a newly inserted key, the val will be a newly allocated
  * and associated tracing_map_elt pointer val.  If the key wasn't
@@ -630,6 +633,9 @@ __tracing_map_insert(struct tracing_map *map, void *key, bool lookup_only)
  */
 struct tracing_map_elt *tracing_map_insert(struct tracing_map *map, void *key)
 {
+	if (map->shards)
+		map = map->shards[smp_processor_id()];
+
 	return __tracing_map_insert(map, key, false);
 }
 
@@ -645,13 +651,17 @@ struct tracing_map_elt *tracing_map_insert(struct tracing_map *map, void *key)
  * incrememented.  There is one user-visible tracing_map variable,
  * 'hits', which is updated by this function.  Every time an element
  * is successfully retrieved, the 'hits' value is incrememented.  The
- * 'drops' value is never updated by this function.
+ * 'drops' value is never updated by this function.  On a per-CPU map,
+ * only the shard of the current CPU is looked up.
  *
  * Return: the tracing_map_elt pointer val associated with the key.
  * If the key wasn't found, NULL is returned.
  */
 struct tracing_map_elt *tracing_map_lookup(struct tracing_map *map, void *key)
 {
+	if (map->shards)
+		map = map->shards[smp_processor_id()];
+
 	return __tracing_map_insert(map, key, true);
 }
 
@@ -667,38 +677,99 @@ struct tracing_map_elt *tracing_map_lookup(struct tracing_map *map, void *key)
  */
 void tracing_map_destroy(struct tracing_map *map)
 {
+	int cpu;
+
 	if (!map)
 		return;
 
+	if (map->shards) {
+		for_each_possible_cpu(cpu)
+			tracing_map_destroy(map->shards[cpu]);
+		kfree(map->shards);
+	}
+
 	tracing_map_free_elts(map);
 
 	tracing_map_array_free(map->map);
 	kfree(map);
 }
 
+static void __tracing_map_clear(struct tracing_map *map)
+{
+	unsigned int i;
+
+	atomic_set(&map->next_elt, -1);
+	atomic64_set(&map->hits, 0);
+	atomic64_set(&map->drops, 0);
+
+	tracing_map_array_clear(map->map);
+
+	for (i = 0; i < map->max_elts; i++)
+		tracing_map_elt_clear(*(TRACING_MAP_ELT(map->elts, i)));
+}
+
 /**
  * tracing_map_clear - Clear a tracing_map
  * @map: The tracing_map to clear
  *
  * Resets the tracing map to a cleared or initial state.  The
  * tracing_map_elts are all cleared, and the array of struct
- * tracing_map_entry is reset to an initialized state.
+ * tracing_map_entry is reset to an initialized state.  The per-CPU
+ * shards of the map, if any, are cleared as well.
  *
  * Callers should make sure there are no writers actively inserting
  * into the map before calling this.
  */
 void tracing_map_clear(struct tracing_map *map)
 {
-	unsigned int i;
+	int cpu;
 
-	atomic_set(&map->next_elt, -1);
-	atomic64_set(&map->hits, 0);
-	atomic64_set(&map->drops, 0);
+	__tracing_map_clear(map);
 
-	tracing_map_array_clear(map->map);
+	if (map->shards)
+		for_each_possible_cpu(cpu)
+			__tracing_map_clear(map->shards[cpu]);
+}
 
-	for (i = 0; i < map->max_elts; i++)
-		tracing_map_elt_clear(*(TRACING_MAP_ELT(map->elts, i)));
+/**
+ * tracing_map_read_hits - Return the 'hits' count of a tracing_map
+ * @map: The tracing_map
+ *
+ * Return: the number of successful insertions and lookups into the
+ * map, summed over the shards of a per-CPU map.
+ */
+u64 tracing_map_read_hits(struct tracing_map *map)
+{
+	u64 hits = 0;
+	int cpu;
+
+	if (!map->shards)
+		return atomic64_read(&map->hits);
+
+	for_each_possible_cpu(cpu)
+		hits += atomic64_read(&map->shards[cpu]->hits);
+
+	return hits;
+}
+
+/**
+ * tracing_map_read_drops - Return the 'drops' count of a tracing_map
+ * @map: The tracing_map
+ *
+ * Return: the number of failed insertions into the map.  For a
+ * per-CPU map, the drops of all the shards plus the elements the last
+ * tracing_map_sort_entries() could not merge into the map.
+ */
+u64 tracing_map_read_drops(struct tracing_map *map)
+{
+	u64 drops = atomic64_read(&map->drops);
+	int cpu;
+
+	if (map->shards)
+		for_each_possible_cpu(cpu)
+			drops += atomic64_read(&map->shards[cpu]->drops);
+
+	return drops;
 }
 
 static void set_sort_key(struct tracing_map *map,
@@ -799,6 +870,53 @@ struct tracing_map *tracing_map_create(unsigned int map_bits,
 	goto out;
 }
 
+/**
+ * tracing_map_set_percpu - Make a tracing_map per-CPU
+ * @map: The tracing_map, not yet initialized
+ *
+ * Has tracing_map_init() give the map a shard for each possible CPU,
+ * which tracing_map_insert() and tracing_map_lookup() use instead of
+ * the map itself.  The shards are merged into the map by
+ * tracing_map_sort_entries().  This multiplies the memory of the map
+ * by the number of possible CPUs plus one, and lookups only see the
+ * elements inserted on the same CPU, so it is meant for maps that only
+ * aggregate sums.
+ */
+void tracing_map_set_percpu(struct tracing_map *map)
+{
+	map->percpu = true;
+}
+
+static int tracing_map_alloc_shards(struct tracing_map *map)
+{
+	struct tracing_map *shard;
+	int cpu, err;
+
+	map->shards = kcalloc(nr_cpu_ids, sizeof(*map->shards), GFP_KERNEL);
+	if (!map->shards)
+		return -ENOMEM;
+
+	for_each_possible_cpu(cpu) {
+		shard = tracing_map_create(map->map_bits, map->key_size,
+					   map->ops, map->private_data);
+		if (IS_ERR(shard))
+			return PTR_ERR(shard);
+		map->shards[cpu] = shard;
+
+		memcpy(shard->fields, map->fields, sizeof(map->fields));
+		shard->n_fields = map->n_fields;
+		memcpy(shard->key_idx, map->key_idx, sizeof(map->key_idx));
+		shard->n_keys = map->n_keys;
+		shard->n_vars = map->n_vars;
+
+		err = tracing_map_init(shard);
+		if (err)
+			return err;
+	}
+
+	return 0;
+}
+
 /**
  * tracing_map_init - Allocate and clear a map's tracing_map_elts
  * @map: The tracing_map to initialize
@@ -829,6 +947,12 @@ int tracing_map_init(struct tracing_map *map)
 	if (err)
 		return err;
 
+	if (map->percpu) {
+		err = tracing_map_alloc_shards(map);
+		if (err)
+			return err;
+	}
+
 	tracing_map_clear(map);
 
 	return err;
@@ -1032,6 +1156,53 @@ static void sort_secondary(struct tracing_map *map,
 	}
 }
 
+static void merge_elt(struct tracing_map *map, struct tracing_map_elt *from)
+{
+	struct tracing_map_elt *elt;
+	unsigned int i;
+
+	elt = __tracing_map_insert(map, from->key, false);
+	if (!elt)
+		return;
+
+	for (i = 0; i < map->n_fields; i++) {
+		if (map->fields[i].cmp_fn != tracing_map_cmp_atomic64)
+			continue;
+		atomic64_add(atomic64_read(&from->fields[i].sum),
+			     &elt->fields[i].sum);
+	}
+
+	if (map->ops && map->ops->elt_copy)
+		map->ops->elt_copy(elt, from);
+}
+
+/*
+ * Rebuild a per-CPU map from its shards.  The writers keep inserting
+ * into the shards meanwhile, the merge is a snapshot of each element
+ * at the time it is read.  An element that the map has no room left
+ * for, when the shards have more distinct keys between them than the
+ * map holds, counts as a drop of the map.
+ */
+static void tracing_map_merge_shards(struct tracing_map *map)
+{
+	struct tracing_map_elt *val;
+	struct tracing_map *shard;
+	unsigned int i;
+	int cpu;
+
+	__tracing_map_clear(map);
+
+	for_each_possible_cpu(cpu) {
+		shard = map->shards[cpu];
+
+		for (i = 0; i < shard->map_size; i++) {
+			val = READ_ONCE(TRACING_MAP_ENTRY(shard->map, i)->val);
+			if (val)
+				merge_elt(map, val);
+		}
+	}
+}
+
 /**
  * tracing_map_sort_entries - Sort the current set of tracing_map_elts in a map
  * @map: The tracing_map
@@ -1053,6 +1224,11 @@ static void sort_secondary(struct tracing_map *map,
  * The client should not hold on to the returned array but should use
  * it and call tracing_map_destroy_sort_entries() when done.
  *
+ * The shards of a per-CPU map are first merged into the map, which the
+ * returned entries refer to: the client must serialize the calls to
+ * this function on such a map, and be done with the entries before the
+ * next one.
+ *
  * Return: the number of sort_entries in the struct tracing_map_sort_entry
  * array, negative on error
  */
@@ -1066,6 +1242,9 @@ int tracing_map_sort_entries(struct tracing_map *map,
 	struct tracing_map_sort_entry *sort_entry, **entries;
 	int i, n_entries, ret;
 
+	if (map->shards)
+		tracing_map_merge_shards(map);
+
 	entries = vmalloc(array_size(sizeof(sort_entry), map->max_elts));
 	if (!entries)
 		return -ENOMEM;
@@ -95,6 +95,16 @@ typedef int (*tracing_map_cmp_fn_t) (void *val_a, void *val_b);
  * tracing_map_elts is allocated as a single block and is stored in
  * the elts field of struct tracing_map.
  *
+ * A map set up with tracing_map_set_percpu() before tracing_map_init()
+ * also gets a shard for each possible CPU, a complete tracing_map of
+ * the same size and fields, in the shards array of struct tracing_map.
+ * tracing_map_insert() and tracing_map_lookup() then only touch the
+ * shard of the CPU they run on, so that CPUs hitting the same keys
+ * don't bounce the cache lines of the table and of the sums between
+ * them.  The map itself is only filled when the entries are sorted:
+ * tracing_map_sort_entries() clears it and merges the elements of all
+ * the shards into it, adding up their sums.
+ *
  * There is also a set of structures used for sorting that might
  * benefit from some minimal explanation.
  *
@@ -198,6 +208,8 @@ struct tracing_map {
 	unsigned int			n_vars;
 	atomic64_t			hits;
 	atomic64_t			drops;
+	bool				percpu;
+	struct tracing_map		**shards;
 };
 
 /**
@@ -229,12 +241,18 @@ struct tracing_map {
  *	be initialized when used i.e. when the element is actually
  *	claimed by tracing_map_insert() in the context of the map
  *	insertion.
+ *
+ * @elt_copy: This callback allows per-element client-defined data to
+ *	be copied from the element of a per-CPU shard to the element
+ *	the shards are merged into, see tracing_map_set_percpu().
  */
 struct tracing_map_ops {
 	int			(*elt_alloc)(struct tracing_map_elt *elt);
 	void			(*elt_free)(struct tracing_map_elt *elt);
 	void			(*elt_clear)(struct tracing_map_elt *elt);
 	void			(*elt_init)(struct tracing_map_elt *elt);
+	void			(*elt_copy)(struct tracing_map_elt *to,
+					    struct tracing_map_elt *from);
 };
 
 extern struct tracing_map *
@@ -242,6 +260,7 @@ tracing_map_create(unsigned int map_bits,
 		   unsigned int key_size,
 		   const struct tracing_map_ops *ops,
 		   void *private_data);
+extern void tracing_map_set_percpu(struct tracing_map *map);
 extern int tracing_map_init(struct tracing_map *map);
 
 extern int tracing_map_add_sum_field(struct tracing_map *map);
@@ -252,6 +271,8 @@ extern int tracing_map_add_key_field(struct tracing_map *map,
 
 extern void tracing_map_destroy(struct tracing_map *map);
 extern void tracing_map_clear(struct tracing_map *map);
+extern u64 tracing_map_read_hits(struct tracing_map *map);
+extern u64 tracing_map_read_drops(struct tracing_map *map);
 
 extern struct tracing_map_elt *
 tracing_map_insert(struct tracing_map *map, void *key);
@@ -42,13 +42,17 @@
 #include <linux/lockdep.h>
 #include <linux/idr.h>
 #include <linux/jhash.h>
+#include <linux/hash.h>
 #include <linux/hashtable.h>
 #include <linux/rculist.h>
 #include <linux/nodemask.h>
+#include <linux/module.h>
 #include <linux/moduleparam.h>
 #include <linux/uaccess.h>
 #include <linux/sched/isolation.h>
 #include <linux/nmi.h>
+#include <linux/debugfs.h>
+#include <linux/seq_file.h>
 
 #include "workqueue_internal.h"
 
@@ -189,6 +193,22 @@ struct worker_pool {
 	struct rcu_head		rcu;
 } ____cacheline_aligned_in_smp;
 
+/*
+ * Statistics of a pool_workqueue.  The times are in ns; LATENCY and
+ * RUN_TIME are only counted with CONFIG_WQ_STATS.
+ */
+enum pool_workqueue_stats {
+	PWQ_STAT_STARTED,	/* work items started execution */
+	PWQ_STAT_COMPLETED,	/* work items completed execution */
+	PWQ_STAT_CPU_TIME,	/* CPU time sampled by the tick */
+	PWQ_STAT_CPU_INTENSIVE,	/* wq_cpu_intensive_thresh_us violations */
+	PWQ_STAT_CM_WAKEUP,	/* workers woken by the violations */
+	PWQ_STAT_LATENCY,	/* from queueing to the start of execution */
+	PWQ_STAT_RUN_TIME,	/* from the start to the end of execution */
+
+	PWQ_NR_STATS,
+};
+
 /*
  * The per-pool workqueue.  While queued, the lower WORK_STRUCT_FLAG_BITS
  * of work_struct->data are used for flags and the remaining high bits
@@ -209,6 +229,9 @@ struct pool_workqueue {
 	struct list_head	pwqs_node;	/* WR: node on wq->pwqs */
 	struct list_head	mayday_node;	/* MD: node on wq->maydays */
 
+	u64			stats[PWQ_NR_STATS]; /* L: see above, CPU_TIME
+							 is added by the tick */
+
 	/*
 	 * Release of unbound pwq is punted to system_wq.  See put_pwq()
 	 * and pwq_unbound_release_workfn() for details.  pool_workqueue
@@ -288,6 +311,16 @@ module_param_named(disable_numa, wq_disable_numa, bool, 0444);
 static bool wq_power_efficient = IS_ENABLED(CONFIG_WQ_POWER_EFFICIENT_DEFAULT);
 module_param_named(power_efficient, wq_power_efficient, bool, 0444);
 
+/*
+ * A concurrency managed work item which runs for longer than this without
+ * sleeping is taken out of concurrency management, as if its workqueue had
+ * WQ_CPU_INTENSIVE, so that it doesn't hold up the other work items of its
+ * pool.  0 disables the detection.
+ */
+static unsigned long wq_cpu_intensive_thresh_us = 10000;
+module_param_named(cpu_intensive_thresh_us, wq_cpu_intensive_thresh_us,
+		   ulong, 0644);
+
 static bool wq_online;			/* can kworkers be created yet? */
 
 static bool wq_numa_enabled;		/* unbound NUMA affinity enabled */
@@ -838,6 +871,152 @@ static void wake_up_worker(struct worker_pool *pool)
 		wake_up_process(worker->task);
 }
 
+#ifdef CONFIG_WQ_STATS
+/*
+ * Execution statistics of each work function, shown in
+ * debugfs/workqueue/functions.  An entry is claimed the first time its
+ * function runs.  It is given back when the module of the function is
+ * unloaded, marked WQ_FUNC_STATS_FREED so that lookups of the functions
+ * past it go on probing.  The histograms have buckets of times below 4us,
+ * 16us, 64us and so on, four times wider each.
+ */
+enum {
+	WQ_FUNC_STATS_BITS	= 8,
+	WQ_FUNC_STATS_SIZE	= 1 << WQ_FUNC_STATS_BITS,
+	WQ_STATS_HIST		= 10,
+};
+
+struct wq_func_stats {
+	work_func_t		func;
+	atomic_long_t		count;
+	atomic_long_t		cpu_intensive;
+	atomic64_t		cpu_time;
+	atomic64_t		latency;
+	atomic64_t		runtime;
+	atomic_long_t		latency_hist[WQ_STATS_HIST];
+	atomic_long_t		runtime_hist[WQ_STATS_HIST];
+};
+
+#define WQ_FUNC_STATS_FREED	((work_func_t)1)
+
+static struct wq_func_stats wq_func_stats[WQ_FUNC_STATS_SIZE];
+static atomic_long_t wq_func_stats_dropped;	/* runs of no entry */
+
+static struct wq_func_stats *wq_func_stats_get(work_func_t func)
+{
+	unsigned long i, hash = hash_ptr(func, WQ_FUNC_STATS_BITS);
+	struct wq_func_stats *stats, *free;
+	work_func_t old, expected;
+
+retry:
+	free = NULL;
+	expected = NULL;
+	for (i = 0; i < WQ_FUNC_STATS_SIZE; i++) {
+		stats = &wq_func_stats[(hash + i) % WQ_FUNC_STATS_SIZE];
+		old = READ_ONCE(stats->func);
+		if (old == func)
+			return stats;
+		if (!free && (!old || old == WQ_FUNC_STATS_FREED)) {
+			free = stats;
+			expected = old;
+		}
+		if (!old)
+			break;
+	}
+	if (!free)
+		return NULL;
+
+	old = cmpxchg(&free->func, expected, func);
+	if (old == expected || old == func)
+		return free;
+	/* another function took the entry, each retry means one less free */
+	goto retry;
+}
+
+static void wq_stats_hist_add(atomic_long_t *hist, u64 ns)
+{
+	u64 us = div_u64(ns, NSEC_PER_USEC);
+
+	atomic_long_inc(&hist[us ? min(ilog2(us) / 2, WQ_STATS_HIST - 1) : 0]);
+}
+
+/* @worker is about to run @work, with pool->lock held */
+static void wq_stats_work_start(struct worker *worker, struct work_struct *work)
+{
+	struct wq_func_stats *stats = wq_func_stats_get(worker->current_func);
+	u64 now = local_clock();
+	/* local_clock() of another CPU may be a little ahead */
+	u64 latency = max_t(s64, now - work->queued_at, 0);
+
+	worker->current_stats = stats;
+	worker->current_start = now;
+	worker->current_latency = latency;
+	worker->current_pwq->stats[PWQ_STAT_LATENCY] += latency;
+	if (stats) {
+		atomic64_add(latency, &stats->latency);
+		wq_stats_hist_add(stats->latency_hist, latency);
+	}
+}
+
+/* @work, which may be freed already, has returned, returns its runtime */
+static u64 wq_stats_work_end(struct worker *worker, struct work_struct *work)
+{
+	struct wq_func_stats *stats = worker->current_stats;
+	u64 runtime = local_clock() - worker->current_start;
+
+	if (stats) {
+		atomic_long_inc(&stats->count);
+		atomic64_add(runtime, &stats->runtime);
+		wq_stats_hist_add(stats->runtime_hist, runtime);
+	} else {
+		atomic_long_inc(&wq_func_stats_dropped);
+	}
+	trace_workqueue_execute_stats(work, worker->current_func,
+				      worker->current_latency, runtime);
+	worker->current_stats = NULL;
+	return runtime;
+}
+
+static void wq_stats_tick(struct worker *worker)
+{
+	struct wq_func_stats *stats = worker->current_stats;
+
+	if (stats)
+		atomic64_add(TICK_NSEC, &stats->cpu_time);
+}
+
+/*
+ * A work function which keeps getting flagged should go on a
+ * WQ_CPU_INTENSIVE or WQ_UNBOUND workqueue instead.  Say so when it has
+ * been flagged 4, 8, 16... times.  Called from the scheduler tick with
+ * pool->lock held, hence printk_deferred().
+ */
+static void wq_stats_cpu_intensive(struct worker *worker)
+{
+	struct wq_func_stats *stats = worker->current_stats;
+	long cnt;
+
+	if (!stats)
+		return;
+
+	cnt = atomic_long_inc_return(&stats->cpu_intensive);
+	if (cnt >= 4 && is_power_of_2(cnt))
+		printk_deferred(KERN_WARNING "workqueue: %pf hogged CPU for >%luus %ld times, consider switching to WQ_UNBOUND or WQ_CPU_INTENSIVE\n",
+				worker->current_func,
+				wq_cpu_intensive_thresh_us, cnt);
+}
+#else	/* CONFIG_WQ_STATS */
+static inline void wq_stats_work_start(struct worker *worker,
+				       struct work_struct *work) { }
+static inline u64 wq_stats_work_end(struct worker *worker,
+				    struct work_struct *work)
+{
+	return 0;
+}
+static inline void wq_stats_tick(struct worker *worker) { }
+static inline void wq_stats_cpu_intensive(struct worker *worker) { }
+#endif	/* CONFIG_WQ_STATS */
+
 /**
  * wq_worker_waking_up - a worker is waking up
  * @task: task waking up
@@ -857,6 +1036,9 @@ void wq_worker_waking_up(struct task_struct *task, int cpu)
 		WARN_ON_ONCE(worker->pool->cpu != cpu);
 		atomic_inc(&worker->pool->nr_running);
 	}
+
+	/* wq_worker_tick() measures the runtime since the last sleep */
+	worker->current_at = task->se.sum_exec_runtime;
 }
 
 /**
@@ -963,6 +1145,60 @@ static inline void worker_clr_flags(struct worker *worker, unsigned int flags)
 			atomic_inc(&pool->nr_running);
 }
 
+/**
+ * wq_worker_tick - a scheduler tick occurred while a worker is running
+ * @task: task currently running
+ *
+ * This function is called from scheduler_tick() for a worker.  It samples
+ * the CPU time of the work item being run and takes a concurrency managed
+ * worker which has run for longer than wq_cpu_intensive_thresh_us without
+ * sleeping out of concurrency management, so that the other work items of
+ * its pool get a worker.
+ *
+ * CONTEXT:
+ * Hardirq on the local cpu, @task is %current.
+ */
+void wq_worker_tick(struct task_struct *task)
+{
+	struct worker *worker = kthread_data(task);
+	struct pool_workqueue *pwq = worker->current_pwq;
+	struct worker_pool *pool = worker->pool;
+	u64 runtime;
+
+	if (!pwq)
+		return;
+
+	pwq->stats[PWQ_STAT_CPU_TIME] += TICK_NSEC;
+	wq_stats_tick(worker);
+
+	/*
+	 * Only @worker changes its NOT_RUNNING flags while it's bound, and
+	 * wq_worker_sleeping() can't run until this tick is over.  Rescuers
+	 * stay NOT_RUNNING and never get here.
+	 */
+	if (!wq_cpu_intensive_thresh_us || (worker->flags & WORKER_NOT_RUNNING))
+		return;
+
+	runtime = task->se.sum_exec_runtime - worker->current_at;
+	if (runtime < wq_cpu_intensive_thresh_us * NSEC_PER_USEC)
+		return;
+
+	spin_lock(&pool->lock);
+
+	worker_set_flags(worker, WORKER_CPU_INTENSIVE);
+	pwq->stats[PWQ_STAT_CPU_INTENSIVE]++;
+	trace_workqueue_cpu_intensive(worker->current_work,
+				      worker->current_func, runtime);
+	wq_stats_cpu_intensive(worker);
+
+	if (need_more_worker(pool)) {
+		pwq->stats[PWQ_STAT_CM_WAKEUP]++;
+		wake_up_worker(pool);
+	}
+
+	spin_unlock(&pool->lock);
+}
+
 /**
  * find_worker_executing_work - find worker which is executing a work
  * @pool: pool of interest
@@ -1299,6 +1535,9 @@ static void insert_work(struct pool_workqueue *pwq, struct work_struct *work,
 	set_work_pwq(work, pwq, extra_flags);
 	list_add_tail(&work->entry, head);
 	get_pwq(pwq);
+#ifdef CONFIG_WQ_STATS
+	work->queued_at = local_clock();
+#endif
 
 	/*
 	 * Ensure either wq_worker_sleeping() sees the above
@@ -2052,6 +2291,7 @@ __acquires(&pool->lock)
 	bool cpu_intensive = pwq->wq->flags & WQ_CPU_INTENSIVE;
 	int work_color;
 	struct worker *collision;
+	u64 runtime;
 #ifdef CONFIG_LOCKDEP
 	/*
 	 * It is permissible to free the struct work_struct from
@@ -2086,7 +2326,10 @@ __acquires(&pool->lock)
 	worker->current_work = work;
 	worker->current_func = work->func;
 	worker->current_pwq = pwq;
+	worker->current_at = worker->task->se.sum_exec_runtime;
 	work_color = get_work_color(work);
+	pwq->stats[PWQ_STAT_STARTED]++;
+	wq_stats_work_start(worker, work);
 
 	/*
 	 * Record wq name for cmdline and debug reporting, may get
@@ -2156,6 +2399,7 @@ __acquires(&pool->lock)
 	 * point will only record its address.
 	 */
 	trace_workqueue_execute_end(work);
+	runtime = wq_stats_work_end(worker, work);
 	lock_map_release(&lockdep_map);
 	lock_map_release(&pwq->wq->lockdep_map);
 
@@ -2180,9 +2424,14 @@ __acquires(&pool->lock)
 
 	spin_lock_irq(&pool->lock);
 
-	/* clear cpu intensive status */
-	if (unlikely(cpu_intensive))
-		worker_clr_flags(worker, WORKER_CPU_INTENSIVE);
+	/*
+	 * Clear cpu intensive status, which wq_worker_tick() may also have
+	 * set for a work item that ran too long.
+	 */
+	worker_clr_flags(worker, WORKER_CPU_INTENSIVE);
+
+	pwq->stats[PWQ_STAT_COMPLETED]++;
+	pwq->stats[PWQ_STAT_RUN_TIME] += runtime;
 
 	/* we're done with it, release */
 	hash_del(&worker->hentry);
@@ -5635,6 +5884,145 @@ static inline void wq_watchdog_init(void) { }
 
 #endif	/* CONFIG_WQ_WATCHDOG */
 
+#ifdef CONFIG_WQ_STATS
+/*
+ * debugfs/workqueue/workqueues has the totals of the pool_workqueue stats
+ * of each workqueue, the times in us.  debugfs/workqueue/functions has
+ * the wq_func_stats of each work function that has run: how many times it
+ * ran, was flagged CPU intensive, its CPU time in us and its total and
+ * histogram of latencies and runtimes in us.
+ */
+static int wq_workqueues_show(struct seq_file *m, void *v)
+{
+	struct workqueue_struct *wq;
+	struct pool_workqueue *pwq;
+	u64 stats[PWQ_NR_STATS];
+	int i;
+
+	seq_printf(m, "%-24s %10s %10s %12s %9s %9s %14s %14s\n",
+		   "workqueue", "started", "completed", "cpu_time", "intensive",
+		   "cm_wakeup", "latency", "run_time");
+
+	mutex_lock(&wq_pool_mutex);
+	list_for_each_entry(wq, &workqueues, list) {
+		memset(stats, 0, sizeof(stats));
+		mutex_lock(&wq->mutex);
+		for_each_pwq(pwq, wq) {
+			spin_lock_irq(&pwq->pool->lock);
+			for (i = 0; i < PWQ_NR_STATS; i++)
+				stats[i] += pwq->stats[i];
+			spin_unlock_irq(&pwq->pool->lock);
+		}
+		mutex_unlock(&wq->mutex);
+
+		seq_printf(m, "%-24s %10llu %10llu %12llu %9llu %9llu %14llu %14llu\n",
+			   wq->name, stats[PWQ_STAT_STARTED],
+			   stats[PWQ_STAT_COMPLETED],
+			   div_u64(stats[PWQ_STAT_CPU_TIME], NSEC_PER_USEC),
+			   stats[PWQ_STAT_CPU_INTENSIVE],
+			   stats[PWQ_STAT_CM_WAKEUP],
+			   div_u64(stats[PWQ_STAT_LATENCY], NSEC_PER_USEC),
+			   div_u64(stats[PWQ_STAT_RUN_TIME], NSEC_PER_USEC));
+	}
+	mutex_unlock(&wq_pool_mutex);
+	return 0;
+}
+DEFINE_SHOW_ATTRIBUTE(wq_workqueues);
+
+static void wq_hist_show(struct seq_file *m, const char *name,
+			 atomic_long_t *hist)
+{
+	int i;
+
+	seq_printf(m, "  %-8s", name);
+	for (i = 0; i < WQ_STATS_HIST; i++)
+		seq_printf(m, " %ld", atomic_long_read(&hist[i]));
+	seq_putc(m, '\n');
+}
+
+static int wq_functions_show(struct seq_file *m, void *v)
+{
+	struct wq_func_stats *stats;
+	work_func_t func;
+	int i;
+
+	seq_puts(m, "buckets");
+	for (i = 0; i < WQ_STATS_HIST - 1; i++)
+		seq_printf(m, " <%u", 4 << (2 * i));
+	seq_puts(m, " more\n");
+
+	for (i = 0; i < WQ_FUNC_STATS_SIZE; i++) {
+		stats = &wq_func_stats[i];
+		func = READ_ONCE(stats->func);
+		if (!func || func == WQ_FUNC_STATS_FREED)
+			continue;
+		seq_printf(m, "%pf count %ld cpu_intensive %ld cpu_time %llu latency %llu runtime %llu\n",
+			   func, atomic_long_read(&stats->count),
+			   atomic_long_read(&stats->cpu_intensive),
+			   div_u64(atomic64_read(&stats->cpu_time), NSEC_PER_USEC),
+			   div_u64(atomic64_read(&stats->latency), NSEC_PER_USEC),
+			   div_u64(atomic64_read(&stats->runtime), NSEC_PER_USEC));
+		wq_hist_show(m, "latency", stats->latency_hist);
+		wq_hist_show(m, "runtime", stats->runtime_hist);
+	}
+	seq_printf(m, "dropped %ld\n", atomic_long_read(&wq_func_stats_dropped));
+	return 0;
+}
+DEFINE_SHOW_ATTRIBUTE(wq_functions);
+
+#ifdef CONFIG_MODULES
+/*
+ * Give back the entries of the functions of a module going away, its work
+ * items can't run anymore.  Another module may be loaded at the same
+ * addresses, so the stats would be credited to the wrong function.
+ */
+static int wq_stats_module_notify(struct notifier_block *nb,
+				  unsigned long val, void *data)
+{
+	struct module *mod = data;
+	struct wq_func_stats *stats;
+	work_func_t func;
+	int i;
+
+	if (val != MODULE_STATE_GOING)
+		return NOTIFY_DONE;
+
+	for (i = 0; i < WQ_FUNC_STATS_SIZE; i++) {
+		stats = &wq_func_stats[i];
+		func = READ_ONCE(stats->func);
+		if (!func || func == WQ_FUNC_STATS_FREED ||
+		    !within_module((unsigned long)func, mod))
+			continue;
+
+		memset((void *)stats + offsetof(struct wq_func_stats, count), 0,
+		       sizeof(*stats) - offsetof(struct wq_func_stats, count));
+		/* clear the counters before the entry can be claimed again */
+		smp_wmb();
+		WRITE_ONCE(stats->func, WQ_FUNC_STATS_FREED);
+	}
+	return NOTIFY_DONE;
+}
+
+static struct notifier_block wq_stats_module_nb = {
+	.notifier_call = wq_stats_module_notify,
+};
+#endif	/* CONFIG_MODULES */
+
+static int __init wq_stats_init(void)
+{
+	struct dentry *dir = debugfs_create_dir("workqueue", NULL);
+
+	debugfs_create_file("workqueues", 0444, dir, NULL,
+			    &wq_workqueues_fops);
+	debugfs_create_file("functions", 0444, dir, NULL, &wq_functions_fops);
+#ifdef CONFIG_MODULES
+	register_module_notifier(&wq_stats_module_nb);
+#endif
+	return 0;
+}
+late_initcall(wq_stats_init);
+#endif	/* CONFIG_WQ_STATS */
+
 static void __init wq_numa_init(void)
 {
 	cpumask_var_t *tbl;
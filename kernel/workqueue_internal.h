@@ -13,6 +13,7 @@
 #include <linux/preempt.h>
 
 struct worker_pool;
+struct wq_func_stats;
 
 /*
  * The poor guys doing the actual heavy lifting.  All on-duty workers are
@@ -31,6 +32,7 @@ struct worker {
 	struct work_struct	*current_work;	/* L: work being processed */
 	work_func_t		current_func;	/* L: current_work's fn */
 	struct pool_workqueue	*current_pwq; /* L: current_work's pwq */
+	u64			current_at;	/* runtime at start or last wakeup */
 	struct list_head	scheduled;	/* L: scheduled works */
 
 	/* 64 bytes boundary on 64bit, 32 on 32bit */
@@ -53,6 +55,12 @@ struct worker {
 
 	/* used only by rescuers to point to the target workqueue */
 	struct workqueue_struct	*rescue_wq;	/* I: the workqueue to rescue */
+
+#ifdef CONFIG_WQ_STATS
+	struct wq_func_stats	*current_stats;	/* L: current_func's stats */
+	u64			current_start;	/* L: local_clock() at start */
+	u64			current_latency; /* L: queued to start */
+#endif
 };
 
 /**
@@ -71,5 +79,6 @@ static inline struct worker *current_wq_worker(void)
  */
 void wq_worker_waking_up(struct task_struct *task, int cpu);
 struct task_struct *wq_worker_sleeping(struct task_struct *task);
+void wq_worker_tick(struct task_struct *task);
 
 #endif /* _KERNEL_WORKQUEUE_INTERNAL_H */
@@ -3507,6 +3507,59 @@ static struct bpf_test tests[] = {
 		{ },
 		{ { 0, 0x1 } },
 	},
+	{
+		"ALU64_K: bitmask, imm12 and shifted imm12 immediates",
+		.u.insns_int = {
+			BPF_LD_IMM64(R1, 0x0123456789abcdefLL),
+			BPF_ALU64_IMM(BPF_AND, R1, 0x00ff00ff),
+			BPF_ALU64_IMM(BPF_OR, R1, 0x0f000f00),
+			BPF_ALU64_IMM(BPF_XOR, R1, -256),
+			BPF_ALU64_IMM(BPF_ADD, R1, 0x123000),
+			BPF_ALU64_IMM(BPF_SUB, R1, -4095),
+			BPF_LD_IMM64(R2, 0xfffffffff06730eeLL),
+			BPF_JMP_REG(BPF_JEQ, R1, R2, 2),
+			BPF_MOV32_IMM(R0, 2),
+			BPF_EXIT_INSN(),
+			BPF_MOV32_IMM(R0, 1),
+			BPF_EXIT_INSN(),
+		},
+		INTERNAL,
+		{ },
+		{ { 0, 0x1 } },
+	},
+	{
+		"ALU_K: bitmask and negative imm12 immediates",
+		.u.insns_int = {
+			BPF_LD_IMM64(R1, 0xfffffffff06730eeLL),
+			BPF_ALU32_IMM(BPF_AND, R1, 0xfffffffe),
+			BPF_ALU32_IMM(BPF_ADD, R1, -2),
+			BPF_MOV64_REG(R0, R1),
+			BPF_EXIT_INSN(),
+		},
+		INTERNAL,
+		{ },
+		{ { 0, 0xf06730ec } },
+	},
+	{
+		"JMP_K: negative, shifted imm12 and bitmask immediates",
+		.u.insns_int = {
+			BPF_LD_IMM64(R1, -2),
+			BPF_MOV32_IMM(R0, 2),
+			BPF_JMP_IMM(BPF_JSGT, R1, -3, 1),
+			BPF_EXIT_INSN(),
+			BPF_JMP_IMM(BPF_JGT, R1, 0x7ff000, 1),
+			BPF_EXIT_INSN(),
+			BPF_JMP_IMM(BPF_JSET, R1, 0x00ff00ff, 1),
+			BPF_EXIT_INSN(),
+			BPF_JMP_IMM(BPF_JEQ, R1, -2, 1),
+			BPF_EXIT_INSN(),
+			BPF_MOV32_IMM(R0, 1),
+			BPF_EXIT_INSN(),
+		},
+		INTERNAL,
+		{ },
+		{ { 0, 0x1 } },
+	},
 	/* BPF_ALU | BPF_OR | BPF_X */
 	{
 		"ALU_OR_X: 1 | 2 = 3",
@@ -4302,6 +4355,31 @@ static struct bpf_test tests[] = {
 		{ { 0, 0xffffffff } },
 		.stack_depth = 40,
 	},
+	{
+		"STX_MEM/LDX_MEM: scaled, unscaled and register offsets",
+		.u.insns_int = {
+			BPF_MOV64_REG(R1, R10),
+			BPF_ALU64_IMM(BPF_ADD, R1, -512),
+			BPF_LD_IMM64(R2, 0x0102030405060708LL),
+			BPF_STX_MEM(BPF_DW, R1, R2, 8),
+			BPF_STX_MEM(BPF_W, R1, R2, 258),
+			BPF_STX_MEM(BPF_H, R10, R2, -3),
+			BPF_LDX_MEM(BPF_DW, R3, R1, 8),
+			BPF_JMP_REG(BPF_JNE, R3, R2, 6),
+			BPF_LDX_MEM(BPF_W, R3, R1, 258),
+			BPF_JMP_IMM(BPF_JNE, R3, 0x05060708, 4),
+			BPF_LDX_MEM(BPF_H, R3, R10, -3),
+			BPF_JMP_IMM(BPF_JNE, R3, 0x0708, 2),
+			BPF_MOV32_IMM(R0, 1),
+			BPF_EXIT_INSN(),
+			BPF_MOV32_IMM(R0, 2),
+			BPF_EXIT_INSN(),
+		},
+		INTERNAL,
+		{ },
+		{ { 0, 0x1 } },
+		.stack_depth = 512,
+	},
 	/* BPF_STX | BPF_XADD | BPF_W/DW */
 	{
 		"STX_XADD_W: Test: 0x12 + 0x10 = 0x22",
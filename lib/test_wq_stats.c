@@ -0,0 +1,49 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * Queues a known number of runs of a known work function, for the
+ * CONFIG_WQ_STATS selftest to find in debugfs/workqueue/functions.  The
+ * entry of test_wq_stats_fn must be gone once the module is unloaded.
+ */
+#define pr_fmt(fmt) KBUILD_MODNAME ": " fmt
+
+#include <linux/delay.h>
+#include <linux/module.h>
+#include <linux/workqueue.h>
+
+static unsigned int runs = 16;
+module_param(runs, uint, 0444);
+MODULE_PARM_DESC(runs, "Number of times the work function runs (default: 16)");
+
+static unsigned int delay_us = 100;
+module_param(delay_us, uint, 0444);
+MODULE_PARM_DESC(delay_us, "Runtime of each run in us (default: 100)");
+
+static void test_wq_stats_fn(struct work_struct *work)
+{
+	udelay(delay_us);
+}
+
+static int __init test_wq_stats_init(void)
+{
+	struct work_struct work;
+	unsigned int i;
+
+	INIT_WORK_ONSTACK(&work, test_wq_stats_fn);
+	for (i = 0; i < runs; i++) {
+		queue_work(system_wq, &work);
+		flush_work(&work);
+	}
+	destroy_work_on_stack(&work);
+
+	pr_info("ran test_wq_stats_fn %u times\n", runs);
+	return 0;
+}
+module_init(test_wq_stats_init);
+
+static void __exit test_wq_stats_exit(void)
+{
+}
+module_exit(test_wq_stats_exit);
+
+MODULE_DESCRIPTION("Workqueue statistics test module");
+MODULE_LICENSE("GPL");
@@ -48,6 +48,7 @@ enum scan_result {
 	SCAN_CGROUP_CHARGE_FAIL,
 	SCAN_EXCEED_SWAP_PTE,
 	SCAN_TRUNCATED,
+	SCAN_PTE_SHARED,
 };
 
 #define CREATE_TRACE_POINTS
@@ -895,6 +896,11 @@ static bool __collapse_huge_page_swapin(struct mm_struct *mm,
 		trace_mm_collapse_huge_page_swapin(mm, swapped_in, referenced, 0);
 		return false;
 	}
+	/* do_swap_page() changes the table, a table shared on fork first */
+	if (pte_unshare(vma, pmd, address)) {
+		trace_mm_collapse_huge_page_swapin(mm, swapped_in, referenced, 0);
+		return false;
+	}
 	vmf.pte = pte_offset_map(pmd, address);
 	for (; vmf.address < address + HPAGE_PMD_NR*PAGE_SIZE;
 			vmf.pte++, vmf.address += PAGE_SIZE) {
@@ -986,6 +992,12 @@ static void collapse_huge_page(struct mm_struct *mm,
 		up_read(&mm->mmap_sem);
 		goto out_nolock;
 	}
+	if (pte_table_shared(pmd)) {
+		result = SCAN_PTE_SHARED;
+		mem_cgroup_cancel_charge(new_page, memcg, true);
+		up_read(&mm->mmap_sem);
+		goto out_nolock;
+	}
 
 	/*
 	 * __collapse_huge_page_swapin always returns with mmap_sem locked.
@@ -1011,6 +1023,14 @@ static void collapse_huge_page(struct mm_struct *mm,
 	/* check if the pmd is still valid */
 	if (mm_find_pmd(mm, address) != pmd)
 		goto out;
+	/*
+	 * Another mm still uses a PTE table shared on fork.  With mmap_sem
+	 * held for write, a table of our own cannot become shared.
+	 */
+	if (pte_table_shared(pmd)) {
+		result = SCAN_PTE_SHARED;
+		goto out;
+	}
 
 	anon_vma_lock_write(vma->anon_vma);
 
@@ -1117,6 +1137,10 @@ static int khugepaged_scan_pmd(struct mm_struct *mm,
 		result = SCAN_PMD_NULL;
 		goto out;
 	}
+	if (pte_table_shared(pmd)) {
+		result = SCAN_PTE_SHARED;
+		goto out;
+	}
 
 	memset(khugepaged_node_load, 0, sizeof(khugepaged_node_load));
 	pte = pte_offset_map_lock(mm, pmd, address, &ptl);
@@ -1044,6 +1044,7 @@ static int write_protect_page(struct vm_area_struct *vma, struct page *page,
 	int err = -EFAULT;
 	unsigned long mmun_start;	/* For mmu_notifiers */
 	unsigned long mmun_end;		/* For mmu_notifiers */
+	pmd_t *pmd;
 
 	pvmw.address = page_address_in_vma(page, vma);
 	if (pvmw.address == -EFAULT)
@@ -1051,6 +1052,11 @@ static int write_protect_page(struct vm_area_struct *vma, struct page *page,
 
 	BUG_ON(PageTransCompound(page));
 
+	/* Other mms map the page through a PTE table shared on fork */
+	pmd = mm_find_pmd(mm, pvmw.address);
+	if (pmd && pte_unshare(vma, pmd, pvmw.address))
+		goto out;
+
 	mmun_start = pvmw.address;
 	mmun_end   = pvmw.address + PAGE_SIZE;
 	mmu_notifier_invalidate_range_start(mm, mmun_start, mmun_end);
@@ -327,6 +327,9 @@ static int madvise_free_pte_range(pmd_t *pmd, unsigned long addr,
 
 	if (pmd_trans_unstable(pmd))
 		return 0;
+	/* Other mms still use the pages of a PTE table shared on fork */
+	if (pte_unshare(vma, pmd, addr))
+		return 0;
 
 	tlb_remove_check_page_size_change(tlb, PAGE_SIZE);
 	orig_pte = pte = pte_offset_map_lock(mm, pmd, addr, &ptl);
@@ -507,6 +510,11 @@ static int madvise_free_single_vma(struct vm_area_struct *vma,
 static long madvise_dontneed_single_vma(struct vm_area_struct *vma,
 					unsigned long start, unsigned long end)
 {
+	long error;
+
+	error = pte_unshare_vma(vma, start, end);
+	if (error)
+		return error;
 	zap_page_range(vma, start, end - start);
 	return 0;
 }
@@ -1123,6 +1123,368 @@ again:
 	return 0;
 }
 
+#ifdef CONFIG_FORK_SHARE_PTE
+/*
+ * Sharing of PTE tables on fork, for a process that asked for it with
+ * PR_SET_LAZY_FORK: the child gets the PTE tables of the private
+ * anonymous memory of its parent, write-protected, instead of copies.
+ * page->pt_share_count of a table counts the mms using it but one.
+ *
+ * A shared table holds one reference to the pages and swap entries it
+ * maps, and one mapcount, whatever the number of mms using it; the RSS
+ * of each mm counts them.  It is never changed but for the accessed and
+ * dirty bits: the first mm to change its mapping of the range, on a
+ * fault, mprotect, mremap, munmap and the like, takes a copy with the
+ * references fork would have taken, see __pte_unshare().  KSM and
+ * NUMA hinting copy the table as well, reclaim and migration have it
+ * copied by pte_unshare_async() and retry.
+ *
+ * The table of a pmd is replaced under mmap_sem held for read, under the
+ * lock of the table and the anon_vma lock that rmap walks hold:
+ * pte_offset_map_lock() checks the pmd again once the lock is taken.
+ */
+
+/* The RSS counter of an entry, NR_MM_COUNTERS for none */
+static int shared_pte_counter(pte_t pte)
+{
+	swp_entry_t entry;
+
+	if (pte_none(pte))
+		return NR_MM_COUNTERS;
+	if (pte_present(pte))
+		return is_zero_pfn(pte_pfn(pte)) ? NR_MM_COUNTERS : MM_ANONPAGES;
+	entry = pte_to_swp_entry(pte);
+	if (!non_swap_entry(entry))
+		return MM_SWAPENTS;
+	if (is_migration_entry(entry) || is_device_private_entry(entry))
+		return MM_ANONPAGES;
+	return NR_MM_COUNTERS;
+}
+
+/*
+ * Give @dst_pmd the PTE table of @src_pmd instead of a copy, when the
+ * table maps private anonymous memory of @vma only.
+ */
+static bool share_pte_table(struct mm_struct *dst_mm, struct mm_struct *src_mm,
+			    pmd_t *dst_pmd, pmd_t *src_pmd,
+			    struct vm_area_struct *vma, unsigned long addr,
+			    unsigned long end)
+{
+	int rss[NR_MM_COUNTERS + 1];
+	pte_t *orig_pte, *pte, ptent;
+	bool swapped = false;
+	swp_entry_t entry;
+	spinlock_t *ptl;
+
+	if (!test_bit(MMF_FORK_SHARE_PTE, &src_mm->flags) ||
+	    !vma_is_anonymous(vma) || (addr & ~PMD_MASK) ||
+	    end - addr != PMD_SIZE || mm_has_notifiers(src_mm))
+		return false;
+
+	memset(rss, 0, sizeof(rss));
+	orig_pte = pte = pte_offset_map_lock(src_mm, src_pmd, addr, &ptl);
+	for (; addr != end; pte++, addr += PAGE_SIZE) {
+		ptent = *pte;
+		if (pte_none(ptent))
+			continue;
+		rss[shared_pte_counter(ptent)]++;
+		if (pte_present(ptent)) {
+			if (pte_write(ptent))
+				ptep_set_wrprotect(src_mm, addr, pte);
+			continue;
+		}
+		entry = pte_to_swp_entry(ptent);
+		if (!non_swap_entry(entry)) {
+			swapped = true;
+		} else if (is_write_migration_entry(entry)) {
+			make_migration_entry_read(&entry);
+			ptent = swp_entry_to_pte(entry);
+			if (pte_swp_soft_dirty(*pte))
+				ptent = pte_swp_mksoft_dirty(ptent);
+			set_pte_at(src_mm, addr, pte, ptent);
+		} else if (is_write_device_private_entry(entry)) {
+			make_device_private_entry_read(&entry);
+			set_pte_at(src_mm, addr, pte, swp_entry_to_pte(entry));
+		}
+	}
+	atomic_inc(&pmd_page(*src_pmd)->pt_share_count);
+	mm_inc_nr_ptes(dst_mm);
+	pmd_populate(dst_mm, dst_pmd, pmd_pgtable(*src_pmd));
+	pte_unmap_unlock(orig_pte, ptl);
+
+	add_mm_rss_vec(dst_mm, rss);
+	if (swapped && unlikely(list_empty(&dst_mm->mmlist))) {
+		spin_lock(&mmlist_lock);
+		if (list_empty(&dst_mm->mmlist))
+			list_add(&dst_mm->mmlist, &src_mm->mmlist);
+		spin_unlock(&mmlist_lock);
+	}
+	return true;
+}
+
+#ifndef CONFIG_HAVE_RCU_TABLE_FREE
+static void pte_unshare_sync_ipi(void *arg)
+{
+	/* Simply deliver the interrupt */
+}
+#endif
+
+/*
+ * Wait for gup_fast() still walking the shared table that the mm let go
+ * of, with interrupts disabled.  Page tables freed after an RCU-sched
+ * grace period need nothing, otherwise interrupt the CPUs the mm runs on.
+ */
+static void pte_unshare_sync(struct mm_struct *mm)
+{
+#ifndef CONFIG_HAVE_RCU_TABLE_FREE
+	if (atomic_read(&mm->mm_users) > 1)
+		smp_call_function_many(mm_cpumask(mm), pte_unshare_sync_ipi,
+				       NULL, 1);
+#endif
+}
+
+/*
+ * Replace the shared PTE table of @addr with a copy of it for the mm of
+ * @vma.  Returns 0 when done or when the table is no longer shared,
+ * -ENOMEM.
+ */
+int __pte_unshare(struct vm_area_struct *vma, pmd_t *pmd, unsigned long addr)
+{
+	struct mm_struct *mm = vma->vm_mm;
+	unsigned long start = addr & PMD_MASK;
+	swp_entry_t entry, failed;
+	pte_t *src, *dst, ptent;
+	struct page *table, *page;
+	pgtable_t new;
+	spinlock_t *ptl;
+	int i, ret = 0;
+
+	new = pte_alloc_one(mm, start);
+	if (!new)
+		return -ENOMEM;
+
+	anon_vma_lock_write(vma->anon_vma);
+again:
+	src = pte_offset_map_lock(mm, pmd, start, &ptl);
+	table = pmd_page(*pmd);
+	if (!atomic_read(&table->pt_share_count))
+		goto out;
+
+	/* The swap entries first, the only references that can fail */
+	for (i = 0, addr = start; i < PTRS_PER_PTE; i++, addr += PAGE_SIZE) {
+		if (!is_swap_pte(src[i]))
+			continue;
+		entry = pte_to_swp_entry(src[i]);
+		if (!non_swap_entry(entry) && swap_duplicate(entry) < 0)
+			break;
+	}
+	if (i < PTRS_PER_PTE) {
+		failed = entry;
+		while (i--) {
+			addr -= PAGE_SIZE;
+			if (!is_swap_pte(src[i]))
+				continue;
+			entry = pte_to_swp_entry(src[i]);
+			if (!non_swap_entry(entry))
+				swap_free(entry);
+		}
+		pte_unmap_unlock(src, ptl);
+		if (add_swap_count_continuation(failed, GFP_KERNEL) < 0) {
+			ret = -ENOMEM;
+			goto out_unlocked;
+		}
+		goto again;
+	}
+
+	dst = kmap_atomic(new);
+	for (i = 0, addr = start; i < PTRS_PER_PTE; i++, addr += PAGE_SIZE) {
+		ptent = src[i];
+		if (pte_none(ptent))
+			continue;
+		page = NULL;
+		if (pte_present(ptent)) {
+			page = _vm_normal_page(vma, addr, ptent, true);
+		} else {
+			entry = pte_to_swp_entry(ptent);
+			if (is_device_private_entry(entry))
+				page = device_private_entry_to_page(entry);
+		}
+		if (page) {
+			get_page(page);
+			page_dup_rmap(page, false);
+		}
+		set_pte_at(mm, addr, dst + i, ptent);
+	}
+	kunmap_atomic(dst);
+
+	smp_wmb(); /* See comment in __pte_alloc() */
+	pmd_populate(mm, pmd, new);
+	flush_tlb_range(vma, start, start + PMD_SIZE);
+	pte_unshare_sync(mm);
+	atomic_dec(&table->pt_share_count);
+	pte_unmap_unlock(src, ptl);
+	anon_vma_unlock_write(vma->anon_vma);
+	return 0;
+
+out:
+	pte_unmap_unlock(src, ptl);
+out_unlocked:
+	anon_vma_unlock_write(vma->anon_vma);
+	pte_free(mm, new);
+	return ret;
+}
+
+/*
+ * Copy the PTE tables shared on fork that [@start, @end) of @vma covers,
+ * while the failure can still be reported: mprotect() changes every entry
+ * of the range, munmap() and MADV_DONTNEED zap them, which must not clear
+ * a pmd under mmap_sem held for read, see zap_shared_pte_table().
+ * mmap_sem is held.
+ */
+int pte_unshare_vma(struct vm_area_struct *vma, unsigned long start,
+		    unsigned long end)
+{
+	unsigned long addr, next;
+	pmd_t *pmd;
+	int err;
+
+	if (!vma->anon_vma || !vma_is_anonymous(vma))
+		return 0;
+	for (addr = start; addr < end; addr = next) {
+		next = pmd_addr_end(addr, end);
+		pmd = mm_find_pmd(vma->vm_mm, addr);
+		if (pmd && pte_table_shared(pmd)) {
+			err = __pte_unshare(vma, pmd, addr);
+			if (err)
+				return err;
+		}
+		cond_resched();
+	}
+	return 0;
+}
+
+struct pte_unshare_work {
+	struct work_struct work;
+	struct mm_struct *mm;
+	unsigned long addr;
+};
+
+static void pte_unshare_workfn(struct work_struct *work)
+{
+	struct pte_unshare_work *uw = container_of(work,
+					struct pte_unshare_work, work);
+	struct mm_struct *mm = uw->mm;
+	struct vm_area_struct *vma;
+	pmd_t *pmd;
+
+	if (mmget_not_zero(mm)) {
+		down_read(&mm->mmap_sem);
+		vma = find_vma(mm, uw->addr);
+		if (vma && vma->vm_start <= uw->addr && vma->anon_vma) {
+			pmd = mm_find_pmd(mm, uw->addr);
+			if (pmd)
+				pte_unshare(vma, pmd, uw->addr);
+		}
+		up_read(&mm->mmap_sem);
+		mmput(mm);
+	}
+	clear_bit(MMF_PTE_UNSHARE_QUEUED, &mm->flags);
+	mmdrop(mm);
+	kfree(uw);
+}
+
+/*
+ * Reclaim and migration find the pages of a shared PTE table under the
+ * anon_vma lock, which the copy takes for write, and without mmap_sem:
+ * have the table of @addr copied for the mm of @vma from a worker, for
+ * the next attempt to succeed.  One table at a time per mm.
+ */
+void pte_unshare_async(struct vm_area_struct *vma, unsigned long addr)
+{
+	struct mm_struct *mm = vma->vm_mm;
+	struct pte_unshare_work *uw;
+
+	if (test_and_set_bit(MMF_PTE_UNSHARE_QUEUED, &mm->flags))
+		return;
+	uw = kmalloc(sizeof(*uw), GFP_ATOMIC | __GFP_NOWARN);
+	if (!uw) {
+		clear_bit(MMF_PTE_UNSHARE_QUEUED, &mm->flags);
+		return;
+	}
+	INIT_WORK(&uw->work, pte_unshare_workfn);
+	mmgrab(mm);
+	uw->mm = mm;
+	uw->addr = addr & PMD_MASK;
+	queue_work(system_unbound_wq, &uw->work);
+}
+
+/*
+ * Zap [@addr, @end) of a shared PTE table.  munmap() and MADV_DONTNEED
+ * copied the shared tables of their range with pte_unshare_vma(), where
+ * they could still fail, and fork cannot share more under their mmap_sem:
+ * only the final unmap of the mm meets a shared table, and lets go of it,
+ * as nothing else walks the tables of the mm by then.  The OOM reaper
+ * cannot free what other mms still map, it leaves the table to the final
+ * unmap.  Returns false when the table turns out not to be shared, to be
+ * zapped as usual.
+ */
+static bool zap_shared_pte_table(struct mmu_gather *tlb,
+				 struct vm_area_struct *vma, pmd_t *pmd,
+				 unsigned long addr, unsigned long end)
+{
+	struct mm_struct *mm = tlb->mm;
+	unsigned long start = addr & PMD_MASK;
+	int rss[NR_MM_COUNTERS + 1];
+	struct page *table;
+	pte_t *pte;
+	spinlock_t *ptl;
+	int i;
+
+	if (!tlb->fullmm) {
+		/* Never clear a live pmd, walkers only hold mmap_sem for read */
+		VM_WARN_ON_ONCE(!test_bit(MMF_UNSTABLE, &mm->flags));
+		return true;
+	}
+
+	anon_vma_lock_write(vma->anon_vma);
+	pte = pte_offset_map_lock(mm, pmd, start, &ptl);
+	table = pmd_page(*pmd);
+	if (!atomic_read(&table->pt_share_count)) {
+		pte_unmap_unlock(pte, ptl);
+		anon_vma_unlock_write(vma->anon_vma);
+		return false;
+	}
+	memset(rss, 0, sizeof(rss));
+	for (i = 0; i < PTRS_PER_PTE; i++)
+		rss[shared_pte_counter(pte[i])]--;
+	/* The entries stay valid for others, only this mm has to forget them */
+	pmd_clear(pmd);
+	atomic_dec(&table->pt_share_count);
+	pte_unmap_unlock(pte, ptl);
+	anon_vma_unlock_write(vma->anon_vma);
+
+	mm_dec_nr_ptes(mm);
+	add_mm_rss_vec(mm, rss);
+	return true;
+}
+#else
+static inline bool share_pte_table(struct mm_struct *dst_mm,
+				   struct mm_struct *src_mm,
+				   pmd_t *dst_pmd, pmd_t *src_pmd,
+				   struct vm_area_struct *vma,
+				   unsigned long addr, unsigned long end)
+{
+	return false;
+}
+
+static inline bool zap_shared_pte_table(struct mmu_gather *tlb,
+					struct vm_area_struct *vma, pmd_t *pmd,
+					unsigned long addr, unsigned long end)
+{
+	return false;
+}
+#endif /* CONFIG_FORK_SHARE_PTE */
+
 static inline int copy_pmd_range(struct mm_struct *dst_mm, struct mm_struct *src_mm,
 		pud_t *dst_pud, pud_t *src_pud, struct vm_area_struct *vma,
 		unsigned long addr, unsigned long end)
@@ -1150,6 +1512,9 @@ static inline int copy_pmd_range(struct mm_struct *dst_mm, struct mm_struct *src
 		}
 		if (pmd_none_or_clear_bad(src_pmd))
 			continue;
+		if (share_pte_table(dst_mm, src_mm, dst_pmd, src_pmd,
+				    vma, addr, next))
+			continue;
 		if (copy_pte_range(dst_mm, src_mm, dst_pmd, src_pmd,
 						vma, addr, next))
 			return -ENOMEM;
@@ -1437,6 +1802,9 @@ static inline unsigned long zap_pmd_range(struct mmu_gather *tlb,
 		 */
 		if (pmd_none_or_trans_huge_or_clear_bad(pmd))
 			goto next;
+		if (unlikely(pte_table_shared(pmd)) &&
+		    zap_shared_pte_table(tlb, vma, pmd, addr, next))
+			goto next;
 		next = zap_pte_range(tlb, vma, pmd, addr, next, details);
 next:
 		cond_resched();
@@ -4010,6 +4378,9 @@ static vm_fault_t handle_pte_fault(struct vm_fault *vmf)
 		/* See comment in pte_alloc_one_map() */
 		if (pmd_devmap_trans_unstable(vmf->pmd))
 			return 0;
+		/* A PTE table shared on fork is copied before any change */
+		if (unlikely(pte_unshare(vmf->vma, vmf->pmd, vmf->address)))
+			return VM_FAULT_OOM;
 		/*
 		 * A regular pmd is established and it can't morph into a huge
 		 * pmd from under us anymore at this point because we hold the
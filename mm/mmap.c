@@ -2716,6 +2716,14 @@ int do_munmap(struct mm_struct *mm, unsigned long start, size_t len,
 	if (vma->vm_start >= end)
 		return 0;
 
+	/* Copy the PTE tables shared on fork, while we can still fail */
+	for (last = vma; last && last->vm_start < end; last = last->vm_next) {
+		int error = pte_unshare_vma(last, max(start, last->vm_start),
+					    min(end, last->vm_end));
+		if (error)
+			return error;
+	}
+
 	/*
 	 * If we need to split any vma, do it now to save pain later.
 	 *
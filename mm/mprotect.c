@@ -207,6 +207,15 @@ static inline unsigned long change_pmd_range(struct vm_area_struct *vma,
 			}
 			/* fall through, the trans huge pmd just split */
 		}
+		/*
+		 * Copy a PTE table shared on fork: mprotect_fixup() did for
+		 * mprotect(), NUMA hinting can do without.
+		 */
+		if (unlikely(pte_table_shared(pmd)) &&
+		    pte_unshare(vma, pmd, addr)) {
+			VM_WARN_ON_ONCE(!prot_numa);
+			goto next;
+		}
 		this_pages = change_pte_range(vma, pmd, addr, next, newprot,
 				 dirty_accountable, prot_numa);
 		pages += this_pages;
@@ -372,6 +381,11 @@ mprotect_fixup(struct vm_area_struct *vma, struct vm_area_struct **pprev,
 			return error;
 	}
 
+	/* Entries of tables shared on fork change, copy them while we can fail */
+	error = pte_unshare_vma(vma, start, end);
+	if (error)
+		return error;
+
 	/*
 	 * If we make a private mapping writable we increase our commit;
 	 * but (without finer accounting) cannot reduce our commit if we
@@ -240,6 +240,8 @@ unsigned long move_page_tables(struct vm_area_struct *vma,
 		}
 		if (pte_alloc(new_vma->vm_mm, new_pmd, new_addr))
 			break;
+		if (pte_unshare(vma, old_pmd, old_addr))
+			break;
 		next = (new_addr + PMD_SIZE) & PMD_MASK;
 		if (extent > next - new_addr)
 			extent = next - new_addr;
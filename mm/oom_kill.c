@@ -488,6 +488,11 @@ static DECLARE_WAIT_QUEUE_HEAD(oom_reaper_wait);
 static struct task_struct *oom_reaper_list;
 static DEFINE_SPINLOCK(oom_reaper_lock);
 
+bool current_is_oom_reaper(void)
+{
+	return current == oom_reaper_th;
+}
+
 bool __oom_reap_task_mm(struct mm_struct *mm)
 {
 	struct vm_area_struct *vma;
@@ -15,7 +15,12 @@ static inline bool not_found(struct page_vma_mapped_walk *pvmw)
 
 static bool map_pte(struct page_vma_mapped_walk *pvmw)
 {
-	pvmw->pte = pte_offset_map(pvmw->pmd, pvmw->address);
+	pmd_t pmde;
+
+again:
+	/* A PTE table shared on fork is replaced when unshared */
+	pmde = READ_ONCE(*pvmw->pmd);
+	pvmw->pte = pte_offset_map(&pmde, pvmw->address);
 	if (!(pvmw->flags & PVMW_SYNC)) {
 		if (pvmw->flags & PVMW_MIGRATION) {
 			if (!is_swap_pte(*pvmw->pte))
@@ -47,8 +52,14 @@ static bool map_pte(struct page_vma_mapped_walk *pvmw)
 				return false;
 		}
 	}
-	pvmw->ptl = pte_lockptr(pvmw->vma->vm_mm, pvmw->pmd);
+	pvmw->ptl = pte_lockptr(pvmw->vma->vm_mm, &pmde);
 	spin_lock(pvmw->ptl);
+	if (unlikely(pmd_val(pmde) != pmd_val(READ_ONCE(*pvmw->pmd)))) {
+		spin_unlock(pvmw->ptl);
+		pvmw->ptl = NULL;
+		pte_unmap(pvmw->pte);
+		goto again;
+	}
 	return true;
 }
 
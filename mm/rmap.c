@@ -1416,6 +1416,14 @@ static bool try_to_unmap_one(struct page *page, struct vm_area_struct *vma,
 		/* Unexpected PMD-mapped THP? */
 		VM_BUG_ON_PAGE(!pvmw.pte, page);
 
+		/* Other mms map the page through a PTE table shared on fork */
+		if (pte_table_shared(pvmw.pmd)) {
+			pte_unshare_async(vma, pvmw.address);
+			ret = false;
+			page_vma_mapped_walk_done(&pvmw);
+			break;
+		}
+
 		subpage = page - page_to_pfn(page) + pte_pfn(*pvmw.pte);
 		address = pvmw.address;
 
@@ -555,6 +555,11 @@ retry:
 		BUG_ON(pmd_none(*dst_pmd));
 		BUG_ON(pmd_trans_huge(*dst_pmd));
 
+		if (unlikely(pte_unshare(dst_vma, dst_pmd, dst_addr))) {
+			err = -ENOMEM;
+			break;
+		}
+
 		err = mfill_atomic_pte(dst_mm, dst_pmd, dst_vma, dst_addr,
 				       src_addr, &page, zeropage);
 		cond_resched();
@@ -36,6 +36,29 @@ static const struct rhashtable_params br_fdb_rht_params = {
 	.locks_mul = 1,
 };
 
+/* Addresses not yet in the FDB are learnt right away when hash_lock is
+ * free. Under contention they are queued per cpu and learnt in batches,
+ * so that a learning storm does not serialise all cpus on hash_lock. The
+ * port is referenced by ifindex as it may go away before the batch is
+ * processed.
+ */
+#define BR_FDB_LEARN_BATCH	32
+
+struct br_fdb_learn_entry {
+	unsigned char	addr[ETH_ALEN];
+	u16		vid;
+	int		ifindex;
+};
+
+struct br_fdb_learn_queue {
+	spinlock_t			lock;
+	unsigned int			count;
+	struct br_fdb_learn_entry	entries[BR_FDB_LEARN_BATCH];
+};
+
+/* entries aged out before hash_lock is released */
+#define BR_FDB_GC_BATCH		64
+
 static struct kmem_cache *br_fdb_cache __read_mostly;
 static int fdb_insert(struct net_bridge *br, struct net_bridge_port *source,
 		      const unsigned char *addr, u16 vid);
@@ -61,12 +84,43 @@ void br_fdb_fini(void)
 
 int br_fdb_hash_init(struct net_bridge *br)
 {
-	return rhashtable_init(&br->fdb_hash_tbl, &br_fdb_rht_params);
+	int err, cpu;
+
+	br->fdb_wheel = kvcalloc(BR_FDB_WHEEL_SLOTS, sizeof(*br->fdb_wheel),
+				 GFP_KERNEL);
+	if (!br->fdb_wheel)
+		return -ENOMEM;
+	br->fdb_wheel_next = jiffies & ~(BR_FDB_WHEEL_GRAN - 1);
+	br->fdb_wheel_hold = br->ageing_time;
+
+	br->fdb_learn_queue = alloc_percpu(struct br_fdb_learn_queue);
+	if (!br->fdb_learn_queue) {
+		err = -ENOMEM;
+		goto err_wheel;
+	}
+	for_each_possible_cpu(cpu)
+		spin_lock_init(&per_cpu_ptr(br->fdb_learn_queue, cpu)->lock);
+
+	err = rhashtable_init(&br->fdb_hash_tbl, &br_fdb_rht_params);
+	if (err)
+		goto err_queue;
+
+	return 0;
+
+err_queue:
+	free_percpu(br->fdb_learn_queue);
+err_wheel:
+	kvfree(br->fdb_wheel);
+	return err;
 }
 
 void br_fdb_hash_fini(struct net_bridge *br)
 {
+	/* ports are gone, nothing can queue new addresses anymore */
+	cancel_work_sync(&br->fdb_learn_work);
+	free_percpu(br->fdb_learn_queue);
 	rhashtable_destroy(&br->fdb_hash_tbl);
+	kvfree(br->fdb_wheel);
 }
 
 /* if topology_changing then use forward_delay (default 15 sec)
@@ -81,7 +135,52 @@ static inline int has_expired(const struct net_bridge *br,
 				  const struct net_bridge_fdb_entry *fdb)
 {
 	return !fdb->is_static && !fdb->added_by_external_learn &&
-		time_before_eq(fdb->updated + hold_time(br), jiffies);
+		time_before_eq(READ_ONCE(fdb->updated) + hold_time(br), jiffies);
+}
+
+/* Static and externally learnt entries never expire, they are kept in the
+ * last slot of the wheel.
+ */
+static unsigned long fdb_wheel_expires(const struct net_bridge *br,
+				       const struct net_bridge_fdb_entry *f,
+				       unsigned long hold)
+{
+	if (f->is_static || f->added_by_external_learn)
+		return br->fdb_wheel_next +
+		       BR_FDB_WHEEL_SLOTS * BR_FDB_WHEEL_GRAN;
+	return READ_ONCE(f->updated) + hold;
+}
+
+/* requires bridge hash_lock */
+static void fdb_wheel_add(struct net_bridge *br,
+			  struct net_bridge_fdb_entry *f,
+			  unsigned long expires)
+{
+	unsigned long last = br->fdb_wheel_next +
+			     (BR_FDB_WHEEL_SLOTS - 1) * BR_FDB_WHEEL_GRAN;
+	unsigned int idx;
+
+	/* entries beyond the wheel horizon are moved on when their slot
+	 * elapses, expired ones go to the next slot to be aged out
+	 */
+	if (time_before(expires, br->fdb_wheel_next))
+		expires = br->fdb_wheel_next;
+	else if (time_after(expires, last))
+		expires = last;
+
+	idx = (expires >> BR_FDB_WHEEL_GRAN_LOG) & BR_FDB_WHEEL_MASK;
+	hlist_add_head(&f->wheel_node, &br->fdb_wheel[idx]);
+	__set_bit(idx, br->fdb_wheel_map);
+}
+
+/* requires bridge hash_lock, called when is_static or
+ * added_by_external_learn changed, as the entry's slot depends on them
+ */
+static void fdb_wheel_requeue(struct net_bridge *br,
+			      struct net_bridge_fdb_entry *f)
+{
+	hlist_del_init(&f->wheel_node);
+	fdb_wheel_add(br, f, fdb_wheel_expires(br, f, hold_time(br)));
 }
 
 static void fdb_rcu_free(struct rcu_head *head)
@@ -206,6 +305,7 @@ static void fdb_delete(struct net_bridge *br, struct net_bridge_fdb_entry *f,
 		fdb_del_hw_addr(br, f->key.addr.addr);
 
 	hlist_del_init_rcu(&f->fdb_node);
+	hlist_del_init(&f->wheel_node);
 	rhashtable_remove_fast(&br->fdb_hash_tbl, &f->rhnode,
 			       br_fdb_rht_params);
 	fdb_notify(br, f, RTM_DELNEIGH, swdev_notify);
@@ -334,36 +434,103 @@ out:
 	spin_unlock_bh(&br->hash_lock);
 }
 
+/* Re-bucket all entries after the hold time got shorter (topology change
+ * or ageing time update).
+ */
+static void fdb_wheel_rebuild(struct net_bridge *br, unsigned long hold)
+{
+	struct net_bridge_fdb_entry *f;
+
+	bitmap_zero(br->fdb_wheel_map, BR_FDB_WHEEL_SLOTS);
+	hlist_for_each_entry(f, &br->fdb_list, fdb_node) {
+		hlist_del_init(&f->wheel_node);
+		fdb_wheel_add(br, f, fdb_wheel_expires(br, f, hold));
+	}
+}
+
+/* Age out the entries of an elapsed slot and move those refreshed since
+ * they were bucketed to the slot of their new expiry. hash_lock is
+ * dropped every BR_FDB_GC_BATCH entries so that learning is not stalled
+ * by a large slot.
+ */
+static void fdb_wheel_expire_slot(struct net_bridge *br, unsigned int idx,
+				  unsigned long hold)
+{
+	struct hlist_head *head = &br->fdb_wheel[idx];
+	unsigned int n = 0;
+
+	while (!hlist_empty(head)) {
+		struct net_bridge_fdb_entry *f;
+		unsigned long expires;
+
+		f = hlist_entry(head->first, struct net_bridge_fdb_entry,
+				wheel_node);
+		hlist_del_init(&f->wheel_node);
+
+		expires = fdb_wheel_expires(br, f, hold);
+		if (time_after(expires, jiffies))
+			fdb_wheel_add(br, f, expires);
+		else
+			fdb_delete(br, f, true);
+
+		if (++n % BR_FDB_GC_BATCH == 0) {
+			spin_unlock_bh(&br->hash_lock);
+			cond_resched();
+			spin_lock_bh(&br->hash_lock);
+		}
+	}
+	__clear_bit(idx, br->fdb_wheel_map);
+}
+
 void br_fdb_cleanup(struct work_struct *work)
 {
 	struct net_bridge *br = container_of(work, struct net_bridge,
 					     gc_work.work);
-	struct net_bridge_fdb_entry *f = NULL;
 	unsigned long delay = hold_time(br);
 	unsigned long work_delay = delay;
 	unsigned long now = jiffies;
+	unsigned int idx, slot, n = 0;
 
-	/* this part is tricky, in order to avoid blocking learning and
-	 * consequently forwarding, we rely on rcu to delete objects with
-	 * delayed freeing allowing us to continue traversing
+	/* Instead of walking the whole table, only the slots of the ageing
+	 * wheel which elapsed since the last run are visited. Refreshing an
+	 * entry does not move it, it is moved on lazily when its old slot
+	 * elapses.
 	 */
-	rcu_read_lock();
-	hlist_for_each_entry_rcu(f, &br->fdb_list, fdb_node) {
-		unsigned long this_timer;
-
-		if (f->is_static || f->added_by_external_learn)
-			continue;
-		this_timer = f->updated + delay;
-		if (time_after(this_timer, now)) {
-			work_delay = min(work_delay, this_timer - now);
-		} else {
-			spin_lock_bh(&br->hash_lock);
-			if (!hlist_unhashed(&f->fdb_node))
-				fdb_delete(br, f, true);
-			spin_unlock_bh(&br->hash_lock);
+	spin_lock_bh(&br->hash_lock);
+	if (delay < br->fdb_wheel_hold)
+		fdb_wheel_rebuild(br, delay);
+	br->fdb_wheel_hold = delay;
+
+	while (time_after_eq(now, br->fdb_wheel_next + BR_FDB_WHEEL_GRAN)) {
+		idx = (br->fdb_wheel_next >> BR_FDB_WHEEL_GRAN_LOG) &
+		      BR_FDB_WHEEL_MASK;
+		if (test_bit(idx, br->fdb_wheel_map))
+			fdb_wheel_expire_slot(br, idx, delay);
+		br->fdb_wheel_next += BR_FDB_WHEEL_GRAN;
+
+		/* every slot was visited, catch up after a long stall */
+		if (++n == BR_FDB_WHEEL_SLOTS) {
+			br->fdb_wheel_next = now & ~(BR_FDB_WHEEL_GRAN - 1);
+			break;
 		}
 	}
-	rcu_read_unlock();
+
+	/* run again when the next non empty slot elapses */
+	idx = (br->fdb_wheel_next >> BR_FDB_WHEEL_GRAN_LOG) & BR_FDB_WHEEL_MASK;
+	slot = find_next_bit(br->fdb_wheel_map, BR_FDB_WHEEL_SLOTS, idx);
+	if (slot >= BR_FDB_WHEEL_SLOTS)
+		slot = find_first_bit(br->fdb_wheel_map, BR_FDB_WHEEL_SLOTS);
+	if (slot < BR_FDB_WHEEL_SLOTS) {
+		unsigned long expires = br->fdb_wheel_next +
+			(((slot - idx) & BR_FDB_WHEEL_MASK) + 1) *
+			BR_FDB_WHEEL_GRAN;
+
+		if (time_after(expires, now))
+			work_delay = min(work_delay, expires - now);
+		else
+			work_delay = 0;
+	}
+	spin_unlock_bh(&br->hash_lock);
 
 	/* Cleanup minimum 10 milliseconds apart */
 	work_delay = max_t(unsigned long, work_delay, msecs_to_jiffies(10));
@@ -512,6 +679,9 @@ static struct net_bridge_fdb_entry *fdb_create(struct net_bridge *br,
 			fdb = NULL;
 		} else {
 			hlist_add_head_rcu(&fdb->fdb_node, &br->fdb_list);
+			fdb_wheel_add(br, fdb,
+				      fdb_wheel_expires(br, fdb,
+							hold_time(br)));
 		}
 	}
 	return fdb;
@@ -558,11 +728,166 @@ int br_fdb_insert(struct net_bridge *br, struct net_bridge_port *source,
 	return ret;
 }
 
+/* Refresh an existing entry, without hash_lock */
+static void fdb_refresh(struct net_bridge *br, struct net_bridge_fdb_entry *fdb,
+			struct net_bridge_port *source,
+			const unsigned char *addr, u16 vid, bool added_by_user)
+{
+	unsigned long now = jiffies;
+	bool fdb_modified = false;
+
+	/* attempt to update an entry for a local interface */
+	if (unlikely(fdb->is_local)) {
+		if (net_ratelimit())
+			br_warn(br, "received packet on %s with own address as source address (addr:%pM, vlan:%u)\n",
+				source->dev->name, addr, vid);
+		return;
+	}
+
+	/* fastpath: update of existing entry, the ageing wheel picks up
+	 * the new timestamp when the entry's old slot elapses. Taking over
+	 * a HW learned entry is left to fdb_learn(), which holds hash_lock.
+	 */
+	if (unlikely(source != fdb->dst)) {
+		fdb->dst = source;
+		fdb_modified = true;
+	}
+	if (now != READ_ONCE(fdb->updated))
+		WRITE_ONCE(fdb->updated, now);
+	if (unlikely(added_by_user))
+		fdb->added_by_user = 1;
+	if (unlikely(fdb_modified)) {
+		trace_br_fdb_update(br, source, addr, vid, added_by_user);
+		fdb_notify(br, fdb, RTM_NEWNEIGH, true);
+	}
+}
+
+/* requires bridge hash_lock */
+static void fdb_learn(struct net_bridge *br, struct net_bridge_port *source,
+		      const unsigned char *addr, u16 vid, bool added_by_user)
+{
+	struct net_bridge_fdb_entry *fdb;
+
+	/* learnt meanwhile by another cpu or an earlier batch */
+	fdb = br_fdb_find(br, addr, vid);
+	if (fdb) {
+		bool takeover = fdb->added_by_external_learn &&
+				!fdb->is_local && source != fdb->dst;
+
+		/* Take over HW learned entry, it ages from now on */
+		if (unlikely(takeover))
+			fdb->added_by_external_learn = 0;
+		fdb_refresh(br, fdb, source, addr, vid, added_by_user);
+		if (unlikely(takeover))
+			fdb_wheel_requeue(br, fdb);
+		return;
+	}
+
+	fdb = fdb_create(br, source, addr, vid, 0, 0);
+	if (fdb) {
+		if (unlikely(added_by_user))
+			fdb->added_by_user = 1;
+		trace_br_fdb_update(br, source, addr, vid, added_by_user);
+		fdb_notify(br, fdb, RTM_NEWNEIGH, true);
+	}
+}
+
+static void fdb_learn_batch(struct net_bridge *br,
+			    const struct br_fdb_learn_entry *entries,
+			    unsigned int count)
+{
+	struct net *net = dev_net(br->dev);
+	unsigned int i;
+
+	rcu_read_lock();
+	spin_lock_bh(&br->hash_lock);
+	for (i = 0; i < count; i++) {
+		const struct br_fdb_learn_entry *e = &entries[i];
+		struct net_bridge_port *p;
+		struct net_device *dev;
+
+		/* the port may have been removed or stopped learning */
+		dev = dev_get_by_index_rcu(net, e->ifindex);
+		p = dev ? br_port_get_check_rcu(dev) : NULL;
+		if (!p || p->br != br || !(p->flags & BR_LEARNING) ||
+		    !(p->state == BR_STATE_LEARNING ||
+		      p->state == BR_STATE_FORWARDING))
+			continue;
+
+		fdb_learn(br, p, e->addr, e->vid, false);
+	}
+	spin_unlock_bh(&br->hash_lock);
+	rcu_read_unlock();
+}
+
+/* Learn the addresses queued on all cpus */
+void br_fdb_learn_flush(struct work_struct *work)
+{
+	struct net_bridge *br = container_of(work, struct net_bridge,
+					     fdb_learn_work);
+	struct br_fdb_learn_entry entries[BR_FDB_LEARN_BATCH];
+	int cpu;
+
+	for_each_possible_cpu(cpu) {
+		struct br_fdb_learn_queue *q;
+		unsigned int count;
+
+		q = per_cpu_ptr(br->fdb_learn_queue, cpu);
+		if (!READ_ONCE(q->count))
+			continue;
+
+		spin_lock_bh(&q->lock);
+		count = q->count;
+		memcpy(entries, q->entries, count * sizeof(entries[0]));
+		q->count = 0;
+		spin_unlock_bh(&q->lock);
+
+		fdb_learn_batch(br, entries, count);
+		cond_resched();
+	}
+}
+
+/* called in softirq context */
+static void fdb_learn_queue(struct net_bridge *br,
+			    struct net_bridge_port *source,
+			    const unsigned char *addr, u16 vid)
+{
+	struct br_fdb_learn_queue *q = this_cpu_ptr(br->fdb_learn_queue);
+	int ifindex = source->dev->ifindex;
+	struct br_fdb_learn_entry *e;
+	unsigned int i;
+
+	spin_lock(&q->lock);
+	/* a new station usually sends a train of frames before it is learnt */
+	for (i = 0; i < q->count; i++) {
+		e = &q->entries[i];
+		if (e->vid == vid && e->ifindex == ifindex &&
+		    ether_addr_equal(e->addr, addr))
+			goto out;
+	}
+
+	/* the queue is full, learn its content from here; hash_lock nests
+	 * inside the queue lock, it is never taken the other way around
+	 */
+	if (q->count == BR_FDB_LEARN_BATCH) {
+		fdb_learn_batch(br, q->entries, q->count);
+		q->count = 0;
+	}
+
+	e = &q->entries[q->count++];
+	ether_addr_copy(e->addr, addr);
+	e->vid = vid;
+	e->ifindex = ifindex;
+	if (q->count == 1)
+		schedule_work(&br->fdb_learn_work);
+out:
+	spin_unlock(&q->lock);
+}
+
 void br_fdb_update(struct net_bridge *br, struct net_bridge_port *source,
 		   const unsigned char *addr, u16 vid, bool added_by_user)
 {
 	struct net_bridge_fdb_entry *fdb;
-	bool fdb_modified = false;
 
 	/* some users want to always flood. */
 	if (hold_time(br) == 0)
@@ -574,46 +899,24 @@ void br_fdb_update(struct net_bridge *br, struct net_bridge_port *source,
 		return;
 
 	fdb = fdb_find_rcu(&br->fdb_hash_tbl, addr, vid);
-	if (likely(fdb)) {
-		/* attempt to update an entry for a local interface */
-		if (unlikely(fdb->is_local)) {
-			if (net_ratelimit())
-				br_warn(br, "received packet on %s with own address as source address (addr:%pM, vlan:%u)\n",
-					source->dev->name, addr, vid);
-		} else {
-			unsigned long now = jiffies;
-
-			/* fastpath: update of existing entry */
-			if (unlikely(source != fdb->dst)) {
-				fdb->dst = source;
-				fdb_modified = true;
-				/* Take over HW learned entry */
-				if (unlikely(fdb->added_by_external_learn))
-					fdb->added_by_external_learn = 0;
-			}
-			if (now != fdb->updated)
-				fdb->updated = now;
-			if (unlikely(added_by_user))
-				fdb->added_by_user = 1;
-			if (unlikely(fdb_modified)) {
-				trace_br_fdb_update(br, source, addr, vid, added_by_user);
-				fdb_notify(br, fdb, RTM_NEWNEIGH, true);
-			}
-		}
-	} else {
+	if (likely(fdb) &&
+	    likely(!fdb->added_by_external_learn || source == fdb->dst)) {
+		fdb_refresh(br, fdb, source, addr, vid, added_by_user);
+	} else if (unlikely(added_by_user) || fdb) {
+		/* entries added from user space, and takeovers of HW
+		 * learned entries, are learnt right away
+		 */
 		spin_lock(&br->hash_lock);
-		fdb = fdb_create(br, source, addr, vid, 0, 0);
-		if (fdb) {
-			if (unlikely(added_by_user))
-				fdb->added_by_user = 1;
-			trace_br_fdb_update(br, source, addr, vid,
-					    added_by_user);
-			fdb_notify(br, fdb, RTM_NEWNEIGH, true);
-		}
-		/* else  we lose race and someone else inserts
-		 * it first, don't bother updating
+		fdb_learn(br, source, addr, vid, added_by_user);
+		spin_unlock(&br->hash_lock);
+	} else if (spin_trylock(&br->hash_lock)) {
+		/* learn synchronously unless other cpus are learning too,
+		 * so that frames to the new station are not flooded
 		 */
+		fdb_learn(br, source, addr, vid, false);
 		spin_unlock(&br->hash_lock);
+	} else {
+		fdb_learn_queue(br, source, addr, vid);
 	}
 }
 
@@ -776,6 +1079,7 @@ static int fdb_add_entry(struct net_bridge *br, struct net_bridge_port *source,
 {
 	struct net_bridge_fdb_entry *fdb;
 	bool modified = false;
+	bool requeue = false;
 
 	/* If the port cannot learn allow only local and static entries */
 	if (source && !(state & NUD_PERMANENT) && !(state & NUD_NOARP) &&
@@ -815,18 +1119,21 @@ static int fdb_add_entry(struct net_bridge *br, struct net_bridge_port *source,
 			if (!fdb->is_static) {
 				fdb->is_static = 1;
 				fdb_add_hw_addr(br, addr);
+				requeue = true;
 			}
 		} else if (state & NUD_NOARP) {
 			fdb->is_local = 0;
 			if (!fdb->is_static) {
 				fdb->is_static = 1;
 				fdb_add_hw_addr(br, addr);
+				requeue = true;
 			}
 		} else {
 			fdb->is_local = 0;
 			if (fdb->is_static) {
 				fdb->is_static = 0;
 				fdb_del_hw_addr(br, addr);
+				requeue = true;
 			}
 		}
 
@@ -839,6 +1146,8 @@ static int fdb_add_entry(struct net_bridge *br, struct net_bridge_port *source,
 		fdb->updated = jiffies;
 		fdb_notify(br, fdb, RTM_NEWNEIGH, true);
 	}
+	if (requeue)
+		fdb_wheel_requeue(br, fdb);
 
 	return 0;
 }
@@ -1091,6 +1400,7 @@ int br_fdb_external_learn_add(struct net_bridge *br, struct net_bridge_port *p,
 		if (swdev_notify)
 			fdb->added_by_user = 1;
 		fdb->added_by_external_learn = 1;
+		fdb_wheel_requeue(br, fdb);
 		fdb_notify(br, fdb, RTM_NEWNEIGH, swdev_notify);
 	} else {
 		fdb->updated = jiffies;
@@ -1106,6 +1416,7 @@ int br_fdb_external_learn_add(struct net_bridge *br, struct net_bridge_port *p,
 		} else if (!fdb->added_by_user) {
 			/* Take over SW learned entry */
 			fdb->added_by_external_learn = 1;
+			fdb_wheel_requeue(br, fdb);
 			modified = true;
 		}
 
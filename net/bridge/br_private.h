@@ -179,6 +179,7 @@ struct net_bridge_fdb_entry {
 
 	struct net_bridge_fdb_key	key;
 	struct hlist_node		fdb_node;
+	struct hlist_node		wheel_node;
 	unsigned char			is_local:1,
 					is_static:1,
 					added_by_user:1,
@@ -192,6 +193,16 @@ struct net_bridge_fdb_entry {
 	struct rcu_head			rcu;
 };
 
+/* FDB ageing wheel: 1024 slots of 32 jiffies, entries are bucketed by
+ * expiry and lazily moved on when their slot elapses.
+ */
+#define BR_FDB_WHEEL_GRAN_LOG	5
+#define BR_FDB_WHEEL_GRAN	(1UL << BR_FDB_WHEEL_GRAN_LOG)
+#define BR_FDB_WHEEL_SLOTS	1024
+#define BR_FDB_WHEEL_MASK	(BR_FDB_WHEEL_SLOTS - 1)
+
+struct br_fdb_learn_queue;
+
 #define MDB_PG_FLAGS_PERMANENT	BIT(0)
 #define MDB_PG_FLAGS_OFFLOAD	BIT(1)
 
@@ -416,6 +427,16 @@ struct net_bridge {
 	bool				neigh_suppress_enabled;
 	bool				mtu_set_by_user;
 	struct hlist_head		fdb_list;
+
+	/* batched learning of new addresses */
+	struct br_fdb_learn_queue __percpu *fdb_learn_queue;
+	struct work_struct		fdb_learn_work;
+
+	/* incremental ageing, protected by hash_lock */
+	struct hlist_head		*fdb_wheel;
+	unsigned long			fdb_wheel_next;
+	unsigned long			fdb_wheel_hold;
+	DECLARE_BITMAP(fdb_wheel_map, BR_FDB_WHEEL_SLOTS);
 };
 
 struct br_input_skb_cb {
@@ -536,6 +557,7 @@ void br_fdb_find_delete_local(struct net_bridge *br,
 void br_fdb_changeaddr(struct net_bridge_port *p, const unsigned char *newaddr);
 void br_fdb_change_mac_address(struct net_bridge *br, const u8 *newaddr);
 void br_fdb_cleanup(struct work_struct *work);
+void br_fdb_learn_flush(struct work_struct *work);
 void br_fdb_delete_by_port(struct net_bridge *br,
 			   const struct net_bridge_port *p, u16 vid, int do_all);
 struct net_bridge_fdb_entry *br_fdb_find_rcu(struct net_bridge *br,
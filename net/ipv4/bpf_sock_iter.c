@@ -0,0 +1,419 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * BPF iterators over TCP and UDP sockets
+ *
+ * /proc/net/tcp formats every socket under the lock of its hash bucket and
+ * has to find its place again, walking the chains from the start of the
+ * bucket, whenever the read buffer fills up. These iterators instead take
+ * a reference on all sockets of a bucket in one go under its lock, and
+ * run the program on the batch without holding any lock.
+ */
+#include <linux/bpf.h>
+#include <linux/init.h>
+#include <linux/nsproxy.h>
+#include <linux/seq_file.h>
+#include <linux/slab.h>
+#include <linux/sock_diag.h>
+#include <net/inet_hashtables.h>
+#include <net/inet_timewait_sock.h>
+#include <net/net_namespace.h>
+#include <net/request_sock.h>
+#include <net/sock.h>
+#include <net/tcp.h>
+#include <net/udp.h>
+
+#define BPF_SOCK_ITER_BATCH	16
+
+struct bpf_sock_iter_priv;
+
+struct bpf_sock_iter_table {
+	/* Store references to up to priv->size sockets of @bucket in
+	 * priv->batch, from the priv->offset-th on, return the number of
+	 * sockets in the bucket.
+	 */
+	u32 (*fill)(struct bpf_sock_iter_priv *priv, u32 bucket);
+	void (*show)(struct bpf_iter_sock *ctx, struct sock *sk,
+		     struct seq_file *seq);
+};
+
+struct bpf_sock_iter_priv {
+	const struct bpf_sock_iter_table *table;
+	struct net *net;
+	u32 nr_buckets;
+	/* cursor, the bucket and the number of its sockets already shown */
+	u32 bucket;
+	u32 offset;
+	/* sockets batch[pos] to batch[nr - 1] are held and not shown yet */
+	u32 pos;
+	u32 nr;
+	u32 size;
+	/* the batch ends with the last socket of the bucket */
+	bool bucket_done;
+	struct sock **batch;
+};
+
+static void bpf_sock_iter_release(struct bpf_sock_iter_priv *priv)
+{
+	while (priv->pos < priv->nr)
+		sock_gen_put(priv->batch[priv->pos++]);
+	priv->pos = priv->nr = 0;
+}
+
+static int bpf_sock_iter_grow(struct bpf_sock_iter_priv *priv, u32 size)
+{
+	struct sock **batch;
+
+	batch = kvmalloc_array(size, sizeof(*batch), GFP_USER | __GFP_NOWARN);
+	if (!batch)
+		return -ENOMEM;
+
+	kvfree(priv->batch);
+	priv->batch = batch;
+	priv->size = size;
+	return 0;
+}
+
+/* Whether ->fill stores the @n-th socket of the bucket in the batch */
+static bool bpf_sock_iter_want(const struct bpf_sock_iter_priv *priv, u32 n)
+{
+	return n >= priv->offset && n - priv->offset < priv->size;
+}
+
+/* Take references on the sockets of the current bucket not shown yet */
+static bool bpf_sock_iter_fill(struct bpf_sock_iter_priv *priv)
+{
+	bool resized = false;
+	u32 n, left;
+
+again:
+	n = priv->table->fill(priv, priv->bucket);
+	left = n > priv->offset ? n - priv->offset : 0;
+	priv->pos = 0;
+	priv->nr = min(left, priv->size);
+
+	/* If a larger batch cannot be had, show the sockets that fit and
+	 * come back to the bucket for the others
+	 */
+	if (left > priv->size && !resized) {
+		bpf_sock_iter_release(priv);
+		bpf_sock_iter_grow(priv, left * 3 / 2);
+		resized = true;
+		goto again;
+	}
+	priv->bucket_done = left <= priv->size;
+
+	return priv->nr > 0;
+}
+
+static struct sock *bpf_sock_iter_get_next(struct bpf_sock_iter_priv *priv)
+{
+	if (priv->pos < priv->nr)
+		return priv->batch[priv->pos];
+
+	for (; priv->bucket < priv->nr_buckets; priv->bucket++) {
+		if (bpf_sock_iter_fill(priv))
+			return priv->batch[priv->pos];
+		priv->offset = 0;
+	}
+
+	return NULL;
+}
+
+static void *bpf_sock_seq_start(struct seq_file *seq, loff_t *pos)
+{
+	struct bpf_sock_iter_priv *priv = bpf_iter_priv(seq);
+
+	if (!*pos) {
+		bpf_sock_iter_release(priv);
+		priv->bucket = 0;
+		priv->offset = 0;
+	}
+
+	return bpf_sock_iter_get_next(priv);
+}
+
+static void *bpf_sock_seq_next(struct seq_file *seq, void *v, loff_t *pos)
+{
+	struct bpf_sock_iter_priv *priv = bpf_iter_priv(seq);
+
+	sock_gen_put(v);
+	++*pos;
+	priv->offset++;
+
+	if (++priv->pos >= priv->nr) {
+		priv->pos = priv->nr = 0;
+		if (priv->bucket_done) {
+			priv->bucket++;
+			priv->offset = 0;
+		}
+	}
+
+	return bpf_sock_iter_get_next(priv);
+}
+
+/* Do not keep sockets pinned while the reader is away, the next read()
+ * takes the batch again and skips what was already shown.
+ */
+static void bpf_sock_seq_stop(struct seq_file *seq, void *v)
+{
+	struct bpf_sock_iter_priv *priv = bpf_iter_priv(seq);
+
+	if (v)
+		bpf_sock_iter_release(priv);
+}
+
+static int bpf_sock_seq_show(struct seq_file *seq, void *v)
+{
+	struct bpf_sock_iter_priv *priv = bpf_iter_priv(seq);
+	struct bpf_iter_sock *ctx = bpf_iter_ctx(seq);
+	struct sock *sk = v;
+
+	memset((void *)ctx + sizeof(ctx->meta), 0,
+	       sizeof(*ctx) - sizeof(ctx->meta));
+
+	/* Addresses and ports live in sock_common, shared by full, request
+	 * and timewait sockets.
+	 */
+	ctx->family = sk->sk_family;
+	ctx->src_port = sk->sk_num;
+	ctx->dst_port = ntohs(sk->sk_dport);
+	if (sk->sk_family == AF_INET) {
+		ctx->src_ip4 = sk->sk_rcv_saddr;
+		ctx->dst_ip4 = sk->sk_daddr;
+#if IS_ENABLED(CONFIG_IPV6)
+	} else if (sk->sk_family == AF_INET6) {
+		memcpy(ctx->src_ip6, &sk->sk_v6_rcv_saddr,
+		       sizeof(ctx->src_ip6));
+		memcpy(ctx->dst_ip6, &sk->sk_v6_daddr, sizeof(ctx->dst_ip6));
+#endif
+	}
+	ctx->cookie = sock_gen_cookie(sk);
+
+	priv->table->show(ctx, sk, seq);
+
+	return 0;
+}
+
+static const struct seq_operations bpf_sock_seq_ops = {
+	.start	= bpf_sock_seq_start,
+	.next	= bpf_sock_seq_next,
+	.stop	= bpf_sock_seq_stop,
+	.show	= bpf_sock_seq_show,
+};
+
+static int bpf_sock_iter_init(struct bpf_sock_iter_priv *priv,
+			      const struct bpf_sock_iter_table *table,
+			      u32 nr_buckets)
+{
+	priv->table = table;
+	priv->nr_buckets = nr_buckets;
+	if (bpf_sock_iter_grow(priv, BPF_SOCK_ITER_BATCH))
+		return -ENOMEM;
+	priv->net = get_net(current->nsproxy->net_ns);
+
+	return 0;
+}
+
+static void bpf_sock_iter_fini(void *priv)
+{
+	struct bpf_sock_iter_priv *p = priv;
+
+	bpf_sock_iter_release(p);
+	put_net(p->net);
+	kvfree(p->batch);
+}
+
+static u32 tcp_iter_fill(struct bpf_sock_iter_priv *priv, u32 bucket)
+{
+	struct inet_hashinfo *hinfo = &tcp_hashinfo;
+	struct hlist_nulls_node *node;
+	u32 n = 0;
+	struct sock *sk;
+
+	if (bucket < INET_LHTABLE_SIZE) {
+		struct inet_listen_hashbucket *ilb;
+
+		ilb = &hinfo->listening_hash[bucket];
+		spin_lock(&ilb->lock);
+		sk_for_each(sk, &ilb->head) {
+			if (!net_eq(sock_net(sk), priv->net))
+				continue;
+			if (bpf_sock_iter_want(priv, n)) {
+				sock_hold(sk);
+				priv->batch[n - priv->offset] = sk;
+			}
+			n++;
+		}
+		spin_unlock(&ilb->lock);
+		return n;
+	}
+
+	bucket -= INET_LHTABLE_SIZE;
+	/* Lockless fast path for the common case of empty buckets */
+	if (hlist_nulls_empty(&hinfo->ehash[bucket].chain))
+		return 0;
+
+	spin_lock_bh(inet_ehash_lockp(hinfo, bucket));
+	sk_nulls_for_each(sk, node, &hinfo->ehash[bucket].chain) {
+		if (!net_eq(sock_net(sk), priv->net))
+			continue;
+		if (bpf_sock_iter_want(priv, n)) {
+			if (!refcount_inc_not_zero(&sk->sk_refcnt))
+				continue;
+			priv->batch[n - priv->offset] = sk;
+		}
+		n++;
+	}
+	spin_unlock_bh(inet_ehash_lockp(hinfo, bucket));
+
+	return n;
+}
+
+/* Same fields as /proc/net/tcp */
+static void tcp_iter_show(struct bpf_iter_sock *ctx, struct sock *sk,
+			  struct seq_file *seq)
+{
+	struct user_namespace *user_ns = seq_user_ns(seq);
+	const struct inet_connection_sock *icsk;
+	const struct tcp_sock *tp;
+	unsigned long expires;
+
+	if (sk->sk_state == TCP_TIME_WAIT) {
+		const struct inet_timewait_sock *tw = inet_twsk(sk);
+
+		ctx->state = tw->tw_substate;
+		ctx->timer = 3;
+		ctx->timer_expires = (long)(tw->tw_timer.expires - jiffies);
+		return;
+	}
+
+	if (sk->sk_state == TCP_NEW_SYN_RECV) {
+		const struct request_sock *req = inet_reqsk(sk);
+
+		ctx->state = TCP_SYN_RECV;
+		ctx->timer = 1;
+		ctx->timer_expires = (long)(req->rsk_timer.expires - jiffies);
+		ctx->retransmits = req->num_timeout;
+		ctx->uid = from_kuid_munged(user_ns,
+					    sock_i_uid(req->rsk_listener));
+		return;
+	}
+
+	icsk = inet_csk(sk);
+	tp = tcp_sk(sk);
+
+	if (icsk->icsk_pending == ICSK_TIME_RETRANS ||
+	    icsk->icsk_pending == ICSK_TIME_REO_TIMEOUT ||
+	    icsk->icsk_pending == ICSK_TIME_LOSS_PROBE) {
+		ctx->timer = 1;
+		expires = icsk->icsk_timeout;
+	} else if (icsk->icsk_pending == ICSK_TIME_PROBE0) {
+		ctx->timer = 4;
+		expires = icsk->icsk_timeout;
+	} else if (timer_pending(&sk->sk_timer)) {
+		ctx->timer = 2;
+		expires = sk->sk_timer.expires;
+	} else {
+		ctx->timer = 0;
+		expires = jiffies;
+	}
+	ctx->timer_expires = (long)(expires - jiffies);
+
+	ctx->state = inet_sk_state_load(sk);
+	if (ctx->state == TCP_LISTEN)
+		ctx->rx_queue = sk->sk_ack_backlog;
+	else
+		ctx->rx_queue = max_t(int, tp->rcv_nxt - tp->copied_seq, 0);
+	ctx->tx_queue = tp->write_seq - tp->snd_una;
+	ctx->retransmits = icsk->icsk_retransmits;
+	ctx->drops = atomic_read(&sk->sk_drops);
+	ctx->uid = from_kuid_munged(user_ns, sock_i_uid(sk));
+	ctx->ino = sock_i_ino(sk);
+}
+
+static const struct bpf_sock_iter_table tcp_iter_table = {
+	.fill	= tcp_iter_fill,
+	.show	= tcp_iter_show,
+};
+
+static int tcp_iter_init(void *priv, struct bpf_map *map)
+{
+	return bpf_sock_iter_init(priv, &tcp_iter_table, INET_LHTABLE_SIZE +
+				  tcp_hashinfo.ehash_mask + 1);
+}
+
+static struct bpf_iter_target tcp_iter_target = {
+	.attach_type	= BPF_ITER_TCP,
+	.ctx_size	= sizeof(struct bpf_iter_sock),
+	.priv_size	= sizeof(struct bpf_sock_iter_priv),
+	.seq_ops	= &bpf_sock_seq_ops,
+	.init		= tcp_iter_init,
+	.fini		= bpf_sock_iter_fini,
+};
+
+static u32 udp_iter_fill(struct bpf_sock_iter_priv *priv, u32 bucket)
+{
+	struct udp_hslot *hslot = &udp_table.hash[bucket];
+	struct sock *sk;
+	u32 n = 0;
+
+	if (hlist_empty(&hslot->head))
+		return 0;
+
+	spin_lock_bh(&hslot->lock);
+	sk_for_each(sk, &hslot->head) {
+		if (!net_eq(sock_net(sk), priv->net))
+			continue;
+		if (bpf_sock_iter_want(priv, n)) {
+			sock_hold(sk);
+			priv->batch[n - priv->offset] = sk;
+		}
+		n++;
+	}
+	spin_unlock_bh(&hslot->lock);
+
+	return n;
+}
+
+/* Same fields as /proc/net/udp */
+static void udp_iter_show(struct bpf_iter_sock *ctx, struct sock *sk,
+			  struct seq_file *seq)
+{
+	ctx->state = sk->sk_state;
+	ctx->tx_queue = sk_wmem_alloc_get(sk);
+	ctx->rx_queue = sk_rmem_alloc_get(sk);
+	ctx->drops = atomic_read(&sk->sk_drops);
+	ctx->uid = from_kuid_munged(seq_user_ns(seq), sock_i_uid(sk));
+	ctx->ino = sock_i_ino(sk);
+}
+
+static const struct bpf_sock_iter_table udp_iter_table = {
+	.fill	= udp_iter_fill,
+	.show	= udp_iter_show,
+};
+
+static int udp_iter_init(void *priv, struct bpf_map *map)
+{
+	return bpf_sock_iter_init(priv, &udp_iter_table, udp_table.mask + 1);
+}
+
+static struct bpf_iter_target udp_iter_target = {
+	.attach_type	= BPF_ITER_UDP,
+	.ctx_size	= sizeof(struct bpf_iter_sock),
+	.priv_size	= sizeof(struct bpf_sock_iter_priv),
+	.seq_ops	= &bpf_sock_seq_ops,
+	.init		= udp_iter_init,
+	.fini		= bpf_sock_iter_fini,
+};
+
+static int __init bpf_sock_iter_register(void)
+{
+	int err;
+
+	err = bpf_iter_reg_target(&tcp_iter_target);
+	if (err)
+		return err;
+
+	return bpf_iter_reg_target(&udp_iter_target);
+}
+late_initcall(bpf_sock_iter_register);
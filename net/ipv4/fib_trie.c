@@ -74,6 +74,7 @@
 #include <linux/slab.h>
 #include <linux/export.h>
 #include <linux/vmalloc.h>
+#include <linux/hash.h>
 #include <linux/notifier.h>
 #include <net/net_namespace.h>
 #include <net/ip.h>
@@ -162,6 +163,7 @@ struct trie_use_stats {
 	unsigned int semantic_match_miss;
 	unsigned int null_node_hit;
 	unsigned int resize_node_skipped;
+	unsigned int cache_hit;
 };
 #endif
 
@@ -185,6 +187,43 @@ struct trie {
 static struct key_vector *resize(struct trie *t, struct key_vector *tn);
 static size_t tnode_free_size;
 
+/* Per-cpu direct mapped cache of fib_table_lookup() results.
+ *
+ * An entry is valid while fib_lookup_cache_genid is unchanged. The
+ * generation is bumped whenever an alias is added to or removed from a
+ * trie, a table is freed, or rt_cache_flush() is called (which covers
+ * nexthop and device state changes), so a valid entry never refers to a
+ * released fib_info.
+ */
+#define FIB_LOOKUP_CACHE_BITS	8
+#define FIB_LOOKUP_CACHE_SIZE	(1U << FIB_LOOKUP_CACHE_BITS)
+
+#define FIB_LC_IGNORE_LINKSTATE	0x1
+#define FIB_LC_SKIP_NH_OIF	0x2
+
+struct fib_lookup_cache_entry {
+	const struct fib_table	*tb;
+	__be32			daddr;
+	int			oif;
+	u32			genid;
+	u8			tos;
+	u8			scope;
+	u8			flags;
+	int			err;
+	struct fib_result	res;
+};
+
+static struct fib_lookup_cache_entry __percpu *fib_lookup_cache;
+static atomic_t fib_lookup_cache_genid;
+
+/* Called after the change, which a lookup seeing the new generation
+ * must observe: fully ordered, pairs with smp_rmb() in fib_table_lookup().
+ */
+void fib_lookup_cache_flush(void)
+{
+	atomic_inc_return(&fib_lookup_cache_genid);
+}
+
 /*
  * synchronize_rcu after call_rcu for that many pages; it should be especially
  * useful before resizing the root node with PREEMPT_NONE configs; the value was
@@ -1057,6 +1096,7 @@ static int fib_insert_node(struct trie *t, struct key_vector *tp,
 	NODE_INIT_PARENT(l, tp);
 	put_child_root(tp, key, l);
 	trie_rebalance(t, tp);
+	fib_lookup_cache_flush();
 
 	return 0;
 notnode:
@@ -1100,6 +1140,7 @@ static int fib_insert_alias(struct trie *t, struct key_vector *tp,
 		l->slen = new->fa_slen;
 		node_push_suffix(tp, new->fa_slen);
 	}
+	fib_lookup_cache_flush();
 
 	return 0;
 }
@@ -1230,6 +1271,7 @@ int fib_table_insert(struct net *net, struct fib_table *tb,
 				  tb->tb_id, &cfg->fc_nlinfo, nlflags);
 
 			hlist_replace_rcu(&fa->fa_list, &new_fa->fa_list);
+			fib_lookup_cache_flush();
 
 			alias_free_mem_rcu(fa);
 
@@ -1313,8 +1355,8 @@ static inline t_key prefix_mismatch(t_key key, struct key_vector *n)
 }
 
 /* should be called with rcu_read_lock */
-int fib_table_lookup(struct fib_table *tb, const struct flowi4 *flp,
-		     struct fib_result *res, int fib_flags)
+static int __fib_table_lookup(struct fib_table *tb, const struct flowi4 *flp,
+			      struct fib_result *res, int fib_flags)
 {
 	struct trie *t = (struct trie *) tb->tb_data;
 #ifdef CONFIG_IP_FIB_TRIE_STATS
@@ -1508,6 +1550,79 @@ found:
 #endif
 	goto backtrace;
 }
+
+static u8 fib_lookup_cache_flags(const struct flowi4 *flp, int fib_flags)
+{
+	u8 flags = 0;
+
+	if (fib_flags & FIB_LOOKUP_IGNORE_LINKSTATE)
+		flags |= FIB_LC_IGNORE_LINKSTATE;
+	if (flp->flowi4_flags & FLOWI_FLAG_SKIP_NH_OIF)
+		flags |= FIB_LC_SKIP_NH_OIF;
+	return flags;
+}
+
+/* should be called with rcu_read_lock */
+int fib_table_lookup(struct fib_table *tb, const struct flowi4 *flp,
+		     struct fib_result *res, int fib_flags)
+{
+	struct fib_lookup_cache_entry *ce;
+	u8 flags;
+	u32 genid;
+	int err;
+
+	/* entries are only written with BH disabled */
+	if (unlikely(!fib_lookup_cache || in_irq() || irqs_disabled()))
+		return __fib_table_lookup(tb, flp, res, fib_flags);
+
+	/* sample the generation before walking the trie, so that a result
+	 * racing with a table change is never considered valid
+	 */
+	genid = atomic_read(&fib_lookup_cache_genid);
+	smp_rmb();
+	flags = fib_lookup_cache_flags(flp, fib_flags);
+
+	local_bh_disable();
+	ce = this_cpu_ptr(fib_lookup_cache) +
+	     hash_32((__force u32)flp->daddr ^ flp->flowi4_oif ^ tb->tb_id,
+		     FIB_LOOKUP_CACHE_BITS);
+
+	if (ce->tb == tb && ce->genid == genid &&
+	    ce->daddr == flp->daddr && ce->oif == flp->flowi4_oif &&
+	    ce->tos == flp->flowi4_tos && ce->scope == flp->flowi4_scope &&
+	    ce->flags == flags) {
+		err = ce->err;
+		if (!err) {
+			*res = ce->res;
+			if (!(fib_flags & FIB_LOOKUP_NOREF))
+				refcount_inc(&res->fi->fib_clntref);
+		}
+		local_bh_enable();
+#ifdef CONFIG_IP_FIB_TRIE_STATS
+		this_cpu_inc(((struct trie *)tb->tb_data)->stats->cache_hit);
+#endif
+		trace_fib_table_lookup(tb->tb_id, flp,
+				       err ? NULL :
+				       &res->fi->fib_nh[res->nh_sel], err);
+		return err;
+	}
+
+	err = __fib_table_lookup(tb, flp, res, fib_flags);
+
+	ce->tb = tb;
+	ce->genid = genid;
+	ce->daddr = flp->daddr;
+	ce->oif = flp->flowi4_oif;
+	ce->tos = flp->flowi4_tos;
+	ce->scope = flp->flowi4_scope;
+	ce->flags = flags;
+	ce->err = err;
+	if (!err)
+		ce->res = *res;
+	local_bh_enable();
+
+	return err;
+}
 EXPORT_SYMBOL_GPL(fib_table_lookup);
 
 static void fib_remove_alias(struct trie *t, struct key_vector *tp,
@@ -1519,6 +1634,7 @@ static void fib_remove_alias(struct trie *t, struct key_vector *tp,
 
 	/* remove the fib_alias from the list */
 	hlist_del_rcu(&old->fa_list);
+	fib_lookup_cache_flush();
 
 	/* if we emptied the list this leaf will be freed and we can sort
 	 * out parent suffix lengths as a part of trie_rebalance
@@ -1717,6 +1833,7 @@ static void fib_trie_free(struct fib_table *tb)
 			hlist_del_rcu(&fa->fa_list);
 			alias_free_mem_rcu(fa);
 		}
+		fib_lookup_cache_flush();
 
 		put_child_root(pn, n->key, NULL);
 		node_free(n);
@@ -1837,6 +1954,7 @@ void fib_table_flush_external(struct fib_table *tb)
 			 */
 			if (tb->tb_id != fa->tb_id) {
 				hlist_del_rcu(&fa->fa_list);
+				fib_lookup_cache_flush();
 				alias_free_mem_rcu(fa);
 				continue;
 			}
@@ -1924,6 +2042,7 @@ int fib_table_flush(struct net *net, struct fib_table *tb, bool flush_all)
 						 KEYLENGTH - fa->fa_slen, fa,
 						 NULL);
 			hlist_del_rcu(&fa->fa_list);
+			fib_lookup_cache_flush();
 			fib_release_info(fa->fa_info);
 			alias_free_mem_rcu(fa);
 			found++;
@@ -2008,6 +2127,8 @@ static void __trie_free_rcu(struct rcu_head *head)
 
 void fib_free_table(struct fib_table *tb)
 {
+	/* the table address may be reused by a new table */
+	fib_lookup_cache_flush();
 	call_rcu(&tb->rcu, __trie_free_rcu);
 }
 
@@ -2099,6 +2220,11 @@ void __init fib_trie_init(void)
 	trie_leaf_kmem = kmem_cache_create("ip_fib_trie",
 					   LEAF_SIZE,
 					   0, SLAB_PANIC, NULL);
+
+	/* the lookup cache is optional, lookups walk the trie without it */
+	fib_lookup_cache = __alloc_percpu(sizeof(struct fib_lookup_cache_entry) *
+					  FIB_LOOKUP_CACHE_SIZE,
+					  __alignof__(struct fib_lookup_cache_entry));
 }
 
 struct fib_table *fib_trie_table(u32 id, struct fib_table *alias)
@@ -2303,6 +2429,7 @@ static void trie_show_usage(struct seq_file *seq,
 		s.semantic_match_miss += pcpu->semantic_match_miss;
 		s.null_node_hit += pcpu->null_node_hit;
 		s.resize_node_skipped += pcpu->resize_node_skipped;
+		s.cache_hit += pcpu->cache_hit;
 	}
 
 	seq_printf(seq, "\nCounters:\n---------\n");
@@ -2312,7 +2439,8 @@ static void trie_show_usage(struct seq_file *seq,
 		   s.semantic_match_passed);
 	seq_printf(seq, "semantic match miss = %u\n", s.semantic_match_miss);
 	seq_printf(seq, "null node hit= %u\n", s.null_node_hit);
-	seq_printf(seq, "skipped node resize = %u\n\n", s.resize_node_skipped);
+	seq_printf(seq, "skipped node resize = %u\n", s.resize_node_skipped);
+	seq_printf(seq, "lookup cache hit = %u\n\n", s.cache_hit);
 }
 #endif /*  CONFIG_IP_FIB_TRIE_STATS */
 
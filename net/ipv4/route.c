@@ -428,6 +428,7 @@ static inline bool rt_is_expired(const struct rtable *rth)
 void rt_cache_flush(struct net *net)
 {
 	rt_genid_bump_ipv4(net);
+	fib_lookup_cache_flush();
 }
 
 static struct neighbour *ipv4_neigh_lookup(const struct dst_entry *dst,
@@ -2169,6 +2170,82 @@ int ip_route_input_noref(struct sk_buff *skb, __be32 daddr, __be32 saddr,
 }
 EXPORT_SYMBOL(ip_route_input_noref);
 
+/* Can the input route of @skb be reused for packets with the same
+ * addresses, tos, mark, protocol and device ?
+ */
+static bool ip_route_input_batchable(const struct sk_buff *skb, __be32 daddr)
+{
+	const struct iphdr *iph = ip_hdr(skb);
+
+	/* options may change the route (source routing), multicast input
+	 * depends on the protocol, ICMP errors may be hashed on their
+	 * inner header by multipath routing.
+	 */
+	if (iph->ihl != 5 || ipv4_is_multicast(daddr) ||
+	    iph->protocol == IPPROTO_ICMP)
+		return false;
+
+#ifdef CONFIG_IP_ROUTE_MULTIPATH
+	/* L4 multipath hashing depends on the ports */
+	if (dev_net(skb->dev)->ipv4.sysctl_fib_multipath_hash_policy)
+		return false;
+#endif
+#ifdef CONFIG_IP_MULTIPLE_TABLES
+	/* fib rules may match on the ports or the protocol */
+	if (dev_net(skb->dev)->ipv4.fib_rules_require_fldissect)
+		return false;
+#endif
+	return true;
+}
+
+/* ip_route_input_noref() for a batch of received packets, which are often
+ * trains of packets of the same flow: the route of the previous packet is
+ * reused when the route keys match, saving the FIB lookup and the source
+ * validation. Must be called within one RCU read side section for the
+ * whole batch.
+ */
+int ip_route_input_batch_noref(struct sk_buff *skb, __be32 daddr, __be32 saddr,
+			       u8 tos, struct net_device *dev,
+			       struct ip_route_input_batch *batch)
+{
+	int err;
+
+	tos &= IPTOS_RT_MASK;
+
+	/* a metadata dst carries tunnel keys used by the lookup */
+	if (skb_dst(skb)) {
+		batch->dst = NULL;
+		return ip_route_input_noref(skb, daddr, saddr, tos, dev);
+	}
+
+	if (batch->dst && batch->daddr == daddr && batch->saddr == saddr &&
+	    batch->tos == tos && batch->dev == dev &&
+	    rt_cache_valid((struct rtable *)batch->dst) &&
+	    batch->mark == skb->mark &&
+	    batch->protocol == ip_hdr(skb)->protocol &&
+	    ip_route_input_batchable(skb, daddr)) {
+		skb_dst_set_noref(skb, batch->dst);
+		IPCB(skb)->flags |= batch->ipcb_flags;
+		return 0;
+	}
+
+	batch->dst = NULL;
+	err = ip_route_input_noref(skb, daddr, saddr, tos, dev);
+	if (err || !skb_dst_is_noref(skb) || !ip_route_input_batchable(skb, daddr))
+		return err;
+
+	/* only cached routes, which do not need a reference here */
+	batch->dst = skb_dst(skb);
+	batch->dev = dev;
+	batch->daddr = daddr;
+	batch->saddr = saddr;
+	batch->mark = skb->mark;
+	batch->tos = tos;
+	batch->protocol = ip_hdr(skb)->protocol;
+	batch->ipcb_flags = IPCB(skb)->flags & IPSKB_DOREDIRECT;
+	return 0;
+}
+
 /* called with rcu_read_lock held */
 int ip_route_input_rcu(struct sk_buff *skb, __be32 daddr, __be32 saddr,
 		       u8 tos, struct net_device *dev, struct fib_result *res)
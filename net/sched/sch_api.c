@@ -611,21 +611,28 @@ void qdisc_watchdog_init(struct qdisc_watchdog *wd, struct Qdisc *qdisc)
 }
 EXPORT_SYMBOL(qdisc_watchdog_init);
 
-void qdisc_watchdog_schedule_ns(struct qdisc_watchdog *wd, u64 expires)
+void qdisc_watchdog_schedule_range_ns(struct qdisc_watchdog *wd, u64 expires,
+				      u64 delta_ns)
 {
 	if (test_bit(__QDISC_STATE_DEACTIVATED,
 		     &qdisc_root_sleeping(wd->qdisc)->state))
 		return;
 
-	if (wd->last_expires == expires)
-		return;
+	if (hrtimer_is_queued(&wd->timer)) {
+		/* If timer is already set in [expires, expires + delta_ns],
+		 * do not reprogram it.
+		 */
+		if (wd->last_expires - expires <= delta_ns)
+			return;
+	}
 
 	wd->last_expires = expires;
-	hrtimer_start(&wd->timer,
-		      ns_to_ktime(expires),
-		      HRTIMER_MODE_ABS_PINNED);
+	hrtimer_start_range_ns(&wd->timer,
+			       ns_to_ktime(expires),
+			       delta_ns,
+			       HRTIMER_MODE_ABS_PINNED);
 }
-EXPORT_SYMBOL(qdisc_watchdog_schedule_ns);
+EXPORT_SYMBOL(qdisc_watchdog_schedule_range_ns);
 
 void qdisc_watchdog_cancel(struct qdisc_watchdog *wd)
 {
@@ -996,9 +1003,11 @@ skip:
 	} else {
 		const struct Qdisc_class_ops *cops = parent->ops->cl_ops;
 
-		/* Only support running class lockless if parent is lockless */
-		if (new && (new->flags & TCQ_F_NOLOCK) &&
-		    parent && !(parent->flags & TCQ_F_NOLOCK))
+		/* Only support running class lockless if parent is lockless,
+		 * or if the parent only dispatches to per txq qdiscs (mq).
+		 */
+		if (new && (new->flags & TCQ_F_NOLOCK) && parent &&
+		    !(parent->flags & (TCQ_F_NOLOCK | TCQ_F_MQROOT)))
 			new->flags &= ~TCQ_F_NOLOCK;
 
 		err = -EOPNOTSUPP;
@@ -1151,6 +1160,14 @@ static struct Qdisc *qdisc_create(struct net_device *dev,
 	if (err)
 		goto err_out3;
 
+	/* Settle TCQ_F_NOLOCK before ->init() (qdisc_graft() applies the
+	 * same rule), so that init only sets up lockless state when the
+	 * qdisc will really run lockless.
+	 */
+	if ((sch->flags & TCQ_F_NOLOCK) && p &&
+	    !(p->flags & (TCQ_F_NOLOCK | TCQ_F_MQROOT)))
+		sch->flags &= ~TCQ_F_NOLOCK;
+
 	if (ops->init) {
 		err = ops->init(sch, tca[TCA_OPTIONS], extack);
 		if (err != 0)
@@ -28,10 +28,19 @@
  *     Add skb to the per flow list of skb (fifo).
  *   - Use a special fifo for high prio packets
  *
- *  dequeue() : serves flows in Round Robin
+ *  dequeue() : serves flows in Round Robin. A lone flow of GSO packets
+ *  larger than the quantum gets its deficit refilled in one step.
  *  Note : When a flow becomes empty, we do not immediately remove it from
  *  rb trees, for performance reasons (its expected to send additional packets,
  *  or SLAB cache will reuse socket for another flow)
+ *
+ *  Throttled flows are parked in a timer wheel (calendar queue) indexed by
+ *  their next departure time, so that throttling and unthrottling a flow is
+ *  O(1) even with thousands of paced flows. Flows paced beyond the wheel
+ *  horizon use an rb tree sorted by departure time instead.
+ *
+ *  Packets sent by sockets using SO_TXTIME (CLOCK_MONOTONIC) carry their
+ *  Earliest Departure Time in skb->tstamp, which is honored as well.
  */
 
 #include <linux/module.h>
@@ -48,6 +57,7 @@
 #include <linux/hash.h>
 #include <linux/prefetch.h>
 #include <linux/vmalloc.h>
+#include <linux/bitmap.h>
 #include <net/netlink.h>
 #include <net/pkt_sched.h>
 #include <net/sock.h>
@@ -68,12 +78,25 @@ struct fq_flow {
 	int		qlen;		/* number of packets in flow queue */
 	int		credit;
 	u32		socket_hash;	/* sk_hash */
+	u8		in_wheel;	/* throttled in q->wheel, not q->delayed */
 	struct fq_flow *next;		/* next pointer in RR lists, or &detached */
+	u32		backlog;	/* bytes in flow queue, for class dumps */
 
-	struct rb_node  rate_node;	/* anchor in q->delayed tree */
+	union {
+		struct rb_node	  rate_node;	/* anchor in q->delayed tree */
+		struct hlist_node wheel_node;	/* anchor in q->wheel[] slot */
+	};
 	u64		time_next_packet;
 };
 
+/* Timer wheel for throttled flows : FQ_WHEEL_SLOTS slots of
+ * 2^FQ_WHEEL_GRAN_LOG ns (65.5 us), giving a ~67 ms horizon.
+ */
+#define FQ_WHEEL_GRAN_LOG	16
+#define FQ_WHEEL_SLOTS_LOG	10
+#define FQ_WHEEL_SLOTS		(1U << FQ_WHEEL_SLOTS_LOG)
+#define FQ_WHEEL_MASK		(FQ_WHEEL_SLOTS - 1)
+
 struct fq_flow_head {
 	struct fq_flow *first;
 	struct fq_flow *last;
@@ -84,7 +107,10 @@ struct fq_sched_data {
 
 	struct fq_flow_head old_flows;
 
-	struct rb_root	delayed;	/* for rate limited flows */
+	struct rb_root	delayed;	/* for flows throttled beyond the wheel */
+	struct hlist_head *wheel;	/* for rate limited flows */
+	unsigned long	wheel_map[BITS_TO_LONGS(FQ_WHEEL_SLOTS)];
+	u64		wheel_slot;	/* absolute slot of the wheel cursor */
 	u64		time_next_delayed_flow;
 	unsigned long	unthrottle_latency_ns;
 
@@ -96,6 +122,7 @@ struct fq_sched_data {
 	u32		flow_plimit;	/* max packets per flow */
 	u32		orphan_mask;	/* mask for orphaned skb */
 	u32		low_rate_threshold;
+	u32		timer_slack;	/* hrtimer slack in ns */
 	struct rb_root	*fq_root;
 	u8		rate_enable;
 	u8		fq_trees_log;
@@ -111,6 +138,7 @@ struct fq_sched_data {
 	u64		stat_flows_plimit;
 	u64		stat_pkts_too_long;
 	u64		stat_allocation_errors;
+	u64		stat_wheel_overflows;
 	struct qdisc_watchdog watchdog;
 };
 
@@ -143,9 +171,46 @@ static void fq_flow_add_tail(struct fq_flow_head *head, struct fq_flow *flow)
 	flow->next = NULL;
 }
 
+static u32 fq_wheel_idx(u64 time)
+{
+	return (time >> FQ_WHEEL_GRAN_LOG) & FQ_WHEEL_MASK;
+}
+
+/* Returns the absolute slot number of the first non empty wheel slot at
+ * or after @slot, or ~0ULL if the wheel is empty.
+ * All flows in the wheel are within FQ_WHEEL_SLOTS slots of the cursor,
+ * so the circular distance from @slot is not ambiguous.
+ */
+static u64 fq_wheel_next_slot(const struct fq_sched_data *q, u64 slot)
+{
+	u32 idx = slot & FQ_WHEEL_MASK;
+	u32 next;
+
+	next = find_next_bit(q->wheel_map, FQ_WHEEL_SLOTS, idx);
+	if (next >= FQ_WHEEL_SLOTS) {
+		next = find_first_bit(q->wheel_map, FQ_WHEEL_SLOTS);
+		if (next >= FQ_WHEEL_SLOTS)
+			return ~0ULL;
+	}
+	return slot + ((next - idx) & FQ_WHEEL_MASK);
+}
+
+static void fq_wheel_del(struct fq_sched_data *q, struct fq_flow *f)
+{
+	u32 idx = fq_wheel_idx(f->time_next_packet);
+
+	hlist_del(&f->wheel_node);
+	if (hlist_empty(&q->wheel[idx]))
+		__clear_bit(idx, q->wheel_map);
+	f->in_wheel = 0;
+}
+
 static void fq_flow_unset_throttled(struct fq_sched_data *q, struct fq_flow *f)
 {
-	rb_erase(&f->rate_node, &q->delayed);
+	if (f->in_wheel)
+		fq_wheel_del(q, f);
+	else
+		rb_erase(&f->rate_node, &q->delayed);
 	q->throttled_flows--;
 	fq_flow_add_tail(&q->old_flows, f);
 }
@@ -154,6 +219,17 @@ static void fq_flow_set_throttled(struct fq_sched_data *q, struct fq_flow *f)
 {
 	struct rb_node **p = &q->delayed.rb_node, *parent = NULL;
 
+	if (likely(f->time_next_packet >>
+		   FQ_WHEEL_GRAN_LOG < q->wheel_slot + FQ_WHEEL_SLOTS)) {
+		u32 idx = fq_wheel_idx(f->time_next_packet);
+
+		hlist_add_head(&f->wheel_node, &q->wheel[idx]);
+		__set_bit(idx, q->wheel_map);
+		f->in_wheel = 1;
+		goto throttled;
+	}
+
+	q->stat_wheel_overflows++;
 	while (*p) {
 		struct fq_flow *aux;
 
@@ -166,6 +242,7 @@ static void fq_flow_set_throttled(struct fq_sched_data *q, struct fq_flow *f)
 	}
 	rb_link_node(&f->rate_node, parent, p);
 	rb_insert_color(&f->rate_node, &q->delayed);
+throttled:
 	q->throttled_flows++;
 	q->stat_throttled++;
 
@@ -321,6 +398,7 @@ static struct sk_buff *fq_dequeue_head(struct Qdisc *sch, struct fq_flow *flow)
 		flow->head = skb->next;
 		skb->next = NULL;
 		flow->qlen--;
+		flow->backlog -= qdisc_pkt_len(skb);
 		qdisc_qstats_backlog_dec(sch, skb);
 		sch->q.qlen--;
 	}
@@ -401,6 +479,7 @@ static int fq_enqueue(struct sk_buff *skb, struct Qdisc *sch,
 	}
 
 	f->qlen++;
+	f->backlog += qdisc_pkt_len(skb);
 	if (skb_is_retransmit(skb))
 		q->stat_tcp_retrans++;
 	qdisc_qstats_backlog_inc(sch, skb);
@@ -430,13 +509,60 @@ static int fq_enqueue(struct sk_buff *skb, struct Qdisc *sch,
 	return NET_XMIT_SUCCESS;
 }
 
+/* Release all flows of the wheel slots up to @now, slots entirely in
+ * the past as a whole. Returns the earliest departure time left in the
+ * wheel, or ~0ULL.
+ */
+static u64 fq_wheel_advance(struct fq_sched_data *q, u64 now)
+{
+	u64 now_slot = now >> FQ_WHEEL_GRAN_LOG;
+	u64 slot = q->wheel_slot;
+	u64 next = ~0ULL;
+	struct hlist_node *tmp;
+	struct fq_flow *f;
+	u32 idx;
+
+	while ((slot = fq_wheel_next_slot(q, slot)) <= now_slot) {
+		idx = slot & FQ_WHEEL_MASK;
+		hlist_for_each_entry_safe(f, tmp, &q->wheel[idx], wheel_node) {
+			/* only possible in the current slot */
+			if (f->time_next_packet > now) {
+				next = min(next, f->time_next_packet);
+				continue;
+			}
+			hlist_del(&f->wheel_node);
+			f->in_wheel = 0;
+			q->throttled_flows--;
+			fq_flow_add_tail(&q->old_flows, f);
+		}
+		if (hlist_empty(&q->wheel[idx]))
+			__clear_bit(idx, q->wheel_map);
+		if (slot++ == now_slot)
+			break;
+	}
+	q->wheel_slot = now_slot;
+
+	if (next == ~0ULL) {
+		slot = fq_wheel_next_slot(q, now_slot + 1);
+		if (slot != ~0ULL) {
+			idx = slot & FQ_WHEEL_MASK;
+			hlist_for_each_entry(f, &q->wheel[idx], wheel_node)
+				next = min(next, f->time_next_packet);
+		}
+	}
+	return next;
+}
+
 static void fq_check_throttled(struct fq_sched_data *q, u64 now)
 {
 	unsigned long sample;
 	struct rb_node *p;
 
-	if (q->time_next_delayed_flow > now)
+	if (q->time_next_delayed_flow > now) {
+		/* Nothing is due, hence no flow sits in a past slot. */
+		q->wheel_slot = now >> FQ_WHEEL_GRAN_LOG;
 		return;
+	}
 
 	/* Update unthrottle latency EWMA.
 	 * This is cheap and can help diagnosing timer/latency problems.
@@ -455,6 +581,19 @@ static void fq_check_throttled(struct fq_sched_data *q, u64 now)
 		}
 		fq_flow_unset_throttled(q, f);
 	}
+	q->time_next_delayed_flow = min(q->time_next_delayed_flow,
+					fq_wheel_advance(q, now));
+}
+
+/* Earliest Departure Time provided by a SO_TXTIME sender, or 0. */
+static u64 fq_skb_edt(const struct sk_buff *skb)
+{
+	const struct sock *sk = skb->sk;
+
+	if (!skb->tstamp || !sk || !sk_fullsock(sk) ||
+	    !sock_flag(sk, SOCK_TXTIME) || sk->sk_clockid != CLOCK_MONOTONIC)
+		return 0;
+	return ktime_to_ns(skb->tstamp);
 }
 
 static struct sk_buff *fq_dequeue(struct Qdisc *sch)
@@ -475,27 +614,43 @@ begin:
 	if (!head->first) {
 		head = &q->old_flows;
 		if (!head->first) {
+			/* The timer slack lets one expiry release all the
+			 * flows due within it, in one batch.
+			 */
 			if (q->time_next_delayed_flow != ~0ULL)
-				qdisc_watchdog_schedule_ns(&q->watchdog,
-							   q->time_next_delayed_flow);
+				qdisc_watchdog_schedule_range_ns(&q->watchdog,
+							q->time_next_delayed_flow,
+							q->timer_slack);
 			return NULL;
 		}
 	}
 	f = head->first;
 
 	if (f->credit <= 0) {
-		f->credit += q->quantum;
+		/* A GSO packet can leave a flow many quanta in debt. When no
+		 * other flow waits for its turn, refill all of it at once
+		 * rather than looping once per quantum.
+		 */
+		if (!f->next && (head == &q->old_flows || !q->old_flows.first))
+			f->credit += (-f->credit / q->quantum + 1) * q->quantum;
+		else
+			f->credit += q->quantum;
 		head->first = f->next;
 		fq_flow_add_tail(&q->old_flows, f);
 		goto begin;
 	}
 
 	skb = f->head;
-	if (unlikely(skb && now < f->time_next_packet &&
-		     !skb_is_tcp_pure_ack(skb))) {
-		head->first = f->next;
-		fq_flow_set_throttled(q, f);
-		goto begin;
+	if (skb && !skb_is_tcp_pure_ack(skb)) {
+		u64 time_next_packet = max_t(u64, fq_skb_edt(skb),
+					     f->time_next_packet);
+
+		if (now < time_next_packet) {
+			head->first = f->next;
+			f->time_next_packet = time_next_packet;
+			fq_flow_set_throttled(q, f);
+			goto begin;
+		}
 	}
 
 	skb = fq_dequeue_head(sch, f);
@@ -563,6 +718,7 @@ static void fq_flow_purge(struct fq_flow *flow)
 	rtnl_kfree_skbs(flow->head, flow->tail);
 	flow->head = NULL;
 	flow->qlen = 0;
+	flow->backlog = 0;
 }
 
 static void fq_reset(struct Qdisc *sch)
@@ -595,6 +751,11 @@ static void fq_reset(struct Qdisc *sch)
 	q->new_flows.first	= NULL;
 	q->old_flows.first	= NULL;
 	q->delayed		= RB_ROOT;
+	if (q->wheel) {
+		for (idx = 0; idx < FQ_WHEEL_SLOTS; idx++)
+			INIT_HLIST_HEAD(&q->wheel[idx]);
+	}
+	bitmap_zero(q->wheel_map, FQ_WHEEL_SLOTS);
 	q->flows		= 0;
 	q->inactive_flows	= 0;
 	q->throttled_flows	= 0;
@@ -696,6 +857,7 @@ static const struct nla_policy fq_policy[TCA_FQ_MAX + 1] = {
 	[TCA_FQ_BUCKETS_LOG]		= { .type = NLA_U32 },
 	[TCA_FQ_FLOW_REFILL_DELAY]	= { .type = NLA_U32 },
 	[TCA_FQ_LOW_RATE_THRESHOLD]	= { .type = NLA_U32 },
+	[TCA_FQ_TIMER_SLACK]		= { .type = NLA_U32 },
 };
 
 static int fq_change(struct Qdisc *sch, struct nlattr *opt,
@@ -773,6 +935,9 @@ static int fq_change(struct Qdisc *sch, struct nlattr *opt,
 	if (tb[TCA_FQ_ORPHAN_MASK])
 		q->orphan_mask = nla_get_u32(tb[TCA_FQ_ORPHAN_MASK]);
 
+	if (tb[TCA_FQ_TIMER_SLACK])
+		q->timer_slack = nla_get_u32(tb[TCA_FQ_TIMER_SLACK]);
+
 	if (!err) {
 		sch_tree_unlock(sch);
 		err = fq_resize(sch, fq_log);
@@ -799,6 +964,7 @@ static void fq_destroy(struct Qdisc *sch)
 
 	fq_reset(sch);
 	fq_free(q->fq_root);
+	fq_free(q->wheel);
 	qdisc_watchdog_cancel(&q->watchdog);
 }
 
@@ -823,8 +989,15 @@ static int fq_init(struct Qdisc *sch, struct nlattr *opt,
 	q->fq_trees_log		= ilog2(1024);
 	q->orphan_mask		= 1024 - 1;
 	q->low_rate_threshold	= 550000 / 8;
+	q->timer_slack		= 10 * NSEC_PER_USEC;
+	q->wheel_slot		= ktime_get_ns() >> FQ_WHEEL_GRAN_LOG;
 	qdisc_watchdog_init(&q->watchdog, sch);
 
+	q->wheel = kvcalloc(FQ_WHEEL_SLOTS, sizeof(struct hlist_head),
+			    GFP_KERNEL);
+	if (!q->wheel)
+		return -ENOMEM;
+
 	if (opt)
 		err = fq_change(sch, opt, extack);
 	else
@@ -855,6 +1028,7 @@ static int fq_dump(struct Qdisc *sch, struct sk_buff *skb)
 	    nla_put_u32(skb, TCA_FQ_ORPHAN_MASK, q->orphan_mask) ||
 	    nla_put_u32(skb, TCA_FQ_LOW_RATE_THRESHOLD,
 			q->low_rate_threshold) ||
+	    nla_put_u32(skb, TCA_FQ_TIMER_SLACK, q->timer_slack) ||
 	    nla_put_u32(skb, TCA_FQ_BUCKETS_LOG, q->fq_trees_log))
 		goto nla_put_failure;
 
@@ -884,12 +1058,158 @@ static int fq_dump_stats(struct Qdisc *sch, struct gnet_dump *d)
 	st.throttled_flows	  = q->throttled_flows;
 	st.unthrottle_latency_ns  = min_t(unsigned long,
 					  q->unthrottle_latency_ns, ~0U);
+	st.wheel_overflows	  = q->stat_wheel_overflows;
 	sch_tree_unlock(sch);
 
 	return gnet_stats_copy_app(d, &st, sizeof(st));
 }
 
+/* Flows are exported as classes 1..N, in the order of the flow trees.
+ * Each part of a dump takes a snapshot of the flows it has left to report,
+ * in one pass under the qdisc lock, which lives as long as fq_walk() and
+ * is handed to fq_dump_class() and fq_dump_class_stats() as the class.
+ * Class ids are 16 bits: flows past the first 0xffff are not reported.
+ */
+struct fq_flow_dump {
+	u32			classid;
+	struct tc_fq_cl_stats	st;
+};
+
+static struct Qdisc *fq_leaf(struct Qdisc *sch, unsigned long cl)
+{
+	return NULL;
+}
+
+static unsigned long fq_find(struct Qdisc *sch, u32 classid)
+{
+	return 0;
+}
+
+static int fq_dump_class(struct Qdisc *sch, unsigned long cl,
+			 struct sk_buff *skb, struct tcmsg *tcm)
+{
+	const struct fq_flow_dump *fd = (const struct fq_flow_dump *)cl;
+
+	tcm->tcm_handle |= TC_H_MIN(fd->classid);
+	return 0;
+}
+
+static int fq_dump_class_stats(struct Qdisc *sch, unsigned long cl,
+			       struct gnet_dump *d)
+{
+	const struct fq_flow_dump *fd = (const struct fq_flow_dump *)cl;
+	struct gnet_stats_queue qs = { 0 };
+
+	qs.qlen = fd->st.qlen;
+	qs.backlog = fd->st.backlog;
+
+	if (gnet_stats_copy_queue(d, NULL, &qs, fd->st.qlen) < 0)
+		return -1;
+	return gnet_stats_copy_app(d, &fd->st, sizeof(fd->st));
+}
+
+static void fq_flow_snapshot(const struct fq_sched_data *q,
+			     const struct fq_flow *f, u64 now,
+			     struct tc_fq_cl_stats *st)
+{
+	memset(st, 0, sizeof(*st));
+	st->credit = f->credit;
+	st->socket_hash = f->socket_hash;
+	if (fq_flow_is_detached(f)) {
+		st->flags |= TC_FQ_FLOW_DETACHED;
+	} else {
+		st->qlen = f->qlen;
+		st->backlog = f->backlog;
+	}
+	if (fq_flow_is_throttled(f))
+		st->flags |= TC_FQ_FLOW_THROTTLED;
+	if ((unsigned long)f->sk & 1UL)
+		st->flags |= TC_FQ_FLOW_ORPHAN;
+	if (f->time_next_packet > now)
+		st->time_to_send = f->time_next_packet - now;
+}
+
+/* Snapshot of the flows past the @first ones, up to the last class id.
+ * Flows come and go while the lock is dropped to allocate it, the part
+ * then only covers as many flows as there were.  Returns the number of
+ * flows in *@dump, or -ENOMEM.
+ */
+static int fq_flow_dump_take(struct Qdisc *sch, u32 first,
+			     struct fq_flow_dump **dump)
+{
+	struct fq_sched_data *q = qdisc_priv(sch);
+	struct fq_flow_dump *fd;
+	u32 cnt, pos, i, idx;
+	struct rb_node *p;
+	u64 now;
+
+	*dump = NULL;
+	sch_tree_lock(sch);
+	cnt = min_t(u32, q->flows, TC_H_MIN_MASK);
+	sch_tree_unlock(sch);
+	if (cnt <= first)
+		return 0;
+	cnt -= first;
+
+	fd = kvmalloc_array(cnt, sizeof(*fd), GFP_KERNEL);
+	if (!fd)
+		return -ENOMEM;
+
+	sch_tree_lock(sch);
+	now = ktime_get_ns();
+	pos = 0;
+	i = 0;
+	for (idx = 0; q->fq_root && idx < (1U << q->fq_trees_log); idx++) {
+		for (p = rb_first(&q->fq_root[idx]); p && i < cnt;
+		     p = rb_next(p), pos++) {
+			if (pos < first)
+				continue;
+			fd[i].classid = pos + 1;
+			fq_flow_snapshot(q, rb_entry(p, struct fq_flow, fq_node),
+					 now, &fd[i++].st);
+		}
+	}
+	sch_tree_unlock(sch);
+
+	*dump = fd;
+	return i;
+}
+
+static void fq_walk(struct Qdisc *sch, struct qdisc_walker *arg)
+{
+	struct fq_flow_dump *dump;
+	int i, cnt;
+
+	if (arg->stop)
+		return;
+
+	cnt = fq_flow_dump_take(sch, arg->skip, &dump);
+	if (cnt < 0) {
+		arg->stop = 1;
+		return;
+	}
+
+	arg->count = arg->skip;
+	for (i = 0; i < cnt; i++) {
+		if (arg->fn(sch, (unsigned long)&dump[i], arg) < 0) {
+			arg->stop = 1;
+			break;
+		}
+		arg->count++;
+	}
+	kvfree(dump);
+}
+
+static const struct Qdisc_class_ops fq_class_ops = {
+	.leaf		=	fq_leaf,
+	.find		=	fq_find,
+	.dump		=	fq_dump_class,
+	.dump_stats	=	fq_dump_class_stats,
+	.walk		=	fq_walk,
+};
+
 static struct Qdisc_ops fq_qdisc_ops __read_mostly = {
+	.cl_ops		=	&fq_class_ops,
 	.id		=	"fq",
 	.priv_size	=	sizeof(struct fq_sched_data),
 
@@ -21,6 +21,9 @@
 #include <linux/jhash.h>
 #include <linux/slab.h>
 #include <linux/vmalloc.h>
+#include <linux/skb_array.h>
+#include <linux/cpumask.h>
+#include <linux/percpu.h>
 #include <net/netlink.h>
 #include <net/pkt_sched.h>
 #include <net/pkt_cls.h>
@@ -42,8 +45,37 @@
  * head drops only.
  * ECN capability is on by default.
  * Low memory footprint (64 bytes per flow)
+ *
+ * Lockless mode (TCQ_F_NOLOCK) :
+ * When fq_codel is the root qdisc of a transmit queue (directly, or as a
+ * child of mq/mqprio), enqueue does not take the qdisc lock. Packets are
+ * classified and parked in a per-cpu staging ring, then moved to their flow
+ * by the single dequeuer (the owner of qdisc->seqlock) before it picks the
+ * next packet. All flow state is only touched by the dequeuer.
+ * When grafted under a classful qdisc, the parent lock serializes us and
+ * packets go straight to their flow. The staging rings only exist while
+ * the qdisc runs lockless, and are freed if TCQ_F_NOLOCK gets cleared.
  */
 
+#define FQ_CODEL_STAGE_LEN	256	/* per-cpu staging ring size */
+
+struct fq_codel_stage {
+	struct skb_array ring;
+	u32		overflows;	/* packets dropped, ring was full */
+	u32		contended;	/* enqueues while dequeuer was running */
+};
+
+struct fq_codel_skb_cb {
+	struct codel_skb_cb cb;
+	u32		idx;		/* flow index, set at classification */
+};
+
+static struct fq_codel_skb_cb *fq_codel_skb_cb(const struct sk_buff *skb)
+{
+	qdisc_cb_private_validate(skb, sizeof(struct fq_codel_skb_cb));
+	return (struct fq_codel_skb_cb *)qdisc_skb_cb(skb)->data;
+}
+
 struct fq_codel_flow {
 	struct sk_buff	  *head;
 	struct sk_buff	  *tail;
@@ -64,6 +96,7 @@ struct fq_codel_sched_data {
 	u32		memory_limit;
 	struct codel_params cparams;
 	struct codel_stats cstats;
+	u32		backlog;	/* bytes queued in flows */
 	u32		memory_usage;
 	u32		drop_overmemory;
 	u32		drop_overlimit;
@@ -71,8 +104,40 @@ struct fq_codel_sched_data {
 
 	struct list_head new_flows;	/* list of new flows */
 	struct list_head old_flows;	/* list of old flows */
+
+	struct fq_codel_stage __percpu *stage;
+	cpumask_var_t	staged;		/* cpus with packets in their stage */
+	u32		stage_drains;
+	u32		stage_max_batch;
 };
 
+/* Serializes control path with the dequeuer, which holds qdisc->seqlock
+ * but not the qdisc lock in lockless mode.
+ */
+static void fq_codel_lock(struct Qdisc *sch)
+{
+	if (sch->flags & TCQ_F_NOLOCK)
+		spin_lock_bh(&sch->seqlock);
+	sch_tree_lock(sch);
+}
+
+static void fq_codel_unlock(struct Qdisc *sch)
+{
+	sch_tree_unlock(sch);
+	if (sch->flags & TCQ_F_NOLOCK)
+		spin_unlock_bh(&sch->seqlock);
+}
+
+/* Backlog accounting : per-cpu for our own stats, plus sch->qstats.backlog
+ * when a locked parent serializes us, as classful parents read it directly.
+ */
+static void fq_codel_backlog_add(struct Qdisc *sch, int len)
+{
+	this_cpu_add(sch->cpu_qstats->backlog, len);
+	if (!(sch->flags & TCQ_F_NOLOCK))
+		sch->qstats.backlog += len;
+}
+
 static unsigned int fq_codel_hash(const struct fq_codel_sched_data *q,
 				  struct sk_buff *skb)
 {
@@ -141,7 +206,8 @@ static inline void flow_queue_add(struct fq_codel_flow *flow,
 }
 
 static unsigned int fq_codel_drop(struct Qdisc *sch, unsigned int max_packets,
-				  struct sk_buff **to_free)
+				  struct sk_buff **to_free,
+				  unsigned int *dropped, unsigned int *dropped_len)
 {
 	struct fq_codel_sched_data *q = qdisc_priv(sch);
 	struct sk_buff *skb;
@@ -179,37 +245,31 @@ static unsigned int fq_codel_drop(struct Qdisc *sch, unsigned int max_packets,
 
 	flow->dropped += i;
 	q->backlogs[idx] -= len;
+	q->backlog -= len;
 	q->memory_usage -= mem;
-	sch->qstats.drops += i;
-	sch->qstats.backlog -= len;
-	sch->q.qlen -= i;
+	this_cpu_add(sch->cpu_qstats->drops, i);
+	fq_codel_backlog_add(sch, -len);
+	atomic_sub(i, &sch->q.atomic_qlen);
+	*dropped = i;
+	*dropped_len = len;
 	return idx;
 }
 
-static int fq_codel_enqueue(struct sk_buff *skb, struct Qdisc *sch,
-			    struct sk_buff **to_free)
+/* Adds a classified and accounted packet to its flow. */
+static int fq_codel_enqueue_flow(struct sk_buff *skb, struct Qdisc *sch,
+				 unsigned int idx, struct sk_buff **to_free)
 {
 	struct fq_codel_sched_data *q = qdisc_priv(sch);
-	unsigned int idx, prev_backlog, prev_qlen;
+	unsigned int dropped, dropped_len;
 	struct fq_codel_flow *flow;
-	int uninitialized_var(ret);
 	unsigned int pkt_len;
 	bool memory_limited;
+	int ret;
 
-	idx = fq_codel_classify(skb, sch, &ret);
-	if (idx == 0) {
-		if (ret & __NET_XMIT_BYPASS)
-			qdisc_qstats_drop(sch);
-		__qdisc_drop(skb, to_free);
-		return ret;
-	}
-	idx--;
-
-	codel_set_enqueue_time(skb);
 	flow = &q->flows[idx];
 	flow_queue_add(flow, skb);
 	q->backlogs[idx] += qdisc_pkt_len(skb);
-	qdisc_qstats_backlog_inc(sch, skb);
+	q->backlog += qdisc_pkt_len(skb);
 
 	if (list_empty(&flow->flowchain)) {
 		list_add_tail(&flow->flowchain, &q->new_flows);
@@ -220,12 +280,9 @@ static int fq_codel_enqueue(struct sk_buff *skb, struct Qdisc *sch,
 	get_codel_cb(skb)->mem_usage = skb->truesize;
 	q->memory_usage += get_codel_cb(skb)->mem_usage;
 	memory_limited = q->memory_usage > q->memory_limit;
-	if (++sch->q.qlen <= sch->limit && !memory_limited)
+	if (qdisc_qlen(sch) <= sch->limit && !memory_limited)
 		return NET_XMIT_SUCCESS;
 
-	prev_backlog = sch->qstats.backlog;
-	prev_qlen = sch->q.qlen;
-
 	/* save this packet length as it might be dropped by fq_codel_drop() */
 	pkt_len = qdisc_pkt_len(skb);
 	/* fq_codel_drop() is quite expensive, as it performs a linear search
@@ -233,27 +290,155 @@ static int fq_codel_enqueue(struct sk_buff *skb, struct Qdisc *sch,
 	 * So instead of dropping a single packet, drop half of its backlog
 	 * with a 64 packets limit to not add a too big cpu spike here.
 	 */
-	ret = fq_codel_drop(sch, q->drop_batch_size, to_free);
+	ret = fq_codel_drop(sch, q->drop_batch_size, to_free,
+			    &dropped, &dropped_len);
 
-	prev_qlen -= sch->q.qlen;
-	prev_backlog -= sch->qstats.backlog;
-	q->drop_overlimit += prev_qlen;
+	q->drop_overlimit += dropped;
 	if (memory_limited)
-		q->drop_overmemory += prev_qlen;
+		q->drop_overmemory += dropped;
 
 	/* As we dropped packet(s), better let upper stack know this.
 	 * If we dropped a packet for this flow, return NET_XMIT_CN,
 	 * but in this case, our parents wont increase their backlogs.
 	 */
 	if (ret == idx) {
-		qdisc_tree_reduce_backlog(sch, prev_qlen - 1,
-					  prev_backlog - pkt_len);
+		qdisc_tree_reduce_backlog(sch, dropped - 1,
+					  dropped_len - pkt_len);
 		return NET_XMIT_CN;
 	}
-	qdisc_tree_reduce_backlog(sch, prev_qlen, prev_backlog);
+	qdisc_tree_reduce_backlog(sch, dropped, dropped_len);
+	return NET_XMIT_SUCCESS;
+}
+
+/* Lockless enqueue : park the packet in this cpu staging ring.
+ * BH are disabled, so the ring has a single producer.
+ */
+static int fq_codel_enqueue_stage(struct sk_buff *skb, struct Qdisc *sch,
+				  struct sk_buff **to_free)
+{
+	struct fq_codel_sched_data *q = qdisc_priv(sch);
+	struct fq_codel_stage *stage = this_cpu_ptr(q->stage);
+	int cpu = smp_processor_id();
+
+	if (qdisc_is_running(sch))
+		stage->contended++;
+
+	if (unlikely(skb_array_produce(&stage->ring, skb))) {
+		stage->overflows++;
+		qdisc_qstats_cpu_backlog_dec(sch, skb);
+		qdisc_qstats_atomic_qlen_dec(sch);
+		return qdisc_drop_cpu(skb, sch, to_free);
+	}
+
+	/* Pairs with smp_mb__after_atomic() in fq_codel_drain() */
+	smp_mb();
+	if (!cpumask_test_cpu(cpu, q->staged))
+		cpumask_set_cpu(cpu, q->staged);
 	return NET_XMIT_SUCCESS;
 }
 
+static int fq_codel_enqueue(struct sk_buff *skb, struct Qdisc *sch,
+			    struct sk_buff **to_free)
+{
+	unsigned int idx;
+	int uninitialized_var(ret);
+
+	idx = fq_codel_classify(skb, sch, &ret);
+	if (idx == 0) {
+		if (ret & __NET_XMIT_BYPASS)
+			qdisc_qstats_cpu_drop(sch);
+		__qdisc_drop(skb, to_free);
+		return ret;
+	}
+	idx--;
+
+	codel_set_enqueue_time(skb);
+	/* Packets are accounted before they reach their flow, so that they
+	 * count against sch->limit while staged.
+	 */
+	fq_codel_backlog_add(sch, qdisc_pkt_len(skb));
+	qdisc_qstats_atomic_qlen_inc(sch);
+
+	if (sch->flags & TCQ_F_NOLOCK) {
+		fq_codel_skb_cb(skb)->idx = idx;
+		return fq_codel_enqueue_stage(skb, sch, to_free);
+	}
+	return fq_codel_enqueue_flow(skb, sch, idx, to_free);
+}
+
+static int fq_codel_stage_alloc(struct fq_codel_sched_data *q)
+{
+	int cpu, err;
+
+	q->stage = alloc_percpu(struct fq_codel_stage);
+	if (!q->stage)
+		return -ENOMEM;
+	for_each_possible_cpu(cpu) {
+		err = skb_array_init(&per_cpu_ptr(q->stage, cpu)->ring,
+				     FQ_CODEL_STAGE_LEN, GFP_KERNEL);
+		if (err)
+			return err;
+	}
+	return 0;
+}
+
+/* Rings must be empty. Callable from the dequeuer. */
+static void fq_codel_stage_free(struct fq_codel_sched_data *q)
+{
+	int cpu;
+
+	for_each_possible_cpu(cpu) {
+		struct fq_codel_stage *stage = per_cpu_ptr(q->stage, cpu);
+
+		/* NULL ring is possible after a failed skb_array_init() */
+		if (stage->ring.ring.queue)
+			ptr_ring_cleanup(&stage->ring.ring, NULL);
+	}
+	free_percpu(q->stage);
+	q->stage = NULL;
+}
+
+/* Moves staged packets to their flows, called by the dequeuer. */
+static void fq_codel_drain(struct Qdisc *sch)
+{
+	struct fq_codel_sched_data *q = qdisc_priv(sch);
+	struct sk_buff *skb, *to_free = NULL;
+	unsigned int batch = 0, n, pkt_len;
+	int cpu;
+
+	for_each_cpu(cpu, q->staged) {
+		struct fq_codel_stage *stage = per_cpu_ptr(q->stage, cpu);
+
+		cpumask_clear_cpu(cpu, q->staged);
+		smp_mb__after_atomic();
+
+		for (n = 0; n < FQ_CODEL_STAGE_LEN; n++) {
+			skb = __skb_array_consume(&stage->ring);
+			if (!skb)
+				break;
+			pkt_len = qdisc_pkt_len(skb);
+			/* Our parents were told the packet was queued when it
+			 * was staged, so they must see all drops, this one
+			 * included.
+			 */
+			if (fq_codel_enqueue_flow(skb, sch,
+						  fq_codel_skb_cb(skb)->idx,
+						  &to_free) == NET_XMIT_CN)
+				qdisc_tree_reduce_backlog(sch, 1, pkt_len);
+		}
+		/* Do not starve the device, finish on next round */
+		if (n == FQ_CODEL_STAGE_LEN)
+			cpumask_set_cpu(cpu, q->staged);
+		batch += n;
+	}
+	if (batch) {
+		q->stage_drains++;
+		q->stage_max_batch = max(q->stage_max_batch, batch);
+	}
+	if (unlikely(to_free))
+		kfree_skb_list(to_free);
+}
+
 /* This is the specific function called from codel_dequeue()
  * to dequeue a packet from queue. Note: backlog is handled in
  * codel, we dont need to reduce it here.
@@ -269,9 +454,10 @@ static struct sk_buff *dequeue_func(struct codel_vars *vars, void *ctx)
 	if (flow->head) {
 		skb = dequeue_head(flow);
 		q->backlogs[flow - q->flows] -= qdisc_pkt_len(skb);
+		q->backlog -= qdisc_pkt_len(skb);
 		q->memory_usage -= get_codel_cb(skb)->mem_usage;
-		sch->q.qlen--;
-		sch->qstats.backlog -= qdisc_pkt_len(skb);
+		qdisc_qstats_atomic_qlen_dec(sch);
+		fq_codel_backlog_add(sch, -qdisc_pkt_len(skb));
 	}
 	return skb;
 }
@@ -281,7 +467,7 @@ static void drop_func(struct sk_buff *skb, void *ctx)
 	struct Qdisc *sch = ctx;
 
 	kfree_skb(skb);
-	qdisc_qstats_drop(sch);
+	qdisc_qstats_cpu_drop(sch);
 }
 
 static struct sk_buff *fq_codel_dequeue(struct Qdisc *sch)
@@ -292,6 +478,17 @@ static struct sk_buff *fq_codel_dequeue(struct Qdisc *sch)
 	struct list_head *head;
 	u32 prev_drop_count, prev_ecn_mark;
 
+	if (!cpumask_empty(q->staged))
+		fq_codel_drain(sch);
+	/* TCQ_F_NOLOCK was cleared by qdisc_graft(), the parent lock now
+	 * serializes enqueue with us. sch->qstats.backlog only counts from
+	 * there on, resync it with the packets in flows.
+	 */
+	if (unlikely(q->stage && !(sch->flags & TCQ_F_NOLOCK))) {
+		sch->qstats.backlog = q->backlog;
+		if (cpumask_empty(q->staged))
+			fq_codel_stage_free(q);
+	}
 begin:
 	head = &q->new_flows;
 	if (list_empty(head)) {
@@ -310,7 +507,7 @@ begin:
 	prev_drop_count = q->cstats.drop_count;
 	prev_ecn_mark = q->cstats.ecn_mark;
 
-	skb = codel_dequeue(sch, &sch->qstats.backlog, &q->cparams,
+	skb = codel_dequeue(sch, &q->backlog, &q->cparams,
 			    &flow->cvars, &q->cstats, qdisc_pkt_len,
 			    codel_get_enqueue_time, drop_func, dequeue_func);
 
@@ -325,7 +522,7 @@ begin:
 			list_del_init(&flow->flowchain);
 		goto begin;
 	}
-	qdisc_bstats_update(sch, skb);
+	qdisc_bstats_cpu_update(sch, skb);
 	flow->deficit -= qdisc_pkt_len(skb);
 	/* We cant call qdisc_tree_reduce_backlog() if our qlen is 0,
 	 * or HTB crashes. Defer it for next round.
@@ -345,11 +542,33 @@ static void fq_codel_flow_purge(struct fq_codel_flow *flow)
 	flow->head = NULL;
 }
 
+static void fq_codel_stage_purge(struct fq_codel_sched_data *q)
+{
+	struct sk_buff *skb;
+	int cpu;
+
+	if (!q->stage)
+		return;
+
+	for_each_possible_cpu(cpu) {
+		struct fq_codel_stage *stage = per_cpu_ptr(q->stage, cpu);
+
+		/* NULL ring is possible after a failed skb_array_init() */
+		if (!stage->ring.ring.queue)
+			continue;
+		while ((skb = __skb_array_consume(&stage->ring)) != NULL)
+			kfree_skb(skb);
+	}
+	cpumask_clear(q->staged);
+}
+
 static void fq_codel_reset(struct Qdisc *sch)
 {
 	struct fq_codel_sched_data *q = qdisc_priv(sch);
 	int i;
 
+	fq_codel_stage_purge(q);
+
 	INIT_LIST_HEAD(&q->new_flows);
 	INIT_LIST_HEAD(&q->old_flows);
 	for (i = 0; i < q->flows_cnt; i++) {
@@ -361,7 +580,10 @@ static void fq_codel_reset(struct Qdisc *sch)
 	}
 	memset(q->backlogs, 0, q->flows_cnt * sizeof(u32));
 	sch->q.qlen = 0;
+	for_each_possible_cpu(i)
+		per_cpu_ptr(sch->cpu_qstats, i)->backlog = 0;
 	sch->qstats.backlog = 0;
+	q->backlog = 0;
 	q->memory_usage = 0;
 }
 
@@ -399,7 +621,7 @@ static int fq_codel_change(struct Qdisc *sch, struct nlattr *opt,
 		    q->flows_cnt > 65536)
 			return -EINVAL;
 	}
-	sch_tree_lock(sch);
+	fq_codel_lock(sch);
 
 	if (tb[TCA_FQ_CODEL_TARGET]) {
 		u64 target = nla_get_u32(tb[TCA_FQ_CODEL_TARGET]);
@@ -446,7 +668,7 @@ static int fq_codel_change(struct Qdisc *sch, struct nlattr *opt,
 	q->cstats.drop_count = 0;
 	q->cstats.drop_len = 0;
 
-	sch_tree_unlock(sch);
+	fq_codel_unlock(sch);
 	return 0;
 }
 
@@ -457,6 +679,10 @@ static void fq_codel_destroy(struct Qdisc *sch)
 	tcf_block_put(q->block);
 	kvfree(q->backlogs);
 	kvfree(q->flows);
+	/* fq_codel_reset() already freed the skbs */
+	if (q->stage)
+		fq_codel_stage_free(q);
+	free_cpumask_var(q->staged);
 }
 
 static int fq_codel_init(struct Qdisc *sch, struct nlattr *opt,
@@ -488,6 +714,16 @@ static int fq_codel_init(struct Qdisc *sch, struct nlattr *opt,
 	if (err)
 		goto init_failure;
 
+	err = -ENOMEM;
+	if (!zalloc_cpumask_var(&q->staged, GFP_KERNEL))
+		goto init_failure;
+	/* qdisc_create() already cleared TCQ_F_NOLOCK under a locked parent */
+	if (sch->flags & TCQ_F_NOLOCK) {
+		err = fq_codel_stage_alloc(q);
+		if (err)
+			goto init_failure;
+	}
+
 	if (!q->flows) {
 		q->flows = kvcalloc(q->flows_cnt,
 				    sizeof(struct fq_codel_flow),
@@ -567,6 +803,7 @@ static int fq_codel_dump_stats(struct Qdisc *sch, struct gnet_dump *d)
 		.type				= TCA_FQ_CODEL_XSTATS_QDISC,
 	};
 	struct list_head *pos;
+	int cpu;
 
 	st.qdisc_stats.maxpacket = q->cstats.maxpacket;
 	st.qdisc_stats.drop_overlimit = q->drop_overlimit;
@@ -576,13 +813,25 @@ static int fq_codel_dump_stats(struct Qdisc *sch, struct gnet_dump *d)
 	st.qdisc_stats.memory_usage  = q->memory_usage;
 	st.qdisc_stats.drop_overmemory = q->drop_overmemory;
 
-	sch_tree_lock(sch);
+	fq_codel_lock(sch);
+	/* The dequeuer frees the stage if we stop running lockless */
+	if (q->stage) {
+		for_each_possible_cpu(cpu) {
+			const struct fq_codel_stage *stage;
+
+			stage = per_cpu_ptr(q->stage, cpu);
+			st.qdisc_stats.stage_overflows += stage->overflows;
+			st.qdisc_stats.stage_contended += stage->contended;
+		}
+	}
+	st.qdisc_stats.stage_drains = q->stage_drains;
+	st.qdisc_stats.stage_max_batch = q->stage_max_batch;
 	list_for_each(pos, &q->new_flows)
 		st.qdisc_stats.new_flows_len++;
 
 	list_for_each(pos, &q->old_flows)
 		st.qdisc_stats.old_flows_len++;
-	sch_tree_unlock(sch);
+	fq_codel_unlock(sch);
 
 	return gnet_stats_copy_app(d, &st, sizeof(st));
 }
@@ -655,13 +904,13 @@ static int fq_codel_dump_class_stats(struct Qdisc *sch, unsigned long cl,
 				-codel_time_to_us(-delta);
 		}
 		if (flow->head) {
-			sch_tree_lock(sch);
+			fq_codel_lock(sch);
 			skb = flow->head;
 			while (skb) {
 				qs.qlen++;
 				skb = skb->next;
 			}
-			sch_tree_unlock(sch);
+			fq_codel_unlock(sch);
 		}
 		qs.backlog = q->backlogs[idx];
 		qs.drops = flow->dropped;
@@ -720,6 +969,7 @@ static struct Qdisc_ops fq_codel_qdisc_ops __read_mostly = {
 	.dump		=	fq_codel_dump,
 	.dump_stats =	fq_codel_dump_stats,
 	.owner		=	THIS_MODULE,
+	.static_flags	=	TCQ_F_NOLOCK | TCQ_F_CPUSTATS,
 };
 
 static int __init fq_codel_module_init(void)
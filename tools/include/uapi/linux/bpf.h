@@ -103,6 +103,11 @@ enum bpf_cmd {
 	BPF_BTF_LOAD,
 	BPF_BTF_GET_FD_BY_ID,
 	BPF_TASK_FD_QUERY,
+	BPF_MAP_LOOKUP_BATCH,
+	BPF_MAP_LOOKUP_AND_DELETE_BATCH,
+	BPF_MAP_UPDATE_BATCH,
+	BPF_MAP_DELETE_BATCH,
+	BPF_ITER_CREATE,
 };
 
 enum bpf_map_type {
@@ -127,6 +132,10 @@ enum bpf_map_type {
 	BPF_MAP_TYPE_SOCKHASH,
 	BPF_MAP_TYPE_CGROUP_STORAGE,
 	BPF_MAP_TYPE_REUSEPORT_SOCKARRAY,
+	BPF_MAP_TYPE_RINGBUF,
+	BPF_MAP_TYPE_RHASH,
+	BPF_MAP_TYPE_TASK_STORAGE,
+	BPF_MAP_TYPE_INODE_STORAGE,
 };
 
 enum bpf_prog_type {
@@ -152,6 +161,8 @@ enum bpf_prog_type {
 	BPF_PROG_TYPE_LWT_SEG6LOCAL,
 	BPF_PROG_TYPE_LIRC_MODE2,
 	BPF_PROG_TYPE_SK_REUSEPORT,
+	BPF_PROG_TYPE_ITER,
+	BPF_PROG_TYPE_TRACING,
 };
 
 enum bpf_attach_type {
@@ -172,6 +183,15 @@ enum bpf_attach_type {
 	BPF_CGROUP_UDP4_SENDMSG,
 	BPF_CGROUP_UDP6_SENDMSG,
 	BPF_LIRC_MODE2,
+	BPF_SK_REUSEPORT_SELECT,
+	BPF_SK_REUSEPORT_SELECT_OR_MIGRATE,
+	BPF_ITER_TASK,
+	BPF_ITER_TASK_FILE,
+	BPF_ITER_MAP_ELEM,
+	BPF_ITER_TCP,
+	BPF_ITER_UDP,
+	BPF_TRACE_FENTRY,
+	BPF_TRACE_FEXIT,
 	__MAX_BPF_ATTACH_TYPE
 };
 
@@ -263,6 +283,9 @@ enum bpf_attach_type {
 /* Flag for stack_map, store build_id+offset instead of pointer */
 #define BPF_F_STACK_BUILD_ID	(1U << 5)
 
+/* Flag for lpm_trie, also keep a multibit table for full length lookups */
+#define BPF_F_LPM_MULTIBIT	(1U << 6)
+
 enum bpf_stack_build_id_status {
 	/* user space need an empty entry to identify end of a trace */
 	BPF_STACK_BUILD_ID_EMPTY = 0,
@@ -312,6 +335,23 @@ union bpf_attr {
 		__u64		flags;
 	};
 
+	struct { /* struct used by BPF_MAP_*_BATCH commands */
+		__aligned_u64	in_batch;	/* start batch,
+						 * NULL to start from beginning
+						 */
+		__aligned_u64	out_batch;	/* output: next start batch */
+		__aligned_u64	keys;
+		__aligned_u64	values;
+		__u32		count;		/* input/output:
+						 * input: # of key/value
+						 * elements
+						 * output: # of filled elements
+						 */
+		__u32		map_fd;
+		__u64		elem_flags;
+		__u64		flags;
+	} batch;
+
 	struct { /* anonymous struct used by BPF_PROG_LOAD command */
 		__u32		prog_type;	/* one of enum bpf_prog_type */
 		__u32		insn_cnt;
@@ -409,6 +449,12 @@ union bpf_attr {
 		__u64		probe_offset;	/* output: probe_offset */
 		__u64		probe_addr;	/* output: probe_addr */
 	} task_fd_query;
+
+	struct { /* struct used by BPF_ITER_CREATE command */
+		__u32		prog_fd;
+		__u32		target_fd;	/* map for BPF_ITER_MAP_ELEM */
+		__u32		flags;
+	} iter_create;
 } __attribute__((aligned(8)));
 
 /* The description below is an attempt at providing documentation to eBPF
@@ -2141,6 +2187,129 @@ union bpf_attr {
  *		request in the skb.
  *	Return
  *		0 on success, or a negative error in case of failure.
+ *
+ * int bpf_ringbuf_output(void *ringbuf, void *data, u64 size, u64 flags)
+ * 	Description
+ * 		Copy *size* bytes from *data* into a ring buffer *ringbuf*.
+ * 		If **BPF_RB_NO_WAKEUP** is specified in *flags*, no
+ * 		notification of new data availability is sent.
+ * 		If **BPF_RB_FORCE_WAKEUP** is specified in *flags*,
+ * 		notification of new data availability is sent unconditionally.
+ * 		Otherwise the consumer is only woken up when it has already
+ * 		consumed all previously committed records.
+ * 	Return
+ * 		0 on success, or a negative error in case of failure.
+ *
+ * void *bpf_ringbuf_reserve(void *ringbuf, u64 size, u64 flags)
+ * 	Description
+ * 		Reserve *size* bytes of payload in a ring buffer *ringbuf*.
+ * 		*size* must be a constant known to the verifier and *flags*
+ * 		must be 0. The reserved record must be passed to either
+ * 		**bpf_ringbuf_submit**\ () or **bpf_ringbuf_discard**\ ()
+ * 		before the program exits.
+ * 	Return
+ * 		Valid pointer with *size* bytes of memory available; NULL,
+ * 		otherwise.
+ *
+ * void bpf_ringbuf_submit(void *data, u64 flags)
+ * 	Description
+ * 		Submit reserved ring buffer sample, pointed to by *data*.
+ * 		*flags* control consumer notification the same way as for
+ * 		**bpf_ringbuf_output**\ ().
+ * 	Return
+ * 		Nothing. Always succeeds.
+ *
+ * void bpf_ringbuf_discard(void *data, u64 flags)
+ * 	Description
+ * 		Discard reserved ring buffer sample, pointed to by *data*.
+ * 		*flags* control consumer notification the same way as for
+ * 		**bpf_ringbuf_output**\ ().
+ * 	Return
+ * 		Nothing. Always succeeds.
+ *
+ * u64 bpf_ringbuf_query(void *ringbuf, u64 flags)
+ *	Description
+ *		Query various characteristics of provided ring buffer. What
+ *		exactly is queried is determined by *flags*:
+ *
+ *		* **BPF_RB_AVAIL_DATA**: Amount of data not yet consumed.
+ *		* **BPF_RB_RING_SIZE**: The size of ring buffer.
+ *		* **BPF_RB_CONS_POS**: Consumer position (can wrap around).
+ *		* **BPF_RB_PROD_POS**: Producer(s) position (can wrap around).
+ *
+ *		Data returned is just a momentary snapshot of actual values
+ *		and could be inaccurate, so this facility should be used to
+ *		power heuristics and for reporting, not to make 100% correct
+ *		calculation.
+ *	Return
+ *		Requested value, or 0, if *flags* are not recognized.
+ *
+ * int bpf_seq_printf(void *ctx, const char *fmt, u32 fmt_size, const void *data, u32 data_len)
+ * 	Description
+ * 		For **BPF_PROG_TYPE_ITER** programs, print *fmt* to the
+ * 		seq_file the iterator is read through. *fmt* must be NUL
+ * 		terminated within *fmt_size* bytes, at most 512.
+ *
+ * 		*data* is an array of u64 holding the arguments, *data_len*
+ * 		its size in bytes. Conversions **%d**, **%i**, **%u**,
+ * 		**%x**, **%X** and **%c** with the **l** and **ll** length
+ * 		modifiers, flags and a field width are supported, as well as
+ * 		**%%**.
+ * 	Return
+ * 		0 on success, **-E2BIG** if *fmt_size* is over 512,
+ * 		**-EINVAL** for an invalid format or a mismatch between
+ * 		conversions and arguments, **-EOVERFLOW**
+ * 		if the output did not fit, in which case the program is
+ * 		run again for the same object with a larger buffer.
+ *
+ * int bpf_seq_write(void *ctx, const void *data, u32 len)
+ * 	Description
+ * 		For **BPF_PROG_TYPE_ITER** programs, write *len* bytes from
+ * 		*data* to the seq_file the iterator is read through.
+ * 	Return
+ * 		0 on success, or **-EOVERFLOW** as for **bpf_seq_printf**\ ().
+ *
+ * void *bpf_task_storage_get(struct bpf_map *map, u64 flags)
+ * 	Description
+ * 		Get the storage of the current task in *map*, a
+ * 		**BPF_MAP_TYPE_TASK_STORAGE** map. The storage lives as long
+ * 		as the task and the map do, there is nothing to clean up when
+ * 		the task exits.
+ *
+ * 		If the task has no storage in *map* yet and *flags* holds
+ * 		**BPF_LOCAL_STORAGE_GET_F_CREATE**, zeroed storage is
+ * 		created, except in NMI context.
+ * 	Return
+ * 		Pointer to the storage, or NULL if there is none and it
+ * 		could not be created.
+ *
+ * int bpf_task_storage_delete(struct bpf_map *map)
+ * 	Description
+ * 		Delete the storage of the current task in *map*.
+ * 	Return
+ * 		0 on success, **-ENOENT** if there is none, **-EBUSY** if
+ * 		local storage is being changed on this cpu or the program
+ * 		runs in NMI context.
+ *
+ * void *bpf_inode_storage_get(struct bpf_map *map, int fd, u64 flags)
+ * 	Description
+ * 		Get the storage in *map*, a **BPF_MAP_TYPE_INODE_STORAGE**
+ * 		map, of the inode of the file open as *fd* in the current
+ * 		task. The storage lives as long as the inode and the map do.
+ * 		*flags* are as for **bpf_task_storage_get**\ ().
+ * 	Return
+ * 		Pointer to the storage, or NULL if *fd* is not open, the
+ * 		program runs in NMI context, or there is no storage and it
+ * 		could not be created.
+ *
+ * int bpf_inode_storage_delete(struct bpf_map *map, int fd)
+ * 	Description
+ * 		Delete the storage in *map* of the inode of the file open as
+ * 		*fd* in the current task.
+ * 	Return
+ * 		0 on success, **-EBADF** if *fd* is not open, **-ENOENT** if
+ * 		there is no storage, **-EBUSY** as for
+ * 		**bpf_task_storage_delete**\ ().
  */
 #define __BPF_FUNC_MAPPER(FN)		\
 	FN(unspec),			\
@@ -2226,7 +2395,18 @@ union bpf_attr {
 	FN(get_current_cgroup_id),	\
 	FN(get_local_storage),		\
 	FN(sk_select_reuseport),	\
-	FN(skb_ancestor_cgroup_id),
+	FN(skb_ancestor_cgroup_id),	\
+	FN(ringbuf_output),		\
+	FN(ringbuf_reserve),		\
+	FN(ringbuf_submit),		\
+	FN(ringbuf_discard),		\
+	FN(ringbuf_query),		\
+	FN(seq_printf),			\
+	FN(seq_write),			\
+	FN(task_storage_get),		\
+	FN(task_storage_delete),	\
+	FN(inode_storage_get),		\
+	FN(inode_storage_delete),
 
 /* integer value in 'imm' field of BPF_CALL instruction selects which helper
  * function eBPF program intends to call
@@ -2282,6 +2462,33 @@ enum bpf_func_id {
 /* BPF_FUNC_perf_event_output for sk_buff input context. */
 #define BPF_F_CTXLEN_MASK		(0xfffffULL << 32)
 
+/* BPF_FUNC_ringbuf_output, BPF_FUNC_ringbuf_submit and
+ * BPF_FUNC_ringbuf_discard flags.
+ */
+#define BPF_RB_NO_WAKEUP		(1ULL << 0)
+#define BPF_RB_FORCE_WAKEUP		(1ULL << 1)
+
+/* BPF_FUNC_ringbuf_query flags */
+enum {
+	BPF_RB_AVAIL_DATA = 0,
+	BPF_RB_RING_SIZE = 1,
+	BPF_RB_CONS_POS = 2,
+	BPF_RB_PROD_POS = 3,
+};
+
+/* BPF ring buffer record header, as seen by the consumer. The length
+ * field carries the busy bit while the record is reserved but not yet
+ * committed, and the discard bit if the producer discarded it.
+ */
+enum {
+	BPF_RINGBUF_BUSY_BIT		= (1U << 31),
+	BPF_RINGBUF_DISCARD_BIT		= (1U << 30),
+	BPF_RINGBUF_HDR_SZ		= 8,
+};
+
+/* BPF_FUNC_task_storage_get and BPF_FUNC_inode_storage_get flags. */
+#define BPF_LOCAL_STORAGE_GET_F_CREATE	(1ULL << 0)
+
 /* Mode for BPF_FUNC_skb_adjust_room helper. */
 enum bpf_adj_room_mode {
 	BPF_ADJ_ROOM_NET,
@@ -2465,6 +2672,12 @@ struct sk_reuseport_md {
 	__u32 ip_protocol;	/* IP protocol. e.g. IPPROTO_TCP, IPPROTO_UDP */
 	__u32 bind_inany;	/* Is sock bound to an INANY address? */
 	__u32 hash;		/* A hash of the packet 4 tuples */
+	/*
+	 * Set when the program is asked to pick a new listener for a
+	 * request or child socket of a closing listener.  Migration only
+	 * runs programs loaded with BPF_SK_REUSEPORT_SELECT_OR_MIGRATE.
+	 */
+	__u32 migrating;
 };
 
 #define BPF_TAG_SIZE	8
@@ -2702,6 +2915,97 @@ struct bpf_raw_tracepoint_args {
 	__u64 args[0];
 };
 
+/* Context of BPF_PROG_TYPE_TRACING programs, attached by passing the name
+ * of a kernel function to BPF_RAW_TRACEPOINT_OPEN. BPF_TRACE_FENTRY
+ * programs run on entry to the function and see its register arguments,
+ * BPF_TRACE_FEXIT programs run on return and also see its return value.
+ * Arguments past the ones the function takes hold garbage.
+ */
+#define BPF_TRACING_MAX_ARGS	6
+
+struct bpf_tracing_ctx {
+	__u64 args[BPF_TRACING_MAX_ARGS];
+	__u64 ret;		/* BPF_TRACE_FEXIT only */
+};
+
+/* Context of BPF_PROG_TYPE_ITER programs. The program is run once per
+ * object, with a read-only record whose layout depends on the
+ * expected_attach_type it was loaded with, and prints through
+ * bpf_seq_printf() and bpf_seq_write(). Returning 1 ends the walk after
+ * the current object.
+ */
+struct bpf_iter_meta {
+	__u64	seq_num;	/* number of objects seen before this one */
+};
+
+/* BPF_ITER_TASK: every task of the reader's pid namespace */
+struct bpf_iter_task {
+	struct bpf_iter_meta meta;
+	__u32	pid;
+	__u32	tgid;
+	__u32	ppid;
+	__u32	uid;
+	__u32	gid;
+	__u32	state;		/* index into "RSDTtXZPI" */
+	__s32	prio;
+	__u32	nr_threads;
+	__u64	utime;		/* ns */
+	__u64	stime;		/* ns */
+	__u64	start_time;	/* ns since boot */
+	__u64	min_flt;
+	__u64	maj_flt;
+	__u64	vsize;		/* bytes */
+	__u64	rss;		/* pages */
+	char	comm[16];
+};
+
+/* BPF_ITER_TASK_FILE: every open file of every process */
+struct bpf_iter_task_file {
+	struct bpf_iter_meta meta;
+	__u32	pid;
+	__u32	fd;
+	__u32	flags;		/* O_* */
+	__u32	mode;		/* i_mode */
+	__u64	pos;
+	__u64	ino;
+	__u32	dev;
+	__u32	pad;
+};
+
+/* BPF_ITER_MAP_ELEM: every element of the map given at creation, the
+ * key at data, the value at data + round_up(key_size, 8).
+ */
+struct bpf_iter_map_elem {
+	struct bpf_iter_meta meta;
+	__u32	key_size;
+	__u32	value_size;
+	__u8	data[0];
+};
+
+/* BPF_ITER_TCP and BPF_ITER_UDP: every socket of the reader's network
+ * namespace. Addresses are in network, ports in host byte order.
+ */
+struct bpf_iter_sock {
+	struct bpf_iter_meta meta;
+	__u32	family;
+	__u32	state;		/* TCP_* */
+	__u32	src_ip4;
+	__u32	dst_ip4;
+	__u32	src_ip6[4];
+	__u32	dst_ip6[4];
+	__u32	src_port;
+	__u32	dst_port;
+	__u32	tx_queue;
+	__u32	rx_queue;
+	__u32	uid;
+	__u32	timer;		/* as in /proc/net/tcp */
+	__u64	timer_expires;	/* jiffies from now */
+	__u32	retransmits;
+	__u32	drops;
+	__u64	ino;
+	__u64	cookie;
+};
+
 /* DIRECT:  Skip the FIB rules and go to FIB table associated with device
  * OUTPUT:  Do lookup from egress perspective; default is ingress
  */
@@ -220,4 +220,15 @@ struct prctl_mm_map {
 # define PR_SPEC_DISABLE		(1UL << 2)
 # define PR_SPEC_FORCE_DISABLE		(1UL << 3)
 
+/* Size of the private futex hash, 54 to 77 are taken upstream */
+#define PR_FUTEX_HASH			78
+# define PR_FUTEX_HASH_SET_SLOTS	1
+# define PR_FUTEX_HASH_GET_SLOTS	2
+
+/* Copy-on-write page tables and fd table on fork, not inherited */
+#define PR_SET_LAZY_FORK		79
+#define PR_GET_LAZY_FORK		80
+# define PR_LAZY_FORK_PTE		(1UL << 0)
+# define PR_LAZY_FORK_FILES		(1UL << 1)
+
 #endif /* _LINUX_PRCTL_H */
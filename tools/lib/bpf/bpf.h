@@ -89,6 +89,27 @@ int bpf_map_update_elem(int fd, const void *key, const void *value,
 int bpf_map_lookup_elem(int fd, const void *key, void *value);
 int bpf_map_delete_elem(int fd, const void *key);
 int bpf_map_get_next_key(int fd, const void *key, void *next_key);
+
+/* Batched map operations. *count is the number of elements passed in and
+ * is updated with the number of elements processed. in_batch/out_batch are
+ * opaque cursors of the map: NULL in_batch starts from the beginning, and
+ * the walk is complete when -1 is returned with errno ENOENT.
+ */
+int bpf_map_lookup_batch(int fd, void *in_batch, void *out_batch, void *keys,
+			 void *values, __u32 *count, __u64 elem_flags,
+			 __u64 flags);
+int bpf_map_lookup_and_delete_batch(int fd, void *in_batch, void *out_batch,
+				    void *keys, void *values, __u32 *count,
+				    __u64 elem_flags, __u64 flags);
+int bpf_map_update_batch(int fd, void *keys, void *values, __u32 *count,
+			 __u64 elem_flags, __u64 flags);
+int bpf_map_delete_batch(int fd, void *keys, __u32 *count, __u64 elem_flags,
+			 __u64 flags);
+/* Bind an iterator program, and the map walked by BPF_ITER_MAP_ELEM
+ * programs (target_fd, else 0), into a file descriptor whose read()s return
+ * the program's output for one walk. Pin it to read new walks.
+ */
+int bpf_iter_create(int prog_fd, int target_fd, __u32 flags);
 int bpf_obj_pin(int fd, const char *pathname);
 int bpf_obj_get(const char *pathname);
 int bpf_prog_attach(int prog_fd, int attachable_fd, enum bpf_attach_type type,
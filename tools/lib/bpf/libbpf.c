@@ -1502,6 +1502,8 @@ static bool bpf_prog_type__needs_kver(enum bpf_prog_type type)
 	case BPF_PROG_TYPE_CGROUP_SOCK_ADDR:
 	case BPF_PROG_TYPE_LIRC_MODE2:
 	case BPF_PROG_TYPE_SK_REUSEPORT:
+	case BPF_PROG_TYPE_ITER:
+	case BPF_PROG_TYPE_TRACING:
 		return false;
 	case BPF_PROG_TYPE_UNSPEC:
 	case BPF_PROG_TYPE_KPROBE:
@@ -2095,6 +2097,12 @@ void bpf_program__set_expected_attach_type(struct bpf_program *prog,
 #define BPF_SA_PROG_SEC(string, ptype) \
 	BPF_PROG_SEC_FULL(string, BPF_PROG_TYPE_CGROUP_SOCK_ADDR, ptype)
 
+#define BPF_ITER_PROG_SEC(string, ptype) \
+	BPF_PROG_SEC_FULL(string, BPF_PROG_TYPE_ITER, ptype)
+
+#define BPF_TRACE_PROG_SEC(string, ptype) \
+	BPF_PROG_SEC_FULL(string, BPF_PROG_TYPE_TRACING, ptype)
+
 static const struct {
 	const char *sec;
 	size_t len;
@@ -2129,12 +2137,22 @@ static const struct {
 	BPF_SA_PROG_SEC("cgroup/sendmsg6", BPF_CGROUP_UDP6_SENDMSG),
 	BPF_S_PROG_SEC("cgroup/post_bind4", BPF_CGROUP_INET4_POST_BIND),
 	BPF_S_PROG_SEC("cgroup/post_bind6", BPF_CGROUP_INET6_POST_BIND),
+	/* prefixes match, "iter/task" has to come after "iter/task_file" */
+	BPF_ITER_PROG_SEC("iter/task_file", BPF_ITER_TASK_FILE),
+	BPF_ITER_PROG_SEC("iter/task",	BPF_ITER_TASK),
+	BPF_ITER_PROG_SEC("iter/map_elem", BPF_ITER_MAP_ELEM),
+	BPF_ITER_PROG_SEC("iter/tcp",	BPF_ITER_TCP),
+	BPF_ITER_PROG_SEC("iter/udp",	BPF_ITER_UDP),
+	BPF_TRACE_PROG_SEC("fentry/",	BPF_TRACE_FENTRY),
+	BPF_TRACE_PROG_SEC("fexit/",	BPF_TRACE_FEXIT),
 };
 
 #undef BPF_PROG_SEC
 #undef BPF_PROG_SEC_FULL
 #undef BPF_S_PROG_SEC
 #undef BPF_SA_PROG_SEC
+#undef BPF_ITER_PROG_SEC
+#undef BPF_TRACE_PROG_SEC
 
 int libbpf_prog_type_by_name(const char *name, enum bpf_prog_type *prog_type,
 			     enum bpf_attach_type *expected_attach_type)
@@ -34,6 +34,7 @@ static unsigned int nsecs    = 10;
 static unsigned int nfutexes = 1024;
 static bool fshared = false, done = false, silent = false;
 static int futex_flag = 0;
+static int nbuckets = -1;
 
 struct timeval start, end, runtime;
 static pthread_mutex_t thread_lock;
@@ -54,6 +55,7 @@ static const struct option options[] = {
 	OPT_UINTEGER('f', "futexes", &nfutexes, "Specify amount of futexes per threads"),
 	OPT_BOOLEAN( 's', "silent",  &silent,   "Silent mode: do not display data/details"),
 	OPT_BOOLEAN( 'S', "shared",  &fshared,  "Use shared futexes instead of private ones"),
+	OPT_INTEGER( 'b', "buckets", &nbuckets, "Size of the private futex hash, 0 for the global hash"),
 	OPT_END()
 };
 
@@ -148,6 +150,7 @@ int bench_futex_hash(int argc, const char **argv)
 
 	if (!fshared)
 		futex_flag = FUTEX_PRIVATE_FLAG;
+	futex_set_nbuckets(nbuckets);
 
 	printf("Run summary [PID %d]: %d threads, each operating on %d [%s] futexes for %d secs.\n\n",
 	       getpid(), nthreads, nfutexes, fshared ? "shared":"private", nsecs);
@@ -218,6 +221,7 @@ int bench_futex_hash(int argc, const char **argv)
 	}
 
 	print_summary();
+	futex_print_nbuckets();
 
 	free(worker);
 	free(cpu);
@@ -44,12 +44,14 @@ static pthread_cond_t thread_parent, thread_worker;
 static struct stats waketime_stats, wakeup_stats;
 static unsigned int ncpus, threads_starting, nthreads = 0;
 static int futex_flag = 0;
+static int nbuckets = -1;
 
 static const struct option options[] = {
 	OPT_UINTEGER('t', "threads", &nthreads, "Specify amount of threads"),
 	OPT_UINTEGER('w', "nwakes",  &nwakes,   "Specify amount of threads to wake at once"),
 	OPT_BOOLEAN( 's', "silent",  &silent,   "Silent mode: do not display data/details"),
 	OPT_BOOLEAN( 'S', "shared",  &fshared,  "Use shared futexes instead of private ones"),
+	OPT_INTEGER( 'b', "buckets", &nbuckets, "Size of the private futex hash, 0 for the global hash"),
 	OPT_END()
 };
 
@@ -148,6 +150,7 @@ int bench_futex_wake(int argc, const char **argv)
 
 	if (!fshared)
 		futex_flag = FUTEX_PRIVATE_FLAG;
+	futex_set_nbuckets(nbuckets);
 
 	printf("Run summary [PID %d]: blocking on %d threads (at [%s] futex %p), "
 	       "waking up %d at a time.\n\n",
@@ -206,6 +209,7 @@ int bench_futex_wake(int argc, const char **argv)
 	pthread_attr_destroy(&thread_attr);
 
 	print_summary();
+	futex_print_nbuckets();
 
 	free(worker);
 	return ret;
@@ -8,11 +8,21 @@
 #ifndef _FUTEX_H
 #define _FUTEX_H
 
+#include <err.h>
+#include <stdio.h>
+#include <stdlib.h>
 #include <unistd.h>
+#include <sys/prctl.h>
 #include <sys/syscall.h>
 #include <sys/types.h>
 #include <linux/futex.h>
 
+#ifndef PR_FUTEX_HASH
+#define PR_FUTEX_HASH			78
+# define PR_FUTEX_HASH_SET_SLOTS	1
+# define PR_FUTEX_HASH_GET_SLOTS	2
+#endif
+
 /**
  * futex() - SYS_futex syscall wrapper
  * @uaddr:	address of first futex
@@ -87,6 +97,32 @@ futex_cmp_requeue(u_int32_t *uaddr, u_int32_t val, u_int32_t *uaddr2, int nr_wak
 		 val, opflags);
 }
 
+/**
+ * futex_set_nbuckets() - size the private futex hash of the process
+ * @nbuckets:	number of buckets, 0 for the global hash, -1 for the default
+ *
+ * Must be called before any thread is created.
+ */
+static inline void futex_set_nbuckets(int nbuckets)
+{
+	if (nbuckets < 0)
+		return;
+	if (prctl(PR_FUTEX_HASH, PR_FUTEX_HASH_SET_SLOTS, nbuckets, 0, 0))
+		err(EXIT_FAILURE, "prctl(PR_FUTEX_HASH)");
+}
+
+/* The hash the private futexes went to, once the threads are created */
+static inline void futex_print_nbuckets(void)
+{
+	int nbuckets = prctl(PR_FUTEX_HASH, PR_FUTEX_HASH_GET_SLOTS, 0, 0, 0);
+
+	if (nbuckets > 0)
+		printf("Private futexes hashed into %d process buckets\n",
+		       nbuckets);
+	else if (!nbuckets)
+		printf("Private futexes hashed into the global hash\n");
+}
+
 #ifndef HAVE_PTHREAD_ATTR_SETAFFINITY_NP
 #include <pthread.h>
 #include <linux/compiler.h>
@@ -143,6 +143,46 @@ static unsigned long long (*bpf_skb_cgroup_id)(void *ctx) =
 	(void *) BPF_FUNC_skb_cgroup_id;
 static unsigned long long (*bpf_skb_ancestor_cgroup_id)(void *ctx, int level) =
 	(void *) BPF_FUNC_skb_ancestor_cgroup_id;
+static int (*bpf_ringbuf_output)(void *ringbuf, void *data,
+				 unsigned long long size,
+				 unsigned long long flags) =
+	(void *) BPF_FUNC_ringbuf_output;
+static void *(*bpf_ringbuf_reserve)(void *ringbuf, unsigned long long size,
+				    unsigned long long flags) =
+	(void *) BPF_FUNC_ringbuf_reserve;
+static void (*bpf_ringbuf_submit)(void *data, unsigned long long flags) =
+	(void *) BPF_FUNC_ringbuf_submit;
+static void (*bpf_ringbuf_discard)(void *data, unsigned long long flags) =
+	(void *) BPF_FUNC_ringbuf_discard;
+static unsigned long long (*bpf_ringbuf_query)(void *ringbuf,
+					       unsigned long long flags) =
+	(void *) BPF_FUNC_ringbuf_query;
+static int (*bpf_seq_printf)(void *ctx, const char *fmt, int fmt_size,
+			     const void *data, int data_len) =
+	(void *) BPF_FUNC_seq_printf;
+static int (*bpf_seq_write)(void *ctx, const void *data, int len) =
+	(void *) BPF_FUNC_seq_write;
+static void *(*bpf_task_storage_get)(void *map, unsigned long long flags) =
+	(void *) BPF_FUNC_task_storage_get;
+static int (*bpf_task_storage_delete)(void *map) =
+	(void *) BPF_FUNC_task_storage_delete;
+static void *(*bpf_inode_storage_get)(void *map, int fd,
+				      unsigned long long flags) =
+	(void *) BPF_FUNC_inode_storage_get;
+static int (*bpf_inode_storage_delete)(void *map, int fd) =
+	(void *) BPF_FUNC_inode_storage_delete;
+
+/* Arguments of bpf_seq_printf() are passed as an array of u64, the format
+ * string is built on the stack as there is no .rodata support.
+ */
+#define BPF_SEQ_PRINTF(ctx, fmt, args...)				\
+({									\
+	char ___fmt[] = fmt;						\
+	unsigned long long ___param[] = { args };			\
+									\
+	bpf_seq_printf(ctx, ___fmt, sizeof(___fmt),			\
+		       ___param, sizeof(___param));			\
+})
 
 /* llvm builtin functions that eBPF C program may use to
  * emit BPF_LD_ABS and BPF_LD_IND instructions
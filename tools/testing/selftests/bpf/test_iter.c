@@ -0,0 +1,353 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * Tests for BPF iterator programs: reads the output of task, task_file,
+ * map_elem, tcp and udp iterators, with small reads to exercise resuming a
+ * walk, and through a pinned iterator in bpffs.
+ */
+
+#include <arpa/inet.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <linux/bpf.h>
+#include <bpf/bpf.h>
+#include <bpf/libbpf.h>
+
+#include "bpf_rlimit.h"
+
+#define PIN_PATH	"/sys/fs/bpf/test_iter_task"
+#define MAP_ELEMS	10000
+#define OUT_SIZE	(1 << 22)
+
+#define fail(format...) ({					\
+	printf("%s(%d):FAIL: ", __func__, __LINE__);		\
+	printf(format);						\
+	exit(1);						\
+})
+
+struct udp_rec {
+	__u32 family;
+	__u32 port;
+	__u32 rx_queue;
+};
+
+static struct bpf_object *obj;
+static char out[OUT_SIZE];
+
+static int prog_fd(const char *title)
+{
+	struct bpf_program *prog;
+
+	prog = bpf_object__find_program_by_title(obj, title);
+	if (!prog)
+		fail("no program %s\n", title);
+	return bpf_program__fd(prog);
+}
+
+/* Return the nth program of the object with the section title */
+static int prog_fd_nth(const char *title, int nth)
+{
+	struct bpf_program *prog;
+
+	bpf_object__for_each_program(prog, obj) {
+		if (strcmp(bpf_program__title(prog, false), title))
+			continue;
+		if (!nth--)
+			return bpf_program__fd(prog);
+	}
+	fail("no program %s\n", title);
+}
+
+/* Read the whole output of @fd, @chunk bytes at a time */
+static size_t read_all(int fd, size_t chunk)
+{
+	size_t len = 0;
+	ssize_t n;
+
+	while ((n = read(fd, out + len, chunk)) > 0) {
+		len += n;
+		if (len + chunk >= OUT_SIZE)
+			fail("output too large\n");
+	}
+	if (n < 0)
+		fail("read: %s\n", strerror(errno));
+	out[len] = 0;
+	return len;
+}
+
+static size_t iter_read(int prog, int map, size_t chunk)
+{
+	size_t len;
+	int fd;
+
+	fd = bpf_iter_create(prog, map, 0);
+	if (fd < 0)
+		fail("bpf_iter_create: %s\n", strerror(errno));
+	len = read_all(fd, chunk);
+	close(fd);
+	return len;
+}
+
+static void test_task(void)
+{
+	char line[64];
+
+	snprintf(line, sizeof(line), "pid=%d tgid=%d ppid=%d ", getpid(),
+		 getpid(), getppid());
+
+	iter_read(prog_fd("iter/task"), 0, 4096);
+	if (!strstr(out, line))
+		fail("no \"%s\" in task output\n", line);
+
+	/* the overflowing record is run again with a larger buffer */
+	iter_read(prog_fd("iter/task"), 0, 7);
+	if (!strstr(out, line))
+		fail("no \"%s\" in task output read in small chunks\n", line);
+}
+
+static void test_task_file(void)
+{
+	char line[64];
+	struct stat st;
+	int fd, i;
+
+	/* enough files for the output to take more than one page */
+	for (i = 0; i < 256; i++) {
+		fd = open("/dev/null", O_RDONLY);
+		if (fd < 0)
+			fail("open: %s\n", strerror(errno));
+	}
+	if (fstat(fd, &st))
+		fail("fstat: %s\n", strerror(errno));
+
+	snprintf(line, sizeof(line), "\n%d %d %llu %x\n", getpid(), fd,
+		 (unsigned long long)st.st_ino, st.st_mode);
+	iter_read(prog_fd("iter/task_file"), 0, 100);
+	if (!strstr(out, line) && strncmp(out, line + 1, strlen(line + 1)))
+		fail("no \"%s\" in task_file output\n", line + 1);
+
+	for (i = 0; i < 256; i++)
+		close(fd - i);
+}
+
+static void check_map_output(enum bpf_map_type type)
+{
+	static bool seen[MAP_ELEMS];
+	unsigned long long value, sum = 0;
+	unsigned int key, n = 0;
+	char *p = out;
+	int len;
+
+	memset(seen, 0, sizeof(seen));
+	while (sscanf(p, "%u %llu\n%n", &key, &value, &len) == 2) {
+		if (key >= MAP_ELEMS || seen[key])
+			fail("map type %d: bad or duplicate key %u\n", type, key);
+		if (value != key * 3ULL)
+			fail("map type %d: key %u value %llu\n", type, key,
+			     value);
+		seen[key] = true;
+		sum += value;
+		n++;
+		p += len;
+	}
+	if (*p || n != MAP_ELEMS ||
+	    sum != 3ULL * MAP_ELEMS * (MAP_ELEMS - 1) / 2)
+		fail("map type %d: %u elements, sum %llu\n", type, n, sum);
+}
+
+static void test_map_elem(enum bpf_map_type type)
+{
+	int map_fd, lines;
+	__u64 value;
+	__u32 key;
+	char *p;
+
+	map_fd = bpf_create_map(type, sizeof(key), sizeof(value), MAP_ELEMS,
+				0);
+	if (map_fd < 0)
+		fail("bpf_create_map: %s\n", strerror(errno));
+	for (key = 0; key < MAP_ELEMS; key++) {
+		value = key * 3ULL;
+		if (bpf_map_update_elem(map_fd, &key, &value, BPF_ANY))
+			fail("bpf_map_update_elem: %s\n", strerror(errno));
+	}
+
+	iter_read(prog_fd_nth("iter/map_elem", 0), map_fd, 4096);
+	check_map_output(type);
+	iter_read(prog_fd_nth("iter/map_elem", 0), map_fd, 13);
+	check_map_output(type);
+
+	/* the program ends the walk after 3 elements */
+	iter_read(prog_fd_nth("iter/map_elem", 1), map_fd, 4096);
+	for (p = out, lines = 0; (p = strchr(p, '\n')); p++)
+		lines++;
+	if (lines != 3)
+		fail("map type %d: walk ended after %d elements\n", type,
+		     lines);
+
+	/* the map is required, and the only thing such programs accept */
+	if (bpf_iter_create(prog_fd_nth("iter/map_elem", 0), 0, 0) >= 0 ||
+	    errno != EINVAL)
+		fail("map_elem iterator created without a map\n");
+	if (bpf_iter_create(prog_fd("iter/task"), map_fd, 0) >= 0 ||
+	    errno != EINVAL)
+		fail("task iterator created with a map\n");
+
+	close(map_fd);
+}
+
+static void test_map_elem_unsupported(void)
+{
+	int map_fd;
+
+	map_fd = bpf_create_map(BPF_MAP_TYPE_PERCPU_HASH, sizeof(__u32),
+				sizeof(__u64), 1, 0);
+	if (map_fd < 0)
+		fail("bpf_create_map: %s\n", strerror(errno));
+	if (bpf_iter_create(prog_fd_nth("iter/map_elem", 0), map_fd, 0) >= 0 ||
+	    errno != EOPNOTSUPP)
+		fail("map_elem iterator created for a per-cpu map\n");
+	close(map_fd);
+
+	/* the program reads a value the map does not have */
+	map_fd = bpf_create_map(BPF_MAP_TYPE_HASH, sizeof(__u32),
+				sizeof(__u32), 1, 0);
+	if (map_fd < 0)
+		fail("bpf_create_map: %s\n", strerror(errno));
+	if (bpf_iter_create(prog_fd_nth("iter/map_elem", 0), map_fd, 0) >= 0 ||
+	    errno != EACCES)
+		fail("map_elem iterator created for a too small value\n");
+	close(map_fd);
+}
+
+static int listen_loopback(int type, unsigned short *port)
+{
+	struct sockaddr_in addr = {
+		.sin_family = AF_INET,
+		.sin_addr.s_addr = htonl(INADDR_LOOPBACK),
+	};
+	socklen_t len = sizeof(addr);
+	int fd;
+
+	fd = socket(AF_INET, type, 0);
+	if (fd < 0)
+		fail("socket: %s\n", strerror(errno));
+	if (bind(fd, (struct sockaddr *)&addr, len))
+		fail("bind: %s\n", strerror(errno));
+	if (type == SOCK_STREAM && listen(fd, 1))
+		fail("listen: %s\n", strerror(errno));
+	if (getsockname(fd, (struct sockaddr *)&addr, &len))
+		fail("getsockname: %s\n", strerror(errno));
+	*port = ntohs(addr.sin_port);
+	return fd;
+}
+
+static void test_tcp(void)
+{
+	unsigned short port;
+	char line[64];
+	int fd;
+
+	fd = listen_loopback(SOCK_STREAM, &port);
+
+	/* TCP_LISTEN */
+	snprintf(line, sizeof(line), "%d %u 0 10\n", AF_INET, port);
+	iter_read(prog_fd("iter/tcp"), 0, 4096);
+	if (!strstr(out, line))
+		fail("no \"%s\" in tcp output\n", line);
+
+	close(fd);
+}
+
+static void test_udp(void)
+{
+	struct udp_rec *rec;
+	unsigned short port;
+	size_t len, i;
+	int fd;
+
+	fd = listen_loopback(SOCK_DGRAM, &port);
+
+	len = iter_read(prog_fd("iter/udp"), 0, 4096);
+	if (len % sizeof(*rec))
+		fail("udp output of %zu bytes\n", len);
+	for (i = 0, rec = (void *)out; i < len / sizeof(*rec); i++, rec++)
+		if (rec->family == AF_INET && rec->port == port)
+			break;
+	if (i == len / sizeof(*rec))
+		fail("no socket on port %u in udp output\n", port);
+
+	close(fd);
+}
+
+static void test_pin(void)
+{
+	char line[64];
+	int iter_fd, fd, i;
+
+	iter_fd = bpf_iter_create(prog_fd("iter/task"), 0, 0);
+	if (iter_fd < 0)
+		fail("bpf_iter_create: %s\n", strerror(errno));
+
+	unlink(PIN_PATH);
+	if (bpf_obj_pin(iter_fd, PIN_PATH))
+		fail("bpf_obj_pin: %s\n", strerror(errno));
+	close(iter_fd);
+
+	snprintf(line, sizeof(line), "pid=%d ", getpid());
+
+	/* every open() reads a new walk */
+	for (i = 0; i < 2; i++) {
+		fd = open(PIN_PATH, O_RDONLY);
+		if (fd < 0)
+			fail("open: %s\n", strerror(errno));
+		read_all(fd, 4096);
+		close(fd);
+		if (!strstr(out, line))
+			fail("no \"%s\" in pinned task output\n", line);
+	}
+
+	/* and bpf_obj_get() gives a new iterator fd */
+	fd = bpf_obj_get(PIN_PATH);
+	if (fd < 0)
+		fail("bpf_obj_get: %s\n", strerror(errno));
+	read_all(fd, 4096);
+	close(fd);
+	if (!strstr(out, line))
+		fail("no \"%s\" in task output of bpf_obj_get()\n", line);
+
+	unlink(PIN_PATH);
+}
+
+int main(void)
+{
+	struct bpf_prog_load_attr attr = {
+		.file = "./test_iter_kern.o",
+	};
+	int fd;
+
+	if (bpf_prog_load_xattr(&attr, &obj, &fd))
+		fail("bpf_prog_load_xattr %s\n", attr.file);
+
+	test_task();
+	test_task_file();
+	test_map_elem(BPF_MAP_TYPE_HASH);
+	test_map_elem(BPF_MAP_TYPE_ARRAY);
+	test_map_elem(BPF_MAP_TYPE_RHASH);
+	test_map_elem_unsupported();
+	test_tcp();
+	test_udp();
+	test_pin();
+
+	bpf_object__close(obj);
+	printf("test_iter: OK\n");
+	return 0;
+}
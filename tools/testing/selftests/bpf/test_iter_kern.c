@@ -0,0 +1,64 @@
+// SPDX-License-Identifier: GPL-2.0
+
+#include <linux/bpf.h>
+#include "bpf_helpers.h"
+
+SEC("iter/task")
+int dump_task(struct bpf_iter_task *ctx)
+{
+	BPF_SEQ_PRINTF(ctx, "pid=%u tgid=%u ppid=%u state=%u prio=%d\n",
+		       ctx->pid, ctx->tgid, ctx->ppid, ctx->state, ctx->prio);
+	return 0;
+}
+
+SEC("iter/task_file")
+int dump_task_file(struct bpf_iter_task_file *ctx)
+{
+	BPF_SEQ_PRINTF(ctx, "%u %u %llu %x\n",
+		       ctx->pid, ctx->fd, ctx->ino, ctx->mode);
+	return 0;
+}
+
+/* u32 keys, u64 values */
+SEC("iter/map_elem")
+int dump_map(struct bpf_iter_map_elem *ctx)
+{
+	__u32 key = *(__u32 *)ctx->data;
+	__u64 value = *(__u64 *)(ctx->data + 8);
+
+	BPF_SEQ_PRINTF(ctx, "%u %llu\n", key, value);
+	return 0;
+}
+
+/* Ends the walk after the third element */
+SEC("iter/map_elem")
+int dump_map_head(struct bpf_iter_map_elem *ctx)
+{
+	__u32 key = *(__u32 *)ctx->data;
+
+	BPF_SEQ_PRINTF(ctx, "%u\n", key);
+	return ctx->meta.seq_num == 2;
+}
+
+SEC("iter/tcp")
+int dump_tcp(struct bpf_iter_sock *ctx)
+{
+	BPF_SEQ_PRINTF(ctx, "%u %u %u %u\n",
+		       ctx->family, ctx->src_port, ctx->dst_port, ctx->state);
+	return 0;
+}
+
+/* Binary records, see struct udp_rec in test_iter.c */
+SEC("iter/udp")
+int dump_udp(struct bpf_iter_sock *ctx)
+{
+	__u32 rec[3];
+
+	rec[0] = ctx->family;
+	rec[1] = ctx->src_port;
+	rec[2] = ctx->rx_queue;
+	bpf_seq_write(ctx, rec, sizeof(rec));
+	return 0;
+}
+
+char _license[] SEC("license") = "GPL";
@@ -0,0 +1,199 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * TCP socket dump benchmark: /proc/net/tcp vs. a BPF tcp iterator.
+ *
+ * Opens -n loopback connections (default 50000, so twice as many sockets
+ * plus the listener), each from its own 127.1.0.0/16 source address, and
+ * reads the whole table -r times (default 10) through /proc/net/tcp and
+ * through the "iter/tcp" program of test_iter_kern.o, which prints one
+ * short line per socket. Reports the wall clock and the cpu time spent
+ * per dump, and the number of lines read.
+ *
+ * Usage: test_iter_tcp_bench [-n connections] [-r repeat]
+ */
+
+#include <arpa/inet.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <linux/bpf.h>
+#include <bpf/bpf.h>
+#include <bpf/libbpf.h>
+
+#include "bpf_rlimit.h"
+
+#define BUF_SIZE	(128 << 10)
+
+#define fail(format...) ({					\
+	printf("%s(%d):FAIL: ", __func__, __LINE__);		\
+	printf(format);						\
+	exit(1);						\
+})
+
+static unsigned int cfg_conns = 50000;
+static unsigned int cfg_repeat = 10;
+
+static char buf[BUF_SIZE];
+
+static unsigned long long now_us(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000ULL + ts.tv_nsec / 1000;
+}
+
+static unsigned long long cpu_us(void)
+{
+	struct rusage ru;
+
+	getrusage(RUSAGE_SELF, &ru);
+	return (ru.ru_utime.tv_sec + ru.ru_stime.tv_sec) * 1000000ULL +
+	       ru.ru_utime.tv_usec + ru.ru_stime.tv_usec;
+}
+
+static void open_conns(void)
+{
+	struct sockaddr_in addr = {
+		.sin_family = AF_INET,
+		.sin_addr.s_addr = htonl(INADDR_LOOPBACK),
+	};
+	socklen_t len = sizeof(addr);
+	struct rlimit rlim;
+	unsigned int i;
+	int lfd, fd;
+
+	rlim.rlim_cur = rlim.rlim_max = 2 * cfg_conns + 64;
+	if (setrlimit(RLIMIT_NOFILE, &rlim))
+		fail("setrlimit: %s\n", strerror(errno));
+
+	lfd = socket(AF_INET, SOCK_STREAM, 0);
+	if (lfd < 0)
+		fail("socket: %s\n", strerror(errno));
+	if (bind(lfd, (struct sockaddr *)&addr, len) || listen(lfd, 128) ||
+	    getsockname(lfd, (struct sockaddr *)&addr, &len))
+		fail("listen: %s\n", strerror(errno));
+
+	for (i = 0; i < cfg_conns; i++) {
+		struct sockaddr_in src = {
+			.sin_family = AF_INET,
+			.sin_addr.s_addr = htonl(0x7f010000 | (i & 0xffff)),
+		};
+
+		fd = socket(AF_INET, SOCK_STREAM, 0);
+		if (fd < 0)
+			fail("socket: %s\n", strerror(errno));
+		if (bind(fd, (struct sockaddr *)&src, sizeof(src)))
+			fail("bind: %s\n", strerror(errno));
+		if (connect(fd, (struct sockaddr *)&addr, sizeof(addr)))
+			fail("connect: %s\n", strerror(errno));
+		if (accept(lfd, NULL, NULL) < 0)
+			fail("accept: %s\n", strerror(errno));
+	}
+}
+
+/* Read @fd to the end like cat(1) does, return the number of lines */
+static unsigned long dump(int fd)
+{
+	unsigned long lines = 0;
+	ssize_t n, i;
+
+	while ((n = read(fd, buf, sizeof(buf))) > 0)
+		for (i = 0; i < n; i++)
+			lines += buf[i] == '\n';
+	if (n < 0)
+		fail("read: %s\n", strerror(errno));
+
+	close(fd);
+	return lines;
+}
+
+static void report(const char *what, unsigned long long wall,
+		   unsigned long long cpu, unsigned long lines)
+{
+	printf("%-16s %10llu us/dump %10llu cpu us/dump %8lu lines\n", what,
+	       wall / cfg_repeat, cpu / cfg_repeat, lines);
+}
+
+static void run(int prog_fd)
+{
+	unsigned long long wall, cpu;
+	unsigned long lines = 0;
+	unsigned int i;
+	int fd;
+
+	wall = now_us();
+	cpu = cpu_us();
+	for (i = 0; i < cfg_repeat; i++) {
+		fd = open("/proc/net/tcp", O_RDONLY);
+		if (fd < 0)
+			fail("open: %s\n", strerror(errno));
+		lines = dump(fd);
+	}
+	report("/proc/net/tcp", now_us() - wall, cpu_us() - cpu, lines);
+
+	wall = now_us();
+	cpu = cpu_us();
+	for (i = 0; i < cfg_repeat; i++) {
+		fd = bpf_iter_create(prog_fd, 0, 0);
+		if (fd < 0)
+			fail("bpf_iter_create: %s\n", strerror(errno));
+		lines = dump(fd);
+	}
+	report("bpf iterator", now_us() - wall, cpu_us() - cpu, lines);
+}
+
+static void parse_opts(int argc, char **argv)
+{
+	int c;
+
+	while ((c = getopt(argc, argv, "n:r:")) != -1) {
+		switch (c) {
+		case 'n':
+			cfg_conns = strtoul(optarg, NULL, 0);
+			break;
+		case 'r':
+			cfg_repeat = strtoul(optarg, NULL, 0);
+			break;
+		default:
+			fail("usage: %s [-n connections] [-r repeat]\n",
+			     argv[0]);
+		}
+	}
+
+	if (!cfg_repeat || cfg_conns > 0xffff)
+		fail("repeat must not be zero, at most 65535 connections\n");
+}
+
+int main(int argc, char **argv)
+{
+	struct bpf_prog_load_attr attr = {
+		.file = "./test_iter_kern.o",
+	};
+	struct bpf_program *prog;
+	struct bpf_object *obj;
+	int fd;
+
+	parse_opts(argc, argv);
+
+	if (bpf_prog_load_xattr(&attr, &obj, &fd))
+		fail("bpf_prog_load_xattr %s\n", attr.file);
+	prog = bpf_object__find_program_by_title(obj, "iter/tcp");
+	if (!prog)
+		fail("no iter/tcp program\n");
+
+	open_conns();
+	printf("%u connections, %u sockets\n", cfg_conns, 2 * cfg_conns + 1);
+	run(bpf_program__fd(prog));
+
+	bpf_object__close(obj);
+	return 0;
+}
@@ -0,0 +1,300 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * Tests for BPF_MAP_TYPE_TASK_STORAGE and BPF_MAP_TYPE_INODE_STORAGE: a
+ * raw tracepoint program counts the getpgid() calls of this process in the
+ * storage of the calling task and of the inode of a file it has open, the
+ * test checks the counts through the syscall side of the maps, that
+ * storage is neither inherited nor shared, and the creation and verifier
+ * errors.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/syscall.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <linux/bpf.h>
+#include <bpf/bpf.h>
+#include <bpf/libbpf.h>
+
+#include "bpf_rlimit.h"
+#include "bpf_util.h"
+#include "test_local_storage_common.h"
+#include "../../../include/linux/filter.h"
+
+#define CALLS	10
+
+#define fail(format...) ({					\
+	printf("%s(%d):FAIL: ", __func__, __LINE__);		\
+	printf(format);						\
+	exit(1);						\
+})
+
+static struct bpf_object *obj;
+static int results_fd, task_fd, inode_fd;
+
+static int map_fd(const char *name)
+{
+	struct bpf_map *map;
+
+	map = bpf_object__find_map_by_name(obj, name);
+	if (!map)
+		fail("no map %s\n", name);
+	return bpf_map__fd(map);
+}
+
+static void set_result(__u32 key, __u64 value)
+{
+	if (bpf_map_update_elem(results_fd, &key, &value, BPF_ANY))
+		fail("bpf_map_update_elem: %s\n", strerror(errno));
+}
+
+static __u64 result(__u32 key)
+{
+	__u64 value;
+
+	if (bpf_map_lookup_elem(results_fd, &key, &value))
+		fail("bpf_map_lookup_elem: %s\n", strerror(errno));
+	return value;
+}
+
+/* The count of key in a storage map, -1 if it has none */
+static long long count(int fd, int key)
+{
+	__u64 value;
+
+	if (bpf_map_lookup_elem(fd, &key, &value)) {
+		if (errno != ENOENT)
+			fail("bpf_map_lookup_elem: %s\n", strerror(errno));
+		return -1;
+	}
+	return value;
+}
+
+static void call_getpgid(int calls)
+{
+	int i;
+
+	for (i = 0; i < calls; i++)
+		syscall(__NR_getpgid, 0);
+}
+
+static int open_tmp(char *name)
+{
+	int fd;
+
+	fd = mkstemp(name);
+	if (fd < 0)
+		fail("mkstemp: %s\n", strerror(errno));
+	return fd;
+}
+
+static void test_storage(void)
+{
+	char name[] = "/tmp/test_local_storage.XXXXXX";
+	char other_name[] = "/tmp/test_local_storage.XXXXXX";
+	int fd, other_fd, same_fd, status;
+	int pipefd[2];
+	__u64 value;
+	pid_t pid;
+
+	fd = open_tmp(name);
+	other_fd = open_tmp(other_name);
+	set_result(RES_FD, fd);
+
+	call_getpgid(CALLS);
+	if (result(RES_GET_FAILS))
+		fail("%llu storage gets failed\n", result(RES_GET_FAILS));
+	if (count(task_fd, getpid()) != CALLS)
+		fail("task count %lld for %d calls\n",
+		     count(task_fd, getpid()), CALLS);
+
+	/* any fd open on the inode finds its storage */
+	same_fd = open(name, O_RDONLY);
+	if (same_fd < 0)
+		fail("open %s: %s\n", name, strerror(errno));
+	if (count(inode_fd, same_fd) != CALLS)
+		fail("inode count %lld for %d calls\n",
+		     count(inode_fd, same_fd), CALLS);
+	if (count(inode_fd, other_fd) != -1)
+		fail("an untouched inode has storage\n");
+
+	/* user space updates are seen by the program */
+	value = 100;
+	if (bpf_map_update_elem(task_fd, &(int){ getpid() }, &value, BPF_EXIST))
+		fail("updating the task storage: %s\n", strerror(errno));
+	if (bpf_map_update_elem(inode_fd, &other_fd, &value, BPF_EXIST) >= 0 ||
+	    errno != ENOENT)
+		fail("BPF_EXIST update of an inode without storage\n");
+	set_result(RES_FD, other_fd);
+	call_getpgid(CALLS);
+	if (count(task_fd, getpid()) != 100 + CALLS ||
+	    count(inode_fd, other_fd) != CALLS ||
+	    count(inode_fd, fd) != CALLS)
+		fail("counts %lld, %lld and %lld after the update\n",
+		     count(task_fd, getpid()), count(inode_fd, other_fd),
+		     count(inode_fd, fd));
+
+	/* the program deletes the storage of its task */
+	set_result(RES_DELETE, 1);
+	call_getpgid(1);
+	if (count(task_fd, getpid()) != -1)
+		fail("the task storage survived its deletion\n");
+	if (bpf_map_delete_elem(inode_fd, &same_fd))
+		fail("deleting the inode storage: %s\n", strerror(errno));
+	if (count(inode_fd, fd) != -1)
+		fail("the inode storage survived its deletion\n");
+	if (bpf_map_delete_elem(inode_fd, &same_fd) >= 0 || errno != ENOENT)
+		fail("deleted the inode storage twice\n");
+
+	/* a child does not inherit the storage of its parent */
+	call_getpgid(CALLS);
+	if (pipe(pipefd))
+		fail("pipe: %s\n", strerror(errno));
+	pid = fork();
+	if (pid < 0)
+		fail("fork: %s\n", strerror(errno));
+	if (!pid) {
+		close(pipefd[1]);
+		read(pipefd[0], &value, 1);
+		_exit(0);
+	}
+	close(pipefd[0]);
+	if (count(task_fd, pid) != -1)
+		fail("the child inherited the task storage\n");
+	value = 1;
+	if (bpf_map_update_elem(task_fd, &pid, &value, BPF_NOEXIST))
+		fail("creating the child's task storage: %s\n", strerror(errno));
+	if (count(task_fd, pid) != 1 || count(task_fd, getpid()) != CALLS)
+		fail("counts %lld and %lld of the child and the parent\n",
+		     count(task_fd, pid), count(task_fd, getpid()));
+	close(pipefd[1]);
+	if (waitpid(pid, &status, 0) != pid)
+		fail("waitpid: %s\n", strerror(errno));
+	if (bpf_map_update_elem(task_fd, &pid, &value, BPF_ANY) >= 0 ||
+	    errno != ESRCH)
+		fail("updated the storage of a reaped task\n");
+
+	if (result(RES_GET_FAILS))
+		fail("%llu storage gets failed\n", result(RES_GET_FAILS));
+	set_result(RES_FD, -1);
+
+	close(same_fd);
+	close(other_fd);
+	close(fd);
+	unlink(other_name);
+	unlink(name);
+}
+
+static void test_map_errors(void)
+{
+	struct bpf_create_map_attr attr = {
+		.map_type = BPF_MAP_TYPE_TASK_STORAGE,
+		.key_size = sizeof(int),
+		.value_size = sizeof(__u64),
+		.map_flags = BPF_F_NO_PREALLOC,
+	};
+	int key = getpid(), next_key;
+	int fd;
+
+	attr.max_entries = 1;
+	if (bpf_create_map_xattr(&attr) >= 0 || errno != EINVAL)
+		fail("created a task storage map with max_entries\n");
+	attr.max_entries = 0;
+
+	attr.map_flags = 0;
+	if (bpf_create_map_xattr(&attr) >= 0 || errno != EINVAL)
+		fail("created a preallocated task storage map\n");
+	attr.map_flags = BPF_F_NO_PREALLOC;
+
+	attr.key_size = sizeof(__u64);
+	if (bpf_create_map_xattr(&attr) >= 0 || errno != EINVAL)
+		fail("created a task storage map with a 64-bit key\n");
+	attr.key_size = sizeof(int);
+
+	fd = bpf_create_map_xattr(&attr);
+	if (fd < 0)
+		fail("bpf_create_map_xattr: %s\n", strerror(errno));
+	/* ENOTSUPP, the values cannot be iterated */
+	if (bpf_map_get_next_key(fd, &key, &next_key) >= 0 || errno != 524)
+		fail("iterated a task storage map\n");
+	close(fd);
+}
+
+/* Programs only reach the storage through its helpers */
+static void test_prog_errors(void)
+{
+	struct bpf_insn lookup[] = {
+		BPF_ST_MEM(BPF_W, BPF_REG_10, -4, 0),
+		BPF_MOV64_REG(BPF_REG_2, BPF_REG_10),
+		BPF_ALU64_IMM(BPF_ADD, BPF_REG_2, -4),
+		BPF_LD_MAP_FD(BPF_REG_1, task_fd),
+		BPF_RAW_INSN(BPF_JMP | BPF_CALL, 0, 0, 0,
+			     BPF_FUNC_map_lookup_elem),
+		BPF_MOV64_IMM(BPF_REG_0, 0),
+		BPF_EXIT_INSN(),
+	};
+	struct bpf_insn wrong_map[] = {
+		BPF_LD_MAP_FD(BPF_REG_1, inode_fd),
+		BPF_MOV64_IMM(BPF_REG_2, 0),
+		BPF_RAW_INSN(BPF_JMP | BPF_CALL, 0, 0, 0,
+			     BPF_FUNC_task_storage_get),
+		BPF_MOV64_IMM(BPF_REG_0, 0),
+		BPF_EXIT_INSN(),
+	};
+	struct bpf_load_program_attr attr = {
+		.prog_type = BPF_PROG_TYPE_RAW_TRACEPOINT,
+		.license = "GPL",
+	};
+
+	attr.insns = lookup;
+	attr.insns_cnt = ARRAY_SIZE(lookup);
+	if (bpf_load_program_xattr(&attr, NULL, 0) >= 0 || errno != EINVAL)
+		fail("program loaded looking up a task storage map\n");
+
+	attr.insns = wrong_map;
+	attr.insns_cnt = ARRAY_SIZE(wrong_map);
+	if (bpf_load_program_xattr(&attr, NULL, 0) >= 0 || errno != EINVAL)
+		fail("program loaded getting task storage from an inode map\n");
+}
+
+int main(void)
+{
+	struct bpf_prog_load_attr attr = {
+		.file = "./test_local_storage_kern.o",
+	};
+	struct bpf_program *prog;
+	int fd, link_fd;
+
+	if (bpf_prog_load_xattr(&attr, &obj, &fd))
+		fail("bpf_prog_load_xattr %s\n", attr.file);
+	results_fd = map_fd("results");
+	task_fd = map_fd("task_storage");
+	inode_fd = map_fd("inode_storage");
+
+	set_result(RES_TGID, getpid());
+	set_result(RES_NR, __NR_getpgid);
+	set_result(RES_FD, -1);
+
+	prog = bpf_object__find_program_by_title(obj,
+						 "raw_tracepoint/sys_enter");
+	if (!prog)
+		fail("no program raw_tracepoint/sys_enter\n");
+	link_fd = bpf_raw_tracepoint_open("sys_enter", bpf_program__fd(prog));
+	if (link_fd < 0)
+		fail("bpf_raw_tracepoint_open: %s\n", strerror(errno));
+
+	test_storage();
+	close(link_fd);
+
+	test_map_errors();
+	test_prog_errors();
+
+	bpf_object__close(obj);
+	printf("test_local_storage: OK\n");
+	return 0;
+}
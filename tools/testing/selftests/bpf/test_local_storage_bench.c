@@ -0,0 +1,211 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * Cost of per-task state in a syscall tracing program: task storage vs. a
+ * hash map keyed by thread id.
+ *
+ * Calls getpgid() -n times (default 10000000) with nothing attached to the
+ * sys_enter raw tracepoint, then with the programs of
+ * test_local_storage_kern.o attached, which count the calls of this
+ * process either in its task storage or in its element of a hash map. The
+ * hash map is filled with -e other threads (default 10000) first, as it is
+ * for a system wide tracer. Reports the time per call and the overhead
+ * over the untraced call.
+ *
+ * Usage: test_local_storage_bench [-n calls] [-e entries]
+ */
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <linux/bpf.h>
+#include <bpf/bpf.h>
+#include <bpf/libbpf.h>
+
+#include "bpf_rlimit.h"
+#include "test_local_storage_common.h"
+
+#define fail(format...) ({					\
+	printf("%s(%d):FAIL: ", __func__, __LINE__);		\
+	printf(format);						\
+	exit(1);						\
+})
+
+enum bench_mode {
+	BENCH_NONE,
+	BENCH_HASH,
+	BENCH_STORAGE,
+	NR_BENCH_MODES,
+};
+
+static const char * const mode_names[NR_BENCH_MODES] = {
+	[BENCH_NONE]	= "none",
+	[BENCH_HASH]	= "hash",
+	[BENCH_STORAGE]	= "storage",
+};
+
+static const char * const mode_progs[NR_BENCH_MODES] = {
+	[BENCH_HASH]	= "raw_tracepoint/sys_enter_hash",
+	[BENCH_STORAGE]	= "raw_tracepoint/sys_enter_storage",
+};
+
+static unsigned long cfg_calls = 10000000;
+static unsigned int cfg_entries = 10000;
+
+static struct bpf_object *obj;
+static int results_fd;
+
+static unsigned long long now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static int map_fd(const char *name)
+{
+	struct bpf_map *map;
+
+	map = bpf_object__find_map_by_name(obj, name);
+	if (!map)
+		fail("no map %s\n", name);
+	return bpf_map__fd(map);
+}
+
+static void set_result(__u32 key, __u64 value)
+{
+	if (bpf_map_update_elem(results_fd, &key, &value, BPF_ANY))
+		fail("bpf_map_update_elem: %s\n", strerror(errno));
+}
+
+static __u64 get_result(__u32 key)
+{
+	__u64 value;
+
+	if (bpf_map_lookup_elem(results_fd, &key, &value))
+		fail("bpf_map_lookup_elem: %s\n", strerror(errno));
+	return value;
+}
+
+/* Fill the hash map with thread ids that are not ours */
+static void fill_hash(void)
+{
+	int fd = map_fd("task_hash");
+	__u32 tid, self = syscall(__NR_gettid);
+	__u64 zero = 0;
+	unsigned int i;
+
+	for (i = 0, tid = 1 << 22; i < cfg_entries; i++, tid++) {
+		if (tid == self)
+			continue;
+		if (bpf_map_update_elem(fd, &tid, &zero, BPF_ANY))
+			fail("filling the hash map: %s\n", strerror(errno));
+	}
+}
+
+/* The count of the program, kept in the map it benchmarks */
+static __u64 get_count(int mode)
+{
+	int key = mode == BENCH_HASH ? syscall(__NR_gettid) : getpid();
+	int fd = map_fd(mode == BENCH_HASH ? "task_hash" : "task_storage");
+	__u64 value;
+
+	if (bpf_map_lookup_elem(fd, &key, &value))
+		fail("%s: no count: %s\n", mode_names[mode], strerror(errno));
+	return value;
+}
+
+/* Return the time per call in ns */
+static double run(int mode)
+{
+	unsigned long long start, elapsed;
+	struct bpf_program *prog;
+	unsigned long i;
+	int fd = -1;
+
+	if (mode != BENCH_NONE) {
+		prog = bpf_object__find_program_by_title(obj, mode_progs[mode]);
+		if (!prog)
+			fail("no program %s\n", mode_progs[mode]);
+		fd = bpf_raw_tracepoint_open("sys_enter",
+					     bpf_program__fd(prog));
+		if (fd < 0)
+			fail("bpf_raw_tracepoint_open: %s\n", strerror(errno));
+	}
+
+	start = now_ns();
+	for (i = 0; i < cfg_calls; i++)
+		syscall(__NR_getpgid, 0);
+	elapsed = now_ns() - start;
+
+	if (fd >= 0) {
+		close(fd);
+		if (get_count(mode) != cfg_calls)
+			fail("%s: counted %llu of %lu calls\n", mode_names[mode],
+			     get_count(mode), cfg_calls);
+	}
+	if (get_result(RES_GET_FAILS))
+		fail("%s: %llu failed gets\n", mode_names[mode],
+		     get_result(RES_GET_FAILS));
+
+	return (double)elapsed / cfg_calls;
+}
+
+static void parse_opts(int argc, char **argv)
+{
+	int c;
+
+	while ((c = getopt(argc, argv, "n:e:")) != -1) {
+		switch (c) {
+		case 'n':
+			cfg_calls = strtoul(optarg, NULL, 0);
+			break;
+		case 'e':
+			cfg_entries = strtoul(optarg, NULL, 0);
+			break;
+		default:
+			fail("usage: %s [-n calls] [-e entries]\n", argv[0]);
+		}
+	}
+
+	if (!cfg_calls)
+		fail("calls must not be zero\n");
+	if (cfg_entries >= 1 << 16)
+		fail("at most %u entries\n", (1 << 16) - 1);
+}
+
+int main(int argc, char **argv)
+{
+	struct bpf_prog_load_attr attr = {
+		.file = "./test_local_storage_kern.o",
+	};
+	double base, ns;
+	int mode, fd;
+
+	parse_opts(argc, argv);
+
+	if (bpf_prog_load_xattr(&attr, &obj, &fd))
+		fail("bpf_prog_load_xattr %s\n", attr.file);
+	results_fd = map_fd("results");
+	set_result(RES_TGID, getpid());
+	set_result(RES_NR, __NR_getpgid);
+	fill_hash();
+
+	printf("%lu getpgid() calls, %u other threads in the hash map\n",
+	       cfg_calls, cfg_entries);
+	base = run(BENCH_NONE);
+	printf("%-8s %8.1f ns/call\n", mode_names[BENCH_NONE], base);
+	for (mode = BENCH_NONE + 1; mode < NR_BENCH_MODES; mode++) {
+		ns = run(mode);
+		printf("%-8s %8.1f ns/call %8.1f ns overhead\n",
+		       mode_names[mode], ns, ns - base);
+	}
+
+	bpf_object__close(obj);
+	return 0;
+}
@@ -0,0 +1,16 @@
+/* SPDX-License-Identifier: GPL-2.0 */
+
+#ifndef __TEST_LOCAL_STORAGE_COMMON_H
+#define __TEST_LOCAL_STORAGE_COMMON_H
+
+/* Slots of the results array of test_local_storage_kern.o */
+enum local_storage_result {
+	RES_TGID,		/* process the programs count, set by the test */
+	RES_NR,			/* syscall the programs count, set by the test */
+	RES_FD,			/* fd of the inode storage, set by the test */
+	RES_DELETE,		/* delete the task storage on the next call */
+	RES_GET_FAILS,		/* storage gets that returned NULL */
+	NR_RESULTS,
+};
+
+#endif
@@ -0,0 +1,132 @@
+// SPDX-License-Identifier: GPL-2.0
+
+#include <linux/bpf.h>
+#include "bpf_helpers.h"
+#include "test_local_storage_common.h"
+
+struct bpf_map_def SEC("maps") results = {
+	.type = BPF_MAP_TYPE_ARRAY,
+	.key_size = sizeof(__u32),
+	.value_size = sizeof(__u64),
+	.max_entries = NR_RESULTS,
+};
+
+/* Per task and per inode count of calls */
+struct bpf_map_def SEC("maps") task_storage = {
+	.type = BPF_MAP_TYPE_TASK_STORAGE,
+	.key_size = sizeof(int),
+	.value_size = sizeof(__u64),
+	.map_flags = BPF_F_NO_PREALLOC,
+};
+
+struct bpf_map_def SEC("maps") inode_storage = {
+	.type = BPF_MAP_TYPE_INODE_STORAGE,
+	.key_size = sizeof(int),
+	.value_size = sizeof(__u64),
+	.map_flags = BPF_F_NO_PREALLOC,
+};
+
+/* The same count in a hash keyed by thread id, for the benchmark */
+struct bpf_map_def SEC("maps") task_hash = {
+	.type = BPF_MAP_TYPE_HASH,
+	.key_size = sizeof(__u32),
+	.value_size = sizeof(__u64),
+	.max_entries = 1 << 16,
+};
+
+static __always_inline __u64 *result(__u32 key)
+{
+	return bpf_map_lookup_elem(&results, &key);
+}
+
+static __always_inline void count_fail(void)
+{
+	__u64 *fails = result(RES_GET_FAILS);
+
+	if (fails)
+		__sync_fetch_and_add(fails, 1);
+}
+
+/* sys_enter(regs, id) of the traced process for the syscall under test */
+static __always_inline int traced_call(struct bpf_raw_tracepoint_args *ctx)
+{
+	__u64 *tgid = result(RES_TGID);
+	__u64 *nr = result(RES_NR);
+
+	return tgid && nr && *tgid == bpf_get_current_pid_tgid() >> 32 &&
+	       *nr == ctx->args[1];
+}
+
+SEC("raw_tracepoint/sys_enter")
+int count_calls(struct bpf_raw_tracepoint_args *ctx)
+{
+	__u64 *fd = result(RES_FD);
+	__u64 *del = result(RES_DELETE);
+	__u64 *calls;
+
+	if (!fd || !del || !traced_call(ctx))
+		return 0;
+
+	if (*del) {
+		*del = 0;
+		bpf_task_storage_delete(&task_storage);
+		return 0;
+	}
+
+	calls = bpf_task_storage_get(&task_storage,
+				     BPF_LOCAL_STORAGE_GET_F_CREATE);
+	if (calls)
+		__sync_fetch_and_add(calls, 1);
+	else
+		count_fail();
+
+	calls = bpf_inode_storage_get(&inode_storage, *fd,
+				      BPF_LOCAL_STORAGE_GET_F_CREATE);
+	if (calls)
+		__sync_fetch_and_add(calls, 1);
+	else
+		count_fail();
+
+	return 0;
+}
+
+/* The programs compared by test_local_storage_bench */
+SEC("raw_tracepoint/sys_enter_storage")
+int bench_storage(struct bpf_raw_tracepoint_args *ctx)
+{
+	__u64 *calls;
+
+	if (!traced_call(ctx))
+		return 0;
+
+	calls = bpf_task_storage_get(&task_storage,
+				     BPF_LOCAL_STORAGE_GET_F_CREATE);
+	if (calls)
+		__sync_fetch_and_add(calls, 1);
+	else
+		count_fail();
+	return 0;
+}
+
+SEC("raw_tracepoint/sys_enter_hash")
+int bench_hash(struct bpf_raw_tracepoint_args *ctx)
+{
+	__u32 tid = bpf_get_current_pid_tgid();
+	__u64 zero = 0, *calls;
+
+	if (!traced_call(ctx))
+		return 0;
+
+	calls = bpf_map_lookup_elem(&task_hash, &tid);
+	if (!calls) {
+		bpf_map_update_elem(&task_hash, &tid, &zero, BPF_NOEXIST);
+		calls = bpf_map_lookup_elem(&task_hash, &tid);
+	}
+	if (calls)
+		__sync_fetch_and_add(calls, 1);
+	else
+		count_fail();
+	return 0;
+}
+
+char _license[] SEC("license") = "GPL";
@@ -0,0 +1,220 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * LPM trie lookup benchmark: binary trie vs. multibit table.
+ *
+ * Fills an LPM trie with random prefixes and runs an XDP program -r times
+ * (default 10000000) through BPF_PROG_TEST_RUN that looks up a random
+ * address, once on a plain map and once on a map created with
+ * BPF_F_LPM_MULTIBIT. IPv4 prefixes are mostly /24s, as in a routing
+ * table; with -6 IPv6 /40 to /64 prefixes below 2001:db8::/32 are used and
+ * looked up from the same /32, which makes the trie walks long.
+ *
+ * By default this is done for 10000, 100000 and 1000000 prefixes, -n runs
+ * a single size instead.
+ *
+ * Usage: test_lpm_bench [-n prefixes] [-r repeat] [-6]
+ */
+
+#include <errno.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+
+#include <linux/bpf.h>
+#include <linux/filter.h>
+#include <bpf/bpf.h>
+
+#include "bpf_rlimit.h"
+#include "bpf_util.h"
+
+#define fail(format...) ({					\
+	printf("%s(%d):FAIL: ", __func__, __LINE__);		\
+	printf(format);						\
+	exit(1);						\
+})
+
+#define MAX_INSNS	32
+
+static __u32 cfg_prefixes;
+static __u32 cfg_repeat = 10000000;
+static bool cfg_ipv6;
+
+static size_t data_size;
+
+static long long fdinfo_field(int fd, const char *field)
+{
+	long long val = -1;
+	char buff[256];
+	FILE *fp;
+
+	snprintf(buff, sizeof(buff), "/proc/%d/fdinfo/%d", getpid(), fd);
+	fp = fopen(buff, "r");
+	if (!fp)
+		fail("fopen %s: %s\n", buff, strerror(errno));
+
+	while (fgets(buff, sizeof(buff), fp)) {
+		if (strncmp(buff, field, strlen(field)) ||
+		    buff[strlen(field)] != ':')
+			continue;
+		val = strtoll(buff + strlen(field) + 1, NULL, 0);
+		break;
+	}
+
+	fclose(fp);
+	return val;
+}
+
+static void gen_prefix(struct bpf_lpm_trie_key *key)
+{
+	static const __u32 ipv6_lens[] = { 40, 48, 56, 64 };
+	__u32 addr = rand() ^ (rand() << 16);
+
+	if (cfg_ipv6) {
+		memset(key->data, 0, data_size);
+		*(__u32 *)key->data = htonl(0x20010db8);
+		memcpy(key->data + 4, &addr, sizeof(addr));
+		key->prefixlen = ipv6_lens[rand() % ARRAY_SIZE(ipv6_lens)];
+	} else {
+		memcpy(key->data, &addr, sizeof(addr));
+		key->prefixlen = rand() % 10 < 6 ? 24 : 8 + rand() % 25;
+	}
+}
+
+/* Build the key on the stack at fp - key_size and look it up */
+static int load_prog(int map_fd)
+{
+	int key_off = -(int)(sizeof(struct bpf_lpm_trie_key) + data_size);
+	struct bpf_insn ld_map[] = { BPF_LD_MAP_FD(BPF_REG_1, map_fd) };
+	struct bpf_insn prog[MAX_INSNS], *insn = prog;
+	char log[4096];
+	int off, fd;
+
+	*insn++ = BPF_ST_MEM(BPF_W, BPF_REG_10, key_off, data_size * 8);
+	off = key_off + sizeof(struct bpf_lpm_trie_key);
+	if (cfg_ipv6) {
+		*insn++ = BPF_ST_MEM(BPF_W, BPF_REG_10, off,
+				     htonl(0x20010db8));
+		off += 4;
+	}
+	for (; off < 0; off += 4) {
+		*insn++ = BPF_EMIT_CALL(BPF_FUNC_get_prandom_u32);
+		*insn++ = BPF_STX_MEM(BPF_W, BPF_REG_10, BPF_REG_0, off);
+	}
+	*insn++ = BPF_MOV64_REG(BPF_REG_2, BPF_REG_10);
+	*insn++ = BPF_ALU64_IMM(BPF_ADD, BPF_REG_2, key_off);
+	memcpy(insn, ld_map, sizeof(ld_map));
+	insn += ARRAY_SIZE(ld_map);
+	*insn++ = BPF_EMIT_CALL(BPF_FUNC_map_lookup_elem);
+	*insn++ = BPF_MOV64_IMM(BPF_REG_0, XDP_PASS);
+	*insn++ = BPF_EXIT_INSN();
+
+	fd = bpf_load_program(BPF_PROG_TYPE_XDP, prog, insn - prog, "GPL", 0,
+			      log, sizeof(log));
+	if (fd < 0)
+		fail("bpf_load_program: %s\n%s", strerror(errno), log);
+	return fd;
+}
+
+static void run(__u32 nr_prefixes, __u32 map_flags)
+{
+	size_t key_size = sizeof(struct bpf_lpm_trie_key) + data_size;
+	struct bpf_lpm_trie_key *key;
+	__u32 i, retval, duration;
+	int map_fd, prog_fd;
+	char pkt[64] = {0};
+	__u64 value = 0;
+
+	map_fd = bpf_create_map(BPF_MAP_TYPE_LPM_TRIE, key_size, sizeof(value),
+				nr_prefixes, BPF_F_NO_PREALLOC | map_flags);
+	if (map_fd < 0)
+		fail("bpf_create_map: %s\n", strerror(errno));
+
+	key = calloc(1, key_size);
+	if (!key)
+		fail("calloc\n");
+
+	/* same prefixes for every map of a given size */
+	srand(nr_prefixes);
+	for (i = 0; i < nr_prefixes; i++) {
+		gen_prefix(key);
+		if (bpf_map_update_elem(map_fd, key, &value, BPF_ANY))
+			fail("bpf_map_update_elem: %s\n", strerror(errno));
+	}
+	free(key);
+
+	/* lookups only use the table once it caught up with the updates */
+	if (map_flags & BPF_F_LPM_MULTIBIT)
+		while (fdinfo_field(map_fd, "multibit_current") != 1)
+			usleep(10000);
+
+	prog_fd = load_prog(map_fd);
+	if (bpf_prog_test_run(prog_fd, cfg_repeat, pkt, sizeof(pkt), NULL,
+			      NULL, &retval, &duration))
+		fail("bpf_prog_test_run: %s\n", strerror(errno));
+	if (retval != XDP_PASS)
+		fail("unexpected retval %u\n", retval);
+
+	printf("%-8s %8u prefixes %5u ns/op %8.2f Mlookups/s",
+	       map_flags & BPF_F_LPM_MULTIBIT ? "multibit" : "trie",
+	       nr_prefixes, duration, duration ? 1000.0 / duration : 0);
+	if (map_flags & BPF_F_LPM_MULTIBIT)
+		printf(" %8lld nodes %9lld leaves",
+		       fdinfo_field(map_fd, "multibit_nodes"),
+		       fdinfo_field(map_fd, "multibit_leaves"));
+	printf("\n");
+
+	close(prog_fd);
+	close(map_fd);
+}
+
+static void parse_opts(int argc, char **argv)
+{
+	int c;
+
+	while ((c = getopt(argc, argv, "6n:r:")) != -1) {
+		switch (c) {
+		case '6':
+			cfg_ipv6 = true;
+			break;
+		case 'n':
+			cfg_prefixes = strtoul(optarg, NULL, 0);
+			if (!cfg_prefixes)
+				fail("prefixes must not be zero\n");
+			break;
+		case 'r':
+			cfg_repeat = strtoul(optarg, NULL, 0);
+			break;
+		default:
+			fail("usage: %s [-n prefixes] [-r repeat] [-6]\n",
+			     argv[0]);
+		}
+	}
+
+	if (!cfg_repeat)
+		fail("repeat must not be zero\n");
+}
+
+int main(int argc, char **argv)
+{
+	static const __u32 sizes[] = { 10000, 100000, 1000000 };
+	unsigned int i;
+
+	parse_opts(argc, argv);
+	data_size = cfg_ipv6 ? 16 : 4;
+
+	printf("%s, %u runs\n", cfg_ipv6 ? "IPv6" : "IPv4", cfg_repeat);
+
+	for (i = 0; i < ARRAY_SIZE(sizes); i++) {
+		__u32 n = cfg_prefixes ? cfg_prefixes : sizes[i];
+
+		run(n, 0);
+		run(n, BPF_F_LPM_MULTIBIT);
+		if (cfg_prefixes)
+			break;
+	}
+
+	return 0;
+}
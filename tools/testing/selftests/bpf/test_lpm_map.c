@@ -206,7 +206,29 @@ static void test_lpm_order(void)
 	tlpm_clear(l2);
 }
 
-static void test_lpm_map(int keysize)
+/* Wait for the multibit table of @map to catch up with its trie */
+static void lpm_wait_multibit(int map)
+{
+	char buff[128];
+	int i, current = 0;
+	FILE *fp;
+
+	for (i = 0; i < 1000 && !current; i++) {
+		snprintf(buff, sizeof(buff), "/proc/%d/fdinfo/%d",
+			 getpid(), map);
+		fp = fopen(buff, "r");
+		assert(fp);
+		while (fgets(buff, sizeof(buff), fp))
+			if (!strcmp(buff, "multibit_current:\t1\n"))
+				current = 1;
+		fclose(fp);
+		if (!current)
+			usleep(1000);
+	}
+	assert(current);
+}
+
+static void test_lpm_map(int keysize, __u32 map_flags)
 {
 	size_t i, j, n_matches, n_matches_after_delete, n_nodes, n_lookups;
 	struct tlpm_node *t, *list = NULL;
@@ -237,7 +259,7 @@ static void test_lpm_map(int keysize)
 			     sizeof(*key) + keysize,
 			     keysize + 1,
 			     4096,
-			     BPF_F_NO_PREALLOC);
+			     BPF_F_NO_PREALLOC | map_flags);
 	assert(map >= 0);
 
 	for (i = 0; i < n_nodes; ++i) {
@@ -253,6 +275,9 @@ static void test_lpm_map(int keysize)
 		assert(!r);
 	}
 
+	if (map_flags & BPF_F_LPM_MULTIBIT)
+		lpm_wait_multibit(map);
+
 	for (i = 0; i < n_lookups; ++i) {
 		for (j = 0; j < keysize; ++j)
 			data[j] = rand() & 0xff;
@@ -290,6 +315,8 @@ static void test_lpm_map(int keysize)
 		list = tlpm_delete(list, list->key, list->n_bits);
 		assert(list);
 	}
+	if (map_flags & BPF_F_LPM_MULTIBIT)
+		lpm_wait_multibit(map);
 	for (i = 0; i < n_lookups; ++i) {
 		for (j = 0; j < keysize; ++j)
 			data[j] = rand() & 0xff;
@@ -325,6 +352,22 @@ static void test_lpm_map(int keysize)
 	 */
 }
 
+static void test_lpm_multibit_size(void)
+{
+	size_t key_size = sizeof(struct bpf_lpm_trie_key);
+	int map;
+
+	/* the multibit table is limited to IPv6 sized keys */
+	map = bpf_create_map(BPF_MAP_TYPE_LPM_TRIE, key_size + 16, 1, 1,
+			     BPF_F_NO_PREALLOC | BPF_F_LPM_MULTIBIT);
+	assert(map >= 0);
+	close(map);
+
+	map = bpf_create_map(BPF_MAP_TYPE_LPM_TRIE, key_size + 17, 1, 1,
+			     BPF_F_NO_PREALLOC | BPF_F_LPM_MULTIBIT);
+	assert(map < 0 && errno == EINVAL);
+}
+
 /* Test the implementation with some 'real world' examples */
 
 static void test_lpm_ipaddr(void)
@@ -757,7 +800,12 @@ int main(void)
 
 	/* Test with 8, 16, 24, 32, ... 128 bit prefix length */
 	for (i = 1; i <= 16; ++i)
-		test_lpm_map(i);
+		test_lpm_map(i, 0);
+
+	/* and the same with the multibit table */
+	for (i = 1; i <= 16; ++i)
+		test_lpm_map(i, BPF_F_LPM_MULTIBIT);
+	test_lpm_multibit_size();
 
 	test_lpm_ipaddr();
 	test_lpm_delete();
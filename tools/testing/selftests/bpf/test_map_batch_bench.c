@@ -0,0 +1,296 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * Map dump benchmark: batched syscalls vs. one element at a time.
+ *
+ * Fills a hash map of -n entries (default 1000000) and measures the time to
+ * populate it, to dump it and to drain it, once with one BPF_MAP_*_ELEM /
+ * BPF_MAP_GET_NEXT_KEY syscall per element and once with the
+ * BPF_MAP_*_BATCH commands moving -b elements (default 4096) per syscall.
+ * With -a the same is done for an array map, which has no delete.
+ *
+ * Usage: test_map_batch_bench [-n entries] [-b batch] [-a] [-p]
+ */
+
+#include <errno.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <linux/bpf.h>
+#include <bpf/bpf.h>
+
+#include "bpf_rlimit.h"
+#include "bpf_util.h"
+
+#define fail(format...) ({					\
+	printf("%s(%d):FAIL: ", __func__, __LINE__);		\
+	printf(format);						\
+	exit(1);						\
+})
+
+struct flow_key {
+	__u32 saddr;
+	__u32 daddr;
+	__u16 sport;
+	__u16 dport;
+	__u32 proto;
+};
+
+struct flow_value {
+	__u64 packets;
+	__u64 bytes;
+};
+
+static __u32 cfg_entries = 1000000;
+static __u32 cfg_batch = 4096;
+static bool cfg_array;
+static bool cfg_percpu;
+
+static size_t key_size, value_size;
+static void *keys, *values;
+
+static unsigned long now_ms(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000UL + ts.tv_nsec / 1000000UL;
+}
+
+static void gen_elems(void)
+{
+	__u32 i;
+
+	for (i = 0; i < cfg_entries; i++) {
+		if (cfg_array) {
+			((__u32 *)keys)[i] = i;
+		} else {
+			struct flow_key *k = keys + i * key_size;
+
+			memset(k, 0, sizeof(*k));
+			k->saddr = 0x0a000000 | (i >> 8);
+			k->daddr = 0x0a800000 | (i & 0xff);
+			k->sport = i;
+			k->dport = 80;
+			k->proto = 6;
+		}
+		memset(values + i * value_size, i, value_size);
+	}
+}
+
+static int create_map(void)
+{
+	enum bpf_map_type type;
+	int fd;
+
+	if (cfg_array)
+		type = cfg_percpu ? BPF_MAP_TYPE_PERCPU_ARRAY :
+				    BPF_MAP_TYPE_ARRAY;
+	else
+		type = cfg_percpu ? BPF_MAP_TYPE_PERCPU_HASH :
+				    BPF_MAP_TYPE_HASH;
+
+	fd = bpf_create_map(type, key_size, sizeof(struct flow_value),
+			    cfg_entries, 0);
+	if (fd < 0)
+		fail("bpf_create_map: %s\n", strerror(errno));
+	return fd;
+}
+
+static void update_elem(int fd)
+{
+	__u32 i;
+
+	for (i = 0; i < cfg_entries; i++)
+		if (bpf_map_update_elem(fd, keys + i * key_size,
+					values + i * value_size, BPF_ANY))
+			fail("bpf_map_update_elem: %s\n", strerror(errno));
+}
+
+static void update_batch(int fd)
+{
+	__u32 i, count;
+
+	for (i = 0; i < cfg_entries; i += count) {
+		count = cfg_entries - i < cfg_batch ? cfg_entries - i :
+						      cfg_batch;
+		if (bpf_map_update_batch(fd, keys + i * key_size,
+					 values + i * value_size, &count,
+					 BPF_ANY, 0))
+			fail("bpf_map_update_batch: %s\n", strerror(errno));
+	}
+}
+
+static __u32 dump_elem(int fd, bool delete)
+{
+	void *key, *next_key, *value;
+	__u32 n = 0;
+
+	key = malloc(key_size);
+	next_key = malloc(key_size);
+	value = malloc(value_size);
+	if (!key || !next_key || !value)
+		fail("malloc\n");
+
+	if (bpf_map_get_next_key(fd, NULL, next_key))
+		goto out;
+	do {
+		if (bpf_map_lookup_elem(fd, next_key, value))
+			fail("bpf_map_lookup_elem: %s\n", strerror(errno));
+		n++;
+		if (delete) {
+			/* the deleted key cannot be used as a cursor, always
+			 * restart from the head of the map
+			 */
+			if (bpf_map_delete_elem(fd, next_key))
+				fail("bpf_map_delete_elem: %s\n",
+				     strerror(errno));
+			if (bpf_map_get_next_key(fd, NULL, next_key))
+				break;
+			continue;
+		}
+		memcpy(key, next_key, key_size);
+	} while (!bpf_map_get_next_key(fd, key, next_key));
+
+out:
+	free(key);
+	free(next_key);
+	free(value);
+	return n;
+}
+
+static __u32 dump_batch(int fd, bool delete)
+{
+	__u64 batch[2], next_batch[2];
+	__u32 count, total = 0;
+	int err;
+
+	/* the cursor is as large as a key for the generic implementation */
+	do {
+		count = cfg_batch;
+		if (total + count > cfg_entries)
+			count = cfg_entries - total;
+		if (delete)
+			err = bpf_map_lookup_and_delete_batch(fd,
+					total ? batch : NULL, next_batch,
+					keys + total * key_size,
+					values + total * value_size,
+					&count, 0, 0);
+		else
+			err = bpf_map_lookup_batch(fd,
+					total ? batch : NULL, next_batch,
+					keys + total * key_size,
+					values + total * value_size,
+					&count, 0, 0);
+		if (err && errno != ENOENT)
+			fail("lookup batch: %s\n", strerror(errno));
+		total += count;
+		memcpy(batch, next_batch, sizeof(batch));
+	} while (!err && total < cfg_entries);
+
+	return total;
+}
+
+static void report(const char *what, unsigned long ms, __u32 n)
+{
+	printf("%-32s %8lu ms %10u elems %10lu elems/s\n", what, ms, n,
+	       ms ? n * 1000UL / ms : 0);
+}
+
+static void run(void)
+{
+	unsigned long t;
+	__u32 n;
+	int fd;
+
+	fd = create_map();
+
+	t = now_ms();
+	update_elem(fd);
+	report("update, per element", now_ms() - t, cfg_entries);
+
+	t = now_ms();
+	n = dump_elem(fd, false);
+	report("lookup, per element", now_ms() - t, n);
+
+	if (!cfg_array) {
+		t = now_ms();
+		n = dump_elem(fd, true);
+		report("lookup and delete, per element", now_ms() - t, n);
+	}
+	close(fd);
+
+	fd = create_map();
+
+	t = now_ms();
+	update_batch(fd);
+	report("update, batched", now_ms() - t, cfg_entries);
+
+	t = now_ms();
+	n = dump_batch(fd, false);
+	report("lookup, batched", now_ms() - t, n);
+
+	if (!cfg_array) {
+		t = now_ms();
+		n = dump_batch(fd, true);
+		report("lookup and delete, batched", now_ms() - t, n);
+	}
+	close(fd);
+}
+
+static void parse_opts(int argc, char **argv)
+{
+	int c;
+
+	while ((c = getopt(argc, argv, "ab:n:p")) != -1) {
+		switch (c) {
+		case 'a':
+			cfg_array = true;
+			break;
+		case 'b':
+			cfg_batch = strtoul(optarg, NULL, 0);
+			break;
+		case 'n':
+			cfg_entries = strtoul(optarg, NULL, 0);
+			break;
+		case 'p':
+			cfg_percpu = true;
+			break;
+		default:
+			fail("usage: %s [-n entries] [-b batch] [-a] [-p]\n",
+			     argv[0]);
+		}
+	}
+
+	if (!cfg_entries || !cfg_batch)
+		fail("entries and batch size must not be zero\n");
+}
+
+int main(int argc, char **argv)
+{
+	parse_opts(argc, argv);
+
+	key_size = cfg_array ? sizeof(__u32) : sizeof(struct flow_key);
+	value_size = sizeof(struct flow_value);
+	if (cfg_percpu)
+		value_size *= bpf_num_possible_cpus();
+
+	keys = calloc(cfg_entries, key_size);
+	values = calloc(cfg_entries, value_size);
+	if (!keys || !values)
+		fail("calloc\n");
+
+	printf("%s%s map, %u entries, batch %u\n",
+	       cfg_percpu ? "per-cpu " : "", cfg_array ? "array" : "hash",
+	       cfg_entries, cfg_batch);
+
+	gen_elems();
+	run();
+
+	free(keys);
+	free(values);
+	return 0;
+}
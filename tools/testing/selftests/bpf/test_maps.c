@@ -305,6 +305,309 @@ static void test_hashmap_walk(int task, void *data)
 	close(fd);
 }
 
+static void map_batch_verify(int *visited, __u32 max_entries, int *keys,
+			     void *values, bool is_pcpu)
+{
+	unsigned int nr_cpus = bpf_num_possible_cpus();
+	BPF_DECLARE_PERCPU(long, pcpu_value);
+	int i, j;
+
+	memset(visited, 0, max_entries * sizeof(*visited));
+	for (i = 0; i < max_entries; i++) {
+		if (is_pcpu) {
+			memcpy(pcpu_value, values + i * sizeof(pcpu_value),
+			       sizeof(pcpu_value));
+			for (j = 0; j < nr_cpus; j++)
+				CHECK(keys[i] + 1 + j !=
+				      bpf_percpu(pcpu_value, j),
+				      "key/value checking",
+				      "error: i %d j %d key %d value %ld\n",
+				      i, j, keys[i],
+				      bpf_percpu(pcpu_value, j));
+		} else {
+			CHECK(keys[i] + 1 != ((long *)values)[i],
+			      "key/value checking",
+			      "error: i %d key %d value %ld\n", i, keys[i],
+			      ((long *)values)[i]);
+		}
+		CHECK(keys[i] < 0 || keys[i] >= max_entries, "key range",
+		      "error: i %d key %d\n", i, keys[i]);
+		visited[keys[i]] = 1;
+	}
+	for (i = 0; i < max_entries; i++)
+		CHECK(visited[i] != 1, "visited checking",
+		      "error: keys array at index %d missing\n", i);
+}
+
+static void map_batch_fill(int fd, __u32 max_entries, int *keys,
+			   void *values, bool is_pcpu)
+{
+	unsigned int nr_cpus = bpf_num_possible_cpus();
+	BPF_DECLARE_PERCPU(long, pcpu_value);
+	__u32 count = max_entries;
+	int i, j, err;
+
+	for (i = 0; i < max_entries; i++) {
+		keys[i] = i;
+		if (is_pcpu) {
+			for (j = 0; j < nr_cpus; j++)
+				bpf_percpu(pcpu_value, j) = i + 1 + j;
+			memcpy(values + i * sizeof(pcpu_value), pcpu_value,
+			       sizeof(pcpu_value));
+		} else {
+			((long *)values)[i] = i + 1;
+		}
+	}
+
+	err = bpf_map_update_batch(fd, keys, values, &count, 0, 0);
+	CHECK(err || count != max_entries, "bpf_map_update_batch()",
+	      "error: %s count %u\n", strerror(errno), count);
+}
+
+/* Walk the map in batches of at most step elements. Hash maps return
+ * whole buckets, so a step smaller than a bucket fails with ENOSPC and is
+ * retried with a larger one.
+ */
+static __u32 map_batch_walk(int fd, __u32 max_entries, int *keys,
+			    void *values, size_t value_size, __u32 step,
+			    bool delete)
+{
+	__u32 batch, count, total = 0;
+	int err;
+
+	for (;;) {
+		count = step;
+		if (delete)
+			err = bpf_map_lookup_and_delete_batch(fd,
+					total ? &batch : NULL, &batch,
+					keys + total,
+					values + total * value_size,
+					&count, 0, 0);
+		else
+			err = bpf_map_lookup_batch(fd,
+					total ? &batch : NULL, &batch,
+					keys + total,
+					values + total * value_size,
+					&count, 0, 0);
+		if (err && errno == ENOSPC) {
+			CHECK(count, "ENOSPC count", "count %u\n", count);
+			step *= 2;
+			continue;
+		}
+		CHECK(err && errno != ENOENT, "lookup batch",
+		      "error: %s\n", strerror(errno));
+		total += count;
+		CHECK(total > max_entries, "total", "total %u\n", total);
+		if (err)
+			break;
+	}
+	return total;
+}
+
+static void __test_hashmap_batch(enum bpf_map_type type, bool is_pcpu)
+{
+	BPF_DECLARE_PERCPU(long, pcpu_value);
+	size_t value_size = is_pcpu ? sizeof(pcpu_value) : sizeof(long);
+	int fd, key, *keys, *visited, max_entries = 100;
+	__u32 count, step, total;
+	void *values;
+	int err;
+
+	fd = bpf_create_map(type, sizeof(int), sizeof(long), max_entries,
+			    map_flags);
+	CHECK(fd < 0, "bpf_create_map", "error: %s\n", strerror(errno));
+
+	keys = malloc(max_entries * sizeof(int));
+	values = malloc(max_entries * value_size);
+	visited = malloc(max_entries * sizeof(int));
+	CHECK(!keys || !values || !visited, "malloc()", "error: %s\n",
+	      strerror(errno));
+
+	/* empty map */
+	count = max_entries;
+	err = bpf_map_lookup_batch(fd, NULL, &total, keys, values, &count,
+				   0, 0);
+	CHECK(!err || errno != ENOENT || count, "empty map",
+	      "error: %s count %u\n", strerror(errno), count);
+
+	/* unsupported flags */
+	count = max_entries;
+	err = bpf_map_lookup_batch(fd, NULL, &total, keys, values, &count,
+				   1, 0);
+	CHECK(!err || errno != EINVAL, "elem_flags", "error: %s\n",
+	      strerror(errno));
+
+	map_batch_fill(fd, max_entries, keys, values, is_pcpu);
+
+	/* updating existing elements with BPF_NOEXIST fails on the first */
+	count = max_entries;
+	err = bpf_map_update_batch(fd, keys, values, &count, BPF_NOEXIST, 0);
+	CHECK(!err || errno != EEXIST || count, "BPF_NOEXIST",
+	      "error: %s count %u\n", strerror(errno), count);
+
+	for (step = 1; step < max_entries; step *= 3) {
+		memset(keys, 0, max_entries * sizeof(*keys));
+		memset(values, 0, max_entries * value_size);
+		total = map_batch_walk(fd, max_entries, keys, values,
+				       value_size, step, false);
+		CHECK(total != max_entries, "lookup walk",
+		      "step %u total %u\n", step, total);
+		map_batch_verify(visited, max_entries, keys, values, is_pcpu);
+	}
+
+	/* lookup and delete everything */
+	memset(keys, 0, max_entries * sizeof(*keys));
+	total = map_batch_walk(fd, max_entries, keys, values, value_size, 4,
+			       true);
+	CHECK(total != max_entries, "lookup and delete walk", "total %u\n",
+	      total);
+	map_batch_verify(visited, max_entries, keys, values, is_pcpu);
+	CHECK(bpf_map_get_next_key(fd, NULL, &key) != -1 || errno != ENOENT,
+	      "map empty", "error: %s\n", strerror(errno));
+
+	/* delete by key */
+	map_batch_fill(fd, max_entries, keys, values, is_pcpu);
+	count = max_entries;
+	err = bpf_map_delete_batch(fd, keys, &count, 0, 0);
+	CHECK(err || count != max_entries, "bpf_map_delete_batch()",
+	      "error: %s count %u\n", strerror(errno), count);
+	CHECK(bpf_map_get_next_key(fd, NULL, &key) != -1 || errno != ENOENT,
+	      "map empty", "error: %s\n", strerror(errno));
+
+	/* deleting a missing key stops the batch there */
+	count = max_entries;
+	err = bpf_map_delete_batch(fd, keys, &count, 0, 0);
+	CHECK(!err || errno != ENOENT || count, "delete missing",
+	      "error: %s count %u\n", strerror(errno), count);
+
+	free(keys);
+	free(values);
+	free(visited);
+	close(fd);
+}
+
+static void test_hashmap_batch(int task, void *data)
+{
+	__test_hashmap_batch(BPF_MAP_TYPE_HASH, false);
+	__test_hashmap_batch(BPF_MAP_TYPE_PERCPU_HASH, true);
+}
+
+/* Returns the value of 'field' in the fdinfo of map fd, or -1 */
+static long long map_fdinfo_field(int fd, const char *field)
+{
+	long long val = -1;
+	char buff[256];
+	FILE *fp;
+
+	snprintf(buff, sizeof(buff), "/proc/%d/fdinfo/%d", getpid(), fd);
+	fp = fopen(buff, "r");
+	assert(fp);
+
+	while (fgets(buff, sizeof(buff), fp)) {
+		if (strncmp(buff, field, strlen(field)) ||
+		    buff[strlen(field)] != ':')
+			continue;
+		val = strtoll(buff + strlen(field) + 1, NULL, 0);
+		break;
+	}
+
+	fclose(fp);
+	return val;
+}
+
+static void test_rhashmap(int task, void *data)
+{
+	int fd, i, max_entries = 100000, nr_elems = 20000;
+	long long key, next_key, value, buckets;
+
+	fd = bpf_create_map(BPF_MAP_TYPE_RHASH, sizeof(key), sizeof(value),
+			    max_entries, map_flags);
+	if (fd < 0) {
+		printf("Failed to create rhashmap '%s'!\n", strerror(errno));
+		exit(1);
+	}
+
+	/* the bucket table starts small, not sized for max_entries */
+	buckets = map_fdinfo_field(fd, "buckets");
+	CHECK(buckets <= 0 || buckets >= max_entries, "initial buckets",
+	      "buckets %lld\n", buckets);
+	CHECK(map_fdinfo_field(fd, "elements") != 0, "initial elements",
+	      "elements %lld\n", map_fdinfo_field(fd, "elements"));
+
+	for (i = 0; i < nr_elems; i++) {
+		key = i; value = i;
+		assert(bpf_map_update_elem(fd, &key, &value, BPF_NOEXIST) == 0);
+	}
+
+	key = 0;
+	assert(bpf_map_update_elem(fd, &key, &value, BPF_NOEXIST) == -1 &&
+	       errno == EEXIST);
+	key = nr_elems;
+	assert(bpf_map_update_elem(fd, &key, &value, BPF_EXIST) == -1 &&
+	       errno == ENOENT);
+	assert(bpf_map_lookup_elem(fd, &key, &value) == -1 && errno == ENOENT);
+
+	/* the table grows in the background, wait for it */
+	for (i = 0; i < 100; i++) {
+		buckets = map_fdinfo_field(fd, "buckets");
+		if (buckets >= nr_elems)
+			break;
+		usleep(10000);
+	}
+	CHECK(buckets < nr_elems, "grown buckets", "buckets %lld\n",
+	      buckets);
+	CHECK(map_fdinfo_field(fd, "elements") != nr_elems, "elements",
+	      "elements %lld\n", map_fdinfo_field(fd, "elements"));
+
+	for (i = 0; i < nr_elems; i++) {
+		key = i;
+		assert(bpf_map_lookup_elem(fd, &key, &value) == 0 &&
+		       value == i);
+		value = i + 1;
+		assert(bpf_map_update_elem(fd, &key, &value, BPF_EXIST) == 0);
+	}
+
+	for (i = 0; bpf_map_get_next_key(fd, !i ? NULL : &key,
+					 &next_key) == 0; i++) {
+		key = next_key;
+		assert(bpf_map_lookup_elem(fd, &key, &value) == 0);
+		assert(value == key + 1);
+	}
+	assert(i == nr_elems);
+
+	for (i = 0; i < nr_elems; i++) {
+		key = i;
+		assert(bpf_map_delete_elem(fd, &key) == 0);
+	}
+	assert(bpf_map_delete_elem(fd, &key) == -1 && errno == ENOENT);
+	assert(bpf_map_get_next_key(fd, NULL, &next_key) == -1 &&
+	       errno == ENOENT);
+	close(fd);
+
+	/* max_entries still caps the number of elements */
+	fd = bpf_create_map(BPF_MAP_TYPE_RHASH, sizeof(key), sizeof(value),
+			    4, map_flags);
+	assert(fd >= 0);
+	for (key = 0; key < 4; key++)
+		assert(bpf_map_update_elem(fd, &key, &value, BPF_ANY) == 0);
+	assert(bpf_map_update_elem(fd, &key, &value, BPF_ANY) == -1 &&
+	       errno == E2BIG);
+	key = 0;
+	assert(bpf_map_update_elem(fd, &key, &value, BPF_ANY) == 0);
+	close(fd);
+
+	/* hash maps report their chains too */
+	fd = bpf_create_map(BPF_MAP_TYPE_HASH, sizeof(key), sizeof(value),
+			    1000, map_flags);
+	assert(fd >= 0);
+	key = 1;
+	assert(bpf_map_update_elem(fd, &key, &value, BPF_ANY) == 0);
+	assert(map_fdinfo_field(fd, "buckets") == 1024);
+	assert(map_fdinfo_field(fd, "elements") == 1);
+	assert(map_fdinfo_field(fd, "max_chain") == 1);
+	close(fd);
+}
+
 static void test_arraymap(int task, void *data)
 {
 	int key, next_key, fd;
@@ -456,6 +759,58 @@ static void test_arraymap_percpu_many_keys(void)
 	close(fd);
 }
 
+static void __test_arraymap_batch(enum bpf_map_type type, bool is_pcpu)
+{
+	BPF_DECLARE_PERCPU(long, pcpu_value);
+	size_t value_size = is_pcpu ? sizeof(pcpu_value) : sizeof(long);
+	int fd, *keys, *visited, max_entries = 10;
+	__u32 count, step, total;
+	void *values;
+	int err;
+
+	fd = bpf_create_map(type, sizeof(int), sizeof(long), max_entries, 0);
+	CHECK(fd < 0, "bpf_create_map", "error: %s\n", strerror(errno));
+
+	keys = malloc(max_entries * sizeof(int));
+	values = malloc(max_entries * value_size);
+	visited = malloc(max_entries * sizeof(int));
+	CHECK(!keys || !values || !visited, "malloc()", "error: %s\n",
+	      strerror(errno));
+
+	map_batch_fill(fd, max_entries, keys, values, is_pcpu);
+
+	for (step = 1; step <= max_entries; step++) {
+		memset(keys, 0, max_entries * sizeof(*keys));
+		memset(values, 0, max_entries * value_size);
+		total = map_batch_walk(fd, max_entries, keys, values,
+				       value_size, step, false);
+		CHECK(total != max_entries, "lookup walk",
+		      "step %u total %u\n", step, total);
+		map_batch_verify(visited, max_entries, keys, values, is_pcpu);
+	}
+
+	/* array elements cannot be deleted */
+	count = max_entries;
+	err = bpf_map_delete_batch(fd, keys, &count, 0, 0);
+	CHECK(!err || errno != ENOTSUPP, "bpf_map_delete_batch()",
+	      "error: %s\n", strerror(errno));
+	err = bpf_map_lookup_and_delete_batch(fd, NULL, &total, keys, values,
+					      &count, 0, 0);
+	CHECK(!err || errno != ENOTSUPP, "bpf_map_lookup_and_delete_batch()",
+	      "error: %s\n", strerror(errno));
+
+	free(keys);
+	free(values);
+	free(visited);
+	close(fd);
+}
+
+static void test_arraymap_batch(void)
+{
+	__test_arraymap_batch(BPF_MAP_TYPE_ARRAY, false);
+	__test_arraymap_batch(BPF_MAP_TYPE_PERCPU_ARRAY, true);
+}
+
 static void test_devmap(int task, void *data)
 {
 	int fd;
@@ -1417,11 +1772,14 @@ static void run_all_tests(void)
 	test_hashmap(0, NULL);
 	test_hashmap_percpu(0, NULL);
 	test_hashmap_walk(0, NULL);
+	test_hashmap_batch(0, NULL);
+	test_rhashmap(0, NULL);
 
 	test_arraymap(0, NULL);
 	test_arraymap_percpu(0, NULL);
 
 	test_arraymap_percpu_many_keys();
+	test_arraymap_batch();
 
 	test_devmap(0, NULL);
 	test_sockmap(0, NULL);
@@ -0,0 +1,193 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * Hash map lookup benchmark: fixed-size vs. resizable buckets.
+ *
+ * Populates a map with -n keys (default 1000000) and runs an XDP program
+ * -r times (default 10000000) through BPF_PROG_TEST_RUN that looks up a
+ * random key and, with -u, rewrites its value. This is done for a
+ * BPF_MAP_TYPE_HASH sized for several load factors, i.e. with max_entries
+ * of 4, 2 and 1 times the number of keys, and for a BPF_MAP_TYPE_RHASH
+ * whose bucket table follows the number of elements.
+ *
+ * Reports the time per program run along with the number of buckets,
+ * the longest chain and the memory charged to the map, as per fdinfo.
+ *
+ * Usage: test_rhash_bench [-n keys] [-r repeat] [-u]
+ */
+
+#include <errno.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <linux/bpf.h>
+#include <linux/filter.h>
+#include <bpf/bpf.h>
+
+#include "bpf_rlimit.h"
+#include "bpf_util.h"
+
+#define fail(format...) ({					\
+	printf("%s(%d):FAIL: ", __func__, __LINE__);		\
+	printf(format);						\
+	exit(1);						\
+})
+
+#define MAX_INSNS	32
+
+static __u32 cfg_keys = 1000000;
+static __u32 cfg_repeat = 10000000;
+static bool cfg_update;
+
+static long long fdinfo_field(int fd, const char *field)
+{
+	long long val = -1;
+	char buff[256];
+	FILE *fp;
+
+	snprintf(buff, sizeof(buff), "/proc/%d/fdinfo/%d", getpid(), fd);
+	fp = fopen(buff, "r");
+	if (!fp)
+		fail("fopen %s: %s\n", buff, strerror(errno));
+
+	while (fgets(buff, sizeof(buff), fp)) {
+		if (strncmp(buff, field, strlen(field)) ||
+		    buff[strlen(field)] != ':')
+			continue;
+		val = strtoll(buff + strlen(field) + 1, NULL, 0);
+		break;
+	}
+
+	fclose(fp);
+	return val;
+}
+
+static int load_prog(int map_fd)
+{
+	struct bpf_insn prog[MAX_INSNS], *insn = prog;
+	struct bpf_insn update[] = {
+		BPF_LD_MAP_FD(BPF_REG_1, map_fd),
+		BPF_MOV64_REG(BPF_REG_2, BPF_REG_10),
+		BPF_ALU64_IMM(BPF_ADD, BPF_REG_2, -4),
+		BPF_MOV64_REG(BPF_REG_3, BPF_REG_10),
+		BPF_ALU64_IMM(BPF_ADD, BPF_REG_3, -16),
+		BPF_MOV64_IMM(BPF_REG_4, BPF_EXIST),
+		BPF_EMIT_CALL(BPF_FUNC_map_update_elem),
+	};
+	struct bpf_insn lookup[] = {
+		/* key = value = bpf_get_prandom_u32() % keys */
+		BPF_EMIT_CALL(BPF_FUNC_get_prandom_u32),
+		BPF_ALU64_IMM(BPF_MOD, BPF_REG_0, cfg_keys),
+		BPF_STX_MEM(BPF_W, BPF_REG_10, BPF_REG_0, -4),
+		BPF_STX_MEM(BPF_DW, BPF_REG_10, BPF_REG_0, -16),
+		BPF_MOV64_REG(BPF_REG_2, BPF_REG_10),
+		BPF_ALU64_IMM(BPF_ADD, BPF_REG_2, -4),
+		BPF_LD_MAP_FD(BPF_REG_1, map_fd),
+		BPF_EMIT_CALL(BPF_FUNC_map_lookup_elem),
+		BPF_JMP_IMM(BPF_JEQ, BPF_REG_0, 0,
+			    cfg_update ? ARRAY_SIZE(update) : 0),
+	};
+	char log[4096];
+	int fd;
+
+	memcpy(insn, lookup, sizeof(lookup));
+	insn += ARRAY_SIZE(lookup);
+	if (cfg_update) {
+		memcpy(insn, update, sizeof(update));
+		insn += ARRAY_SIZE(update);
+	}
+	*insn++ = BPF_MOV64_IMM(BPF_REG_0, XDP_PASS);
+	*insn++ = BPF_EXIT_INSN();
+
+	fd = bpf_load_program(BPF_PROG_TYPE_XDP, prog, insn - prog, "GPL", 0,
+			      log, sizeof(log));
+	if (fd < 0)
+		fail("bpf_load_program: %s\n%s", strerror(errno), log);
+	return fd;
+}
+
+static void run(const char *name, enum bpf_map_type type, __u32 max_entries)
+{
+	char pkt[64] = {0};
+	__u32 key, retval, duration;
+	__u64 value;
+	int map_fd, prog_fd;
+
+	map_fd = bpf_create_map(type, sizeof(key), sizeof(value), max_entries,
+				0);
+	if (map_fd < 0)
+		fail("bpf_create_map %s: %s\n", name, strerror(errno));
+
+	for (key = 0; key < cfg_keys; key++) {
+		value = key;
+		if (bpf_map_update_elem(map_fd, &key, &value, BPF_NOEXIST))
+			fail("bpf_map_update_elem: %s\n", strerror(errno));
+	}
+
+	/* let a resizable table finish growing before measuring */
+	if (type == BPF_MAP_TYPE_RHASH) {
+		long long prev = 0, cur;
+
+		while ((cur = fdinfo_field(map_fd, "buckets")) != prev) {
+			prev = cur;
+			usleep(100000);
+		}
+	}
+
+	prog_fd = load_prog(map_fd);
+	if (bpf_prog_test_run(prog_fd, cfg_repeat, pkt, sizeof(pkt), NULL,
+			      NULL, &retval, &duration))
+		fail("bpf_prog_test_run: %s\n", strerror(errno));
+	if (retval != XDP_PASS)
+		fail("unexpected retval %u\n", retval);
+
+	printf("%-12s %10u max_entries %5u ns/op %10lld buckets %3lld max_chain %8lld kB\n",
+	       name, max_entries, duration,
+	       fdinfo_field(map_fd, "buckets"),
+	       fdinfo_field(map_fd, "max_chain"),
+	       fdinfo_field(map_fd, "memlock") >> 10);
+
+	close(prog_fd);
+	close(map_fd);
+}
+
+static void parse_opts(int argc, char **argv)
+{
+	int c;
+
+	while ((c = getopt(argc, argv, "n:r:u")) != -1) {
+		switch (c) {
+		case 'n':
+			cfg_keys = strtoul(optarg, NULL, 0);
+			break;
+		case 'r':
+			cfg_repeat = strtoul(optarg, NULL, 0);
+			break;
+		case 'u':
+			cfg_update = true;
+			break;
+		default:
+			fail("usage: %s [-n keys] [-r repeat] [-u]\n", argv[0]);
+		}
+	}
+
+	if (!cfg_keys || !cfg_repeat)
+		fail("keys and repeat must not be zero\n");
+}
+
+int main(int argc, char **argv)
+{
+	parse_opts(argc, argv);
+
+	printf("%u keys, %u runs, %s\n", cfg_keys, cfg_repeat,
+	       cfg_update ? "lookup and update" : "lookup");
+
+	run("hash 4x", BPF_MAP_TYPE_HASH, cfg_keys * 4);
+	run("hash 2x", BPF_MAP_TYPE_HASH, cfg_keys * 2);
+	run("hash 1x", BPF_MAP_TYPE_HASH, cfg_keys);
+	run("rhash", BPF_MAP_TYPE_RHASH, cfg_keys * 4);
+
+	return 0;
+}
@@ -0,0 +1,723 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * BPF ring buffer functional tests and ring buffer vs. perf buffer
+ * benchmark.
+ *
+ * The functional tests run first, with this thread as the only producer:
+ * the program numbers the records it emits, and the consumer checks it
+ * gets all of them in order, discarded ones flagged as such, while the
+ * ring wraps around several times and once it overflows.  They also
+ * check when poll() and epoll report the ring buffer fd readable, and
+ * that other map fds are always ready, as before maps could be polled.
+ *
+ * A raw tracepoint program on sys_enter emits one 64 byte record per
+ * getpgid() call of this process, either by reserving and submitting it in
+ * the shared ring buffer, by copying it with bpf_ringbuf_output() or by
+ * copying it into the per-cpu perf buffers with bpf_perf_event_output().
+ * For 1 to 4 producer threads, each pinned to its own cpu, one consumer
+ * thread waits in epoll and drains the buffers. Reports the rate of
+ * records received by the consumer and the number of records the program
+ * failed to emit because the buffers were full.
+ *
+ * The benchmark only runs with -b.
+ *
+ * Usage: test_ringbuf [-b] [-l secs] [-p max producers] [-r ring size]
+ */
+
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <linux/perf_event.h>
+#include <poll.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <bpf/bpf.h>
+#include <bpf/libbpf.h>
+
+#include "bpf_rlimit.h"
+#include "test_ringbuf_common.h"
+
+#define MAX_PRODUCERS	4
+
+#define fail(format...) ({					\
+	printf("%s(%d):FAIL: ", __func__, __LINE__);		\
+	printf(format);						\
+	exit(1);						\
+})
+
+static bool cfg_bench;
+static int cfg_runtime_sec = 2;
+static int cfg_max_producers = MAX_PRODUCERS;
+static unsigned long cfg_ring_size = 1 << 20;
+
+static const char * const mode_name[NR_BENCH_MODES] = {
+	[BENCH_RINGBUF_RESERVE]	= "ringbuf reserve/submit",
+	[BENCH_RINGBUF_OUTPUT]	= "ringbuf output",
+	[BENCH_PERFBUF]		= "perfbuf output",
+};
+
+static int cfg_fd, drops_fd, ringbuf_fd, perfbuf_fd;
+static int page_size;
+static volatile bool stop_producers, stop_consumer;
+
+struct ringbuf {
+	unsigned long *consumer_pos;
+	unsigned long *producer_pos;
+	void *data;
+	unsigned long mask;
+};
+
+struct perfbuf {
+	int nr_cpus;
+	int fds[MAX_PRODUCERS];
+	struct perf_event_mmap_page *headers[MAX_PRODUCERS];
+	void *copy_buf;
+	size_t copy_len;
+};
+
+struct consumer {
+	pthread_t thread;
+	int mode;
+	int epfd;
+	struct ringbuf rb;
+	struct perfbuf pb;
+	unsigned long received;
+	unsigned long lost;
+};
+
+struct producer {
+	pthread_t thread;
+	int cpu;
+	unsigned long calls;
+};
+
+static void pin_to_cpu(int cpu)
+{
+	cpu_set_t mask;
+
+	CPU_ZERO(&mask);
+	CPU_SET(cpu, &mask);
+	if (sched_setaffinity(0, sizeof(mask), &mask))
+		fail("sched_setaffinity %d: %s\n", cpu, strerror(errno));
+}
+
+static void *producer_fn(void *arg)
+{
+	struct producer *p = arg;
+
+	pin_to_cpu(p->cpu);
+	while (!stop_producers) {
+		syscall(__NR_getpgid, 0);
+		p->calls++;
+	}
+	return NULL;
+}
+
+static int ringbuf_rec_len(__u32 len)
+{
+	len &= ~(BPF_RINGBUF_BUSY_BIT | BPF_RINGBUF_DISCARD_BIT);
+	return (len + BPF_RINGBUF_HDR_SZ + 7) & ~7;
+}
+
+static void ringbuf_consume(struct consumer *c)
+{
+	struct ringbuf *rb = &c->rb;
+	unsigned long cons_pos, prod_pos;
+	__u32 len;
+
+	cons_pos = __atomic_load_n(rb->consumer_pos, __ATOMIC_ACQUIRE);
+	for (;;) {
+		prod_pos = __atomic_load_n(rb->producer_pos, __ATOMIC_ACQUIRE);
+		if (cons_pos >= prod_pos)
+			return;
+
+		while (cons_pos < prod_pos) {
+			len = __atomic_load_n((__u32 *)(rb->data +
+							(cons_pos & rb->mask)),
+					      __ATOMIC_ACQUIRE);
+			/* not committed yet, the producer will wake us up */
+			if (len & BPF_RINGBUF_BUSY_BIT)
+				return;
+			if (!(len & BPF_RINGBUF_DISCARD_BIT))
+				c->received++;
+			cons_pos += ringbuf_rec_len(len);
+			__atomic_store_n(rb->consumer_pos, cons_pos,
+					 __ATOMIC_RELEASE);
+		}
+	}
+}
+
+static void ringbuf_setup(struct consumer *c)
+{
+	struct epoll_event ev = { .events = EPOLLIN };
+	struct ringbuf *rb = &c->rb;
+	void *p;
+
+	/* the consumer position page is the only writable one */
+	p = mmap(NULL, page_size, PROT_READ | PROT_WRITE, MAP_SHARED,
+		 ringbuf_fd, 0);
+	if (p == MAP_FAILED)
+		fail("mmap consumer page: %s\n", strerror(errno));
+	rb->consumer_pos = p;
+
+	/* data pages are mapped twice, so records never wrap around */
+	p = mmap(NULL, page_size + 2 * cfg_ring_size, PROT_READ, MAP_SHARED,
+		 ringbuf_fd, page_size);
+	if (p == MAP_FAILED)
+		fail("mmap producer pages: %s\n", strerror(errno));
+	rb->producer_pos = p;
+	rb->data = p + page_size;
+	rb->mask = cfg_ring_size - 1;
+
+	if (epoll_ctl(c->epfd, EPOLL_CTL_ADD, ringbuf_fd, &ev))
+		fail("epoll_ctl ringbuf: %s\n", strerror(errno));
+}
+
+static void ringbuf_teardown(struct consumer *c)
+{
+	epoll_ctl(c->epfd, EPOLL_CTL_DEL, ringbuf_fd, NULL);
+	munmap(c->rb.consumer_pos, page_size);
+	munmap(c->rb.producer_pos, page_size + 2 * cfg_ring_size);
+}
+
+static enum bpf_perf_event_ret perfbuf_record(void *event, void *priv)
+{
+	struct perf_event_header *hdr = event;
+	struct consumer *c = priv;
+
+	if (hdr->type == PERF_RECORD_SAMPLE) {
+		c->received++;
+	} else if (hdr->type == PERF_RECORD_LOST) {
+		struct {
+			struct perf_event_header header;
+			__u64 id;
+			__u64 lost;
+		} *lost = event;
+
+		c->lost += lost->lost;
+	}
+	return LIBBPF_PERF_EVENT_CONT;
+}
+
+static void perfbuf_consume(struct consumer *c, int i)
+{
+	struct perfbuf *pb = &c->pb;
+
+	bpf_perf_event_read_simple(pb->headers[i], cfg_ring_size, page_size,
+				   &pb->copy_buf, &pb->copy_len,
+				   perfbuf_record, c);
+}
+
+static void perfbuf_setup(struct consumer *c, int nr_cpus)
+{
+	struct perf_event_attr attr = {
+		.type = PERF_TYPE_SOFTWARE,
+		.config = PERF_COUNT_SW_BPF_OUTPUT,
+		.sample_type = PERF_SAMPLE_RAW,
+		/* wake up for every record, like most tracing tools */
+		.wakeup_events = 1,
+	};
+	struct perfbuf *pb = &c->pb;
+	int i;
+
+	pb->nr_cpus = nr_cpus;
+	for (i = 0; i < nr_cpus; i++) {
+		struct epoll_event ev = { .events = EPOLLIN, .data.u32 = i };
+		void *p;
+		int fd;
+
+		fd = syscall(__NR_perf_event_open, &attr, -1, i, -1, 0);
+		if (fd < 0)
+			fail("perf_event_open cpu %d: %s\n", i, strerror(errno));
+
+		/* one ring of the same size as the shared one per cpu */
+		p = mmap(NULL, page_size + cfg_ring_size,
+			 PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+		if (p == MAP_FAILED)
+			fail("mmap perf buffer: %s\n", strerror(errno));
+
+		if (bpf_map_update_elem(perfbuf_fd, &i, &fd, BPF_ANY))
+			fail("bpf_map_update_elem perfbuf: %s\n",
+			     strerror(errno));
+		if (ioctl(fd, PERF_EVENT_IOC_ENABLE, 0))
+			fail("PERF_EVENT_IOC_ENABLE: %s\n", strerror(errno));
+		if (epoll_ctl(c->epfd, EPOLL_CTL_ADD, fd, &ev))
+			fail("epoll_ctl perf: %s\n", strerror(errno));
+
+		pb->fds[i] = fd;
+		pb->headers[i] = p;
+	}
+}
+
+static void perfbuf_teardown(struct consumer *c)
+{
+	struct perfbuf *pb = &c->pb;
+	int i;
+
+	for (i = 0; i < pb->nr_cpus; i++) {
+		bpf_map_delete_elem(perfbuf_fd, &i);
+		munmap(pb->headers[i], page_size + cfg_ring_size);
+		close(pb->fds[i]);
+	}
+	free(pb->copy_buf);
+	memset(pb, 0, sizeof(*pb));
+}
+
+static void consume_all(struct consumer *c)
+{
+	int i;
+
+	if (c->mode != BENCH_PERFBUF) {
+		ringbuf_consume(c);
+		return;
+	}
+	for (i = 0; i < c->pb.nr_cpus; i++)
+		perfbuf_consume(c, i);
+}
+
+static void *consumer_fn(void *arg)
+{
+	struct epoll_event events[MAX_PRODUCERS];
+	struct consumer *c = arg;
+	int i, n;
+
+	while (!stop_consumer) {
+		n = epoll_wait(c->epfd, events, MAX_PRODUCERS, 100);
+		if (n < 0 && errno != EINTR)
+			fail("epoll_wait: %s\n", strerror(errno));
+
+		for (i = 0; i < n; i++) {
+			if (c->mode == BENCH_PERFBUF)
+				perfbuf_consume(c, events[i].data.u32);
+			else
+				ringbuf_consume(c);
+		}
+	}
+	/* whatever was committed before the producers stopped */
+	consume_all(c);
+	return NULL;
+}
+
+static void run_bench(int mode, int nr_producers)
+{
+	struct producer producers[MAX_PRODUCERS] = {};
+	struct bench_cfg cfg = {
+		.pid = getpid(),
+		.mode = mode,
+		.syscall_nr = __NR_getpgid,
+	};
+	struct consumer c = { .mode = mode };
+	unsigned long calls = 0;
+	__u64 drops = 0;
+	__u32 key = 0;
+	int i;
+
+	c.epfd = epoll_create1(0);
+	if (c.epfd < 0)
+		fail("epoll_create1: %s\n", strerror(errno));
+	if (mode == BENCH_PERFBUF)
+		perfbuf_setup(&c, nr_producers);
+	else
+		ringbuf_setup(&c);
+
+	/* start from an empty ring buffer */
+	consume_all(&c);
+	c.received = 0;
+
+	if (bpf_map_update_elem(drops_fd, &key, &drops, BPF_ANY) ||
+	    bpf_map_update_elem(cfg_fd, &key, &cfg, BPF_ANY))
+		fail("bpf_map_update_elem: %s\n", strerror(errno));
+
+	stop_producers = false;
+	stop_consumer = false;
+	if (pthread_create(&c.thread, NULL, consumer_fn, &c))
+		fail("pthread_create consumer\n");
+	for (i = 0; i < nr_producers; i++) {
+		producers[i].cpu = i;
+		if (pthread_create(&producers[i].thread, NULL, producer_fn,
+				   &producers[i]))
+			fail("pthread_create producer\n");
+	}
+
+	sleep(cfg_runtime_sec);
+	stop_producers = true;
+	for (i = 0; i < nr_producers; i++) {
+		pthread_join(producers[i].thread, NULL);
+		calls += producers[i].calls;
+	}
+	stop_consumer = true;
+	pthread_join(c.thread, NULL);
+
+	/* stop emitting before the buffers go away */
+	cfg.mode = NR_BENCH_MODES;
+	bpf_map_update_elem(cfg_fd, &key, &cfg, BPF_ANY);
+	if (bpf_map_lookup_elem(drops_fd, &key, &drops))
+		fail("bpf_map_lookup_elem drops: %s\n", strerror(errno));
+
+	printf("%-24s producers=%d: %9lu events/s received, %9lu calls/s, %lu dropped, %lu lost, %lu KB buffers\n",
+	       mode_name[mode], nr_producers,
+	       c.received / cfg_runtime_sec, calls / cfg_runtime_sec,
+	       (unsigned long)drops, c.lost,
+	       (mode == BENCH_PERFBUF ? nr_producers : 1) *
+	       cfg_ring_size / 1024);
+
+	if (mode == BENCH_PERFBUF)
+		perfbuf_teardown(&c);
+	else
+		ringbuf_teardown(&c);
+	close(c.epfd);
+}
+
+/* What the consumer expects next from a single producer */
+struct check_state {
+	__u64 next_seq;
+	unsigned int discard_every;
+	unsigned long received;
+	unsigned long discarded;
+};
+
+/* Consume all records, checking they come in order */
+static void ringbuf_check(struct ringbuf *rb, struct check_state *st)
+{
+	unsigned long cons_pos, prod_pos;
+	struct bench_sample *s;
+	__u32 len;
+
+	cons_pos = __atomic_load_n(rb->consumer_pos, __ATOMIC_ACQUIRE);
+	prod_pos = __atomic_load_n(rb->producer_pos, __ATOMIC_ACQUIRE);
+	while (cons_pos < prod_pos) {
+		len = __atomic_load_n((__u32 *)(rb->data +
+						(cons_pos & rb->mask)),
+				      __ATOMIC_ACQUIRE);
+		s = rb->data + (cons_pos & rb->mask) + BPF_RINGBUF_HDR_SZ;
+
+		/* the producer is this thread, which is not running it */
+		if (len & BPF_RINGBUF_BUSY_BIT)
+			fail("record at %lu not committed\n", cons_pos);
+		if ((len & ~BPF_RINGBUF_DISCARD_BIT) != sizeof(*s))
+			fail("record at %lu has length %u\n", cons_pos, len);
+		if (s->seq != st->next_seq)
+			fail("record at %lu has seq %llu, expected %llu\n",
+			     cons_pos, (unsigned long long)s->seq,
+			     (unsigned long long)st->next_seq);
+		if (s->pid != (__u32)getpid())
+			fail("record %llu has pid %u\n",
+			     (unsigned long long)s->seq, s->pid);
+
+		if (st->discard_every && s->seq % st->discard_every == 0) {
+			if (!(len & BPF_RINGBUF_DISCARD_BIT))
+				fail("record %llu not discarded\n",
+				     (unsigned long long)s->seq);
+			st->discarded++;
+		} else {
+			if (len & BPF_RINGBUF_DISCARD_BIT)
+				fail("record %llu discarded\n",
+				     (unsigned long long)s->seq);
+			st->received++;
+		}
+		st->next_seq++;
+		cons_pos += ringbuf_rec_len(len);
+		__atomic_store_n(rb->consumer_pos, cons_pos, __ATOMIC_RELEASE);
+	}
+}
+
+static void produce(unsigned long n)
+{
+	while (n--)
+		syscall(__NR_getpgid, 0);
+}
+
+static void check_start(int mode, unsigned int discard_every,
+			struct check_state *st)
+{
+	struct bench_cfg cfg = {
+		.pid = getpid(),
+		.mode = mode,
+		.syscall_nr = __NR_getpgid,
+		.check = 1,
+		.discard_every = discard_every,
+	};
+	__u64 drops = 0;
+	__u32 key = 0;
+
+	memset(st, 0, sizeof(*st));
+	st->discard_every = discard_every;
+	if (bpf_map_update_elem(drops_fd, &key, &drops, BPF_ANY) ||
+	    bpf_map_update_elem(cfg_fd, &key, &cfg, BPF_ANY))
+		fail("bpf_map_update_elem: %s\n", strerror(errno));
+}
+
+static __u64 check_stop(void)
+{
+	struct bench_cfg cfg = { .mode = NR_BENCH_MODES };
+	__u64 drops;
+	__u32 key = 0;
+
+	if (bpf_map_update_elem(cfg_fd, &key, &cfg, BPF_ANY) ||
+	    bpf_map_lookup_elem(drops_fd, &key, &drops))
+		fail("bpf_map: %s\n", strerror(errno));
+	return drops;
+}
+
+static short poll_fd(int fd, short events)
+{
+	struct pollfd pfd = { .fd = fd, .events = events };
+
+	if (poll(&pfd, 1, 0) < 0)
+		fail("poll: %s\n", strerror(errno));
+	return pfd.revents;
+}
+
+/* Records are numbered and every third one discarded */
+static void test_seq_discard(struct ringbuf *rb)
+{
+	struct check_state st;
+
+	check_start(BENCH_RINGBUF_RESERVE, 3, &st);
+	produce(1000);
+	if (check_stop())
+		fail("records dropped\n");
+	ringbuf_check(rb, &st);
+	if (st.received != 666 || st.discarded != 334)
+		fail("received %lu, discarded %lu, expected 666 and 334\n",
+		     st.received, st.discarded);
+}
+
+/* Records straddle the end of the ring, read through the second mapping */
+static void test_wrap(struct ringbuf *rb, int mode)
+{
+	unsigned long start, batch;
+	struct check_state st;
+
+	batch = cfg_ring_size / ringbuf_rec_len(sizeof(struct bench_sample));
+	batch = batch / 2 + 1;
+	start = *rb->consumer_pos;
+
+	check_start(mode, 0, &st);
+	while (*rb->consumer_pos - start < 3 * cfg_ring_size) {
+		produce(batch);
+		ringbuf_check(rb, &st);
+	}
+	if (check_stop())
+		fail("records dropped\n");
+	if (st.received != st.next_seq)
+		fail("received %lu of %llu records\n", st.received,
+		     (unsigned long long)st.next_seq);
+}
+
+/* Records which do not fit are dropped, the others are intact */
+static void test_overflow(struct ringbuf *rb)
+{
+	unsigned long n;
+	struct check_state st;
+	__u64 drops;
+
+	n = cfg_ring_size / ringbuf_rec_len(sizeof(struct bench_sample));
+
+	check_start(BENCH_RINGBUF_RESERVE, 0, &st);
+	produce(n + 64);
+	drops = check_stop();
+	ringbuf_check(rb, &st);
+	if (!drops || st.received + drops != n + 64)
+		fail("received %lu, dropped %llu of %lu records\n",
+		     st.received, (unsigned long long)drops, n + 64);
+
+	/* there is room again once consumed */
+	check_start(BENCH_RINGBUF_RESERVE, 0, &st);
+	produce(1);
+	if (check_stop())
+		fail("record dropped after overflow\n");
+	ringbuf_check(rb, &st);
+	if (st.received != 1)
+		fail("received %lu records after overflow\n", st.received);
+}
+
+struct poll_waiter {
+	pthread_t thread;
+	int epfd;
+	int n;
+	struct epoll_event ev;
+};
+
+static void *poll_waiter_fn(void *arg)
+{
+	struct poll_waiter *w = arg;
+
+	w->n = epoll_wait(w->epfd, &w->ev, 1, 5000);
+	return NULL;
+}
+
+static void test_poll(struct consumer *c)
+{
+	struct epoll_event ev = { .events = EPOLLIN };
+	struct poll_waiter w = { .epfd = c->epfd };
+	struct check_state st;
+	int epfd;
+
+	/* an empty ring buffer is not readable */
+	consume_all(c);
+	if (poll_fd(ringbuf_fd, POLLIN))
+		fail("empty ring buffer readable\n");
+
+	/* a consumer waiting in epoll is woken up by the first record */
+	if (pthread_create(&w.thread, NULL, poll_waiter_fn, &w))
+		fail("pthread_create\n");
+	usleep(100000);
+	check_start(BENCH_RINGBUF_RESERVE, 0, &st);
+	produce(1);
+	check_stop();
+	pthread_join(w.thread, NULL);
+	if (w.n != 1 || !(w.ev.events & EPOLLIN))
+		fail("epoll_wait returned %d, events %x\n", w.n, w.ev.events);
+	if (poll_fd(ringbuf_fd, POLLIN) != POLLIN)
+		fail("ring buffer with a record not readable\n");
+
+	/* and it is not readable anymore once consumed */
+	ringbuf_check(&c->rb, &st);
+	if (st.received != 1)
+		fail("received %lu records\n", st.received);
+	if (poll_fd(ringbuf_fd, POLLIN))
+		fail("consumed ring buffer readable\n");
+
+	/* other maps are always ready, neither in error nor blocking */
+	if (poll_fd(cfg_fd, POLLIN | POLLOUT) != (POLLIN | POLLOUT))
+		fail("array map not ready for poll\n");
+	epfd = epoll_create1(0);
+	if (epfd < 0)
+		fail("epoll_create1: %s\n", strerror(errno));
+	if (epoll_ctl(epfd, EPOLL_CTL_ADD, cfg_fd, &ev))
+		fail("epoll_ctl array map: %s\n", strerror(errno));
+	if (epoll_wait(epfd, &ev, 1, 0) != 1 || ev.events != EPOLLIN)
+		fail("array map not ready for epoll\n");
+	close(epfd);
+}
+
+static void run_tests(void)
+{
+	struct consumer c = { .mode = BENCH_RINGBUF_RESERVE };
+
+	c.epfd = epoll_create1(0);
+	if (c.epfd < 0)
+		fail("epoll_create1: %s\n", strerror(errno));
+	ringbuf_setup(&c);
+	/* whatever a previous run left */
+	consume_all(&c);
+
+	test_seq_discard(&c.rb);
+	test_wrap(&c.rb, BENCH_RINGBUF_RESERVE);
+	test_wrap(&c.rb, BENCH_RINGBUF_OUTPUT);
+	test_overflow(&c.rb);
+	test_poll(&c);
+	printf("ringbuf functional tests: PASS\n");
+
+	ringbuf_teardown(&c);
+	close(c.epfd);
+}
+
+static struct bpf_object *load_prog(void)
+{
+	const char *file = "./test_ringbuf_kern.o";
+	struct bpf_program *prog;
+	struct bpf_object *obj;
+	struct bpf_map *map;
+	int err;
+
+	obj = bpf_object__open(file);
+	if (libbpf_get_error(obj))
+		fail("bpf_object__open %s\n", file);
+
+	/* size the shared ring buffer before the program is loaded */
+	ringbuf_fd = bpf_create_map(BPF_MAP_TYPE_RINGBUF, 0, 0, cfg_ring_size,
+				    0);
+	if (ringbuf_fd < 0)
+		fail("bpf_create_map ringbuf: %s\n", strerror(errno));
+	map = bpf_object__find_map_by_name(obj, "ringbuf");
+	if (!map || bpf_map__reuse_fd(map, ringbuf_fd))
+		fail("reuse ringbuf map\n");
+
+	bpf_object__for_each_program(prog, obj)
+		bpf_program__set_type(prog, BPF_PROG_TYPE_RAW_TRACEPOINT);
+
+	err = bpf_object__load(obj);
+	if (err)
+		fail("bpf_object__load: %d\n", err);
+
+	cfg_fd = bpf_map__fd(bpf_object__find_map_by_name(obj, "cfg_map"));
+	drops_fd = bpf_map__fd(bpf_object__find_map_by_name(obj, "drops_map"));
+	perfbuf_fd = bpf_map__fd(bpf_object__find_map_by_name(obj, "perfbuf"));
+	if (cfg_fd < 0 || drops_fd < 0 || perfbuf_fd < 0)
+		fail("bpf_object__find_map_by_name\n");
+
+	prog = bpf_object__find_program_by_title(obj,
+						 "raw_tracepoint/sys_enter");
+	if (!prog)
+		fail("bpf_object__find_program_by_title\n");
+	if (bpf_raw_tracepoint_open("sys_enter", bpf_program__fd(prog)) < 0)
+		fail("bpf_raw_tracepoint_open: %s\n", strerror(errno));
+
+	return obj;
+}
+
+static void parse_opts(int argc, char **argv)
+{
+	int c;
+
+	while ((c = getopt(argc, argv, "bl:p:r:")) != -1) {
+		switch (c) {
+		case 'b':
+			cfg_bench = true;
+			break;
+		case 'l':
+			cfg_runtime_sec = strtoul(optarg, NULL, 0);
+			break;
+		case 'p':
+			cfg_max_producers = strtoul(optarg, NULL, 0);
+			break;
+		case 'r':
+			cfg_ring_size = strtoul(optarg, NULL, 0);
+			break;
+		default:
+			fail("usage: %s [-b] [-l secs] [-p max producers] [-r ring size]\n",
+			     argv[0]);
+		}
+	}
+
+	page_size = getpagesize();
+	if (cfg_runtime_sec <= 0)
+		fail("invalid runtime\n");
+	if (cfg_max_producers <= 0 || cfg_max_producers > MAX_PRODUCERS)
+		fail("producers must be 1 to %d\n", MAX_PRODUCERS);
+	if (cfg_max_producers > sysconf(_SC_NPROCESSORS_ONLN))
+		cfg_max_producers = sysconf(_SC_NPROCESSORS_ONLN);
+	if (cfg_ring_size < (unsigned long)page_size ||
+	    cfg_ring_size & (cfg_ring_size - 1))
+		fail("ring size must be a power of 2 of at least a page\n");
+}
+
+int main(int argc, char **argv)
+{
+	struct bpf_object *obj;
+	int mode, n;
+
+	parse_opts(argc, argv);
+	obj = load_prog();
+	run_tests();
+
+	for (mode = 0; cfg_bench && mode < NR_BENCH_MODES; mode++)
+		for (n = 1; n <= cfg_max_producers; n++)
+			run_bench(mode, n);
+
+	bpf_object__close(obj);
+	close(ringbuf_fd);
+	return 0;
+}
@@ -0,0 +1,35 @@
+/* SPDX-License-Identifier: GPL-2.0 */
+
+#ifndef __TEST_RINGBUF_COMMON_H
+#define __TEST_RINGBUF_COMMON_H
+
+#include <linux/types.h>
+
+enum bench_mode {
+	BENCH_RINGBUF_RESERVE,
+	BENCH_RINGBUF_OUTPUT,
+	BENCH_PERFBUF,
+	NR_BENCH_MODES,
+};
+
+struct bench_cfg {
+	__u32 pid;
+	__u32 mode;
+	__u64 syscall_nr;
+	/* functional tests only, left 0 by the benchmark */
+	__u32 check;		/* number the records with seq */
+	__u32 discard_every;	/* discard the records of seq % n == 0 */
+	__u64 next_seq;
+};
+
+/* a record the size of a typical tracing event */
+struct bench_sample {
+	__u64 ts;
+	__u32 pid;
+	__u32 cpu;
+	char comm[16];
+	__u64 seq;
+	__u64 pad[3];
+};
+
+#endif
@@ -0,0 +1,101 @@
+// SPDX-License-Identifier: GPL-2.0
+
+#include <linux/bpf.h>
+#include "bpf_helpers.h"
+#include "test_ringbuf_common.h"
+
+/* resized by the loader */
+struct bpf_map_def SEC("maps") ringbuf = {
+	.type = BPF_MAP_TYPE_RINGBUF,
+	.max_entries = 4096,
+};
+
+struct bpf_map_def SEC("maps") perfbuf = {
+	.type = BPF_MAP_TYPE_PERF_EVENT_ARRAY,
+	.key_size = sizeof(int),
+	.value_size = sizeof(__u32),
+	.max_entries = 128,
+};
+
+struct bpf_map_def SEC("maps") cfg_map = {
+	.type = BPF_MAP_TYPE_ARRAY,
+	.key_size = sizeof(__u32),
+	.value_size = sizeof(struct bench_cfg),
+	.max_entries = 1,
+};
+
+struct bpf_map_def SEC("maps") drops_map = {
+	.type = BPF_MAP_TYPE_ARRAY,
+	.key_size = sizeof(__u32),
+	.value_size = sizeof(__u64),
+	.max_entries = 1,
+};
+
+SEC("raw_tracepoint/sys_enter")
+int bench_sys_enter(struct bpf_raw_tracepoint_args *ctx)
+{
+	struct bench_sample *s, sample;
+	struct bench_cfg *cfg;
+	__u32 key = 0;
+	__u64 *drops;
+
+	cfg = bpf_map_lookup_elem(&cfg_map, &key);
+	if (!cfg || ctx->args[1] != cfg->syscall_nr ||
+	    bpf_get_current_pid_tgid() >> 32 != cfg->pid)
+		return 0;
+
+	switch (cfg->mode) {
+	case BENCH_RINGBUF_RESERVE:
+		/* the record is written in place, no copy */
+		s = bpf_ringbuf_reserve(&ringbuf, sizeof(*s), 0);
+		if (!s)
+			break;
+		s->ts = bpf_ktime_get_ns();
+		s->pid = cfg->pid;
+		s->cpu = bpf_get_smp_processor_id();
+		bpf_get_current_comm(s->comm, sizeof(s->comm));
+		if (cfg->check) {
+			/* single producer, no need for atomics */
+			s->seq = cfg->next_seq++;
+			if (cfg->discard_every &&
+			    s->seq % cfg->discard_every == 0) {
+				bpf_ringbuf_discard(s, 0);
+				return 0;
+			}
+		}
+		bpf_ringbuf_submit(s, 0);
+		return 0;
+	case BENCH_RINGBUF_OUTPUT:
+	case BENCH_PERFBUF:
+		__builtin_memset(&sample, 0, sizeof(sample));
+		sample.ts = bpf_ktime_get_ns();
+		sample.pid = cfg->pid;
+		sample.cpu = bpf_get_smp_processor_id();
+		bpf_get_current_comm(sample.comm, sizeof(sample.comm));
+		if (cfg->mode == BENCH_RINGBUF_OUTPUT) {
+			if (cfg->check)
+				sample.seq = cfg->next_seq;
+			if (!bpf_ringbuf_output(&ringbuf, &sample,
+						sizeof(sample), 0)) {
+				if (cfg->check)
+					cfg->next_seq++;
+				return 0;
+			}
+		} else {
+			if (!bpf_perf_event_output(ctx, &perfbuf,
+						   BPF_F_CURRENT_CPU,
+						   &sample, sizeof(sample)))
+				return 0;
+		}
+		break;
+	default:
+		return 0;
+	}
+
+	drops = bpf_map_lookup_elem(&drops_map, &key);
+	if (drops)
+		__sync_fetch_and_add(drops, 1);
+	return 0;
+}
+
+char _license[] SEC("license") = "GPL";
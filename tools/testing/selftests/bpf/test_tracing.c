@@ -0,0 +1,226 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * Tests for BPF_PROG_TYPE_TRACING programs: attaches fentry and fexit
+ * programs to the getpid() syscall, checks the arguments and the return
+ * value they see and that detaching either one leaves the other running,
+ * then checks the attach and load errors.
+ */
+
+#include <errno.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <linux/bpf.h>
+#include <bpf/bpf.h>
+#include <bpf/libbpf.h>
+
+#include "bpf_rlimit.h"
+#include "bpf_util.h"
+#include "test_tracing_common.h"
+#include "../../../include/linux/filter.h"
+
+#define CALLS	10
+
+#define fail(format...) ({					\
+	printf("%s(%d):FAIL: ", __func__, __LINE__);		\
+	printf(format);						\
+	exit(1);						\
+})
+
+static struct bpf_object *obj;
+static int results_fd;
+
+static int prog_fd(const char *title)
+{
+	struct bpf_program *prog;
+
+	prog = bpf_object__find_program_by_title(obj, title);
+	if (!prog)
+		fail("no program %s\n", title);
+	return bpf_program__fd(prog);
+}
+
+static __u64 result(__u32 key)
+{
+	__u64 value;
+
+	if (bpf_map_lookup_elem(results_fd, &key, &value))
+		fail("bpf_map_lookup_elem: %s\n", strerror(errno));
+	return value;
+}
+
+static void reset_results(void)
+{
+	__u64 value;
+	__u32 key;
+
+	for (key = 0; key < NR_RESULTS; key++) {
+		value = key == RES_TGID ? getpid() : 0;
+		if (bpf_map_update_elem(results_fd, &key, &value, BPF_ANY))
+			fail("bpf_map_update_elem: %s\n", strerror(errno));
+	}
+}
+
+static int attach(const char *title, const char *func)
+{
+	int fd;
+
+	fd = bpf_raw_tracepoint_open(func, prog_fd(title));
+	if (fd < 0)
+		fail("attaching %s to %s: %s\n", title, func, strerror(errno));
+	return fd;
+}
+
+static void call_getpid(void)
+{
+	int i;
+
+	/* not the libc wrapper, which may cache the result */
+	for (i = 0; i < CALLS; i++)
+		syscall(__NR_getpid);
+}
+
+static void test_fentry_fexit(void)
+{
+	int fentry_fd, fexit_fd;
+
+	reset_results();
+	fentry_fd = attach("fentry/getpid", SYS_GETPID);
+	fexit_fd = attach("fexit/getpid", SYS_GETPID);
+
+	call_getpid();
+	if (result(RES_FENTRY_HITS) != CALLS || result(RES_FEXIT_HITS) != CALLS)
+		fail("%llu fentry and %llu fexit hits for %d calls\n",
+		     result(RES_FENTRY_HITS), result(RES_FEXIT_HITS), CALLS);
+	if (result(RES_FEXIT_RET) != getpid())
+		fail("fexit saw %llu returned, getpid() is %d\n",
+		     result(RES_FEXIT_RET), getpid());
+	/* the pt_regs pointer of the syscall wrapper */
+	if (!result(RES_FENTRY_ARG0) ||
+	    result(RES_FENTRY_ARG0) != result(RES_FEXIT_ARG0))
+		fail("fentry saw arg0 %llx, fexit %llx\n",
+		     result(RES_FENTRY_ARG0), result(RES_FEXIT_ARG0));
+
+	/* the function keeps running the fexit program alone */
+	close(fentry_fd);
+	call_getpid();
+	if (result(RES_FENTRY_HITS) != CALLS ||
+	    result(RES_FEXIT_HITS) != 2 * CALLS)
+		fail("%llu fentry and %llu fexit hits after detaching fentry\n",
+		     result(RES_FENTRY_HITS), result(RES_FEXIT_HITS));
+
+	/* and is restored once the last program is detached */
+	close(fexit_fd);
+	call_getpid();
+	if (result(RES_FEXIT_HITS) != 2 * CALLS)
+		fail("%llu fexit hits after detaching fexit\n",
+		     result(RES_FEXIT_HITS));
+
+	/* and can be traced again */
+	fentry_fd = attach("fentry/getpid", SYS_GETPID);
+	call_getpid();
+	if (result(RES_FENTRY_HITS) != 2 * CALLS)
+		fail("%llu fentry hits after attaching again\n",
+		     result(RES_FENTRY_HITS));
+	close(fentry_fd);
+}
+
+static void test_attach_errors(void)
+{
+	int fentry = prog_fd("fentry/getpid");
+	int fd;
+
+	if (bpf_raw_tracepoint_open("no_such_function", fentry) >= 0 ||
+	    errno != ENOENT)
+		fail("attached to a function that does not exist\n");
+
+	/* notrace, the trampoline calls it */
+	if (bpf_raw_tracepoint_open("__bpf_prog_enter", fentry) >= 0 ||
+	    errno != EINVAL)
+		fail("attached to a notrace function\n");
+
+	fd = attach("fentry/getpid", SYS_GETPID);
+	if (bpf_raw_tracepoint_open(SYS_GETPID, fentry) >= 0 || errno != EBUSY)
+		fail("attached the same program twice\n");
+	close(fd);
+
+	/* kprobe programs do not attach through the raw tracepoint command */
+	if (bpf_raw_tracepoint_open(SYS_GETPID, prog_fd("kprobe/getpid")) >= 0 ||
+	    errno != EINVAL)
+		fail("attached a kprobe program to a function\n");
+}
+
+static int load(enum bpf_attach_type type, const struct bpf_insn *insns,
+		size_t cnt)
+{
+	struct bpf_load_program_attr attr = {
+		.prog_type = BPF_PROG_TYPE_TRACING,
+		.expected_attach_type = type,
+		.insns = insns,
+		.insns_cnt = cnt,
+		.license = "GPL",
+	};
+
+	return bpf_load_program_xattr(&attr, NULL, 0);
+}
+
+static void test_load_errors(void)
+{
+	const struct bpf_insn read_ret[] = {
+		BPF_LDX_MEM(BPF_DW, BPF_REG_0, BPF_REG_1,
+			    offsetof(struct bpf_tracing_ctx, ret)),
+		BPF_EXIT_INSN(),
+	};
+	const struct bpf_insn write_arg[] = {
+		BPF_ST_MEM(BPF_DW, BPF_REG_1, 0, 0),
+		BPF_MOV64_IMM(BPF_REG_0, 0),
+		BPF_EXIT_INSN(),
+	};
+	int fd;
+
+	/* the return value is only there on exit */
+	if (load(BPF_TRACE_FENTRY, read_ret, ARRAY_SIZE(read_ret)) >= 0 ||
+	    errno != EACCES)
+		fail("fentry program loaded reading the return value\n");
+	fd = load(BPF_TRACE_FEXIT, read_ret, ARRAY_SIZE(read_ret));
+	if (fd < 0)
+		fail("fexit program reading the return value: %s\n",
+		     strerror(errno));
+	close(fd);
+
+	if (load(BPF_TRACE_FEXIT, write_arg, ARRAY_SIZE(write_arg)) >= 0 ||
+	    errno != EACCES)
+		fail("program loaded writing its context\n");
+
+	if (load(BPF_ITER_TASK, read_ret, ARRAY_SIZE(read_ret)) >= 0 ||
+	    errno != EINVAL)
+		fail("program loaded with an iterator attach type\n");
+}
+
+int main(void)
+{
+	struct bpf_prog_load_attr attr = {
+		.file = "./test_tracing_kern.o",
+	};
+	struct bpf_map *map;
+	int fd;
+
+	if (bpf_prog_load_xattr(&attr, &obj, &fd))
+		fail("bpf_prog_load_xattr %s\n", attr.file);
+	map = bpf_object__find_map_by_name(obj, "results");
+	if (!map)
+		fail("no results map\n");
+	results_fd = bpf_map__fd(map);
+
+	test_fentry_fexit();
+	test_attach_errors();
+	test_load_errors();
+
+	bpf_object__close(obj);
+	printf("test_tracing: OK\n");
+	return 0;
+}
@@ -0,0 +1,232 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * Per-call overhead of kprobe vs. fentry programs.
+ *
+ * Calls getpid() -n times (default 10000000) with nothing attached to the
+ * kernel's getpid() entry point, then with the programs of
+ * test_tracing_kern.o attached as kprobe, kretprobe, fentry and fexit.
+ * Every program does the same work, a map lookup and an increment.
+ * Reports the time per call and the overhead over the untraced call.
+ *
+ * Usage: test_tracing_bench [-n calls]
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <linux/perf_event.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <linux/bpf.h>
+#include <bpf/bpf.h>
+#include <bpf/libbpf.h>
+
+#include "bpf_rlimit.h"
+#include "test_tracing_common.h"
+
+#define KPROBE_PMU	"/sys/bus/event_source/devices/kprobe"
+
+#define fail(format...) ({					\
+	printf("%s(%d):FAIL: ", __func__, __LINE__);		\
+	printf(format);						\
+	exit(1);						\
+})
+
+enum bench_mode {
+	BENCH_NONE,
+	BENCH_KPROBE,
+	BENCH_KRETPROBE,
+	BENCH_FENTRY,
+	BENCH_FEXIT,
+	NR_BENCH_MODES,
+};
+
+static const char * const mode_names[NR_BENCH_MODES] = {
+	[BENCH_NONE]		= "none",
+	[BENCH_KPROBE]		= "kprobe",
+	[BENCH_KRETPROBE]	= "kretprobe",
+	[BENCH_FENTRY]		= "fentry",
+	[BENCH_FEXIT]		= "fexit",
+};
+
+static unsigned long cfg_calls = 10000000;
+
+static struct bpf_object *obj;
+static int results_fd;
+
+static unsigned long long now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static int prog_fd(const char *title)
+{
+	struct bpf_program *prog;
+
+	prog = bpf_object__find_program_by_title(obj, title);
+	if (!prog)
+		fail("no program %s\n", title);
+	return bpf_program__fd(prog);
+}
+
+static int read_sysfs(const char *path, const char *format)
+{
+	int n, value;
+	FILE *f;
+
+	f = fopen(path, "r");
+	if (!f)
+		fail("open %s: %s\n", path, strerror(errno));
+	n = fscanf(f, format, &value);
+	fclose(f);
+	if (n != 1)
+		fail("unexpected contents of %s\n", path);
+	return value;
+}
+
+/* Attach the kprobe program through the kprobe PMU */
+static int attach_kprobe(bool retprobe)
+{
+	struct perf_event_attr attr = {
+		.size = sizeof(attr),
+		.kprobe_func = (unsigned long)SYS_GETPID,
+	};
+	int fd;
+
+	attr.type = read_sysfs(KPROBE_PMU "/type", "%d");
+	if (retprobe)
+		attr.config |= 1ULL << read_sysfs(KPROBE_PMU "/format/retprobe",
+						  "config:%d");
+
+	fd = syscall(__NR_perf_event_open, &attr, -1, 0, -1, 0);
+	if (fd < 0)
+		fail("perf_event_open: %s\n", strerror(errno));
+	if (ioctl(fd, PERF_EVENT_IOC_SET_BPF, prog_fd("kprobe/getpid")) ||
+	    ioctl(fd, PERF_EVENT_IOC_ENABLE, 0))
+		fail("attaching the kprobe program: %s\n", strerror(errno));
+	return fd;
+}
+
+static int attach_tracing(const char *title)
+{
+	int fd;
+
+	fd = bpf_raw_tracepoint_open(SYS_GETPID, prog_fd(title));
+	if (fd < 0)
+		fail("attaching %s: %s\n", title, strerror(errno));
+	return fd;
+}
+
+static void set_result(__u32 key, __u64 value)
+{
+	if (bpf_map_update_elem(results_fd, &key, &value, BPF_ANY))
+		fail("bpf_map_update_elem: %s\n", strerror(errno));
+}
+
+static __u64 get_result(__u32 key)
+{
+	__u64 value;
+
+	if (bpf_map_lookup_elem(results_fd, &key, &value))
+		fail("bpf_map_lookup_elem: %s\n", strerror(errno));
+	return value;
+}
+
+/* Return the time per call in ns */
+static double run(int mode)
+{
+	unsigned long long start, elapsed;
+	__u32 hits_key = 0;
+	unsigned long i;
+	int fd = -1;
+
+	switch (mode) {
+	case BENCH_KPROBE:
+	case BENCH_KRETPROBE:
+		fd = attach_kprobe(mode == BENCH_KRETPROBE);
+		hits_key = RES_KPROBE_HITS;
+		break;
+	case BENCH_FENTRY:
+		fd = attach_tracing("fentry/getpid");
+		hits_key = RES_FENTRY_HITS;
+		break;
+	case BENCH_FEXIT:
+		fd = attach_tracing("fexit/getpid");
+		hits_key = RES_FEXIT_HITS;
+		break;
+	}
+	if (hits_key)
+		set_result(hits_key, 0);
+
+	start = now_ns();
+	for (i = 0; i < cfg_calls; i++)
+		syscall(__NR_getpid);
+	elapsed = now_ns() - start;
+
+	if (fd >= 0)
+		close(fd);
+	if (hits_key && get_result(hits_key) != cfg_calls)
+		fail("%s: %llu hits for %lu calls\n", mode_names[mode],
+		     get_result(hits_key), cfg_calls);
+
+	return (double)elapsed / cfg_calls;
+}
+
+static void parse_opts(int argc, char **argv)
+{
+	int c;
+
+	while ((c = getopt(argc, argv, "n:")) != -1) {
+		switch (c) {
+		case 'n':
+			cfg_calls = strtoul(optarg, NULL, 0);
+			break;
+		default:
+			fail("usage: %s [-n calls]\n", argv[0]);
+		}
+	}
+
+	if (!cfg_calls)
+		fail("calls must not be zero\n");
+}
+
+int main(int argc, char **argv)
+{
+	struct bpf_prog_load_attr attr = {
+		.file = "./test_tracing_kern.o",
+	};
+	struct bpf_map *map;
+	double base, ns;
+	int mode, fd;
+
+	parse_opts(argc, argv);
+
+	if (bpf_prog_load_xattr(&attr, &obj, &fd))
+		fail("bpf_prog_load_xattr %s\n", attr.file);
+	map = bpf_object__find_map_by_name(obj, "results");
+	if (!map)
+		fail("no results map\n");
+	results_fd = bpf_map__fd(map);
+	set_result(RES_TGID, getpid());
+
+	printf("%lu getpid() calls traced at %s\n", cfg_calls, SYS_GETPID);
+	base = run(BENCH_NONE);
+	printf("%-10s %8.1f ns/call\n", mode_names[BENCH_NONE], base);
+	for (mode = BENCH_NONE + 1; mode < NR_BENCH_MODES; mode++) {
+		ns = run(mode);
+		printf("%-10s %8.1f ns/call %8.1f ns overhead\n",
+		       mode_names[mode], ns, ns - base);
+	}
+
+	bpf_object__close(obj);
+	return 0;
+}
@@ -0,0 +1,27 @@
+/* SPDX-License-Identifier: GPL-2.0 */
+
+#ifndef __TEST_TRACING_COMMON_H
+#define __TEST_TRACING_COMMON_H
+
+/* Slots of the results array of test_tracing_kern.o */
+enum tracing_result {
+	RES_TGID,		/* process the programs count, set by the test */
+	RES_FENTRY_HITS,
+	RES_FENTRY_ARG0,
+	RES_FEXIT_HITS,
+	RES_FEXIT_ARG0,
+	RES_FEXIT_RET,
+	RES_KPROBE_HITS,
+	NR_RESULTS,
+};
+
+/* The getpid() entry point, with the syscall wrapper of the arch */
+#if defined(__aarch64__)
+#define SYS_GETPID	"__arm64_sys_getpid"
+#elif defined(__x86_64__)
+#define SYS_GETPID	"__x64_sys_getpid"
+#else
+#define SYS_GETPID	"sys_getpid"
+#endif
+
+#endif
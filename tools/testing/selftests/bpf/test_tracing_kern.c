@@ -0,0 +1,69 @@
+// SPDX-License-Identifier: GPL-2.0
+
+#include <linux/bpf.h>
+#include <linux/version.h>
+#include "bpf_helpers.h"
+#include "test_tracing_common.h"
+
+struct bpf_map_def SEC("maps") results = {
+	.type = BPF_MAP_TYPE_ARRAY,
+	.key_size = sizeof(__u32),
+	.value_size = sizeof(__u64),
+	.max_entries = NR_RESULTS,
+};
+
+static __always_inline __u64 *result(__u32 key)
+{
+	return bpf_map_lookup_elem(&results, &key);
+}
+
+static __always_inline int traced_task(void)
+{
+	__u64 *tgid = result(RES_TGID);
+
+	return tgid && *tgid == bpf_get_current_pid_tgid() >> 32;
+}
+
+/* All programs are attached to SYS_GETPID by the test */
+SEC("fentry/getpid")
+int fentry_getpid(struct bpf_tracing_ctx *ctx)
+{
+	__u64 *hits = result(RES_FENTRY_HITS);
+	__u64 *arg = result(RES_FENTRY_ARG0);
+
+	if (!hits || !arg || !traced_task())
+		return 0;
+	__sync_fetch_and_add(hits, 1);
+	*arg = ctx->args[0];
+	return 0;
+}
+
+SEC("fexit/getpid")
+int fexit_getpid(struct bpf_tracing_ctx *ctx)
+{
+	__u64 *hits = result(RES_FEXIT_HITS);
+	__u64 *arg = result(RES_FEXIT_ARG0);
+	__u64 *ret = result(RES_FEXIT_RET);
+
+	if (!hits || !arg || !ret || !traced_task())
+		return 0;
+	__sync_fetch_and_add(hits, 1);
+	*arg = ctx->args[0];
+	*ret = ctx->ret;
+	return 0;
+}
+
+/* The same work for test_tracing_bench, attached as kprobe or kretprobe */
+SEC("kprobe/getpid")
+int kprobe_getpid(void *ctx)
+{
+	__u64 *hits = result(RES_KPROBE_HITS);
+
+	if (!hits || !traced_task())
+		return 0;
+	__sync_fetch_and_add(hits, 1);
+	return 0;
+}
+
+char _license[] SEC("license") = "GPL";
+__u32 _version SEC("version") = LINUX_VERSION_CODE;
@@ -47,7 +47,7 @@
 
 #define MAX_INSNS	BPF_MAXINSNS
 #define MAX_FIXUPS	8
-#define MAX_NR_MAPS	8
+#define MAX_NR_MAPS	9
 #define POINTER_VALUE	0xcafe4all
 #define TEST_DATA_LEN	64
 
@@ -68,6 +68,7 @@ struct bpf_test {
 	int fixup_prog2[MAX_FIXUPS];
 	int fixup_map_in_map[MAX_FIXUPS];
 	int fixup_cgroup_storage[MAX_FIXUPS];
+	int fixup_map_ringbuf[MAX_FIXUPS];
 	const char *errstr;
 	const char *errstr_unpriv;
 	uint32_t retval;
@@ -4641,6 +4642,157 @@ static struct bpf_test tests[] = {
 		.result = REJECT,
 		.flags = F_NEEDS_EFFICIENT_UNALIGNED_ACCESS,
 	},
+	{
+		"ringbuf: reserve, write and submit",
+		.insns = {
+			BPF_MOV64_IMM(BPF_REG_2, 8),
+			BPF_LD_MAP_FD(BPF_REG_1, 0),
+			BPF_MOV64_IMM(BPF_REG_3, 0),
+			BPF_RAW_INSN(BPF_JMP | BPF_CALL, 0, 0, 0,
+				     BPF_FUNC_ringbuf_reserve),
+			BPF_JMP_IMM(BPF_JEQ, BPF_REG_0, 0, 4),
+			BPF_ST_MEM(BPF_DW, BPF_REG_0, 0, 42),
+			BPF_MOV64_REG(BPF_REG_1, BPF_REG_0),
+			BPF_MOV64_IMM(BPF_REG_2, 0),
+			BPF_RAW_INSN(BPF_JMP | BPF_CALL, 0, 0, 0,
+				     BPF_FUNC_ringbuf_submit),
+			BPF_MOV64_IMM(BPF_REG_0, 0),
+			BPF_EXIT_INSN(),
+		},
+		.fixup_map_ringbuf = { 1 },
+		.result = ACCEPT,
+	},
+	{
+		"ringbuf: reserve and discard from spilled pointer",
+		.insns = {
+			BPF_MOV64_IMM(BPF_REG_2, 8),
+			BPF_LD_MAP_FD(BPF_REG_1, 0),
+			BPF_MOV64_IMM(BPF_REG_3, 0),
+			BPF_RAW_INSN(BPF_JMP | BPF_CALL, 0, 0, 0,
+				     BPF_FUNC_ringbuf_reserve),
+			BPF_STX_MEM(BPF_DW, BPF_REG_10, BPF_REG_0, -8),
+			BPF_JMP_IMM(BPF_JEQ, BPF_REG_0, 0, 3),
+			BPF_LDX_MEM(BPF_DW, BPF_REG_1, BPF_REG_10, -8),
+			BPF_MOV64_IMM(BPF_REG_2, 0),
+			BPF_RAW_INSN(BPF_JMP | BPF_CALL, 0, 0, 0,
+				     BPF_FUNC_ringbuf_discard),
+			BPF_MOV64_IMM(BPF_REG_0, 0),
+			BPF_EXIT_INSN(),
+		},
+		.fixup_map_ringbuf = { 1 },
+		.result = ACCEPT,
+	},
+	{
+		"ringbuf: unreleased reservation",
+		.insns = {
+			BPF_MOV64_IMM(BPF_REG_2, 8),
+			BPF_LD_MAP_FD(BPF_REG_1, 0),
+			BPF_MOV64_IMM(BPF_REG_3, 0),
+			BPF_RAW_INSN(BPF_JMP | BPF_CALL, 0, 0, 0,
+				     BPF_FUNC_ringbuf_reserve),
+			BPF_MOV64_IMM(BPF_REG_0, 0),
+			BPF_EXIT_INSN(),
+		},
+		.fixup_map_ringbuf = { 1 },
+		.result = REJECT,
+		.errstr = "Unreleased reference",
+	},
+	{
+		"ringbuf: write past the reservation",
+		.insns = {
+			BPF_MOV64_IMM(BPF_REG_2, 8),
+			BPF_LD_MAP_FD(BPF_REG_1, 0),
+			BPF_MOV64_IMM(BPF_REG_3, 0),
+			BPF_RAW_INSN(BPF_JMP | BPF_CALL, 0, 0, 0,
+				     BPF_FUNC_ringbuf_reserve),
+			BPF_JMP_IMM(BPF_JEQ, BPF_REG_0, 0, 4),
+			BPF_ST_MEM(BPF_DW, BPF_REG_0, 8, 42),
+			BPF_MOV64_REG(BPF_REG_1, BPF_REG_0),
+			BPF_MOV64_IMM(BPF_REG_2, 0),
+			BPF_RAW_INSN(BPF_JMP | BPF_CALL, 0, 0, 0,
+				     BPF_FUNC_ringbuf_submit),
+			BPF_MOV64_IMM(BPF_REG_0, 0),
+			BPF_EXIT_INSN(),
+		},
+		.fixup_map_ringbuf = { 1 },
+		.result = REJECT,
+		.errstr = "invalid access to memory, mem_size=8 off=8 size=8",
+	},
+	{
+		"ringbuf: use after submit",
+		.insns = {
+			BPF_MOV64_IMM(BPF_REG_2, 8),
+			BPF_LD_MAP_FD(BPF_REG_1, 0),
+			BPF_MOV64_IMM(BPF_REG_3, 0),
+			BPF_RAW_INSN(BPF_JMP | BPF_CALL, 0, 0, 0,
+				     BPF_FUNC_ringbuf_reserve),
+			BPF_MOV64_REG(BPF_REG_6, BPF_REG_0),
+			BPF_JMP_IMM(BPF_JEQ, BPF_REG_6, 0, 4),
+			BPF_MOV64_REG(BPF_REG_1, BPF_REG_6),
+			BPF_MOV64_IMM(BPF_REG_2, 0),
+			BPF_RAW_INSN(BPF_JMP | BPF_CALL, 0, 0, 0,
+				     BPF_FUNC_ringbuf_submit),
+			BPF_ST_MEM(BPF_DW, BPF_REG_6, 0, 42),
+			BPF_MOV64_IMM(BPF_REG_0, 0),
+			BPF_EXIT_INSN(),
+		},
+		.fixup_map_ringbuf = { 1 },
+		.result = REJECT,
+		.errstr = "R6 invalid mem access 'inv'",
+	},
+	{
+		"ringbuf: pointer arithmetic before null check",
+		.insns = {
+			BPF_MOV64_IMM(BPF_REG_2, 8),
+			BPF_LD_MAP_FD(BPF_REG_1, 0),
+			BPF_MOV64_IMM(BPF_REG_3, 0),
+			BPF_RAW_INSN(BPF_JMP | BPF_CALL, 0, 0, 0,
+				     BPF_FUNC_ringbuf_reserve),
+			BPF_ALU64_IMM(BPF_ADD, BPF_REG_0, 8),
+			BPF_MOV64_IMM(BPF_REG_0, 0),
+			BPF_EXIT_INSN(),
+		},
+		.fixup_map_ringbuf = { 1 },
+		.result = REJECT,
+		.errstr = "pointer arithmetic on PTR_TO_MEM_OR_NULL prohibited",
+	},
+	{
+		"ringbuf: submit of an interior pointer",
+		.insns = {
+			BPF_MOV64_IMM(BPF_REG_2, 16),
+			BPF_LD_MAP_FD(BPF_REG_1, 0),
+			BPF_MOV64_IMM(BPF_REG_3, 0),
+			BPF_RAW_INSN(BPF_JMP | BPF_CALL, 0, 0, 0,
+				     BPF_FUNC_ringbuf_reserve),
+			BPF_JMP_IMM(BPF_JEQ, BPF_REG_0, 0, 4),
+			BPF_MOV64_REG(BPF_REG_1, BPF_REG_0),
+			BPF_ALU64_IMM(BPF_ADD, BPF_REG_1, 8),
+			BPF_MOV64_IMM(BPF_REG_2, 0),
+			BPF_RAW_INSN(BPF_JMP | BPF_CALL, 0, 0, 0,
+				     BPF_FUNC_ringbuf_submit),
+			BPF_MOV64_IMM(BPF_REG_0, 0),
+			BPF_EXIT_INSN(),
+		},
+		.fixup_map_ringbuf = { 1 },
+		.result = REJECT,
+		.errstr = "R1 must point to the start of the allocated memory",
+	},
+	{
+		"ringbuf: reservation size not known",
+		.insns = {
+			BPF_LDX_MEM(BPF_W, BPF_REG_2, BPF_REG_1,
+				    offsetof(struct __sk_buff, len)),
+			BPF_LD_MAP_FD(BPF_REG_1, 0),
+			BPF_MOV64_IMM(BPF_REG_3, 0),
+			BPF_RAW_INSN(BPF_JMP | BPF_CALL, 0, 0, 0,
+				     BPF_FUNC_ringbuf_reserve),
+			BPF_MOV64_IMM(BPF_REG_0, 0),
+			BPF_EXIT_INSN(),
+		},
+		.fixup_map_ringbuf = { 1 },
+		.result = REJECT,
+		.errstr = "R2 is not a known constant",
+	},
 	{
 		"valid cgroup storage access",
 		.insns = {
@@ -12660,6 +12812,17 @@ static int create_cgroup_storage(void)
 	return fd;
 }
 
+static int create_ringbuf(void)
+{
+	int fd;
+
+	fd = bpf_create_map(BPF_MAP_TYPE_RINGBUF, 0, 0, getpagesize(), 0);
+	if (fd < 0)
+		printf("Failed to create ringbuf '%s'!\n", strerror(errno));
+
+	return fd;
+}
+
 static char bpf_vlog[UINT_MAX >> 8];
 
 static void do_test_fixup(struct bpf_test *test, struct bpf_insn *prog,
@@ -12673,6 +12836,7 @@ static void do_test_fixup(struct bpf_test *test, struct bpf_insn *prog,
 	int *fixup_prog2 = test->fixup_prog2;
 	int *fixup_map_in_map = test->fixup_map_in_map;
 	int *fixup_cgroup_storage = test->fixup_cgroup_storage;
+	int *fixup_map_ringbuf = test->fixup_map_ringbuf;
 
 	if (test->fill_helper)
 		test->fill_helper(test);
@@ -12748,6 +12912,14 @@ static void do_test_fixup(struct bpf_test *test, struct bpf_insn *prog,
 			fixup_cgroup_storage++;
 		} while (*fixup_cgroup_storage);
 	}
+
+	if (*fixup_map_ringbuf) {
+		map_fds[8] = create_ringbuf();
+		do {
+			prog[*fixup_map_ringbuf].imm = map_fds[8];
+			fixup_map_ringbuf++;
+		} while (*fixup_map_ringbuf);
+	}
 }
 
 static void do_test_single(struct bpf_test *test, bool unpriv,
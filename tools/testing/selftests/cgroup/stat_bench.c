@@ -0,0 +1,163 @@
+/* SPDX-License-Identifier: GPL-2.0 */
+/*
+ * Cost of reading the stats of many cgroups: -n cgroups (default 500)
+ * are created under one parent with the memory controller enabled, and
+ * each faults in some anonymous memory once.  memory.stat and cpu.stat
+ * of every cgroup are then read -r times over, first with all of them
+ * idle, then with -a of them allocating and freeing memory in a loop.
+ * The parent's memory.stat, which covers them all, is read as well.
+ * Reports the average time of a read of each file.
+ *
+ * With the stats on rstat, a read costs the cgroups and CPUs with updates
+ * since the last flush, not the whole subtree on every CPU.
+ *
+ * Usage: stat_bench [-n cgroups] [-a active] [-r rounds]
+ */
+
+#include <linux/limits.h>
+#include <errno.h>
+#include <getopt.h>
+#include <signal.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "../kselftest.h"
+#include "cgroup_util.h"
+
+static int cfg_cgroups = 500;
+static int cfg_active = 10;
+static int cfg_rounds = 20;
+
+static char *parent;
+static char **children;
+static int *churners;
+
+static unsigned long long now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/* Fault in, touch and free memory until killed */
+static int churn(const char *cgroup, void *arg)
+{
+	for (;;)
+		alloc_anon(cgroup, arg);
+	return 0;
+}
+
+/* Average ns of a read of @control in each of the @nr @cgroups */
+static double read_all(char **cgroups, int nr, const char *control)
+{
+	static char buf[16 * PAGE_SIZE];
+	unsigned long long start;
+	int r, i;
+
+	start = now_ns();
+	for (r = 0; r < cfg_rounds; r++)
+		for (i = 0; i < nr; i++)
+			if (cg_read(cgroups[i], control, buf, sizeof(buf)))
+				ksft_exit_fail_msg("cannot read %s/%s\n",
+						   cgroups[i], control);
+	return (double)(now_ns() - start) / cfg_rounds / nr;
+}
+
+static void run(const char *name)
+{
+	double mem, cpu, top;
+
+	mem = read_all(children, cfg_cgroups, "memory.stat");
+	cpu = read_all(children, cfg_cgroups, "cpu.stat");
+	top = read_all(&parent, 1, "memory.stat");
+
+	printf("%-8s memory.stat %8.1f us  cpu.stat %8.1f us  parent memory.stat %8.1f us\n",
+	       name, mem / 1000, cpu / 1000, top / 1000);
+}
+
+static void cleanup(void)
+{
+	int i;
+
+	for (i = 0; i < cfg_active; i++) {
+		if (churners[i] <= 0)
+			continue;
+		kill(churners[i], SIGKILL);
+		waitpid(churners[i], NULL, 0);
+	}
+	for (i = 0; i < cfg_cgroups; i++)
+		if (children[i])
+			cg_destroy(children[i]);
+	cg_destroy(parent);
+}
+
+int main(int argc, char **argv)
+{
+	char root[PATH_MAX];
+	int c, i;
+
+	while ((c = getopt(argc, argv, "n:a:r:")) != -1) {
+		switch (c) {
+		case 'n':
+			cfg_cgroups = atoi(optarg);
+			break;
+		case 'a':
+			cfg_active = atoi(optarg);
+			break;
+		case 'r':
+			cfg_rounds = atoi(optarg);
+			break;
+		default:
+			ksft_exit_fail_msg("usage: %s [-n cgroups] [-a active] [-r rounds]\n",
+					   argv[0]);
+		}
+	}
+	if (cfg_cgroups <= 0 || cfg_active < 0 || cfg_active > cfg_cgroups ||
+	    cfg_rounds <= 0)
+		ksft_exit_fail_msg("bad arguments\n");
+
+	if (cg_find_unified_root(root, sizeof(root)))
+		ksft_exit_skip("cgroup v2 isn't mounted\n");
+	if (cg_read_strstr(root, "cgroup.controllers", "memory"))
+		ksft_exit_skip("memory controller isn't available\n");
+	if (cg_write(root, "cgroup.subtree_control", "+memory"))
+		ksft_exit_skip("cannot enable the memory controller\n");
+
+	children = calloc(cfg_cgroups, sizeof(*children));
+	churners = calloc(cfg_active, sizeof(*churners));
+	parent = cg_name(root, "stat_bench");
+	if (!children || !churners || !parent)
+		ksft_exit_fail_msg("no memory\n");
+	if (cg_create(parent) ||
+	    cg_write(parent, "cgroup.subtree_control", "+memory"))
+		ksft_exit_fail_msg("cannot create %s\n", parent);
+
+	for (i = 0; i < cfg_cgroups; i++) {
+		children[i] = cg_name_indexed(parent, "child", i);
+		if (!children[i] || cg_create(children[i]) ||
+		    cg_run(children[i], alloc_anon, (void *)MB(1))) {
+			cleanup();
+			ksft_exit_fail_msg("cannot set up cgroup %d\n", i);
+		}
+	}
+
+	printf("%d cgroups, %d active, %d rounds\n", cfg_cgroups, cfg_active,
+	       cfg_rounds);
+	run("idle");
+
+	for (i = 0; i < cfg_active; i++) {
+		churners[i] = cg_run_nowait(children[i], churn, (void *)MB(4));
+		if (churners[i] < 0) {
+			cleanup();
+			ksft_exit_fail_msg("fork: %s\n", strerror(errno));
+		}
+	}
+	run("active");
+
+	cleanup();
+	return 0;
+}
@@ -0,0 +1,88 @@
+#!/bin/bash
+# SPDX-License-Identifier: GPL-2.0
+#
+# Private futex hash against the global one across many processes: runs
+# NR_PROCS copies of perf bench futex hash, then of perf bench futex wake,
+# at once, with the private futexes of each process in the global hash
+# (-b 0), in the default private hash, and in a private hash of BUCKETS
+# buckets. Reports the summed operations per second of the hash runs, the
+# average wakeup time of the wake runs, and the bucket lock contention
+# counted in debugfs futex_hash, which is enabled for the runs.
+#
+# Set NR_PROCS (default 8), THREADS per process (default 4), RUNTIME of a
+# hash run in seconds (default 5) and BUCKETS (default 256).
+
+readonly STATS=/sys/kernel/debug/futex_hash
+readonly NR_PROCS=${NR_PROCS:-8}
+readonly THREADS=${THREADS:-4}
+readonly RUNTIME=${RUNTIME:-5}
+readonly BUCKETS=${BUCKETS:-256}
+
+ksft_skip=4
+
+tmp=$(mktemp -d)
+enabled=
+cleanup() {
+	[[ -n "${enabled}" ]] && echo "${enabled}" > "${STATS}"
+	rm -rf "${tmp}"
+}
+trap cleanup EXIT
+
+if [[ $EUID -ne 0 ]]; then
+	echo "SKIP: need root privileges"
+	exit $ksft_skip
+fi
+if [[ ! -r "${STATS}" ]]; then
+	echo "SKIP: no ${STATS}"
+	exit $ksft_skip
+fi
+if ! perf bench futex hash -b 0 -r 1 -t 1 -s >/dev/null 2>&1; then
+	echo "SKIP: no perf bench futex hash with PR_FUTEX_HASH"
+	exit $ksft_skip
+fi
+
+enabled=$(awk '$1 == "enabled" { print $2 }' "${STATS}")
+echo 1 > "${STATS}"
+
+# lookups and contended of the global and private tables
+hash_stats() {
+	awk '{ v[$1] = $2 }
+	     END { print v["global_lookups"], v["global_contended"],
+			 v["private_lookups"], v["private_contended"] }' "${STATS}"
+}
+
+# Run NR_PROCS copies of a perf bench futex command, their outputs in tmp
+run_procs() {
+	local i
+
+	for ((i = 0; i < NR_PROCS; i++)); do
+		perf bench futex "$@" > "${tmp}/${i}" 2>&1 &
+	done
+	wait
+}
+
+run() {
+	local name=$1; shift
+	local before after ops wake lookups contended
+
+	before=($(hash_stats))
+	run_procs hash -s -t "${THREADS}" -r "${RUNTIME}" "$@"
+	ops=$(awk '/^Averaged/ { ops += $2 * '"${THREADS}"' } END { print ops }' \
+	      "${tmp}"/*)
+	run_procs wake -s -t "${THREADS}" "$@"
+	wake=$(awk '/^Wokeup/ { ms += $(NF - 2); n++ } END { printf "%.4f", ms / n }' \
+	       "${tmp}"/*)
+	after=($(hash_stats))
+
+	lookups=$((after[0] - before[0] + after[2] - before[2]))
+	contended=$((after[1] - before[1] + after[3] - before[3]))
+	awk -v name="${name}" -v ops="${ops}" -v wake="${wake}" \
+	    -v l="${lookups}" -v c="${contended}" \
+	    'BEGIN { printf "  %-16s %12d hash ops/s %10s ms/wakeup %8.4f%% contended\n",
+		     name, ops, wake, l ? 100 * c / l : 0 }'
+}
+
+echo "${NR_PROCS} processes of ${THREADS} threads"
+run "global" -b 0
+run "private default"
+run "private ${BUCKETS}" -b "${BUCKETS}"
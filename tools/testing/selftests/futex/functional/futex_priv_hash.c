@@ -0,0 +1,196 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * DESCRIPTION
+ *      Test the private futex hash of a process: PR_FUTEX_HASH sizes it
+ *      while the process is single threaded only, a default one comes
+ *      with the first thread, and waits and wakes work through it.
+ */
+
+#include <errno.h>
+#include <getopt.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/prctl.h>
+#include <sys/wait.h>
+#include "futextest.h"
+#include "logging.h"
+
+#ifndef PR_FUTEX_HASH
+#define PR_FUTEX_HASH			78
+# define PR_FUTEX_HASH_SET_SLOTS	1
+# define PR_FUTEX_HASH_GET_SLOTS	2
+#endif
+
+#define TEST_NAME "futex-priv-hash"
+#define WAKE_WAIT_US 10000
+
+static futex_t f1 = FUTEX_INITIALIZER;
+static int ret = RET_PASS;
+
+void usage(char *prog)
+{
+	printf("Usage: %s\n", prog);
+	printf("  -c	Use color\n");
+	printf("  -h	Display this help message\n");
+	printf("  -v L	Verbosity level: %d=QUIET %d=CRITICAL %d=INFO\n",
+	       VQUIET, VCRITICAL, VINFO);
+}
+
+static int hash_set(unsigned long slots, unsigned long arg4)
+{
+	return prctl(PR_FUTEX_HASH, PR_FUTEX_HASH_SET_SLOTS, slots, arg4, 0);
+}
+
+static int hash_get(void)
+{
+	return prctl(PR_FUTEX_HASH, PR_FUTEX_HASH_GET_SLOTS, 0, 0, 0);
+}
+
+static void expect_slots(const char *what, int slots)
+{
+	int res = hash_get();
+
+	if (res != slots) {
+		fail("%s: %d buckets, expected %d\n", what, res, slots);
+		ret = RET_FAIL;
+	}
+}
+
+static void expect_set(const char *what, unsigned long slots,
+		       unsigned long arg4, int err)
+{
+	int res = hash_set(slots, arg4);
+
+	if (err ? res != -1 || errno != err : res != 0) {
+		fail("%s: PR_FUTEX_HASH_SET_SLOTS returned %d (%s)\n", what,
+		     res, res ? strerror(errno) : "");
+		ret = RET_FAIL;
+	}
+}
+
+static void *waiter(void *arg)
+{
+	futex_wait(&f1, 0, NULL, FUTEX_PRIVATE_FLAG);
+	return NULL;
+}
+
+static void *idle(void *arg)
+{
+	return NULL;
+}
+
+static void test_set(void)
+{
+	expect_slots("single threaded", 0);
+
+	expect_set("one bucket", 1, 0, EINVAL);
+	expect_set("not a power of two", 24, 0, EINVAL);
+	expect_set("too many buckets", 1UL << 30, 0, EINVAL);
+	expect_set("flags", 16, 1, EINVAL);
+
+	expect_set("16 buckets", 16, 0, 0);
+	expect_slots("16 buckets", 16);
+	expect_set("global hash", 0, 0, 0);
+	expect_slots("global hash", 0);
+	expect_set("4 buckets", 4, 0, 0);
+	expect_slots("4 buckets", 4);
+}
+
+static void test_threads(void)
+{
+	pthread_t thread;
+	int i;
+
+	/* a size set before the first thread is kept */
+	f1 = 0;
+	if (pthread_create(&thread, NULL, waiter, NULL)) {
+		error("pthread_create\n", errno);
+		ret = RET_ERROR;
+		return;
+	}
+	usleep(WAKE_WAIT_US);
+	expect_slots("with a thread", 4);
+	expect_set("with a thread", 64, 0, EBUSY);
+
+	info("Waking the thread through the private hash\n");
+	f1 = 1;
+	if (futex_wake(&f1, 1, FUTEX_PRIVATE_FLAG) != 1) {
+		fail("no thread woken\n");
+		ret = RET_FAIL;
+		f1 = 0;
+	}
+	pthread_join(thread, NULL);
+
+	/* the mm of the thread can be released after it is joined */
+	for (i = 0; i < 100 && hash_set(64, 0); i++)
+		usleep(WAKE_WAIT_US);
+	expect_slots("thread gone", 64);
+}
+
+static void test_default(void)
+{
+	pthread_t thread;
+	int status, slots;
+	pid_t pid;
+
+	pid = fork();
+	if (pid < 0) {
+		error("fork\n", errno);
+		ret = RET_ERROR;
+		return;
+	}
+	if (!pid) {
+		/* a new mm starts on the global hash */
+		if (hash_get())
+			_exit(1);
+		if (pthread_create(&thread, NULL, idle, NULL))
+			_exit(2);
+		slots = hash_get();
+		pthread_join(thread, NULL);
+		_exit(slots >= 16 && !(slots & (slots - 1)) ? 0 : 3);
+	}
+
+	waitpid(pid, &status, 0);
+	if (!WIFEXITED(status) || WEXITSTATUS(status)) {
+		fail("no default private hash with the first thread: %d\n",
+		     WIFEXITED(status) ? WEXITSTATUS(status) : -1);
+		ret = RET_FAIL;
+	}
+}
+
+int main(int argc, char *argv[])
+{
+	int c;
+
+	while ((c = getopt(argc, argv, "chv:")) != -1) {
+		switch (c) {
+		case 'c':
+			log_color(1);
+			break;
+		case 'h':
+			usage(basename(argv[0]));
+			exit(0);
+		case 'v':
+			log_verbosity(atoi(optarg));
+			break;
+		default:
+			usage(basename(argv[0]));
+			exit(1);
+		}
+	}
+
+	ksft_print_header();
+	ksft_print_msg("%s: Test the private futex hash\n", basename(argv[0]));
+
+	if (hash_get() < 0)
+		ksft_exit_skip("PR_FUTEX_HASH is not supported\n");
+
+	test_default();
+	test_set();
+	test_threads();
+
+	print_result(TEST_NAME, ret);
+	return ret;
+}
@@ -0,0 +1,218 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * DESCRIPTION
+ *      Test futex_waitv(): waiting on private and shared futexes, the
+ *      index of the woken futex, the timeouts of both clocks, a futex
+ *      holding an unexpected value and the invalid arguments.
+ */
+
+#include <errno.h>
+#include <getopt.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <sys/mman.h>
+#include "futex2test.h"
+#include "logging.h"
+
+#define TEST_NAME "futex-waitv"
+#define WAKE_WAIT_US 10000
+
+static futex_t *futexes;
+static struct futex_waitv waitv[FUTEX_WAITV_MAX];
+static int ret = RET_PASS;
+
+void usage(char *prog)
+{
+	printf("Usage: %s\n", prog);
+	printf("  -c	Use color\n");
+	printf("  -h	Display this help message\n");
+	printf("  -v L	Verbosity level: %d=QUIET %d=CRITICAL %d=INFO\n",
+	       VQUIET, VCRITICAL, VINFO);
+}
+
+static void waitv_init(int nr, unsigned int flags)
+{
+	int i;
+
+	for (i = 0; i < nr; i++) {
+		futexes[i] = 0;
+		waitv[i].uaddr = (uintptr_t)&futexes[i];
+		waitv[i].val = 0;
+		waitv[i].flags = FUTEX_32 | flags;
+		waitv[i].__reserved = 0;
+	}
+}
+
+static void timeout_in(struct timespec *to, clockid_t clockid, long ms)
+{
+	clock_gettime(clockid, to);
+	to->tv_sec += ms / 1000;
+	to->tv_nsec += (ms % 1000) * 1000000;
+	if (to->tv_nsec >= 1000000000) {
+		to->tv_nsec -= 1000000000;
+		to->tv_sec++;
+	}
+}
+
+static void *waiter(void *arg)
+{
+	struct timespec to;
+	long res;
+
+	timeout_in(&to, CLOCK_MONOTONIC, 1000);
+	res = futex_waitv(waitv, FUTEX_WAITV_MAX, 0, &to, CLOCK_MONOTONIC);
+	return (void *)(res < 0 ? -(long)errno : res);
+}
+
+/* Wake the futex at index idx of a waiter of all the futexes */
+static void test_wake(const char *name, unsigned int flags, int idx)
+{
+	pthread_t thread;
+	void *res;
+
+	waitv_init(FUTEX_WAITV_MAX, flags);
+	if (pthread_create(&thread, NULL, waiter, NULL)) {
+		error("pthread_create\n", errno);
+		ret = RET_ERROR;
+		return;
+	}
+	usleep(WAKE_WAIT_US);
+
+	info("Waking futex %d of %d %s futexes\n", idx, FUTEX_WAITV_MAX, name);
+	futexes[idx] = 1;
+	futex_wake(&futexes[idx], 1, flags & FUTEX_PRIVATE_FLAG);
+	pthread_join(thread, &res);
+
+	if ((long)res != idx) {
+		fail("%s futexes: futex_waitv returned %ld, expected %d\n",
+		     name, (long)res, idx);
+		ret = RET_FAIL;
+	}
+}
+
+static void expect_error(const char *what, int res, int err)
+{
+	if (res != -1 || errno != err) {
+		fail("%s: futex_waitv returned %d (%s), expected %s\n", what,
+		     res, res < 0 ? strerror(errno) : "", strerror(err));
+		ret = RET_FAIL;
+	}
+}
+
+static void test_timeout(void)
+{
+	static const clockid_t clocks[] = { CLOCK_MONOTONIC, CLOCK_REALTIME };
+	struct timespec to;
+	unsigned int i;
+
+	waitv_init(FUTEX_WAITV_MAX, FUTEX_PRIVATE_FLAG);
+	for (i = 0; i < sizeof(clocks) / sizeof(clocks[0]); i++) {
+		timeout_in(&to, clocks[i], 10);
+		expect_error("timeout",
+			     futex_waitv(waitv, FUTEX_WAITV_MAX, 0, &to, clocks[i]),
+			     ETIMEDOUT);
+	}
+}
+
+static void test_errors(void)
+{
+	struct timespec to;
+
+	timeout_in(&to, CLOCK_MONOTONIC, 10);
+
+	/* The last futex does not hold its expected value */
+	waitv_init(FUTEX_WAITV_MAX, FUTEX_PRIVATE_FLAG);
+	futexes[FUTEX_WAITV_MAX - 1] = 1;
+	expect_error("unexpected value",
+		     futex_waitv(waitv, FUTEX_WAITV_MAX, 0, &to, CLOCK_MONOTONIC),
+		     EWOULDBLOCK);
+
+	waitv_init(2, FUTEX_PRIVATE_FLAG);
+	expect_error("flags", futex_waitv(waitv, 2, 1, &to, CLOCK_MONOTONIC),
+		     EINVAL);
+	expect_error("no futexes", futex_waitv(waitv, 0, 0, &to, CLOCK_MONOTONIC),
+		     EINVAL);
+	expect_error("too many futexes",
+		     futex_waitv(waitv, FUTEX_WAITV_MAX + 1, 0, &to,
+				 CLOCK_MONOTONIC), EINVAL);
+	expect_error("NULL list", futex_waitv(NULL, 2, 0, &to, CLOCK_MONOTONIC),
+		     EINVAL);
+	expect_error("bad clock", futex_waitv(waitv, 2, 0, &to, CLOCK_TAI),
+		     EINVAL);
+	expect_error("bad list", futex_waitv((struct futex_waitv *)16, 2, 0, &to,
+					     CLOCK_MONOTONIC), EFAULT);
+
+	waitv[1].flags = FUTEX_PRIVATE_FLAG;
+	expect_error("no FUTEX_32", futex_waitv(waitv, 2, 0, &to, CLOCK_MONOTONIC),
+		     EINVAL);
+	waitv_init(2, FUTEX_PRIVATE_FLAG);
+	waitv[1].__reserved = 1;
+	expect_error("reserved", futex_waitv(waitv, 2, 0, &to, CLOCK_MONOTONIC),
+		     EINVAL);
+	waitv_init(2, FUTEX_PRIVATE_FLAG);
+	waitv[1].val = 1ULL << 32;
+	expect_error("64 bit value", futex_waitv(waitv, 2, 0, &to, CLOCK_MONOTONIC),
+		     EINVAL);
+	waitv_init(2, FUTEX_PRIVATE_FLAG);
+	waitv[1].uaddr += 1;
+	expect_error("unaligned futex",
+		     futex_waitv(waitv, 2, 0, &to, CLOCK_MONOTONIC), EINVAL);
+	waitv_init(2, FUTEX_PRIVATE_FLAG);
+	waitv[1].uaddr = 16;
+	expect_error("bad futex", futex_waitv(waitv, 2, 0, &to, CLOCK_MONOTONIC),
+		     EFAULT);
+
+	waitv_init(2, FUTEX_PRIVATE_FLAG);
+	to.tv_nsec = 1000000000;
+	expect_error("bad timeout", futex_waitv(waitv, 2, 0, &to, CLOCK_MONOTONIC),
+		     EINVAL);
+}
+
+int main(int argc, char *argv[])
+{
+	int c;
+
+	while ((c = getopt(argc, argv, "chv:")) != -1) {
+		switch (c) {
+		case 'c':
+			log_color(1);
+			break;
+		case 'h':
+			usage(basename(argv[0]));
+			exit(0);
+		case 'v':
+			log_verbosity(atoi(optarg));
+			break;
+		default:
+			usage(basename(argv[0]));
+			exit(1);
+		}
+	}
+
+	ksft_print_header();
+	ksft_print_msg("%s: Test futex_waitv\n", basename(argv[0]));
+
+	if (futex_waitv(NULL, 0, 0, NULL, 0) && errno == ENOSYS)
+		ksft_exit_skip("futex_waitv is not supported\n");
+
+	/* shared futexes must live in a shared mapping to be shared */
+	futexes = mmap(NULL, FUTEX_WAITV_MAX * sizeof(*futexes),
+		       PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+	if (futexes == MAP_FAILED) {
+		error("mmap\n", errno);
+		return RET_ERROR;
+	}
+
+	test_wake("private", FUTEX_PRIVATE_FLAG, FUTEX_WAITV_MAX - 1);
+	test_wake("private", FUTEX_PRIVATE_FLAG, 0);
+	test_wake("shared", 0, FUTEX_WAITV_MAX / 2);
+	test_timeout();
+	test_errors();
+
+	print_result(TEST_NAME, ret);
+	return ret;
+}
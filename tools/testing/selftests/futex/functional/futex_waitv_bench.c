@@ -0,0 +1,215 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * DESCRIPTION
+ *      Wakeup latency of a thread waiting on many objects at once, the
+ *      WaitForMultipleObjects() pattern: two threads ping-pong, each waits
+ *      on -n objects and the other signals a different one of them every
+ *      round. The objects are futexes waited on with futex_waitv(), then
+ *      eventfds waited on with poll(). Reports the average, median and
+ *      99th percentile of a one way wakeup.
+ *
+ *      Usage: futex_waitv_bench [-n objects] [-l loops]
+ */
+
+#include <errno.h>
+#include <getopt.h>
+#include <poll.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <sys/eventfd.h>
+#include "futex2test.h"
+
+#define KSFT_SKIP 4
+
+static int nr_objs = 64;
+static long loops = 100000;
+
+/* The objects each side waits on */
+static futex_t futexes[2][FUTEX_WAITV_MAX];
+static struct pollfd pollfds[2][FUTEX_WAITV_MAX];
+
+static unsigned long long now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static void die(const char *what)
+{
+	fprintf(stderr, "%s: %s\n", what, strerror(errno));
+	exit(1);
+}
+
+static void futex_signal(int side, int idx)
+{
+	__atomic_store_n(&futexes[side][idx], 1, __ATOMIC_RELEASE);
+	futex_wake(&futexes[side][idx], 1, FUTEX_PRIVATE_FLAG);
+}
+
+static int futex_wait_any(int side)
+{
+	struct futex_waitv waitv[FUTEX_WAITV_MAX];
+	int i, idx;
+
+	for (i = 0; i < nr_objs; i++) {
+		waitv[i].uaddr = (uintptr_t)&futexes[side][i];
+		waitv[i].val = 0;
+		waitv[i].flags = FUTEX_32 | FUTEX_PRIVATE_FLAG;
+		waitv[i].__reserved = 0;
+	}
+
+	for (;;) {
+		idx = futex_waitv(waitv, nr_objs, 0, NULL, 0);
+		if (idx < 0 && errno != EWOULDBLOCK && errno != EINTR)
+			die("futex_waitv");
+		/* signalled before we slept, or woken */
+		for (i = 0; i < nr_objs; i++) {
+			if (__atomic_load_n(&futexes[side][i], __ATOMIC_ACQUIRE)) {
+				futexes[side][i] = 0;
+				return i;
+			}
+		}
+	}
+}
+
+static void eventfd_signal(int side, int idx)
+{
+	uint64_t one = 1;
+
+	if (write(pollfds[side][idx].fd, &one, sizeof(one)) != sizeof(one))
+		die("eventfd write");
+}
+
+static int eventfd_wait_any(int side)
+{
+	uint64_t val;
+	int i;
+
+	for (;;) {
+		if (poll(pollfds[side], nr_objs, -1) < 0 && errno != EINTR)
+			die("poll");
+		for (i = 0; i < nr_objs; i++) {
+			if (pollfds[side][i].revents & POLLIN) {
+				if (read(pollfds[side][i].fd, &val, sizeof(val)) < 0)
+					die("eventfd read");
+				return i;
+			}
+		}
+	}
+}
+
+struct method {
+	const char *name;
+	void (*signal)(int side, int idx);
+	int (*wait_any)(int side);
+};
+
+static const struct method *method;
+
+/* Side 1: wait, then signal the same index back */
+static void *echo(void *arg)
+{
+	long i;
+
+	for (i = 0; i < loops; i++)
+		method->signal(0, method->wait_any(1));
+	return NULL;
+}
+
+static int cmp_ull(const void *a, const void *b)
+{
+	unsigned long long x = *(const unsigned long long *)a;
+	unsigned long long y = *(const unsigned long long *)b;
+
+	return x < y ? -1 : x > y;
+}
+
+static void run(const struct method *m)
+{
+	unsigned long long *lat, start, sum = 0;
+	pthread_t thread;
+	long i;
+	int idx;
+
+	method = m;
+	lat = calloc(loops, sizeof(*lat));
+	if (!lat)
+		die("calloc");
+	if (pthread_create(&thread, NULL, echo, NULL))
+		die("pthread_create");
+
+	for (i = 0; i < loops; i++) {
+		start = now_ns();
+		m->signal(1, i % nr_objs);
+		idx = m->wait_any(0);
+		/* a round trip is two wakeups */
+		lat[i] = (now_ns() - start) / 2;
+		sum += lat[i];
+		if (idx != i % nr_objs) {
+			fprintf(stderr, "%s: object %d signalled, %ld expected\n",
+				m->name, idx, i % nr_objs);
+			exit(1);
+		}
+	}
+	pthread_join(thread, NULL);
+
+	qsort(lat, loops, sizeof(*lat), cmp_ull);
+	printf("%-14s avg %8.0f ns  p50 %8llu ns  p99 %8llu ns\n", m->name,
+	       (double)sum / loops, lat[loops / 2], lat[loops * 99 / 100]);
+	free(lat);
+}
+
+static const struct method methods[] = {
+	{ "futex_waitv", futex_signal, futex_wait_any },
+	{ "eventfd+poll", eventfd_signal, eventfd_wait_any },
+};
+
+int main(int argc, char *argv[])
+{
+	unsigned int m;
+	int c, i, side;
+
+	while ((c = getopt(argc, argv, "n:l:")) != -1) {
+		switch (c) {
+		case 'n':
+			nr_objs = atoi(optarg);
+			break;
+		case 'l':
+			loops = strtol(optarg, NULL, 0);
+			break;
+		default:
+			printf("Usage: %s [-n objects] [-l loops]\n", argv[0]);
+			exit(1);
+		}
+	}
+	if (nr_objs <= 0 || nr_objs > FUTEX_WAITV_MAX || loops <= 0) {
+		printf("objects must be in [1, %d], loops positive\n",
+		       FUTEX_WAITV_MAX);
+		exit(1);
+	}
+
+	if (futex_waitv(NULL, 0, 0, NULL, 0) && errno == ENOSYS) {
+		printf("futex_waitv is not supported, skipping\n");
+		return KSFT_SKIP;
+	}
+
+	for (side = 0; side < 2; side++) {
+		for (i = 0; i < nr_objs; i++) {
+			pollfds[side][i].fd = eventfd(0, 0);
+			pollfds[side][i].events = POLLIN;
+			if (pollfds[side][i].fd < 0)
+				die("eventfd");
+		}
+	}
+
+	printf("%d objects, %ld round trips\n", nr_objs, loops);
+	for (m = 0; m < sizeof(methods) / sizeof(methods[0]); m++)
+		run(&methods[m]);
+	return 0;
+}
@@ -77,3 +77,9 @@ echo
 echo
 ./futex_wait_uninitialized_heap $COLOR
 ./futex_wait_private_mapped_file $COLOR
+
+echo
+./futex_waitv $COLOR
+
+echo
+./futex_priv_hash $COLOR
@@ -0,0 +1,57 @@
+/* SPDX-License-Identifier: GPL-2.0 */
+/*
+ * futex_waitv() wrapper for the futex tests, with the definitions a system
+ * header older than the syscall lacks.
+ */
+#ifndef _FUTEX2TEST_H
+#define _FUTEX2TEST_H
+
+#include <time.h>
+#include "futextest.h"
+
+#ifndef __NR_futex_waitv
+#define __NR_futex_waitv 449
+#endif
+
+#ifndef FUTEX_32
+#define FUTEX_32		2
+#define FUTEX_WAITV_MAX		128
+
+struct futex_waitv {
+	__u64 val;
+	__u64 uaddr;
+	__u32 flags;
+	__u32 __reserved;
+};
+#endif
+
+/**
+ * futex_waitv() - wait on a list of futexes
+ * @waiters:	the futexes, with their expected values
+ * @nr_waiters:	length of the list
+ * @flags:	syscall flags, must be 0
+ * @timo:	absolute timeout, or NULL
+ * @clockid:	clock of the timeout, CLOCK_MONOTONIC or CLOCK_REALTIME
+ *
+ * Return: the index of a woken futex, or -1 with errno set.
+ */
+static inline int
+futex_waitv(struct futex_waitv *waiters, unsigned long nr_waiters,
+	    unsigned long flags, struct timespec *timo, clockid_t clockid)
+{
+	/* the syscall takes a struct __kernel_timespec */
+	struct {
+		long long tv_sec;
+		long long tv_nsec;
+	} kts, *ktsp = NULL;
+
+	if (timo) {
+		kts.tv_sec = timo->tv_sec;
+		kts.tv_nsec = timo->tv_nsec;
+		ktsp = &kts;
+	}
+	return syscall(__NR_futex_waitv, waiters, nr_waiters, flags, ktsp,
+		       clockid);
+}
+
+#endif
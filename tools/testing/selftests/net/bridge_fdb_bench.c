@@ -0,0 +1,188 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * Bridge forwarding benchmark with many MAC addresses.
+ *
+ * Sends Ethernet frames on -i from -n source addresses, optionally to -m
+ * destination addresses, cycling through both sets so that every frame
+ * comes from a different station. Source addresses are generated from
+ * the -s seed byte and destinations from -d, so that one instance run on
+ * the far side of a bridge with -s X can populate the FDB with the
+ * destinations of another instance run with -d X.
+ *
+ * Reports the transmit rate; the forwarding rate is read on the receiving
+ * side by the caller.
+ *
+ * Usage: bridge_fdb_bench -i dev -n srcs -s seed [-m dsts -d seed]
+ *			   [-l secs] [-t threads]
+ */
+
+#define _GNU_SOURCE
+
+#include <arpa/inet.h>
+#include <errno.h>
+#include <error.h>
+#include <linux/if_ether.h>
+#include <linux/if_packet.h>
+#include <net/if.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+#define FRAME_LEN	64
+
+static const char *cfg_ifname;
+static int cfg_num_src = 1000;
+static int cfg_num_dst;
+static int cfg_src_seed = 1;
+static int cfg_dst_seed = 2;
+static int cfg_runtime_sec = 5;
+static int cfg_threads = 1;
+
+static struct sockaddr_ll cfg_addr;
+static volatile bool stop;
+
+struct sender {
+	pthread_t	thread;
+	int		id;
+	unsigned long	frames;
+	unsigned long	errors;
+};
+
+/* locally administered unicast address 02:<seed>:<index> */
+static void gen_addr(unsigned char *mac, int seed, uint32_t idx)
+{
+	mac[0] = 0x02;
+	mac[1] = seed;
+	mac[2] = idx >> 24;
+	mac[3] = idx >> 16;
+	mac[4] = idx >> 8;
+	mac[5] = idx;
+}
+
+static void *sender_fn(void *arg)
+{
+	struct sender *s = arg;
+	unsigned char frame[FRAME_LEN] = {0};
+	struct ethhdr *eth = (void *)frame;
+	uint32_t src, dst = 0;
+	int fd;
+
+	fd = socket(PF_PACKET, SOCK_RAW, 0);
+	if (fd < 0)
+		error(1, errno, "socket");
+
+	eth->h_proto = htons(ETH_P_IP);
+	if (!cfg_num_dst)
+		memset(eth->h_dest, 0xff, ETH_ALEN);
+
+	/* threads start at different offsets of the address sets */
+	src = s->id * (cfg_num_src / cfg_threads);
+	while (!stop) {
+		gen_addr(eth->h_source, cfg_src_seed, src);
+		if (++src == (uint32_t)cfg_num_src)
+			src = 0;
+		if (cfg_num_dst) {
+			gen_addr(eth->h_dest, cfg_dst_seed, dst);
+			if (++dst == (uint32_t)cfg_num_dst)
+				dst = 0;
+		}
+
+		if (sendto(fd, frame, sizeof(frame), 0, (void *)&cfg_addr,
+			   sizeof(cfg_addr)) == sizeof(frame))
+			s->frames++;
+		else
+			s->errors++;
+	}
+
+	close(fd);
+	return NULL;
+}
+
+static void parse_opts(int argc, char **argv)
+{
+	int c;
+
+	while ((c = getopt(argc, argv, "d:i:l:m:n:s:t:")) != -1) {
+		switch (c) {
+		case 'd':
+			cfg_dst_seed = strtoul(optarg, NULL, 0);
+			break;
+		case 'i':
+			cfg_ifname = optarg;
+			break;
+		case 'l':
+			cfg_runtime_sec = strtoul(optarg, NULL, 0);
+			break;
+		case 'm':
+			cfg_num_dst = strtoul(optarg, NULL, 0);
+			break;
+		case 'n':
+			cfg_num_src = strtoul(optarg, NULL, 0);
+			break;
+		case 's':
+			cfg_src_seed = strtoul(optarg, NULL, 0);
+			break;
+		case 't':
+			cfg_threads = strtoul(optarg, NULL, 0);
+			break;
+		default:
+			error(1, 0, "usage: %s -i dev [-n srcs] [-s seed] [-m dsts] [-d seed] [-l secs] [-t threads]",
+			      argv[0]);
+		}
+	}
+
+	if (!cfg_ifname)
+		error(1, 0, "-i <dev> required");
+	if (cfg_num_src <= 0 || cfg_num_dst < 0)
+		error(1, 0, "invalid number of addresses");
+	if (cfg_threads <= 0)
+		error(1, 0, "invalid number of threads");
+
+	cfg_addr.sll_family = AF_PACKET;
+	cfg_addr.sll_halen = ETH_ALEN;
+	cfg_addr.sll_ifindex = if_nametoindex(cfg_ifname);
+	if (!cfg_addr.sll_ifindex)
+		error(1, errno, "if_nametoindex %s", cfg_ifname);
+}
+
+int main(int argc, char **argv)
+{
+	unsigned long total = 0, errors = 0;
+	struct sender *senders;
+	int i;
+
+	parse_opts(argc, argv);
+
+	senders = calloc(cfg_threads, sizeof(*senders));
+	if (!senders)
+		error(1, 0, "calloc");
+
+	for (i = 0; i < cfg_threads; i++) {
+		senders[i].id = i;
+		if (pthread_create(&senders[i].thread, NULL, sender_fn,
+				   &senders[i]))
+			error(1, errno, "pthread_create");
+	}
+
+	sleep(cfg_runtime_sec);
+	stop = true;
+
+	for (i = 0; i < cfg_threads; i++) {
+		pthread_join(senders[i].thread, NULL);
+		total += senders[i].frames;
+		errors += senders[i].errors;
+	}
+
+	fprintf(stderr, "srcs=%d dsts=%d threads=%d: %lu pps, %lu send errors\n",
+		cfg_num_src, cfg_num_dst, cfg_threads,
+		total / cfg_runtime_sec, errors);
+
+	free(senders);
+	return 0;
+}
@@ -0,0 +1,79 @@
+#!/bin/bash
+# SPDX-License-Identifier: GPL-2.0
+#
+# Forward frames from many stations through a bridge between two veth
+# ports, first with a stable set of source addresses (FDB refreshes
+# only), then with a learning storm where most frames come from a new
+# address. The destinations are learnt on the receiving port before each
+# run so that frames are forwarded instead of flooded.
+#
+# Reports the transmit rate, the forwarding rate seen on the receiving
+# port and the FDB size after each run.
+
+readonly NS_TX="br-tx-$$"
+readonly NS_BR="br-fdb-$$"
+readonly NS_RX="br-rx-$$"
+readonly DSTS=${DSTS:-1000}
+readonly THREADS=${THREADS:-$(nproc)}
+
+ksft_skip=4
+
+cleanup() {
+	ip netns del "${NS_TX}" 2>/dev/null
+	ip netns del "${NS_BR}" 2>/dev/null
+	ip netns del "${NS_RX}" 2>/dev/null
+}
+trap cleanup EXIT
+
+setup() {
+	ip netns add "${NS_TX}" || exit $ksft_skip
+	ip netns add "${NS_BR}"
+	ip netns add "${NS_RX}"
+
+	ip -netns "${NS_BR}" link add br0 type bridge || exit $ksft_skip
+	ip -netns "${NS_BR}" link add a1 numrxqueues "${THREADS}" type veth \
+		peer name a0 netns "${NS_TX}" numtxqueues "${THREADS}"
+	ip -netns "${NS_BR}" link add b1 type veth peer name b0 netns "${NS_RX}"
+
+	for dev in a1 b1; do
+		ip -netns "${NS_BR}" link set dev "${dev}" master br0
+		ip -netns "${NS_BR}" link set dev "${dev}" up
+	done
+	ip -netns "${NS_BR}" link set dev br0 up
+	ip -netns "${NS_TX}" link set dev a0 up
+	ip -netns "${NS_RX}" link set dev b0 up
+}
+
+rx_packets() {
+	ip netns exec "${NS_RX}" cat /sys/class/net/b0/statistics/rx_packets
+}
+
+run_one() {
+	local -r srcs=$1
+	local rx0 rx1
+
+	ip -netns "${NS_BR}" link set dev br0 type bridge fdb_flush
+
+	# learn the destinations on the receiving port
+	ip netns exec "${NS_RX}" ./bridge_fdb_bench -i b0 -n "${DSTS}" -s 2 -l 1
+
+	echo "sources ${srcs}"
+	rx0=$(rx_packets)
+	ip netns exec "${NS_TX}" ./bridge_fdb_bench -i a0 -n "${srcs}" -s 1 \
+		-m "${DSTS}" -d 2 -t "${THREADS}" -l "${DURATION:-5}"
+	rx1=$(rx_packets)
+
+	echo "forwarded $(( (rx1 - rx0) / ${DURATION:-5} )) pps," \
+		"fdb entries $(bridge -n "${NS_BR}" fdb show br br0 | wc -l)"
+}
+
+if [[ $EUID -ne 0 ]]; then
+	echo "SKIP: need root privileges"
+	exit $ksft_skip
+fi
+
+setup
+
+for srcs in 1000 100000 1000000; do
+	run_one ${srcs}
+done
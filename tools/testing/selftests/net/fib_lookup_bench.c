@@ -0,0 +1,291 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * IPv4 FIB lookup benchmark.
+ *
+ * Loads -n random prefixes (default 500000) via dev -d into the main table
+ * with batched RTM_NEWROUTE netlink messages, then measures the rate of
+ * route lookups by sending UDP datagrams on an unconnected socket to
+ * random addresses covered by the prefixes.  With -w only the first -w
+ * prefixes are used as destinations, to compare a working set that fits
+ * in the per-cpu lookup cache with one that does not.
+ *
+ * The device is expected to drop packets without neighbour resolution,
+ * e.g. a dummy device.
+ *
+ * Usage: fib_lookup_bench -d dev [-n prefixes] [-w working set] [-l secs]
+ *			   [-s seed]
+ */
+
+#define _GNU_SOURCE
+
+#include <arpa/inet.h>
+#include <errno.h>
+#include <error.h>
+#include <linux/netlink.h>
+#include <linux/rtnetlink.h>
+#include <net/if.h>
+#include <netinet/in.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/types.h>
+#include <time.h>
+#include <unistd.h>
+
+#define BATCH_BYTES	(64 * 1024)
+
+struct prefix {
+	uint32_t	addr;	/* host byte order */
+	uint8_t		len;
+};
+
+static const char *cfg_dev;
+static int cfg_num_prefixes = 500000;
+static int cfg_working_set;
+static int cfg_runtime_sec = 5;
+static unsigned int cfg_seed = 1;
+
+static struct prefix *prefixes;
+static int ifindex;
+
+static unsigned long gettimeofday_ms(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000UL + ts.tv_nsec / 1000000UL;
+}
+
+/* Random unicast prefixes of length 16 to 32, outside of 0/8, 127/8 and
+ * class D and E, in the style of a full routing table.
+ */
+static void gen_prefixes(void)
+{
+	int i;
+
+	prefixes = calloc(cfg_num_prefixes, sizeof(*prefixes));
+	if (!prefixes)
+		error(1, 0, "calloc");
+
+	srandom(cfg_seed);
+	for (i = 0; i < cfg_num_prefixes; i++) {
+		uint32_t addr;
+		uint8_t len;
+
+		do {
+			addr = (uint32_t)random() << 1 ^ random();
+		} while ((addr >> 24) == 0 || (addr >> 24) == 127 ||
+			 (addr >> 24) >= 224);
+
+		len = 16 + random() % 17;
+		if (len < 32)
+			addr &= ~0U << (32 - len);
+		prefixes[i].addr = addr;
+		prefixes[i].len = len;
+	}
+}
+
+static void addattr32(struct nlmsghdr *nh, int type, uint32_t data)
+{
+	struct rtattr *rta;
+
+	rta = (void *)nh + NLMSG_ALIGN(nh->nlmsg_len);
+	rta->rta_type = type;
+	rta->rta_len = RTA_LENGTH(sizeof(data));
+	memcpy(RTA_DATA(rta), &data, sizeof(data));
+	nh->nlmsg_len = NLMSG_ALIGN(nh->nlmsg_len) + RTA_ALIGN(rta->rta_len);
+}
+
+/* Returns the number of errors reported for the messages sent so far. */
+static int nl_drain(int fd, bool block)
+{
+	char buf[8192];
+	int errors = 0;
+
+	while (1) {
+		struct nlmsghdr *nh;
+		int len;
+
+		len = recv(fd, buf, sizeof(buf), block ? 0 : MSG_DONTWAIT);
+		if (len < 0) {
+			if (errno == EAGAIN || errno == EWOULDBLOCK)
+				break;
+			error(1, errno, "recv netlink");
+		}
+
+		for (nh = (void *)buf; NLMSG_OK(nh, len);
+		     nh = NLMSG_NEXT(nh, len)) {
+			struct nlmsgerr *err = NLMSG_DATA(nh);
+
+			if (nh->nlmsg_type != NLMSG_ERROR)
+				continue;
+			if (err->error)
+				errors++;
+			/* the ack of the last message ends the load */
+			if (nh->nlmsg_seq == (uint32_t)cfg_num_prefixes)
+				return errors;
+		}
+		block = false;
+	}
+	return errors;
+}
+
+static void load_prefixes(void)
+{
+	struct sockaddr_nl sa = { .nl_family = AF_NETLINK };
+	unsigned long tstart, tstop;
+	int fd, i, errors = 0;
+	char *buf;
+	size_t off;
+
+	fd = socket(AF_NETLINK, SOCK_RAW, NETLINK_ROUTE);
+	if (fd < 0)
+		error(1, errno, "socket netlink");
+
+	buf = malloc(BATCH_BYTES);
+	if (!buf)
+		error(1, 0, "malloc");
+
+	tstart = gettimeofday_ms();
+	off = 0;
+	for (i = 0; i < cfg_num_prefixes; i++) {
+		struct nlmsghdr *nh = (void *)buf + off;
+		struct rtmsg *rtm;
+
+		memset(nh, 0, NLMSG_SPACE(sizeof(*rtm)));
+		nh->nlmsg_len = NLMSG_LENGTH(sizeof(*rtm));
+		nh->nlmsg_type = RTM_NEWROUTE;
+		nh->nlmsg_flags = NLM_F_REQUEST | NLM_F_CREATE | NLM_F_REPLACE;
+		nh->nlmsg_seq = i + 1;
+		/* only ask for the ack of the last route, errors are
+		 * reported regardless
+		 */
+		if (i == cfg_num_prefixes - 1)
+			nh->nlmsg_flags |= NLM_F_ACK;
+
+		rtm = NLMSG_DATA(nh);
+		rtm->rtm_family = AF_INET;
+		rtm->rtm_dst_len = prefixes[i].len;
+		rtm->rtm_table = RT_TABLE_MAIN;
+		rtm->rtm_protocol = RTPROT_STATIC;
+		rtm->rtm_scope = RT_SCOPE_LINK;
+		rtm->rtm_type = RTN_UNICAST;
+
+		addattr32(nh, RTA_DST, htonl(prefixes[i].addr));
+		addattr32(nh, RTA_OIF, ifindex);
+		off += NLMSG_ALIGN(nh->nlmsg_len);
+
+		if (off + 256 > BATCH_BYTES || i == cfg_num_prefixes - 1) {
+			if (sendto(fd, buf, off, 0, (void *)&sa, sizeof(sa)) !=
+			    (ssize_t)off)
+				error(1, errno, "sendto netlink");
+			off = 0;
+			errors += nl_drain(fd, false);
+		}
+	}
+	errors += nl_drain(fd, true);
+	tstop = gettimeofday_ms();
+
+	fprintf(stderr, "loaded %d prefixes in %lu ms, %d errors\n",
+		cfg_num_prefixes, tstop - tstart, errors);
+
+	free(buf);
+	close(fd);
+}
+
+static void run_lookups(void)
+{
+	struct sockaddr_in dst = { .sin_family = AF_INET };
+	unsigned long tstart, tstop, now;
+	unsigned long lookups = 0, errors = 0;
+	int fd, range;
+	char payload = 0;
+
+	fd = socket(AF_INET, SOCK_DGRAM, 0);
+	if (fd < 0)
+		error(1, errno, "socket");
+
+	range = cfg_working_set ? cfg_working_set : cfg_num_prefixes;
+	dst.sin_port = htons(9);
+
+	tstart = gettimeofday_ms();
+	tstop = tstart + cfg_runtime_sec * 1000UL;
+	do {
+		int i;
+
+		for (i = 0; i < 1024; i++) {
+			const struct prefix *p = &prefixes[random() % range];
+			uint32_t host = 0;
+
+			if (p->len < 32)
+				host = random() & ~(~0U << (32 - p->len));
+			dst.sin_addr.s_addr = htonl(p->addr | host);
+
+			if (sendto(fd, &payload, sizeof(payload), 0,
+				   (void *)&dst, sizeof(dst)) < 0)
+				errors++;
+			lookups++;
+		}
+		now = gettimeofday_ms();
+	} while (now < tstop);
+
+	fprintf(stderr, "prefixes=%d working set=%d: %lu lookups/s, %lu send errors\n",
+		cfg_num_prefixes, range,
+		lookups * 1000 / (now - tstart ? : 1), errors);
+
+	close(fd);
+}
+
+static void parse_opts(int argc, char **argv)
+{
+	int c;
+
+	while ((c = getopt(argc, argv, "d:l:n:s:w:")) != -1) {
+		switch (c) {
+		case 'd':
+			cfg_dev = optarg;
+			break;
+		case 'l':
+			cfg_runtime_sec = strtoul(optarg, NULL, 0);
+			break;
+		case 'n':
+			cfg_num_prefixes = strtoul(optarg, NULL, 0);
+			break;
+		case 's':
+			cfg_seed = strtoul(optarg, NULL, 0);
+			break;
+		case 'w':
+			cfg_working_set = strtoul(optarg, NULL, 0);
+			break;
+		default:
+			error(1, 0, "usage: %s -d dev [-l secs] [-n prefixes] [-s seed] [-w working set]",
+			      argv[0]);
+		}
+	}
+
+	if (!cfg_dev)
+		error(1, 0, "-d <dev> required");
+	if (cfg_num_prefixes <= 0)
+		error(1, 0, "invalid number of prefixes");
+	if (cfg_working_set < 0 || cfg_working_set > cfg_num_prefixes)
+		error(1, 0, "invalid working set");
+
+	ifindex = if_nametoindex(cfg_dev);
+	if (!ifindex)
+		error(1, errno, "if_nametoindex %s", cfg_dev);
+}
+
+int main(int argc, char **argv)
+{
+	parse_opts(argc, argv);
+
+	gen_prefixes();
+	load_prefixes();
+	run_lookups();
+
+	free(prefixes);
+	return 0;
+}
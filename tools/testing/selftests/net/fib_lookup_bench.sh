@@ -0,0 +1,39 @@
+#!/bin/bash
+# SPDX-License-Identifier: GPL-2.0
+#
+# Load a full-table sized set of IPv4 prefixes on a dummy device in a new
+# netns and measure route lookup rates, for a working set that fits in the
+# per-cpu FIB lookup cache and for lookups spread over all prefixes.
+#
+# Set PREFIXES to change the table size (default 500000).
+
+readonly NS="fib-bench-$$"
+readonly PREFIXES=${PREFIXES:-500000}
+
+ksft_skip=4
+
+cleanup() {
+	ip netns del "${NS}" 2>/dev/null
+}
+trap cleanup EXIT
+
+if [[ $EUID -ne 0 ]]; then
+	echo "SKIP: need root privileges"
+	exit $ksft_skip
+fi
+
+ip netns add "${NS}" || exit $ksft_skip
+ip -netns "${NS}" link add dummy0 type dummy || exit $ksft_skip
+ip -netns "${NS}" addr add 192.0.2.1/24 dev dummy0
+ip -netns "${NS}" link set dev dummy0 up
+
+for ws in 64 4096 0; do
+	echo "working set $([[ ${ws} -eq 0 ]] && echo all || echo ${ws})"
+	ip netns exec "${NS}" ./fib_lookup_bench -d dummy0 -n "${PREFIXES}" \
+		-w "${ws}" -l "${DURATION:-5}"
+	ip -netns "${NS}" route flush proto static
+done
+
+if [[ -r /proc/net/fib_triestat ]]; then
+	ip netns exec "${NS}" cat /proc/net/fib_triestat
+fi
@@ -0,0 +1,258 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * Benchmark the fq packet scheduler with many paced TCP flows.
+ *
+ * The receiver accepts connections and discards data.  The sender opens
+ * -n connections, caps each of them with SO_MAX_PACING_RATE and keeps
+ * their send queues full for -l seconds, then reports the aggregate
+ * goodput, the goodput expected from the pacing rates, and the CPU time
+ * spent in softirq and system context (from /proc/stat) while sending.
+ *
+ * Usage:
+ *   fq_pacing_bench -r [-p port]
+ *   fq_pacing_bench -D addr [-p port] [-n flows] [-R bytes/sec] [-l secs]
+ */
+
+#define _GNU_SOURCE
+
+#include <arpa/inet.h>
+#include <errno.h>
+#include <error.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/types.h>
+#include <time.h>
+#include <unistd.h>
+
+#ifndef SO_MAX_PACING_RATE
+#define SO_MAX_PACING_RATE 47
+#endif
+
+static int cfg_port = 8000;
+static int cfg_num_flows = 1000;
+static unsigned int cfg_rate = 125000;	/* 1 Mbit/s per flow */
+static int cfg_runtime_sec = 10;
+static bool cfg_rx;
+static const char *cfg_host;
+
+static char buf[1 << 16];
+
+static unsigned long gettimeofday_ms(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000UL + ts.tv_nsec / 1000000UL;
+}
+
+/* Returns softirq + system jiffies summed over all cpus. */
+static unsigned long long read_cpu_time(unsigned long long *softirq)
+{
+	unsigned long long user, nice, sys, idle, iowait, irq, sirq;
+	FILE *f;
+
+	f = fopen("/proc/stat", "r");
+	if (!f)
+		error(1, errno, "fopen /proc/stat");
+	if (fscanf(f, "cpu %llu %llu %llu %llu %llu %llu %llu",
+		   &user, &nice, &sys, &idle, &iowait, &irq, &sirq) != 7)
+		error(1, 0, "failed to parse /proc/stat");
+	fclose(f);
+
+	*softirq = sirq;
+	return sys;
+}
+
+static void do_rx(void)
+{
+	struct sockaddr_in6 addr = {0};
+	struct epoll_event ev;
+	int fd, epfd, one = 1;
+
+	fd = socket(AF_INET6, SOCK_STREAM, 0);
+	if (fd < 0)
+		error(1, errno, "socket");
+	if (setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one)))
+		error(1, errno, "setsockopt SO_REUSEADDR");
+
+	addr.sin6_family = AF_INET6;
+	addr.sin6_port = htons(cfg_port);
+	addr.sin6_addr = in6addr_any;
+	if (bind(fd, (void *)&addr, sizeof(addr)))
+		error(1, errno, "bind");
+	if (listen(fd, 4096))
+		error(1, errno, "listen");
+
+	epfd = epoll_create1(0);
+	if (epfd < 0)
+		error(1, errno, "epoll_create");
+	ev.events = EPOLLIN;
+	ev.data.fd = fd;
+	if (epoll_ctl(epfd, EPOLL_CTL_ADD, fd, &ev))
+		error(1, errno, "epoll_ctl listener");
+
+	while (1) {
+		int child, ret;
+
+		if (epoll_wait(epfd, &ev, 1, -1) != 1)
+			error(1, errno, "epoll_wait");
+
+		if (ev.data.fd == fd) {
+			child = accept4(fd, NULL, NULL, SOCK_NONBLOCK);
+			if (child < 0)
+				error(1, errno, "accept");
+			ev.events = EPOLLIN;
+			ev.data.fd = child;
+			if (epoll_ctl(epfd, EPOLL_CTL_ADD, child, &ev))
+				error(1, errno, "epoll_ctl child");
+			continue;
+		}
+
+		do {
+			ret = read(ev.data.fd, buf, sizeof(buf));
+		} while (ret > 0);
+		if (ret == 0 || (ret < 0 && errno != EAGAIN))
+			close(ev.data.fd);
+	}
+}
+
+static int connect_one(const struct sockaddr_in6 *addr)
+{
+	int fd;
+
+	fd = socket(AF_INET6, SOCK_STREAM, 0);
+	if (fd < 0)
+		error(1, errno, "socket");
+	if (setsockopt(fd, SOL_SOCKET, SO_MAX_PACING_RATE,
+		       &cfg_rate, sizeof(cfg_rate)))
+		error(1, errno, "setsockopt SO_MAX_PACING_RATE");
+	if (connect(fd, (void *)addr, sizeof(*addr)))
+		error(1, errno, "connect");
+	if (fcntl(fd, F_SETFL, O_NONBLOCK))
+		error(1, errno, "fcntl");
+	return fd;
+}
+
+static void do_tx(void)
+{
+	unsigned long long sys0, sys1, sirq0, sirq1;
+	unsigned long tstart, tstop, now;
+	unsigned long long bytes = 0;
+	struct sockaddr_in6 addr = {0};
+	struct epoll_event *events;
+	struct epoll_event ev;
+	long hz = sysconf(_SC_CLK_TCK);
+	double secs;
+	int epfd, i, n;
+
+	addr.sin6_family = AF_INET6;
+	addr.sin6_port = htons(cfg_port);
+	if (inet_pton(AF_INET6, cfg_host, &addr.sin6_addr) != 1) {
+		/* accept IPv4 addresses as v4-mapped */
+		char mapped[64];
+
+		snprintf(mapped, sizeof(mapped), "::ffff:%s", cfg_host);
+		if (inet_pton(AF_INET6, mapped, &addr.sin6_addr) != 1)
+			error(1, 0, "invalid address %s", cfg_host);
+	}
+
+	epfd = epoll_create1(0);
+	if (epfd < 0)
+		error(1, errno, "epoll_create");
+	events = calloc(cfg_num_flows, sizeof(*events));
+	if (!events)
+		error(1, 0, "calloc");
+
+	for (i = 0; i < cfg_num_flows; i++) {
+		ev.events = EPOLLOUT;
+		ev.data.fd = connect_one(&addr);
+		if (epoll_ctl(epfd, EPOLL_CTL_ADD, ev.data.fd, &ev))
+			error(1, errno, "epoll_ctl");
+	}
+
+	sys0 = read_cpu_time(&sirq0);
+	tstart = gettimeofday_ms();
+	tstop = tstart + cfg_runtime_sec * 1000UL;
+
+	do {
+		n = epoll_wait(epfd, events, cfg_num_flows, 100);
+		if (n < 0)
+			error(1, errno, "epoll_wait");
+		for (i = 0; i < n; i++) {
+			int ret;
+
+			ret = write(events[i].data.fd, buf, sizeof(buf));
+			if (ret > 0)
+				bytes += ret;
+			else if (ret < 0 && errno != EAGAIN)
+				error(1, errno, "write");
+		}
+		now = gettimeofday_ms();
+	} while (now < tstop);
+
+	sys1 = read_cpu_time(&sirq1);
+	secs = (now - tstart) / 1000.0;
+
+	fprintf(stderr,
+		"flows=%d rate=%u B/s: %.1f Mbit/s (expected %.1f), sys %.2f s, softirq %.2f s\n",
+		cfg_num_flows, cfg_rate, bytes * 8 / secs / 1e6,
+		(double)cfg_num_flows * cfg_rate * 8 / 1e6,
+		(double)(sys1 - sys0) / hz, (double)(sirq1 - sirq0) / hz);
+
+	free(events);
+	close(epfd);
+}
+
+static void parse_opts(int argc, char **argv)
+{
+	int c;
+
+	while ((c = getopt(argc, argv, "D:l:n:p:rR:")) != -1) {
+		switch (c) {
+		case 'D':
+			cfg_host = optarg;
+			break;
+		case 'l':
+			cfg_runtime_sec = strtoul(optarg, NULL, 0);
+			break;
+		case 'n':
+			cfg_num_flows = strtoul(optarg, NULL, 0);
+			break;
+		case 'p':
+			cfg_port = strtoul(optarg, NULL, 0);
+			break;
+		case 'r':
+			cfg_rx = true;
+			break;
+		case 'R':
+			cfg_rate = strtoul(optarg, NULL, 0);
+			break;
+		default:
+			error(1, 0, "usage: %s [-r] [-D addr] [-l secs] [-n flows] [-p port] [-R rate]",
+			      argv[0]);
+		}
+	}
+
+	if (!cfg_rx && !cfg_host)
+		error(1, 0, "-D <addr> required in sender mode");
+	if (cfg_num_flows <= 0)
+		error(1, 0, "invalid number of flows");
+}
+
+int main(int argc, char **argv)
+{
+	parse_opts(argc, argv);
+
+	if (cfg_rx)
+		do_rx();
+	else
+		do_tx();
+
+	return 0;
+}
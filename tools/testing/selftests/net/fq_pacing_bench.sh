@@ -0,0 +1,68 @@
+#!/bin/bash
+# SPDX-License-Identifier: GPL-2.0
+#
+# Run fq_pacing_bench over a veth pair, with fq as the root qdisc of the
+# sending device, for an increasing number of paced flows.
+#
+# Reports goodput and sender CPU usage, then the fq qdisc statistics
+# (throttled flows, unthrottle latency, wheel overflows) for each run.
+
+readonly NS_TX="fq-tx-$$"
+readonly NS_RX="fq-rx-$$"
+
+ksft_skip=4
+
+cleanup() {
+	local -r jobs="$(jobs -p)"
+
+	if [[ "${jobs}" != "" ]]; then
+		kill ${jobs} 2>/dev/null
+	fi
+	ip netns del "${NS_TX}" 2>/dev/null
+	ip netns del "${NS_RX}" 2>/dev/null
+}
+trap cleanup EXIT
+
+setup() {
+	ip netns add "${NS_TX}" || exit $ksft_skip
+	ip netns add "${NS_RX}"
+
+	ip link add veth0 netns "${NS_TX}" type veth peer name veth1 \
+		netns "${NS_RX}"
+
+	ip -netns "${NS_TX}" addr add 192.168.1.1/24 dev veth0
+	ip -netns "${NS_RX}" addr add 192.168.1.2/24 dev veth1
+	ip -netns "${NS_TX}" link set dev veth0 up
+	ip -netns "${NS_RX}" link set dev veth1 up
+
+	# veth has no queue by default, which would bypass the root qdisc
+	ip -netns "${NS_TX}" link set dev veth0 txqueuelen 1000
+	ip netns exec "${NS_TX}" tc qdisc replace dev veth0 root fq \
+		${FQ_ARGS} || exit $ksft_skip
+
+	ip netns exec "${NS_TX}" sysctl -qw net.ipv4.tcp_wmem="4096 16384 65536"
+}
+
+run_one() {
+	local -r flows=$1
+
+	ip netns exec "${NS_TX}" tc qdisc replace dev veth0 root fq ${FQ_ARGS}
+	echo "flows ${flows}"
+	ip netns exec "${NS_TX}" ./fq_pacing_bench -D 192.168.1.2 \
+		-n "${flows}" -R "${RATE:-125000}" -l "${DURATION:-10}"
+	ip netns exec "${NS_TX}" tc -s qdisc show dev veth0
+}
+
+if [[ $EUID -ne 0 ]]; then
+	echo "SKIP: need root privileges"
+	exit $ksft_skip
+fi
+
+setup
+
+ip netns exec "${NS_RX}" ./fq_pacing_bench -r &
+sleep 1
+
+for flows in 100 1000 5000 10000; do
+	run_one ${flows}
+done
@@ -0,0 +1,340 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * Test migration of queued connections between the listeners of an
+ * SO_REUSEPORT group, and CPU-local listener selection with
+ * SO_INCOMING_CPU.
+ *
+ * The migration test fills the accept queues of a TCP SO_REUSEPORT group
+ * over loopback, closes one listener and checks that every connection can
+ * still be accept()ed from the remaining listeners when
+ * net.ipv4.tcp_migrate_req is enabled (and that some are reset when it is
+ * not).  The rolling restart benchmark keeps a client connecting while the
+ * listeners are closed and re-created one at a time, and reports the accept
+ * rate and the number of connections that got reset.
+ *
+ * The SO_INCOMING_CPU test binds one listener per CPU, connects from each
+ * CPU and checks that the connection lands on the listener of that CPU.
+ */
+
+#define _GNU_SOURCE
+
+#include <arpa/inet.h>
+#include <errno.h>
+#include <error.h>
+#include <fcntl.h>
+#include <linux/in.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/types.h>
+#include <time.h>
+#include <unistd.h>
+
+#ifndef SO_INCOMING_CPU
+#define SO_INCOMING_CPU 49
+#endif
+
+static const int PORT = 8889;
+static const char *MIGRATE_SYSCTL = "/proc/sys/net/ipv4/tcp_migrate_req";
+
+#define NR_LISTENERS	4
+#define NR_CLIENTS	64
+#define RESTART_ROUNDS	20
+
+static void set_migrate_req(int val)
+{
+	char buf[2] = { '0' + val, '\n' };
+	int fd;
+
+	fd = open(MIGRATE_SYSCTL, O_WRONLY);
+	if (fd < 0)
+		error(1, errno, "failed to open %s", MIGRATE_SYSCTL);
+	if (write(fd, buf, sizeof(buf)) != sizeof(buf))
+		error(1, errno, "failed to write %s", MIGRATE_SYSCTL);
+	close(fd);
+}
+
+static void build_addr(struct sockaddr_in *addr)
+{
+	memset(addr, 0, sizeof(*addr));
+	addr->sin_family = AF_INET;
+	addr->sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	addr->sin_port = htons(PORT);
+}
+
+static int new_listener(int cpu)
+{
+	struct sockaddr_in addr;
+	int fd, opt = 1;
+
+	build_addr(&addr);
+
+	fd = socket(AF_INET, SOCK_STREAM, 0);
+	if (fd < 0)
+		error(1, errno, "failed to create listener");
+
+	if (setsockopt(fd, SOL_SOCKET, SO_REUSEPORT, &opt, sizeof(opt)))
+		error(1, errno, "failed to set SO_REUSEPORT");
+
+	if (cpu >= 0 &&
+	    setsockopt(fd, SOL_SOCKET, SO_INCOMING_CPU, &cpu, sizeof(cpu)))
+		error(1, errno, "failed to set SO_INCOMING_CPU");
+
+	if (bind(fd, (struct sockaddr *)&addr, sizeof(addr)))
+		error(1, errno, "failed to bind listener");
+
+	if (listen(fd, NR_CLIENTS * 2))
+		error(1, errno, "failed to listen");
+
+	return fd;
+}
+
+static int new_client(void)
+{
+	struct sockaddr_in addr;
+	int fd;
+
+	build_addr(&addr);
+
+	fd = socket(AF_INET, SOCK_STREAM, 0);
+	if (fd < 0)
+		error(1, errno, "failed to create client");
+
+	if (connect(fd, (struct sockaddr *)&addr, sizeof(addr)))
+		return -errno;
+
+	if (send(fd, "a", 1, 0) != 1)
+		error(1, errno, "failed to send");
+
+	return fd;
+}
+
+/* Returns the number of connections accepted with their data intact. */
+static int drain(int fd)
+{
+	int child, n = 0;
+	char buf;
+
+	if (fcntl(fd, F_SETFL, O_NONBLOCK))
+		error(1, errno, "failed to set O_NONBLOCK");
+
+	while ((child = accept(fd, NULL, NULL)) >= 0) {
+		if (recv(child, &buf, 1, 0) == 1)
+			n++;
+		close(child);
+	}
+
+	if (errno != EAGAIN)
+		error(1, errno, "failed to accept");
+
+	return n;
+}
+
+static void test_migrate(int migrate)
+{
+	int listeners[NR_LISTENERS], clients[NR_CLIENTS];
+	int i, accepted = 0;
+
+	set_migrate_req(migrate);
+
+	for (i = 0; i < NR_LISTENERS; i++)
+		listeners[i] = new_listener(-1);
+
+	for (i = 0; i < NR_CLIENTS; i++) {
+		clients[i] = new_client();
+		if (clients[i] < 0)
+			error(1, -clients[i], "failed to connect");
+	}
+
+	/* Give the last ACKs time to complete the handshakes. */
+	usleep(100000);
+
+	close(listeners[0]);
+
+	for (i = 1; i < NR_LISTENERS; i++) {
+		accepted += drain(listeners[i]);
+		close(listeners[i]);
+	}
+
+	for (i = 0; i < NR_CLIENTS; i++)
+		close(clients[i]);
+
+	fprintf(stderr, "tcp_migrate_req=%d: accepted %d/%d\n",
+		migrate, accepted, NR_CLIENTS);
+
+	if (migrate && accepted != NR_CLIENTS)
+		error(1, 0, "connections lost with migration enabled");
+	if (!migrate && accepted == NR_CLIENTS)
+		error(1, 0, "no connection was queued on the closed listener");
+}
+
+static volatile bool stop;
+
+static void *client_loop(void *arg)
+{
+	long *errors = arg;
+	char buf;
+	int fd;
+
+	while (!stop) {
+		fd = new_client();
+		if (fd < 0) {
+			(*errors)++;
+			continue;
+		}
+		/* The server closes after reading, anything but EOF is a
+		 * connection that was dropped by a closing listener.
+		 */
+		if (recv(fd, &buf, 1, 0) != 0)
+			(*errors)++;
+		close(fd);
+	}
+
+	return NULL;
+}
+
+static long serve(int fd, int usec)
+{
+	struct timespec start, now;
+	long n = 0;
+	char buf;
+	int child;
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	do {
+		child = accept4(fd, NULL, NULL, 0);
+		if (child >= 0) {
+			if (recv(child, &buf, 1, 0) == 1)
+				n++;
+			close(child);
+		} else if (errno != EAGAIN) {
+			error(1, errno, "failed to accept");
+		}
+		clock_gettime(CLOCK_MONOTONIC, &now);
+	} while ((now.tv_sec - start.tv_sec) * 1000000 +
+		 (now.tv_nsec - start.tv_nsec) / 1000 < usec);
+
+	return n;
+}
+
+static void bench_rolling_restart(int migrate)
+{
+	int listeners[NR_LISTENERS];
+	struct timespec start, end;
+	long accepted = 0, errors = 0;
+	pthread_t client;
+	double secs;
+	int i, j, round;
+
+	set_migrate_req(migrate);
+
+	for (i = 0; i < NR_LISTENERS; i++) {
+		listeners[i] = new_listener(-1);
+		if (fcntl(listeners[i], F_SETFL, O_NONBLOCK))
+			error(1, errno, "failed to set O_NONBLOCK");
+	}
+
+	stop = false;
+	if (pthread_create(&client, NULL, client_loop, &errors))
+		error(1, errno, "failed to create client thread");
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for (round = 0; round < RESTART_ROUNDS; round++) {
+		i = round % NR_LISTENERS;
+
+		for (j = 0; j < NR_LISTENERS; j++)
+			accepted += serve(listeners[j], 10000);
+
+		/* Restart one listener, as a rolling upgrade would. */
+		close(listeners[i]);
+		listeners[i] = new_listener(-1);
+		if (fcntl(listeners[i], F_SETFL, O_NONBLOCK))
+			error(1, errno, "failed to set O_NONBLOCK");
+	}
+	clock_gettime(CLOCK_MONOTONIC, &end);
+
+	stop = true;
+	for (i = 0; i < NR_LISTENERS; i++)
+		accepted += serve(listeners[i], 10000);
+	pthread_join(client, NULL);
+
+	for (i = 0; i < NR_LISTENERS; i++)
+		close(listeners[i]);
+
+	secs = (end.tv_sec - start.tv_sec) +
+	       (end.tv_nsec - start.tv_nsec) / 1e9;
+	fprintf(stderr,
+		"tcp_migrate_req=%d: %ld accepts (%.0f/s), %ld connection errors\n",
+		migrate, accepted, accepted / secs, errors);
+}
+
+static void connect_from_cpu(int cpu)
+{
+	cpu_set_t cpu_set;
+	int fd;
+
+	CPU_ZERO(&cpu_set);
+	CPU_SET(cpu, &cpu_set);
+	if (sched_setaffinity(0, sizeof(cpu_set), &cpu_set) < 0)
+		error(1, errno, "failed to pin to cpu");
+
+	fd = new_client();
+	if (fd < 0)
+		error(1, -fd, "failed to connect");
+	close(fd);
+}
+
+static void test_incoming_cpu(int cpus)
+{
+	int *listeners, cpu, i;
+
+	listeners = calloc(cpus, sizeof(int));
+	if (!listeners)
+		error(1, 0, "failed to allocate array");
+
+	for (cpu = 0; cpu < cpus; cpu++)
+		listeners[cpu] = new_listener(cpu);
+
+	for (cpu = 0; cpu < cpus; cpu++) {
+		connect_from_cpu(cpu);
+
+		for (i = 0; i < cpus; i++) {
+			if (drain(listeners[i]) && i != cpu)
+				error(1, 0, "cpu %d: connection on listener %d",
+				      cpu, i);
+		}
+	}
+
+	for (cpu = 0; cpu < cpus; cpu++)
+		close(listeners[cpu]);
+	free(listeners);
+}
+
+int main(void)
+{
+	int cpus;
+
+	cpus = sysconf(_SC_NPROCESSORS_ONLN);
+	if (cpus <= 0)
+		error(1, errno, "failed counting cpus");
+
+	fprintf(stderr, "---- migrate accept queue ----\n");
+	test_migrate(0);
+	test_migrate(1);
+
+	fprintf(stderr, "---- rolling restart ----\n");
+	bench_rolling_restart(0);
+	bench_rolling_restart(1);
+
+	set_migrate_req(0);
+
+	fprintf(stderr, "---- SO_INCOMING_CPU ----\n");
+	test_incoming_cpu(cpus);
+
+	fprintf(stderr, "SUCCESS\n");
+	return 0;
+}
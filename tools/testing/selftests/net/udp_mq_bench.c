@@ -0,0 +1,158 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * Multi-threaded UDP transmit benchmark.
+ *
+ * Starts one sender thread per cpu (or -t threads), each pinned to its cpu
+ * and owning a connected UDP socket, so that packets spread over the
+ * transmit queues of a multi-queue device. Reports the aggregate and per
+ * thread packet rates, which are bound by the qdisc when the device is
+ * fast (veth, dummy, virtio_net).
+ *
+ * Usage: udp_mq_bench -D addr [-p port] [-t threads] [-s size] [-l secs]
+ */
+
+#define _GNU_SOURCE
+
+#include <arpa/inet.h>
+#include <errno.h>
+#include <error.h>
+#include <netinet/in.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/types.h>
+#include <time.h>
+#include <unistd.h>
+
+static int cfg_port = 9000;
+static int cfg_threads;
+static int cfg_payload_len = 64;
+static int cfg_runtime_sec = 5;
+static struct sockaddr_in cfg_dst;
+
+static volatile bool stop;
+
+struct sender {
+	pthread_t	thread;
+	int		cpu;
+	unsigned long	packets;
+	unsigned long	errors;
+};
+
+static void *sender_fn(void *arg)
+{
+	struct sender *s = arg;
+	char buf[65536];
+	cpu_set_t mask;
+	int fd;
+
+	CPU_ZERO(&mask);
+	CPU_SET(s->cpu, &mask);
+	if (sched_setaffinity(0, sizeof(mask), &mask))
+		error(1, errno, "sched_setaffinity %d", s->cpu);
+
+	fd = socket(AF_INET, SOCK_DGRAM, 0);
+	if (fd < 0)
+		error(1, errno, "socket");
+
+	/* distinct source ports hash to distinct fq_codel flows */
+	if (connect(fd, (void *)&cfg_dst, sizeof(cfg_dst)))
+		error(1, errno, "connect");
+
+	memset(buf, 'a', cfg_payload_len);
+	while (!stop) {
+		if (send(fd, buf, cfg_payload_len, 0) == cfg_payload_len)
+			s->packets++;
+		else
+			s->errors++;
+	}
+
+	close(fd);
+	return NULL;
+}
+
+static void parse_opts(int argc, char **argv)
+{
+	const char *host = NULL;
+	int c;
+
+	while ((c = getopt(argc, argv, "D:l:p:s:t:")) != -1) {
+		switch (c) {
+		case 'D':
+			host = optarg;
+			break;
+		case 'l':
+			cfg_runtime_sec = strtoul(optarg, NULL, 0);
+			break;
+		case 'p':
+			cfg_port = strtoul(optarg, NULL, 0);
+			break;
+		case 's':
+			cfg_payload_len = strtoul(optarg, NULL, 0);
+			break;
+		case 't':
+			cfg_threads = strtoul(optarg, NULL, 0);
+			break;
+		default:
+			error(1, 0, "usage: %s -D addr [-l secs] [-p port] [-s size] [-t threads]",
+			      argv[0]);
+		}
+	}
+
+	if (!host)
+		error(1, 0, "-D <addr> required");
+	if (cfg_payload_len <= 0 || cfg_payload_len > 65507)
+		error(1, 0, "invalid payload size");
+
+	cfg_dst.sin_family = AF_INET;
+	cfg_dst.sin_port = htons(cfg_port);
+	if (inet_pton(AF_INET, host, &cfg_dst.sin_addr) != 1)
+		error(1, 0, "invalid address %s", host);
+
+	if (!cfg_threads)
+		cfg_threads = sysconf(_SC_NPROCESSORS_ONLN);
+	if (cfg_threads <= 0)
+		error(1, 0, "invalid number of threads");
+}
+
+int main(int argc, char **argv)
+{
+	unsigned long total = 0, errors = 0;
+	struct sender *senders;
+	int i, cpus;
+
+	parse_opts(argc, argv);
+
+	cpus = sysconf(_SC_NPROCESSORS_ONLN);
+	senders = calloc(cfg_threads, sizeof(*senders));
+	if (!senders)
+		error(1, 0, "calloc");
+
+	for (i = 0; i < cfg_threads; i++) {
+		senders[i].cpu = i % cpus;
+		if (pthread_create(&senders[i].thread, NULL, sender_fn,
+				   &senders[i]))
+			error(1, errno, "pthread_create");
+	}
+
+	sleep(cfg_runtime_sec);
+	stop = true;
+
+	for (i = 0; i < cfg_threads; i++) {
+		pthread_join(senders[i].thread, NULL);
+		fprintf(stderr, "thread %d (cpu %d): %lu pps\n", i,
+			senders[i].cpu, senders[i].packets / cfg_runtime_sec);
+		total += senders[i].packets;
+		errors += senders[i].errors;
+	}
+
+	fprintf(stderr, "threads=%d size=%d: %lu pps, %lu send errors\n",
+		cfg_threads, cfg_payload_len, total / cfg_runtime_sec, errors);
+
+	free(senders);
+	return 0;
+}
@@ -0,0 +1,70 @@
+#!/bin/bash
+# SPDX-License-Identifier: GPL-2.0
+#
+# Compare multi-threaded UDP transmit rates over a multi-queue veth with
+# mq + pfifo_fast, mq + fq_codel (one lockless fq_codel per txq) and a
+# single root fq_codel (one dequeuer for all cpus).
+#
+# Set DEV to use an existing multi-queue device (e.g. virtio_net) instead,
+# with DST the address to send to.
+
+readonly NS="udp-mq-tx-$$"
+readonly NS_RX="udp-mq-rx-$$"
+readonly NTXQ=$(nproc)
+
+ksft_skip=4
+
+cleanup() {
+	ip netns del "${NS}" 2>/dev/null
+	ip netns del "${NS_RX}" 2>/dev/null
+}
+trap cleanup EXIT
+
+setup_veth() {
+	ip netns add "${NS}" || exit $ksft_skip
+	ip netns add "${NS_RX}"
+	ip -netns "${NS}" link add veth0 numtxqueues ${NTXQ} \
+		numrxqueues ${NTXQ} type veth peer name veth1 netns "${NS_RX}" \
+		numtxqueues ${NTXQ} numrxqueues ${NTXQ} || exit $ksft_skip
+	ip -netns "${NS}" addr add 192.168.2.1/24 dev veth0
+	ip -netns "${NS_RX}" addr add 192.168.2.2/24 dev veth1
+	ip -netns "${NS}" link set dev veth0 up
+	ip -netns "${NS_RX}" link set dev veth1 up
+	# drop at the receiver ingress, before any port unreachable
+	ip netns exec "${NS_RX}" tc qdisc add dev veth1 clsact
+	ip netns exec "${NS_RX}" tc filter add dev veth1 ingress matchall \
+		action drop
+}
+
+run() {
+	local -r desc=$1
+
+	echo "${desc}"
+	${EXEC} ./udp_mq_bench -D "${DST}" -l "${DURATION:-5}" ${ARGS}
+	${EXEC} tc -s qdisc show dev "${DEV}"
+}
+
+if [[ $EUID -ne 0 ]]; then
+	echo "SKIP: need root privileges"
+	exit $ksft_skip
+fi
+
+if [[ -z "${DEV}" ]]; then
+	setup_veth
+	EXEC="ip netns exec ${NS}"
+	DEV=veth0
+	DST=192.168.2.2
+fi
+
+${EXEC} tc qdisc replace dev "${DEV}" root handle 1: mq
+run "mq + pfifo_fast"
+
+for i in $(seq 1 ${NTXQ}); do
+	${EXEC} tc qdisc replace dev "${DEV}" parent 1:$(printf %x $i) fq_codel
+done
+run "mq + fq_codel"
+
+${EXEC} tc qdisc replace dev "${DEV}" root fq_codel
+run "root fq_codel"
+
+${EXEC} tc qdisc del dev "${DEV}" root
@@ -0,0 +1,188 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * Events per second a reader gets out of a CPU buffer: through its
+ * mapping and TRACE_MMAP_IOCTL_GET_READER, or by splicing trace_pipe_raw
+ * pages into a pipe and reading them, as trace-cmd record does, with a
+ * read() of the last partial page.
+ *
+ * -n trace_marker events (default 500000) are written on CPU 0 for each
+ * reader, into a buffer resized to hold them all, then drained and parsed.
+ *
+ * Usage: map_bench [-n events]
+ */
+
+#include <getopt.h>
+#include <time.h>
+
+#include "map_common.h"
+
+#define CPU	0
+
+static struct print_format fmt;
+static long cfg_events = 500000;
+static int commit_offset;
+
+static unsigned long long now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static void fill(void)
+{
+	char msg[64];
+	long i;
+	int fd;
+
+	tracefs_write("trace", "");
+	fd = tracefs_open("trace_marker", O_WRONLY);
+	if (fd < 0)
+		fail("open trace_marker: %s\n", strerror(errno));
+	for (i = 0; i < cfg_events; i++) {
+		snprintf(msg, sizeof(msg), "map_bench %ld\n", i);
+		if (write(fd, msg, strlen(msg)) < 0)
+			fail("write trace_marker: %s\n", strerror(errno));
+	}
+	close(fd);
+}
+
+static long read_mmap(void)
+{
+	struct trace_buffer_meta *meta;
+	struct cpu_map map;
+	long events = 0;
+
+	cpu_map_open(&map, CPU);
+	meta = map.meta;
+	for (;;) {
+		if (ioctl(map.fd, TRACE_MMAP_IOCTL_GET_READER))
+			fail("TRACE_MMAP_IOCTL_GET_READER: %s\n", strerror(errno));
+		if (meta->reader.read == meta->reader.commit)
+			break;
+		events += for_each_print(&fmt, cpu_map_reader(&map),
+					 meta->reader.read, meta->reader.commit,
+					 NULL, NULL);
+	}
+	cpu_map_close(&map);
+	return events;
+}
+
+/* The events of a page read out of trace_pipe_raw */
+static long page_events(const char *page)
+{
+	/* without the missed events flags of the commit */
+	unsigned long commit = *(const unsigned long *)(page + commit_offset);
+
+	return for_each_print(&fmt, page + fmt.data_offset, 0,
+			      commit & ((1UL << 30) - 1), NULL, NULL);
+}
+
+static long read_splice(void)
+{
+	int page_size = getpagesize();
+	long events = 0;
+	char file[64];
+	int fd, p[2];
+	char *page;
+	ssize_t n;
+
+	page = malloc(page_size);
+	if (!page || pipe(p))
+		fail("no page or pipe\n");
+	snprintf(file, sizeof(file), "per_cpu/cpu%d/trace_pipe_raw", CPU);
+	fd = tracefs_open(file, O_RDONLY | O_NONBLOCK);
+	if (fd < 0)
+		fail("open %s: %s\n", file, strerror(errno));
+
+	/* The full pages */
+	for (;;) {
+		n = splice(fd, NULL, p[1], NULL, page_size, SPLICE_F_NONBLOCK);
+		if (n < 0 && errno == EAGAIN)
+			break;
+		if (n <= 0)
+			fail("splice: %s\n", strerror(errno));
+		if (read(p[0], page, page_size) != page_size)
+			fail("read of the pipe: %s\n", strerror(errno));
+		events += page_events(page);
+	}
+
+	/* The page the writer stopped on */
+	for (;;) {
+		n = read(fd, page, page_size);
+		if ((n < 0 && errno == EAGAIN) || !n)
+			break;
+		if (n != page_size)
+			fail("read of %s: %s\n", file, strerror(errno));
+		events += page_events(page);
+	}
+
+	close(fd);
+	close(p[0]);
+	close(p[1]);
+	free(page);
+	return events;
+}
+
+static void run(const char *name, long (*reader)(void))
+{
+	unsigned long long start, elapsed;
+	long events;
+
+	fill();
+	start = now_ns();
+	events = reader();
+	elapsed = now_ns() - start;
+
+	if (events != cfg_events)
+		fail("%s: %ld of %ld events read\n", name, events, cfg_events);
+	printf("%-8s %12.0f events/s %8.1f ns/event\n", name,
+	       events * 1e9 / elapsed, (double)elapsed / events);
+}
+
+int main(int argc, char **argv)
+{
+	char file[64], size[32], buf[4096];
+	int c;
+
+	while ((c = getopt(argc, argv, "n:")) != -1) {
+		switch (c) {
+		case 'n':
+			cfg_events = strtol(optarg, NULL, 0);
+			break;
+		default:
+			fail("usage: %s [-n events]\n", argv[0]);
+		}
+	}
+	if (cfg_events <= 0)
+		fail("events must be positive\n");
+
+	if (geteuid() || tracefs_find()) {
+		printf("map_bench: needs root and tracefs, skipping\n");
+		return KSFT_SKIP;
+	}
+
+	pin_to_cpu(CPU);
+	print_format_read(&fmt);
+	if (tracefs_read("events/header_page", buf, sizeof(buf)) < 0 ||
+	    (commit_offset = format_offset(buf, "local_t commit;")) < 0)
+		fail("cannot parse events/header_page\n");
+
+	snprintf(file, sizeof(file), "per_cpu/cpu%d/buffer_size_kb", CPU);
+	if (tracefs_read(file, size, sizeof(size)) < 0)
+		fail("no %s\n", file);
+	/* Room for all the events, at most 48 bytes each */
+	snprintf(buf, sizeof(buf), "%ld", cfg_events * 48 / 1024 + 1024);
+	if (tracefs_write(file, buf) || tracefs_write("current_tracer", "nop") ||
+	    tracefs_write("tracing_on", "1"))
+		fail("cannot set up tracing\n");
+
+	printf("%ld events on CPU %d\n", cfg_events, CPU);
+	run("mmap", read_mmap);
+	run("splice", read_splice);
+
+	tracefs_write("trace", "");
+	tracefs_write(file, size);
+	return 0;
+}
@@ -0,0 +1,244 @@
+/* SPDX-License-Identifier: GPL-2.0 */
+/*
+ * tracefs and ring buffer page helpers of the ring-buffer tests. Events
+ * are parsed the way trace-cmd does it, with the layouts tracefs gives in
+ * events/header_page and events/ftrace/print/format.
+ */
+#ifndef __MAP_COMMON_H
+#define __MAP_COMMON_H
+
+#include <errno.h>
+#include <fcntl.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include <linux/types.h>
+#include <linux/trace_mmap.h>
+
+#define KSFT_SKIP	4
+
+#define fail(format...) ({					\
+	printf("%s(%d):FAIL: ", __func__, __LINE__);		\
+	printf(format);						\
+	exit(1);						\
+})
+
+static char tracefs[64];
+
+/* Find a mounted tracefs, return -1 if there is none we can use */
+static int tracefs_find(void)
+{
+	static const char * const dirs[] = {
+		"/sys/kernel/tracing",
+		"/sys/kernel/debug/tracing",
+	};
+	char path[128];
+	unsigned int i;
+
+	for (i = 0; i < sizeof(dirs) / sizeof(dirs[0]); i++) {
+		snprintf(path, sizeof(path), "%s/trace_marker", dirs[i]);
+		if (!access(path, W_OK)) {
+			strcpy(tracefs, dirs[i]);
+			return 0;
+		}
+	}
+	return -1;
+}
+
+static int tracefs_open(const char *file, int flags)
+{
+	char path[256];
+
+	snprintf(path, sizeof(path), "%s/%s", tracefs, file);
+	return open(path, flags);
+}
+
+/* Write val to a tracefs file, return -errno on failure */
+static int tracefs_write(const char *file, const char *val)
+{
+	int fd, ret = 0;
+
+	fd = tracefs_open(file, O_WRONLY | O_TRUNC);
+	if (fd < 0)
+		return -errno;
+	if (write(fd, val, strlen(val)) < 0)
+		ret = -errno;
+	close(fd);
+	return ret;
+}
+
+static int tracefs_read(const char *file, char *buf, size_t size)
+{
+	ssize_t n;
+	int fd;
+
+	fd = tracefs_open(file, O_RDONLY);
+	if (fd < 0)
+		return -errno;
+	n = read(fd, buf, size - 1);
+	close(fd);
+	if (n < 0)
+		return -errno;
+	buf[n] = '\0';
+	return n;
+}
+
+/* The offset: of a field in a format file */
+static int format_offset(const char *format, const char *field)
+{
+	const char *p = strstr(format, field);
+
+	if (!p || !(p = strstr(p, "offset:")))
+		return -1;
+	return atoi(p + strlen("offset:"));
+}
+
+struct print_format {
+	int id;			/* type of the print events */
+	int buf_offset;		/* offset of the message in an event */
+	int data_offset;	/* offset of the events in a page */
+};
+
+static void print_format_read(struct print_format *fmt)
+{
+	char buf[4096];
+	char *p;
+
+	if (tracefs_read("events/ftrace/print/format", buf, sizeof(buf)) < 0)
+		fail("no events/ftrace/print/format\n");
+	p = strstr(buf, "ID: ");
+	if (!p)
+		fail("no ID in the print format\n");
+	fmt->id = atoi(p + strlen("ID: "));
+	fmt->buf_offset = format_offset(buf, "char buf[];");
+
+	if (tracefs_read("events/header_page", buf, sizeof(buf)) < 0)
+		fail("no events/header_page\n");
+	fmt->data_offset = format_offset(buf, "char data;");
+
+	if (fmt->buf_offset < 0 || fmt->data_offset < 0)
+		fail("cannot parse the print event and page formats\n");
+}
+
+/* Types of the ring buffer event headers, see linux/ring_buffer.h */
+#define RB_TYPE_DATA_MAX	28
+#define RB_TYPE_PADDING		29
+#define RB_TYPE_TIME_EXTEND	30
+#define RB_TYPE_TIME_STAMP	31
+
+typedef void (*print_fn)(const char *msg, void *arg);
+
+/*
+ * Call fn with the message of each print event in data[start, end), return
+ * the number of print events.
+ */
+static long for_each_print(const struct print_format *fmt, const char *data,
+			   unsigned int start, unsigned int end,
+			   print_fn fn, void *arg)
+{
+	unsigned int pos = start, type_len, time_delta, len;
+	const __u32 *event;
+	const char *entry;
+	long n = 0;
+
+	while (pos + sizeof(*event) <= end) {
+		event = (const __u32 *)(data + pos);
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+		type_len = event[0] >> 27;
+		time_delta = event[0] & ((1 << 27) - 1);
+#else
+		type_len = event[0] & 0x1f;
+		time_delta = event[0] >> 5;
+#endif
+		entry = NULL;
+		switch (type_len) {
+		case RB_TYPE_PADDING:
+			/* a null padding fills the rest of the page */
+			if (!time_delta)
+				return n;
+			len = event[1] + 4;
+			break;
+		case RB_TYPE_TIME_EXTEND:
+		case RB_TYPE_TIME_STAMP:
+			len = 8;
+			break;
+		case 0:
+			len = event[1] + 4;
+			entry = (const char *)&event[2];
+			break;
+		default:
+			len = type_len * 4 + 4;
+			entry = (const char *)&event[1];
+			break;
+		}
+
+		if (entry && *(const unsigned short *)entry == fmt->id) {
+			if (fn)
+				fn(entry + fmt->buf_offset, arg);
+			n++;
+		}
+		pos += len;
+	}
+	return n;
+}
+
+static void pin_to_cpu(int cpu)
+{
+	cpu_set_t set;
+
+	CPU_ZERO(&set);
+	CPU_SET(cpu, &set);
+	if (sched_setaffinity(0, sizeof(set), &set))
+		fail("sched_setaffinity: %s\n", strerror(errno));
+}
+
+/* A mapping of the whole of per_cpu/cpu<cpu>/trace_pipe_raw */
+struct cpu_map {
+	int fd;
+	size_t size;
+	struct trace_buffer_meta *meta;
+};
+
+static void cpu_map_open(struct cpu_map *map, int cpu)
+{
+	struct trace_buffer_meta *meta;
+	char file[64];
+
+	snprintf(file, sizeof(file), "per_cpu/cpu%d/trace_pipe_raw", cpu);
+	map->fd = tracefs_open(file, O_RDONLY | O_NONBLOCK);
+	if (map->fd < 0)
+		fail("open %s: %s\n", file, strerror(errno));
+
+	meta = mmap(NULL, getpagesize(), PROT_READ, MAP_SHARED, map->fd, 0);
+	if (meta == MAP_FAILED)
+		fail("mmap of the meta page: %s\n", strerror(errno));
+	map->size = meta->meta_page_size +
+		    (size_t)meta->nr_subbufs * meta->subbuf_size;
+	munmap(meta, getpagesize());
+
+	map->meta = mmap(NULL, map->size, PROT_READ, MAP_SHARED, map->fd, 0);
+	if (map->meta == MAP_FAILED)
+		fail("mmap of %zu bytes: %s\n", map->size, strerror(errno));
+}
+
+static void cpu_map_close(struct cpu_map *map)
+{
+	munmap(map->meta, map->size);
+	close(map->fd);
+}
+
+/* The data of the reader sub-buffer */
+static const char *cpu_map_reader(const struct cpu_map *map)
+{
+	const struct trace_buffer_meta *meta = map->meta;
+
+	return (const char *)meta + meta->meta_page_size +
+	       (size_t)meta->reader.id * meta->subbuf_size + meta->data_offset;
+}
+
+#endif
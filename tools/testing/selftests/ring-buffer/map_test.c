@@ -0,0 +1,231 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * Tests for the mapping of per_cpu/cpuN/trace_pipe_raw: reads trace_marker
+ * events through the meta page and TRACE_MMAP_IOCTL_GET_READER the way a
+ * trace-cmd like reader would, checks that every event is seen once and
+ * in order, that an overflowing writer is reported in the meta page, and
+ * that the CPU buffer can not be resized, snapshot or consumed by another
+ * reader while it is mapped.
+ */
+
+#include "map_common.h"
+
+#define CPU		0
+#define NR_EVENTS	1000
+
+static struct print_format fmt;
+
+struct check {
+	long next;	/* sequence number of the next event */
+	long seen;
+};
+
+static void check_msg(const char *msg, void *arg)
+{
+	struct check *check = arg;
+	long seq;
+
+	if (strncmp(msg, "map_test ", strlen("map_test ")))
+		fail("unexpected event \"%s\"\n", msg);
+	seq = strtol(msg + strlen("map_test "), NULL, 10);
+	if (seq < check->next)
+		fail("event %ld after event %ld\n", seq, check->next - 1);
+	check->next = seq + 1;
+	check->seen++;
+}
+
+static void write_markers(long first, long nr)
+{
+	char msg[64];
+	long i;
+	int fd;
+
+	fd = tracefs_open("trace_marker", O_WRONLY);
+	if (fd < 0)
+		fail("open trace_marker: %s\n", strerror(errno));
+	for (i = first; i < first + nr; i++) {
+		snprintf(msg, sizeof(msg), "map_test %ld\n", i);
+		if (write(fd, msg, strlen(msg)) < 0)
+			fail("write trace_marker: %s\n", strerror(errno));
+	}
+	close(fd);
+}
+
+/* Read the buffer through the mapping until there is nothing new */
+static __u64 drain(struct cpu_map *map, struct check *check)
+{
+	struct trace_buffer_meta *meta = map->meta;
+	__u64 lost = 0;
+
+	for (;;) {
+		if (ioctl(map->fd, TRACE_MMAP_IOCTL_GET_READER))
+			fail("TRACE_MMAP_IOCTL_GET_READER: %s\n", strerror(errno));
+		lost += meta->reader.lost_events;
+		if (meta->reader.read == meta->reader.commit)
+			return lost;
+		if (meta->reader.id >= meta->nr_subbufs ||
+		    meta->reader.commit > meta->subbuf_size - meta->data_offset)
+			fail("reader %u [%u, %u) out of the buffer\n",
+			     meta->reader.id, meta->reader.read,
+			     meta->reader.commit);
+		for_each_print(&fmt, cpu_map_reader(map), meta->reader.read,
+			       meta->reader.commit, check_msg, check);
+	}
+}
+
+static void test_read(void)
+{
+	struct check check = {};
+	struct cpu_map map;
+	__u64 lost;
+
+	tracefs_write("trace", "");
+	/* events from before the mapping are read as well */
+	write_markers(0, NR_EVENTS / 2);
+	cpu_map_open(&map, CPU);
+
+	if (map.meta->meta_struct_len < sizeof(*map.meta) ||
+	    map.meta->subbuf_size != (unsigned int)getpagesize() ||
+	    map.meta->nr_subbufs < 2 ||
+	    map.meta->data_offset != (unsigned int)fmt.data_offset)
+		fail("bad meta page\n");
+
+	write_markers(NR_EVENTS / 2, NR_EVENTS / 2);
+	lost = drain(&map, &check);
+	if (check.seen != NR_EVENTS || lost)
+		fail("%ld events read and %llu lost of %d\n", check.seen,
+		     (unsigned long long)lost, NR_EVENTS);
+	if (map.meta->entries != map.meta->read || map.meta->overrun ||
+	    map.meta->read < NR_EVENTS)
+		fail("meta page counts %llu entries, %llu overrun, %llu read\n",
+		     (unsigned long long)map.meta->entries,
+		     (unsigned long long)map.meta->overrun,
+		     (unsigned long long)map.meta->read);
+
+	/* nothing new: the ioctl does not block a O_NONBLOCK reader */
+	drain(&map, &check);
+	if (check.seen != NR_EVENTS)
+		fail("events read twice\n");
+
+	cpu_map_close(&map);
+}
+
+static void test_overflow(void)
+{
+	struct check check = {};
+	struct cpu_map map;
+	long nr;
+	__u64 lost;
+
+	tracefs_write("trace", "");
+	cpu_map_open(&map, CPU);
+
+	/* Several times the events the buffer holds */
+	nr = 4L * map.meta->nr_subbufs * map.meta->subbuf_size / 32;
+	write_markers(0, nr);
+	lost = drain(&map, &check);
+
+	if (!map.meta->overrun || !lost)
+		fail("%ld events written, nothing lost\n", nr);
+	if (check.seen + map.meta->overrun != nr || lost != map.meta->overrun)
+		fail("%ld events written, %ld read, %llu overrun, %llu lost\n",
+		     nr, check.seen, (unsigned long long)map.meta->overrun,
+		     (unsigned long long)lost);
+	/* the reader swap never let the writer overwrite the newest events */
+	if (check.next != nr)
+		fail("last event read %ld of %ld\n", check.next - 1, nr);
+
+	cpu_map_close(&map);
+}
+
+/* A consuming read() or splice() of @file while CPU is mapped */
+static void check_consume_busy(const char *file)
+{
+	char page[4096];
+	int fd, p[2];
+
+	fd = tracefs_open(file, O_RDONLY | O_NONBLOCK);
+	if (fd < 0)
+		fail("open %s: %s\n", file, strerror(errno));
+	if (read(fd, page, sizeof(page)) >= 0 || errno != EBUSY)
+		fail("read of %s while mapped: %s\n", file, strerror(errno));
+	if (pipe(p))
+		fail("pipe: %s\n", strerror(errno));
+	if (splice(fd, NULL, p[1], NULL, sizeof(page), SPLICE_F_NONBLOCK) >= 0 ||
+	    errno != EBUSY)
+		fail("splice of %s while mapped: %s\n", file, strerror(errno));
+	close(p[0]);
+	close(p[1]);
+	close(fd);
+}
+
+static void test_errors(void)
+{
+	char file[64], size[32];
+	struct cpu_map map;
+	void *addr;
+	int err;
+
+	snprintf(file, sizeof(file), "per_cpu/cpu%d/buffer_size_kb", CPU);
+	if (tracefs_read(file, size, sizeof(size)) < 0)
+		fail("no %s\n", file);
+
+	cpu_map_open(&map, CPU);
+
+	addr = mmap(NULL, getpagesize(), PROT_READ | PROT_WRITE, MAP_SHARED,
+		    map.fd, 0);
+	if (addr != MAP_FAILED || errno != EPERM)
+		fail("writable mapping of the buffer\n");
+	addr = mmap(NULL, map.size + getpagesize(), PROT_READ, MAP_SHARED,
+		    map.fd, 0);
+	if (addr != MAP_FAILED || errno != EINVAL)
+		fail("mapping past the end of the buffer\n");
+	if (mprotect(map.meta, getpagesize(), PROT_READ | PROT_WRITE) >= 0)
+		fail("mapping of the buffer made writable\n");
+
+	err = tracefs_write(file, "64");
+	if (err != -EBUSY)
+		fail("resize of a mapped buffer: %s\n", strerror(-err));
+	err = tracefs_write("snapshot", "1");
+	if (err != -EBUSY && err != -ENOENT)
+		fail("snapshot of a mapped buffer: %s\n", strerror(-err));
+
+	/* Events for the consuming readers to find */
+	write_markers(0, 1);
+	if (read(map.fd, file, sizeof(file)) >= 0 || errno != EBUSY)
+		fail("read of the mapped file: %s\n", strerror(errno));
+	snprintf(file, sizeof(file), "per_cpu/cpu%d/trace_pipe_raw", CPU);
+	check_consume_busy(file);
+	snprintf(file, sizeof(file), "per_cpu/cpu%d/trace_pipe", CPU);
+	check_consume_busy(file);
+	check_consume_busy("trace_pipe");
+
+	cpu_map_close(&map);
+
+	snprintf(file, sizeof(file), "per_cpu/cpu%d/buffer_size_kb", CPU);
+	err = tracefs_write(file, size);
+	if (err)
+		fail("resize of the unmapped buffer: %s\n", strerror(-err));
+}
+
+int main(void)
+{
+	if (geteuid() || tracefs_find()) {
+		printf("map_test: needs root and tracefs, skipping\n");
+		return KSFT_SKIP;
+	}
+
+	pin_to_cpu(CPU);
+	print_format_read(&fmt);
+	if (tracefs_write("current_tracer", "nop") ||
+	    tracefs_write("tracing_on", "1"))
+		fail("cannot set up tracing\n");
+
+	test_read();
+	test_overflow();
+	test_errors();
+
+	tracefs_write("trace", "");
+	printf("map_test: OK\n");
+	return 0;
+}
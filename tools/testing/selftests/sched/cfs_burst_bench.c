@@ -0,0 +1,200 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * Throttling and request latency of a bursty service under CFS bandwidth
+ * control, without and with cpu.max.burst.
+ *
+ * The bench moves itself into a cgroup v2 group with a quota of -q us of
+ * CPU time every -p us, by default 20% of a CPU. Every -i us, -n requests
+ * of -w us of CPU time each arrive at once and are served one after the
+ * other: 16% of a CPU on average by default, but more than the quota of a
+ * period in one go. The latency of a request goes from its arrival to the
+ * end of its service; the 50th and 99th percentiles and the maximum are
+ * reported, with the throttling and burst counts of cpu.stat. The group
+ * runs with cpu.max.burst 0, then with a burst of one quota.
+ *
+ * Usage: cfs_burst_bench [-p period_us] [-q quota_us] [-i interval_us]
+ *			  [-n requests] [-w work_us] [-l loops]
+ */
+
+#include <getopt.h>
+#include <sys/stat.h>
+#include <time.h>
+
+#include "sched_common.h"
+
+static long cfg_period_us = 100000;
+static long cfg_quota_us = 20000;
+static long cfg_interval_us = 200000;
+static long cfg_requests = 4;
+static long cfg_work_us = 8000;
+static long cfg_loops = 50;
+
+static char group[96];
+
+static unsigned long long ts_us(const struct timespec *ts)
+{
+	return ts->tv_sec * 1000000ULL + ts->tv_nsec / 1000;
+}
+
+static unsigned long long now_us(clockid_t clock)
+{
+	struct timespec ts;
+
+	clock_gettime(clock, &ts);
+	return ts_us(&ts);
+}
+
+/* Spin for @us of CPU time, however long it takes while throttled */
+static void work(long us)
+{
+	unsigned long long end = now_us(CLOCK_THREAD_CPUTIME_ID) + us;
+
+	while (now_us(CLOCK_THREAD_CPUTIME_ID) < end)
+		;
+}
+
+static void group_write(const char *file, const char *val)
+{
+	char path[128];
+	int err;
+
+	snprintf(path, sizeof(path), "%s/%s", group, file);
+	err = file_write(path, val);
+	if (err)
+		fail("write \"%s\" to %s: %s\n", val, path, strerror(-err));
+}
+
+static unsigned long long group_stat(const char *name)
+{
+	char path[128], buf[512], *p;
+
+	snprintf(path, sizeof(path), "%s/cpu.stat", group);
+	if (file_read(path, buf, sizeof(buf)) < 0)
+		fail("no %s\n", path);
+	p = strstr(buf, name);
+	if (!p)
+		return 0;
+	return strtoull(p + strlen(name), NULL, 10);
+}
+
+static int cmp_ull(const void *a, const void *b)
+{
+	unsigned long long x = *(const unsigned long long *)a;
+	unsigned long long y = *(const unsigned long long *)b;
+
+	return x < y ? -1 : x > y;
+}
+
+static void run(long burst_us)
+{
+	unsigned long long throttled, throttled_us, bursts, arrival, *lat;
+	long nr = cfg_loops * cfg_requests, i, r;
+	struct timespec next;
+	char val[32];
+
+	lat = calloc(nr, sizeof(*lat));
+	if (!lat)
+		fail("no memory\n");
+	snprintf(val, sizeof(val), "%ld", burst_us);
+	group_write("cpu.max.burst", val);
+
+	clock_gettime(CLOCK_MONOTONIC, &next);
+	throttled = group_stat("nr_throttled ");
+	throttled_us = group_stat("throttled_usec ");
+	bursts = group_stat("nr_bursts ");
+
+	for (i = 0; i < cfg_loops; i++) {
+		next.tv_nsec += cfg_interval_us * 1000;
+		while (next.tv_nsec >= 1000000000) {
+			next.tv_nsec -= 1000000000;
+			next.tv_sec++;
+		}
+		clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &next, NULL);
+		arrival = ts_us(&next);
+		for (r = 0; r < cfg_requests; r++) {
+			work(cfg_work_us);
+			lat[i * cfg_requests + r] =
+				now_us(CLOCK_MONOTONIC) - arrival;
+		}
+	}
+
+	throttled = group_stat("nr_throttled ") - throttled;
+	throttled_us = group_stat("throttled_usec ") - throttled_us;
+	bursts = group_stat("nr_bursts ") - bursts;
+
+	qsort(lat, nr, sizeof(*lat), cmp_ull);
+	printf("burst %6ld us: %4llu throttled %8llu us, %4llu bursts, latency p50 %6llu p99 %6llu max %6llu us\n",
+	       burst_us, throttled, throttled_us, bursts, lat[nr / 2],
+	       lat[nr * 99 / 100], lat[nr - 1]);
+	free(lat);
+}
+
+int main(int argc, char **argv)
+{
+	char path[128], val[64];
+	int c;
+
+	while ((c = getopt(argc, argv, "p:q:i:n:w:l:")) != -1) {
+		switch (c) {
+		case 'p':
+			cfg_period_us = strtol(optarg, NULL, 0);
+			break;
+		case 'q':
+			cfg_quota_us = strtol(optarg, NULL, 0);
+			break;
+		case 'i':
+			cfg_interval_us = strtol(optarg, NULL, 0);
+			break;
+		case 'n':
+			cfg_requests = strtol(optarg, NULL, 0);
+			break;
+		case 'w':
+			cfg_work_us = strtol(optarg, NULL, 0);
+			break;
+		case 'l':
+			cfg_loops = strtol(optarg, NULL, 0);
+			break;
+		default:
+			fail("usage: %s [-p period_us] [-q quota_us] [-i interval_us] [-n requests] [-w work_us] [-l loops]\n",
+			     argv[0]);
+		}
+	}
+	if (cfg_period_us <= 0 || cfg_quota_us <= 0 || cfg_interval_us <= 0 ||
+	    cfg_requests <= 0 || cfg_work_us <= 0 || cfg_loops <= 0)
+		fail("bad arguments\n");
+
+	if (geteuid() || cgroup_find()) {
+		printf("cfs_burst_bench: needs root and cgroup v2, skipping\n");
+		return KSFT_SKIP;
+	}
+	snprintf(path, sizeof(path), "%s/cgroup.subtree_control", cgroup);
+	if (file_write(path, "+cpu")) {
+		printf("cfs_burst_bench: no cpu controller, skipping\n");
+		return KSFT_SKIP;
+	}
+	snprintf(group, sizeof(group), "%s/cfs_burst_bench", cgroup);
+	if (mkdir(group, 0755) && errno != EEXIST)
+		fail("mkdir %s: %s\n", group, strerror(errno));
+	snprintf(path, sizeof(path), "%s/cpu.max.burst", group);
+	if (access(path, F_OK)) {
+		printf("cfs_burst_bench: no cpu.max.burst, skipping\n");
+		rmdir(group);
+		return KSFT_SKIP;
+	}
+
+	snprintf(val, sizeof(val), "%ld %ld", cfg_quota_us, cfg_period_us);
+	group_write("cpu.max", val);
+	snprintf(val, sizeof(val), "%d", getpid());
+	group_write("cgroup.procs", val);
+
+	printf("quota %ld us every %ld us, %ld requests of %ld us every %ld us\n",
+	       cfg_quota_us, cfg_period_us, cfg_requests, cfg_work_us,
+	       cfg_interval_us);
+	run(0);
+	run(cfg_quota_us);
+
+	snprintf(path, sizeof(path), "%s/cgroup.procs", cgroup);
+	file_write(path, val);
+	rmdir(group);
+	return 0;
+}
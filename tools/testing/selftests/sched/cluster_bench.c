@@ -0,0 +1,201 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * Placement of communicating threads across cache domains (the clusters
+ * of an arm64 system): -p producer/consumer pairs of threads pass -n
+ * items each through a pair of pipes, one at a time, while as many
+ * independent threads spin on their own. Runs with the WA_CLUSTER
+ * scheduler feature and without it when debugfs lets us set it, and
+ * reports the items per second with the schedstats of the pair threads:
+ * wakeups pulled into the cluster of the waker and migrations between
+ * cache domains.
+ *
+ * On a single cluster system both runs are the same; QEMU can give a two
+ * cluster topology with -smp 8,sockets=2,cores=4.
+ *
+ * Usage: cluster_bench [-p pairs] [-n items]
+ */
+
+#include <getopt.h>
+#include <pthread.h>
+#include <time.h>
+
+#include "sched_common.h"
+
+#define FEATURES	"/sys/kernel/debug/sched_features"
+#define SCHEDSTATS	"/proc/sys/kernel/sched_schedstats"
+#define MAX_PAIRS	256
+
+static int cfg_pairs;
+static long cfg_items = 100000;
+
+struct pair {
+	int to_consumer[2];
+	int to_producer[2];
+	pthread_t producer, consumer;
+	/* schedstats of the two threads */
+	unsigned long long pulled, cross;
+};
+
+static struct pair pairs[MAX_PAIRS];
+static pthread_t spinners[MAX_PAIRS];
+static volatile int stop;
+
+static unsigned long long now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/* A schedstat of the calling thread, 0 without schedstats */
+static unsigned long long thread_stat(const char *name)
+{
+	char path[64], buf[8192], *p;
+
+	snprintf(path, sizeof(path), "/proc/self/task/%ld/sched",
+		 syscall(SYS_gettid));
+	if (file_read(path, buf, sizeof(buf)) < 0)
+		return 0;
+	p = strstr(buf, name);
+	if (!p || !(p = strchr(p, ':')))
+		return 0;
+	return strtoull(p + 1, NULL, 10);
+}
+
+static void add_stats(struct pair *pair)
+{
+	__atomic_add_fetch(&pair->pulled, thread_stat("nr_wakeups_cluster"),
+			   __ATOMIC_RELAXED);
+	__atomic_add_fetch(&pair->cross, thread_stat("nr_migrations_cross_llc"),
+			   __ATOMIC_RELAXED);
+}
+
+static void *producer(void *arg)
+{
+	struct pair *pair = arg;
+	long i, item;
+
+	for (i = 0; i < cfg_items; i++) {
+		if (write(pair->to_consumer[1], &i, sizeof(i)) != sizeof(i) ||
+		    read(pair->to_producer[0], &item, sizeof(item)) != sizeof(item))
+			fail("pipe: %s\n", strerror(errno));
+		if (item != i)
+			fail("item %ld back for %ld\n", item, i);
+	}
+	add_stats(pair);
+	return NULL;
+}
+
+static void *consumer(void *arg)
+{
+	struct pair *pair = arg;
+	long i, item;
+
+	for (i = 0; i < cfg_items; i++) {
+		if (read(pair->to_consumer[0], &item, sizeof(item)) != sizeof(item) ||
+		    write(pair->to_producer[1], &item, sizeof(item)) != sizeof(item))
+			fail("pipe: %s\n", strerror(errno));
+	}
+	add_stats(pair);
+	return NULL;
+}
+
+static void *spinner(void *arg)
+{
+	while (!stop)
+		;
+	return NULL;
+}
+
+static void run(const char *feature)
+{
+	unsigned long long start, elapsed, pulled = 0, cross = 0;
+	struct pair *pair;
+	int i;
+
+	if (feature && file_write(FEATURES, feature))
+		fail("cannot set %s\n", feature);
+
+	stop = 0;
+	for (i = 0; i < cfg_pairs; i++)
+		if (pthread_create(&spinners[i], NULL, spinner, NULL))
+			fail("pthread_create\n");
+
+	start = now_ns();
+	for (i = 0; i < cfg_pairs; i++) {
+		pair = &pairs[i];
+		pair->pulled = pair->cross = 0;
+		if (pipe(pair->to_consumer) || pipe(pair->to_producer))
+			fail("pipe: %s\n", strerror(errno));
+		if (pthread_create(&pair->consumer, NULL, consumer, pair) ||
+		    pthread_create(&pair->producer, NULL, producer, pair))
+			fail("pthread_create\n");
+	}
+
+	for (i = 0; i < cfg_pairs; i++) {
+		pthread_join(pairs[i].producer, NULL);
+		pthread_join(pairs[i].consumer, NULL);
+	}
+	elapsed = now_ns() - start;
+	for (i = 0; i < cfg_pairs; i++) {
+		pair = &pairs[i];
+		pulled += pair->pulled;
+		cross += pair->cross;
+		close(pair->to_consumer[0]);
+		close(pair->to_consumer[1]);
+		close(pair->to_producer[0]);
+		close(pair->to_producer[1]);
+	}
+
+	stop = 1;
+	for (i = 0; i < cfg_pairs; i++)
+		pthread_join(spinners[i], NULL);
+
+	printf("%-15s %10.0f items/s %10llu pulled %10llu cross-cluster migrations\n",
+	       feature ? feature : "default",
+	       cfg_pairs * cfg_items * 1e9 / elapsed, pulled, cross);
+}
+
+int main(int argc, char **argv)
+{
+	char schedstats[16] = "";
+	int c, features;
+
+	cfg_pairs = sysconf(_SC_NPROCESSORS_ONLN) / 4;
+	if (cfg_pairs < 1)
+		cfg_pairs = 1;
+	while ((c = getopt(argc, argv, "p:n:")) != -1) {
+		switch (c) {
+		case 'p':
+			cfg_pairs = atoi(optarg);
+			break;
+		case 'n':
+			cfg_items = strtol(optarg, NULL, 0);
+			break;
+		default:
+			fail("usage: %s [-p pairs] [-n items]\n", argv[0]);
+		}
+	}
+	if (cfg_pairs <= 0 || cfg_pairs > MAX_PAIRS || cfg_items <= 0)
+		fail("bad arguments\n");
+
+	/* the per task schedstats are only counted with schedstats on */
+	if (file_read(SCHEDSTATS, schedstats, sizeof(schedstats)) >= 0)
+		file_write(SCHEDSTATS, "1");
+	features = !access(FEATURES, W_OK);
+
+	printf("%d pairs of %ld items, %d spinning threads\n", cfg_pairs,
+	       cfg_items, cfg_pairs);
+	if (features) {
+		run("WA_CLUSTER");
+		run("NO_WA_CLUSTER");
+		file_write(FEATURES, "WA_CLUSTER");
+	} else {
+		run(NULL);
+	}
+
+	if (schedstats[0])
+		file_write(SCHEDSTATS, schedstats);
+	return 0;
+}
@@ -0,0 +1,184 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * Wakeup latency of a SCHED_NORMAL task by latency nice, cyclictest like,
+ * under a hackbench like background load: -g groups of -f sender and
+ * receiver process pairs exchanging 100 byte messages over pipes.
+ *
+ * For each latency nice value in turn, a task wakes up every -i
+ * microseconds on an absolute timer, -l times, and records how late it
+ * runs. The minimum, average, 99th percentile and maximum are reported.
+ *
+ * Usage: latency_nice_bench [-g groups] [-f fds] [-i interval_us] [-l loops]
+ */
+
+#include <getopt.h>
+#include <signal.h>
+#include <time.h>
+#include <sys/wait.h>
+
+#include "sched_common.h"
+
+#define MSG_SIZE	100
+#define MAX_PROCS	4096
+
+static int cfg_groups;
+static int cfg_fds = 10;
+static long cfg_interval_us = 1000;
+static long cfg_loops = 10000;
+
+static pid_t procs[MAX_PROCS];
+static int nr_procs;
+
+static unsigned long long ts_us(const struct timespec *ts)
+{
+	return ts->tv_sec * 1000000ULL + ts->tv_nsec / 1000;
+}
+
+static void spawn(void (*fn)(int), int fd)
+{
+	pid_t pid;
+
+	if (nr_procs == MAX_PROCS)
+		fail("too many processes\n");
+	pid = fork();
+	if (pid < 0)
+		fail("fork: %s\n", strerror(errno));
+	if (!pid) {
+		fn(fd);
+		exit(0);
+	}
+	procs[nr_procs++] = pid;
+}
+
+static void sender(int fd)
+{
+	char msg[MSG_SIZE] = {};
+
+	while (write(fd, msg, sizeof(msg)) > 0)
+		;
+}
+
+static void receiver(int fd)
+{
+	char msg[MSG_SIZE];
+
+	while (read(fd, msg, sizeof(msg)) > 0)
+		;
+}
+
+static void load_start(void)
+{
+	int g, i, p[2];
+
+	for (g = 0; g < cfg_groups; g++) {
+		for (i = 0; i < cfg_fds; i++) {
+			if (pipe(p))
+				fail("pipe: %s\n", strerror(errno));
+			spawn(receiver, p[0]);
+			spawn(sender, p[1]);
+			close(p[0]);
+			close(p[1]);
+		}
+	}
+}
+
+static void load_stop(void)
+{
+	int i;
+
+	for (i = 0; i < nr_procs; i++)
+		kill(procs[i], SIGKILL);
+	for (i = 0; i < nr_procs; i++)
+		waitpid(procs[i], NULL, 0);
+}
+
+static int cmp_ull(const void *a, const void *b)
+{
+	unsigned long long x = *(const unsigned long long *)a;
+	unsigned long long y = *(const unsigned long long *)b;
+
+	return x < y ? -1 : x > y;
+}
+
+static void measure(int latency_nice)
+{
+	struct sched_attr_ext attr = {
+		.size			= sizeof(attr),
+		.sched_flags		= SCHED_FLAG_KEEP_ALL |
+					  SCHED_FLAG_LATENCY_NICE,
+		.sched_latency_nice	= latency_nice,
+	};
+	unsigned long long *lat, sum = 0;
+	struct timespec next, now;
+	long i;
+
+	lat = calloc(cfg_loops, sizeof(*lat));
+	if (!lat)
+		fail("no memory\n");
+	if (sched_setattr_ext(0, &attr))
+		fail("latency nice %d: %s\n", latency_nice, strerror(errno));
+
+	clock_gettime(CLOCK_MONOTONIC, &next);
+	for (i = 0; i < cfg_loops; i++) {
+		next.tv_nsec += cfg_interval_us * 1000;
+		while (next.tv_nsec >= 1000000000) {
+			next.tv_nsec -= 1000000000;
+			next.tv_sec++;
+		}
+		clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &next, NULL);
+		clock_gettime(CLOCK_MONOTONIC, &now);
+		lat[i] = ts_us(&now) - ts_us(&next);
+		sum += lat[i];
+	}
+
+	qsort(lat, cfg_loops, sizeof(*lat), cmp_ull);
+	printf("latency nice %3d: min %5llu avg %7.1f p99 %6llu max %6llu us\n",
+	       latency_nice, lat[0], (double)sum / cfg_loops,
+	       lat[cfg_loops * 99 / 100], lat[cfg_loops - 1]);
+	free(lat);
+}
+
+int main(int argc, char **argv)
+{
+	static const int values[] = { 0, -20, 19 };
+	unsigned int i;
+	int c;
+
+	cfg_groups = sysconf(_SC_NPROCESSORS_ONLN);
+	while ((c = getopt(argc, argv, "g:f:i:l:")) != -1) {
+		switch (c) {
+		case 'g':
+			cfg_groups = atoi(optarg);
+			break;
+		case 'f':
+			cfg_fds = atoi(optarg);
+			break;
+		case 'i':
+			cfg_interval_us = strtol(optarg, NULL, 0);
+			break;
+		case 'l':
+			cfg_loops = strtol(optarg, NULL, 0);
+			break;
+		default:
+			fail("usage: %s [-g groups] [-f fds] [-i interval_us] [-l loops]\n",
+			     argv[0]);
+		}
+	}
+	if (cfg_groups < 0 || cfg_fds <= 0 || cfg_interval_us <= 0 ||
+	    cfg_loops <= 0)
+		fail("bad arguments\n");
+
+	/* lowering the latency nice needs CAP_SYS_NICE */
+	if (geteuid()) {
+		printf("latency_nice_bench: needs root, skipping\n");
+		return KSFT_SKIP;
+	}
+
+	printf("%d groups of %d pipe pairs, %ld wakeups every %ld us\n",
+	       cfg_groups, cfg_fds, cfg_loops, cfg_interval_us);
+	load_start();
+	for (i = 0; i < sizeof(values) / sizeof(values[0]); i++)
+		measure(values[i]);
+	load_stop();
+	return 0;
+}
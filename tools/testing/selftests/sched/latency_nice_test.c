@@ -0,0 +1,218 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * Tests for the latency nice interfaces: the sched_latency_nice field of
+ * sched_setattr() and sched_getattr(), its validation and permission
+ * checks, its inheritance across fork() and the cpu.latency.nice file of
+ * a cgroup v2 group.
+ */
+
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+
+#include "sched_common.h"
+
+#define MAX_LATENCY_NICE	19
+#define MIN_LATENCY_NICE	-20
+#define DEFAULT_LATENCY_NICE	0
+
+static int latency_nice_set(int latency_nice, __u64 flags)
+{
+	struct sched_attr_ext attr = {
+		.size			= sizeof(attr),
+		.sched_flags		= SCHED_FLAG_KEEP_ALL |
+					  SCHED_FLAG_LATENCY_NICE | flags,
+		.sched_latency_nice	= latency_nice,
+	};
+
+	return sched_setattr_ext(0, &attr);
+}
+
+static int latency_nice_get(void)
+{
+	struct sched_attr_ext attr = {};
+
+	if (sched_getattr_ext(0, &attr, sizeof(attr)))
+		fail("sched_getattr: %s\n", strerror(errno));
+	return attr.sched_latency_nice;
+}
+
+static void test_attr(void)
+{
+	struct sched_attr_ext attr = {};
+
+	if (latency_nice_get())
+		fail("latency nice %d by default\n", latency_nice_get());
+
+	if (setpriority(PRIO_PROCESS, 0, 3))
+		fail("setpriority: %s\n", strerror(errno));
+	if (latency_nice_set(10, 0))
+		fail("sched_setattr: %s\n", strerror(errno));
+	if (latency_nice_get() != 10)
+		fail("latency nice %d instead of 10\n", latency_nice_get());
+	if (sched_getattr_ext(0, &attr, sizeof(attr)))
+		fail("sched_getattr: %s\n", strerror(errno));
+	if (attr.sched_policy != SCHED_NORMAL || attr.sched_nice != 3)
+		fail("policy %u nice %d after a latency nice change\n",
+		     attr.sched_policy, attr.sched_nice);
+
+	/* kept across a policy change without the flag */
+	memset(&attr, 0, sizeof(attr));
+	attr.size = sizeof(attr);
+	attr.sched_policy = SCHED_BATCH;
+	attr.sched_nice = 3;
+	if (sched_setattr_ext(0, &attr))
+		fail("sched_setattr SCHED_BATCH: %s\n", strerror(errno));
+	if (latency_nice_get() != 10)
+		fail("latency nice %d after a policy change\n",
+		     latency_nice_get());
+	attr.sched_policy = SCHED_NORMAL;
+	if (sched_setattr_ext(0, &attr))
+		fail("sched_setattr SCHED_NORMAL: %s\n", strerror(errno));
+}
+
+static void test_errors(void)
+{
+	struct sched_attr_ext attr = {
+		.size			= ATTR_SIZE_VER1,
+		.sched_flags		= SCHED_FLAG_KEEP_ALL |
+					  SCHED_FLAG_LATENCY_NICE,
+		.sched_latency_nice	= 15,
+	};
+
+	if (latency_nice_set(MAX_LATENCY_NICE + 1, 0) != -1 || errno != EINVAL)
+		fail("latency nice %d accepted\n", MAX_LATENCY_NICE + 1);
+	if (latency_nice_set(MIN_LATENCY_NICE - 1, 0) != -1 || errno != EINVAL)
+		fail("latency nice %d accepted\n", MIN_LATENCY_NICE - 1);
+	if (sched_setattr_ext(0, &attr) != -1 || errno != EINVAL)
+		fail("latency nice in a VER1 sched_attr accepted\n");
+	if (latency_nice_get() != 10)
+		fail("latency nice %d after errors\n", latency_nice_get());
+}
+
+/* Run fn in a child, return its exit status */
+static int in_child(void (*fn)(void))
+{
+	int status;
+	pid_t pid;
+
+	pid = fork();
+	if (pid < 0)
+		fail("fork: %s\n", strerror(errno));
+	if (!pid) {
+		fn();
+		exit(0);
+	}
+	if (waitpid(pid, &status, 0) != pid || !WIFEXITED(status))
+		fail("child did not exit\n");
+	return WEXITSTATUS(status);
+}
+
+static void child_inherits(void)
+{
+	if (latency_nice_get() != 10)
+		fail("child latency nice %d instead of 10\n",
+		     latency_nice_get());
+	/* raising it is always allowed */
+	if (latency_nice_set(15, 0) || latency_nice_get() != 15)
+		fail("sched_setattr: %s\n", strerror(errno));
+}
+
+static void grandchild_reset(void)
+{
+	if (latency_nice_get() != DEFAULT_LATENCY_NICE)
+		fail("latency nice %d not reset on fork\n", latency_nice_get());
+}
+
+static void child_reset(void)
+{
+	if (latency_nice_set(15, SCHED_FLAG_RESET_ON_FORK))
+		fail("sched_setattr: %s\n", strerror(errno));
+	if (in_child(grandchild_reset))
+		exit(1);
+}
+
+static void child_unprivileged(void)
+{
+	if (setresgid(65534, 65534, 65534) || setresuid(65534, 65534, 65534))
+		fail("cannot drop privileges: %s\n", strerror(errno));
+	if (latency_nice_set(5, 0) != -1 || errno != EPERM)
+		fail("unprivileged latency nice decrease accepted\n");
+	if (latency_nice_set(12, 0))
+		fail("unprivileged latency nice increase: %s\n",
+		     strerror(errno));
+}
+
+static void test_fork(void)
+{
+	if (in_child(child_inherits) || in_child(child_reset))
+		exit(1);
+	if (!geteuid() && in_child(child_unprivileged))
+		exit(1);
+	if (geteuid() && (latency_nice_set(5, 0) != -1 || errno != EPERM))
+		fail("unprivileged latency nice decrease accepted\n");
+}
+
+static void cgroup_expect(const char *val, int err, const char *read)
+{
+	char path[128], buf[32];
+	int ret;
+
+	snprintf(path, sizeof(path), "%s/latency_nice_test/cpu.latency.nice",
+		 cgroup);
+	ret = file_write(path, val);
+	if (ret != err)
+		fail("cpu.latency.nice of \"%s\": %s\n", val, strerror(-ret));
+	if (file_read(path, buf, sizeof(buf)) < 0)
+		fail("read of cpu.latency.nice: %s\n", strerror(errno));
+	if (strcmp(buf, read))
+		fail("cpu.latency.nice reads \"%s\" instead of \"%s\"\n",
+		     buf, read);
+}
+
+static void test_cgroup(void)
+{
+	char path[128];
+
+	if (cgroup_find()) {
+		printf("test_cgroup: no cgroup v2, skipping\n");
+		return;
+	}
+	snprintf(path, sizeof(path), "%s/cgroup.subtree_control", cgroup);
+	if (file_write(path, "+cpu")) {
+		printf("test_cgroup: no cpu controller, skipping\n");
+		return;
+	}
+	snprintf(path, sizeof(path), "%s/cpu.latency.nice", cgroup);
+	if (!access(path, F_OK))
+		fail("cpu.latency.nice in the root cgroup\n");
+	snprintf(path, sizeof(path), "%s/latency_nice_test", cgroup);
+	if (mkdir(path, 0755) && errno != EEXIST)
+		fail("mkdir %s: %s\n", path, strerror(errno));
+
+	cgroup_expect("0", 0, "0\n");
+	cgroup_expect("-5", 0, "-5\n");
+	cgroup_expect("19", 0, "19\n");
+	cgroup_expect("20", -ERANGE, "19\n");
+	cgroup_expect("-21", -ERANGE, "19\n");
+	cgroup_expect("0", 0, "0\n");
+
+	rmdir(path);
+}
+
+int main(void)
+{
+	if (latency_nice_set(0, 0)) {
+		printf("latency_nice_test: no latency nice support, skipping\n");
+		return KSFT_SKIP;
+	}
+
+	test_attr();
+	test_errors();
+	test_fork();
+	if (!geteuid())
+		test_cgroup();
+
+	printf("latency_nice_test: OK\n");
+	return 0;
+}
@@ -0,0 +1,131 @@
+/* SPDX-License-Identifier: GPL-2.0 */
+/*
+ * sched_setattr() and sched_getattr() wrappers of the sched tests, with a
+ * sched_attr of our own: the C library one, if any, may not know the
+ * sched_util_{min,max} and sched_latency_nice fields.
+ */
+#ifndef __SCHED_COMMON_H
+#define __SCHED_COMMON_H
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <linux/types.h>
+#include <linux/sched.h>
+
+#define KSFT_SKIP	4
+
+#define fail(format...) ({					\
+	printf("%s(%d):FAIL: ", __func__, __LINE__);		\
+	printf(format);						\
+	exit(1);						\
+})
+
+#define SCHED_CAPACITY_SCALE	1024
+
+#define ATTR_SIZE_VER0		48
+#define ATTR_SIZE_VER1		56
+#define ATTR_SIZE_VER2		60
+
+struct sched_attr_ext {
+	__u32 size;
+
+	__u32 sched_policy;
+	__u64 sched_flags;
+
+	__s32 sched_nice;
+	__u32 sched_priority;
+
+	__u64 sched_runtime;
+	__u64 sched_deadline;
+	__u64 sched_period;
+
+	__u32 sched_util_min;
+	__u32 sched_util_max;
+
+	__s32 sched_latency_nice;
+};
+
+static inline int sched_setattr_ext(pid_t pid, struct sched_attr_ext *attr)
+{
+	return syscall(__NR_sched_setattr, pid, attr, 0);
+}
+
+static inline int sched_getattr_ext(pid_t pid, struct sched_attr_ext *attr,
+				    unsigned int size)
+{
+	return syscall(__NR_sched_getattr, pid, attr, size, 0);
+}
+
+/* Set the clamps of pid, keeping its policy and priority */
+static inline int uclamp_set(pid_t pid, unsigned int min, unsigned int max)
+{
+	struct sched_attr_ext attr = {
+		.size		= sizeof(attr),
+		.sched_flags	= SCHED_FLAG_KEEP_ALL | SCHED_FLAG_UTIL_CLAMP,
+		.sched_util_min	= min,
+		.sched_util_max	= max,
+	};
+
+	return sched_setattr_ext(pid, &attr);
+}
+
+static inline int file_read(const char *path, char *buf, size_t size)
+{
+	ssize_t n;
+	int fd;
+
+	fd = open(path, O_RDONLY);
+	if (fd < 0)
+		return -errno;
+	n = read(fd, buf, size - 1);
+	close(fd);
+	if (n < 0)
+		return -errno;
+	buf[n] = '\0';
+	return n;
+}
+
+/* Write val to a file, return -errno on failure */
+static inline int file_write(const char *path, const char *val)
+{
+	int fd, ret = 0;
+
+	fd = open(path, O_WRONLY | O_TRUNC);
+	if (fd < 0)
+		return -errno;
+	if (write(fd, val, strlen(val)) < 0)
+		ret = -errno;
+	close(fd);
+	return ret;
+}
+
+static char cgroup[64];
+
+/* Find a mounted cgroup v2 hierarchy, return -1 if there is none */
+static inline int cgroup_find(void)
+{
+	static const char * const dirs[] = {
+		"/sys/fs/cgroup",
+		"/sys/fs/cgroup/unified",
+	};
+	char path[128];
+	unsigned int i;
+
+	for (i = 0; i < sizeof(dirs) / sizeof(dirs[0]); i++) {
+		snprintf(path, sizeof(path), "%s/cgroup.subtree_control",
+			 dirs[i]);
+		if (!access(path, W_OK)) {
+			strcpy(cgroup, dirs[i]);
+			return 0;
+		}
+	}
+	return -1;
+}
+
+#endif
@@ -0,0 +1,76 @@
+#!/bin/bash
+# SPDX-License-Identifier: GPL-2.0
+#
+# Wakeup placement cost with and without the idle CPU mask of the LLC:
+# runs perf bench sched messaging (hackbench) and sched pipe (a pipe
+# ping-pong) with the SIS_IDLE_MASK and NO_SIS_IDLE_MASK scheduler
+# features, and reports the select_idle_sibling() schedstats of each run:
+# LLC searches, CPUs scanned per search and the share of searches that
+# found an idle CPU.
+#
+# Set NR_GROUPS and LOOPS to size the hackbench run (default 10 and 1000),
+# PIPE_LOOPS for the ping-pong (default 1000000).
+
+readonly FEATURES=/sys/kernel/debug/sched_features
+readonly NR_GROUPS=${NR_GROUPS:-10}
+readonly LOOPS=${LOOPS:-1000}
+readonly PIPE_LOOPS=${PIPE_LOOPS:-1000000}
+
+ksft_skip=4
+
+old_schedstats=
+
+cleanup() {
+	[[ -n "${old_schedstats}" ]] &&
+		sysctl -qw kernel.sched_schedstats="${old_schedstats}"
+	[[ -w "${FEATURES}" ]] && echo SIS_IDLE_MASK > "${FEATURES}"
+}
+trap cleanup EXIT
+
+if [[ $EUID -ne 0 ]]; then
+	echo "SKIP: need root privileges"
+	exit $ksft_skip
+fi
+if ! grep -qw SIS_IDLE_MASK "${FEATURES}" 2>/dev/null; then
+	echo "SKIP: no SIS_IDLE_MASK in ${FEATURES}"
+	exit $ksft_skip
+fi
+if ! perf bench sched pipe -l 1 >/dev/null 2>&1; then
+	echo "SKIP: no perf bench"
+	exit $ksft_skip
+fi
+
+old_schedstats=$(sysctl -n kernel.sched_schedstats 2>/dev/null)
+if ! sysctl -qw kernel.sched_schedstats=1; then
+	echo "SKIP: no schedstats"
+	exit $ksft_skip
+fi
+
+# Sum of the search, scanned and found columns of the cpu lines
+sis_stats() {
+	awk '/^version/ && $2 < 16 { exit 1 }
+	     /^cpu/ { s += $11; n += $12; f += $13 }
+	     END { print s, n, f }' /proc/schedstat
+}
+
+run() {
+	local name=$1; shift
+	local before after time
+
+	before=($(sis_stats)) || { echo "SKIP: old /proc/schedstat"; exit $ksft_skip; }
+	time=$(perf bench -f simple sched "$@")
+	after=($(sis_stats))
+
+	awk -v name="${name}" -v time="${time}" \
+	    -v s=$((after[0] - before[0])) -v n=$((after[1] - before[1])) \
+	    -v f=$((after[2] - before[2])) \
+	    'BEGIN { printf "  %-9s %10s s %10d searches %6.2f scanned %6.1f%% found\n",
+		     name, time, s, s ? n / s : 0, s ? 100 * f / s : 0 }'
+}
+
+for feat in SIS_IDLE_MASK NO_SIS_IDLE_MASK; do
+	echo "${feat}" > "${FEATURES}"
+	echo "${feat}"
+	run hackbench messaging -g "${NR_GROUPS}" -l "${LOOPS}"
+	run pipe pipe -l "${PIPE_LOOPS}"
+done
@@ -0,0 +1,265 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * Frequency ramp, deadline misses and an energy proxy of an rt-app like
+ * periodic task: each period it runs a fixed amount of work, calibrated to
+ * -d percent of the period at the highest frequency, then sleeps until the
+ * next period. The task runs unclamped, boosted to the full capacity with
+ * UCLAMP_MIN and capped to a quarter of it with UCLAMP_MAX.
+ *
+ * While it runs, scaling_cur_freq of its CPU is sampled every millisecond
+ * from another CPU: "ramp" is the time until the CPU first reaches 90% of
+ * its highest frequency. The energy proxy sums the cpufreq time_in_state
+ * residencies weighted by (f / f_max)^3, as dynamic power goes with f.V^2,
+ * relative to the whole run at f_max. The CPU is expected to run schedutil.
+ *
+ * Usage: uclamp_bench [-c cpu] [-d duty%] [-p period_us] [-t seconds]
+ */
+
+#include <getopt.h>
+#include <sched.h>
+#include <time.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+
+#include "sched_common.h"
+
+#define MAX_STATES	64
+
+static int cfg_cpu;
+static int cfg_duty = 20;
+static long cfg_period_us = 16000;
+static int cfg_seconds = 3;
+
+static char cpufreq[64];
+static double loops_per_us;
+
+struct freq_states {
+	int nr;
+	unsigned long freq[MAX_STATES];
+	unsigned long long time[MAX_STATES];	/* in 10ms units */
+};
+
+struct run_stats {
+	long periods;
+	long missed;
+};
+
+static unsigned long long now_us(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000ULL + ts.tv_nsec / 1000;
+}
+
+static unsigned long cpufreq_read(const char *file)
+{
+	char path[128], buf[32];
+
+	snprintf(path, sizeof(path), "%s/%s", cpufreq, file);
+	if (file_read(path, buf, sizeof(buf)) < 0)
+		return 0;
+	return strtoul(buf, NULL, 10);
+}
+
+static void pin_to_cpu(int cpu)
+{
+	cpu_set_t set;
+
+	CPU_ZERO(&set);
+	CPU_SET(cpu, &set);
+	if (sched_setaffinity(0, sizeof(set), &set))
+		fail("sched_setaffinity: %s\n", strerror(errno));
+}
+
+static void states_read(struct freq_states *st)
+{
+	char path[128];
+	FILE *f;
+
+	st->nr = 0;
+	snprintf(path, sizeof(path), "%s/stats/time_in_state", cpufreq);
+	f = fopen(path, "r");
+	if (!f)
+		return;
+	while (st->nr < MAX_STATES &&
+	       fscanf(f, "%lu %llu", &st->freq[st->nr], &st->time[st->nr]) == 2)
+		st->nr++;
+	fclose(f);
+}
+
+static void work(long loops)
+{
+	volatile long i;
+
+	for (i = 0; i < loops; i++)
+		;
+}
+
+/* Loops per microsecond, boosted to the highest frequency */
+static void calibrate(void)
+{
+	unsigned long long start, elapsed;
+	long loops = 1000;
+
+	uclamp_set(0, SCHED_CAPACITY_SCALE, SCHED_CAPACITY_SCALE);
+	/* let schedutil ramp up */
+	work(100000000);
+	do {
+		loops *= 2;
+		start = now_us();
+		work(loops);
+		elapsed = now_us() - start;
+	} while (elapsed < 100000);
+	loops_per_us = (double)loops / elapsed;
+	uclamp_set(0, 0, SCHED_CAPACITY_SCALE);
+}
+
+static void periodic_task(unsigned int min, unsigned int max,
+			  struct run_stats *stats)
+{
+	long loops = loops_per_us * cfg_period_us * cfg_duty / 100;
+	unsigned long long end;
+	struct timespec next;
+
+	pin_to_cpu(cfg_cpu);
+	if (uclamp_set(0, min, max))
+		fail("sched_setattr: %s\n", strerror(errno));
+
+	end = now_us() + cfg_seconds * 1000000ULL;
+	clock_gettime(CLOCK_MONOTONIC, &next);
+	while (now_us() < end) {
+		work(loops);
+		next.tv_nsec += cfg_period_us * 1000;
+		while (next.tv_nsec >= 1000000000) {
+			next.tv_nsec -= 1000000000;
+			next.tv_sec++;
+		}
+		stats->periods++;
+		if (now_us() > next.tv_sec * 1000000ULL + next.tv_nsec / 1000) {
+			/* overran: restart from now */
+			stats->missed++;
+			clock_gettime(CLOCK_MONOTONIC, &next);
+			continue;
+		}
+		clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &next, NULL);
+	}
+	exit(0);
+}
+
+static void run(const char *name, unsigned int min, unsigned int max)
+{
+	unsigned long fmax = cpufreq_read("cpuinfo_max_freq");
+	unsigned long long start, t, ramp = 0, samples = 0;
+	unsigned long long total = 0, dt;
+	struct freq_states before, after;
+	double freq_sum = 0, energy = 0;
+	struct run_stats *stats;
+	unsigned long freq;
+	int i, status;
+	pid_t pid;
+
+	stats = mmap(NULL, sizeof(*stats), PROT_READ | PROT_WRITE,
+		     MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+	if (stats == MAP_FAILED)
+		fail("mmap: %s\n", strerror(errno));
+	memset(stats, 0, sizeof(*stats));
+
+	/* start from an idle CPU */
+	sleep(1);
+	states_read(&before);
+	start = now_us();
+	pid = fork();
+	if (pid < 0)
+		fail("fork: %s\n", strerror(errno));
+	if (!pid)
+		periodic_task(min, max, stats);
+
+	while (waitpid(pid, &status, WNOHANG) == 0) {
+		t = now_us();
+		freq = cpufreq_read("scaling_cur_freq");
+		if (!ramp && freq * 10 >= fmax * 9)
+			ramp = t - start;
+		freq_sum += freq;
+		samples++;
+		usleep(1000);
+	}
+	if (!WIFEXITED(status) || WEXITSTATUS(status))
+		fail("%s: periodic task failed\n", name);
+	states_read(&after);
+
+	for (i = 0; i < before.nr && i < after.nr; i++) {
+		dt = after.time[i] - before.time[i];
+		total += dt;
+		energy += dt * ((double)after.freq[i] / fmax) *
+			  ((double)after.freq[i] / fmax) *
+			  ((double)after.freq[i] / fmax);
+	}
+
+	printf("%-6s [%4u, %4u] ", name, min, max);
+	if (ramp)
+		printf("ramp %6.1f ms ", ramp / 1000.0);
+	else
+		printf("ramp      - ms ");
+	printf("avg %7.0f MHz missed %5ld/%-5ld ",
+	       samples ? freq_sum / samples / 1000 : 0, stats->missed,
+	       stats->periods);
+	if (total)
+		printf("energy %5.1f%%\n", energy * 100 / total);
+	else
+		printf("energy     -\n");
+	munmap(stats, sizeof(*stats));
+}
+
+int main(int argc, char **argv)
+{
+	int nr_cpus = sysconf(_SC_NPROCESSORS_ONLN);
+	char path[128], gov[32];
+	int c;
+
+	while ((c = getopt(argc, argv, "c:d:p:t:")) != -1) {
+		switch (c) {
+		case 'c':
+			cfg_cpu = atoi(optarg);
+			break;
+		case 'd':
+			cfg_duty = atoi(optarg);
+			break;
+		case 'p':
+			cfg_period_us = strtol(optarg, NULL, 0);
+			break;
+		case 't':
+			cfg_seconds = atoi(optarg);
+			break;
+		default:
+			fail("usage: %s [-c cpu] [-d duty%%] [-p period_us] [-t seconds]\n",
+			     argv[0]);
+		}
+	}
+	if (cfg_cpu < 0 || cfg_cpu >= nr_cpus || cfg_duty <= 0 ||
+	    cfg_duty > 100 || cfg_period_us <= 0 || cfg_seconds <= 0)
+		fail("bad arguments\n");
+
+	snprintf(cpufreq, sizeof(cpufreq),
+		 "/sys/devices/system/cpu/cpu%d/cpufreq", cfg_cpu);
+	snprintf(path, sizeof(path), "%s/scaling_governor", cpufreq);
+	if (uclamp_set(0, 0, SCHED_CAPACITY_SCALE) ||
+	    file_read(path, gov, sizeof(gov)) < 0) {
+		printf("uclamp_bench: needs util clamps and cpufreq, skipping\n");
+		return KSFT_SKIP;
+	}
+	if (strcmp(gov, "schedutil\n"))
+		printf("uclamp_bench: CPU %d runs %s", cfg_cpu, gov);
+
+	pin_to_cpu(cfg_cpu);
+	calibrate();
+	/* sample from another CPU, if any */
+	pin_to_cpu((cfg_cpu + 1) % nr_cpus);
+
+	printf("CPU %d, %d%% of %ld us periods for %d s\n", cfg_cpu, cfg_duty,
+	       cfg_period_us, cfg_seconds);
+	run("none", 0, SCHED_CAPACITY_SCALE);
+	run("boost", SCHED_CAPACITY_SCALE, SCHED_CAPACITY_SCALE);
+	run("cap", 0, SCHED_CAPACITY_SCALE / 4);
+	return 0;
+}
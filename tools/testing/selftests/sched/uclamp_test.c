@@ -0,0 +1,266 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * Tests for the util clamp interfaces: the sched_util_{min,max} fields of
+ * sched_setattr() and sched_getattr() and their validation, the
+ * kernel/sched_util_clamp_{min,max} sysctls and the cpu.uclamp.{min,max}
+ * files of a cgroup v2 group.
+ */
+
+#include <sys/resource.h>
+#include <sys/stat.h>
+
+#include "sched_common.h"
+
+#define SYSCTL_MIN	"/proc/sys/kernel/sched_util_clamp_min"
+#define SYSCTL_MAX	"/proc/sys/kernel/sched_util_clamp_max"
+
+static void check_clamps(unsigned int min, unsigned int max)
+{
+	struct sched_attr_ext attr = {};
+
+	if (sched_getattr_ext(0, &attr, sizeof(attr)))
+		fail("sched_getattr: %s\n", strerror(errno));
+	if (attr.size != sizeof(attr))
+		fail("sched_getattr size %u\n", attr.size);
+	if (attr.sched_util_min != min || attr.sched_util_max != max)
+		fail("clamps [%u, %u] instead of [%u, %u]\n",
+		     attr.sched_util_min, attr.sched_util_max, min, max);
+}
+
+static void test_attr(void)
+{
+	struct sched_attr_ext attr = {};
+
+	check_clamps(0, SCHED_CAPACITY_SCALE);
+
+	if (setpriority(PRIO_PROCESS, 0, 5))
+		fail("setpriority: %s\n", strerror(errno));
+	if (uclamp_set(0, 256, 512))
+		fail("sched_setattr: %s\n", strerror(errno));
+	check_clamps(256, 512);
+
+	/* the policy and nice value are kept */
+	if (sched_getattr_ext(0, &attr, sizeof(attr)))
+		fail("sched_getattr: %s\n", strerror(errno));
+	if (attr.sched_policy != SCHED_NORMAL || attr.sched_nice != 5)
+		fail("policy %u nice %d after a clamp change\n",
+		     attr.sched_policy, attr.sched_nice);
+
+	/* a clamp only is changed */
+	attr.size = sizeof(attr);
+	attr.sched_flags = SCHED_FLAG_KEEP_ALL | SCHED_FLAG_UTIL_CLAMP_MAX;
+	attr.sched_util_max = 768;
+	if (sched_setattr_ext(0, &attr))
+		fail("sched_setattr: %s\n", strerror(errno));
+	check_clamps(256, 768);
+
+	/* the clamps are kept across a policy change */
+	memset(&attr, 0, sizeof(attr));
+	attr.size = sizeof(attr);
+	attr.sched_policy = SCHED_BATCH;
+	attr.sched_nice = 5;
+	if (sched_setattr_ext(0, &attr))
+		fail("sched_setattr SCHED_BATCH: %s\n", strerror(errno));
+	check_clamps(256, 768);
+
+	/* old binaries read the fields they know of */
+	memset(&attr, 0xff, sizeof(attr));
+	if (sched_getattr_ext(0, &attr, ATTR_SIZE_VER0))
+		fail("sched_getattr of VER0: %s\n", strerror(errno));
+	if (attr.size != ATTR_SIZE_VER0 || attr.sched_util_min != ~0U)
+		fail("sched_getattr of VER0 wrote %u bytes\n", attr.size);
+
+	if (uclamp_set(0, 0, SCHED_CAPACITY_SCALE))
+		fail("sched_setattr: %s\n", strerror(errno));
+	check_clamps(0, SCHED_CAPACITY_SCALE);
+}
+
+static void expect_einval(const char *what, struct sched_attr_ext *attr)
+{
+	if (!sched_setattr_ext(0, attr) || errno != EINVAL)
+		fail("%s accepted\n", what);
+}
+
+static void test_errors(void)
+{
+	struct sched_attr_ext attr = {
+		.size		= sizeof(attr),
+		.sched_flags	= SCHED_FLAG_KEEP_ALL | SCHED_FLAG_UTIL_CLAMP,
+	};
+
+	attr.sched_util_min = 512;
+	attr.sched_util_max = 256;
+	expect_einval("min above max", &attr);
+
+	attr.sched_util_min = 0;
+	attr.sched_util_max = SCHED_CAPACITY_SCALE + 1;
+	expect_einval("max above the capacity scale", &attr);
+
+	/* min is checked against the current max */
+	if (uclamp_set(0, 0, 256))
+		fail("sched_setattr: %s\n", strerror(errno));
+	attr.sched_flags = SCHED_FLAG_KEEP_ALL | SCHED_FLAG_UTIL_CLAMP_MIN;
+	attr.sched_util_min = 512;
+	expect_einval("min above the current max", &attr);
+
+	/* the clamps need a VER1 sched_attr */
+	attr.size = ATTR_SIZE_VER0;
+	attr.sched_util_min = 128;
+	expect_einval("clamps in a VER0 sched_attr", &attr);
+
+	check_clamps(0, 256);
+	if (uclamp_set(0, 0, SCHED_CAPACITY_SCALE))
+		fail("sched_setattr: %s\n", strerror(errno));
+}
+
+static void test_sysctl(void)
+{
+	char min[16], max[16];
+	int err;
+
+	if (file_read(SYSCTL_MIN, min, sizeof(min)) < 0 ||
+	    file_read(SYSCTL_MAX, max, sizeof(max)) < 0) {
+		printf("test_sysctl: no sched_util_clamp sysctls, skipping\n");
+		return;
+	}
+
+	err = file_write(SYSCTL_MAX, "1025");
+	if (err != -EINVAL)
+		fail("sched_util_clamp_max above the capacity scale: %s\n",
+		     strerror(-err));
+	err = file_write(SYSCTL_MIN, "1024");
+	if (!err && atoi(max) < 1024)
+		fail("sched_util_clamp_min above sched_util_clamp_max\n");
+	if (file_write(SYSCTL_MIN, min) || file_write(SYSCTL_MAX, max))
+		fail("cannot restore the sched_util_clamp sysctls\n");
+}
+
+static void cgroup_expect(const char *file, const char *val,
+			  int err, const char *read)
+{
+	char path[128], buf[32];
+	int ret;
+
+	snprintf(path, sizeof(path), "%s/uclamp_test/%s", cgroup, file);
+	ret = file_write(path, val);
+	if (ret != err)
+		fail("%s of \"%s\": %s\n", file, val, strerror(-ret));
+	if (file_read(path, buf, sizeof(buf)) < 0)
+		fail("read of %s: %s\n", file, strerror(errno));
+	if (strcmp(buf, read))
+		fail("%s reads \"%s\" instead of \"%s\"\n", file, buf, read);
+}
+
+/* The effective clamp of the caller, -1 without /proc/self/sched */
+static int effective_clamp(const char *name)
+{
+	char buf[8192], key[64], *p;
+
+	if (file_read("/proc/self/sched", buf, sizeof(buf)) < 0)
+		return -1;
+	snprintf(key, sizeof(key), "\neffective uclamp.%s", name);
+	p = strstr(buf, key);
+	if (!p || !(p = strchr(p, ':')))
+		return -1;
+	return atoi(p + 1);
+}
+
+static void check_effective(unsigned int min, unsigned int max,
+			    int eff_min, int eff_max)
+{
+	if (uclamp_set(0, min, max))
+		fail("sched_setattr: %s\n", strerror(errno));
+	if (effective_clamp("min") != eff_min ||
+	    effective_clamp("max") != eff_max)
+		fail("clamps %u..%u in the group: effective %d..%d, not %d..%d\n",
+		     min, max, effective_clamp("min"), effective_clamp("max"),
+		     eff_min, eff_max);
+}
+
+/*
+ * The group's min is a protection and its max a limit: a task's request
+ * is clamped between them, a boost above the group's min is kept.
+ */
+static void test_cgroup_effective(void)
+{
+	char path[128], pid[16];
+
+	if (effective_clamp("min") < 0) {
+		printf("test_cgroup: no /proc/self/sched, skipping the effective clamps\n");
+		return;
+	}
+	snprintf(pid, sizeof(pid), "%d", getpid());
+	snprintf(path, sizeof(path), "%s/uclamp_test/cgroup.procs", cgroup);
+	if (file_write(path, pid))
+		fail("cannot join the group: %s\n", strerror(errno));
+
+	cgroup_expect("cpu.uclamp.min", "25", 0, "25.00\n");
+	cgroup_expect("cpu.uclamp.max", "50", 0, "50.00\n");
+	check_effective(0, SCHED_CAPACITY_SCALE, 256, 512);
+	check_effective(128, 384, 256, 384);
+	check_effective(384, 384, 384, 384);
+	check_effective(768, SCHED_CAPACITY_SCALE, 512, 512);
+	cgroup_expect("cpu.uclamp.max", "max", 0, "max\n");
+	check_effective(768, SCHED_CAPACITY_SCALE, 768, SCHED_CAPACITY_SCALE);
+	cgroup_expect("cpu.uclamp.min", "0", 0, "0.00\n");
+	check_effective(0, SCHED_CAPACITY_SCALE, 0, SCHED_CAPACITY_SCALE);
+
+	snprintf(path, sizeof(path), "%s/cgroup.procs", cgroup);
+	if (file_write(path, pid))
+		fail("cannot leave the group: %s\n", strerror(errno));
+}
+
+static void test_cgroup(void)
+{
+	char path[128];
+
+	if (cgroup_find()) {
+		printf("test_cgroup: no cgroup v2, skipping\n");
+		return;
+	}
+	snprintf(path, sizeof(path), "%s/cgroup.subtree_control", cgroup);
+	if (file_write(path, "+cpu")) {
+		printf("test_cgroup: no cpu controller, skipping\n");
+		return;
+	}
+	snprintf(path, sizeof(path), "%s/uclamp_test", cgroup);
+	if (mkdir(path, 0755) && errno != EEXIST)
+		fail("mkdir %s: %s\n", path, strerror(errno));
+	snprintf(path, sizeof(path), "%s/uclamp_test/cpu.uclamp.min", cgroup);
+	if (access(path, F_OK)) {
+		printf("test_cgroup: no cpu.uclamp.min, skipping\n");
+		goto out;
+	}
+
+	cgroup_expect("cpu.uclamp.min", "0", 0, "0.00\n");
+	cgroup_expect("cpu.uclamp.max", "max", 0, "max\n");
+	cgroup_expect("cpu.uclamp.min", "12.34", 0, "12.34\n");
+	cgroup_expect("cpu.uclamp.max", "50.5", 0, "50.50\n");
+	cgroup_expect("cpu.uclamp.max", "101", -ERANGE, "50.50\n");
+	cgroup_expect("cpu.uclamp.max", "1.234", -EINVAL, "50.50\n");
+	cgroup_expect("cpu.uclamp.max", "abc", -EINVAL, "50.50\n");
+	cgroup_expect("cpu.uclamp.max", "100", 0, "max\n");
+	cgroup_expect("cpu.uclamp.min", "0", 0, "0.00\n");
+	test_cgroup_effective();
+out:
+	snprintf(path, sizeof(path), "%s/uclamp_test", cgroup);
+	rmdir(path);
+}
+
+int main(void)
+{
+	if (uclamp_set(0, 0, SCHED_CAPACITY_SCALE)) {
+		printf("uclamp_test: no util clamp support, skipping\n");
+		return KSFT_SKIP;
+	}
+
+	test_attr();
+	test_errors();
+	if (!geteuid()) {
+		test_sysctl();
+		test_cgroup();
+	}
+
+	printf("uclamp_test: OK\n");
+	return 0;
+}
@@ -0,0 +1,173 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * Latency of fork and exec from a big process, with and without the page
+ * tables and the fd table shared copy-on-write (PR_SET_LAZY_FORK).
+ *
+ * For each size of -m (default 100, 512, 1024 and 2048 MiB), the bench
+ * maps and touches that much anonymous memory and, with -f files open
+ * (default 1000), forks -n times (default 20) a child that execs
+ * /bin/true, or just exits without it. Reports the average time fork
+ * takes in the parent and the time until the child is reaped, with
+ * nothing shared, the fd table, the page tables and both. The page
+ * tables are only shared with CONFIG_FORK_SHARE_PTE, the fd table once
+ * it has outgrown the one embedded in files_struct (64 files).
+ *
+ * Usage: fork_bench [-m MiB[,MiB...]] [-f files] [-n rounds]
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <getopt.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/prctl.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "../kselftest.h"
+
+#ifndef PR_SET_LAZY_FORK
+#define PR_SET_LAZY_FORK	79
+#define PR_GET_LAZY_FORK	80
+# define PR_LAZY_FORK_PTE	(1UL << 0)
+# define PR_LAZY_FORK_FILES	(1UL << 1)
+#endif
+
+#define MAX_SIZES	16
+
+static long cfg_sizes[MAX_SIZES] = { 100, 512, 1024, 2048 };
+static int cfg_nr_sizes = 4;
+static int cfg_files = 1000;
+static int cfg_rounds = 20;
+
+static unsigned long long now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static void parse_sizes(char *arg)
+{
+	char *tok;
+
+	cfg_nr_sizes = 0;
+	for (tok = strtok(arg, ","); tok; tok = strtok(NULL, ",")) {
+		if (cfg_nr_sizes == MAX_SIZES)
+			ksft_exit_fail_msg("at most %d sizes\n", MAX_SIZES);
+		cfg_sizes[cfg_nr_sizes++] = strtol(tok, NULL, 0);
+	}
+}
+
+static void run(const char *name, unsigned long flags)
+{
+	unsigned long long start, forked = 0, reaped = 0;
+	int i, status;
+	pid_t pid;
+
+	if (prctl(PR_SET_LAZY_FORK, flags, 0, 0, 0))
+		ksft_exit_fail_msg("PR_SET_LAZY_FORK: %s\n", strerror(errno));
+
+	for (i = 0; i < cfg_rounds; i++) {
+		start = now_ns();
+		pid = fork();
+		if (pid < 0)
+			ksft_exit_fail_msg("fork: %s\n", strerror(errno));
+		if (!pid) {
+			execl("/bin/true", "true", (char *)NULL);
+			_exit(0);
+		}
+		forked += now_ns() - start;
+		if (waitpid(pid, &status, 0) != pid || !WIFEXITED(status) ||
+		    WEXITSTATUS(status))
+			ksft_exit_fail_msg("child failed\n");
+		reaped += now_ns() - start;
+	}
+
+	printf("  %-8s fork %10.1f us  fork+exec+exit %10.1f us\n", name,
+	       forked / 1000.0 / cfg_rounds, reaped / 1000.0 / cfg_rounds);
+}
+
+int main(int argc, char **argv)
+{
+	int c, i, fd, pte;
+	struct rlimit rlim;
+	size_t len;
+	char *p;
+
+	while ((c = getopt(argc, argv, "m:f:n:")) != -1) {
+		switch (c) {
+		case 'm':
+			parse_sizes(optarg);
+			break;
+		case 'f':
+			cfg_files = atoi(optarg);
+			break;
+		case 'n':
+			cfg_rounds = atoi(optarg);
+			break;
+		default:
+			ksft_exit_fail_msg("usage: %s [-m MiB[,MiB...]] [-f files] [-n rounds]\n",
+					   argv[0]);
+		}
+	}
+	if (!cfg_nr_sizes || cfg_files < 0 || cfg_rounds <= 0)
+		ksft_exit_fail_msg("bad arguments\n");
+	for (i = 0; i < cfg_nr_sizes; i++)
+		if (cfg_sizes[i] <= 0)
+			ksft_exit_fail_msg("bad size %ld\n", cfg_sizes[i]);
+
+	if (prctl(PR_SET_LAZY_FORK, 0, 0, 0, 0)) {
+		printf("fork_bench: no PR_SET_LAZY_FORK, skipping\n");
+		return KSFT_SKIP;
+	}
+	pte = !prctl(PR_SET_LAZY_FORK, PR_LAZY_FORK_PTE, 0, 0, 0);
+
+	if (getrlimit(RLIMIT_NOFILE, &rlim))
+		ksft_exit_fail_msg("getrlimit: %s\n", strerror(errno));
+	if (rlim.rlim_cur < (rlim_t)cfg_files + 64) {
+		rlim.rlim_cur = cfg_files + 64;
+		if (rlim.rlim_max < rlim.rlim_cur)
+			rlim.rlim_max = rlim.rlim_cur;
+		if (setrlimit(RLIMIT_NOFILE, &rlim))
+			ksft_exit_fail_msg("cannot open %d files\n", cfg_files);
+	}
+	for (i = 0; i < cfg_files; i++) {
+		fd = open("/dev/null", O_RDONLY | (i & 1 ? O_CLOEXEC : 0));
+		if (fd < 0)
+			ksft_exit_fail_msg("open: %s\n", strerror(errno));
+	}
+
+	printf("%d files open, half of them close-on-exec, %d rounds\n",
+	       cfg_files, cfg_rounds);
+	for (i = 0; i < cfg_nr_sizes; i++) {
+		len = (size_t)cfg_sizes[i] << 20;
+		p = mmap(NULL, len, PROT_READ | PROT_WRITE,
+			 MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+		if (p == MAP_FAILED) {
+			printf("%ld MiB: mmap: %s, skipping\n", cfg_sizes[i],
+			       strerror(errno));
+			continue;
+		}
+		/* Page tables for all of it, without huge pages */
+		madvise(p, len, MADV_NOHUGEPAGE);
+		memset(p, 1, len);
+
+		printf("%ld MiB\n", cfg_sizes[i]);
+		run("eager", 0);
+		run("files", PR_LAZY_FORK_FILES);
+		if (pte) {
+			run("pte", PR_LAZY_FORK_PTE);
+			run("both", PR_LAZY_FORK_PTE | PR_LAZY_FORK_FILES);
+		}
+		munmap(p, len);
+	}
+
+	prctl(PR_SET_LAZY_FORK, 0, 0, 0, 0);
+	return 0;
+}
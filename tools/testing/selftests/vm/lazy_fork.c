@@ -0,0 +1,859 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * Functional tests for PR_SET_LAZY_FORK: whatever one side of a fork
+ * does to memory behind shared page tables or to a shared fd table must
+ * stay invisible to the other side.
+ *
+ * Each test forks a pair with the flag set. One side (the actor, the
+ * parent or the child) writes, munmaps, mprotects or exits, or closes,
+ * dup2s, sets close-on-exec or execs; then the other side checks it
+ * still sees the state from before the fork and changes it itself, and
+ * the actor checks it sees its own change and not the other side's.
+ * Both sides report to the test through a pipe, so a side that crashes
+ * or hangs fails the test.
+ *
+ * The other "pte" tests have the actor drive a kernel path that walks
+ * the page tables of others while a table is shared: khugepaged, KSM,
+ * migration with move_pages(), reclaim to swap and swapoff under a memory
+ * cgroup limit, and the OOM reaper.  They need root, and skip where the
+ * knob, a second NUMA node or a memory cgroup is missing.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <setjmp.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/prctl.h>
+#include <sys/stat.h>
+#include <sys/swap.h>
+#include <sys/syscall.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "../kselftest.h"
+
+#ifndef PR_SET_LAZY_FORK
+#define PR_SET_LAZY_FORK	79
+#define PR_GET_LAZY_FORK	80
+# define PR_LAZY_FORK_PTE	(1UL << 0)
+# define PR_LAZY_FORK_FILES	(1UL << 1)
+#endif
+
+/* Two PTE tables' worth, so a partial munmap leaves one whole table */
+#define PMD_SIZE	(2UL << 20)
+#define AREA_SIZE	(2 * PMD_SIZE)
+/* More than fit in the fd table embedded in files_struct */
+#define NR_FILES	128
+#define TIMEOUT		10
+
+#ifndef MPOL_MF_MOVE
+#define MPOL_MF_MOVE	(1 << 1)
+#endif
+
+#define SWAPFILE	"lazy_fork.swap"
+#define SWAPFILE_SIZE	(16UL << 20)
+#define THP		"/sys/kernel/mm/transparent_hugepage/"
+#define KSM		"/sys/kernel/mm/ksm/"
+
+struct lazy_test {
+	const char *name;
+	unsigned long flags;
+	int (*setup)(void);
+	/* Actor; does not return if it exits or execs */
+	int (*act)(void);
+	/* The other side, once the actor is done */
+	int (*observe)(void);
+	/* Actor, once the other side is done */
+	int (*verify)(void);
+	/* Why the test cannot run here, if it cannot */
+	const char *(*skip)(void);
+	/* The test, once the pair is gone */
+	void (*cleanup)(void);
+};
+
+static char *area;
+static size_t page_size;
+static int test_fd;
+static int zero_fd;
+static dev_t null_rdev, zero_rdev;
+static int pte_supported;
+static int result_fd = -1;
+static int sync_fd = -1;
+static sigjmp_buf fault_jmp;
+
+static void report(int ok)
+{
+	if (write(result_fd, ok ? "y" : "n", 1) != 1)
+		_exit(1);
+}
+
+static void fill(char *p, size_t len, char val)
+{
+	memset(p, val, len);
+}
+
+static int check(char *p, size_t len, char val)
+{
+	size_t off;
+
+	for (off = 0; off < len; off += page_size)
+		if (p[off] != val || p[off + page_size - 1] != val)
+			return 0;
+	return 1;
+}
+
+static void fault_handler(int sig)
+{
+	siglongjmp(fault_jmp, 1);
+}
+
+static int write_faults(char *p)
+{
+	int faulted = 1;
+
+	signal(SIGSEGV, fault_handler);
+	if (!sigsetjmp(fault_jmp, 1)) {
+		*(volatile char *)p = 'A';
+		faulted = 0;
+	}
+	signal(SIGSEGV, SIG_DFL);
+	return faulted;
+}
+
+static int setup_area(void)
+{
+	char *p;
+
+	p = mmap(NULL, AREA_SIZE + PMD_SIZE, PROT_READ | PROT_WRITE,
+		 MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (p == MAP_FAILED)
+		return 0;
+	area = (char *)(((unsigned long)p + PMD_SIZE - 1) & ~(PMD_SIZE - 1));
+	/* PTE tables, not huge pages */
+	madvise(area, AREA_SIZE, MADV_NOHUGEPAGE);
+	fill(area, AREA_SIZE, 'P');
+	return 1;
+}
+
+static int observe_area(void)
+{
+	if (!check(area, AREA_SIZE, 'P'))
+		return 0;
+	fill(area, AREA_SIZE, 'O');
+	return check(area, AREA_SIZE, 'O');
+}
+
+static int act_write(void)
+{
+	fill(area, AREA_SIZE, 'A');
+	return 1;
+}
+
+static int verify_write(void)
+{
+	return check(area, AREA_SIZE, 'A');
+}
+
+static int act_munmap(void)
+{
+	/* Half of the first table, the second one stays whole */
+	return !munmap(area, PMD_SIZE / 2);
+}
+
+static int verify_munmap(void)
+{
+	return check(area + PMD_SIZE / 2, AREA_SIZE - PMD_SIZE / 2, 'P');
+}
+
+static int act_mprotect(void)
+{
+	return !mprotect(area, AREA_SIZE, PROT_READ);
+}
+
+static int verify_mprotect(void)
+{
+	return check(area, AREA_SIZE, 'P') && write_faults(area) &&
+	       write_faults(area + AREA_SIZE - page_size);
+}
+
+static int act_exit(void)
+{
+	report(1);
+	_exit(0);
+}
+
+static int write_str(const char *path, const char *val)
+{
+	ssize_t len = strlen(val);
+	int fd, ok;
+
+	fd = open(path, O_WRONLY);
+	if (fd < 0)
+		return 0;
+	ok = write(fd, val, len) == len;
+	close(fd);
+	return ok;
+}
+
+static int read_str(const char *path, char *buf, size_t size)
+{
+	ssize_t len;
+	int fd;
+
+	fd = open(path, O_RDONLY);
+	if (fd < 0)
+		return 0;
+	len = read(fd, buf, size - 1);
+	close(fd);
+	if (len <= 0)
+		return 0;
+	buf[len] = '\0';
+	return 1;
+}
+
+static long read_long(const char *path)
+{
+	char buf[64];
+
+	return read_str(path, buf, sizeof(buf)) ? atol(buf) : -1;
+}
+
+/* Wait for a full_scans counter to go up by two: a whole pass over the area */
+static int wait_full_scans(const char *path)
+{
+	long start = read_long(path);
+	int i;
+
+	for (i = 0; start >= 0 && i < 80; i++) {
+		if (read_long(path) >= start + 2)
+			return 1;
+		usleep(100000);
+	}
+	return 0;
+}
+
+/* The knobs the tests turn, restored once each test is done */
+static struct {
+	const char *path;
+	const char *val;
+	char orig[32];
+} knobs[] = {
+	{ THP "khugepaged/scan_sleep_millisecs", "10" },
+	{ KSM "sleep_millisecs", "10" },
+	{ KSM "pages_to_scan", "4096" },
+	{ KSM "run", "1" },
+};
+
+static void save_knobs(void)
+{
+	int i;
+
+	for (i = 0; i < sizeof(knobs) / sizeof(knobs[0]); i++)
+		if (!read_str(knobs[i].path, knobs[i].orig,
+			      sizeof(knobs[i].orig)))
+			knobs[i].orig[0] = '\0';
+}
+
+static int set_knobs(const char *prefix)
+{
+	int i;
+
+	for (i = 0; i < sizeof(knobs) / sizeof(knobs[0]); i++)
+		if (!strncmp(knobs[i].path, prefix, strlen(prefix)) &&
+		    !write_str(knobs[i].path, knobs[i].val))
+			return 0;
+	return 1;
+}
+
+static void restore_knobs(void)
+{
+	int i;
+
+	for (i = 0; i < sizeof(knobs) / sizeof(knobs[0]); i++)
+		if (knobs[i].orig[0])
+			write_str(knobs[i].path, knobs[i].orig);
+}
+
+static const char *skip_khugepaged(void)
+{
+	char buf[64];
+
+	if (!read_str(THP "enabled", buf, sizeof(buf)) ||
+	    strstr(buf, "[never]"))
+		return "no transparent huge pages";
+	if (access(knobs[0].path, W_OK))
+		return "khugepaged not tunable";
+	return NULL;
+}
+
+static int setup_khugepaged(void)
+{
+	return set_knobs(THP) && setup_area();
+}
+
+/* khugepaged must leave a shared table alone, not collapse and free it */
+static int act_khugepaged(void)
+{
+	return !madvise(area, AREA_SIZE, MADV_HUGEPAGE) &&
+	       wait_full_scans(THP "khugepaged/full_scans");
+}
+
+static const char *skip_ksm(void)
+{
+	return access(KSM "run", W_OK) ? "KSM not tunable" : NULL;
+}
+
+static int setup_ksm(void)
+{
+	return set_knobs(KSM) && setup_area();
+}
+
+/* The area is all the same page: KSM write-protects and merges it */
+static int act_ksm(void)
+{
+	return !madvise(area, AREA_SIZE, MADV_MERGEABLE) &&
+	       wait_full_scans(KSM "full_scans");
+}
+
+static const char *skip_migrate(void)
+{
+	if (access("/sys/devices/system/node/node1", F_OK))
+		return "a single NUMA node";
+	return NULL;
+}
+
+/* Move the area to the other node, retrying while the table is copied */
+static int act_migrate(void)
+{
+	unsigned long i, count = AREA_SIZE / page_size;
+	int *nodes, *status, node, ok = 0, tries;
+	void **pages;
+
+	pages = calloc(count, sizeof(*pages));
+	nodes = calloc(count, sizeof(*nodes));
+	status = calloc(count, sizeof(*status));
+	if (!pages || !nodes || !status)
+		return 0;
+	for (i = 0; i < count; i++)
+		pages[i] = area + i * page_size;
+	if (syscall(__NR_move_pages, 0, 1, pages, NULL, status, 0))
+		return 0;
+	node = !status[0];
+	for (i = 0; i < count; i++)
+		nodes[i] = node;
+
+	for (tries = 0; !ok && tries < 50; tries++) {
+		if (tries)
+			usleep(100000);
+		if (syscall(__NR_move_pages, 0, count, pages, nodes, status,
+			    MPOL_MF_MOVE) < 0)
+			break;
+		for (ok = 1, i = 0; i < count; i++)
+			ok &= status[i] == node;
+	}
+	return ok;
+}
+
+static char memcg_path[64];
+static int memcg_v2;
+
+static void find_memcg(void)
+{
+	char buf[256];
+
+	if (!access("/sys/fs/cgroup/memory/memory.limit_in_bytes", F_OK)) {
+		strcpy(memcg_path, "/sys/fs/cgroup/memory/lazy_fork");
+	} else if (read_str("/sys/fs/cgroup/cgroup.subtree_control",
+			    buf, sizeof(buf)) && strstr(buf, "memory")) {
+		strcpy(memcg_path, "/sys/fs/cgroup/lazy_fork");
+		memcg_v2 = 1;
+	}
+}
+
+static int memcg_write(const char *file, const char *val)
+{
+	char path[PATH_MAX];
+
+	snprintf(path, sizeof(path), "%s/%s", memcg_path, file);
+	return write_str(path, val);
+}
+
+/* Move the caller to a memory cgroup of its own, before the area is faulted */
+static int memcg_join(void)
+{
+	char pid[16];
+
+	if (mkdir(memcg_path, 0755) && errno != EEXIST)
+		return 0;
+	snprintf(pid, sizeof(pid), "%d", getpid());
+	return memcg_write("cgroup.procs", pid);
+}
+
+/* A limit that reclaims down to it but does not OOM, or none */
+static int memcg_limit(const char *val)
+{
+	if (!val)
+		val = memcg_v2 ? "max" : "-1";
+	return memcg_write(memcg_v2 ? "memory.high" : "memory.limit_in_bytes",
+			   val);
+}
+
+static const char *skip_memcg(void)
+{
+	if (getuid())
+		return "not root";
+	if (!memcg_path[0])
+		return "no memory cgroup";
+	return NULL;
+}
+
+static void cleanup_memcg(void)
+{
+	rmdir(memcg_path);
+}
+
+static long vm_swap(void)
+{
+	char buf[4096], *p;
+
+	if (!read_str("/proc/self/status", buf, sizeof(buf)))
+		return -1;
+	p = strstr(buf, "VmSwap:");
+	return p ? atol(p + strlen("VmSwap:")) : -1;
+}
+
+/* Push the area out to swap with a limit under its size, then lift it */
+static int swap_out_area(void)
+{
+	int swapped = 0, tries;
+
+	for (tries = 0; !swapped && tries < 50; tries++) {
+		if (tries)
+			usleep(100000);
+		memcg_limit("2M");
+		swapped = vm_swap() > 0;
+	}
+	return memcg_limit(NULL) && swapped;
+}
+
+static int make_swapfile(void)
+{
+	static char zeros[65536];
+	unsigned int *info;
+	char *header;
+	size_t done;
+	int fd, ok;
+
+	fd = open(SWAPFILE, O_WRONLY | O_CREAT | O_TRUNC, 0600);
+	if (fd < 0)
+		return 0;
+	/* No holes in a swap file */
+	for (done = 0; done < SWAPFILE_SIZE; done += sizeof(zeros))
+		if (write(fd, zeros, sizeof(zeros)) != sizeof(zeros))
+			break;
+	header = calloc(1, page_size);
+	ok = done == SWAPFILE_SIZE && header;
+	if (ok) {
+		/* version, last_page, nr_badpages after the boot block */
+		info = (unsigned int *)(header + 1024);
+		info[0] = 1;
+		info[1] = SWAPFILE_SIZE / page_size - 1;
+		memcpy(header + page_size - 10, "SWAPSPACE2", 10);
+		ok = pwrite(fd, header, page_size, 0) == page_size &&
+		     !fsync(fd);
+	}
+	free(header);
+	close(fd);
+	return ok;
+}
+
+static int swap_on(void)
+{
+	return !swapon(SWAPFILE, SWAP_FLAG_PREFER | SWAP_FLAG_PRIO_MASK);
+}
+
+static const char *skip_swap(void)
+{
+	const char *reason = skip_memcg();
+
+	if (reason)
+		return reason;
+	if (!make_swapfile() || !swap_on()) {
+		unlink(SWAPFILE);
+		return "no swap file here";
+	}
+	swapoff(SWAPFILE);
+	return NULL;
+}
+
+static void cleanup_swap(void)
+{
+	swapoff(SWAPFILE);
+	unlink(SWAPFILE);
+	cleanup_memcg();
+}
+
+static int setup_swap(void)
+{
+	return swap_on() && memcg_join() && setup_area();
+}
+
+/* Reclaim has the shared table copied to unmap the pages of the area */
+static int act_swapout(void)
+{
+	return swap_out_area();
+}
+
+/* The table is shared with swap entries in it */
+static int setup_swapped(void)
+{
+	return setup_swap() && swap_out_area();
+}
+
+static int act_swapoff(void)
+{
+	return !swapoff(SWAPFILE);
+}
+
+/* Memory the memory cgroup cannot swap out, under a limit it will hit */
+static int setup_oom(void)
+{
+	if (mkdir(memcg_path, 0755) && errno != EEXIST)
+		return 0;
+	if (memcg_v2)
+		memcg_write("memory.swap.max", "0");
+	else if (!memcg_write("memory.swappiness", "0"))
+		return 0;
+	return memcg_join() && setup_area();
+}
+
+/* Get killed by the memory cgroup OOM killer, and reaped */
+static int act_oom(void)
+{
+	char *p;
+
+	report(1);
+	if (!write_str("/proc/self/oom_score_adj", "1000") ||
+	    !memcg_write(memcg_v2 ? "memory.max" : "memory.limit_in_bytes",
+			 "16M"))
+		_exit(1);
+	for (;;) {
+		p = mmap(NULL, PMD_SIZE, PROT_READ | PROT_WRITE,
+			 MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+		if (p == MAP_FAILED)
+			_exit(1);
+		fill(p, PMD_SIZE, 'A');
+	}
+}
+
+static int observe_oom(void)
+{
+	return memcg_write(memcg_v2 ? "memory.max" : "memory.limit_in_bytes",
+			   memcg_v2 ? "max" : "-1") && observe_area();
+}
+
+static int verify_area(void)
+{
+	return check(area, AREA_SIZE, 'P');
+}
+
+static int fd_is(int fd, dev_t rdev)
+{
+	struct stat st;
+
+	return !fstat(fd, &st) && S_ISCHR(st.st_mode) && st.st_rdev == rdev;
+}
+
+static int fd_closed(int fd)
+{
+	return fcntl(fd, F_GETFD) == -1 && errno == EBADF;
+}
+
+static int setup_files(void)
+{
+	struct stat st;
+	int i, fd;
+
+	for (i = 0; i < NR_FILES; i++) {
+		fd = open("/dev/null", O_RDONLY);
+		if (fd < 0)
+			return 0;
+		if (i == NR_FILES / 2)
+			test_fd = fd;
+	}
+	zero_fd = open("/dev/zero", O_RDONLY);
+	if (zero_fd < 0 || fstat(test_fd, &st))
+		return 0;
+	null_rdev = st.st_rdev;
+	if (fstat(zero_fd, &st))
+		return 0;
+	zero_rdev = st.st_rdev;
+	return 1;
+}
+
+static int act_close(void)
+{
+	return !close(test_fd);
+}
+
+static int observe_close(void)
+{
+	return fd_is(test_fd, null_rdev) && !close(test_fd + 1);
+}
+
+static int verify_close(void)
+{
+	return fd_closed(test_fd) && fd_is(test_fd + 1, null_rdev);
+}
+
+static int act_dup2(void)
+{
+	return dup2(zero_fd, test_fd) == test_fd;
+}
+
+static int observe_dup2(void)
+{
+	return fd_is(test_fd, null_rdev) &&
+	       dup2(zero_fd, test_fd + 1) == test_fd + 1;
+}
+
+static int verify_dup2(void)
+{
+	return fd_is(test_fd, zero_rdev) && fd_is(test_fd + 1, null_rdev);
+}
+
+static int act_cloexec(void)
+{
+	return !fcntl(test_fd, F_SETFD, FD_CLOEXEC) &&
+	       !ioctl(test_fd + 1, FIOCLEX);
+}
+
+static int observe_cloexec(void)
+{
+	return fcntl(test_fd, F_GETFD) == 0 &&
+	       fcntl(test_fd + 1, F_GETFD) == 0 &&
+	       !fcntl(test_fd + 2, F_SETFD, FD_CLOEXEC);
+}
+
+static int verify_cloexec(void)
+{
+	return fcntl(test_fd, F_GETFD) == FD_CLOEXEC &&
+	       fcntl(test_fd + 1, F_GETFD) == FD_CLOEXEC &&
+	       fcntl(test_fd + 2, F_GETFD) == 0;
+}
+
+static int setup_exec(void)
+{
+	return setup_files() && !fcntl(test_fd, F_SETFD, FD_CLOEXEC);
+}
+
+static int act_exec(void)
+{
+	char fd[16], sync[16], result[16];
+
+	snprintf(fd, sizeof(fd), "%d", test_fd);
+	snprintf(sync, sizeof(sync), "%d", sync_fd);
+	snprintf(result, sizeof(result), "%d", result_fd);
+	execl("/proc/self/exe", "lazy_fork", "exec-check", fd, sync, result,
+	      (char *)NULL);
+	return 0;
+}
+
+static int observe_exec(void)
+{
+	return fd_is(test_fd, null_rdev) &&
+	       fcntl(test_fd, F_GETFD) == FD_CLOEXEC &&
+	       fd_is(test_fd + 1, null_rdev);
+}
+
+/* What act_exec execs: test_fd is gone, the one after it is not */
+static int exec_check(char **argv)
+{
+	struct stat st;
+	int ok;
+
+	test_fd = atoi(argv[2]);
+	sync_fd = atoi(argv[3]);
+	result_fd = atoi(argv[4]);
+
+	ok = !stat("/dev/null", &st) && fd_closed(test_fd) &&
+	     fd_is(test_fd + 1, st.st_rdev);
+	report(ok);
+	return write(sync_fd, "x", 1) != 1;
+}
+
+static const struct lazy_test tests[] = {
+	{ "pte write", PR_LAZY_FORK_PTE, setup_area,
+	  act_write, observe_area, verify_write },
+	{ "pte munmap", PR_LAZY_FORK_PTE, setup_area,
+	  act_munmap, observe_area, verify_munmap },
+	{ "pte mprotect", PR_LAZY_FORK_PTE, setup_area,
+	  act_mprotect, observe_area, verify_mprotect },
+	{ "pte exit", PR_LAZY_FORK_PTE, setup_area,
+	  act_exit, observe_area, NULL },
+	{ "pte khugepaged", PR_LAZY_FORK_PTE, setup_khugepaged,
+	  act_khugepaged, observe_area, verify_area,
+	  skip_khugepaged, restore_knobs },
+	{ "pte ksm", PR_LAZY_FORK_PTE, setup_ksm,
+	  act_ksm, observe_area, verify_area,
+	  skip_ksm, restore_knobs },
+	{ "pte migrate", PR_LAZY_FORK_PTE, setup_area,
+	  act_migrate, observe_area, verify_area,
+	  skip_migrate },
+	{ "pte swap-out", PR_LAZY_FORK_PTE, setup_swap,
+	  act_swapout, observe_area, verify_area,
+	  skip_swap, cleanup_swap },
+	{ "pte swapoff", PR_LAZY_FORK_PTE, setup_swapped,
+	  act_swapoff, observe_area, verify_area,
+	  skip_swap, cleanup_swap },
+	{ "pte oom reaper", PR_LAZY_FORK_PTE, setup_oom,
+	  act_oom, observe_oom, NULL,
+	  skip_memcg, cleanup_memcg },
+	{ "files close", PR_LAZY_FORK_FILES, setup_files,
+	  act_close, observe_close, verify_close },
+	{ "files dup2", PR_LAZY_FORK_FILES, setup_files,
+	  act_dup2, observe_dup2, verify_dup2 },
+	{ "files cloexec", PR_LAZY_FORK_FILES, setup_files,
+	  act_cloexec, observe_cloexec, verify_cloexec },
+	{ "files exec", PR_LAZY_FORK_FILES, setup_exec,
+	  act_exec, observe_exec, NULL },
+};
+
+static void act_side(const struct lazy_test *t, int in, int out)
+{
+	char c;
+	int ok;
+
+	sync_fd = out;
+	ok = t->act();
+	if (write(out, "x", 1) != 1 || read(in, &c, 1) != 1)
+		ok = 0;
+	report(ok && t->verify && t->verify());
+}
+
+static void observe_side(const struct lazy_test *t, int in, int out)
+{
+	char c;
+	int ok;
+
+	/* A token, or EOF if the actor exited */
+	if (read(in, &c, 1) < 0)
+		ok = 0;
+	else
+		ok = t->observe();
+	if (write(out, "x", 1) != 1 && errno != EPIPE)
+		ok = 0;
+	report(ok);
+}
+
+/* The parent of the pair; runs in a child of the test */
+static void run_pair(const struct lazy_test *t, int actor_is_parent)
+{
+	int a2o[2], o2a[2];
+	pid_t pid;
+
+	if (!t->setup() || prctl(PR_SET_LAZY_FORK, t->flags, 0, 0, 0) ||
+	    pipe(a2o) || pipe(o2a)) {
+		report(0);
+		return;
+	}
+
+	pid = fork();
+	if (pid < 0) {
+		report(0);
+		return;
+	}
+	alarm(TIMEOUT);
+	if (!!pid == actor_is_parent) {
+		close(a2o[0]);
+		close(o2a[1]);
+		act_side(t, o2a[0], a2o[1]);
+	} else {
+		close(a2o[1]);
+		close(o2a[0]);
+		observe_side(t, a2o[0], o2a[1]);
+	}
+	if (pid)
+		waitpid(pid, NULL, 0);
+}
+
+static void run_test(const struct lazy_test *t, int actor_is_parent)
+{
+	const char *side = actor_is_parent ? "parent" : "child";
+	const char *reason;
+	int res[2], n = 0, ok = 0;
+	pid_t pid;
+	char c;
+
+	if ((t->flags & PR_LAZY_FORK_PTE) && !pte_supported) {
+		ksft_test_result_skip("%s from the %s: no CONFIG_FORK_SHARE_PTE\n",
+				      t->name, side);
+		return;
+	}
+	if (t->skip && (reason = t->skip())) {
+		ksft_test_result_skip("%s from the %s: %s\n",
+				      t->name, side, reason);
+		return;
+	}
+
+	if (pipe(res))
+		ksft_exit_fail_msg("pipe: %s\n", strerror(errno));
+	pid = fork();
+	if (pid < 0)
+		ksft_exit_fail_msg("fork: %s\n", strerror(errno));
+	if (!pid) {
+		close(res[0]);
+		result_fd = res[1];
+		run_pair(t, actor_is_parent);
+		_exit(0);
+	}
+	close(res[1]);
+	/* One result from each side; EOF once both are gone */
+	while (read(res[0], &c, 1) == 1) {
+		n++;
+		ok += c == 'y';
+	}
+	close(res[0]);
+	waitpid(pid, NULL, 0);
+	if (t->cleanup)
+		t->cleanup();
+
+	if (n == 2 && ok == 2)
+		ksft_test_result_pass("%s from the %s\n", t->name, side);
+	else
+		ksft_test_result_fail("%s from the %s\n", t->name, side);
+}
+
+int main(int argc, char **argv)
+{
+	int i;
+
+	if (argc == 5 && !strcmp(argv[1], "exec-check"))
+		return exec_check(argv);
+
+	ksft_print_header();
+	if (prctl(PR_SET_LAZY_FORK, 0, 0, 0, 0))
+		ksft_exit_skip("no PR_SET_LAZY_FORK\n");
+	pte_supported = !prctl(PR_SET_LAZY_FORK, PR_LAZY_FORK_PTE, 0, 0, 0);
+	prctl(PR_SET_LAZY_FORK, 0, 0, 0, 0);
+
+	page_size = sysconf(_SC_PAGESIZE);
+	save_knobs();
+	find_memcg();
+	/* The observer writes to an actor that may be gone */
+	signal(SIGPIPE, SIG_IGN);
+
+	for (i = 0; i < sizeof(tests) / sizeof(tests[0]); i++) {
+		run_test(&tests[i], 1);
+		run_test(&tests[i], 0);
+	}
+
+	ksft_print_cnts();
+	return ksft_get_fail_cnt() ? ksft_exit_fail() : ksft_exit_pass();
+}
@@ -0,0 +1,85 @@
+#!/bin/sh
+# SPDX-License-Identifier: GPL-2.0
+# Checks debugfs/workqueue/functions after queueing known work:
+#  - test_wq_stats runs test_wq_stats_fn a known number of times,
+#  - writing vm/stat_refresh runs refresh_vm_stats once per online cpu.
+
+# Kselftest framework requirement - SKIP code is 4.
+ksft_skip=4
+
+DEBUGFS=`grep -w debugfs /proc/mounts | head -1 | cut -d' ' -f2`
+if [ -z "$DEBUGFS" ]; then
+	mount -t debugfs none /sys/kernel/debug 2>/dev/null
+	DEBUGFS=/sys/kernel/debug
+fi
+FUNCS=$DEBUGFS/workqueue/functions
+
+if [ ! -r $FUNCS ]; then
+	echo "wq_stats: $FUNCS missing, CONFIG_WQ_STATS=n [SKIP]"
+	exit $ksft_skip
+fi
+
+fail() {
+	echo "wq_stats: $1 [FAIL]"
+	modprobe -q -r test_wq_stats
+	exit 1
+}
+
+# print field $2 of the entry of function $1, nothing if there is none
+field() {
+	awk -v fn="$1" -v f="$2" \
+		'$1 == fn { for (i = 2; i < NF; i++) if ($i == f) print $(i + 1) }' $FUNCS
+}
+
+# sum of the buckets of histogram $2 of the entry of function $1
+hist_sum() {
+	awk -v fn="$1" -v h="$2" '
+		$1 ~ /^[^ ]/ && !/^ / { cur = $1 }
+		cur == fn && $1 == h { for (i = 2; i <= NF; i++) s += $i }
+		END { print s + 0 }' $FUNCS
+}
+
+grep -q "^buckets <4 <16 <64" $FUNCS || fail "bad histogram header"
+grep -q "^dropped [0-9]*$" $FUNCS || fail "bad dropped counter"
+
+if [ -w /proc/sys/vm/stat_refresh ]; then
+	before=`field refresh_vm_stats count`
+	echo 1 > /proc/sys/vm/stat_refresh
+	after=`field refresh_vm_stats count`
+	cpus=`grep -c ^processor /proc/cpuinfo`
+	[ -n "$after" ] || fail "refresh_vm_stats has no entry"
+	[ $((after - ${before:-0})) -ge $cpus ] || \
+		fail "refresh_vm_stats ran $((after - ${before:-0})) times, expected $cpus"
+	echo "wq_stats: refresh_vm_stats [PASS]"
+fi
+
+modprobe -q -r test_wq_stats
+if ! modprobe -q test_wq_stats runs=16 delay_us=100; then
+	echo "wq_stats: test_wq_stats module missing [SKIP]"
+	exit $ksft_skip
+fi
+
+count=`field test_wq_stats_fn count`
+[ "$count" = 16 ] || fail "test_wq_stats_fn count is '$count', expected 16"
+# every run took at least 100us
+runtime=`field test_wq_stats_fn runtime`
+[ "$runtime" -ge 1600 ] || fail "test_wq_stats_fn runtime is ${runtime}us, expected >= 1600us"
+[ `hist_sum test_wq_stats_fn latency` -eq 16 ] || \
+	fail "test_wq_stats_fn latency histogram does not add up to 16"
+[ `hist_sum test_wq_stats_fn runtime` -eq 16 ] || \
+	fail "test_wq_stats_fn runtime histogram does not add up to 16"
+echo "wq_stats: test_wq_stats_fn [PASS]"
+
+modprobe -r test_wq_stats || fail "can't unload test_wq_stats"
+[ -z "`field test_wq_stats_fn count`" ] || \
+	fail "test_wq_stats_fn entry left after unload"
+grep -q "^0x" $FUNCS && fail "stale function address after unload"
+
+# the freed entry can be claimed again, the counts start over
+modprobe -q test_wq_stats runs=4 || fail "can't reload test_wq_stats"
+count=`field test_wq_stats_fn count`
+[ "$count" = 4 ] || fail "test_wq_stats_fn count is '$count' after reload, expected 4"
+modprobe -r test_wq_stats
+echo "wq_stats: module unload [PASS]"
+
+exit 0